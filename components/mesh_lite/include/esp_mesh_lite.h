@@ -17,6 +17,17 @@ extern "C"
 
 #define ROOT    (1)
 
+typedef enum {
+    MESH_LITE_MSG_ID_INVALID = 0,
+    MESH_LITE_MSG_ID_REPORT_NODE_INFO,
+    MESH_LITE_MSG_ID_REPORT_NODE_INFO_RESP,
+    MESH_LITE_MSG_ID_UPDATE_NODES_LIST,
+    MESH_LITE_MSG_ID_REPORT_OTA_PROGRESS,
+    MESH_LITE_MSG_ID_REPORT_OTA_PROGRESS_RESP,
+    MESH_LITE_MSG_ID_TIME_SYNC,
+    MESH_LITE_MSG_ID_TIME_SYNC_RESP,
+} esp_mesh_lite_msg_id_t;
+
 typedef enum {
     ESP_MESH_LITE_EVENT_NODE_JOIN = ESP_MESH_LITE_EVENT_OTA_MAX,
     ESP_MESH_LITE_EVENT_NODE_LEAVE,
@@ -49,18 +60,45 @@ typedef struct  esp_mesh_lite_node_info {
     uint8_t mac_addr[ETH_HWADDR_LEN];
 } esp_mesh_lite_node_info_t;
 
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+/**
+ * @brief Health summary that a node piggybacks on its node info report.
+ */
+typedef struct {
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+    int8_t parent_rssi;         /**< 0 on the root node */
+    uint8_t child_num;
+    uint16_t queue_depth;       /**< Filled in by the application, see esp_mesh_lite_set_health_cb() */
+    uint32_t queue_drops;       /**< Filled in by the application, see esp_mesh_lite_set_health_cb() */
+    uint32_t uptime;            /**< Seconds since boot of the node */
+    uint32_t update_time;       /**< Uptime of the root node in seconds when received, 0 if not reported yet */
+} esp_mesh_lite_node_health_t;
+
+/**
+ * @brief Callback to add application state, like queue depths, to the health summary before it is reported.
+ */
+typedef void (*esp_mesh_lite_health_cb_t)(esp_mesh_lite_node_health_t *health);
+#endif /* CONFIG_MESH_LITE_NODE_HEALTH_REPORT */
+
 typedef struct node_info_list {
     struct node_info_list* next;
     esp_mesh_lite_node_info_t* node;
     uint32_t ttl;
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+    esp_mesh_lite_node_health_t health;     /**< Only collected on the root node */
+#endif
 } node_info_list_t;
 
-typedef enum {
-    MESH_LITE_MSG_ID_INVALID = 0,
-    MESH_LITE_MSG_ID_REPORT_NODE_INFO,
-    MESH_LITE_MSG_ID_REPORT_NODE_INFO_RESP,
-    MESH_LITE_MSG_ID_UPDATE_NODES_LIST,
-} esp_mesh_lite_msg_id_t;
+/**
+ * @brief Copy of one entry of the node list, see esp_mesh_lite_get_nodes_snapshot().
+ */
+typedef struct {
+    esp_mesh_lite_node_info_t node;
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+    esp_mesh_lite_node_health_t health;     /**< Only collected on the root node */
+#endif
+} esp_mesh_lite_node_snapshot_t;
 
 /**
  * @brief Child nodes report MAC and level information to the root node.
@@ -89,9 +127,51 @@ esp_err_t esp_mesh_lite_report_info(void);
  *      - NULL: If the list could not be retrieved or is empty.
  *
  * @note The returned pointer should not be modified or freed by the caller.
+ * @note The list changes under the caller when nodes join or leave, use esp_mesh_lite_get_nodes_snapshot()
+ *       outside of the mesh-lite tasks.
  */
 const node_info_list_t *esp_mesh_lite_get_nodes_list(uint32_t *size);
 
+/**
+ * @brief Copy the list of nodes in the mesh network.
+ *
+ * The list is copied under the lock of the node table, so the copy stays valid however long the
+ * caller takes to format it.
+ *
+ * @param[out] nodes Buffer for the copy
+ * @param[in]  max   Number of entries of the buffer, CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER holds all nodes
+ *
+ * @return Number of nodes copied
+ */
+uint32_t esp_mesh_lite_get_nodes_snapshot(esp_mesh_lite_node_snapshot_t *nodes, uint32_t max);
+
+/**
+ * @brief Get the generation of the node list.
+ *
+ * The root bumps the generation on every change of its node table and sends it with the node list.
+ * Other nodes keep the list they received last, with its generation, as a replica; a node that
+ * becomes root takes its replica over as node table and continues the generation.
+ *
+ * @return Generation of the node table on the root, of the last node list received on other nodes.
+ */
+uint32_t esp_mesh_lite_get_nodes_generation(void);
+
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+/**
+ * @brief Register a callback that completes the health summary of this node before each report.
+ *
+ * @param[in] cb Callback, NULL to unregister.
+ */
+void esp_mesh_lite_set_health_cb(esp_mesh_lite_health_cb_t cb);
+
+/**
+ * @brief Fill in the health summary of this node.
+ *
+ * @param[out] health Health summary, update_time is left 0.
+ */
+void esp_mesh_lite_get_self_health(esp_mesh_lite_node_health_t *health);
+#endif /* CONFIG_MESH_LITE_NODE_HEALTH_REPORT */
+
 #endif /* CONFIG_MESH_LITE_NODE_INFO_REPORT */
 
 /**
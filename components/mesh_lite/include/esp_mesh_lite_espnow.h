@@ -21,6 +21,7 @@
                                     && (((uint8_t*)addr)[3] == 0xFF) && (((uint8_t*)addr)[4] == 0xFF) && (((uint8_t*)addr)[5] == 0xFF))
 
 typedef void (*esp_mesh_lite_espnow_handler_failed_hook_t)(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
+typedef void (*esp_mesh_lite_espnow_rx_hook_t)(const esp_now_recv_info_t *recv_info, int len);
 typedef esp_err_t (*esp_mesh_lite_espnow_recv_cb_t)(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
 
 typedef enum {
@@ -30,6 +31,8 @@ typedef enum {
     ESPNOW_DATA_TYPE_WIRELESS_DEBUG,
     ESPNOW_DATA_TYPE_WIRELESS_LOG,
     ESPNOW_DATA_TYPE_RESERVE = 200,
+    /* Types below ESPNOW_DATA_TYPE_RESERVE may be used by the core library, applications allocate upward from it */
+    ESPNOW_DATA_TYPE_CAPABILITY = 255,
 } esp_mesh_lite_espnow_data_type_t;
 
 typedef struct espnow_cb_register {
@@ -66,6 +69,19 @@ typedef struct {
     esp_mesh_lite_espnow_event_info_t info;
 } esp_mesh_lite_espnow_event_t;
 
+typedef struct {
+    uint32_t hits;      /**< Peer already in the driver table with the same settings, no driver call */
+    uint32_t adds;      /**< Peers added to the driver table */
+    uint32_t mods;      /**< Cached peers whose channel or interface changed */
+    uint32_t evictions; /**< Least recently used peers deleted to make room */
+} esp_mesh_lite_espnow_peer_stats_t;
+
+typedef struct {
+    uint8_t version;      /**< ESP-NOW version of the peer */
+    uint16_t max_payload; /**< Largest ESP-NOW frame the peer receives, data type byte included */
+    uint32_t codecs;      /**< Application defined bitmap of the payload codecs the peer decodes */
+} esp_mesh_lite_espnow_caps_t;
+
 /**
  * @brief Initialize ESP-Mesh-Lite ESP-NOW module.
  *
@@ -110,6 +126,94 @@ esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *peer_addr, const uint
  */
 esp_err_t esp_mesh_lite_espnow_send_and_del_peer(uint8_t type, uint8_t *peer_addr, const uint8_t *data, size_t len);
 
+/**
+ * @brief Make sure an unencrypted peer is in the ESP-NOW peer table.
+ *
+ * Peers are cached in RAM, so calling this before every send only calls the driver when the peer
+ * is new or its channel or interface changed. When CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM peers are
+ * cached, or the driver table is full, the least recently used cached peer is deleted.
+ *
+ * @param[in] peer_addr MAC address of the peer node.
+ * @param[in] channel Wi-Fi channel of the peer, 0 for the current channel.
+ * @param[in] ifidx Wi-Fi interface used to send to the peer.
+ *
+ * @return
+ *      - ESP_OK: The peer is in the peer table
+ *      - Others: Error code of esp_now_add_peer() or esp_now_mod_peer()
+ */
+esp_err_t esp_mesh_lite_espnow_peer_add(const uint8_t *peer_addr, uint8_t channel, wifi_interface_t ifidx);
+
+/**
+ * @brief Delete a peer from the ESP-NOW peer table and the peer cache.
+ *
+ * @param[in] peer_addr MAC address of the peer node.
+ *
+ * @return
+ *      - ESP_OK: Peer deleted
+ *      - Others: Error code of esp_now_del_peer()
+ */
+esp_err_t esp_mesh_lite_espnow_peer_del(const uint8_t *peer_addr);
+
+/**
+ * @brief Get the counters of the peer cache since boot.
+ *
+ * @param[out] stats Peer cache counters.
+ */
+void esp_mesh_lite_espnow_peer_get_stats(esp_mesh_lite_espnow_peer_stats_t *stats);
+
+/**
+ * @brief Set the payload codecs advertised to peers in the capability exchange.
+ *
+ * @param[in] codecs Application defined bitmap of the payload codecs this node decodes.
+ */
+void esp_mesh_lite_espnow_set_codecs(uint32_t codecs);
+
+/**
+ * @brief Request the capabilities of a peer.
+ *
+ * The request carries the capabilities of this node, so one exchange informs both ends. The reply
+ * is cached in RAM and read with esp_mesh_lite_espnow_peer_get_caps(). Requests to peers that never
+ * answer, e.g. older firmware, are backed off, call this again before each transfer that depends
+ * on the answer.
+ *
+ * @param[in] peer_addr MAC address of the peer node.
+ *
+ * @return
+ *      - ESP_OK: Request sent, or the capabilities are already known
+ *      - ESP_ERR_NOT_FINISHED: An earlier request is unanswered and the next one is backed off
+ *      - ESP_ERR_INVALID_ARG: Broadcast address
+ *      - Others: Error code of esp_mesh_lite_espnow_peer_add() or esp_now_send()
+ */
+esp_err_t esp_mesh_lite_espnow_peer_query_caps(const uint8_t *peer_addr);
+
+/**
+ * @brief Get the capabilities of a peer.
+ *
+ * Only looks up the cache, nothing is sent. See esp_mesh_lite_espnow_peer_query_caps().
+ *
+ * @param[in] peer_addr MAC address of the peer node.
+ * @param[out] caps Capabilities of the peer.
+ *
+ * @return
+ *      - ESP_OK: caps is valid
+ *      - ESP_ERR_NOT_FOUND: The peer has not answered yet
+ *      - ESP_ERR_INVALID_ARG: Broadcast address
+ */
+esp_err_t esp_mesh_lite_espnow_peer_get_caps(const uint8_t *peer_addr, esp_mesh_lite_espnow_caps_t *caps);
+
+/**
+ * @brief Get the largest data length esp_mesh_lite_espnow_send() can deliver to a peer.
+ *
+ * This is the ESPNOW_PAYLOAD_MAX_LEN of the peer when both ends negotiated ESP-NOW v2 frames, and the
+ * v1 limit for the broadcast address and peers whose capabilities are not known yet. Nothing is sent,
+ * peers are asked with esp_mesh_lite_espnow_peer_query_caps().
+ *
+ * @param[in] peer_addr MAC address of the peer node.
+ *
+ * @return Maximum data length, without the data type byte
+ */
+size_t esp_mesh_lite_espnow_max_data_len(const uint8_t *peer_addr);
+
 /**
  * @brief Register a callback function for handling ESP-Mesh-Lite ESP-NOW data reception.
  *
@@ -152,3 +256,15 @@ esp_err_t esp_mesh_lite_espnow_recv_cb_unregister(esp_mesh_lite_espnow_data_type
  *      - ESP_FAIL: Failed to register the callback
  */
 esp_err_t esp_mesh_lite_espnow_register_handler_failed_callback(esp_mesh_lite_espnow_handler_failed_hook_t cb);
+
+/**
+ * @brief Register a callback called for every received ESP-NOW frame, before it is dispatched.
+ *
+ * It runs in the Wi-Fi task and must not block, e.g. to collect link statistics from rx_ctrl.
+ *
+ * @param[in] cb  The callback function to be registered, NULL to unregister.
+ *
+ * @return
+ *      - ESP_OK: Callback registration successful
+ */
+esp_err_t esp_mesh_lite_espnow_register_rx_hook(esp_mesh_lite_espnow_rx_hook_t cb);
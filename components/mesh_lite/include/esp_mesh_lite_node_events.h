@@ -0,0 +1,94 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_mesh_lite.h"
+
+/**
+ * @brief Kind of change of a node in the node table.
+ */
+typedef enum {
+    ESP_MESH_LITE_NODE_DIFF_JOIN = 0,   /**< Node added to the node table */
+    ESP_MESH_LITE_NODE_DIFF_LEAVE,      /**< Node removed from the node table */
+    ESP_MESH_LITE_NODE_DIFF_CHANGE,     /**< Level or IP of the node changed */
+} esp_mesh_lite_node_diff_type_t;
+
+/**
+ * @brief Net change of one node over a batch window.
+ */
+typedef struct {
+    esp_mesh_lite_node_diff_type_t type;
+    esp_mesh_lite_node_info_t node;     /**< Latest information of the node, the last known one for a leave */
+} esp_mesh_lite_node_diff_t;
+
+/**
+ * @brief Changes of the node table collected over one batch window.
+ */
+typedef struct {
+    const esp_mesh_lite_node_diff_t *diffs;
+    size_t num;
+    uint32_t posted;        /**< Changes posted in the window, before coalescing */
+    bool overflow;          /**< Changes were lost, re-read esp_mesh_lite_get_nodes_list() */
+    uint32_t generation;    /**< esp_mesh_lite_get_nodes_generation() at delivery */
+} esp_mesh_lite_node_diff_batch_t;
+
+/**
+ * @brief Callback of a subscriber, runs in the node event task.
+ *
+ * The batch is only valid during the call.
+ */
+typedef void (*esp_mesh_lite_node_diff_cb_t)(const esp_mesh_lite_node_diff_batch_t *batch, void *arg);
+
+/**
+ * @brief Start the node event channel.
+ *
+ * Joins, leaves and changes of the node table are no longer posted one by one to the default event
+ * loop (unless CONFIG_MESH_LITE_NODE_EVENT_DEFAULT_LOOP is set). They are collected per MAC for
+ * CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS after the first one, so that e.g. a node that joins and
+ * changes level within the window is a single join, and a node that joins and leaves again is
+ * nothing at all. The net changes are then delivered as one batch to every subscriber.
+ *
+ * @note Called by esp_mesh_lite_init().
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t esp_mesh_lite_node_events_init(void);
+
+/**
+ * @brief Subscribe to the batches of node table changes.
+ *
+ * @param[in] cb   Callback
+ * @param[in] arg  Argument of the callback
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: cb is NULL
+ *      - ESP_ERR_NO_MEM: CONFIG_MESH_LITE_NODE_EVENT_SUBSCRIBERS reached
+ */
+esp_err_t esp_mesh_lite_node_diff_subscribe(esp_mesh_lite_node_diff_cb_t cb, void *arg);
+
+/**
+ * @brief Post a change of the node table, never blocks.
+ *
+ * @note Called by the node table code of esp_mesh_lite.c.
+ */
+void esp_mesh_lite_node_diff_post(esp_mesh_lite_node_diff_type_t type, const esp_mesh_lite_node_info_t *node);
+
+#ifdef __cplusplus
+}
+#endif
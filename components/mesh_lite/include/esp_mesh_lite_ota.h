@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_mesh_lite_core.h"
+
+#ifdef CONFIG_ESP_MESH_LITE_OTA_ENABLE
+
+/**
+ * @brief LAN OTA state of a node, as reported to the root node.
+ */
+typedef enum {
+    ESP_MESH_LITE_OTA_STATE_IDLE = 0,       /**< No LAN OTA in progress */
+    ESP_MESH_LITE_OTA_STATE_DOWNLOADING,    /**< Firmware is being received */
+    ESP_MESH_LITE_OTA_STATE_SUCCESS,        /**< Firmware received and verified */
+    ESP_MESH_LITE_OTA_STATE_FAIL,           /**< LAN OTA failed, see `reason` */
+} esp_mesh_lite_ota_state_t;
+
+/**
+ * @brief LAN OTA progress of one node, aggregated on the root node.
+ */
+typedef struct {
+    uint8_t mac_addr[6];                    /**< Station MAC address of the node */
+    uint8_t level;                          /**< Mesh level of the node */
+    uint8_t percentage;                     /**< Download progress, 0 ~ 100 */
+    esp_mesh_lite_ota_state_t state;        /**< LAN OTA state */
+    esp_mesh_lite_ota_finish_reason_t reason; /**< Failure reason, valid when state is ESP_MESH_LITE_OTA_STATE_FAIL */
+    uint32_t update_time;                   /**< Root uptime in seconds when the last report was received */
+} esp_mesh_lite_ota_progress_t;
+
+/**
+ * @brief Initialize LAN OTA progress aggregation and, if CONFIG_MESH_LITE_OTA_RESUMABLE is enabled,
+ *        register the resumable LAN OTA file transfer callbacks.
+ *
+ * Every node reports its LAN OTA state and progress to the root node, which keeps one entry per node.
+ *
+ * With CONFIG_MESH_LITE_OTA_RESUMABLE, received data is written straight to the next update partition
+ * and a bitmap of received chunks, keyed by firmware version and file size, is kept in NVS.
+ * After a reboot, a transfer of the same firmware keeps the chunks that are already on flash.
+ * While a node is still downloading, it serves the chunks it already holds to its own children,
+ * so that deeper levels do not have to wait for their parent to finish.
+ *
+ * @note Called by esp_mesh_lite_init(). An application that registers its own callbacks with
+ *       esp_mesh_lite_ota_register_file_transfer_cb() afterwards replaces the resumable ones.
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t esp_mesh_lite_ota_init(void);
+
+/**
+ * @brief Get the LAN OTA progress of all nodes. Only valid on the root node.
+ *
+ * @param[out] list     Array to be filled with the progress of each node, may be NULL to only get the number of nodes.
+ * @param[in]  max_num  Number of entries in list.
+ *
+ * @return Number of nodes known to the root node, which may be larger than max_num.
+ */
+size_t esp_mesh_lite_ota_get_progress(esp_mesh_lite_ota_progress_t *list, size_t max_num);
+
+/**
+ * @brief Clear the LAN OTA progress table on the root node, e.g. before starting a new rollout.
+ */
+void esp_mesh_lite_ota_clear_progress(void);
+
+#endif /* CONFIG_ESP_MESH_LITE_OTA_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_bit_defs.h"
+#include "esp_partition.h"
+
+#define ESP_MESH_LITE_OTA_PACK_MAGIC        0x4B504C4D  /* "MLPK" */
+#define ESP_MESH_LITE_OTA_PACK_VERSION      1
+
+#define ESP_MESH_LITE_OTA_PACK_FLAG_DEFLATE BIT(0)      /* Payload is a zlib stream */
+
+/**
+ * @brief Type of a packed LAN OTA image.
+ */
+typedef enum {
+    ESP_MESH_LITE_OTA_PACK_FULL = 0,    /**< Payload is the complete application image */
+    ESP_MESH_LITE_OTA_PACK_DELTA,       /**< Payload is a delta against the running application image */
+} esp_mesh_lite_ota_pack_type_t;
+
+/**
+ * @brief Delta payload opcodes. All integers are little endian.
+ *
+ * - COPY   <u32 src_offset> <u32 len>:         copy len bytes of the running image
+ * - ADD    <u32 src_offset> <u32 len> <bytes>: add len bytes bytewise to the running image
+ * - INSERT <u32 len> <bytes>:                  write len literal bytes
+ */
+typedef enum {
+    ESP_MESH_LITE_OTA_DELTA_COPY = 1,
+    ESP_MESH_LITE_OTA_DELTA_ADD,
+    ESP_MESH_LITE_OTA_DELTA_INSERT,
+} esp_mesh_lite_ota_delta_op_t;
+
+/**
+ * @brief Header of a packed LAN OTA image, produced by tools/mesh_lite_ota_pack.py.
+ */
+typedef struct {
+    uint32_t magic;                     /**< ESP_MESH_LITE_OTA_PACK_MAGIC */
+    uint8_t version;                    /**< ESP_MESH_LITE_OTA_PACK_VERSION */
+    uint8_t type;                       /**< esp_mesh_lite_ota_pack_type_t */
+    uint8_t flags;                      /**< ESP_MESH_LITE_OTA_PACK_FLAG_* */
+    uint8_t reserved;
+    uint32_t image_size;                /**< Size of the resulting application image */
+    uint32_t payload_size;              /**< Number of payload bytes following the header */
+    uint8_t image_sha256[32];           /**< SHA-256 of the resulting application image */
+    uint8_t source_sha256[32];          /**< Delta only: SHA-256 of the application image the delta applies to */
+} __attribute__((packed)) esp_mesh_lite_ota_pack_header_t;
+
+/**
+ * @brief Install a LAN OTA file stored in a staging partition into the next update partition.
+ *
+ * A packed image is decoded while streaming it into the update partition: a compressed payload
+ * is inflated, and a delta is applied against the running partition. A file without a pack header
+ * is treated as a plain application image and copied as is. The result is verified against the
+ * SHA-256 in the header and the update partition is set as the boot partition.
+ *
+ * @param[in] staging   Partition holding the received file.
+ * @param[in] filesize  Number of bytes of the file in the staging partition.
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_VERSION: The delta does not apply to the running image
+ *      - ESP_ERR_INVALID_CRC: The decoded image does not match its SHA-256
+ *      - ESP_ERR_NOT_SUPPORTED: Unknown pack version or type
+ *      - Others: Flash or OTA errors
+ */
+esp_err_t esp_mesh_lite_ota_pack_install(const esp_partition_t *staging, size_t filesize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -48,6 +48,18 @@ typedef struct {
  */
 wifi_ap_record_t *esp_mesh_lite_scan_get_ap_records_list(uint16_t count);
 
+/**
+ * @brief Observe the access point records fetched after a scan.
+ *
+ * Called by `esp_mesh_lite_scan_get_ap_records_list` with every batch of records it fetches,
+ * so that other modules can learn from scan results without consuming the driver's scan list.
+ * The default implementation is a weak no-op.
+ *
+ * @param ap_list Pointer to the fetched access point records.
+ * @param count Number of records in ap_list.
+ */
+void esp_mesh_lite_scan_ap_records_observe(const wifi_ap_record_t *ap_list, uint16_t count);
+
 /**
  * @brief Get the next access point record.
  *
@@ -0,0 +1,70 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * @brief Time synchronization state of this node.
+ */
+typedef struct {
+    bool synced;                /**< Mesh time is valid, always true on the root node */
+    int64_t offset_us;          /**< Mesh time minus local time, now */
+    float drift_ppm;            /**< Estimated drift of the local clock against mesh time */
+    uint32_t delay_us;          /**< Round trip delay of the last accepted exchange with the parent */
+    uint32_t sample_num;        /**< Number of accepted exchanges since the last parent change */
+} esp_mesh_lite_time_sync_status_t;
+
+/**
+ * @brief Start mesh time synchronization.
+ *
+ * Mesh time is the esp_timer time of the root node. Every other node periodically runs a two-way
+ * timestamp exchange with its parent over the raw message path, and only accepts answers from a
+ * parent that is synchronized itself, so time propagates level by level from the root.
+ * Offset and drift of the local clock are tracked with a small phase/frequency loop. Exchanges count
+ * less the longer their round trip is over the fastest recent one, far slower ones are discarded.
+ *
+ * @note Called by esp_mesh_lite_init().
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t esp_mesh_lite_time_sync_init(void);
+
+/**
+ * @brief Get the current mesh time in microseconds.
+ *
+ * @return Mesh time, or the local esp_timer time while not synchronized
+ */
+int64_t esp_mesh_lite_time_get_us(void);
+
+/**
+ * @brief Convert a local esp_timer timestamp into mesh time.
+ */
+int64_t esp_mesh_lite_time_from_local(int64_t local_us);
+
+/**
+ * @brief Check whether mesh time is valid on this node.
+ */
+bool esp_mesh_lite_time_is_synced(void);
+
+/**
+ * @brief Get the time synchronization state of this node.
+ */
+void esp_mesh_lite_time_sync_get_status(esp_mesh_lite_time_sync_status_t *status);
+
+#ifdef __cplusplus
+}
+#endif
@@ -27,6 +27,26 @@ typedef void (*esp_mesh_lite_wireless_debug_recieve_response_data_cb)(char *resp
 // Callback type for receiving debug logs from other devices
 typedef void (*esp_mesh_lite_wireless_debug_recieve_debug_log_cb)(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
 
+// Outcome of one target of a fan-out command
+typedef enum {
+    WIRELESS_DEBUG_FANOUT_PENDING = 0,    // No response yet
+    WIRELESS_DEBUG_FANOUT_OK,             // Response received
+    WIRELESS_DEBUG_FANOUT_TIMEOUT,        // No response within the timeout
+    WIRELESS_DEBUG_FANOUT_SEND_FAIL,      // The command could not be sent to this target
+} esp_mesh_lite_wireless_debug_fanout_status_t;
+
+// Per-node result of a fan-out command
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];                       // Target (or responder, for broadcast) MAC
+    esp_mesh_lite_wireless_debug_fanout_status_t status; // Outcome for this node
+    uint32_t latency_ms;                                 // Time from send to response
+    char *response;                                      // NUL-terminated response, NULL unless status is OK
+    size_t response_len;                                 // Length of response
+} esp_mesh_lite_wireless_debug_fanout_result_t;
+
+// Callback type delivering all results of a fan-out command at once. The results are freed after it returns.
+typedef void (*esp_mesh_lite_wireless_debug_fanout_cb)(uint32_t corr_id, const esp_mesh_lite_wireless_debug_fanout_result_t *results, size_t count, void *arg);
+
 // Structure to store the list of wireless debug callback functions
 typedef struct esp_mesh_lite_wireless_debug_cb_list {
     esp_mesh_lite_wireless_debug_wifi_error_cb wifi_error_cb; // Wi-Fi error callback
@@ -54,6 +74,41 @@ void esp_mesh_lite_set_wireless_debug_log_writev(wireless_debug_log_writev_t wri
  */
 esp_err_t esp_mesh_lite_wireless_debug_send_command(uint8_t *dst_mac, char *command, size_t command_len, uint8_t channel);
 
+/**
+ * @brief Send a wireless debug command to several devices at once and collect their responses.
+ *
+ * The command is sent back-to-back to every target without waiting for the previous answer,
+ * tagged with a correlation ID that the responders echo back. Responses are collected into
+ * per-node slots and delivered together through `cb` once every target has answered or
+ * `timeout_ms` has elapsed, whichever comes first. A response longer than one ESP-NOW frame
+ * arrives in several frames, which are joined in its slot.
+ *
+ * If `dst_macs` is NULL or `count` is 0, the command is broadcast and every responder is recorded,
+ * up to CONFIG_MESH_LITE_WIRELESS_DEBUG_FANOUT_MAX_NODES, until the timeout expires.
+ * For unicast targets, a command without a `--mac` argument has the target MAC appended,
+ * so that per-device commands such as `discover` are answered by each target.
+ *
+ * @param dst_macs    Array of destination MAC addresses, or NULL for broadcast.
+ * @param count       Number of entries in dst_macs.
+ * @param command     The command to send.
+ * @param command_len The length of the command.
+ * @param channel     The Wi-Fi channel the responders should answer on.
+ * @param timeout_ms  Per-node response timeout in milliseconds.
+ * @param cb          Callback receiving the aggregated results, called from the timer task.
+ * @param arg         User argument passed to cb.
+ * @param corr_id     Optional output of the correlation ID assigned to this request.
+ *
+ * @return
+ *      - ESP_OK: The command was sent to at least one target
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: All request slots are busy or out of memory
+ *      - ESP_FAIL: Wireless debug is not initialized
+ */
+esp_err_t esp_mesh_lite_wireless_debug_send_command_multi(const uint8_t (*dst_macs)[ESP_NOW_ETH_ALEN], size_t count,
+                                                          const char *command, size_t command_len, uint8_t channel,
+                                                          uint32_t timeout_ms, esp_mesh_lite_wireless_debug_fanout_cb cb,
+                                                          void *arg, uint32_t *corr_id);
+
 /**
  * @brief Register wireless debug callbacks for handling various debug events.
  *
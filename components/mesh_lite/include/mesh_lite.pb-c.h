@@ -19,32 +19,96 @@ PROTOBUF_C__BEGIN_DECLS
 # error This file was generated by an older version of protoc-c which is incompatible with your libprotobuf-c headers. Please regenerate this file with a newer version of protoc-c.
 #endif
 
+typedef struct MeshLite__NodeHealth MeshLite__NodeHealth;
 typedef struct MeshLite__NodeData MeshLite__NodeData;
 typedef struct MeshLite__Data MeshLite__Data;
+typedef struct MeshLite__OtaProgress MeshLite__OtaProgress;
+typedef struct MeshLite__TimeSync MeshLite__TimeSync;
 
 /* --- enums --- */
 
 /* --- messages --- */
 
+struct  MeshLite__NodeHealth {
+    ProtobufCMessage base;
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+    int32_t parent_rssi;
+    uint32_t child_num;
+    uint32_t queue_depth;
+    uint32_t queue_drops;
+    uint32_t uptime;
+};
+#define MESH_LITE__NODE_HEALTH__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&mesh_lite__node_health__descriptor) \
+, 0, 0, 0, 0, 0, 0, 0 }
+
 struct  MeshLite__NodeData {
     ProtobufCMessage base;
     uint32_t node_level;
     uint32_t node_ip;
     ProtobufCBinaryData node_mac;
+    MeshLite__NodeHealth *health;
 };
 #define MESH_LITE__NODE_DATA__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&mesh_lite__node_data__descriptor) \
-, 0, 0, {0,NULL} }
+, 0, 0, {0,NULL}, NULL }
 
 struct  MeshLite__Data {
     ProtobufCMessage base;
     size_t n_nodes;
     MeshLite__NodeData **nodes;
+    uint32_t generation;
+    ProtobufCBinaryData root_mac;
+    uint32_t epoch;
 };
 #define MESH_LITE__DATA__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&mesh_lite__data__descriptor) \
-, 0,NULL }
+, 0,NULL, 0, {0,NULL}, 0 }
+
+struct  MeshLite__OtaProgress {
+    ProtobufCMessage base;
+    ProtobufCBinaryData node_mac;
+    uint32_t node_level;
+    uint32_t percentage;
+    uint32_t state;
+    uint32_t reason;
+};
+#define MESH_LITE__OTA_PROGRESS__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&mesh_lite__ota_progress__descriptor) \
+, {0,NULL}, 0, 0, 0, 0 }
 
+struct  MeshLite__TimeSync {
+    ProtobufCMessage base;
+    uint32_t seq;
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+    protobuf_c_boolean synced;
+};
+#define MESH_LITE__TIME_SYNC__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&mesh_lite__time_sync__descriptor) \
+, 0, 0, 0, 0, 0 }
+
+/* MeshLite__NodeHealth methods */
+void   mesh_lite__node_health__init
+(MeshLite__NodeHealth         *message);
+size_t mesh_lite__node_health__get_packed_size
+(const MeshLite__NodeHealth   *message);
+size_t mesh_lite__node_health__pack
+(const MeshLite__NodeHealth   *message,
+ uint8_t             *out);
+size_t mesh_lite__node_health__pack_to_buffer
+(const MeshLite__NodeHealth   *message,
+ ProtobufCBuffer     *buffer);
+MeshLite__NodeHealth *
+mesh_lite__node_health__unpack
+(ProtobufCAllocator  *allocator,
+ size_t               len,
+ const uint8_t       *data);
+void   mesh_lite__node_health__free_unpacked
+(MeshLite__NodeHealth *message,
+ ProtobufCAllocator *allocator);
 /* MeshLite__NodeData methods */
 void   mesh_lite__node_data__init
 (MeshLite__NodeData         *message);
@@ -83,21 +147,71 @@ mesh_lite__data__unpack
 void   mesh_lite__data__free_unpacked
 (MeshLite__Data *message,
  ProtobufCAllocator *allocator);
+/* MeshLite__OtaProgress methods */
+void   mesh_lite__ota_progress__init
+(MeshLite__OtaProgress         *message);
+size_t mesh_lite__ota_progress__get_packed_size
+(const MeshLite__OtaProgress   *message);
+size_t mesh_lite__ota_progress__pack
+(const MeshLite__OtaProgress   *message,
+ uint8_t             *out);
+size_t mesh_lite__ota_progress__pack_to_buffer
+(const MeshLite__OtaProgress   *message,
+ ProtobufCBuffer     *buffer);
+MeshLite__OtaProgress *
+mesh_lite__ota_progress__unpack
+(ProtobufCAllocator  *allocator,
+ size_t               len,
+ const uint8_t       *data);
+void   mesh_lite__ota_progress__free_unpacked
+(MeshLite__OtaProgress *message,
+ ProtobufCAllocator *allocator);
+/* MeshLite__TimeSync methods */
+void   mesh_lite__time_sync__init
+(MeshLite__TimeSync         *message);
+size_t mesh_lite__time_sync__get_packed_size
+(const MeshLite__TimeSync   *message);
+size_t mesh_lite__time_sync__pack
+(const MeshLite__TimeSync   *message,
+ uint8_t             *out);
+size_t mesh_lite__time_sync__pack_to_buffer
+(const MeshLite__TimeSync   *message,
+ ProtobufCBuffer     *buffer);
+MeshLite__TimeSync *
+mesh_lite__time_sync__unpack
+(ProtobufCAllocator  *allocator,
+ size_t               len,
+ const uint8_t       *data);
+void   mesh_lite__time_sync__free_unpacked
+(MeshLite__TimeSync *message,
+ ProtobufCAllocator *allocator);
 /* --- per-message closures --- */
 
+typedef void (*MeshLite__NodeHealth_Closure)
+(const MeshLite__NodeHealth *message,
+ void *closure_data);
 typedef void (*MeshLite__NodeData_Closure)
 (const MeshLite__NodeData *message,
  void *closure_data);
 typedef void (*MeshLite__Data_Closure)
 (const MeshLite__Data *message,
  void *closure_data);
+typedef void (*MeshLite__OtaProgress_Closure)
+(const MeshLite__OtaProgress *message,
+ void *closure_data);
+typedef void (*MeshLite__TimeSync_Closure)
+(const MeshLite__TimeSync *message,
+ void *closure_data);
 
 /* --- services --- */
 
 /* --- descriptors --- */
 
+extern const ProtobufCMessageDescriptor mesh_lite__node_health__descriptor;
 extern const ProtobufCMessageDescriptor mesh_lite__node_data__descriptor;
 extern const ProtobufCMessageDescriptor mesh_lite__data__descriptor;
+extern const ProtobufCMessageDescriptor mesh_lite__ota_progress__descriptor;
+extern const ProtobufCMessageDescriptor mesh_lite__time_sync__descriptor;
 
 PROTOBUF_C__END_DECLS
 
@@ -30,6 +30,7 @@ typedef enum {
     ZERO_PROV_SEND_BROADCAST,
     ZERO_PROV_RECIVE_DATA,
     ZERO_PROV_SEND_UNICAST_DATA,
+    ZERO_PROV_PENDING_TICK,
 } zero_prov_event_id_t;
 
 enum {
@@ -6,8 +6,12 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <sys/param.h>
+#include <inttypes.h>
 #include "esp_log.h"
 #include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 
 #include "freertos/task.h"
 #include "freertos/timers.h"
@@ -15,6 +19,9 @@
 #include "esp_mac.h"
 #include "esp_bridge.h"
 #include "esp_mesh_lite.h"
+#include "esp_mesh_lite_ota.h"
+#include "esp_mesh_lite_time_sync.h"
+#include "esp_mesh_lite_node_events.h"
 #include "mesh_lite.pb-c.h"
 
 static const char *TAG = "Mesh-Lite";
@@ -23,12 +30,56 @@ static const char *TAG = "Mesh-Lite";
 
 #define MAX_RETRY  5
 
+#define MESH_LITE_REPORT_INTERVAL_MIN_MS     (MIN(CONFIG_MESH_LITE_REPORT_INTERVAL_MIN, CONFIG_MESH_LITE_REPORT_INTERVAL) * 1000)
+#define MESH_LITE_REPORT_INTERVAL_MAX_MS     (CONFIG_MESH_LITE_REPORT_INTERVAL * 1000)
+/* Entries outlive the longest jittered report interval */
+#define MESH_LITE_REPORT_TTL                 (CONFIG_MESH_LITE_REPORT_INTERVAL * (100 + CONFIG_MESH_LITE_REPORT_JITTER) / 100 + MESH_LITE_REPORT_INTERVAL_BUFFER)
+#define MESH_LITE_NODES_BROADCAST_WINDOW_US  (CONFIG_MESH_LITE_NODES_BROADCAST_WINDOW_MS * 1000LL)
+
 static uint32_t nodes_num = 0;
 static node_info_list_t *node_info_list = NULL;
 static SemaphoreHandle_t node_info_mutex;
 
-static esp_err_t esp_mesh_lite_node_info_update(uint8_t level, uint8_t* mac, uint32_t ip_addr);
+/*
+ * Every node that is not the root keeps the node list broadcast by the root as a replica. The root
+ * bumps the generation on every change of the list, so that replicas ignore stale broadcasts. A node
+ * that becomes root keeps its replica as the node table and continues its generation; the nodes
+ * whose entry in the next broadcast does not match their state report right away, the others are
+ * refreshed by the periodic report. Generations only compare within one boot of the root: a root
+ * that reboots starts over with a new epoch, and the replicas take its list as a new baseline.
+ */
+static uint32_t nodes_generation = 0;
+static uint32_t nodes_epoch = 0;                  /* Boot nonce of the root of the list */
+static uint32_t nodes_boot_epoch = 0;             /* Boot nonce of this node, used while it owns the list */
+static uint8_t nodes_root_mac[ETH_HWADDR_LEN];    /* Root of the list, the node itself while it owns it */
+static bool nodes_owned = false;
+static uint32_t nodes_reconciled_generation = 0;  /* Generation this node last reported itself for */
+
+/* Report interval, back to the minimum on a change of this node and doubled after every report */
+static TimerHandle_t report_timer = NULL;
+static uint32_t report_interval_ms = MESH_LITE_REPORT_INTERVAL_MIN_MS;
+static int64_t report_soon_time = -MESH_LITE_REPORT_INTERVAL_MIN_MS * 1000LL;
+
+/* Node list broadcasts of the root: token bucket, refilled by one token per window */
+static TimerHandle_t nodes_broadcast_timer = NULL;
+static portMUX_TYPE nodes_broadcast_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t nodes_broadcast_tokens = CONFIG_MESH_LITE_NODES_BROADCAST_BURST;
+static int64_t nodes_broadcast_refill_time = 0;
+static bool nodes_broadcast_pending = false;
+static uint32_t nodes_broadcast_coalesced = 0;
+
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+typedef esp_mesh_lite_node_health_t node_health_t;
+static esp_mesh_lite_health_cb_t health_cb = NULL;
+#else
+typedef void node_health_t;
+#endif
+
+static esp_err_t esp_mesh_lite_node_info_update(uint8_t level, uint8_t* mac, uint32_t ip_addr, const node_health_t *health);
 static esp_err_t esp_mesh_lite_update_nodes_info_to_children(void);
+static void esp_mesh_lite_nodes_broadcast_request(void);
+static void esp_mesh_lite_report_soon(void);
+static uint32_t esp_mesh_lite_report_jitter(uint32_t interval_ms);
 
 const node_info_list_t *esp_mesh_lite_get_nodes_list(uint32_t *size)
 {
@@ -38,6 +89,59 @@ const node_info_list_t *esp_mesh_lite_get_nodes_list(uint32_t *size)
     return node_info_list;
 }
 
+uint32_t esp_mesh_lite_get_nodes_snapshot(esp_mesh_lite_node_snapshot_t *nodes, uint32_t max)
+{
+    uint32_t num = 0;
+
+    if ((nodes == NULL) || (node_info_mutex == NULL)) {
+        return 0;
+    }
+
+    xSemaphoreTake(node_info_mutex, portMAX_DELAY);
+    for (node_info_list_t *current = node_info_list; current && (num < max); current = current->next) {
+        nodes[num].node = *current->node;
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+        nodes[num].health = current->health;
+#endif
+        num++;
+    }
+    xSemaphoreGive(node_info_mutex);
+    return num;
+}
+
+uint32_t esp_mesh_lite_get_nodes_generation(void)
+{
+    return nodes_generation;
+}
+
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+void esp_mesh_lite_set_health_cb(esp_mesh_lite_health_cb_t cb)
+{
+    health_cb = cb;
+}
+
+void esp_mesh_lite_get_self_health(esp_mesh_lite_node_health_t *health)
+{
+    wifi_ap_record_t ap_info;
+    wifi_sta_list_t sta_list;
+
+    memset(health, 0x0, sizeof(esp_mesh_lite_node_health_t));
+    health->free_heap = esp_get_free_heap_size();
+    health->min_free_heap = esp_get_minimum_free_heap_size();
+    if (esp_mesh_lite_get_level() > ROOT && esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        health->parent_rssi = ap_info.rssi;
+    }
+    if (esp_wifi_ap_get_sta_list(&sta_list) == ESP_OK) {
+        health->child_num = sta_list.num;
+    }
+    health->uptime = esp_timer_get_time() / 1000000;
+
+    if (health_cb) {
+        health_cb(health);
+    }
+}
+#endif
+
 esp_err_t esp_mesh_lite_report_info(void)
 {
     uint8_t mac[6];
@@ -51,8 +155,16 @@ esp_err_t esp_mesh_lite_report_info(void)
         return ESP_OK;
     }
 
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+    esp_mesh_lite_node_health_t health;
+    esp_mesh_lite_get_self_health(&health);
+    const node_health_t *self_health = &health;
+#else
+    const node_health_t *self_health = NULL;
+#endif
+
     if (esp_mesh_lite_get_level() == ROOT) {
-        esp_mesh_lite_node_info_update(ROOT, mac, ip_addr.ip.addr);
+        esp_mesh_lite_node_info_update(ROOT, mac, ip_addr.ip.addr, self_health);
         return ESP_OK;
     }
 
@@ -62,6 +174,18 @@ esp_err_t esp_mesh_lite_report_info(void)
     req.node_ip = ip_addr.ip.addr;
     req.node_mac.len = ETH_HWADDR_LEN;
     req.node_mac.data = mac;
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+    MeshLite__NodeHealth health_data;
+    mesh_lite__node_health__init(&health_data);
+    health_data.free_heap = health.free_heap;
+    health_data.min_free_heap = health.min_free_heap;
+    health_data.parent_rssi = health.parent_rssi;
+    health_data.child_num = health.child_num;
+    health_data.queue_depth = health.queue_depth;
+    health_data.queue_drops = health.queue_drops;
+    health_data.uptime = health.uptime;
+    req.health = &health_data;
+#endif
     uint32_t outlen = mesh_lite__node_data__get_packed_size(&req);
     uint8_t *outdata = malloc(outlen);
     mesh_lite__node_data__pack(&req, outdata);
@@ -82,23 +206,33 @@ esp_err_t esp_mesh_lite_report_info(void)
     return ESP_OK;
 }
 
-static esp_err_t esp_mesh_lite_node_info_update(uint8_t level, uint8_t* mac, uint32_t ip_addr)
+static esp_err_t esp_mesh_lite_node_info_update(uint8_t level, uint8_t* mac, uint32_t ip_addr, const node_health_t *health)
 {
     xSemaphoreTake(node_info_mutex, portMAX_DELAY);
     node_info_list_t* new = node_info_list;
 
     while (new) {
         if (!memcmp(new->node->mac_addr, mac, ETH_HWADDR_LEN)) {
-            new->ttl = (CONFIG_MESH_LITE_REPORT_INTERVAL + MESH_LITE_REPORT_INTERVAL_BUFFER);
+            new->ttl = MESH_LITE_REPORT_TTL;
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+            /* A health update alone is not a node change */
+            if (health) {
+                new->health = *health;
+                new->health.update_time = MAX(esp_timer_get_time() / 1000000, 1);
+            }
+#endif
             if ((new->node->level != level) || (new->node->ip_addr != ip_addr)) {
                 new->node->level = level;
                 new->node->ip_addr = ip_addr;
+                if (nodes_owned) {
+                    nodes_generation++;
+                }
             } else {
                 xSemaphoreGive(node_info_mutex);
                 return ESP_ERR_DUPLICATE_ADDITION;
             }
             xSemaphoreGive(node_info_mutex);
-            esp_event_post(ESP_MESH_LITE_EVENT, ESP_MESH_LITE_EVENT_NODE_CHANGE, new->node, sizeof(esp_mesh_lite_node_info_t), 0);
+            esp_mesh_lite_node_diff_post(ESP_MESH_LITE_NODE_DIFF_CHANGE, new->node);
             return ESP_OK;
         }
         new = new->next;
@@ -123,14 +257,24 @@ static esp_err_t esp_mesh_lite_node_info_update(uint8_t level, uint8_t* mac, uin
     memcpy(new->node->mac_addr, mac, ETH_HWADDR_LEN);
     new->node->level = level;
     new->node->ip_addr = ip_addr;
-    new->ttl = (CONFIG_MESH_LITE_REPORT_INTERVAL + MESH_LITE_REPORT_INTERVAL_BUFFER);
+    new->ttl = MESH_LITE_REPORT_TTL;
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+    memset(&new->health, 0x0, sizeof(esp_mesh_lite_node_health_t));
+    if (health) {
+        new->health = *health;
+        new->health.update_time = MAX(esp_timer_get_time() / 1000000, 1);
+    }
+#endif
 
     new->next = node_info_list;
     node_info_list = new;
     nodes_num++;
+    if (nodes_owned) {
+        nodes_generation++;
+    }
 
     xSemaphoreGive(node_info_mutex);
-    esp_event_post(ESP_MESH_LITE_EVENT, ESP_MESH_LITE_EVENT_NODE_JOIN, new->node, sizeof(esp_mesh_lite_node_info_t), 0);
+    esp_mesh_lite_node_diff_post(ESP_MESH_LITE_NODE_DIFF_JOIN, new->node);
     return ESP_OK;
 }
 
@@ -149,9 +293,23 @@ static esp_err_t mesh_lite_report_nodes_handler(uint8_t *data, uint32_t len, uin
     if (req) {
         if (req->node_mac.len > 0) {
             if ((req->node_level > 0) && (req->node_ip > 0)) {
-                ret = esp_mesh_lite_node_info_update(req->node_level, req->node_mac.data, req->node_ip);
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+                esp_mesh_lite_node_health_t health = {0};
+                if (req->health) {
+                    health.free_heap = req->health->free_heap;
+                    health.min_free_heap = req->health->min_free_heap;
+                    health.parent_rssi = req->health->parent_rssi;
+                    health.child_num = req->health->child_num;
+                    health.queue_depth = MIN(req->health->queue_depth, UINT16_MAX);
+                    health.queue_drops = req->health->queue_drops;
+                    health.uptime = req->health->uptime;
+                }
+                ret = esp_mesh_lite_node_info_update(req->node_level, req->node_mac.data, req->node_ip, req->health ? &health : NULL);
+#else
+                ret = esp_mesh_lite_node_info_update(req->node_level, req->node_mac.data, req->node_ip, NULL);
+#endif
                 if (ret == ESP_OK) {
-                    esp_mesh_lite_update_nodes_info_to_children();
+                    esp_mesh_lite_nodes_broadcast_request();
                 } else if (ret == ESP_ERR_DUPLICATE_ADDITION) {
                     ret = ESP_OK;
                 }
@@ -163,6 +321,42 @@ static esp_err_t mesh_lite_report_nodes_handler(uint8_t *data, uint32_t len, uin
     return ret;
 }
 
+/* Report right away if the list of the root has no or an outdated entry for this node */
+static void esp_mesh_lite_nodes_reconcile(const MeshLite__Data *req)
+{
+    uint8_t mac[ETH_HWADDR_LEN];
+    esp_netif_ip_info_t ip_info = {0};
+    esp_netif_t *external_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    esp_netif_get_ip_info(external_netif, &ip_info);
+    /* Without an IP, the node reports once it gets one */
+    if ((ip_info.ip.addr == 0) || (req->generation == nodes_reconciled_generation)) {
+        return;
+    }
+    /*
+     * A report asked for within the fast interval is still on its way or not in a list yet, another
+     * one would only push it back; e.g. every list of a reboot storm misses the nodes yet to report.
+     */
+    if (esp_timer_get_time() - report_soon_time < MESH_LITE_REPORT_INTERVAL_MIN_MS * 1000LL) {
+        return;
+    }
+
+    for (uint32_t loop = 0; loop < req->n_nodes; loop++) {
+        const MeshLite__NodeData *node = req->nodes[loop];
+        if ((node->node_mac.len == ETH_HWADDR_LEN) && !memcmp(node->node_mac.data, mac, ETH_HWADDR_LEN)) {
+            if ((node->node_level == esp_mesh_lite_get_level()) && (node->node_ip == ip_info.ip.addr)) {
+                return;
+            }
+            break;
+        }
+    }
+
+    nodes_reconciled_generation = req->generation;
+    ESP_LOGI(TAG, "Node list generation %" PRIu32 " is out of date for this node, reporting", req->generation);
+    esp_mesh_lite_report_soon();
+}
+
 static esp_err_t mesh_lite_update_nodes_list(uint8_t *data, uint32_t len, uint8_t **out_data, uint32_t* out_len, uint32_t seq)
 {
     esp_err_t ret = ESP_OK;
@@ -175,6 +369,32 @@ static esp_err_t mesh_lite_update_nodes_list(uint8_t *data, uint32_t len, uint8_
 
     req = mesh_lite__data__unpack(NULL, len, data);
     if (req) {
+        /* Roots that predate the generation do not send it, their lists are always applied */
+        bool versioned = (req->root_mac.len == ETH_HWADDR_LEN);
+        xSemaphoreTake(node_info_mutex, portMAX_DELAY);
+        bool same_root = versioned && !memcmp(req->root_mac.data, nodes_root_mac, ETH_HWADDR_LEN) &&
+                         (req->epoch == nodes_epoch);
+        bool stale = same_root && ((int32_t)(req->generation - nodes_generation) < 0);
+        if (versioned && !same_root) {
+            /* New root, or the root rebooted: its generations restart, so nothing is older than them */
+            ESP_LOGI(TAG, "Node list of root " MACSTR " epoch %" PRIx32 ", generation %" PRIu32 " as new baseline",
+                     MAC2STR(req->root_mac.data), req->epoch, req->generation);
+            nodes_reconciled_generation = 0;
+        }
+        if (versioned && !stale) {
+            nodes_generation = req->generation;
+            nodes_epoch = req->epoch;
+            memcpy(nodes_root_mac, req->root_mac.data, ETH_HWADDR_LEN);
+        }
+        xSemaphoreGive(node_info_mutex);
+
+        if (stale) {
+            /* Not forwarded either, the children got the newer list already */
+            ESP_LOGD(TAG, "Stale node list generation %" PRIu32 " dropped", req->generation);
+            mesh_lite__data__free_unpacked(req, NULL);
+            return ESP_OK;
+        }
+
         if (req->n_nodes > 0) {
             MeshLite__NodeData** node_data = req->nodes;
             xSemaphoreTake(node_info_mutex, portMAX_DELAY);
@@ -186,7 +406,7 @@ static esp_err_t mesh_lite_update_nodes_list(uint8_t *data, uint32_t len, uint8_
             xSemaphoreGive(node_info_mutex);
             for (uint32_t loop = 0; loop < req->n_nodes; loop++) {
                 if (node_data[loop]->node_mac.len > 0) {
-                    ret = esp_mesh_lite_node_info_update(node_data[loop]->node_level, node_data[loop]->node_mac.data, node_data[loop]->node_ip);
+                    ret = esp_mesh_lite_node_info_update(node_data[loop]->node_level, node_data[loop]->node_mac.data, node_data[loop]->node_ip, NULL);
                     if ((ret != ESP_ERR_DUPLICATE_ADDITION) && (ret != ESP_OK)) {
                         ret = ESP_FAIL;
                         break;
@@ -199,7 +419,7 @@ static esp_err_t mesh_lite_update_nodes_list(uint8_t *data, uint32_t len, uint8_
 
             while (current) {
                 if (current->ttl <= MESH_LITE_REPORT_INTERVAL_BUFFER) {
-                    esp_event_post(ESP_MESH_LITE_EVENT, ESP_MESH_LITE_EVENT_NODE_LEAVE, current->node, sizeof(esp_mesh_lite_node_info_t), 0);
+                    esp_mesh_lite_node_diff_post(ESP_MESH_LITE_NODE_DIFF_LEAVE, current->node);
                     if (node_info_list == current) {
                         node_info_list = current->next;
                         free(current->node);
@@ -219,6 +439,9 @@ static esp_err_t mesh_lite_update_nodes_list(uint8_t *data, uint32_t len, uint8_
             }
             xSemaphoreGive(node_info_mutex);
         }
+        if (versioned) {
+            esp_mesh_lite_nodes_reconcile(req);
+        }
         mesh_lite__data__free_unpacked(req, NULL);
     }
 
@@ -250,12 +473,71 @@ static const esp_mesh_lite_raw_msg_action_t raw_msgs_action[] = {
     {0, 0, NULL}
 };
 
+/* Called when this node becomes root, its replica of the node list becomes the node table */
+static void esp_mesh_lite_nodes_take_over(void)
+{
+    uint8_t mac[ETH_HWADDR_LEN];
+    uint32_t seeded = 0;
+
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+
+    xSemaphoreTake(node_info_mutex, portMAX_DELAY);
+    node_info_list_t* current = node_info_list;
+    node_info_list_t* prev = NULL;
+
+    while (current) {
+        /* The previous root is gone or below this node now, it reports again if it is still around */
+        if ((current->node->level == ROOT) && memcmp(current->node->mac_addr, mac, ETH_HWADDR_LEN)) {
+            esp_mesh_lite_node_diff_post(ESP_MESH_LITE_NODE_DIFF_LEAVE, current->node);
+            if (node_info_list == current) {
+                node_info_list = current->next;
+                free(current->node);
+                free(current);
+                current = node_info_list;
+            } else {
+                prev->next = current->next;
+                free(current->node);
+                free(current);
+                current = prev->next;
+            }
+            nodes_num--;
+            continue;
+        }
+        current->ttl = MESH_LITE_REPORT_TTL;
+        seeded++;
+        prev = current;
+        current = current->next;
+    }
+    nodes_generation++;
+    nodes_epoch = nodes_boot_epoch;
+    memcpy(nodes_root_mac, mac, ETH_HWADDR_LEN);
+    nodes_owned = true;
+    xSemaphoreGive(node_info_mutex);
+
+    ESP_LOGI(TAG, "Root at %" PRId64 " ms, node table seeded with %" PRIu32 " nodes, generation %" PRIu32,
+             esp_timer_get_time() / 1000, seeded, nodes_generation);
+
+    /* Records this node as root, and the broadcast lets the other nodes reconcile their entry */
+    esp_mesh_lite_report_info();
+    esp_mesh_lite_nodes_broadcast_request();
+}
+
 static void root_timer_cb(TimerHandle_t timer)
 {
+    /* The report timer is one-shot, a restart lost to a full timer queue would stop the reports for good */
+    if (!xTimerIsTimerActive(report_timer)) {
+        xTimerChangePeriod(report_timer, MAX(pdMS_TO_TICKS(esp_mesh_lite_report_jitter(report_interval_ms)), 1), 0);
+    }
+
     if (esp_mesh_lite_get_level() > ROOT) {
+        nodes_owned = false;
         return;
     }
 
+    if ((esp_mesh_lite_get_level() == ROOT) && !nodes_owned) {
+        esp_mesh_lite_nodes_take_over();
+    }
+
     if (xSemaphoreTake(node_info_mutex, 0) != pdTRUE) {
         return;
     }
@@ -265,7 +547,10 @@ static void root_timer_cb(TimerHandle_t timer)
 
     while (current) {
         if (current->ttl == 0) {
-            esp_event_post(ESP_MESH_LITE_EVENT, ESP_MESH_LITE_EVENT_NODE_LEAVE, current->node, sizeof(esp_mesh_lite_node_info_t), 0);
+            esp_mesh_lite_node_diff_post(ESP_MESH_LITE_NODE_DIFF_LEAVE, current->node);
+            if (nodes_owned) {
+                nodes_generation++;
+            }
             if (node_info_list == current) {
                 node_info_list = current->next;
                 free(current->node);
@@ -294,6 +579,7 @@ static esp_err_t esp_mesh_lite_update_nodes_info_to_children(void)
     uint32_t total_num = 0;
 
     mesh_lite__data__init(&req);
+    xSemaphoreTake(node_info_mutex, portMAX_DELAY);
     const node_info_list_t *node = esp_mesh_lite_get_nodes_list(&total_num);
     if (total_num > 0) {
         uint32_t loop = 0;
@@ -309,6 +595,11 @@ static esp_err_t esp_mesh_lite_update_nodes_info_to_children(void)
             node = node->next;
         }
         req.n_nodes = loop;
+        req.generation = nodes_generation;
+        req.root_mac.len = ETH_HWADDR_LEN;
+        req.root_mac.data = nodes_root_mac;
+        req.epoch = nodes_epoch;
+        xSemaphoreGive(node_info_mutex);
         size_t outlen = mesh_lite__data__get_packed_size(&req);
         uint8_t* outdata = malloc(outlen);
         mesh_lite__data__pack(&req, outdata);
@@ -330,29 +621,119 @@ static esp_err_t esp_mesh_lite_update_nodes_info_to_children(void)
         };
         esp_mesh_lite_send_msg(ESP_MESH_LITE_RAW_MSG, &config);
         free(outdata);
+    } else {
+        xSemaphoreGive(node_info_mutex);
     }
     return ESP_OK;
 }
 
+/* Called with nodes_broadcast_lock held */
+static void esp_mesh_lite_nodes_broadcast_refill(int64_t now)
+{
+    int64_t windows = (now - nodes_broadcast_refill_time) / MESH_LITE_NODES_BROADCAST_WINDOW_US;
+
+    if (windows <= 0) {
+        return;
+    }
+    nodes_broadcast_tokens = MIN(CONFIG_MESH_LITE_NODES_BROADCAST_BURST, nodes_broadcast_tokens + windows);
+    nodes_broadcast_refill_time = (nodes_broadcast_tokens == CONFIG_MESH_LITE_NODES_BROADCAST_BURST) ?
+                                  now : nodes_broadcast_refill_time + windows * MESH_LITE_NODES_BROADCAST_WINDOW_US;
+}
+
+/*
+ * Send the node list to the children, right away if a token is left, otherwise once the next token
+ * is due. All the requests in between are served by that single broadcast of the then current list.
+ */
+static void esp_mesh_lite_nodes_broadcast_request(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t delay_us = 0;
+    bool send_now = false;
+
+    portENTER_CRITICAL(&nodes_broadcast_lock);
+    esp_mesh_lite_nodes_broadcast_refill(now);
+    if (nodes_broadcast_pending) {
+        nodes_broadcast_coalesced++;
+    } else if (nodes_broadcast_tokens > 0) {
+        nodes_broadcast_tokens--;
+        send_now = true;
+    } else {
+        nodes_broadcast_pending = true;
+        delay_us = nodes_broadcast_refill_time + MESH_LITE_NODES_BROADCAST_WINDOW_US - now;
+    }
+    portEXIT_CRITICAL(&nodes_broadcast_lock);
+
+    if (!send_now && delay_us > 0
+            && xTimerChangePeriod(nodes_broadcast_timer, MAX(pdMS_TO_TICKS(delay_us / 1000), 1), 0) != pdPASS) {
+        /* Timer queue full: nothing would ever clear pending, send now instead */
+        portENTER_CRITICAL(&nodes_broadcast_lock);
+        nodes_broadcast_pending = false;
+        nodes_broadcast_coalesced = 0;
+        portEXIT_CRITICAL(&nodes_broadcast_lock);
+        send_now = true;
+    }
+    if (send_now) {
+        esp_mesh_lite_update_nodes_info_to_children();
+    }
+}
+
+static void nodes_broadcast_timer_cb(TimerHandle_t timer)
+{
+    portENTER_CRITICAL(&nodes_broadcast_lock);
+    uint32_t coalesced = nodes_broadcast_coalesced;
+    nodes_broadcast_pending = false;
+    nodes_broadcast_coalesced = 0;
+    portEXIT_CRITICAL(&nodes_broadcast_lock);
+
+    ESP_LOGD(TAG, "Node list broadcast, %" PRIu32 " more changes coalesced", coalesced);
+    if (esp_mesh_lite_get_level() == ROOT) {
+        esp_mesh_lite_nodes_broadcast_request();
+    }
+}
+
+/* Random offset of up to CONFIG_MESH_LITE_REPORT_JITTER percent either way */
+static uint32_t esp_mesh_lite_report_jitter(uint32_t interval_ms)
+{
+    uint32_t span = interval_ms / 100 * CONFIG_MESH_LITE_REPORT_JITTER;
+    return interval_ms - span + (span ? esp_random() % (2 * span + 1) : 0);
+}
+
+/* Report after a short random delay and restart from the fast interval, e.g. after getting an IP */
+static void esp_mesh_lite_report_soon(void)
+{
+    uint32_t delay_ms = CONFIG_MESH_LITE_REPORT_SPLAY_MS ? esp_random() % (CONFIG_MESH_LITE_REPORT_SPLAY_MS + 1) : 0;
+
+    report_interval_ms = MESH_LITE_REPORT_INTERVAL_MIN_MS;
+    report_soon_time = esp_timer_get_time();
+    if (xTimerChangePeriod(report_timer, MAX(pdMS_TO_TICKS(delay_ms), 1), 0) != pdPASS) {
+        /* The timer keeps its current period, root_timer_cb restarts it if it stopped */
+        ESP_LOGW(TAG, "Report timer busy, report at the next interval");
+    }
+}
+
 static void report_timer_cb(TimerHandle_t timer)
 {
     esp_mesh_lite_report_info();
 
     if (esp_mesh_lite_get_level() == ROOT) {
-        esp_mesh_lite_update_nodes_info_to_children();
+        esp_mesh_lite_nodes_broadcast_request();
     }
+
+    /* Restarted by root_timer_cb if the timer queue is full */
+    xTimerChangePeriod(report_timer, MAX(pdMS_TO_TICKS(esp_mesh_lite_report_jitter(report_interval_ms)), 1), 0);
+    report_interval_ms = MIN(report_interval_ms * 2, MESH_LITE_REPORT_INTERVAL_MAX_MS);
 }
 
 static void esp_mesh_lite_event_got_ip_handler(void *arg, esp_event_base_t event_base,
                                                int32_t event_id, void *event_data)
 {
-    esp_mesh_lite_report_info();
+    esp_mesh_lite_report_soon();
 }
 
 static void esp_mesh_lite_event_ap_sta_ip_assigned_handler(void *arg, esp_event_base_t event_base,
                                                            int32_t event_id, void *event_data)
 {
-    esp_mesh_lite_report_info();
+    esp_mesh_lite_report_soon();
 }
 #endif // CONFIG_MESH_LITE_NODE_INFO_REPORT
 
@@ -431,29 +812,43 @@ void esp_mesh_lite_init(esp_mesh_lite_config_t* config)
 
     esp_mesh_lite_core_init(config);
 #if CONFIG_MESH_LITE_NODE_INFO_REPORT
-    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &esp_mesh_lite_event_got_ip_handler, NULL, NULL);
-    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, &esp_mesh_lite_event_ap_sta_ip_assigned_handler, NULL, NULL);
-
+    esp_mesh_lite_node_events_init();
+    /* Never 0, that is the epoch of roots that do not send one */
+    nodes_boot_epoch = esp_random() | 1;
     node_info_mutex = xSemaphoreCreateMutex();
 
     esp_mesh_lite_raw_msg_action_list_register(raw_msgs_action);
 
-    TimerHandle_t report_timer = xTimerCreate("report_timer", CONFIG_MESH_LITE_REPORT_INTERVAL * 1000 / portTICK_PERIOD_MS,
-                                              pdTRUE, NULL, report_timer_cb);
+    report_timer = xTimerCreate("report_timer", pdMS_TO_TICKS(esp_mesh_lite_report_jitter(report_interval_ms)),
+                                pdFALSE, NULL, report_timer_cb);
+    nodes_broadcast_timer = xTimerCreate("nodes_broadcast", pdMS_TO_TICKS(CONFIG_MESH_LITE_NODES_BROADCAST_WINDOW_MS),
+                                         pdFALSE, NULL, nodes_broadcast_timer_cb);
     TimerHandle_t root_timer = xTimerCreate("root_timer", 1 * 1000 / portTICK_PERIOD_MS,
                                             pdTRUE, NULL, root_timer_cb);
     xTimerStart(report_timer, portMAX_DELAY);
     xTimerStart(root_timer, portMAX_DELAY);
 
+    /* The handlers reschedule report_timer */
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &esp_mesh_lite_event_got_ip_handler, NULL, NULL);
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, &esp_mesh_lite_event_ap_sta_ip_assigned_handler, NULL, NULL);
+
     uint8_t mac[6];
     esp_wifi_get_mac(WIFI_IF_STA, mac);
-    esp_mesh_lite_node_info_update(0, mac, 0);
+    esp_mesh_lite_node_info_update(0, mac, 0, NULL);
 #endif /* MESH_LITE_NODE_INFO_REPORT */
 
 #if CONFIG_MESH_LITE_WIRELESS_DEBUG
     esp_mesh_lite_wireless_debug_init();
 #endif
 
+#ifdef CONFIG_ESP_MESH_LITE_OTA_ENABLE
+    esp_mesh_lite_ota_init();
+#endif
+
+#if CONFIG_MESH_LITE_TIME_SYNC_ENABLE
+    esp_mesh_lite_time_sync_init();
+#endif
+
 #if CONFIG_OTA_AUTO_CANCEL_ROLLBACK
     const esp_partition_t *running = esp_ota_get_running_partition();
     esp_ota_img_states_t ota_state;
@@ -6,22 +6,77 @@
 
 #include <string.h>
 #include <inttypes.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_mesh_lite.h"
 
 static uint8_t espnow_data[ESPNOW_PAYLOAD_MAX_LEN];
 static esp_mesh_lite_espnow_handler_failed_hook_t espnow_recv_failed_hook = NULL;
+static esp_mesh_lite_espnow_rx_hook_t espnow_rx_hook = NULL;
 static espnow_cb_register_t *esp_mesh_lite_espnow_cb_list = NULL;
 static bool espnow_init = false;
 
+typedef struct {
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t channel;
+    wifi_interface_t ifidx;
+    uint32_t last_used;
+    bool valid;
+} espnow_peer_cache_t;
+
+static espnow_peer_cache_t espnow_peer_cache[CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM];
+static esp_mesh_lite_espnow_peer_stats_t espnow_peer_stats;
+static uint32_t espnow_peer_tick = 0;
+static portMUX_TYPE espnow_peer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#define ESPNOW_CAPS_REQUEST_INTERVAL_MS  (5000)
+#define ESPNOW_CAPS_REQUEST_BACKOFF_MAX  (4)    /* Unanswered requests are spaced up to 16 times the interval */
+
+typedef enum {
+    ESPNOW_CAPS_REQUEST,
+    ESPNOW_CAPS_REPLY,
+} espnow_caps_msg_type_t;
+
+/* Sent in ESPNOW_DATA_TYPE_CAPABILITY frames, newer versions may append fields */
+typedef struct {
+    uint8_t type;
+    uint8_t version;
+    uint16_t max_payload;
+    uint32_t codecs;
+} __attribute__((packed)) espnow_caps_msg_t;
+
+typedef struct {
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    esp_mesh_lite_espnow_caps_t caps;
+    TickType_t last_request;
+    uint8_t requests;           /* Unanswered requests */
+    uint32_t last_used;
+    bool known;
+    bool reply;                 /* A request is waiting for the reply */
+    bool valid;
+} espnow_caps_cache_t;
+
+static espnow_caps_cache_t espnow_caps_cache[CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM];
+static esp_mesh_lite_espnow_caps_t espnow_local_caps;
+static uint32_t espnow_caps_tick = 0;
+static bool espnow_caps_reply_scheduled = false;
+static portMUX_TYPE espnow_caps_lock = portMUX_INITIALIZER_UNLOCKED;
+
 esp_err_t esp_mesh_lite_espnow_register_handler_failed_callback(esp_mesh_lite_espnow_handler_failed_hook_t cb)
 {
     espnow_recv_failed_hook = cb;
     return ESP_OK;
 }
 
+esp_err_t esp_mesh_lite_espnow_register_rx_hook(esp_mesh_lite_espnow_rx_hook_t cb)
+{
+    espnow_rx_hook = cb;
+    return ESP_OK;
+}
+
 static inline esp_err_t esp_mesh_lite_espnow_recv_callback(uint8_t type, const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
 {
     esp_err_t ret = ESP_FAIL;
@@ -38,6 +93,10 @@ static inline esp_err_t esp_mesh_lite_espnow_recv_callback(uint8_t type, const e
 
 static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
 {
+    if (espnow_rx_hook) {
+        espnow_rx_hook(recv_info, len);
+    }
+
     esp_err_t ret = esp_mesh_lite_espnow_recv_callback(data[0], recv_info, data + 1, len - 1);
 
     if (ret != ESP_OK) {
@@ -98,6 +157,324 @@ esp_err_t esp_mesh_lite_espnow_recv_cb_unregister(esp_mesh_lite_espnow_data_type
     return ESP_ERR_NOT_FOUND;
 }
 
+/* Called with espnow_peer_lock held */
+static espnow_peer_cache_t *espnow_peer_cache_find(const uint8_t *peer_addr)
+{
+    for (int i = 0; i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM; i++) {
+        if (espnow_peer_cache[i].valid && !memcmp(espnow_peer_cache[i].peer_addr, peer_addr, ESP_NOW_ETH_ALEN)) {
+            return &espnow_peer_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static void espnow_peer_cache_invalidate(const uint8_t *peer_addr)
+{
+    portENTER_CRITICAL(&espnow_peer_lock);
+    espnow_peer_cache_t *entry = espnow_peer_cache_find(peer_addr);
+    if (entry) {
+        entry->valid = false;
+    }
+    portEXIT_CRITICAL(&espnow_peer_lock);
+}
+
+/* Deletes the least recently used cached peer from the driver, returns false if there is none */
+static bool espnow_peer_cache_evict(void)
+{
+    uint8_t victim[ESP_NOW_ETH_ALEN];
+    espnow_peer_cache_t *lru = NULL;
+
+    portENTER_CRITICAL(&espnow_peer_lock);
+    for (int i = 0; i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM; i++) {
+        if (espnow_peer_cache[i].valid && (!lru || espnow_peer_tick - espnow_peer_cache[i].last_used > espnow_peer_tick - lru->last_used)) {
+            lru = &espnow_peer_cache[i];
+        }
+    }
+    if (lru) {
+        memcpy(victim, lru->peer_addr, ESP_NOW_ETH_ALEN);
+        lru->valid = false;
+        espnow_peer_stats.evictions++;
+    }
+    portEXIT_CRITICAL(&espnow_peer_lock);
+
+    if (lru) {
+        esp_now_del_peer(victim);
+    }
+    return lru != NULL;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_add(const uint8_t *peer_addr, uint8_t channel, wifi_interface_t ifidx)
+{
+    bool cached = false;
+    espnow_peer_cache_t *slot = NULL;
+
+    portENTER_CRITICAL(&espnow_peer_lock);
+    espnow_peer_cache_t *entry = espnow_peer_cache_find(peer_addr);
+    if (entry && entry->channel == channel && entry->ifidx == ifidx) {
+        entry->last_used = ++espnow_peer_tick;
+        espnow_peer_stats.hits++;
+        portEXIT_CRITICAL(&espnow_peer_lock);
+        return ESP_OK;
+    }
+    cached = entry != NULL;
+    for (int i = 0; !cached && i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM && !slot; i++) {
+        if (!espnow_peer_cache[i].valid) {
+            slot = &espnow_peer_cache[i];
+        }
+    }
+    portEXIT_CRITICAL(&espnow_peer_lock);
+
+    esp_now_peer_info_t peer = {
+        .channel = channel,
+        .ifidx = ifidx,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, peer_addr, ESP_NOW_ETH_ALEN);
+
+    esp_err_t ret = ESP_OK;
+    if (cached) {
+        ret = esp_now_mod_peer(&peer);
+    } else {
+        if (!slot) {
+            espnow_peer_cache_evict();
+        }
+        ret = esp_now_add_peer(&peer);
+        if (ret == ESP_ERR_ESPNOW_FULL && espnow_peer_cache_evict()) {
+            // Filled up by peers added outside of the cache
+            ret = esp_now_add_peer(&peer);
+        }
+        if (ret == ESP_ERR_ESPNOW_EXIST) {
+            ret = esp_now_mod_peer(&peer);
+        }
+    }
+    if (ret == ESP_ERR_ESPNOW_NOT_FOUND) {
+        // Deleted from the driver behind the back of the cache
+        ret = esp_now_add_peer(&peer);
+    }
+    if (ret != ESP_OK) {
+        espnow_peer_cache_invalidate(peer_addr);
+        return ret;
+    }
+
+    portENTER_CRITICAL(&espnow_peer_lock);
+    entry = espnow_peer_cache_find(peer_addr);
+    for (int i = 0; i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM && !entry; i++) {
+        if (!espnow_peer_cache[i].valid) {
+            entry = &espnow_peer_cache[i];
+        }
+    }
+    if (entry) {
+        memcpy(entry->peer_addr, peer_addr, ESP_NOW_ETH_ALEN);
+        entry->channel = channel;
+        entry->ifidx = ifidx;
+        entry->last_used = ++espnow_peer_tick;
+        entry->valid = true;
+    }
+    if (cached) {
+        espnow_peer_stats.mods++;
+    } else {
+        espnow_peer_stats.adds++;
+    }
+    portEXIT_CRITICAL(&espnow_peer_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_del(const uint8_t *peer_addr)
+{
+    espnow_peer_cache_invalidate(peer_addr);
+    return esp_now_del_peer(peer_addr);
+}
+
+void esp_mesh_lite_espnow_peer_get_stats(esp_mesh_lite_espnow_peer_stats_t *stats)
+{
+    portENTER_CRITICAL(&espnow_peer_lock);
+    *stats = espnow_peer_stats;
+    portEXIT_CRITICAL(&espnow_peer_lock);
+}
+
+/* Called with espnow_caps_lock held */
+static espnow_caps_cache_t *espnow_caps_cache_find(const uint8_t *peer_addr)
+{
+    for (int i = 0; i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM; i++) {
+        espnow_caps_cache_t *entry = &espnow_caps_cache[i];
+        if (entry->valid && !memcmp(entry->peer_addr, peer_addr, ESP_NOW_ETH_ALEN)) {
+            entry->last_used = ++espnow_caps_tick;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Called with espnow_caps_lock held, reuses the least recently used entry when the peer is not cached */
+static espnow_caps_cache_t *espnow_caps_cache_get(const uint8_t *peer_addr)
+{
+    espnow_caps_cache_t *lru = espnow_caps_cache_find(peer_addr);
+
+    if (lru) {
+        return lru;
+    }
+    for (int i = 0; i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM; i++) {
+        espnow_caps_cache_t *entry = &espnow_caps_cache[i];
+        if (!lru || (lru->valid && (!entry->valid || espnow_caps_tick - entry->last_used > espnow_caps_tick - lru->last_used))) {
+            lru = entry;
+        }
+    }
+
+    memset(lru, 0x0, sizeof(espnow_caps_cache_t));
+    memcpy(lru->peer_addr, peer_addr, ESP_NOW_ETH_ALEN);
+    lru->last_used = ++espnow_caps_tick;
+    lru->valid = true;
+    return lru;
+}
+
+static esp_err_t espnow_caps_send(const uint8_t *peer_addr, espnow_caps_msg_type_t type)
+{
+    uint8_t frame[1 + sizeof(espnow_caps_msg_t)];
+    espnow_caps_msg_t msg = {
+        .type = type,
+        .version = espnow_local_caps.version,
+        .max_payload = espnow_local_caps.max_payload,
+        .codecs = espnow_local_caps.codecs,
+    };
+
+    frame[0] = ESPNOW_DATA_TYPE_CAPABILITY;
+    memcpy(&frame[1], &msg, sizeof(msg));
+
+    if (!esp_now_is_peer_exist(peer_addr)) {
+        esp_err_t ret = esp_mesh_lite_espnow_peer_add(peer_addr, 0, WIFI_IF_STA);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    // Not through espnow_data, which belongs to the callers of esp_mesh_lite_espnow_send()
+    return esp_now_send(peer_addr, frame, sizeof(frame));
+}
+
+/* Runs in the timer task, replies are not sent from the receive callback in the Wi-Fi task */
+static void espnow_caps_reply_pending(void *arg1, uint32_t arg2)
+{
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+
+    for (;;) {
+        bool found = false;
+        portENTER_CRITICAL(&espnow_caps_lock);
+        for (int i = 0; i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM && !found; i++) {
+            if (espnow_caps_cache[i].valid && espnow_caps_cache[i].reply) {
+                espnow_caps_cache[i].reply = false;
+                memcpy(peer_addr, espnow_caps_cache[i].peer_addr, ESP_NOW_ETH_ALEN);
+                found = true;
+            }
+        }
+        if (!found) {
+            espnow_caps_reply_scheduled = false;
+        }
+        portEXIT_CRITICAL(&espnow_caps_lock);
+
+        if (!found) {
+            break;
+        }
+        espnow_caps_send(peer_addr, ESPNOW_CAPS_REPLY);
+    }
+}
+
+static esp_err_t espnow_caps_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    espnow_caps_msg_t msg;
+    bool schedule = false;
+
+    if (len < sizeof(espnow_caps_msg_t)) {
+        return ESP_FAIL;
+    }
+    memcpy(&msg, data, sizeof(msg));
+
+    portENTER_CRITICAL(&espnow_caps_lock);
+    espnow_caps_cache_t *entry = espnow_caps_cache_get(recv_info->src_addr);
+    entry->caps.version = msg.version;
+    entry->caps.max_payload = MAX(msg.max_payload, ESP_NOW_MAX_DATA_LEN);
+    entry->caps.codecs = msg.codecs;
+    entry->requests = 0;
+    entry->known = true;
+    // A request carries the capabilities of the requester, so one exchange informs both ends
+    if (msg.type == ESPNOW_CAPS_REQUEST) {
+        entry->reply = true;
+        schedule = !espnow_caps_reply_scheduled;
+        espnow_caps_reply_scheduled = true;
+    }
+    portEXIT_CRITICAL(&espnow_caps_lock);
+
+    if (schedule && xTimerPendFunctionCall(espnow_caps_reply_pending, NULL, 0, 0) != pdPASS) {
+        // Timer queue full, the requester asks again
+        portENTER_CRITICAL(&espnow_caps_lock);
+        espnow_caps_reply_scheduled = false;
+        portEXIT_CRITICAL(&espnow_caps_lock);
+    }
+    return ESP_OK;
+}
+
+void esp_mesh_lite_espnow_set_codecs(uint32_t codecs)
+{
+    espnow_local_caps.codecs = codecs;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_query_caps(const uint8_t *peer_addr)
+{
+    if (IS_BROADCAST_ADDR(peer_addr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_ERR_NOT_FINISHED;
+    bool request = false;
+    TickType_t now = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&espnow_caps_lock);
+    espnow_caps_cache_t *entry = espnow_caps_cache_get(peer_addr);
+    if (entry->known) {
+        ret = ESP_OK;
+    } else if (!entry->requests
+               || now - entry->last_request >= pdMS_TO_TICKS(ESPNOW_CAPS_REQUEST_INTERVAL_MS) << MIN(entry->requests - 1, ESPNOW_CAPS_REQUEST_BACKOFF_MAX)) {
+        entry->last_request = now;
+        entry->requests = MIN(entry->requests + 1, UINT8_MAX);
+        request = true;
+    }
+    portEXIT_CRITICAL(&espnow_caps_lock);
+
+    if (request) {
+        ret = espnow_caps_send(peer_addr, ESPNOW_CAPS_REQUEST);
+    }
+    return ret;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_get_caps(const uint8_t *peer_addr, esp_mesh_lite_espnow_caps_t *caps)
+{
+    if (IS_BROADCAST_ADDR(peer_addr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    portENTER_CRITICAL(&espnow_caps_lock);
+    espnow_caps_cache_t *entry = espnow_caps_cache_find(peer_addr);
+    if (entry && entry->known) {
+        *caps = entry->caps;
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&espnow_caps_lock);
+    return ret;
+}
+
+size_t esp_mesh_lite_espnow_max_data_len(const uint8_t *peer_addr)
+{
+    esp_mesh_lite_espnow_caps_t caps;
+    size_t max_len = ESP_NOW_MAX_DATA_LEN;
+
+    if (!IS_BROADCAST_ADDR(peer_addr) && esp_mesh_lite_espnow_peer_get_caps(peer_addr, &caps) == ESP_OK) {
+        max_len = MIN(caps.max_payload, ESPNOW_PAYLOAD_MAX_LEN);
+    }
+    // One byte goes to the data type
+    return max_len - 1;
+}
+
 esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *peer_addr, const uint8_t *data, size_t len)
 {
     if (espnow_init == false) {
@@ -111,6 +488,9 @@ esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *peer_addr, const uint
     memcpy(&espnow_data[1], data, len);
 
     esp_err_t ret = esp_now_send(peer_addr, espnow_data, len + 1);
+    if (ret == ESP_ERR_ESPNOW_NOT_FOUND) {
+        espnow_peer_cache_invalidate(peer_addr);
+    }
 
     return ret;
 }
@@ -121,7 +501,7 @@ esp_err_t esp_mesh_lite_espnow_send_and_del_peer(uint8_t type, uint8_t *peer_add
 
     // Check if peer_addr is a broadcast address
     if (!IS_BROADCAST_ADDR(peer_addr)) {
-        esp_now_del_peer(peer_addr);
+        esp_mesh_lite_espnow_peer_del(peer_addr);
     }
 
     return ret;
@@ -142,5 +522,11 @@ esp_err_t esp_mesh_lite_espnow_init(void)
 
     espnow_init = true;
 
+    uint32_t version = 1;
+    esp_now_get_version(&version);
+    espnow_local_caps.version = version;
+    espnow_local_caps.max_payload = ESPNOW_PAYLOAD_MAX_LEN;
+    esp_mesh_lite_espnow_recv_cb_register(ESPNOW_DATA_TYPE_CAPABILITY, espnow_caps_recv_cb);
+
     return ESP_OK;
 }
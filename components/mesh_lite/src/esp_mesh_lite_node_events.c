@@ -0,0 +1,204 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_mesh_lite.h"
+#include "esp_mesh_lite_node_events.h"
+
+static const char *TAG = "Mesh-Lite-Node-Events";
+
+#define NODE_EVENTS_TASK_STACK      3072
+#define NODE_EVENTS_TASK_PRIORITY   4
+
+typedef struct {
+    esp_mesh_lite_node_diff_cb_t cb;
+    void *arg;
+} node_events_subscriber_t;
+
+/*
+ * Changes are coalesced into pending_diffs, at most one entry per MAC. The task swaps it with
+ * deliver_diffs at the end of the window, so posting goes on while the batch is delivered.
+ */
+static esp_mesh_lite_node_diff_t *pending_diffs = NULL;
+static esp_mesh_lite_node_diff_t *deliver_diffs = NULL;
+static size_t pending_num = 0;
+static uint32_t pending_posted = 0;
+static bool pending_overflow = false;
+static node_events_subscriber_t subscribers[CONFIG_MESH_LITE_NODE_EVENT_SUBSCRIBERS];
+static size_t subscriber_num = 0;
+static portMUX_TYPE node_events_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t node_events_task = NULL;
+
+esp_err_t esp_mesh_lite_node_diff_subscribe(esp_mesh_lite_node_diff_cb_t cb, void *arg)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&node_events_lock);
+    if (subscriber_num < CONFIG_MESH_LITE_NODE_EVENT_SUBSCRIBERS) {
+        subscribers[subscriber_num].cb = cb;
+        subscribers[subscriber_num].arg = arg;
+        subscriber_num++;
+    } else {
+        ret = ESP_ERR_NO_MEM;
+    }
+    portEXIT_CRITICAL(&node_events_lock);
+    return ret;
+}
+
+/* Called with node_events_lock held, returns false if the entry was cancelled out */
+static bool esp_mesh_lite_node_diff_merge(esp_mesh_lite_node_diff_t *diff, esp_mesh_lite_node_diff_type_t type,
+                                          const esp_mesh_lite_node_info_t *node)
+{
+    switch (type) {
+    case ESP_MESH_LITE_NODE_DIFF_LEAVE:
+        /* Joined and left within the window, nothing happened as far as subscribers are concerned */
+        if (diff->type == ESP_MESH_LITE_NODE_DIFF_JOIN) {
+            return false;
+        }
+        diff->type = ESP_MESH_LITE_NODE_DIFF_LEAVE;
+        break;
+    case ESP_MESH_LITE_NODE_DIFF_JOIN:
+    case ESP_MESH_LITE_NODE_DIFF_CHANGE:
+        /* Left and came back is a change, a change of a node that just joined is still a join */
+        if (diff->type == ESP_MESH_LITE_NODE_DIFF_LEAVE) {
+            diff->type = ESP_MESH_LITE_NODE_DIFF_CHANGE;
+        }
+        break;
+    }
+    diff->node = *node;
+    return true;
+}
+
+void esp_mesh_lite_node_diff_post(esp_mesh_lite_node_diff_type_t type, const esp_mesh_lite_node_info_t *node)
+{
+#if CONFIG_MESH_LITE_NODE_EVENT_DEFAULT_LOOP
+    static const int32_t event_ids[] = {
+        [ESP_MESH_LITE_NODE_DIFF_JOIN] = ESP_MESH_LITE_EVENT_NODE_JOIN,
+        [ESP_MESH_LITE_NODE_DIFF_LEAVE] = ESP_MESH_LITE_EVENT_NODE_LEAVE,
+        [ESP_MESH_LITE_NODE_DIFF_CHANGE] = ESP_MESH_LITE_EVENT_NODE_CHANGE,
+    };
+    esp_event_post(ESP_MESH_LITE_EVENT, event_ids[type], node, sizeof(esp_mesh_lite_node_info_t), 0);
+#endif
+
+    if (pending_diffs == NULL) {
+        return;
+    }
+
+    bool wake = false;
+    portENTER_CRITICAL(&node_events_lock);
+    size_t i = 0;
+    for (; i < pending_num; i++) {
+        if (!memcmp(pending_diffs[i].node.mac_addr, node->mac_addr, ETH_HWADDR_LEN)) {
+            break;
+        }
+    }
+    if (i < pending_num) {
+        if (!esp_mesh_lite_node_diff_merge(&pending_diffs[i], type, node)) {
+            pending_diffs[i] = pending_diffs[--pending_num];
+        }
+    } else if (pending_num < CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE) {
+        pending_diffs[pending_num].type = type;
+        pending_diffs[pending_num].node = *node;
+        pending_num++;
+        /* A full batch is delivered without waiting for the end of the window */
+        wake = (pending_num == CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE);
+    } else {
+        pending_overflow = true;
+    }
+    /* The first change of a window starts it */
+    wake |= (pending_posted++ == 0);
+    portEXIT_CRITICAL(&node_events_lock);
+
+    if (wake) {
+        xTaskNotifyGive(node_events_task);
+    }
+}
+
+static void esp_mesh_lite_node_events_task(void *arg)
+{
+    node_events_subscriber_t subs[CONFIG_MESH_LITE_NODE_EVENT_SUBSCRIBERS];
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        /*
+         * Only a full batch notifies again within the window. Both notifications are taken at once
+         * if the batch filled up before this task ran, e.g. on a node list from the root.
+         */
+        portENTER_CRITICAL(&node_events_lock);
+        bool full = (pending_num == CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE);
+        portEXIT_CRITICAL(&node_events_lock);
+        if (!full) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS));
+        }
+
+        portENTER_CRITICAL(&node_events_lock);
+        esp_mesh_lite_node_diff_t *diffs = pending_diffs;
+        pending_diffs = deliver_diffs;
+        deliver_diffs = diffs;
+        esp_mesh_lite_node_diff_batch_t batch = {
+            .diffs = diffs,
+            .num = pending_num,
+            .posted = pending_posted,
+            .overflow = pending_overflow,
+        };
+        pending_num = 0;
+        pending_posted = 0;
+        pending_overflow = false;
+        size_t num = subscriber_num;
+        memcpy(subs, subscribers, sizeof(subs));
+        portEXIT_CRITICAL(&node_events_lock);
+
+        if (batch.posted == 0) {
+            continue;
+        }
+        if (batch.overflow) {
+            ESP_LOGW(TAG, "Node changes lost, more than %d nodes changed in a window", CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE);
+        }
+        batch.generation = esp_mesh_lite_get_nodes_generation();
+        ESP_LOGD(TAG, "%u node changes out of %" PRIu32 " posted", (unsigned)batch.num, batch.posted);
+
+        for (size_t i = 0; i < num; i++) {
+            subs[i].cb(&batch, subs[i].arg);
+        }
+    }
+}
+
+esp_err_t esp_mesh_lite_node_events_init(void)
+{
+    if (node_events_task) {
+        return ESP_OK;
+    }
+
+    esp_mesh_lite_node_diff_t *pending = calloc(CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE, sizeof(esp_mesh_lite_node_diff_t));
+    deliver_diffs = calloc(CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE, sizeof(esp_mesh_lite_node_diff_t));
+    if (pending == NULL || deliver_diffs == NULL) {
+        free(pending);
+        free(deliver_diffs);
+        deliver_diffs = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(esp_mesh_lite_node_events_task, "mesh_node_evt", NODE_EVENTS_TASK_STACK, NULL,
+                    NODE_EVENTS_TASK_PRIORITY, &node_events_task) != pdPASS) {
+        free(pending);
+        free(deliver_diffs);
+        deliver_diffs = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    /* Posting is enabled last, it needs the task */
+    pending_diffs = pending;
+    return ESP_OK;
+}
@@ -0,0 +1,654 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "mbedtls/sha256.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_mac.h"
+#include "esp_mesh_lite.h"
+#include "esp_mesh_lite_ota.h"
+#include "esp_mesh_lite_ota_pack.h"
+#include "mesh_lite.pb-c.h"
+
+static const char *TAG = "Mesh-Lite-OTA";
+
+#define OTA_PROGRESS_REPORT_STEP        5
+#define OTA_PROGRESS_LIST_GROW          8
+
+static SemaphoreHandle_t progress_mutex;
+static esp_mesh_lite_ota_progress_t *progress_list = NULL;
+static size_t progress_num = 0;
+static size_t progress_size = 0;
+static uint8_t reported_percentage = 0;
+
+#if CONFIG_MESH_LITE_OTA_RESUMABLE
+
+#define OTA_NVS_NAMESPACE               "mesh_lite_ota"
+#define OTA_NVS_KEY_INFO                "info"
+#define OTA_NVS_KEY_BITMAP              "bitmap"
+#define OTA_NVS_KEY_STAGED              "staged"
+#define OTA_FLASH_SECTOR_SIZE           4096
+#define OTA_BITMAP_SAVE_INTERVAL        32      // Chunks received between two bitmap writes to NVS
+
+/*
+ * Identifies the image a bitmap stored in NVS belongs to. The first chunk holds the pack header with
+ * the hash of the image, or the application description with the hash of the build, so its hash tells
+ * apart two builds under the same version and size. Zero until the first chunk has been received.
+ */
+typedef struct {
+    char fw_version[32];
+    int filesize;
+    uint32_t chunk_size;
+    uint8_t head_sha256[32];
+} ota_resume_info_t;
+
+typedef struct {
+    ota_resume_info_t info;
+    const esp_partition_t *partition;
+    uint32_t chunk_num;
+    uint32_t chunk_received;
+    uint8_t *chunk_bitmap;
+    uint32_t sector_num;
+    uint8_t *sector_erased;
+    uint32_t dirty;
+} ota_session_t;
+
+static ota_session_t *ota_session = NULL;
+static SemaphoreHandle_t ota_session_mutex;
+
+/* Complete update in the OTA partition, waiting for the reboot; served to children until then */
+static ota_resume_info_t pending_info;
+static const esp_partition_t *pending_partition = NULL;
+
+#if CONFIG_MESH_LITE_OTA_PACK
+/* Complete file kept in the staging partition, served to children after it has been installed */
+static ota_resume_info_t staged_info;
+static bool staged_valid = false;
+#endif
+
+static inline bool ota_bitmap_get(const uint8_t *bitmap, uint32_t index)
+{
+    return bitmap[index / 8] & (1 << (index % 8));
+}
+
+static inline void ota_bitmap_set(uint8_t *bitmap, uint32_t index)
+{
+    bitmap[index / 8] |= (1 << (index % 8));
+}
+
+static bool ota_head_sha256(const esp_mesh_lite_lan_ota_file_transfer_param_t *param, uint8_t *sha256)
+{
+    if (param->offset != 0 || param->data_size == 0) {
+        return false;
+    }
+    return mbedtls_sha256((const unsigned char *)param->data, param->data_size, sha256, 0) == 0;
+}
+
+static inline bool ota_head_known(const ota_resume_info_t *info)
+{
+    static const uint8_t zero[sizeof(info->head_sha256)];
+    return memcmp(info->head_sha256, zero, sizeof(zero));
+}
+
+/* Requests only carry the version and the size, the hash of the first chunk is checked when it comes by */
+static bool ota_session_match(const ota_session_t *session, const esp_mesh_lite_lan_ota_file_transfer_param_t *param,
+                              const uint8_t *head_sha256)
+{
+    return session->info.filesize == param->filesize
+           && !strncmp(session->info.fw_version, param->fw_version ? param->fw_version : "", sizeof(session->info.fw_version) - 1)
+           && (!head_sha256 || !ota_head_known(&session->info)
+               || !memcmp(session->info.head_sha256, head_sha256, sizeof(session->info.head_sha256)));
+}
+
+static void ota_session_save(ota_session_t *session)
+{
+    nvs_handle_t handle;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    nvs_set_blob(handle, OTA_NVS_KEY_INFO, &session->info, sizeof(session->info));
+    nvs_set_blob(handle, OTA_NVS_KEY_BITMAP, session->chunk_bitmap, (session->chunk_num + 7) / 8);
+    nvs_commit(handle);
+    nvs_close(handle);
+    session->dirty = 0;
+}
+
+static void ota_session_erase(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, OTA_NVS_KEY_INFO);
+        nvs_erase_key(handle, OTA_NVS_KEY_BITMAP);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+#if CONFIG_MESH_LITE_OTA_PACK
+static const esp_partition_t *ota_staging_partition(void)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_MESH_LITE_OTA_PACK_PARTITION_LABEL);
+}
+
+static void ota_staged_set(const ota_resume_info_t *info)
+{
+    nvs_handle_t handle;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+
+    if (info) {
+        memcpy(&staged_info, info, sizeof(staged_info));
+        nvs_set_blob(handle, OTA_NVS_KEY_STAGED, &staged_info, sizeof(staged_info));
+    } else {
+        nvs_erase_key(handle, OTA_NVS_KEY_STAGED);
+    }
+    staged_valid = (info != NULL);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void ota_staged_load(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        size_t len = sizeof(staged_info);
+        staged_valid = (nvs_get_blob(handle, OTA_NVS_KEY_STAGED, &staged_info, &len) == ESP_OK && len == sizeof(staged_info));
+        nvs_close(handle);
+    }
+}
+#endif /* CONFIG_MESH_LITE_OTA_PACK */
+
+static void ota_session_free(void)
+{
+    if (ota_session) {
+        free(ota_session->chunk_bitmap);
+        free(ota_session->sector_erased);
+        free(ota_session);
+        ota_session = NULL;
+    }
+}
+
+static void ota_session_mark_sectors(ota_session_t *session, size_t offset, size_t size)
+{
+    for (uint32_t sector = offset / OTA_FLASH_SECTOR_SIZE; sector <= (offset + size - 1) / OTA_FLASH_SECTOR_SIZE && sector < session->sector_num; sector++) {
+        ota_bitmap_set(session->sector_erased, sector);
+    }
+}
+
+/*
+ * The bitmap in NVS is only taken over when the transfer starts again from the first chunk and that
+ * chunk is the one of the saved image. A session opened on another chunk starts from scratch.
+ */
+static ota_session_t *ota_session_open(const esp_mesh_lite_lan_ota_file_transfer_param_t *param, const uint8_t *head_sha256)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+#if CONFIG_MESH_LITE_OTA_PACK
+    /* With a staging partition the file is kept as received, packed or not, and installed at the end */
+    if (ota_staging_partition()) {
+        partition = ota_staging_partition();
+    }
+#endif
+    if (!partition || param->filesize <= 0 || param->filesize > partition->size) {
+        ESP_LOGE(TAG, "No update partition for a %d bytes image", param->filesize);
+        return NULL;
+    }
+
+    ota_session_t *session = calloc(1, sizeof(ota_session_t));
+    if (!session) {
+        return NULL;
+    }
+    if (partition == pending_partition) {
+        /* About to be overwritten */
+        pending_partition = NULL;
+    }
+    strlcpy(session->info.fw_version, param->fw_version ? param->fw_version : "", sizeof(session->info.fw_version));
+    session->info.filesize = param->filesize;
+    session->info.chunk_size = OTA_DATA_LEN;
+    if (head_sha256) {
+        memcpy(session->info.head_sha256, head_sha256, sizeof(session->info.head_sha256));
+    }
+    session->partition = partition;
+    session->chunk_num = (param->filesize + OTA_DATA_LEN - 1) / OTA_DATA_LEN;
+    session->sector_num = (param->filesize + OTA_FLASH_SECTOR_SIZE - 1) / OTA_FLASH_SECTOR_SIZE;
+    session->chunk_bitmap = calloc((session->chunk_num + 7) / 8, 1);
+    session->sector_erased = calloc((session->sector_num + 7) / 8, 1);
+    if (!session->chunk_bitmap || !session->sector_erased) {
+        free(session->chunk_bitmap);
+        free(session->sector_erased);
+        free(session);
+        return NULL;
+    }
+
+    nvs_handle_t handle;
+    if (head_sha256 && nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        ota_resume_info_t info;
+        size_t len = sizeof(info);
+        if (nvs_get_blob(handle, OTA_NVS_KEY_INFO, &info, &len) == ESP_OK && len == sizeof(info)
+                && !memcmp(&info, &session->info, sizeof(info))) {
+            len = (session->chunk_num + 7) / 8;
+            if (nvs_get_blob(handle, OTA_NVS_KEY_BITMAP, session->chunk_bitmap, &len) != ESP_OK) {
+                memset(session->chunk_bitmap, 0x0, (session->chunk_num + 7) / 8);
+            }
+        }
+        nvs_close(handle);
+    }
+
+    /* Sectors holding a received chunk are already erased and must not be erased again */
+    for (uint32_t i = 0; i < session->chunk_num; i++) {
+        if (ota_bitmap_get(session->chunk_bitmap, i)) {
+            session->chunk_received++;
+            ota_session_mark_sectors(session, i * OTA_DATA_LEN, OTA_DATA_LEN);
+        }
+    }
+
+#if CONFIG_MESH_LITE_OTA_PACK
+    if (staged_valid) {
+        ota_staged_set(NULL);
+    }
+#endif
+
+    if (session->chunk_received) {
+        ESP_LOGI(TAG, "Resume LAN OTA of %s, %"PRIu32"/%"PRIu32" chunks on flash", session->info.fw_version, session->chunk_received, session->chunk_num);
+    } else {
+        ota_session_save(session);
+    }
+    return session;
+}
+
+static esp_err_t ota_session_prepare_sectors(ota_session_t *session, size_t offset, size_t size)
+{
+    for (uint32_t sector = offset / OTA_FLASH_SECTOR_SIZE; sector <= (offset + size - 1) / OTA_FLASH_SECTOR_SIZE; sector++) {
+        if (!ota_bitmap_get(session->sector_erased, sector)) {
+            esp_err_t ret = esp_partition_erase_range(session->partition, sector * OTA_FLASH_SECTOR_SIZE, OTA_FLASH_SECTOR_SIZE);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            ota_bitmap_set(session->sector_erased, sector);
+        }
+    }
+    return ESP_OK;
+}
+
+static bool ota_session_chunk_aligned(const ota_session_t *session, size_t offset, size_t size)
+{
+    return (offset % OTA_DATA_LEN) == 0 && (size == OTA_DATA_LEN || offset + size >= session->info.filesize);
+}
+
+static esp_err_t ota_get_file_cb(esp_mesh_lite_lan_ota_file_transfer_param_t *param)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t sha256[32];
+    const uint8_t *head_sha256 = ota_head_sha256(param, sha256) ? sha256 : NULL;
+
+    xSemaphoreTake(ota_session_mutex, portMAX_DELAY);
+    if (ota_session && !ota_session_match(ota_session, param, head_sha256)) {
+        ota_session_free();
+    }
+
+    if (!ota_session) {
+        ota_session = ota_session_open(param, head_sha256);
+        if (!ota_session) {
+            ret = ESP_ERR_NO_MEM;
+            goto exit;
+        }
+    }
+
+    if (param->data_size == 0 || param->offset + param->data_size > ota_session->info.filesize) {
+        ret = ESP_ERR_INVALID_SIZE;
+        goto exit;
+    }
+
+    uint32_t chunk = param->offset / OTA_DATA_LEN;
+    bool aligned = ota_session_chunk_aligned(ota_session, param->offset, param->data_size);
+    if (aligned && ota_bitmap_get(ota_session->chunk_bitmap, chunk)) {
+        /* Already on flash from before a reboot */
+        goto exit;
+    }
+
+    ret = ota_session_prepare_sectors(ota_session, param->offset, param->data_size);
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(ota_session->partition, param->offset, param->data, param->data_size);
+    }
+
+    if (ret == ESP_OK && aligned) {
+        if (head_sha256 && !ota_head_known(&ota_session->info)) {
+            /* Opened on a later chunk, the saved bitmap can be resumed from now on */
+            memcpy(ota_session->info.head_sha256, head_sha256, sizeof(ota_session->info.head_sha256));
+        }
+        ota_bitmap_set(ota_session->chunk_bitmap, chunk);
+        ota_session->chunk_received++;
+        if (++ota_session->dirty >= OTA_BITMAP_SAVE_INTERVAL) {
+            ota_session_save(ota_session);
+        }
+    }
+
+exit:
+    xSemaphoreGive(ota_session_mutex);
+    return ret;
+}
+
+static esp_err_t ota_get_file_done(void)
+{
+    esp_err_t ret = ESP_FAIL;
+
+    xSemaphoreTake(ota_session_mutex, portMAX_DELAY);
+    if (ota_session) {
+#if CONFIG_MESH_LITE_OTA_PACK
+        if (ota_session->partition == ota_staging_partition()) {
+            ret = esp_mesh_lite_ota_pack_install(ota_session->partition, ota_session->info.filesize);
+            if (ret == ESP_OK) {
+                ota_staged_set(&ota_session->info);
+            }
+        } else
+#endif
+        {
+            /* Validates the image before switching to it */
+            ret = esp_ota_set_boot_partition(ota_session->partition);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Set boot partition fail: %s", esp_err_to_name(ret));
+            } else {
+                memcpy(&pending_info, &ota_session->info, sizeof(pending_info));
+                pending_partition = ota_session->partition;
+            }
+        }
+        ota_session_erase();
+        ota_session_free();
+    }
+    xSemaphoreGive(ota_session_mutex);
+    return ret;
+}
+
+/*
+ * Serve the running firmware as usual. While a transfer of the requested firmware is still in
+ * progress, serve the chunks that have already been written to the update partition instead,
+ * so that children can download in parallel with their parent. Once the transfer is complete,
+ * serve the update partition until the reboot, and never the running firmware under the
+ * version of another one.
+ */
+static esp_err_t ota_provide_file_cb(esp_mesh_lite_lan_ota_file_transfer_param_t *param)
+{
+    xSemaphoreTake(ota_session_mutex, portMAX_DELAY);
+    if (ota_session && ota_session_match(ota_session, param, NULL)) {
+        esp_err_t ret = ESP_OK;
+        if (param->data_size == 0 || param->offset + param->data_size > ota_session->info.filesize) {
+            ret = ESP_ERR_INVALID_SIZE;
+        } else {
+            uint32_t last = (param->offset + param->data_size - 1) / OTA_DATA_LEN;
+            for (uint32_t chunk = param->offset / OTA_DATA_LEN; chunk <= last; chunk++) {
+                if (!ota_bitmap_get(ota_session->chunk_bitmap, chunk)) {
+                    ret = ESP_ERR_NOT_FINISHED;
+                    break;
+                }
+            }
+        }
+
+        if (ret == ESP_OK) {
+            ret = esp_partition_read(ota_session->partition, param->offset, param->data, param->data_size);
+        }
+        xSemaphoreGive(ota_session_mutex);
+        return ret;
+    }
+
+#if CONFIG_MESH_LITE_OTA_PACK
+    /* Children expect the file as distributed, which may be packed, not the running image */
+    if (staged_valid && staged_info.filesize == param->filesize
+            && !strncmp(staged_info.fw_version, param->fw_version ? param->fw_version : "", sizeof(staged_info.fw_version) - 1)) {
+        xSemaphoreGive(ota_session_mutex);
+        return esp_partition_read(ota_staging_partition(), param->offset, param->data, param->data_size);
+    }
+#endif
+    if (pending_partition && pending_info.filesize == param->filesize
+            && !strncmp(pending_info.fw_version, param->fw_version ? param->fw_version : "", sizeof(pending_info.fw_version) - 1)) {
+        const esp_partition_t *partition = pending_partition;
+        xSemaphoreGive(ota_session_mutex);
+        return esp_partition_read(partition, param->offset, param->data, param->data_size);
+    }
+    xSemaphoreGive(ota_session_mutex);
+
+    /* Requests without a version predate the version check */
+    if (param->fw_version && param->fw_version[0]
+            && strncmp(esp_app_get_description()->version, param->fw_version, sizeof(esp_app_get_description()->version))) {
+        ESP_LOGD(TAG, "Firmware %s not available, running %s", param->fw_version, esp_app_get_description()->version);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const esp_partition_t *running_partition = esp_ota_get_running_partition();
+    return esp_partition_read(running_partition, param->offset, param->data, param->data_size);
+}
+
+static esp_mesh_lite_lan_ota_file_transfer_cb_t ota_resumable_cb = {
+    .provide_file_cb = ota_provide_file_cb,
+    .get_file_cb = ota_get_file_cb,
+    .get_file_done = ota_get_file_done,
+};
+#endif /* CONFIG_MESH_LITE_OTA_RESUMABLE */
+
+static void ota_progress_update(const uint8_t *mac, uint8_t level, uint8_t percentage,
+                                esp_mesh_lite_ota_state_t state, esp_mesh_lite_ota_finish_reason_t reason)
+{
+    xSemaphoreTake(progress_mutex, portMAX_DELAY);
+    esp_mesh_lite_ota_progress_t *node = NULL;
+    for (size_t i = 0; i < progress_num; i++) {
+        if (!memcmp(progress_list[i].mac_addr, mac, sizeof(progress_list[i].mac_addr))) {
+            node = &progress_list[i];
+            break;
+        }
+    }
+
+    if (!node) {
+        if (progress_num == progress_size) {
+            esp_mesh_lite_ota_progress_t *list = realloc(progress_list, (progress_size + OTA_PROGRESS_LIST_GROW) * sizeof(esp_mesh_lite_ota_progress_t));
+            if (!list) {
+                xSemaphoreGive(progress_mutex);
+                ESP_LOGE(TAG, "progress add fail(no mem)");
+                return;
+            }
+            progress_list = list;
+            progress_size += OTA_PROGRESS_LIST_GROW;
+        }
+        node = &progress_list[progress_num++];
+        memset(node, 0x0, sizeof(esp_mesh_lite_ota_progress_t));
+        memcpy(node->mac_addr, mac, sizeof(node->mac_addr));
+    }
+
+    if (node->state != state) {
+        ESP_LOGI(TAG, "Node "MACSTR" (level %d) LAN OTA state %d -> %d", MAC2STR(mac), level, node->state, state);
+    }
+    node->level = level;
+    node->percentage = percentage;
+    node->state = state;
+    node->reason = reason;
+    node->update_time = esp_timer_get_time() / 1000000;
+    xSemaphoreGive(progress_mutex);
+}
+
+static void ota_progress_report(esp_mesh_lite_ota_state_t state, uint8_t percentage, esp_mesh_lite_ota_finish_reason_t reason)
+{
+    uint8_t mac[6];
+    uint8_t level = esp_mesh_lite_get_level();
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+
+    if (level < ROOT) {
+        return;
+    }
+
+    if (level == ROOT) {
+        ota_progress_update(mac, level, percentage, state, reason);
+        return;
+    }
+
+    MeshLite__OtaProgress req;
+    mesh_lite__ota_progress__init(&req);
+    req.node_mac.len = sizeof(mac);
+    req.node_mac.data = mac;
+    req.node_level = level;
+    req.percentage = percentage;
+    req.state = state;
+    req.reason = reason;
+    uint32_t outlen = mesh_lite__ota_progress__get_packed_size(&req);
+    uint8_t *outdata = malloc(outlen);
+    if (!outdata) {
+        return;
+    }
+    mesh_lite__ota_progress__pack(&req, outdata);
+
+    esp_mesh_lite_msg_config_t config = {
+        .raw_msg = {
+            .msg_id = MESH_LITE_MSG_ID_REPORT_OTA_PROGRESS,
+            .expect_resp_msg_id = MESH_LITE_MSG_ID_REPORT_OTA_PROGRESS_RESP,
+            /* Progress is superseded by the next report, state changes must get through */
+            .max_retry = (state == ESP_MESH_LITE_OTA_STATE_DOWNLOADING) ? 1 : 3,
+            .data = outdata,
+            .size = outlen,
+            .raw_resend = esp_mesh_lite_send_raw_msg_to_root,
+        },
+    };
+    esp_mesh_lite_send_msg(ESP_MESH_LITE_RAW_MSG, &config);
+    free(outdata);
+}
+
+static esp_err_t mesh_lite_ota_progress_handler(uint8_t *data, uint32_t len, uint8_t **out_data, uint32_t* out_len, uint32_t seq)
+{
+    MeshLite__OtaProgress *req = NULL;
+    esp_err_t ret = ESP_FAIL;
+
+    *out_len = 0;
+    if (esp_mesh_lite_get_level() != ROOT) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    req = mesh_lite__ota_progress__unpack(NULL, len, data);
+    if (req) {
+        if (req->node_mac.len == 6 && req->state <= ESP_MESH_LITE_OTA_STATE_FAIL) {
+            ota_progress_update(req->node_mac.data, req->node_level, MIN(req->percentage, 100), req->state, req->reason);
+            ret = ESP_OK;
+        }
+        mesh_lite__ota_progress__free_unpacked(req, NULL);
+    }
+
+    return ret;
+}
+
+static esp_err_t mesh_lite_ota_progress_resp_handler(uint8_t *data, uint32_t len, uint8_t **out_data, uint32_t* out_len, uint32_t seq)
+{
+    return ESP_OK;
+}
+
+static const esp_mesh_lite_raw_msg_action_t ota_raw_msgs_action[] = {
+    /* Report LAN OTA progress to the root node */
+    {MESH_LITE_MSG_ID_REPORT_OTA_PROGRESS, MESH_LITE_MSG_ID_REPORT_OTA_PROGRESS_RESP, mesh_lite_ota_progress_handler},
+    {MESH_LITE_MSG_ID_REPORT_OTA_PROGRESS_RESP, 0, mesh_lite_ota_progress_resp_handler},
+    {0, 0, NULL}
+};
+
+static void esp_mesh_lite_ota_event_handler(void *arg, esp_event_base_t event_base,
+                                            int32_t event_id, void *event_data)
+{
+    switch (event_id) {
+    case ESP_MESH_LITE_EVENT_OTA_START:
+        reported_percentage = 0;
+        ota_progress_report(ESP_MESH_LITE_OTA_STATE_DOWNLOADING, 0, ESP_MESH_LITE_EVENT_OTA_SUCCESS);
+        break;
+    case ESP_MESH_LITE_EVENT_OTA_PROGRESS: {
+        esp_mesh_lite_event_ota_progress_t *event = (esp_mesh_lite_event_ota_progress_t*)event_data;
+        if (event->percentage >= reported_percentage + OTA_PROGRESS_REPORT_STEP || event->percentage < reported_percentage) {
+            reported_percentage = event->percentage;
+            ota_progress_report(ESP_MESH_LITE_OTA_STATE_DOWNLOADING, event->percentage, ESP_MESH_LITE_EVENT_OTA_SUCCESS);
+        }
+        break;
+    }
+    case ESP_MESH_LITE_EVENT_OTA_FINISH: {
+        esp_mesh_lite_event_ota_finish_t *event = (esp_mesh_lite_event_ota_finish_t*)event_data;
+        if (event->reason == ESP_MESH_LITE_EVENT_OTA_SUCCESS) {
+            ota_progress_report(ESP_MESH_LITE_OTA_STATE_SUCCESS, 100, event->reason);
+        } else {
+            ota_progress_report(ESP_MESH_LITE_OTA_STATE_FAIL, reported_percentage, event->reason);
+        }
+#if CONFIG_MESH_LITE_OTA_RESUMABLE
+        /* Data on flash cannot be trusted after these, start over next time */
+        if (event->reason == ESP_MESH_LITE_EVENT_OTA_CHECKSUM_ERR || event->reason == ESP_MESH_LITE_EVENT_OTA_WRITE_ERR) {
+            xSemaphoreTake(ota_session_mutex, portMAX_DELAY);
+            ota_session_erase();
+            ota_session_free();
+            xSemaphoreGive(ota_session_mutex);
+        }
+#endif
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+size_t esp_mesh_lite_ota_get_progress(esp_mesh_lite_ota_progress_t *list, size_t max_num)
+{
+    if (!progress_mutex) {
+        return 0;
+    }
+
+    xSemaphoreTake(progress_mutex, portMAX_DELAY);
+    size_t num = progress_num;
+    if (list) {
+        memcpy(list, progress_list, MIN(num, max_num) * sizeof(esp_mesh_lite_ota_progress_t));
+    }
+    xSemaphoreGive(progress_mutex);
+    return num;
+}
+
+void esp_mesh_lite_ota_clear_progress(void)
+{
+    if (!progress_mutex) {
+        return;
+    }
+
+    xSemaphoreTake(progress_mutex, portMAX_DELAY);
+    free(progress_list);
+    progress_list = NULL;
+    progress_num = 0;
+    progress_size = 0;
+    xSemaphoreGive(progress_mutex);
+}
+
+esp_err_t esp_mesh_lite_ota_init(void)
+{
+    if (progress_mutex) {
+        return ESP_OK;
+    }
+
+    progress_mutex = xSemaphoreCreateMutex();
+    if (!progress_mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_MESH_LITE_OTA_RESUMABLE
+    ota_session_mutex = xSemaphoreCreateMutex();
+    if (!ota_session_mutex) {
+        vSemaphoreDelete(progress_mutex);
+        progress_mutex = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+#if CONFIG_MESH_LITE_OTA_PACK
+    ota_staged_load();
+#endif
+    esp_mesh_lite_ota_register_file_transfer_cb(&ota_resumable_cb);
+#endif
+
+    esp_mesh_lite_raw_msg_action_list_register(ota_raw_msgs_action);
+    esp_event_handler_instance_register(ESP_MESH_LITE_EVENT, ESP_EVENT_ANY_ID, &esp_mesh_lite_ota_event_handler, NULL, NULL);
+    return ESP_OK;
+}
@@ -0,0 +1,332 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "miniz.h"
+
+#include "esp_mesh_lite_ota_pack.h"
+
+static const char *TAG = "Mesh-Lite-OTA-Pack";
+
+#define OTA_PACK_READ_BUF_SIZE      1024
+
+typedef struct {
+    esp_mesh_lite_ota_pack_header_t header;
+    const esp_partition_t *source;
+    esp_ota_handle_t ota_handle;
+    size_t written;
+
+    /* Inflate state, only allocated for deflated payloads */
+    tinfl_decompressor *inflator;
+    uint8_t *dict;
+    size_t dict_ofs;
+    bool inflate_done;
+
+    /* Delta parser state */
+    uint8_t op;
+    uint8_t arg[8];
+    uint8_t arg_len;
+    uint8_t arg_need;
+    uint32_t src_offset;
+    uint32_t remain;
+    uint8_t src_buf[OTA_PACK_READ_BUF_SIZE];
+} ota_pack_decoder_t;
+
+static inline uint32_t ota_pack_get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static esp_err_t ota_pack_output(ota_pack_decoder_t *decoder, const uint8_t *data, size_t len)
+{
+    if (decoder->written + len > decoder->header.image_size) {
+        ESP_LOGE(TAG, "Decoded image exceeds %"PRIu32" bytes", decoder->header.image_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    decoder->written += len;
+    return esp_ota_write(decoder->ota_handle, data, len);
+}
+
+static esp_err_t ota_pack_copy_source(ota_pack_decoder_t *decoder, uint32_t len)
+{
+    while (len) {
+        size_t size = MIN(len, sizeof(decoder->src_buf));
+        esp_err_t ret = esp_partition_read(decoder->source, decoder->src_offset, decoder->src_buf, size);
+        if (ret == ESP_OK) {
+            ret = ota_pack_output(decoder, decoder->src_buf, size);
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        decoder->src_offset += size;
+        len -= size;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_pack_delta_feed(ota_pack_decoder_t *decoder, const uint8_t *data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+
+    while (len && ret == ESP_OK) {
+        if (decoder->op == 0) {
+            decoder->op = *data++;
+            len--;
+            decoder->arg_len = 0;
+            if (decoder->op == ESP_MESH_LITE_OTA_DELTA_COPY || decoder->op == ESP_MESH_LITE_OTA_DELTA_ADD) {
+                decoder->arg_need = 8;
+            } else if (decoder->op == ESP_MESH_LITE_OTA_DELTA_INSERT) {
+                decoder->arg_need = 4;
+            } else {
+                ESP_LOGE(TAG, "Unknown delta op %d", decoder->op);
+                return ESP_ERR_INVALID_ARG;
+            }
+            continue;
+        }
+
+        if (decoder->arg_len < decoder->arg_need) {
+            size_t size = MIN(len, decoder->arg_need - decoder->arg_len);
+            memcpy(decoder->arg + decoder->arg_len, data, size);
+            decoder->arg_len += size;
+            data += size;
+            len -= size;
+            if (decoder->arg_len < decoder->arg_need) {
+                break;
+            }
+
+            if (decoder->op == ESP_MESH_LITE_OTA_DELTA_INSERT) {
+                decoder->remain = ota_pack_get_le32(decoder->arg);
+            } else {
+                decoder->src_offset = ota_pack_get_le32(decoder->arg);
+                decoder->remain = ota_pack_get_le32(decoder->arg + 4);
+            }
+
+            if (decoder->op == ESP_MESH_LITE_OTA_DELTA_COPY) {
+                ret = ota_pack_copy_source(decoder, decoder->remain);
+                decoder->remain = 0;
+            }
+
+            if (decoder->remain == 0) {
+                decoder->op = 0;
+            }
+            continue;
+        }
+
+        /* ADD and INSERT data bytes */
+        size_t size = MIN(len, decoder->remain);
+        if (decoder->op == ESP_MESH_LITE_OTA_DELTA_ADD) {
+            size = MIN(size, sizeof(decoder->src_buf));
+            ret = esp_partition_read(decoder->source, decoder->src_offset, decoder->src_buf, size);
+            if (ret == ESP_OK) {
+                for (size_t i = 0; i < size; i++) {
+                    decoder->src_buf[i] += data[i];
+                }
+                ret = ota_pack_output(decoder, decoder->src_buf, size);
+            }
+            decoder->src_offset += size;
+        } else {
+            ret = ota_pack_output(decoder, data, size);
+        }
+        data += size;
+        len -= size;
+        decoder->remain -= size;
+        if (decoder->remain == 0) {
+            decoder->op = 0;
+        }
+    }
+
+    return ret;
+}
+
+static esp_err_t ota_pack_payload_feed(ota_pack_decoder_t *decoder, const uint8_t *data, size_t len)
+{
+    if (decoder->header.type == ESP_MESH_LITE_OTA_PACK_DELTA) {
+        return ota_pack_delta_feed(decoder, data, len);
+    }
+    return ota_pack_output(decoder, data, len);
+}
+
+static esp_err_t ota_pack_feed(ota_pack_decoder_t *decoder, const uint8_t *data, size_t len)
+{
+    if (!decoder->inflator) {
+        return ota_pack_payload_feed(decoder, data, len);
+    }
+
+    while (!decoder->inflate_done) {
+        size_t in_bytes = len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - decoder->dict_ofs;
+        tinfl_status status = tinfl_decompress(decoder->inflator, data, &in_bytes, decoder->dict, decoder->dict + decoder->dict_ofs,
+                                               &out_bytes, TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_bytes;
+        len -= in_bytes;
+
+        if (out_bytes) {
+            esp_err_t ret = ota_pack_payload_feed(decoder, decoder->dict + decoder->dict_ofs, out_bytes);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            decoder->dict_ofs = (decoder->dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Inflate fail: %d", status);
+            return ESP_FAIL;
+        } else if (status == TINFL_STATUS_DONE) {
+            decoder->inflate_done = true;
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ota_pack_copy_raw(const esp_partition_t *staging, size_t filesize, const esp_partition_t *update)
+{
+    esp_ota_handle_t ota_handle = 0;
+    uint8_t *buf = malloc(OTA_PACK_READ_BUF_SIZE);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = esp_ota_begin(update, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+    for (size_t offset = 0; ret == ESP_OK && offset < filesize; offset += OTA_PACK_READ_BUF_SIZE) {
+        size_t size = MIN(filesize - offset, OTA_PACK_READ_BUF_SIZE);
+        ret = esp_partition_read(staging, offset, buf, size);
+        if (ret == ESP_OK) {
+            ret = esp_ota_write(ota_handle, buf, size);
+        }
+    }
+    free(buf);
+
+    if (ret != ESP_OK) {
+        if (ota_handle) {
+            esp_ota_abort(ota_handle);
+        }
+        return ret;
+    }
+    return esp_ota_end(ota_handle);
+}
+
+static esp_err_t ota_pack_decode(const esp_partition_t *staging, const esp_mesh_lite_ota_pack_header_t *header, const esp_partition_t *update)
+{
+    esp_err_t ret = ESP_OK;
+    ota_pack_decoder_t *decoder = calloc(1, sizeof(ota_pack_decoder_t));
+    uint8_t *buf = malloc(OTA_PACK_READ_BUF_SIZE);
+    if (!decoder || !buf) {
+        ret = ESP_ERR_NO_MEM;
+        goto exit;
+    }
+    memcpy(&decoder->header, header, sizeof(esp_mesh_lite_ota_pack_header_t));
+    decoder->source = esp_ota_get_running_partition();
+
+    if (header->flags & ESP_MESH_LITE_OTA_PACK_FLAG_DEFLATE) {
+        decoder->inflator = malloc(sizeof(tinfl_decompressor));
+        decoder->dict = malloc(TINFL_LZ_DICT_SIZE);
+        if (!decoder->inflator || !decoder->dict) {
+            ret = ESP_ERR_NO_MEM;
+            goto exit;
+        }
+        tinfl_init(decoder->inflator);
+    }
+
+    ret = esp_ota_begin(update, header->image_size, &decoder->ota_handle);
+    if (ret != ESP_OK) {
+        goto exit;
+    }
+
+    size_t end = sizeof(esp_mesh_lite_ota_pack_header_t) + header->payload_size;
+    for (size_t offset = sizeof(esp_mesh_lite_ota_pack_header_t); ret == ESP_OK && offset < end; offset += OTA_PACK_READ_BUF_SIZE) {
+        size_t size = MIN(end - offset, OTA_PACK_READ_BUF_SIZE);
+        ret = esp_partition_read(staging, offset, buf, size);
+        if (ret == ESP_OK) {
+            ret = ota_pack_feed(decoder, buf, size);
+        }
+    }
+
+    if (ret == ESP_OK && (decoder->written != header->image_size || decoder->op != 0
+                          || (decoder->inflator && !decoder->inflate_done))) {
+        ESP_LOGE(TAG, "Truncated payload, %d/%"PRIu32" bytes decoded", (int)decoder->written, header->image_size);
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+
+    if (ret == ESP_OK) {
+        ret = esp_ota_end(decoder->ota_handle);
+    } else {
+        esp_ota_abort(decoder->ota_handle);
+    }
+
+exit:
+    if (decoder) {
+        free(decoder->inflator);
+        free(decoder->dict);
+        free(decoder);
+    }
+    free(buf);
+    return ret;
+}
+
+esp_err_t esp_mesh_lite_ota_pack_install(const esp_partition_t *staging, size_t filesize)
+{
+    esp_mesh_lite_ota_pack_header_t header;
+    uint8_t sha256[32];
+    esp_err_t ret;
+
+    const esp_partition_t *update = esp_ota_get_next_update_partition(NULL);
+    if (!staging || !update) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ret = esp_partition_read(staging, 0, &header, sizeof(header));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (header.magic != ESP_MESH_LITE_OTA_PACK_MAGIC) {
+        ESP_LOGI(TAG, "Install plain image, %d bytes", (int)filesize);
+        ret = ota_pack_copy_raw(staging, filesize, update);
+        goto exit;
+    }
+
+    if (header.version != ESP_MESH_LITE_OTA_PACK_VERSION || header.type > ESP_MESH_LITE_OTA_PACK_DELTA
+            || sizeof(header) + header.payload_size > filesize || header.image_size > update->size) {
+        ESP_LOGE(TAG, "Unsupported pack, version %d type %d", header.version, header.type);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (header.type == ESP_MESH_LITE_OTA_PACK_DELTA) {
+        ret = esp_partition_get_sha256(esp_ota_get_running_partition(), sha256);
+        if (ret != ESP_OK || memcmp(sha256, header.source_sha256, sizeof(sha256))) {
+            ESP_LOGE(TAG, "Delta does not apply to the running image");
+            return ESP_ERR_INVALID_VERSION;
+        }
+    }
+
+    ESP_LOGI(TAG, "Install %s%s image, %"PRIu32" -> %"PRIu32" bytes", header.type == ESP_MESH_LITE_OTA_PACK_DELTA ? "delta" : "full",
+             (header.flags & ESP_MESH_LITE_OTA_PACK_FLAG_DEFLATE) ? " deflated" : "", header.payload_size, header.image_size);
+    ret = ota_pack_decode(staging, &header, update);
+    if (ret != ESP_OK) {
+        goto exit;
+    }
+
+    ret = esp_partition_get_sha256(update, sha256);
+    if (ret == ESP_OK && memcmp(sha256, header.image_sha256, sizeof(sha256))) {
+        ESP_LOGE(TAG, "Decoded image SHA-256 mismatch");
+        ret = ESP_ERR_INVALID_CRC;
+    }
+
+exit:
+    if (ret == ESP_OK) {
+        ret = esp_ota_set_boot_partition(update);
+    } else {
+        ESP_LOGE(TAG, "Install fail: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
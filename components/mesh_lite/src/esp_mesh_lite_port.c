@@ -15,10 +15,15 @@ wifi_ap_record_t *esp_mesh_lite_scan_get_ap_records_list(uint16_t count)
     wifi_ap_record_t *ap_list = (wifi_ap_record_t *)malloc(sizeof(wifi_ap_record_t) * count);
     if (ap_list) {
         esp_wifi_scan_get_ap_records(&count, ap_list);
+        esp_mesh_lite_scan_ap_records_observe(ap_list, count);
     }
     return ap_list;
 }
 
+void __attribute__((weak)) esp_mesh_lite_scan_ap_records_observe(const wifi_ap_record_t *ap_list, uint16_t count)
+{
+}
+
 void *esp_mesh_lite_scan_get_next_ap_record(void *ap_record)
 {
     if (!ap_record) {
@@ -0,0 +1,282 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+
+#include "esp_mesh_lite.h"
+#include "esp_mesh_lite_time_sync.h"
+#include "mesh_lite.pb-c.h"
+
+static const char *TAG = "Mesh-Lite-Time";
+
+#define TIME_SYNC_FAST_SAMPLES      8       /* Exchanges at the fast interval after a parent change */
+#define TIME_SYNC_MIN_SAMPLES       4       /* Accepted exchanges before mesh time is valid */
+#define TIME_SYNC_DELAY_WINDOW      8
+#define TIME_SYNC_DELAY_MARGIN      1000    /* Excess delay over the fastest recent exchange that halves the weight */
+#define TIME_SYNC_DELAY_DISCARD     4000    /* Excess delay of an exchange that is not used at all */
+#define TIME_SYNC_FREQ_GAIN         8       /* Frequency takes 1/8 of the error, phase 1/2 */
+#define TIME_SYNC_MAX_DRIFT         500e-6  /* Crystal tolerance is well below 100 ppm */
+
+/*
+ * Mesh time of a local timestamp t:
+ *     t + base_offset + drift * (t - base_local)
+ */
+typedef struct {
+    int64_t base_local;
+    int64_t base_offset;
+    double drift;
+    uint32_t delay;
+    uint32_t sample_num;
+} time_sync_model_t;
+
+static time_sync_model_t time_model;
+static portMUX_TYPE time_model_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TimerHandle_t time_sync_timer;
+static uint8_t time_sync_level;
+static uint32_t time_sync_round;
+static uint32_t pending_seq;
+static int64_t pending_t1;
+static uint32_t delay_window[TIME_SYNC_DELAY_WINDOW];
+
+static int64_t time_model_offset(const time_sync_model_t *model, int64_t local_us)
+{
+    return model->base_offset + (int64_t)(model->drift * (local_us - model->base_local));
+}
+
+int64_t esp_mesh_lite_time_from_local(int64_t local_us)
+{
+    if (esp_mesh_lite_get_level() == ROOT) {
+        return local_us;
+    }
+
+    portENTER_CRITICAL(&time_model_lock);
+    int64_t offset = time_model_offset(&time_model, local_us);
+    portEXIT_CRITICAL(&time_model_lock);
+
+    return local_us + offset;
+}
+
+int64_t esp_mesh_lite_time_get_us(void)
+{
+    return esp_mesh_lite_time_from_local(esp_timer_get_time());
+}
+
+bool esp_mesh_lite_time_is_synced(void)
+{
+    if (esp_mesh_lite_get_level() == ROOT) {
+        return true;
+    }
+
+    portENTER_CRITICAL(&time_model_lock);
+    /* Keeps running on the estimated drift while disconnected */
+    bool synced = time_model.sample_num >= TIME_SYNC_MIN_SAMPLES;
+    portEXIT_CRITICAL(&time_model_lock);
+
+    return synced;
+}
+
+void esp_mesh_lite_time_sync_get_status(esp_mesh_lite_time_sync_status_t *status)
+{
+    int64_t now = esp_timer_get_time();
+
+    status->synced = esp_mesh_lite_time_is_synced();
+    if (esp_mesh_lite_get_level() == ROOT) {
+        status->offset_us = 0;
+        status->drift_ppm = 0;
+        status->delay_us = 0;
+        status->sample_num = 0;
+        return;
+    }
+
+    portENTER_CRITICAL(&time_model_lock);
+    status->offset_us = time_model_offset(&time_model, now);
+    status->drift_ppm = time_model.drift * 1e6;
+    status->delay_us = time_model.delay;
+    status->sample_num = time_model.sample_num;
+    portEXIT_CRITICAL(&time_model_lock);
+}
+
+static void time_sync_sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+{
+    int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+    int64_t delay = (t4 - t1) - (t3 - t2);
+
+    if (delay < 0 || delay > UINT32_MAX) {
+        return;
+    }
+
+    /* Queuing in the mesh only ever adds delay and skews the offset, weigh exchanges by their delay over the fastest recent one */
+    uint32_t min_delay = UINT32_MAX;
+    uint32_t window_num = 0;
+    for (int i = 0; i < TIME_SYNC_DELAY_WINDOW; i++) {
+        if (delay_window[i]) {
+            min_delay = MIN(min_delay, delay_window[i]);
+            window_num++;
+        }
+    }
+    delay_window[time_sync_round % TIME_SYNC_DELAY_WINDOW] = MAX(delay, 1);
+    int64_t excess = window_num ? MAX(delay - (int64_t)min_delay, 0) : 0;
+    if (excess > TIME_SYNC_DELAY_DISCARD) {
+        ESP_LOGD(TAG, "Discard exchange, delay %lld us", (long long)delay);
+        return;
+    }
+    double weight = (double)TIME_SYNC_DELAY_MARGIN / (TIME_SYNC_DELAY_MARGIN + excess);
+
+    portENTER_CRITICAL(&time_model_lock);
+    time_sync_model_t *model = &time_model;
+    if (model->sample_num == 0) {
+        model->base_offset = offset;
+        model->drift = 0;
+    } else {
+        int64_t predicted = time_model_offset(model, t4);
+        int64_t err = offset - predicted;
+        int64_t elapsed = t4 - model->base_local;
+
+        /* Until valid the phase takes the fastest exchange as it is, the frequency follows only once the phase holds */
+        if (model->sample_num < TIME_SYNC_MIN_SAMPLES) {
+            model->base_offset = excess ? predicted + (int64_t)(err * weight / 2) : offset;
+        } else {
+            model->base_offset = predicted + (int64_t)(err * weight / 2);
+            /* Over at least the slow interval, the jitter of two close exchanges says nothing about the drift */
+            elapsed = MAX(elapsed, CONFIG_MESH_LITE_TIME_SYNC_INTERVAL * 1000LL);
+            model->drift += err * weight / elapsed / TIME_SYNC_FREQ_GAIN;
+            model->drift = MAX(MIN(model->drift, TIME_SYNC_MAX_DRIFT), -TIME_SYNC_MAX_DRIFT);
+        }
+    }
+    model->base_local = t4;
+    model->delay = delay;
+    model->sample_num++;
+    portEXIT_CRITICAL(&time_model_lock);
+}
+
+static esp_err_t time_sync_req_handler(uint8_t *data, uint32_t len, uint8_t **out_data, uint32_t* out_len, uint32_t seq)
+{
+    int64_t t2 = esp_mesh_lite_time_get_us();
+    MeshLite__TimeSync *req = mesh_lite__time_sync__unpack(NULL, len, data);
+
+    *out_len = 0;
+    if (!req) {
+        return ESP_FAIL;
+    }
+
+    MeshLite__TimeSync resp;
+    mesh_lite__time_sync__init(&resp);
+    resp.seq = req->seq;
+    resp.t1 = req->t1;
+    resp.t2 = t2;
+    resp.synced = esp_mesh_lite_time_is_synced();
+    mesh_lite__time_sync__free_unpacked(req, NULL);
+
+    /* Upper bound of the packed size, so that t3 is taken right before packing */
+    uint8_t *resp_data = malloc(64);
+    if (!resp_data) {
+        return ESP_ERR_NO_MEM;
+    }
+    resp.t3 = esp_mesh_lite_time_get_us();
+    *out_len = mesh_lite__time_sync__pack(&resp, resp_data);
+    *out_data = resp_data;
+
+    return ESP_OK;
+}
+
+static esp_err_t time_sync_resp_handler(uint8_t *data, uint32_t len, uint8_t **out_data, uint32_t* out_len, uint32_t seq)
+{
+    int64_t t4 = esp_timer_get_time();
+    MeshLite__TimeSync *resp = mesh_lite__time_sync__unpack(NULL, len, data);
+
+    *out_len = 0;
+    if (!resp) {
+        return ESP_FAIL;
+    }
+
+    /* Only the answer to the outstanding request, from a parent that has mesh time */
+    if (resp->seq == pending_seq && resp->t1 == pending_t1 && resp->synced && esp_mesh_lite_get_level() > ROOT) {
+        pending_t1 = 0;
+        time_sync_sample(resp->t1, resp->t2, resp->t3, t4);
+    }
+    mesh_lite__time_sync__free_unpacked(resp, NULL);
+
+    return ESP_OK;
+}
+
+static const esp_mesh_lite_raw_msg_action_t time_sync_raw_msgs_action[] = {
+    /* Two-way timestamp exchange with the parent node */
+    {MESH_LITE_MSG_ID_TIME_SYNC, MESH_LITE_MSG_ID_TIME_SYNC_RESP, time_sync_req_handler},
+    {MESH_LITE_MSG_ID_TIME_SYNC_RESP, 0, time_sync_resp_handler},
+    {0, 0, NULL}
+};
+
+static void time_sync_timer_cb(TimerHandle_t timer)
+{
+    uint8_t level = esp_mesh_lite_get_level();
+
+    if (level != time_sync_level) {
+        /*
+         * New parent: keep the current estimate, but converge again at the fast interval. The delays of the
+         * old path stay in the window, they age out within TIME_SYNC_DELAY_WINDOW fast rounds.
+         */
+        time_sync_level = level;
+        time_sync_round = 0;
+        portENTER_CRITICAL(&time_model_lock);
+        time_model.sample_num = MIN(time_model.sample_num, TIME_SYNC_MIN_SAMPLES - 1);
+        portEXIT_CRITICAL(&time_model_lock);
+    }
+
+    if (level <= ROOT) {
+        return;
+    }
+
+    time_sync_round++;
+    if (time_sync_round > TIME_SYNC_FAST_SAMPLES
+            && time_sync_round % MAX(CONFIG_MESH_LITE_TIME_SYNC_INTERVAL / CONFIG_MESH_LITE_TIME_SYNC_FAST_INTERVAL, 1)) {
+        return;
+    }
+
+    MeshLite__TimeSync req;
+    mesh_lite__time_sync__init(&req);
+    req.seq = ++pending_seq;
+    uint8_t outdata[64];
+    /* t1 last, right before the message is handed over */
+    req.t1 = esp_timer_get_time();
+    uint32_t outlen = mesh_lite__time_sync__pack(&req, outdata);
+    pending_t1 = req.t1;
+
+    esp_mesh_lite_msg_config_t config = {
+        .raw_msg = {
+            .msg_id = MESH_LITE_MSG_ID_TIME_SYNC,
+            .expect_resp_msg_id = MESH_LITE_MSG_ID_TIME_SYNC_RESP,
+            /* A resent request would pair a stale t1 with the answer, the next round is as good */
+            .max_retry = 1,
+            .data = outdata,
+            .size = outlen,
+            .raw_resend = esp_mesh_lite_send_raw_msg_to_parent,
+        },
+    };
+    esp_mesh_lite_send_msg(ESP_MESH_LITE_RAW_MSG, &config);
+}
+
+esp_err_t esp_mesh_lite_time_sync_init(void)
+{
+    if (time_sync_timer) {
+        return ESP_OK;
+    }
+
+    time_sync_timer = xTimerCreate("time_sync_timer", CONFIG_MESH_LITE_TIME_SYNC_FAST_INTERVAL / portTICK_PERIOD_MS,
+                                   pdTRUE, NULL, time_sync_timer_cb);
+    if (!time_sync_timer) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_mesh_lite_raw_msg_action_list_register(time_sync_raw_msgs_action);
+    xTimerStart(time_sync_timer, portMAX_DELAY);
+    return ESP_OK;
+}
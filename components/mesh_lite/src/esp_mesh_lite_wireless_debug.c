@@ -6,9 +6,12 @@
 
 #include <string.h>
 #include <inttypes.h>
+#include <sys/param.h>
 #include <stdarg.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_wifi.h"
@@ -39,8 +42,27 @@ typedef struct {
 static const char *TAG = "Mesh-Lite-Wireless-Debug";
 
 #define LOG_COLOR_LEN                   (8)
-#define WIRELESS_DEBUG_QUEUE_SIZE       (10)
+#define WIRELESS_DEBUG_QUEUE_SIZE       (10 + FANOUT_MAX_NODES)    // Fan-out responses arrive in a burst
 #define RESPONSE_DELAY_TIME_TIME_OUT    (3000)
+#define FANOUT_MAX_REQUESTS             CONFIG_MESH_LITE_WIRELESS_DEBUG_FANOUT_MAX_REQUESTS
+#define FANOUT_MAX_NODES                CONFIG_MESH_LITE_WIRELESS_DEBUG_FANOUT_MAX_NODES
+#define FANOUT_SEND_WAIT_MS             (100)   // How long a send waits for the driver TX queue to drain
+#define FANOUT_MAC_ARG_LEN              (sizeof(" --mac 00:00:00:00:00:00") - 1)
+#define FANOUT_TAIL_MS                  (50)    // Responses can span frames, wait for more once every target answered
+
+typedef struct {
+    bool in_use;
+    bool broadcast;
+    bool sending;                                           // The sender arms the timer once it is done
+    uint32_t corr_id;
+    size_t count;                                           // Number of valid slots in results
+    size_t settled;                                         // Slots that answered or failed to send
+    esp_mesh_lite_wireless_debug_fanout_cb cb;
+    void *arg;
+    TimerHandle_t timer;
+    TickType_t *sent_tick;
+    esp_mesh_lite_wireless_debug_fanout_result_t *results;
+} wireless_debug_fanout_req_t;
 
 static char *output_buffer = NULL;
 static char *command_payload = NULL;
@@ -69,31 +91,23 @@ static uint8_t last_response_channel;
 static TaskHandle_t mesh_lite_wireless_debug_task_handle = NULL;
 static QueueHandle_t mesh_lite_wireless_debug_queue_handle = NULL;
 
-static esp_err_t wireless_debug_espnow_create_peer(uint8_t *dst_mac, uint8_t channel)
-{
-    esp_err_t ret = ESP_FAIL;
-    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-    if (peer == NULL) {
-        ESP_LOGE(TAG, "Malloc peer information fail");
-        return ESP_ERR_NO_MEM;
-    }
-    memset(peer, 0, sizeof(esp_now_peer_info_t));
+static wireless_debug_fanout_req_t fanout_reqs[FANOUT_MAX_REQUESTS];
+static SemaphoreHandle_t fanout_mutex = NULL;
+static uint32_t fanout_next_corr_id = 0;
 
-    esp_now_get_peer(dst_mac, peer);
-    peer->channel = channel;
-    peer->ifidx = ESP_IF_WIFI_STA;
-    peer->encrypt = false;
-    // memcpy(peer->lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
-    memcpy(peer->peer_addr, dst_mac, ESP_NOW_ETH_ALEN);
+static bool wireless_debug_fanout_collect(const uint8_t *mac, uint32_t seq, const uint8_t *payload, size_t len);
 
-    if (esp_now_is_peer_exist(dst_mac) == false) {
-        ret = esp_now_add_peer(peer);
-    } else {
-        ret = esp_now_mod_peer(peer);
-    }
-    free(peer);
+static uint8_t wireless_debug_get_home_channel(void)
+{
+    uint8_t primary = 0;
+    wifi_second_chan_t second;
+    esp_wifi_get_channel(&primary, &second);
+    return primary;
+}
 
-    return ret;
+static esp_err_t wireless_debug_espnow_create_peer(uint8_t *dst_mac, uint8_t channel)
+{
+    return esp_mesh_lite_espnow_peer_add(dst_mac, channel, WIFI_IF_STA);
 }
 
 static bool str_2_mac(uint8_t *str, uint8_t *dest)
@@ -175,19 +189,20 @@ static void wireless_debug_log_writev(esp_log_level_t level, const char *tag, co
     size_t new_format_length = strlen(tag) + strlen(format) + 30;
     char new_format[new_format_length];
     snprintf(new_format, new_format_length, "%s%c (%"PRIu32") [%s]: %s " LOG_RESET_COLOR "\n", log_color, letter, esp_log_timestamp(), tag, format);
-    vsnprintf(debug_log_buffer->data, ESPNOW_PAYLOAD_MAX_LEN, new_format, list);
-
-    va_end(list);
-
-    debug_log_buffer->crc32 = esp_rom_crc32_le(CRC_INIT_VALUE, (uint8_t*)debug_log_buffer->data, strlen(debug_log_buffer->data));
 
     esp_err_t ret = wireless_debug_espnow_create_peer(last_dst_mac, last_response_channel);
     if (ret == ESP_OK) {
+        // Sized for the receiver, the terminating NUL is not sent
+        size_t data_len = esp_mesh_lite_espnow_max_data_len(last_dst_mac) - sizeof(wireless_debug_log_t) + 1;
+        vsnprintf(debug_log_buffer->data, data_len, new_format, list);
+        debug_log_buffer->crc32 = esp_rom_crc32_le(CRC_INIT_VALUE, (uint8_t*)debug_log_buffer->data, strlen(debug_log_buffer->data));
         ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_WIRELESS_LOG, last_dst_mac, (uint8_t*)debug_log_buffer, sizeof(wireless_debug_log_t) + strlen(debug_log_buffer->data));
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Wireless log Send error: %d\r\n", ret);
         }
     }
+
+    va_end(list);
 }
 
 static int wireless_debug_cmd_discover(int argc, char **argv)
@@ -465,7 +480,10 @@ static void esp_mesh_lite_wireless_debug_task(void *pvParameter)
             wireless_debug_data_t *data = (wireless_debug_data_t *)recv_cb->data;
 
             memset(command_payload, 0x0, ESPNOW_PAYLOAD_MAX_LEN);
-            if (data->is_rsp_payload) {
+            if (data->is_rsp_payload && wireless_debug_fanout_collect(recv_cb->mac_addr, data->seq, data->payload,
+                                                                      recv_cb->data_len - sizeof(wireless_debug_data_t))) {
+                /* Response to a fan-out command, delivered with the others */
+            } else if (data->is_rsp_payload) {
                 memcpy(command_payload, data->payload, recv_cb->data_len - sizeof(wireless_debug_data_t));
                 if (cb_list.recv_resp_data_cb) {
                     cb_list.recv_resp_data_cb(command_payload, strlen(command_payload));
@@ -478,24 +496,39 @@ static void esp_mesh_lite_wireless_debug_task(void *pvParameter)
                 esp_err_t err = esp_console_run(command_payload, &ret);
 
                 if (err == ESP_OK) {
-                    if (strlen(output_buffer)) {
-                        wireless_debug_data_t *rsp_data = malloc(sizeof(wireless_debug_data_t) + strlen(output_buffer) + 1);
+                    size_t output_len = strlen(output_buffer);
+                    if (output_len) {
+                        wireless_debug_data_t *rsp_data = malloc(sizeof(wireless_debug_data_t) + output_len);
                         if (rsp_data) {
-                            memcpy(rsp_data->payload, output_buffer, strlen(output_buffer));
-                            rsp_data->payload[strlen(output_buffer)] = '\0';
-                            ESP_LOGI(TAG, "response data:%s", rsp_data->payload);
+                            ESP_LOGI(TAG, "response data:%s", output_buffer);
                             if (last_response_channel) {
                                 rsp_data->channel = last_response_channel;
                             }
                             rsp_data->version = WIRELESS_DEBUG_VERSION;
                             rsp_data->mesh_id = esp_mesh_lite_get_mesh_id();
+                            rsp_data->seq = data->seq;
                             rsp_data->is_rsp_payload = true;
                             ret = wireless_debug_espnow_create_peer(recv_cb->mac_addr, last_response_channel);
-                            if (ret == ESP_OK) {
-                                ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_WIRELESS_DEBUG, recv_cb->mac_addr, (const uint8_t*)rsp_data, sizeof(wireless_debug_data_t) + strlen(output_buffer));
+                            // Long outputs are split into as many frames as the requester receives
+                            size_t chunk_max = esp_mesh_lite_espnow_max_data_len(recv_cb->mac_addr) - sizeof(wireless_debug_data_t);
+                            for (size_t offset = 0; (ret == ESP_OK) && (offset < output_len);) {
+                                size_t chunk = MIN(output_len - offset, chunk_max);
+                                memcpy(rsp_data->payload, output_buffer + offset, chunk);
+                                TickType_t send_start = xTaskGetTickCount();
+                                for (;;) {
+                                    ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_WIRELESS_DEBUG, recv_cb->mac_addr,
+                                                                    (const uint8_t*)rsp_data, sizeof(wireless_debug_data_t) + chunk);
+                                    if (ret != ESP_ERR_ESPNOW_NO_MEM
+                                            || xTaskGetTickCount() - send_start >= pdMS_TO_TICKS(FANOUT_SEND_WAIT_MS)) {
+                                        break;
+                                    }
+                                    /* The driver TX queue is full, let it drain */
+                                    vTaskDelay(1);
+                                }
                                 if (ret != ESP_OK) {
                                     ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
                                 }
+                                offset += chunk;
                             }
                             free(rsp_data);
                         }
@@ -535,8 +568,13 @@ esp_err_t esp_mesh_lite_wireless_debug_send_command(uint8_t *dst_mac, char *comm
     if (ret != ESP_OK) {
         return ret;
     }
+    // Long responses are chunked to the frame size of this node once the peer knows it
+    esp_mesh_lite_espnow_peer_query_caps(dst_mac);
 
     uint16_t length = sizeof(wireless_debug_data_t) + command_len + 1;
+    if (length > esp_mesh_lite_espnow_max_data_len(dst_mac)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
     wireless_debug_data_t *pbuf = (wireless_debug_data_t *)malloc(length);
     if (pbuf == NULL) {
         ESP_LOGE(TAG, "Malloc unicast buff fail");
@@ -544,7 +582,7 @@ esp_err_t esp_mesh_lite_wireless_debug_send_command(uint8_t *dst_mac, char *comm
     }
     memset(pbuf, 0, length);
     pbuf->version = WIRELESS_DEBUG_VERSION;
-    pbuf->channel = 11;
+    pbuf->channel = wireless_debug_get_home_channel();
     pbuf->is_rsp_payload = false;
     pbuf->mesh_id = esp_mesh_lite_get_mesh_id();
     strcpy((char*)pbuf->payload, command);
@@ -558,6 +596,277 @@ esp_err_t esp_mesh_lite_wireless_debug_send_command(uint8_t *dst_mac, char *comm
     return ret;
 }
 
+static void wireless_debug_fanout_timer_cb(TimerHandle_t timer)
+{
+    wireless_debug_fanout_req_t *req = &fanout_reqs[(uintptr_t)pvTimerGetTimerID(timer)];
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    if (!req->in_use) {
+        xSemaphoreGive(fanout_mutex);
+        return;
+    }
+    for (size_t i = 0; i < req->count; i++) {
+        if (req->results[i].status == WIRELESS_DEBUG_FANOUT_PENDING) {
+            req->results[i].status = WIRELESS_DEBUG_FANOUT_TIMEOUT;
+        }
+    }
+    /* Detach the results so that late responses are dropped while the callback runs */
+    esp_mesh_lite_wireless_debug_fanout_result_t *results = req->results;
+    TickType_t *sent_tick = req->sent_tick;
+    size_t count = req->count;
+    uint32_t corr_id = req->corr_id;
+    esp_mesh_lite_wireless_debug_fanout_cb cb = req->cb;
+    void *arg = req->arg;
+    req->results = NULL;
+    req->sent_tick = NULL;
+    req->in_use = false;
+    xSemaphoreGive(fanout_mutex);
+
+    ESP_LOGI(TAG, "fan-out %"PRIu32" done, %d results", corr_id, (int)count);
+    if (cb) {
+        cb(corr_id, results, count, arg);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(results[i].response);
+    }
+    free(results);
+    free(sent_tick);
+}
+
+/* Called from the wireless debug task, later frames of a response are appended to the first one */
+static bool wireless_debug_fanout_collect(const uint8_t *mac, uint32_t seq, const uint8_t *payload, size_t len)
+{
+    if (seq == 0 || fanout_mutex == NULL) {
+        return false;
+    }
+
+    bool collected = false;
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    for (int r = 0; r < FANOUT_MAX_REQUESTS; r++) {
+        wireless_debug_fanout_req_t *req = &fanout_reqs[r];
+        if (!req->in_use || req->corr_id != seq) {
+            continue;
+        }
+
+        collected = true;
+        esp_mesh_lite_wireless_debug_fanout_result_t *slot = NULL;
+        size_t i;
+        for (i = 0; i < req->count; i++) {
+            if (!memcmp(req->results[i].mac, mac, ESP_NOW_ETH_ALEN)) {
+                slot = &req->results[i];
+                break;
+            }
+        }
+        if (slot == NULL && req->broadcast && req->count < FANOUT_MAX_NODES) {
+            slot = &req->results[req->count++];
+            memcpy(slot->mac, mac, ESP_NOW_ETH_ALEN);
+        }
+        if (slot == NULL || (slot->status != WIRELESS_DEBUG_FANOUT_PENDING && slot->status != WIRELESS_DEBUG_FANOUT_OK)) {
+            break;
+        }
+
+        bool first = (slot->status == WIRELESS_DEBUG_FANOUT_PENDING);
+        char *response = realloc(slot->response, slot->response_len + len + 1);
+        if (response == NULL) {
+            break;
+        }
+        memcpy(response + slot->response_len, payload, len);
+        slot->response = response;
+        slot->response_len += len;
+        slot->response[slot->response_len] = '\0';
+
+        if (first) {
+            slot->status = WIRELESS_DEBUG_FANOUT_OK;
+            slot->latency_ms = pdTICKS_TO_MS(xTaskGetTickCount() - req->sent_tick[req->broadcast ? 0 : i]);
+            if (!req->broadcast) {
+                req->settled++;
+            }
+        }
+        if (!req->broadcast && req->settled == req->count && !req->sending) {
+            /* Everyone answered, deliver once the last response has no more frames instead of waiting for the timeout */
+            xTimerChangePeriod(req->timer, MAX(pdMS_TO_TICKS(FANOUT_TAIL_MS), 1), 0);
+        }
+        break;
+    }
+    xSemaphoreGive(fanout_mutex);
+
+    return collected;
+}
+
+static esp_err_t wireless_debug_fanout_send(uint8_t *dst_mac, uint32_t corr_id, const char *command, size_t command_len, uint8_t channel)
+{
+    bool broadcast = IS_BROADCAST_ADDR(dst_mac);
+    bool append_mac = !broadcast && (strstr(command, "--mac") == NULL);
+    uint16_t length = sizeof(wireless_debug_data_t) + command_len + (append_mac ? FANOUT_MAC_ARG_LEN : 0) + 1;
+
+    if (wireless_debug_espnow_create_peer(dst_mac, channel) == ESP_OK && !broadcast) {
+        esp_mesh_lite_espnow_peer_query_caps(dst_mac);
+    }
+    if (length > esp_mesh_lite_espnow_max_data_len(dst_mac)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    wireless_debug_data_t *pbuf = (wireless_debug_data_t *)calloc(1, length);
+    if (pbuf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pbuf->version = WIRELESS_DEBUG_VERSION;
+    pbuf->channel = wireless_debug_get_home_channel();
+    pbuf->seq = corr_id;
+    pbuf->is_rsp_payload = false;
+    pbuf->mesh_id = esp_mesh_lite_get_mesh_id();
+    memcpy(pbuf->payload, command, command_len);
+    if (append_mac) {
+        snprintf((char *)pbuf->payload + command_len, FANOUT_MAC_ARG_LEN + 1, " --mac "MACSTR"", MAC2STR(dst_mac));
+    }
+
+    esp_err_t ret = ESP_FAIL;
+    TickType_t send_start = xTaskGetTickCount();
+    for (;;) {
+        ret = wireless_debug_espnow_create_peer(dst_mac, channel);
+        if (ret == ESP_OK) {
+            /* Large fan-outs recycle the least recently used peers instead of exhausting the peer table */
+            ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_WIRELESS_DEBUG, dst_mac, (const uint8_t *)pbuf, length);
+        }
+        /* A burst to every target outruns the driver, a few ticks are not enough at 1000 Hz */
+        if (ret != ESP_ERR_ESPNOW_NO_MEM || xTaskGetTickCount() - send_start >= pdMS_TO_TICKS(FANOUT_SEND_WAIT_MS)) {
+            break;
+        }
+        /* The driver TX queue is full, let it drain */
+        vTaskDelay(1);
+    }
+    free(pbuf);
+    return ret;
+}
+
+esp_err_t esp_mesh_lite_wireless_debug_send_command_multi(const uint8_t (*dst_macs)[ESP_NOW_ETH_ALEN], size_t count,
+                                                          const char *command, size_t command_len, uint8_t channel,
+                                                          uint32_t timeout_ms, esp_mesh_lite_wireless_debug_fanout_cb cb,
+                                                          void *arg, uint32_t *corr_id)
+{
+    if (mesh_lite_wireless_debug_task_handle == NULL || fanout_mutex == NULL) {
+        return ESP_FAIL;
+    }
+
+    bool broadcast = (dst_macs == NULL || count == 0);
+    if (command == NULL || count > FANOUT_MAX_NODES
+            || sizeof(wireless_debug_data_t) + command_len + FANOUT_MAC_ARG_LEN + 1 >= ESPNOW_PAYLOAD_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t slots = broadcast ? FANOUT_MAX_NODES : count;
+    esp_mesh_lite_wireless_debug_fanout_result_t *results = calloc(slots, sizeof(esp_mesh_lite_wireless_debug_fanout_result_t));
+    TickType_t *sent_tick = calloc(broadcast ? 1 : count, sizeof(TickType_t));
+    if (results == NULL || sent_tick == NULL) {
+        free(results);
+        free(sent_tick);
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    wireless_debug_fanout_req_t *req = NULL;
+    for (int r = 0; r < FANOUT_MAX_REQUESTS; r++) {
+        if (!fanout_reqs[r].in_use) {
+            req = &fanout_reqs[r];
+            break;
+        }
+    }
+    if (req == NULL) {
+        xSemaphoreGive(fanout_mutex);
+        ESP_LOGW(TAG, "No free fan-out request slot");
+        free(results);
+        free(sent_tick);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (++fanout_next_corr_id == 0) {
+        fanout_next_corr_id = 1;
+    }
+    req->in_use = true;
+    req->sending = true;
+    req->broadcast = broadcast;
+    req->corr_id = fanout_next_corr_id;
+    req->count = broadcast ? 0 : count;
+    req->settled = 0;
+    req->cb = cb;
+    req->arg = arg;
+    req->results = results;
+    req->sent_tick = sent_tick;
+    for (size_t i = 0; i < req->count; i++) {
+        memcpy(results[i].mac, dst_macs[i], ESP_NOW_ETH_ALEN);
+    }
+    uint32_t id = req->corr_id;
+    xSemaphoreGive(fanout_mutex);
+
+    if (corr_id) {
+        *corr_id = id;
+    }
+    ESP_LOGI(TAG, "fan-out %"PRIu32" command: %s, targets: %d", id, command, broadcast ? 0 : (int)count);
+
+    /*
+     * The timer is not running while sending, so the request stays published. Send ticks are
+     * written under the mutex, the debug task reads them when the responses come in.
+     */
+    size_t sent = 0;
+    if (broadcast) {
+        uint8_t broadcast_mac[ESP_NOW_ETH_ALEN];
+        memset(broadcast_mac, 0xFF, sizeof(broadcast_mac));
+        xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+        sent_tick[0] = xTaskGetTickCount();
+        xSemaphoreGive(fanout_mutex);
+        if (wireless_debug_fanout_send(broadcast_mac, id, command, command_len, channel) == ESP_OK) {
+            sent++;
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            uint8_t dst_mac[ESP_NOW_ETH_ALEN];
+            memcpy(dst_mac, dst_macs[i], ESP_NOW_ETH_ALEN);
+            xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+            sent_tick[i] = xTaskGetTickCount();
+            xSemaphoreGive(fanout_mutex);
+            esp_err_t ret = wireless_debug_fanout_send(dst_mac, id, command, command_len, channel);
+            if (ret == ESP_OK) {
+                sent++;
+                continue;
+            }
+            ESP_LOGE(TAG, "Send to "MACSTR" error: %d", MAC2STR(dst_mac), ret);
+            xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+            if (results[i].status == WIRELESS_DEBUG_FANOUT_PENDING) {
+                results[i].status = WIRELESS_DEBUG_FANOUT_SEND_FAIL;
+                req->settled++;
+            }
+            xSemaphoreGive(fanout_mutex);
+        }
+    }
+
+    /*
+     * The deadline counts from the last send, so every target gets at least timeout_ms. The timer
+     * callback takes fanout_mutex, so the period is not changed with the mutex held: with the timer
+     * queue full, the timer task would wait for the mutex and the mutex for the timer task.
+     */
+    TickType_t ticks = 0;
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    if (req->in_use && req->corr_id == id) {
+        ticks = (!broadcast && req->settled == req->count) ? 1 : MAX(pdMS_TO_TICKS(timeout_ms), 1);
+    }
+    xSemaphoreGive(fanout_mutex);
+    if (ticks) {
+        xTimerChangePeriod(req->timer, ticks, portMAX_DELAY);
+    }
+
+    /* Responses that settled the request while the timer was armed for the timeout deliver early */
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    if (req->in_use && req->corr_id == id) {
+        req->sending = false;
+        if (!broadcast && req->settled == req->count && ticks > 1) {
+            xTimerChangePeriod(req->timer, MAX(pdMS_TO_TICKS(FANOUT_TAIL_MS), 1), 0);
+        }
+    }
+    xSemaphoreGive(fanout_mutex);
+
+    return sent ? ESP_OK : ESP_FAIL;
+}
+
 static esp_err_t wireless_log_process_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
 {
     if (mesh_lite_wireless_debug_task_handle == NULL) {
@@ -637,8 +946,9 @@ static esp_err_t wireless_debug_process_cb(const esp_now_recv_info_t *recv_info,
     memcpy(recv_cb->data, data, len);
     recv_cb->data_len = len;
 
-    if (!mesh_lite_wireless_debug_queue_handle || xQueueSend(mesh_lite_wireless_debug_queue_handle, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send receive queue fail");
+    // Runs in the Wi-Fi task, drop the command rather than stall it
+    if (!mesh_lite_wireless_debug_queue_handle || xQueueSend(mesh_lite_wireless_debug_queue_handle, &evt, 0) != pdTRUE) {
+        ESP_LOGD(TAG, "Send receive queue fail");
         free(recv_cb->data);
         recv_cb->data = NULL;
         return ESP_FAIL;
@@ -678,6 +988,12 @@ void esp_mesh_lite_wireless_debug_init(void)
     memset(last_dst_mac, 0x0, 6);
     last_response_channel = 0;
 
+    fanout_mutex = xSemaphoreCreateMutex();
+    for (uint32_t r = 0; r < FANOUT_MAX_REQUESTS; r++) {
+        memset(&fanout_reqs[r], 0x0, sizeof(wireless_debug_fanout_req_t));
+        fanout_reqs[r].timer = xTimerCreate("wd_fanout", 1, pdFALSE, (void *)(uintptr_t)r, wireless_debug_fanout_timer_cb);
+    }
+
     esp_mesh_lite_espnow_recv_cb_register(ESPNOW_DATA_TYPE_WIRELESS_LOG, wireless_log_process_cb);
     esp_mesh_lite_espnow_recv_cb_register(ESPNOW_DATA_TYPE_WIRELESS_DEBUG, wireless_debug_process_cb);
 
@@ -706,6 +1022,25 @@ void esp_mesh_lite_wireless_debug_deinit(void)
         debug_log_buffer = NULL;
     }
 
+    if (fanout_mutex != NULL) {
+        xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+        for (int r = 0; r < FANOUT_MAX_REQUESTS; r++) {
+            wireless_debug_fanout_req_t *req = &fanout_reqs[r];
+            xTimerDelete(req->timer, portMAX_DELAY);
+            if (req->results) {
+                for (size_t i = 0; i < req->count; i++) {
+                    free(req->results[i].response);
+                }
+                free(req->results);
+            }
+            free(req->sent_tick);
+            memset(req, 0x0, sizeof(wireless_debug_fanout_req_t));
+        }
+        xSemaphoreGive(fanout_mutex);
+        vSemaphoreDelete(fanout_mutex);
+        fanout_mutex = NULL;
+    }
+
     esp_mesh_lite_espnow_recv_cb_unregister(ESPNOW_DATA_TYPE_WIRELESS_LOG);
     esp_mesh_lite_espnow_recv_cb_unregister(ESPNOW_DATA_TYPE_WIRELESS_DEBUG);
 }
@@ -12,6 +12,52 @@
 #endif
 
 #include "mesh_lite.pb-c.h"
+void   mesh_lite__node_health__init
+(MeshLite__NodeHealth         *message)
+{
+    static const MeshLite__NodeHealth init_value = MESH_LITE__NODE_HEALTH__INIT;
+    *message = init_value;
+}
+size_t mesh_lite__node_health__get_packed_size
+(const MeshLite__NodeHealth *message)
+{
+    assert(message->base.descriptor == &mesh_lite__node_health__descriptor);
+    return protobuf_c_message_get_packed_size((const ProtobufCMessage*)(message));
+}
+size_t mesh_lite__node_health__pack
+(const MeshLite__NodeHealth *message,
+ uint8_t       *out)
+{
+    assert(message->base.descriptor == &mesh_lite__node_health__descriptor);
+    return protobuf_c_message_pack((const ProtobufCMessage*)message, out);
+}
+size_t mesh_lite__node_health__pack_to_buffer
+(const MeshLite__NodeHealth *message,
+ ProtobufCBuffer *buffer)
+{
+    assert(message->base.descriptor == &mesh_lite__node_health__descriptor);
+    return protobuf_c_message_pack_to_buffer((const ProtobufCMessage*)message, buffer);
+}
+MeshLite__NodeHealth *
+mesh_lite__node_health__unpack
+(ProtobufCAllocator  *allocator,
+ size_t               len,
+ const uint8_t       *data)
+{
+    return (MeshLite__NodeHealth *)
+           protobuf_c_message_unpack(&mesh_lite__node_health__descriptor,
+                                     allocator, len, data);
+}
+void   mesh_lite__node_health__free_unpacked
+(MeshLite__NodeHealth *message,
+ ProtobufCAllocator *allocator)
+{
+    if (!message) {
+        return;
+    }
+    assert(message->base.descriptor == &mesh_lite__node_health__descriptor);
+    protobuf_c_message_free_unpacked((ProtobufCMessage*)message, allocator);
+}
 void   mesh_lite__node_data__init
 (MeshLite__NodeData         *message)
 {
@@ -104,7 +150,212 @@ void   mesh_lite__data__free_unpacked
     assert(message->base.descriptor == &mesh_lite__data__descriptor);
     protobuf_c_message_free_unpacked((ProtobufCMessage*)message, allocator);
 }
-static const ProtobufCFieldDescriptor mesh_lite__node_data__field_descriptors[3] = {
+void   mesh_lite__ota_progress__init
+(MeshLite__OtaProgress         *message)
+{
+    static const MeshLite__OtaProgress init_value = MESH_LITE__OTA_PROGRESS__INIT;
+    *message = init_value;
+}
+size_t mesh_lite__ota_progress__get_packed_size
+(const MeshLite__OtaProgress *message)
+{
+    assert(message->base.descriptor == &mesh_lite__ota_progress__descriptor);
+    return protobuf_c_message_get_packed_size((const ProtobufCMessage*)(message));
+}
+size_t mesh_lite__ota_progress__pack
+(const MeshLite__OtaProgress *message,
+ uint8_t       *out)
+{
+    assert(message->base.descriptor == &mesh_lite__ota_progress__descriptor);
+    return protobuf_c_message_pack((const ProtobufCMessage*)message, out);
+}
+size_t mesh_lite__ota_progress__pack_to_buffer
+(const MeshLite__OtaProgress *message,
+ ProtobufCBuffer *buffer)
+{
+    assert(message->base.descriptor == &mesh_lite__ota_progress__descriptor);
+    return protobuf_c_message_pack_to_buffer((const ProtobufCMessage*)message, buffer);
+}
+MeshLite__OtaProgress *
+mesh_lite__ota_progress__unpack
+(ProtobufCAllocator  *allocator,
+ size_t               len,
+ const uint8_t       *data)
+{
+    return (MeshLite__OtaProgress *)
+           protobuf_c_message_unpack(&mesh_lite__ota_progress__descriptor,
+                                     allocator, len, data);
+}
+void   mesh_lite__ota_progress__free_unpacked
+(MeshLite__OtaProgress *message,
+ ProtobufCAllocator *allocator)
+{
+    if (!message) {
+        return;
+    }
+    assert(message->base.descriptor == &mesh_lite__ota_progress__descriptor);
+    protobuf_c_message_free_unpacked((ProtobufCMessage*)message, allocator);
+}
+void   mesh_lite__time_sync__init
+(MeshLite__TimeSync         *message)
+{
+    static const MeshLite__TimeSync init_value = MESH_LITE__TIME_SYNC__INIT;
+    *message = init_value;
+}
+size_t mesh_lite__time_sync__get_packed_size
+(const MeshLite__TimeSync *message)
+{
+    assert(message->base.descriptor == &mesh_lite__time_sync__descriptor);
+    return protobuf_c_message_get_packed_size((const ProtobufCMessage*)(message));
+}
+size_t mesh_lite__time_sync__pack
+(const MeshLite__TimeSync *message,
+ uint8_t       *out)
+{
+    assert(message->base.descriptor == &mesh_lite__time_sync__descriptor);
+    return protobuf_c_message_pack((const ProtobufCMessage*)message, out);
+}
+size_t mesh_lite__time_sync__pack_to_buffer
+(const MeshLite__TimeSync *message,
+ ProtobufCBuffer *buffer)
+{
+    assert(message->base.descriptor == &mesh_lite__time_sync__descriptor);
+    return protobuf_c_message_pack_to_buffer((const ProtobufCMessage*)message, buffer);
+}
+MeshLite__TimeSync *
+mesh_lite__time_sync__unpack
+(ProtobufCAllocator  *allocator,
+ size_t               len,
+ const uint8_t       *data)
+{
+    return (MeshLite__TimeSync *)
+           protobuf_c_message_unpack(&mesh_lite__time_sync__descriptor,
+                                     allocator, len, data);
+}
+void   mesh_lite__time_sync__free_unpacked
+(MeshLite__TimeSync *message,
+ ProtobufCAllocator *allocator)
+{
+    if (!message) {
+        return;
+    }
+    assert(message->base.descriptor == &mesh_lite__time_sync__descriptor);
+    protobuf_c_message_free_unpacked((ProtobufCMessage*)message, allocator);
+}
+static const ProtobufCFieldDescriptor mesh_lite__node_health__field_descriptors[7] = {
+    {
+        "free_heap",
+        1,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeHealth, free_heap),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "min_free_heap",
+        2,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeHealth, min_free_heap),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "parent_rssi",
+        3,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_SINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeHealth, parent_rssi),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "child_num",
+        4,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeHealth, child_num),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "queue_depth",
+        5,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeHealth, queue_depth),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "queue_drops",
+        6,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeHealth, queue_drops),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "uptime",
+        7,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeHealth, uptime),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+};
+static const unsigned mesh_lite__node_health__field_indices_by_name[] = {
+    3,   /* field[3] = child_num */
+    0,   /* field[0] = free_heap */
+    1,   /* field[1] = min_free_heap */
+    2,   /* field[2] = parent_rssi */
+    4,   /* field[4] = queue_depth */
+    5,   /* field[5] = queue_drops */
+    6,   /* field[6] = uptime */
+};
+static const ProtobufCIntRange mesh_lite__node_health__number_ranges[1 + 1] = {
+    { 1, 0 },
+    { 0, 7 }
+};
+const ProtobufCMessageDescriptor mesh_lite__node_health__descriptor = {
+    PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+    "mesh_lite.node_health",
+    "NodeHealth",
+    "MeshLite__NodeHealth",
+    "mesh_lite",
+    sizeof(MeshLite__NodeHealth),
+    7,
+    mesh_lite__node_health__field_descriptors,
+    mesh_lite__node_health__field_indices_by_name,
+    1,  mesh_lite__node_health__number_ranges,
+    (ProtobufCMessageInit) mesh_lite__node_health__init,
+    NULL, NULL, NULL  /* reserved[123] */
+};
+static const ProtobufCFieldDescriptor mesh_lite__node_data__field_descriptors[4] = {
     {
         "node_level",
         1,
@@ -141,15 +392,28 @@ static const ProtobufCFieldDescriptor mesh_lite__node_data__field_descriptors[3]
         0,             /* flags */
         0, NULL, NULL  /* reserved1,reserved2, etc */
     },
+    {
+        "health",
+        4,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_MESSAGE,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__NodeData, health),
+        &mesh_lite__node_health__descriptor,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
 };
 static const unsigned mesh_lite__node_data__field_indices_by_name[] = {
+    3,   /* field[3] = health */
     1,   /* field[1] = node_ip */
     0,   /* field[0] = node_level */
     2,   /* field[2] = node_mac */
 };
 static const ProtobufCIntRange mesh_lite__node_data__number_ranges[1 + 1] = {
     { 1, 0 },
-    { 0, 3 }
+    { 0, 4 }
 };
 const ProtobufCMessageDescriptor mesh_lite__node_data__descriptor = {
     PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
@@ -158,14 +422,14 @@ const ProtobufCMessageDescriptor mesh_lite__node_data__descriptor = {
     "MeshLite__NodeData",
     "mesh_lite",
     sizeof(MeshLite__NodeData),
-    3,
+    4,
     mesh_lite__node_data__field_descriptors,
     mesh_lite__node_data__field_indices_by_name,
     1,  mesh_lite__node_data__number_ranges,
     (ProtobufCMessageInit) mesh_lite__node_data__init,
     NULL, NULL, NULL  /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor mesh_lite__data__field_descriptors[1] = {
+static const ProtobufCFieldDescriptor mesh_lite__data__field_descriptors[4] = {
     {
         "nodes",
         1,
@@ -178,13 +442,52 @@ static const ProtobufCFieldDescriptor mesh_lite__data__field_descriptors[1] = {
         0,             /* flags */
         0, NULL, NULL  /* reserved1,reserved2, etc */
     },
+    {
+        "generation",
+        2,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__Data, generation),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "root_mac",
+        3,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_BYTES,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__Data, root_mac),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "epoch",
+        4,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__Data, epoch),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
 };
 static const unsigned mesh_lite__data__field_indices_by_name[] = {
+    3,   /* field[3] = epoch */
+    1,   /* field[1] = generation */
     0,   /* field[0] = nodes */
+    2,   /* field[2] = root_mac */
 };
 static const ProtobufCIntRange mesh_lite__data__number_ranges[1 + 1] = {
     { 1, 0 },
-    { 0, 1 }
+    { 0, 4 }
 };
 const ProtobufCMessageDescriptor mesh_lite__data__descriptor = {
     PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
@@ -193,10 +496,184 @@ const ProtobufCMessageDescriptor mesh_lite__data__descriptor = {
     "MeshLite__Data",
     "mesh_lite",
     sizeof(MeshLite__Data),
-    1,
+    4,
     mesh_lite__data__field_descriptors,
     mesh_lite__data__field_indices_by_name,
     1,  mesh_lite__data__number_ranges,
     (ProtobufCMessageInit) mesh_lite__data__init,
     NULL, NULL, NULL  /* reserved[123] */
 };
+static const ProtobufCFieldDescriptor mesh_lite__ota_progress__field_descriptors[5] = {
+    {
+        "node_mac",
+        1,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_BYTES,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__OtaProgress, node_mac),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "node_level",
+        2,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__OtaProgress, node_level),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "percentage",
+        3,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__OtaProgress, percentage),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "state",
+        4,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__OtaProgress, state),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "reason",
+        5,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__OtaProgress, reason),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+};
+static const unsigned mesh_lite__ota_progress__field_indices_by_name[] = {
+    1,   /* field[1] = node_level */
+    0,   /* field[0] = node_mac */
+    2,   /* field[2] = percentage */
+    4,   /* field[4] = reason */
+    3,   /* field[3] = state */
+};
+static const ProtobufCIntRange mesh_lite__ota_progress__number_ranges[1 + 1] = {
+    { 1, 0 },
+    { 0, 5 }
+};
+const ProtobufCMessageDescriptor mesh_lite__ota_progress__descriptor = {
+    PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+    "mesh_lite.ota_progress",
+    "OtaProgress",
+    "MeshLite__OtaProgress",
+    "mesh_lite",
+    sizeof(MeshLite__OtaProgress),
+    5,
+    mesh_lite__ota_progress__field_descriptors,
+    mesh_lite__ota_progress__field_indices_by_name,
+    1,  mesh_lite__ota_progress__number_ranges,
+    (ProtobufCMessageInit) mesh_lite__ota_progress__init,
+    NULL, NULL, NULL  /* reserved[123] */
+};
+static const ProtobufCFieldDescriptor mesh_lite__time_sync__field_descriptors[5] = {
+    {
+        "seq",
+        1,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_UINT32,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__TimeSync, seq),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "t1",
+        2,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_INT64,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__TimeSync, t1),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "t2",
+        3,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_INT64,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__TimeSync, t2),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "t3",
+        4,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_INT64,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__TimeSync, t3),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+    {
+        "synced",
+        5,
+        PROTOBUF_C_LABEL_NONE,
+        PROTOBUF_C_TYPE_BOOL,
+        0,   /* quantifier_offset */
+        offsetof(MeshLite__TimeSync, synced),
+        NULL,
+        NULL,
+        0,             /* flags */
+        0, NULL, NULL  /* reserved1,reserved2, etc */
+    },
+};
+static const unsigned mesh_lite__time_sync__field_indices_by_name[] = {
+    0,   /* field[0] = seq */
+    4,   /* field[4] = synced */
+    1,   /* field[1] = t1 */
+    2,   /* field[2] = t2 */
+    3,   /* field[3] = t3 */
+};
+static const ProtobufCIntRange mesh_lite__time_sync__number_ranges[1 + 1] = {
+    { 1, 0 },
+    { 0, 5 }
+};
+const ProtobufCMessageDescriptor mesh_lite__time_sync__descriptor = {
+    PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+    "mesh_lite.time_sync",
+    "TimeSync",
+    "MeshLite__TimeSync",
+    "mesh_lite",
+    sizeof(MeshLite__TimeSync),
+    5,
+    mesh_lite__time_sync__field_descriptors,
+    mesh_lite__time_sync__field_indices_by_name,
+    1,  mesh_lite__time_sync__number_ranges,
+    (ProtobufCMessageInit) mesh_lite__time_sync__init,
+    NULL, NULL, NULL  /* reserved[123] */
+};
@@ -8,6 +8,7 @@
 #include <time.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/timers.h"
@@ -33,6 +34,22 @@
 #define MAX_PASSWORD_LEN        (64)
 
 #define ZERO_PROV_PER_CHANNEL_BROADCAST_COUNT 4
+#define ZERO_PROV_BROADCAST_INTERVAL_MS       100
+#define ZERO_PROV_MAX_DWELL_SHIFT             3
+#define ZERO_PROV_MAX_CHANNEL                 14
+#define ZERO_PROV_CHANNEL_HINT_TTL_US         (10 * 60 * 1000 * 1000LL)
+
+#define ZERO_PROV_PENDING_TICK_MS             100
+#define ZERO_PROV_HANDSHAKE_TIMEOUT_US        (300 * 1000)
+#define ZERO_PROV_HANDSHAKE_MAX_RETRY         5
+#define ZERO_PROV_DONE_LINGER_US              (5 * 1000 * 1000)
+
+/* How likely a channel is to host a provisioner, best first */
+enum {
+    ZERO_PROV_CHANNEL_UNKNOWN = 0,
+    ZERO_PROV_CHANNEL_HAS_AP,
+    ZERO_PROV_CHANNEL_HAS_MESH,
+};
 
 static const char *TAG = "zero";
 
@@ -49,6 +66,42 @@ typedef struct {
     int size;
 } zero_prov_act_t;
 
+typedef struct {
+    int64_t last_seen_us;
+    int8_t rssi;
+    uint8_t level;
+} zero_prov_channel_hint_t;
+
+typedef struct {
+    uint8_t order[ZERO_PROV_MAX_CHANNEL];
+    uint8_t level[ZERO_PROV_MAX_CHANNEL];
+    uint8_t num;
+    uint8_t index;
+    uint8_t round;
+    uint8_t broadcast_count;
+    bool hop;                       // Dwell is over, move to the next channel when the timer fires
+} zero_prov_sweep_t;
+
+/* Provisioner side state of an idle node */
+typedef enum {
+    ZERO_PROV_NODE_FREE = 0,
+    ZERO_PROV_NODE_WAITING,         // Broadcast received, waiting for a handshake slot
+    ZERO_PROV_NODE_INFO_SENT,       // Credentials sent, waiting for confirm
+    ZERO_PROV_NODE_DONE,            // Confirm received and acknowledged
+} zero_prov_node_state_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t state;
+    uint8_t channel;
+    uint8_t retry;
+    int64_t deadline_us;
+} zero_prov_pending_node_t;
+
+static zero_prov_channel_hint_t channel_hints[ZERO_PROV_MAX_CHANNEL + 1];
+static portMUX_TYPE channel_hints_lock = portMUX_INITIALIZER_UNLOCKED;
+static zero_prov_sweep_t br_sweep;
+
 static uint8_t resend_channel;
 static uint8_t resend_mac_addr[ESP_NOW_ETH_ALEN];
 
@@ -59,6 +112,8 @@ static bool flg_is_wifi_provisioning = true;
 static bool zero_prov_esp_now_init_done = false;
 
 static TimerHandle_t resend_timer = NULL;
+static TimerHandle_t pending_timer = NULL;
+static zero_prov_pending_node_t *pending_nodes = NULL;
 static TaskHandle_t zero_prov_handle = NULL;
 static QueueHandle_t s_zero_prov_queue = NULL;
 static esp_timer_handle_t g_timer_handle = NULL, g_listen_timer = NULL;
@@ -72,12 +127,14 @@ static esp_err_t zero_prov_esp_now_init(void);
 static void zero_prov_broadcast_cb(void *arg);
 static void zero_prov_recieve_handle(void *arg);
 static void zero_prov_unicast_handle(void *arg);
+static void zero_prov_pending_handle(void *arg);
 static int zero_prov_data_parse(const uint8_t *data, uint16_t data_len);
 
 zero_prov_table_t zero_prov_table[] = {
     {ZERO_PROV_SEND_BROADCAST, zero_prov_broadcast_cb},
     {ZERO_PROV_RECIVE_DATA, zero_prov_recieve_handle},
     {ZERO_PROV_SEND_UNICAST_DATA, zero_prov_unicast_handle},
+    {ZERO_PROV_PENDING_TICK, zero_prov_pending_handle},
 };
 
 bool is_zero_prov_be_used()
@@ -136,38 +193,119 @@ esp_err_t zero_prov_connect_ap(wifi_config_t *wifi_cfg)
     return ESP_OK;
 }
 
-static void zero_prov_del_peer(void)
+/* Peers stay in the peer cache, the least recently used one is recycled when the table is full */
+static void zero_prov_check_peer_is_exist(uint8_t *mac)
 {
-    esp_now_peer_num_t current_peer_num;
-    esp_now_peer_info_t *current_peer = NULL;
-    ZERO_PROV_CHECK_RETURN_VAIL(esp_now_get_peer_num(&current_peer_num));
-    ESP_LOGW(TAG, "now peer number is %d", current_peer_num.total_num);
-    ZERO_PROV_CHECK_RETURN_VAIL(esp_now_fetch_peer(true, current_peer));
-    ZERO_PROV_CHECK_RETURN_VAIL(esp_now_del_peer(current_peer->peer_addr));
+    ZERO_PROV_CHECK_RETURN_VAIL(esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA));
 }
 
-static void zero_prov_check_peer_is_exist(uint8_t *mac)
+static void zero_prov_channel_hint_update(uint8_t channel, int8_t rssi, uint8_t level)
 {
-    if (esp_now_is_peer_exist(mac) == false) {
-        esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-        if (peer == NULL) {
-            ESP_LOGE(TAG, "Malloc peer information fail");
-            return;
-        }
-        memset(peer, 0, sizeof(esp_now_peer_info_t));
-        peer->channel = 0;
-        peer->ifidx = ESP_IF_WIFI_STA;
-        peer->encrypt = false;
-        // memcpy(peer->lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
-        memcpy(peer->peer_addr, mac, ESP_NOW_ETH_ALEN);
-        if (esp_now_add_peer(peer) != ESP_OK) {
-            zero_prov_del_peer();
-            ZERO_PROV_CHECK_RETURN_VAIL(esp_now_add_peer(peer));
+    if (channel == 0 || channel > ZERO_PROV_MAX_CHANNEL) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    zero_prov_channel_hint_t *hint = &channel_hints[channel];
+    portENTER_CRITICAL(&channel_hints_lock);
+    if (now - hint->last_seen_us > ZERO_PROV_CHANNEL_HINT_TTL_US || level > hint->level
+            || (level == hint->level && rssi > hint->rssi)) {
+        hint->level = level;
+        hint->rssi = rssi;
+    }
+    hint->last_seen_us = now;
+    portEXIT_CRITICAL(&channel_hints_lock);
+}
+
+static bool zero_prov_is_mesh_ssid(const char *ssid)
+{
+    if (!strncmp(ssid, CONFIG_DEFAULT_SSID_PREFIX, strlen(CONFIG_DEFAULT_SSID_PREFIX))) {
+        return true;
+    }
+#ifdef CONFIG_BRIDGE_SOFTAP_SSID
+    if (!strncmp(ssid, CONFIG_BRIDGE_SOFTAP_SSID, strlen(CONFIG_BRIDGE_SOFTAP_SSID))) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+void esp_mesh_lite_scan_ap_records_observe(const wifi_ap_record_t *ap_list, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t level = zero_prov_is_mesh_ssid((const char *)ap_list[i].ssid) ? ZERO_PROV_CHANNEL_HAS_MESH : ZERO_PROV_CHANNEL_HAS_AP;
+        zero_prov_channel_hint_update(ap_list[i].primary, ap_list[i].rssi, level);
+    }
+}
+
+/*
+ * Build the channel order of the next sweep: channels where mesh beacons were seen recently come first,
+ * then channels with any AP, then the rest, each group sorted by RSSI.
+ */
+static void zero_prov_sweep_plan(zero_prov_sweep_t *sweep)
+{
+    wifi_country_t country;
+    memset(&country, 0x0, sizeof(country));
+    esp_wifi_get_country(&country);
+
+    uint8_t schan = country.schan ? country.schan : 1;
+    uint8_t nchan = country.nchan ? country.nchan : 13;
+    int8_t rssi[ZERO_PROV_MAX_CHANNEL];
+    int64_t now = esp_timer_get_time();
+
+    sweep->num = 0;
+    portENTER_CRITICAL(&channel_hints_lock);
+    for (uint8_t channel = schan; channel < schan + nchan && channel <= ZERO_PROV_MAX_CHANNEL; channel++) {
+        zero_prov_channel_hint_t *hint = &channel_hints[channel];
+        bool fresh = hint->last_seen_us && now - hint->last_seen_us <= ZERO_PROV_CHANNEL_HINT_TTL_US;
+        uint8_t level = fresh ? hint->level : ZERO_PROV_CHANNEL_UNKNOWN;
+        int8_t channel_rssi = fresh ? hint->rssi : INT8_MIN;
+
+        /* Insertion sort, the table holds at most 14 entries */
+        int pos = sweep->num;
+        while (pos > 0 && (sweep->level[pos - 1] < level
+                           || (sweep->level[pos - 1] == level && rssi[pos - 1] < channel_rssi))) {
+            sweep->order[pos] = sweep->order[pos - 1];
+            sweep->level[pos] = sweep->level[pos - 1];
+            rssi[pos] = rssi[pos - 1];
+            pos--;
         }
-        free(peer);
-    } else {
-        ESP_LOGI(TAG, "%s %d peer is exist", __func__, __LINE__);
+        sweep->order[pos] = channel;
+        sweep->level[pos] = level;
+        rssi[pos] = channel_rssi;
+        sweep->num++;
+    }
+    portEXIT_CRITICAL(&channel_hints_lock);
+
+    sweep->index = 0;
+    sweep->broadcast_count = 0;
+}
+
+/*
+ * Number of broadcasts sent on the current channel before moving on. Likely channels get a longer dwell,
+ * and every sweep that ends without a response doubles the dwell, up to 2^ZERO_PROV_MAX_DWELL_SHIFT.
+ */
+static uint8_t zero_prov_sweep_dwell(const zero_prov_sweep_t *sweep)
+{
+    uint8_t dwell;
+    switch (sweep->level[sweep->index]) {
+    case ZERO_PROV_CHANNEL_HAS_MESH:
+        dwell = ZERO_PROV_PER_CHANNEL_BROADCAST_COUNT;
+        break;
+    case ZERO_PROV_CHANNEL_HAS_AP:
+        dwell = ZERO_PROV_PER_CHANNEL_BROADCAST_COUNT / 2;
+        break;
+    default:
+        dwell = 1;
+        break;
     }
+    return dwell << MIN(sweep->round, ZERO_PROV_MAX_DWELL_SHIFT);
+}
+
+static void zero_prov_sweep_set_channel(uint8_t channel)
+{
+    esp_wifi_set_channel(channel, 0);
+    esp_mesh_lite_espnow_peer_add(s_broadcast_mac, channel, WIFI_IF_STA);
 }
 
 esp_err_t zero_prov_br_stop(void)
@@ -184,40 +322,38 @@ esp_err_t zero_prov_br_stop(void)
         free(esp_now_data);
         esp_now_data = NULL;
     }
+    memset(&br_sweep, 0x0, sizeof(br_sweep));
     return ESP_OK;
 }
 
 static void zero_prov_broadcast_cb(void *arg)
 {
-    wifi_country_t country;
-    memset(&country, 0x0, sizeof(country));
-    esp_wifi_get_country(&country);
-
-    esp_now_peer_info_t peer;
-    memset(&peer, 0x0, sizeof(peer));
-    static int broadcast_count = 0;
-    static uint8_t channel_num = 0;
-    if (channel_num == 0) {
-        channel_num = country.schan;
+    // Send callbacks queued before the broadcast was stopped must not move us off the provisioner's channel
+    if (g_timer_handle == NULL || br_sweep.num == 0) {
+        return;
     }
 
-    if (broadcast_count >= ZERO_PROV_PER_CHANNEL_BROADCAST_COUNT) {
-        broadcast_count = 0;
-        if (channel_num == country.nchan) {
-            channel_num = country.schan;
-        } else {
-            channel_num++;
+    uint32_t interval_ms = ZERO_PROV_BROADCAST_INTERVAL_MS;
+    if (br_sweep.hop) {
+        // The last broadcast on the previous channel had its full interval to be answered, send right away
+        br_sweep.hop = false;
+        br_sweep.broadcast_count = 0;
+        if (++br_sweep.index >= br_sweep.num) {
+            if (br_sweep.round < UINT8_MAX) {
+                br_sweep.round++;
+            }
+            zero_prov_sweep_plan(&br_sweep);
         }
-        esp_wifi_set_channel(channel_num, 0);
-        esp_now_get_peer(s_broadcast_mac, &peer);
-        peer.channel = channel_num;
-        esp_now_mod_peer(&peer);
+        zero_prov_sweep_set_channel(br_sweep.order[br_sweep.index]);
+        interval_ms = 1;
+    } else if (++br_sweep.broadcast_count >= zero_prov_sweep_dwell(&br_sweep)) {
+        // Leaving now would drop the answer to this broadcast, which comes tens of milliseconds later
+        br_sweep.hop = true;
     }
-    broadcast_count++;
 
-    esp_timer_start_once(g_timer_handle, 400 * 1000);
+    esp_timer_start_once(g_timer_handle, interval_ms * 1000);
 #if ZERO_PROV_DEBUG
-    ESP_LOGI(TAG, "Send br to channel[%d] free heap: %"PRIu32"", channel_num, esp_get_free_heap_size());
+    ESP_LOGI(TAG, "Send br to channel[%d] round %d free heap: %"PRIu32"", br_sweep.order[br_sweep.index], br_sweep.round, esp_get_free_heap_size());
 #endif
 }
 
@@ -246,7 +382,6 @@ static void resend_timer_timercb(TimerHandle_t timer)
         ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
         if (ret == ESP_ERR_ESPNOW_NOT_FOUND) {
             // ESP_ERR_ESPNOW_NOT_FOUND
-            zero_prov_del_peer();
             zero_prov_check_peer_is_exist(resend_mac_addr);
 
             err_count++;
@@ -267,6 +402,259 @@ static void resend_timer_timercb(TimerHandle_t timer)
 #endif
 }
 
+static zero_prov_esp_now_data_t *zero_prov_info_frame_create(uint8_t channel)
+{
+    uint16_t length = sizeof(zero_prov_esp_now_data_t) + sizeof(zero_prov_unicast_data_t);
+    zero_prov_esp_now_data_t *pbuf = (zero_prov_esp_now_data_t *)malloc(length);
+    if (pbuf == NULL) {
+        ESP_LOGE(TAG, "Malloc unicast buff fail");
+        return NULL;
+    }
+    memset(pbuf, 0, length);
+    pbuf->type = ESPNOW_DATA_UNICAST_INFO;
+    pbuf->len = length;
+
+    mesh_lite_sta_config_t router_config;
+    zero_prov_unicast_data_t unicast_data;
+    memset(&router_config, 0x0, sizeof(router_config));
+    memset(&unicast_data, 0x0, sizeof(unicast_data));
+    esp_mesh_lite_get_router_config(&router_config);
+    snprintf((char *)unicast_data.router_ssid, strlen((char *)router_config.ssid) + 1, "%s", router_config.ssid);
+    snprintf((char *)unicast_data.router_password, strlen((char *)router_config.password) + 1, "%s", router_config.password);
+
+    unicast_data.channel = channel;
+    unicast_data.mesh_id = esp_mesh_lite_get_mesh_id();
+    unicast_data.random = esp_mesh_lite_get_argot();
+
+    wifi_config_t wifi_cfg;
+    esp_wifi_get_config(WIFI_IF_AP, &wifi_cfg);
+    uint8_t softap_mac[WIFI_MAC_ADDR_LEN];
+    esp_wifi_get_mac(WIFI_IF_AP, softap_mac);
+    snprintf((char *)unicast_data.softap_ssid, MAX_SSID_LEN, CONFIG_DEFAULT_SSID_PREFIX "_%02x%02x%02x", softap_mac[3], softap_mac[4], softap_mac[5]);
+    snprintf((char *)unicast_data.softap_password, MAX_PASSWORD_LEN, (char *)wifi_cfg.sta.password);
+
+    memcpy(pbuf->payload, &unicast_data, sizeof(zero_prov_unicast_data_t));
+    pbuf->crc = 0;
+    pbuf->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)pbuf, pbuf->len);
+    return pbuf;
+}
+
+static zero_prov_pending_node_t *zero_prov_pending_find(const uint8_t *mac)
+{
+    for (int i = 0; pending_nodes && i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++) {
+        if (pending_nodes[i].state != ZERO_PROV_NODE_FREE && !memcmp(pending_nodes[i].mac, mac, ESP_NOW_ETH_ALEN)) {
+            return &pending_nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static void pending_timer_timercb(TimerHandle_t timer)
+{
+    zero_prov_event_t evt;
+    evt.id = ZERO_PROV_PENDING_TICK;
+    if (s_zero_prov_queue) {
+        xQueueSend(s_zero_prov_queue, &evt, 0);
+    }
+}
+
+/* The peer goes with the entry, through the peer cache so that it stays in sync with the driver table */
+static void zero_prov_pending_release(zero_prov_pending_node_t *node)
+{
+    esp_mesh_lite_espnow_peer_del(node->mac);
+    node->state = ZERO_PROV_NODE_FREE;
+}
+
+static void zero_prov_pending_add(const uint8_t *mac, uint8_t channel)
+{
+    if (pending_nodes == NULL) {
+        pending_nodes = calloc(CONFIG_ZERO_PROV_MAX_PENDING_NODES, sizeof(zero_prov_pending_node_t));
+        if (pending_nodes == NULL) {
+            ESP_LOGE(TAG, "Malloc pending nodes fail");
+            return;
+        }
+    }
+
+    if (pending_timer == NULL) {
+        pending_timer = xTimerCreate("pending_timer", pdMS_TO_TICKS(ZERO_PROV_PENDING_TICK_MS), pdTRUE, NULL, pending_timer_timercb);
+    }
+
+    zero_prov_pending_node_t *node = zero_prov_pending_find(mac);
+    if (node) {
+        if (node->state == ZERO_PROV_NODE_DONE) {
+            // Broadcasts sent before the node got the confirm are still in flight while it lingers
+            if (esp_timer_get_time() < node->deadline_us) {
+                return;
+            }
+            // Still broadcasting after that, it gave up on its handshake, start over
+            node->state = ZERO_PROV_NODE_WAITING;
+            node->retry = 0;
+        }
+        node->channel = channel;
+        return;
+    }
+
+    for (int i = 0; i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++) {
+        if (pending_nodes[i].state == ZERO_PROV_NODE_FREE) {
+            node = &pending_nodes[i];
+            break;
+        }
+    }
+
+    // A full table would otherwise hold new nodes back for the whole linger, take the oldest done entry
+    for (int i = 0; node == NULL && i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++) {
+        zero_prov_pending_node_t *done = &pending_nodes[i];
+        if (done->state == ZERO_PROV_NODE_DONE) {
+            for (int j = i + 1; j < CONFIG_ZERO_PROV_MAX_PENDING_NODES; j++) {
+                if (pending_nodes[j].state == ZERO_PROV_NODE_DONE && pending_nodes[j].deadline_us < done->deadline_us) {
+                    done = &pending_nodes[j];
+                }
+            }
+            zero_prov_pending_release(done);
+            node = done;
+        }
+    }
+
+    if (node == NULL) {
+#if ZERO_PROV_DEBUG
+        ESP_LOGW(TAG, "Pending table full, ignore "MACSTR"", MAC2STR(mac));
+#endif
+        return;
+    }
+
+    memset(node, 0x0, sizeof(zero_prov_pending_node_t));
+    memcpy(node->mac, mac, ESP_NOW_ETH_ALEN);
+    node->channel = channel;
+    node->state = ZERO_PROV_NODE_WAITING;
+
+    if (pending_timer && xTimerIsTimerActive(pending_timer) == pdFALSE) {
+        xTimerStart(pending_timer, 0);
+    }
+}
+
+static void zero_prov_pending_done(const uint8_t *mac)
+{
+    zero_prov_pending_node_t *node = zero_prov_pending_find(mac);
+    if (node) {
+        node->state = ZERO_PROV_NODE_DONE;
+        node->deadline_us = esp_timer_get_time() + ZERO_PROV_DONE_LINGER_US;
+    }
+}
+
+static void zero_prov_pending_deinit(void)
+{
+    if (pending_timer) {
+        xTimerStop(pending_timer, 0);
+        xTimerDelete(pending_timer, 0);
+        pending_timer = NULL;
+    }
+
+    if (pending_nodes) {
+        for (int i = 0; i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++) {
+            if (pending_nodes[i].state != ZERO_PROV_NODE_FREE) {
+                zero_prov_pending_release(&pending_nodes[i]);
+            }
+        }
+        free(pending_nodes);
+        pending_nodes = NULL;
+    }
+}
+
+static void zero_prov_send_info(zero_prov_esp_now_data_t *pbuf, zero_prov_pending_node_t *node)
+{
+    zero_prov_check_peer_is_exist(node->mac);
+
+    esp_err_t ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_ZERO_PROV, node->mac, (const uint8_t *)pbuf, pbuf->len);
+    if (ret != ESP_OK) {
+        switch (ret) {
+        case ESP_ERR_ESPNOW_NOT_FOUND:
+            // Dropped from the peer cache, added again by the next send
+            break;
+
+        case ESP_ERR_ESPNOW_NO_MEM:
+            // ESP_LOGI(TAG, "free heap: %"PRIu32"", esp_get_free_heap_size());
+            break;
+
+        default:
+            ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
+            break;
+        }
+    }
+    node->state = ZERO_PROV_NODE_INFO_SENT;
+    node->deadline_us = esp_timer_get_time() + ZERO_PROV_HANDSHAKE_TIMEOUT_US;
+}
+
+/*
+ * Drive the pending table: retry handshakes whose confirm is overdue, then start handshakes for
+ * waiting nodes while fewer than CONFIG_ZERO_PROV_MAX_CONCURRENT_HANDSHAKES are in flight.
+ * The credential frame is the same for every node on a channel, so it is built once per pass.
+ */
+static void zero_prov_pending_handle(void *arg)
+{
+    if (pending_nodes == NULL) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int inflight = 0;
+    int active = 0;
+    zero_prov_esp_now_data_t *pbuf = NULL;
+    uint8_t pbuf_channel = 0;
+
+    for (int i = 0; i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++) {
+        zero_prov_pending_node_t *node = &pending_nodes[i];
+        if (node->state == ZERO_PROV_NODE_DONE && now >= node->deadline_us) {
+            zero_prov_pending_release(node);
+        } else if (node->state == ZERO_PROV_NODE_INFO_SENT && now >= node->deadline_us
+                   && ++node->retry > ZERO_PROV_HANDSHAKE_MAX_RETRY) {
+            ESP_LOGW(TAG, "Handshake with "MACSTR" timed out", MAC2STR(node->mac));
+            zero_prov_pending_release(node);
+        }
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++) {
+            zero_prov_pending_node_t *node = &pending_nodes[i];
+            // First pass: overdue handshakes, which already hold a slot. Second pass: waiting nodes.
+            if (pass == 0 && node->state == ZERO_PROV_NODE_INFO_SENT) {
+                inflight++;
+                if (now < node->deadline_us) {
+                    continue;
+                }
+            } else if (pass == 1 && node->state == ZERO_PROV_NODE_WAITING
+                       && inflight < CONFIG_ZERO_PROV_MAX_CONCURRENT_HANDSHAKES) {
+                inflight++;
+            } else {
+                continue;
+            }
+
+            if (pbuf == NULL || pbuf_channel != node->channel) {
+                free(pbuf);
+                pbuf = zero_prov_info_frame_create(node->channel);
+                pbuf_channel = node->channel;
+                if (pbuf == NULL) {
+                    return;
+                }
+            }
+            zero_prov_send_info(pbuf, node);
+#if ZERO_PROV_DEBUG
+            ESP_LOGI(TAG, "Send info to "MACSTR", retry %d", MAC2STR(node->mac), node->retry);
+#endif
+        }
+    }
+    free(pbuf);
+
+    for (int i = 0; i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++) {
+        if (pending_nodes[i].state != ZERO_PROV_NODE_FREE) {
+            active++;
+        }
+    }
+
+    if (active == 0 && pending_timer) {
+        xTimerStop(pending_timer, 0);
+    }
+}
+
 esp_err_t __attribute__((weak)) zero_prov_cust_data_validation(char *cust_data)
 {
     // Validate input cust_data
@@ -307,68 +695,11 @@ static void zero_prov_recieve_handle(void *arg)
             goto exit;
         }
 
-        zero_prov_check_peer_is_exist(recv_cb->mac_addr);
-
-        uint16_t length = sizeof(zero_prov_esp_now_data_t) + sizeof(zero_prov_unicast_data_t);
-        zero_prov_esp_now_data_t *pbuf = (zero_prov_esp_now_data_t *)malloc(length);
-        if (pbuf == NULL) {
-            ESP_LOGE(TAG, "Malloc unicast buff fail");
-            goto exit;
-        }
-        memset(pbuf, 0, length);
-        pbuf->type = ESPNOW_DATA_UNICAST_INFO;
-        pbuf->len = length;
-
-        mesh_lite_sta_config_t router_config;
-        zero_prov_unicast_data_t unicast_data;
-        memset(&router_config, 0x0, sizeof(router_config));
-        memset(&unicast_data, 0x0, sizeof(unicast_data));
-        esp_mesh_lite_get_router_config(&router_config);
-        snprintf((char *)unicast_data.router_ssid, strlen((char *)router_config.ssid) + 1, "%s", router_config.ssid);
-        snprintf((char *)unicast_data.router_password, strlen((char *)router_config.password) + 1, "%s", router_config.password);
-#if ZERO_PROV_DEBUG
-        // ESP_LOGI(TAG, "unicast_data.router_ssid:%s, unicast_data.router_password:%s", unicast_data.router_ssid, unicast_data.router_password);
-#endif
-
         uint8_t g_channel;
         wifi_second_chan_t g_channel2;
-        esp_wifi_get_channel(&g_channel,&g_channel2);
-        unicast_data.channel = g_channel;
-        unicast_data.mesh_id = esp_mesh_lite_get_mesh_id();
-        unicast_data.random = esp_mesh_lite_get_argot();
-
-        wifi_config_t wifi_cfg;
-        esp_wifi_get_config(WIFI_IF_AP, &wifi_cfg);
-        uint8_t softap_mac[WIFI_MAC_ADDR_LEN];
-        esp_wifi_get_mac(WIFI_IF_AP, softap_mac);
-        snprintf((char *)unicast_data.softap_ssid, MAX_SSID_LEN, CONFIG_DEFAULT_SSID_PREFIX "_%02x%02x%02x", softap_mac[3], softap_mac[4], softap_mac[5]);
-        snprintf((char *)unicast_data.softap_password, MAX_PASSWORD_LEN, (char *)wifi_cfg.sta.password);
-#if ZERO_PROV_DEBUG
-        // ESP_LOGI(TAG, "unicast_data.softap_ssid:%s, unicast_data.softap_password:%s", unicast_data.softap_ssid, unicast_data.softap_password);
-#endif
-
-        memcpy(pbuf->payload, &unicast_data, sizeof(zero_prov_unicast_data_t));
-        pbuf->crc = 0;
-        pbuf->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)pbuf, pbuf->len);
-
-        esp_err_t ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_ZERO_PROV, recv_cb->mac_addr, (const uint8_t *)pbuf, pbuf->len);
-        if (ret != ESP_OK) {
-            switch (ret) {
-            case ESP_ERR_ESPNOW_NOT_FOUND:
-                zero_prov_del_peer();
-                break;
-
-            case ESP_ERR_ESPNOW_NO_MEM:
-                // ESP_LOGI(TAG, "free heap: %"PRIu32"", esp_get_free_heap_size());
-                break;
-
-            default:
-                ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
-                break;
-            }
-        }
-        free(pbuf);
-        esp_now_del_peer(recv_cb->mac_addr);
+        esp_wifi_get_channel(&g_channel, &g_channel2);
+        zero_prov_pending_add(recv_cb->mac_addr, g_channel);
+        zero_prov_pending_handle(NULL);
 #if ZERO_PROV_DEBUG
         ESP_LOGW(TAG, "Receive ESPNOW_DATA_BROADCAST END**********");
 #endif
@@ -400,13 +731,13 @@ static void zero_prov_recieve_handle(void *arg)
         // within `zero_prov_broadcast_cb`, causing it to be on a different channel from the root node.
         esp_wifi_set_channel(date_unicast->channel, 0);
         ESP_LOGI(TAG, "set wifi channel:%d", date_unicast->channel);
+        zero_prov_channel_hint_update(date_unicast->channel, 0, ZERO_PROV_CHANNEL_HAS_MESH);
 
         esp_err_t ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_ZERO_PROV, recv_cb->mac_addr, (const uint8_t *)pbuf, pbuf->len);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
             if (ret == ESP_ERR_ESPNOW_NOT_FOUND) {
                 // ESP_ERR_ESPNOW_NOT_FOUND
-                zero_prov_del_peer();
                 zero_prov_check_peer_is_exist(recv_cb->mac_addr);
             }
         }
@@ -483,7 +814,7 @@ static void zero_prov_recieve_handle(void *arg)
         if (ret != ESP_OK) {
             switch (ret) {
             case ESP_ERR_ESPNOW_NOT_FOUND:
-                zero_prov_del_peer();
+                // Dropped from the peer cache, added again by the next send
                 break;
 
             case ESP_ERR_ESPNOW_NO_MEM:
@@ -497,7 +828,8 @@ static void zero_prov_recieve_handle(void *arg)
         }
         free(pbuf);
 
-        esp_now_del_peer(recv_cb->mac_addr);
+        zero_prov_pending_done(recv_cb->mac_addr);
+        zero_prov_pending_handle(NULL);
 #if ZERO_PROV_DEBUG
         ESP_LOGW(TAG, "Receive ESPNOW_DATA_UNICAST_CONFIRM END**********");
 #endif
@@ -593,7 +925,7 @@ static void zero_prov_send_cb(const uint8_t *mac_addr, esp_now_send_status_t sta
     memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
     send_cb->status = status;
     if (s_zero_prov_queue) {
-        if (xQueueSend(s_zero_prov_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
+        if (xQueueSend(s_zero_prov_queue, &evt, 0) != pdTRUE) {
             ESP_LOGW(TAG, "Send queue fail");
         }
     }
@@ -655,9 +987,9 @@ static esp_err_t zero_prov_recv_cb(const esp_now_recv_info_t *recv_info, const u
         goto err;
     }
 
-    if (xQueueSend(s_zero_prov_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
+    // Never wait in the Wi-Fi task. Resetting the queue here used to leak the queued frames
+    if (xQueueSend(s_zero_prov_queue, &evt, 0) != pdTRUE) {
         ESP_LOGW(TAG, "Send receive queue fail");
-        xQueueReset(s_zero_prov_queue);
         goto err;
     }
 
@@ -737,7 +1069,11 @@ void zero_prov_listening(uint64_t timeout_s)
 static void zero_prov_br_timer_cb(void *arg)
 {
     zero_prov_esp_now_data_t *buf = (zero_prov_esp_now_data_t *)arg;
-    esp_err_t ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_ZERO_PROV, s_broadcast_mac, (const uint8_t *)buf, buf->len);
+    esp_err_t ret = ESP_FAIL;
+    // A hop is left to zero_prov_task through the event below, it changes the channel and sends
+    if (!br_sweep.hop) {
+        ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_ZERO_PROV, s_broadcast_mac, (const uint8_t *)buf, buf->len);
+    }
     if (ret != ESP_OK) {
 #if ZERO_PROV_DEBUG
         ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
@@ -754,6 +1090,10 @@ static void zero_prov_br_timer_cb(void *arg)
 
 esp_err_t zero_prov_br_start(void)
 {
+    if (g_timer_handle) {
+        return ESP_OK;
+    }
+
     esp_now_data = calloc(1, sizeof(zero_prov_idle_node_data_t) + sizeof(zero_prov_esp_now_data_t));
     ZERO_PROV_ERR_CHECK(esp_now_data != NULL, "calloc failed", ESP_ERR_NO_MEM);
 
@@ -769,7 +1109,13 @@ esp_err_t zero_prov_br_start(void)
     timer.dispatch_method = ESP_TIMER_TASK;
     timer.name = "br";
     esp_timer_create(&timer, &g_timer_handle);
-    esp_timer_start_once(g_timer_handle, 100*1000);
+
+    memset(&br_sweep, 0x0, sizeof(br_sweep));
+    zero_prov_sweep_plan(&br_sweep);
+    if (br_sweep.num) {
+        zero_prov_sweep_set_channel(br_sweep.order[0]);
+    }
+    esp_timer_start_once(g_timer_handle, ZERO_PROV_BROADCAST_INTERVAL_MS * 1000);
     ESP_LOGI(TAG,"Start broadcast timer");
     return ESP_OK;
 }
@@ -846,21 +1192,13 @@ static esp_err_t zero_prov_esp_now_init(void)
     ESP_ERROR_CHECK( esp_now_register_send_cb(zero_prov_send_cb) );
     esp_mesh_lite_espnow_recv_cb_register(ESPNOW_DATA_TYPE_ZERO_PROV, zero_prov_recv_cb);
 
-    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-    if (peer == NULL) {
-        ESP_LOGE(TAG, "Malloc peer information fail");
+    if (esp_mesh_lite_espnow_peer_add(s_broadcast_mac, 0, WIFI_IF_STA) != ESP_OK) {
+        ESP_LOGE(TAG, "Add broadcast peer fail");
         esp_now_unregister_send_cb();
         vSemaphoreDelete(s_zero_prov_queue);
         zero_prov_handle = NULL;
         return ESP_FAIL;
     }
-    memset(peer, 0, sizeof(esp_now_peer_info_t));
-    peer->channel = 0;
-    peer->ifidx = ESP_IF_WIFI_STA;
-    peer->encrypt = false;
-    memcpy(peer->peer_addr, s_broadcast_mac, ESP_NOW_ETH_ALEN);
-    esp_now_add_peer(peer);
-    free(peer);
 
     router_cfg = calloc(1, sizeof(wifi_config_t));
 
@@ -917,6 +1255,8 @@ static void zero_prov_deinit(void)
         zero_prov_handle = NULL;
     }
 
+    zero_prov_pending_deinit();
+
     if (s_zero_prov_queue) {
         vSemaphoreDelete(s_zero_prov_queue);
         s_zero_prov_queue = NULL;
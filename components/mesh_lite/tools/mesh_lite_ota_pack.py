@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+#
+# SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Produce packed LAN OTA files for Mesh-Lite (see esp_mesh_lite_ota_pack.h), and apply them on the host to check them.
+#
+#   mesh_lite_ota_pack.py pack  new.bin -o new.mlpk
+#   mesh_lite_ota_pack.py delta old.bin new.bin -o old_to_new.mlpk
+#   mesh_lite_ota_pack.py apply old_to_new.mlpk -o check.bin --base old.bin
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+PACK_MAGIC = 0x4B504C4D
+PACK_VERSION = 1
+PACK_FULL = 0
+PACK_DELTA = 1
+FLAG_DEFLATE = 0x01
+
+OP_COPY = 1
+OP_ADD = 2
+OP_INSERT = 3
+
+HEADER = struct.Struct('<IBBBBII32s32s')
+
+KEY_LEN = 16
+KEY_STEP = 4
+MIN_COPY = 64
+ADD_WINDOW = 64
+
+
+def image_sha256(data):
+    # Same value as esp_partition_get_sha256() on an app partition: the appended digest if present
+    if len(data) > 32 and hashlib.sha256(data[:-32]).digest() == data[-32:]:
+        return data[-32:]
+    return hashlib.sha256(data).digest()
+
+
+def make_delta(old, new):
+    index = {}
+    for i in range(0, len(old) - KEY_LEN + 1, KEY_STEP):
+        index.setdefault(old[i:i + KEY_LEN], i)
+
+    ops = bytearray()
+    literal = bytearray()
+
+    def flush_literal():
+        if literal:
+            ops.extend(struct.pack('<BI', OP_INSERT, len(literal)) + literal)
+            literal.clear()
+
+    j = 0
+    while j < len(new):
+        src = index.get(new[j:j + KEY_LEN]) if j + KEY_LEN <= len(new) else None
+        if src is None:
+            literal.append(new[j])
+            j += 1
+            continue
+
+        # Extend the exact match forward
+        n = KEY_LEN
+        while j + n < len(new) and src + n < len(old) and new[j + n] == old[src + n]:
+            n += 1
+        if n < MIN_COPY:
+            literal.extend(new[j:j + n])
+            j += n
+            continue
+
+        flush_literal()
+        ops.extend(struct.pack('<BII', OP_COPY, src, n))
+        j += n
+        src += n
+
+        # Keep following the diagonal while it mostly matches, e.g. code with relocated addresses
+        add_start = j
+        while j + ADD_WINDOW <= len(new) and src + (j - add_start) + ADD_WINDOW <= len(old):
+            s = src + (j - add_start)
+            same = sum(1 for k in range(ADD_WINDOW) if new[j + k] == old[s + k])
+            if same < ADD_WINDOW // 2 or new[j:j + KEY_LEN] in index and same == ADD_WINDOW:
+                break
+            j += ADD_WINDOW
+        if j > add_start:
+            diff = bytes((new[add_start + k] - old[src + k]) & 0xFF for k in range(j - add_start))
+            ops.extend(struct.pack('<BII', OP_ADD, src, len(diff)) + diff)
+
+    flush_literal()
+    return bytes(ops)
+
+
+def apply_delta(old, payload):
+    out = bytearray()
+    i = 0
+    while i < len(payload):
+        op = payload[i]
+        if op == OP_COPY:
+            src, n = struct.unpack_from('<II', payload, i + 1)
+            out.extend(old[src:src + n])
+            i += 9
+        elif op == OP_ADD:
+            src, n = struct.unpack_from('<II', payload, i + 1)
+            diff = payload[i + 9:i + 9 + n]
+            out.extend((old[src + k] + diff[k]) & 0xFF for k in range(n))
+            i += 9 + n
+        elif op == OP_INSERT:
+            (n,) = struct.unpack_from('<I', payload, i + 1)
+            out.extend(payload[i + 5:i + 5 + n])
+            i += 5 + n
+        else:
+            raise ValueError('unknown delta op %d at %d' % (op, i))
+    return bytes(out)
+
+
+def build(pack_type, new, payload, source_sha, compress):
+    flags = 0
+    if compress:
+        payload = zlib.compress(payload, 9)
+        flags |= FLAG_DEFLATE
+    header = HEADER.pack(PACK_MAGIC, PACK_VERSION, pack_type, flags, 0, len(new), len(payload),
+                         image_sha256(new), source_sha)
+    return header + payload
+
+
+def cmd_pack(args):
+    new = open(args.new, 'rb').read()
+    out = build(PACK_FULL, new, new, bytes(32), not args.no_compress)
+    open(args.output, 'wb').write(out)
+    print('%s: %d -> %d bytes (%.1f%%)' % (args.output, len(new), len(out), 100.0 * len(out) / len(new)))
+
+
+def cmd_delta(args):
+    old = open(args.old, 'rb').read()
+    new = open(args.new, 'rb').read()
+    payload = make_delta(old, new)
+    if apply_delta(old, payload) != new:
+        sys.exit('internal error: delta does not reproduce the new image')
+    out = build(PACK_DELTA, new, payload, image_sha256(old), not args.no_compress)
+    open(args.output, 'wb').write(out)
+    print('%s: %d -> %d bytes (%.1f%%), delta %d bytes before compression' %
+          (args.output, len(new), len(out), 100.0 * len(out) / len(new), len(payload)))
+
+
+def cmd_apply(args):
+    data = open(args.packed, 'rb').read()
+    magic, version, pack_type, flags, _, image_size, payload_size, image_sha, source_sha = HEADER.unpack_from(data)
+    if magic != PACK_MAGIC or version != PACK_VERSION:
+        sys.exit('not a packed LAN OTA file')
+    payload = data[HEADER.size:HEADER.size + payload_size]
+    if flags & FLAG_DEFLATE:
+        payload = zlib.decompress(payload)
+    if pack_type == PACK_DELTA:
+        if not args.base:
+            sys.exit('a delta needs --base')
+        old = open(args.base, 'rb').read()
+        if image_sha256(old) != source_sha:
+            sys.exit('delta does not apply to %s' % args.base)
+        new = apply_delta(old, payload)
+    else:
+        new = payload
+    if len(new) != image_size or image_sha256(new) != image_sha:
+        sys.exit('decoded image does not match its SHA-256')
+    open(args.output, 'wb').write(new)
+    print('%s: %d bytes transferred, %d bytes image, SHA-256 OK' % (args.output, len(data), len(new)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Mesh-Lite packed LAN OTA tool')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('pack', help='compress a full application image')
+    p.add_argument('new')
+    p.add_argument('-o', '--output', required=True)
+    p.add_argument('--no-compress', action='store_true')
+    p.set_defaults(func=cmd_pack)
+
+    p = sub.add_parser('delta', help='make a delta between two application images')
+    p.add_argument('old')
+    p.add_argument('new')
+    p.add_argument('-o', '--output', required=True)
+    p.add_argument('--no-compress', action='store_true')
+    p.set_defaults(func=cmd_delta)
+
+    p = sub.add_parser('apply', help='decode a packed file on the host')
+    p.add_argument('packed')
+    p.add_argument('-o', '--output', required=True)
+    p.add_argument('--base', help='running image a delta applies to')
+    p.set_defaults(func=cmd_apply)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,41 @@
+/*
+ * Minimal test and benchmark helpers for the host tests. A test binary runs its checks from main()
+ * and returns host_test_result(), benchmarks print their numbers on stdout.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int host_test_failures = 0;
+
+#define TEST_ASSERT(cond)                                                           \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #cond);     \
+            host_test_failures++;                                                   \
+        }                                                                           \
+    } while (0)
+
+#define RUN_TEST(fn)                                                                \
+    do                                                                              \
+    {                                                                               \
+        int before = host_test_failures;                                            \
+        fn();                                                                       \
+        printf("%s %s\n", host_test_failures == before ? "PASS" : "FAIL", #fn);     \
+    } while (0)
+
+static inline int64_t host_test_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline int host_test_result(void)
+{
+    return host_test_failures ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Stand-in application for test_ota_pack: two builds of the same modules, the second one with a
+ * change in the first object, which shifts the code behind it as a firmware update does. The
+ * stripped executables are the old and the new image the packs are made from. The application
+ * installs a pack from a staging file with the decoder, partitions are in memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_ota_ops.h"
+#include "esp_mesh_lite_ota_pack.h"
+
+#define IMAGE_PARTITION_SIZE (256 * 1024)
+
+typedef struct
+{
+    esp_partition_t part;       /* First, the module only sees this */
+    uint8_t *data;
+    size_t len;
+} image_partition_t;
+
+static uint8_t partition_data[3][IMAGE_PARTITION_SIZE];
+static image_partition_t running = {.part = {.address = 0x10000, .size = IMAGE_PARTITION_SIZE, .label = "ota_0"},
+                                    .data = partition_data[0]};
+static image_partition_t update = {.part = {.address = 0x50000, .size = IMAGE_PARTITION_SIZE, .label = "ota_1"},
+                                   .data = partition_data[1]};
+static image_partition_t staging = {.part = {.address = 0x90000, .size = IMAGE_PARTITION_SIZE, .label = "staging"},
+                                    .data = partition_data[2]};
+static const esp_partition_t *boot = &running.part;
+
+#if OTA_IMAGE_NEW
+/* The update: the partitions are printed after the install */
+static void print_partitions(void)
+{
+    const image_partition_t *parts[] = {&running, &update, &staging};
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+    {
+        printf("%-8s 0x%06x %6u bytes%s\n", parts[i]->part.label, (unsigned)parts[i]->part.address,
+               (unsigned)parts[i]->len, boot == &parts[i]->part ? ", boot" : "");
+    }
+}
+#endif
+
+/* FNV-1a folded into the 32 bytes, the image only needs to tell its partitions apart */
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256)
+{
+    const image_partition_t *p = (const image_partition_t *)partition;
+    uint32_t hash = 2166136261u;
+    memset(sha_256, 0, 32);
+    for (size_t i = 0; i < p->len; i++)
+    {
+        hash = (hash ^ p->data[i]) * 16777619u;
+        sha_256[i % 32] ^= (uint8_t)hash;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    const image_partition_t *p = (const image_partition_t *)partition;
+    if (src_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, p->data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    if (partition != &update.part || (image_size != OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    update.len = 0;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (update.len + size > IMAGE_PARTITION_SIZE)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(update.data + update.len, data, size);
+    update.len += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return update.len ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    update.len = 0;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &running.part;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &update.part;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    boot = partition;
+    return ESP_OK;
+}
+
+static size_t load_file(const char *path, image_partition_t *part)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+    part->len = fread(part->data, 1, IMAGE_PARTITION_SIZE, file);
+    fclose(file);
+    return part->len;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || !load_file(argv[1], &running) || !load_file(argv[2], &staging))
+    {
+        fprintf(stderr, "usage: %s <running image> <pack>\n", argv[0]);
+        return 1;
+    }
+    esp_err_t ret = esp_mesh_lite_ota_pack_install(&staging.part, staging.len);
+    printf("install: %s, %u bytes\n", esp_err_to_name(ret), (unsigned)update.len);
+#if OTA_IMAGE_NEW
+    print_partitions();
+#endif
+    return ret == ESP_OK ? 0 : 1;
+}
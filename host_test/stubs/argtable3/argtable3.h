@@ -0,0 +1,28 @@
+/* Host stand-in for the argtable3 header, the tests that register console commands define the parser */
+#pragma once
+
+#include <stdio.h>
+
+struct arg_int
+{
+    int count;
+    int *ival;
+};
+
+struct arg_str
+{
+    int count;
+    const char **sval;
+};
+
+struct arg_end
+{
+    int count;
+};
+
+/* Defined by the tests that use them */
+struct arg_int *arg_int1(const char *shortopts, const char *longopts, const char *datatype, const char *glossary);
+struct arg_str *arg_str1(const char *shortopts, const char *longopts, const char *datatype, const char *glossary);
+struct arg_end *arg_end(int maxcount);
+int arg_parse(int argc, char **argv, void **argtable);
+void arg_print_errors(FILE *fp, struct arg_end *end, const char *progname);
@@ -0,0 +1,4 @@
+/* Host stand-in for the cJSON header, the modules under test only pass the pointers around */
+#pragma once
+
+typedef struct cJSON cJSON;
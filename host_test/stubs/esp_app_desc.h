@@ -0,0 +1,15 @@
+/* Host stand-in for the ESP-IDF header, the test defines esp_app_get_description() */
+#pragma once
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t magic_word;
+    uint32_t secure_version;
+    uint32_t reserv1[2];
+    char version[32];
+    char project_name[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_app_get_description(void);
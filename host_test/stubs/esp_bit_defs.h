@@ -0,0 +1,4 @@
+/* Host stand-in for the ESP-IDF header */
+#pragma once
+
+#define BIT(nr) (1UL << (nr))
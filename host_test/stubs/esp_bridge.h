@@ -0,0 +1,10 @@
+/* Host stand-in for the iot_bridge header, only what the modules under test use */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+
+void esp_bridge_network_segment_check_register(bool (*cb)(uint32_t ip));
+esp_err_t esp_bridge_netif_network_segment_conflict_update(void *netif);
@@ -0,0 +1,6 @@
+/* Host stand-in for the ESP-IDF header, each test that traces defines the cycle counter */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_cpu_get_cycle_count(void);
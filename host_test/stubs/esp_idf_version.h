@@ -0,0 +1,5 @@
+/* Host stand-in for the ESP-IDF header, the tests build against ESP-IDF 5.3 */
+#pragma once
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 3, 0)
@@ -0,0 +1,26 @@
+/* Host stand-in for the ESP-IDF header, logging compiles away, the arguments still count as used */
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#define ESP_LOGE(tag, ...) ((void)(tag), (void)sizeof(printf(__VA_ARGS__)))
+#define ESP_LOGW(tag, ...) ((void)(tag), (void)sizeof(printf(__VA_ARGS__)))
+#define ESP_LOGI(tag, ...) ((void)(tag), (void)sizeof(printf(__VA_ARGS__)))
+#define ESP_LOGD(tag, ...) ((void)(tag), (void)sizeof(printf(__VA_ARGS__)))
+
+#define LOG_COLOR_CYAN "36"
+#define LOG_RESET_COLOR ""
+
+/* Defined by the tests that use it */
+uint32_t esp_log_timestamp(void);
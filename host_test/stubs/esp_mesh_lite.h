@@ -0,0 +1,57 @@
+/*
+ * Host stand-in for the mesh-lite API, only what the modules under test use. The tests define the
+ * functions and play the rest of the mesh.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define ROOT (1)
+
+/* From esp_mesh_lite_espnow.h, v1 ESP-NOW frames */
+#define ESPNOW_PAYLOAD_MAX_LEN (250)
+
+#define MESH_LITE_MSG_ID_TIME_SYNC      0x70
+#define MESH_LITE_MSG_ID_TIME_SYNC_RESP 0x71
+
+typedef esp_err_t (*raw_msg_process_cb_t)(uint8_t *data, uint32_t len, uint8_t **out_data, uint32_t *out_len,
+                                          uint32_t seq);
+
+typedef struct esp_mesh_lite_raw_msg_action {
+    uint32_t msg_id;
+    uint32_t resp_msg_id;
+    raw_msg_process_cb_t raw_process;
+} esp_mesh_lite_raw_msg_action_t;
+
+typedef struct {
+    uint32_t msg_id;
+    uint32_t expect_resp_msg_id;
+    uint32_t max_retry;
+    uint16_t retry_interval;
+    const uint8_t *data;
+    size_t size;
+    esp_err_t (*raw_resend)(const uint8_t *data, size_t size);
+    void (*raw_send_fail)(uint32_t msg_id);
+} esp_mesh_lite_raw_msg_config_t;
+
+typedef union {
+    esp_mesh_lite_raw_msg_config_t raw_msg;
+} esp_mesh_lite_msg_config_t;
+
+typedef enum {
+    ESP_MESH_LITE_JSON_MSG,
+    ESP_MESH_LITE_RAW_MSG,
+    ESP_MESH_LITE_OTHER_MSG,
+} esp_mesh_lite_msg_data_t;
+
+uint8_t esp_mesh_lite_get_level(void);
+esp_err_t esp_mesh_lite_send_msg(esp_mesh_lite_msg_data_t type, esp_mesh_lite_msg_config_t *conf);
+esp_err_t esp_mesh_lite_send_raw_msg_to_parent(const uint8_t *data, size_t size);
+esp_err_t esp_mesh_lite_raw_msg_action_list_register(const esp_mesh_lite_raw_msg_action_t *msg_action);
+
+typedef const uint8_t *(*esp_mesh_lite_get_ssid_by_mac_cb_t)(const uint8_t *mac);
+
+esp_err_t esp_mesh_lite_get_ssid_by_mac_cb_register(esp_mesh_lite_get_ssid_by_mac_cb_t cb, bool whitelist);
@@ -0,0 +1,25 @@
+/* Host stand-in for the ESP-IDF header, only what the modules under test use */
+#pragma once
+
+#include "esp_netif_ip_addr.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct
+{
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef enum
+{
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+    IP_EVENT_AP_STAIPASSIGNED,
+} ip_event_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info);
@@ -0,0 +1,19 @@
+/* Host stand-in for the ESP-IDF header, only what the modules under test use */
+#pragma once
+
+#include <stdint.h>
+#include "esp_event.h"
+
+typedef struct
+{
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct
+{
+    union
+    {
+        esp_ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} esp_ip_addr_t;
@@ -0,0 +1,2 @@
+/* Host stand-in for the ESP-IDF header, nothing in it is used by the modules under test */
+#pragma once
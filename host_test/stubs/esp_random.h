@@ -0,0 +1,6 @@
+/* Host stand-in for the ESP-IDF header, each test defines esp_random() */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
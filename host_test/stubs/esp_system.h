@@ -0,0 +1,5 @@
+/* Host stand-in for the ESP-IDF header, esp_wifi.h declares what the modules under test use */
+#pragma once
+
+#include "esp_wifi.h"
+#include "esp_idf_version.h"
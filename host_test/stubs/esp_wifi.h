@@ -0,0 +1,136 @@
+/* Host stand-in for the ESP-IDF header, only what the modules under test use */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+#define MAX_SSID_LEN 32
+
+typedef struct
+{
+    int8_t rssi;
+    uint8_t rate;
+    int8_t noise_floor;
+} wifi_pkt_rx_ctrl_t;
+
+typedef enum
+{
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+#define ESP_IF_WIFI_STA WIFI_IF_STA
+#define ESP_IF_WIFI_AP WIFI_IF_AP
+
+typedef enum
+{
+    WIFI_STORAGE_FLASH = 0,
+    WIFI_STORAGE_RAM,
+} wifi_storage_t;
+
+typedef enum
+{
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WPA2_PSK = 3,
+} wifi_auth_mode_t;
+
+typedef enum
+{
+    WIFI_SECOND_CHAN_NONE = 0,
+} wifi_second_chan_t;
+
+typedef struct
+{
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+} wifi_scan_threshold_t;
+
+typedef struct
+{
+    uint8_t *ssid;
+    uint8_t *bssid;
+    uint8_t channel;
+} wifi_scan_config_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+    uint8_t ssid_len;
+    wifi_auth_mode_t authmode;
+    uint8_t max_connection;
+} wifi_ap_config_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+    bool bssid_set;
+    uint8_t bssid[6];
+} wifi_sta_config_t;
+
+typedef union
+{
+    wifi_ap_config_t ap;
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct
+{
+    uint8_t schan;
+    uint8_t nchan;
+} wifi_country_t;
+
+typedef struct
+{
+    int num;
+} wifi_sta_list_t;
+
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+} wifi_ap_record_t;
+
+ESP_EVENT_DECLARE_BASE(WIFI_EVENT);
+
+typedef enum
+{
+    WIFI_EVENT_STA_DISCONNECTED = 5,
+} wifi_event_t;
+
+typedef enum
+{
+    WIFI_REASON_NO_AP_FOUND = 201,
+    WIFI_REASON_NO_AP_FOUND_W_COMPATIBLE_SECURITY = 210,
+    WIFI_REASON_NO_AP_FOUND_IN_AUTHMODE_THRESHOLD = 211,
+    WIFI_REASON_NO_AP_FOUND_IN_RSSI_THRESHOLD = 212,
+} wifi_err_reason_t;
+
+typedef struct
+{
+    uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+/* Defined by the tests that use them */
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta);
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_deauth_sta(uint16_t aid);
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+esp_err_t esp_wifi_get_country(wifi_country_t *country);
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_connect(void);
+
+/* Declared by esp_system.h, which the ESP-IDF headers pull in */
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+void esp_restart(void);
@@ -0,0 +1,42 @@
+/*
+ * Host stand-in for the FreeRTOS header. The host tests are single threaded unless they define
+ * HOST_TEST_TASKS and run tasks as threads, critical sections are then recursive mutexes, which nest
+ * like the spinlocks on a chip.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY UINT32_MAX
+#define pdMS_TO_TICKS(ms) (ms)
+#define pdTICKS_TO_MS(ticks) (ticks)
+
+#if HOST_TEST_TASKS
+#include <pthread.h>
+
+typedef pthread_mutex_t portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+#else
+typedef int portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#endif
+#define portENTER_CRITICAL_SAFE(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_SAFE(mux) portEXIT_CRITICAL(mux)
+#define portNUM_PROCESSORS 1
+#define xPortGetCoreID() 0
@@ -0,0 +1,19 @@
+/* Host stand-in for the FreeRTOS header, the event group functions are defined by the tests that use them */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef uint32_t EventBits_t;
+
+typedef struct
+{
+    EventBits_t bits;
+} StaticEventGroup_t;
+
+typedef StaticEventGroup_t *EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all,
+                                TickType_t wait);
@@ -0,0 +1,12 @@
+/* Host stand-in for the FreeRTOS header, the tests that use queues play them */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *QueueHandle_t;
+
+/* Defined by the tests that use them */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+BaseType_t xQueueReset(QueueHandle_t queue);
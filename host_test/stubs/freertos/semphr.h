@@ -0,0 +1,142 @@
+/*
+ * Host stand-in for the FreeRTOS header. Semaphores are no-ops in the single threaded tests, with
+ * HOST_TEST_TASKS they are counting semaphores on a mutex and a condition variable, waits are in
+ * milliseconds like the ticks of the stub.
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#if HOST_TEST_TASKS
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned count;
+    unsigned max;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t host_semaphore_init(StaticSemaphore_t *sem, unsigned count, unsigned max)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    sem->count = count;
+    sem->max = max;
+    return sem;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_semaphore_init(malloc(sizeof(StaticSemaphore_t)), 1, 1);
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf)
+{
+    return host_semaphore_init(buf, 0, 1);
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_semaphore_init(malloc(sizeof(StaticSemaphore_t)), 0, 1);
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait / 1000;
+    deadline.tv_nsec += (wait % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0 && wait != 0)
+    {
+        if (wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(&sem->cond, &sem->lock);
+        }
+        else if (pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    BaseType_t taken = sem->count > 0;
+    if (taken)
+    {
+        sem->count--;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    BaseType_t given = sem->count < sem->max;
+    if (given)
+    {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given ? pdTRUE : pdFALSE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->lock);
+}
+#else
+typedef int StaticSemaphore_t;
+typedef void *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    static int mutex;
+    return &mutex;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf)
+{
+    return buf;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    static int binary;
+    return &binary;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    (void)sem;
+    (void)wait;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    (void)sem;
+    return pdTRUE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    (void)sem;
+}
+#endif
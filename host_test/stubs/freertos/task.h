@@ -0,0 +1,62 @@
+/*
+ * Host stand-in for the FreeRTOS header. Also has the mutexes of semphr.h, which the ESP-IDF headers
+ * pull in along with it.
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+/* ESP-IDF counts stacks in bytes and the run time in microseconds of esp_timer */
+typedef uint8_t StackType_t;
+#define configMAX_TASK_NAME_LEN 16
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#define tskNO_AFFINITY 0x7fffffff
+#define taskSCHEDULER_NOT_STARTED 1
+#define taskSCHEDULER_RUNNING 2
+
+typedef enum
+{
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef struct
+{
+    TaskHandle_t xHandle;
+    const char *pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+    StackType_t *pxStackBase;
+    uint32_t usStackHighWaterMark;
+} TaskStatus_t;
+
+/* Defined by the tests that run tasks, as threads */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task);
+void vTaskDelete(TaskHandle_t task);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t increment);
+
+/* Defined by the tests that simulate the tasks of the scheduler */
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t max, configRUN_TIME_COUNTER_TYPE *total_run_time);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+char *pcTaskGetName(TaskHandle_t task);
+BaseType_t xTaskGetSchedulerState(void);
@@ -0,0 +1,47 @@
+/*
+ * Host stand-in for the FreeRTOS header, the test calls the timer callbacks itself. With
+ * HOST_TEST_TIMERS it also creates the timers.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+typedef void *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+typedef void (*PendedFunction_t)(void *arg1, uint32_t arg2);
+
+#define portTICK_PERIOD_MS 1
+
+#if HOST_TEST_TIMERS
+/* Defined by the tests that run the timers on their simulated clock */
+TimerHandle_t xTimerCreate(const char *name, uint32_t period, int reload, void *id, TimerCallbackFunction_t cb);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+#else
+static inline TimerHandle_t xTimerCreate(const char *name, uint32_t period, int reload, void *id,
+                                         TimerCallbackFunction_t cb)
+{
+    (void)name;
+    (void)period;
+    (void)reload;
+    (void)id;
+    return (TimerHandle_t)cb;
+}
+
+static inline int xTimerStart(TimerHandle_t timer, uint32_t wait)
+{
+    (void)timer;
+    (void)wait;
+    return pdTRUE;
+}
+#endif
+
+/* Defined by the tests that restart their timers */
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+BaseType_t xTimerPendFunctionCall(PendedFunction_t fn, void *arg1, uint32_t arg2, TickType_t wait);
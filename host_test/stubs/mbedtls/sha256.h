@@ -0,0 +1,86 @@
+/* Host stand-in for the mbedtls header, the one-shot SHA-256 (FIPS 180-4) computed block by block */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static inline void host_sha256_block(uint32_t state[8], const unsigned char *block)
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+#define HOST_SHA256_ROR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+    uint32_t w[64], v[8];
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)block[4 * i] << 24 | block[4 * i + 1] << 16 | block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = HOST_SHA256_ROR(w[i - 15], 7) ^ HOST_SHA256_ROR(w[i - 15], 18) ^ w[i - 15] >> 3;
+        uint32_t s1 = HOST_SHA256_ROR(w[i - 2], 17) ^ HOST_SHA256_ROR(w[i - 2], 19) ^ w[i - 2] >> 10;
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(v, state, sizeof(v));
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = v[7] + (HOST_SHA256_ROR(v[4], 6) ^ HOST_SHA256_ROR(v[4], 11) ^ HOST_SHA256_ROR(v[4], 25))
+                      + ((v[4] & v[5]) ^ (~v[4] & v[6])) + k[i] + w[i];
+        uint32_t t2 = (HOST_SHA256_ROR(v[0], 2) ^ HOST_SHA256_ROR(v[0], 13) ^ HOST_SHA256_ROR(v[0], 22))
+                      + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        state[i] += v[i];
+    }
+#undef HOST_SHA256_ROR
+}
+
+/* SHA-224 is not needed by the tests */
+static inline int mbedtls_sha256(const unsigned char *input, size_t ilen, unsigned char *output, int is224)
+{
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char tail[128] = {0};
+    size_t full = ilen / 64 * 64, rest = ilen - full;
+    size_t tail_len = rest < 56 ? 64 : 128;
+
+    if (is224)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < full; i += 64)
+    {
+        host_sha256_block(state, input + i);
+    }
+    memcpy(tail, input + full, rest);
+    tail[rest] = 0x80;
+    for (int i = 0; i < 8; i++)
+    {
+        tail[tail_len - 1 - i] = (unsigned char)((uint64_t)ilen * 8 >> (8 * i));
+    }
+    host_sha256_block(state, tail);
+    if (tail_len == 128)
+    {
+        host_sha256_block(state, tail + 64);
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        output[4 * i] = state[i] >> 24;
+        output[4 * i + 1] = state[i] >> 16;
+        output[4 * i + 2] = state[i] >> 8;
+        output[4 * i + 3] = state[i];
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for the generated protobuf-c header of the time sync message. The test packs the
+ * struct as it is, the wire format does not matter to it.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t seq;
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+    bool synced;
+} MeshLite__TimeSync;
+
+static inline void mesh_lite__time_sync__init(MeshLite__TimeSync *message)
+{
+    memset(message, 0, sizeof(*message));
+}
+
+static inline size_t mesh_lite__time_sync__pack(const MeshLite__TimeSync *message, uint8_t *out)
+{
+    memcpy(out, message, sizeof(*message));
+    return sizeof(*message);
+}
+
+static inline MeshLite__TimeSync *mesh_lite__time_sync__unpack(void *allocator, size_t len, const uint8_t *data)
+{
+    (void)allocator;
+    if (len != sizeof(MeshLite__TimeSync)) {
+        return NULL;
+    }
+    MeshLite__TimeSync *message = malloc(sizeof(*message));
+    if (message) {
+        memcpy(message, data, sizeof(*message));
+    }
+    return message;
+}
+
+static inline void mesh_lite__time_sync__free_unpacked(MeshLite__TimeSync *message, void *allocator)
+{
+    (void)allocator;
+    free(message);
+}
@@ -0,0 +1,91 @@
+/*
+ * Host stand-in for the tinfl part of the ESP-IDF ROM miniz, on top of zlib. The statuses and
+ * the ring dictionary contract are the same: output goes to pOut_buf_next, at most *pOut_buf_size
+ * bytes, and the caller wraps around TINFL_LZ_DICT_SIZE.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE                      32768
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER            1
+#define TINFL_FLAG_HAS_MORE_INPUT               2
+#define TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF 4
+#define TINFL_FLAG_COMPUTE_ADLER32              8
+
+typedef enum
+{
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef struct
+{
+    z_stream stream;
+    int state;                  /* 0 before the first call, 1 inflating, 2 ended */
+} tinfl_decompressor;
+
+#define tinfl_init(r) memset((r), 0, sizeof(tinfl_decompressor))
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                                            uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                                            const uint32_t decomp_flags)
+{
+    (void)pOut_buf_start;
+    if (r->state == 2)
+    {
+        *pIn_buf_size = 0;
+        *pOut_buf_size = 0;
+        return TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS;
+    }
+    if (r->state == 0)
+    {
+        int window = (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15;
+        if (inflateInit2(&r->stream, window) != Z_OK)
+        {
+            return TINFL_STATUS_BAD_PARAM;
+        }
+        r->state = 1;
+    }
+
+    r->stream.next_in = (uint8_t *)pIn_buf_next;
+    r->stream.avail_in = *pIn_buf_size;
+    r->stream.next_out = pOut_buf_next;
+    r->stream.avail_out = *pOut_buf_size;
+    int z = inflate(&r->stream, Z_NO_FLUSH);
+    *pIn_buf_size -= r->stream.avail_in;
+    *pOut_buf_size -= r->stream.avail_out;
+
+    tinfl_status status;
+    if (z == Z_STREAM_END)
+    {
+        status = TINFL_STATUS_DONE;
+    }
+    else if (z == Z_OK || z == Z_BUF_ERROR)
+    {
+        status = r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+    }
+    else if (z == Z_DATA_ERROR && r->stream.msg && !strcmp(r->stream.msg, "incorrect data check"))
+    {
+        status = TINFL_STATUS_ADLER32_MISMATCH;
+    }
+    else
+    {
+        status = TINFL_STATUS_FAILED;
+    }
+    if (status <= TINFL_STATUS_DONE)
+    {
+        inflateEnd(&r->stream);
+        r->state = 2;
+    }
+    return status;
+}
@@ -0,0 +1,4 @@
+/* Host stand-in for the ESP-IDF header, nothing the modules under test use */
+#pragma once
+
+#include "esp_err.h"
@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for the protobuf-c header, enough to declare the generated messages. The tests that
+ * use them define the pack and unpack functions of the messages they exchange.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROTOBUF_C__BEGIN_DECLS
+#define PROTOBUF_C__END_DECLS
+#define PROTOBUF_C_VERSION_NUMBER 1004001
+#define PROTOBUF_C_MIN_COMPILER_VERSION 1000000
+
+typedef int protobuf_c_boolean;
+typedef struct ProtobufCMessageDescriptor ProtobufCMessageDescriptor;
+typedef struct ProtobufCBuffer ProtobufCBuffer;
+typedef struct ProtobufCAllocator ProtobufCAllocator;
+
+typedef struct
+{
+    size_t len;
+    uint8_t *data;
+} ProtobufCBinaryData;
+
+typedef struct
+{
+    const ProtobufCMessageDescriptor *descriptor;
+    unsigned n_unknown_fields;
+    void *unknown_fields;
+} ProtobufCMessage;
+
+#define PROTOBUF_C_MESSAGE_INIT(descriptor) { descriptor, 0, NULL }
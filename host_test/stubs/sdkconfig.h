@@ -0,0 +1,65 @@
+/* Host stand-in for the generated sdkconfig.h, Kconfig defaults of the options the tests use, for a 200 node mesh */
+#pragma once
+
+#define CONFIG_APP_LINK_TABLE_SIZE 32
+#define CONFIG_SENSOR_RING_SIZE 64
+#define CONFIG_SENSOR_MAX_NUM 16
+#define CONFIG_SENSOR_WHEEL_TICK_MS 10
+#define CONFIG_SENSOR_BATCH_TIMEOUT_MS 1000
+#define CONFIG_SENSOR_STORE_MAX_SERIES 1024
+#define CONFIG_SENSOR_STORE_CHUNK_NUM 4
+#define CONFIG_SENSOR_STORE_CHUNK_SIZE 128
+#define CONFIG_SENSOR_STORE_MINUTE_BUCKETS 60
+#define CONFIG_SENSOR_STORE_HOUR_BUCKETS 24
+#define CONFIG_SENSOR_STORE_SPILL 1
+#define CONFIG_SENSOR_STORE_SPILL_PARTITION_LABEL "sensor_log"
+#define CONFIG_MESH_LITE_TIME_SYNC_INTERVAL 10000
+#define CONFIG_MESH_LITE_TIME_SYNC_FAST_INTERVAL 1000
+#define CONFIG_APP_PARENT_OFFER_INTERVAL_MS 2000
+#define CONFIG_APP_PARENT_SELECT 1
+#define CONFIG_APP_PARENT_CANDIDATES 8
+#define CONFIG_APP_PARENT_HOP_COST 30
+#define CONFIG_APP_PARENT_CHILD_COST 15
+#define CONFIG_APP_PARENT_QUEUE_COST 100
+#define CONFIG_APP_PARENT_SWITCH_MARGIN 100
+#define CONFIG_APP_PARENT_SWITCH_HOLD 3
+#define CONFIG_APP_PARENT_MIN_DWELL_S 60
+#define CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH 50
+#define CONFIG_APP_ESPNOW_INGEST_CONTROL_DEPTH 8
+#define CONFIG_APP_ESPNOW_INGEST_HIGH_WATERMARK 75
+#define CONFIG_METRICS_MAX_NUM 64
+#define CONFIG_FREERTOS_UNICORE 1
+#define CONFIG_APP_TRACE_RING_SIZE 256
+#define CONFIG_METRICS_RENDER_BUF_SIZE 2048
+#define CONFIG_MESH_LITE_MAXIMUM_LEVEL_ALLOWED 5
+#define CONFIG_MESH_LITE_NODE_INFO_REPORT 1
+#define CONFIG_MESH_LITE_NODE_HEALTH_REPORT 1
+#define CONFIG_MESH_LITE_REPORT_INTERVAL 300
+#define CONFIG_MESH_LITE_REPORT_INTERVAL_MIN 30
+#define CONFIG_MESH_LITE_REPORT_JITTER 20
+#define CONFIG_MESH_LITE_REPORT_SPLAY_MS 3000
+#define CONFIG_MESH_LITE_NODES_BROADCAST_WINDOW_MS 1000
+#define CONFIG_MESH_LITE_NODES_BROADCAST_BURST 2
+#define CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER 200
+#define CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS 200
+#define CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER
+#define CONFIG_MESH_LITE_NODE_EVENT_SUBSCRIBERS 4
+#define CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM 20
+#define CONFIG_MESH_ID 77
+#define CONFIG_APP_ESPNOW_SINK_ADV_INTERVAL_MS 5000
+#define CONFIG_APP_ESPNOW_SINK_MAX_RETRY 2
+#define CONFIG_MESH_LITE_WIRELESS_DEBUG_FANOUT_MAX_REQUESTS 4
+#define CONFIG_MESH_LITE_WIRELESS_DEBUG_FANOUT_MAX_NODES 100
+#define CONFIG_DEFAULT_SSID_PREFIX "Mesh_Lite"
+#define CONFIG_CUSTOMER_DATA_LENGTH 40
+#define CONFIG_DEVICE_INFO_LENGTH 40
+#define CONFIG_ZERO_PROV_LISTENING_TIMEOUT 360
+#define CONFIG_ZERO_PROV_MAX_PENDING_NODES 32
+#define CONFIG_ZERO_PROV_MAX_CONCURRENT_HANDSHAKES 16
+#define CONFIG_BRIDGE_SOFTAP_MAX_CONNECT_NUMBER 10
+#define CONFIG_APP_DEBUG_STATS_PERIOD_MS 1000
+#define CONFIG_APP_DEBUG_STATS_WINDOW 10
+#define CONFIG_APP_DEBUG_STATS_MAX_TASKS 32
+#define CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE 64
+#define CONFIG_APP_DEBUG_HEAP_SAMPLE_DEPTH 6
+#define CONFIG_APP_DEBUG_HEAP_HOTSPOTS 16
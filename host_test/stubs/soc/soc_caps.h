@@ -0,0 +1,2 @@
+/* Host stand-in for the ESP-IDF header, a chip without the optional peripherals */
+#pragma once
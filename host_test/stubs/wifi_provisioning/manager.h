@@ -0,0 +1,17 @@
+/* Host stand-in for the ESP-IDF header, only what the modules under test use */
+#pragma once
+
+#include "esp_event.h"
+
+typedef enum
+{
+    WIFI_PROV_INIT,
+    WIFI_PROV_START,
+    WIFI_PROV_CRED_RECV,
+    WIFI_PROV_CRED_FAIL,
+    WIFI_PROV_CRED_SUCCESS,
+    WIFI_PROV_END,
+    WIFI_PROV_DEINIT,
+} wifi_prov_cb_event_t;
+
+ESP_EVENT_DECLARE_BASE(WIFI_PROV_EVENT);
@@ -0,0 +1,462 @@
+/*
+ * debug_stats: CPU shares over the sliding window against the run time given to simulated tasks,
+ * a change of load showing up period by period, tasks created and deleted within the window, a wrap
+ * of the run time counter, a task table too small, a sample skipped while a reader holds the lock.
+ * The heap sampling hook under an allocation workload spread over more sites than its table: the
+ * heaviest sites found and their bytes. Cost of a sample, of a read and of the hook.
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+/* In newlib, glibc only has it from 2.38 */
+static size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size)
+    {
+        size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+#endif
+
+/* The timer callback and the lock are static */
+#include "../main/debug_stats.c"
+
+#define PERIOD_US (CONFIG_APP_DEBUG_STATS_PERIOD_MS * 1000)
+#define SIM_TASKS_MAX (CONFIG_APP_DEBUG_STATS_MAX_TASKS + 1)
+#define HEAP_SITES 200
+#define HEAP_ALLOCS 1000000
+#define HEAP_TOP 5
+#define BENCH_SAMPLES 100000
+#define BENCH_HOOKS 10000000
+
+typedef struct
+{
+    char name[configMAX_TASK_NAME_LEN];
+    bool alive;
+    UBaseType_t priority;
+    uint32_t stack_free;
+    configRUN_TIME_COUNTER_TYPE runtime;
+    float share;                /* Percent of the core it gets */
+} sim_task_t;
+
+static sim_task_t sim_tasks[SIM_TASKS_MAX];
+static configRUN_TIME_COUNTER_TYPE sim_total;
+static const char *current_task = "main";
+static bool scheduler_started = true;
+static int64_t now_us = 1000000;
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    return host_test_now_ns();
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    UBaseType_t num = 0;
+    for (int i = 0; i < SIM_TASKS_MAX; i++)
+    {
+        num += sim_tasks[i].alive;
+    }
+    return num;
+}
+
+/* Like FreeRTOS, nothing at all when the array is too small */
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t max, configRUN_TIME_COUNTER_TYPE *total_run_time)
+{
+    if (uxTaskGetNumberOfTasks() > max)
+    {
+        return 0;
+    }
+
+    UBaseType_t num = 0;
+    for (int i = 0; i < SIM_TASKS_MAX; i++)
+    {
+        if (sim_tasks[i].alive)
+        {
+            status[num++] = (TaskStatus_t) {
+                .xHandle = &sim_tasks[i],
+                .pcTaskName = sim_tasks[i].name,
+                .xTaskNumber = i,
+                .eCurrentState = eBlocked,
+                .uxCurrentPriority = sim_tasks[i].priority,
+                .uxBasePriority = sim_tasks[i].priority,
+                .ulRunTimeCounter = sim_tasks[i].runtime,
+                .usStackHighWaterMark = sim_tasks[i].stack_free,
+            };
+        }
+    }
+    *total_run_time = sim_total;
+    return num;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    return (char *)current_task;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    return scheduler_started ? taskSCHEDULER_RUNNING : taskSCHEDULER_NOT_STARTED;
+}
+
+static void sim_reset(void)
+{
+    memset(sim_tasks, 0, sizeof(sim_tasks));
+    memset(debug_snapshots, 0, sizeof(debug_snapshots));
+    debug_snapshot_head = 0;
+    debug_snapshot_num = 0;
+    debug_task_status_num = 0;
+    sim_total = 0;
+}
+
+static sim_task_t *sim_task(int i, const char *name, float share)
+{
+    sim_task_t *task = &sim_tasks[i];
+    strlcpy(task->name, name, sizeof(task->name));
+    task->alive = true;
+    task->priority = 5;
+    task->stack_free = 512 + i;
+    task->share = share;
+    return task;
+}
+
+/* One sampling period of run time shared out, then the sample */
+static void sim_period(void)
+{
+    for (int i = 0; i < SIM_TASKS_MAX; i++)
+    {
+        if (sim_tasks[i].alive)
+        {
+            sim_tasks[i].runtime += (configRUN_TIME_COUNTER_TYPE)(PERIOD_US * sim_tasks[i].share / 100);
+        }
+    }
+    sim_total += PERIOD_US;
+    now_us += PERIOD_US;
+    debug_stats_timer_cb(NULL);
+}
+
+static const debug_task_stats_t *find_task(const debug_task_stats_t *tasks, size_t num, const char *name)
+{
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!strcmp(tasks[i].name, name))
+        {
+            return &tasks[i];
+        }
+    }
+    return NULL;
+}
+
+static float cpu_of(const char *name)
+{
+    static debug_task_stats_t tasks[CONFIG_APP_DEBUG_STATS_MAX_TASKS];
+    debug_stats_info_t info;
+    size_t num = debug_stats_get_tasks(tasks, CONFIG_APP_DEBUG_STATS_MAX_TASKS, &info);
+    const debug_task_stats_t *task = find_task(tasks, num, name);
+    return task ? task->cpu : -1;
+}
+
+static void test_cpu_share(void)
+{
+    static const char *names[] = {"espnow", "sensor", "wifi", "async_req", "nimble", "IDLE"};
+    static const float shares[] = {40, 25, 15, 10, 5, 5};
+    debug_task_stats_t tasks[CONFIG_APP_DEBUG_STATS_MAX_TASKS];
+    debug_stats_info_t info;
+
+    sim_reset();
+    for (int i = 0; i < 6; i++)
+    {
+        sim_task(i, names[i], shares[i]);
+    }
+    sim_period();
+    for (int i = 0; i < CONFIG_APP_DEBUG_STATS_WINDOW + 3; i++)
+    {
+        sim_period();
+    }
+
+    size_t num = debug_stats_get_tasks(tasks, CONFIG_APP_DEBUG_STATS_MAX_TASKS, &info);
+    TEST_ASSERT(num == 6 && info.task_num == 6);
+    TEST_ASSERT(info.window_ms == CONFIG_APP_DEBUG_STATS_WINDOW * CONFIG_APP_DEBUG_STATS_PERIOD_MS);
+    for (size_t i = 0; i < num; i++)
+    {
+        // Sorted by share, which is the order of the table
+        TEST_ASSERT(!strcmp(tasks[i].name, names[i]) && fabsf(tasks[i].cpu - shares[i]) < 0.01f);
+        TEST_ASSERT(tasks[i].stack_free_min == (512 + i) * sizeof(StackType_t) && tasks[i].core == -1);
+    }
+
+    // espnow goes idle: its share leaves the window one period at a time
+    sim_tasks[5].share += sim_tasks[0].share;
+    sim_tasks[0].share = 0;
+    for (int i = 1; i <= CONFIG_APP_DEBUG_STATS_WINDOW; i++)
+    {
+        sim_period();
+        float expected = 40.0f * (CONFIG_APP_DEBUG_STATS_WINDOW - i) / CONFIG_APP_DEBUG_STATS_WINDOW;
+        TEST_ASSERT(fabsf(cpu_of("espnow") - expected) < 0.01f);
+    }
+    TEST_ASSERT(fabsf(cpu_of("IDLE") - 45) < 0.01f);
+}
+
+static void test_task_churn(void)
+{
+    sim_reset();
+    sim_task(0, "IDLE", 80);
+    sim_task(1, "wifi", 20);
+    for (int i = 0; i <= CONFIG_APP_DEBUG_STATS_WINDOW; i++)
+    {
+        sim_period();
+    }
+
+    // Created halfway through the window, counted from its creation only
+    sim_tasks[0].share = 50;
+    sim_task(2, "ota", 30);
+    for (int i = 0; i < CONFIG_APP_DEBUG_STATS_WINDOW / 2; i++)
+    {
+        sim_period();
+    }
+    TEST_ASSERT(fabsf(cpu_of("ota") - 15) < 0.01f);
+
+    // Deleted, gone from the next sample
+    sim_tasks[1].alive = false;
+    sim_period();
+    TEST_ASSERT(cpu_of("wifi") < 0 && cpu_of("ota") > 0);
+}
+
+/* The run time is a 32 bit count of microseconds, it wraps every 71 minutes */
+static void test_counter_wrap(void)
+{
+    sim_reset();
+    sim_task(0, "IDLE", 70)->runtime = UINT32_MAX - 3 * PERIOD_US;
+    sim_task(1, "espnow", 30)->runtime = UINT32_MAX - PERIOD_US;
+    sim_total = UINT32_MAX - 2 * PERIOD_US;
+    for (int i = 0; i <= CONFIG_APP_DEBUG_STATS_WINDOW; i++)
+    {
+        sim_period();
+    }
+    TEST_ASSERT(sim_total < PERIOD_US * CONFIG_APP_DEBUG_STATS_WINDOW);
+    TEST_ASSERT(fabsf(cpu_of("IDLE") - 70) < 0.01f && fabsf(cpu_of("espnow") - 30) < 0.01f);
+}
+
+static void test_table_full(void)
+{
+    debug_task_stats_t tasks[CONFIG_APP_DEBUG_STATS_MAX_TASKS];
+    debug_stats_info_t info;
+    char name[configMAX_TASK_NAME_LEN];
+
+    sim_reset();
+    for (int i = 0; i < CONFIG_APP_DEBUG_STATS_MAX_TASKS; i++)
+    {
+        snprintf(name, sizeof(name), "task%d", i);
+        sim_task(i, name, 100.0f / CONFIG_APP_DEBUG_STATS_MAX_TASKS);
+    }
+    sim_period();
+    sim_period();
+
+    // One task more: the samples stop, the last ones stay readable, the number of tasks tells why
+    sim_task(CONFIG_APP_DEBUG_STATS_MAX_TASKS, "extra", 0);
+    size_t head = debug_snapshot_head;
+    sim_period();
+    TEST_ASSERT(debug_snapshot_head == head);
+    size_t num = debug_stats_get_tasks(tasks, CONFIG_APP_DEBUG_STATS_MAX_TASKS, &info);
+    TEST_ASSERT(num == CONFIG_APP_DEBUG_STATS_MAX_TASKS && info.task_num == CONFIG_APP_DEBUG_STATS_MAX_TASKS + 1);
+}
+
+static void test_reader_skip(void)
+{
+    sim_reset();
+    sim_task(0, "IDLE", 100);
+    sim_period();
+
+    // The timer task never waits for a reader, that period is left out
+    size_t head = debug_snapshot_head;
+    TEST_ASSERT(xSemaphoreTake(debug_stats_mutex, 0) == pdTRUE);
+    sim_period();
+    TEST_ASSERT(debug_snapshot_head == head);
+    xSemaphoreGive(debug_stats_mutex);
+    sim_period();
+    TEST_ASSERT(debug_snapshot_head != head);
+}
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int compare_bytes(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x < y) - (x > y);
+}
+
+/*
+ * Allocation sites drawn from a Zipf law, sizes alike for all sites. Without the backtrace of Xtensa
+ * the sites are told apart by task name, one per site. The space-saving table keeps every site with
+ * more than 1 / CONFIG_APP_DEBUG_HEAP_HOTSPOTS of the sampled bytes, over by no more than that.
+ */
+static void test_heap_hotspots(void)
+{
+    static char names[HEAP_SITES][configMAX_TASK_NAME_LEN];
+    static double cdf[HEAP_SITES];
+    static uint64_t truth[HEAP_SITES];
+    static uint64_t sampled_truth[HEAP_SITES];
+    static uint64_t sorted[HEAP_SITES];
+    debug_heap_hotspot_t hotspots[CONFIG_APP_DEBUG_HEAP_HOTSPOTS];
+    debug_heap_sampling_info_t info;
+
+    double sum = 0;
+    for (int i = 0; i < HEAP_SITES; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "site%d", i);
+        sum += 1.0 / (i + 1);
+        cdf[i] = sum;
+    }
+
+    uint64_t all = 0, sampled_all = 0;
+    for (int n = 0; n < HEAP_ALLOCS; n++)
+    {
+        double u = (rng() / 4294967296.0) * sum;
+        int site = 0;
+        while (site < HEAP_SITES - 1 && cdf[site] < u)
+        {
+            site++;
+        }
+        size_t size = 16 + rng() % 240;
+        truth[site] += size;
+        all += size;
+        // The hook takes allocations 0, rate, 2 rate...
+        if (n % CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE == 0)
+        {
+            sampled_truth[site] += size;
+            sampled_all += size;
+        }
+        current_task = names[site];
+        esp_heap_trace_alloc_hook(NULL, size, 0);
+    }
+    current_task = "main";
+
+    size_t num = debug_stats_get_heap_hotspots(hotspots, CONFIG_APP_DEBUG_HEAP_HOTSPOTS, &info);
+    TEST_ASSERT(num == CONFIG_APP_DEBUG_HEAP_HOTSPOTS && info.rate == CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE);
+    TEST_ASSERT(info.allocs == HEAP_ALLOCS && info.sampled == HEAP_ALLOCS / CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE);
+
+    uint64_t bound = sampled_all / CONFIG_APP_DEBUG_HEAP_HOTSPOTS;
+    int guaranteed = 0;
+    const debug_heap_hotspot_t *found[HEAP_SITES] = {NULL};
+    for (size_t i = 0; i < num; i++)
+    {
+        int site = atoi(hotspots[i].task + strlen("site"));
+        found[site] = &hotspots[i];
+        TEST_ASSERT(hotspots[i].bytes >= sampled_truth[site] && hotspots[i].bytes <= sampled_truth[site] + bound);
+    }
+    for (int site = 0; site < HEAP_SITES; site++)
+    {
+        if (sampled_truth[site] > bound)
+        {
+            TEST_ASSERT(found[site] != NULL);
+            guaranteed++;
+        }
+    }
+    TEST_ASSERT(guaranteed > 0);
+
+    // Against all allocations: how many of the heaviest sites the table shows, and how far off
+    memcpy(sorted, truth, sizeof(truth));
+    qsort(sorted, HEAP_SITES, sizeof(sorted[0]), compare_bytes);
+    int top_found = 0;
+    uint64_t top_bytes = 0;
+    double worst = 0, heaviest = 0;
+    for (int site = 0; site < HEAP_SITES; site++)
+    {
+        if (truth[site] < sorted[HEAP_TOP - 1])
+        {
+            continue;
+        }
+        top_bytes += truth[site];
+        if (found[site])
+        {
+            double error = fabs((double)found[site]->bytes * CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE - truth[site]) / truth[site];
+            worst = error > worst ? error : worst;
+            heaviest = truth[site] == sorted[0] ? error : heaviest;
+            top_found++;
+        }
+    }
+    printf("BENCH heap sampling, %d allocations over %d sites, 1 in %d sampled into %d entries: %d sites above "
+           "1/%d of the bytes, all found; %d of the top %d (%.0f %% of the bytes) found, bytes off by %.1f %% at worst, %.1f %% for the heaviest\n",
+           HEAP_ALLOCS, HEAP_SITES, CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE, CONFIG_APP_DEBUG_HEAP_HOTSPOTS, guaranteed,
+           CONFIG_APP_DEBUG_HEAP_HOTSPOTS, top_found, HEAP_TOP, 100.0 * top_bytes / all, worst * 100, heaviest * 100);
+}
+
+static void bench_overhead(void)
+{
+    static debug_task_stats_t tasks[CONFIG_APP_DEBUG_STATS_MAX_TASKS];
+    debug_stats_info_t info;
+    char name[configMAX_TASK_NAME_LEN];
+
+    // The task list of the request: about 20 tasks
+    sim_reset();
+    for (int i = 0; i < 20; i++)
+    {
+        snprintf(name, sizeof(name), "task%d", i);
+        sim_task(i, name, 5);
+    }
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+    {
+        sim_period();
+    }
+    double sample_ns = (double)(host_test_now_ns() - start) / BENCH_SAMPLES;
+
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+    {
+        debug_stats_get_tasks(tasks, CONFIG_APP_DEBUG_STATS_MAX_TASKS, &info);
+    }
+    double read_ns = (double)(host_test_now_ns() - start) / BENCH_SAMPLES;
+
+    // Every allocation pays the counter, one in the rate the table update
+    uint32_t sampled = heap_sampled;
+    uint64_t cycles = heap_sample_cycles;
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_HOOKS; i++)
+    {
+        esp_heap_trace_alloc_hook(NULL, 64, 0);
+    }
+    double hook_ns = (double)(host_test_now_ns() - start) / BENCH_HOOKS;
+    double sampled_ns = (double)(heap_sample_cycles - cycles) / (heap_sampled - sampled);
+
+    printf("BENCH sample of 20 tasks %.0f ns, every %d ms: %.5f %% of a core; read %.0f ns; static RAM %zu bytes on this host\n",
+           sample_ns, CONFIG_APP_DEBUG_STATS_PERIOD_MS, sample_ns / (PERIOD_US * 10.0), read_ns,
+           sizeof(debug_snapshots) + sizeof(debug_task_status));
+    printf("BENCH heap hook %.1f ns per allocation on average, %.0f ns for a sampled one, 1 in %d\n", hook_ns, sampled_ns,
+           CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE);
+}
+
+int main(void)
+{
+    TEST_ASSERT(debug_stats_init() == ESP_OK);
+
+    RUN_TEST(test_cpu_share);
+    RUN_TEST(test_task_churn);
+    RUN_TEST(test_counter_wrap);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_reader_skip);
+    RUN_TEST(test_heap_hotspots);
+    RUN_TEST(bench_overhead);
+    return host_test_result();
+}
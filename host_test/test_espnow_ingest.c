@@ -0,0 +1,723 @@
+/*
+ * espnow_ingest: shedding policy, watermark events and drop accounting per source, a sensor flood
+ * with a babbling node simulated against the blocking queue send it replaced, and a two thread
+ * flood of the real hand-off that checks nothing is lost or reordered without being counted and
+ * reports the cost of the receive callback. Built with tracing on, the end of the flood is
+ * exported and checked for the events of the receive callback and of the espnow task.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "freertos/task.h"
+
+/* The lanes and the source table are static, the test resets and inspects them */
+#include "../main/espnow_ingest.c"
+
+#define SIM_NODES 20                /* Sensor nodes, node 0 babbles during the burst */
+#define SIM_SINKS 2                 /* Sink advertisements go to the control lane */
+#define SIM_US 5000000
+#define SIM_BURST_START_US 1000000
+#define SIM_BURST_END_US 3000000
+#define SIM_NODE_HZ 10
+#define SIM_BABBLE_HZ 3000
+#define SIM_SINK_HZ 5
+#define SIM_DATA_SERVICE_US 1000    /* espnow task: parse, store and forward a sensor frame */
+#define SIM_CONTROL_SERVICE_US 200
+#define SIM_FRAME_LEN 200
+#define SIM_MAX_FRAMES 16384
+
+/* Old receive callback: xQueueSend(espnow_recv_queue, ..., ESPNOW_MAXDELAY) at CONFIG_FREERTOS_HZ 1000 */
+#define LEGACY_QUEUE_SIZE 50
+#define LEGACY_MAXDELAY_US 512000
+#define LEGACY_RX_BUFFERS 32        /* Driver receive buffers, frames beyond them are lost on air */
+
+#define FLOOD_FRAMES 400000
+#define FLOOD_SOURCES 64
+
+static int64_t esp_timer_base_us;
+
+int64_t esp_timer_get_time(void)
+{
+    return host_test_now_ns() / 1000 - esp_timer_base_us;
+}
+
+#if CONFIG_APP_TRACE_ENABLE
+/* The cycle counter of a 240 MHz core, against esp_timer */
+#define TRACE_CPU_MHZ 240
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    return (uint32_t)(host_test_now_ns() * TRACE_CPU_MHZ / 1000);
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void)
+{
+    return TRACE_CPU_MHZ;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)pthread_self();
+}
+#endif
+
+static int events_high;
+static int events_drained;
+static uint32_t event_high_depth;
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data, size_t event_data_size,
+                         TickType_t ticks_to_wait)
+{
+    const espnow_ingest_event_t *event = event_data;
+    TEST_ASSERT(event_base == ESPNOW_INGEST_EVENT && event_data_size == sizeof(*event) && ticks_to_wait == 0);
+    if (event_id == ESPNOW_INGEST_EVENT_HIGH_WATERMARK)
+    {
+        events_high++;
+        event_high_depth = event->depth;
+    }
+    else
+    {
+        events_drained++;
+    }
+    return ESP_OK;
+}
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t percentile(int64_t *values, int num, double p)
+{
+    if (num == 0)
+    {
+        return 0;
+    }
+    qsort(values, num, sizeof(values[0]), cmp_int64);
+    return values[(int)(p * (num - 1))];
+}
+
+/* A frame carries its source, lane and sequence number, and the time it was received */
+typedef struct
+{
+    int64_t rx_us;
+    uint32_t seq;
+    uint8_t source;
+    uint8_t lane;
+} frame_t;
+
+static void make_mac(uint8_t *mac, uint8_t source)
+{
+    static const uint8_t oui[3] = {0x24, 0x0a, 0xc4};
+    memcpy(mac, oui, 3);
+    mac[3] = 0;
+    mac[4] = 0;
+    mac[5] = source;
+}
+
+static esp_err_t push(const frame_t *frame)
+{
+    uint8_t data[SIM_FRAME_LEN] = {0};
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -60};
+    esp_now_recv_info_t recv_info = {.src_addr = mac, .rx_ctrl = &rx_ctrl};
+
+    TRACE_INSTANT("espnow_rx", sizeof(data));
+    make_mac(mac, frame->source);
+    memcpy(data, frame, sizeof(*frame));
+    return espnow_ingest_push(frame->lane, &recv_info, 0, data, sizeof(data));
+}
+
+static bool pop(frame_t *frame, TickType_t wait)
+{
+    espnow_ingest_item_t item;
+    if (!espnow_ingest_pop(&item, wait))
+    {
+        return false;
+    }
+    memcpy(frame, item.data, sizeof(*frame));
+    TEST_ASSERT(item.len == SIM_FRAME_LEN && item.src[5] == frame->source);
+    free(item.data);
+    return true;
+}
+
+static void reset(void)
+{
+    frame_t frame;
+    while (pop(&frame, 0))
+    {
+    }
+    for (int i = 0; i < ESPNOW_INGEST_LANE_MAX; i++)
+    {
+        ingest_lanes[i].drops = 0;
+        ingest_lanes[i].above = false;
+    }
+    memset(ingest_sources, 0, sizeof(ingest_sources));
+    events_high = 0;
+    events_drained = 0;
+}
+
+static void test_shed_policy(void)
+{
+    frame_t frame = {.lane = ESPNOW_INGEST_LANE_DATA, .source = 1};
+    int refused = 0;
+
+    reset();
+    for (frame.seq = 0; frame.seq < 2 * CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH; frame.seq++)
+    {
+        refused += push(&frame) != ESP_OK;
+    }
+    frame = (frame_t){.lane = ESPNOW_INGEST_LANE_CONTROL, .source = 2, .seq = 1000};
+    TEST_ASSERT(push(&frame) == ESP_OK);
+
+    /* Control first despite the full data lane, then the frames the policy kept, in order */
+    TEST_ASSERT(pop(&frame, 0) && frame.lane == ESPNOW_INGEST_LANE_CONTROL && frame.seq == 1000);
+    uint32_t first = ESPNOW_INGEST_DROP_NEWEST ? 0 : CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH;
+    for (uint32_t seq = first; seq < first + CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH; seq++)
+    {
+        TEST_ASSERT(pop(&frame, 0) && frame.seq == seq);
+    }
+    TEST_ASSERT(!pop(&frame, 0));
+
+    /* Only drop-newest refuses the frame at hand, both count every shed frame */
+    TEST_ASSERT(refused == (ESPNOW_INGEST_DROP_NEWEST ? CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH : 0));
+    TEST_ASSERT(ingest_lanes[ESPNOW_INGEST_LANE_DATA].drops == CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH);
+    TEST_ASSERT(ingest_lanes[ESPNOW_INGEST_LANE_CONTROL].drops == 0);
+}
+
+static void test_watermark(void)
+{
+    uint32_t high = CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH * CONFIG_APP_ESPNOW_INGEST_HIGH_WATERMARK / 100;
+    frame_t frame = {.lane = ESPNOW_INGEST_LANE_DATA, .source = 1};
+
+    reset();
+    for (uint32_t i = 0; i < CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH + 10; i++)
+    {
+        push(&frame);
+        TEST_ASSERT(events_high == (i + 1 >= high));
+    }
+    TEST_ASSERT(event_high_depth == high);
+
+    /* Drained at half the watermark, once, and armed again */
+    for (uint32_t depth = CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH; depth > 0; depth--)
+    {
+        pop(&frame, 0);
+        TEST_ASSERT(events_drained == (depth - 1 <= high / 2));
+    }
+    for (uint32_t i = 0; i < high; i++)
+    {
+        push(&frame);
+    }
+    TEST_ASSERT(events_high == 2);
+}
+
+static void test_source_drops(void)
+{
+    /* A heavy source keeps its slot against a stream of new sources with a drop each */
+    frame_t frame = {.lane = ESPNOW_INGEST_LANE_DATA};
+    uint32_t heavy = 0;
+
+    reset();
+    for (int i = 0; i < 5000; i++)
+    {
+        espnow_ingest_lane_state_t *lane = &ingest_lanes[ESPNOW_INGEST_LANE_DATA];
+        frame.source = (i % 3 == 0) ? 7 : 100 + i % 150;
+        if (lane->count == lane->size)
+        {
+            heavy += (ESPNOW_INGEST_DROP_NEWEST ? frame.source : lane->items[lane->head].src[5]) == 7;
+        }
+        push(&frame);
+    }
+
+    uint32_t drops = 0;
+    int slot = -1;
+    for (int i = 0; i < ESPNOW_INGEST_SOURCES; i++)
+    {
+        drops += ingest_sources[i].drops;
+        if (ingest_sources[i].mac[5] == 7)
+        {
+            slot = i;
+        }
+    }
+    TEST_ASSERT(drops == ingest_lanes[ESPNOW_INGEST_LANE_DATA].drops);
+    TEST_ASSERT(slot >= 0);
+    if (slot >= 0)
+    {
+        /* Space-saving: the count of a kept source is at least its true count */
+        for (int i = 0; i < ESPNOW_INGEST_SOURCES; i++)
+        {
+            TEST_ASSERT(ingest_sources[i].drops <= ingest_sources[slot].drops);
+        }
+        TEST_ASSERT(ingest_sources[slot].drops >= heavy);
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    int frames[ESPNOW_INGEST_LANE_MAX];
+    int lost[ESPNOW_INGEST_LANE_MAX];     /* Shed by the queue or its timeout */
+    int air_lost[ESPNOW_INGEST_LANE_MAX]; /* Lost in the driver while the callback was stuck */
+    int64_t callback_us[SIM_MAX_FRAMES];  /* Simulated time in the callback, waits included */
+    int64_t push_ns[SIM_MAX_FRAMES];      /* Host time of the real push, new hand-off only */
+    int callback_num;
+    int64_t stalled_us;
+    int64_t delay_us[ESPNOW_INGEST_LANE_MAX][SIM_MAX_FRAMES];
+    int delay_num[ESPNOW_INGEST_LANE_MAX];
+    int babbler_lost;
+    int other_lost;
+} sim_result_t;
+
+static frame_t arrivals[SIM_MAX_FRAMES];
+static int arrival_num;
+
+static int cmp_arrival(const void *a, const void *b)
+{
+    const frame_t *x = a, *y = b;
+    return (x->rx_us > y->rx_us) - (x->rx_us < y->rx_us);
+}
+
+static void sim_add_source(uint8_t source, espnow_ingest_lane_t lane, int64_t start, int64_t end, int hz)
+{
+    uint32_t seq = 0;
+    /* Evenly spread with jitter, each source has its own phase */
+    for (int64_t t = start + rng() % (1000000 / hz); t < end && arrival_num < SIM_MAX_FRAMES;
+         t += 1000000 / hz / 2 + rng() % (1000000 / hz))
+    {
+        arrivals[arrival_num++] = (frame_t){.rx_us = t, .seq = seq++, .source = source, .lane = lane};
+    }
+}
+
+static void sim_make_arrivals(void)
+{
+    arrival_num = 0;
+    for (uint8_t node = 0; node < SIM_NODES; node++)
+    {
+        sim_add_source(node, ESPNOW_INGEST_LANE_DATA, 0, SIM_US, SIM_NODE_HZ);
+    }
+    sim_add_source(0, ESPNOW_INGEST_LANE_DATA, SIM_BURST_START_US, SIM_BURST_END_US, SIM_BABBLE_HZ);
+    for (uint8_t sink = 0; sink < SIM_SINKS; sink++)
+    {
+        sim_add_source(200 + sink, ESPNOW_INGEST_LANE_CONTROL, 0, SIM_US, SIM_SINK_HZ);
+    }
+    qsort(arrivals, arrival_num, sizeof(arrivals[0]), cmp_arrival);
+}
+
+static int64_t service_us(const frame_t *frame)
+{
+    return frame->lane == ESPNOW_INGEST_LANE_CONTROL ? SIM_CONTROL_SERVICE_US : SIM_DATA_SERVICE_US;
+}
+
+static void sim_lost(sim_result_t *result, const frame_t *frame)
+{
+    result->lost[frame->lane]++;
+    if (frame->lane == ESPNOW_INGEST_LANE_DATA)
+    {
+        frame->source == 0 ? result->babbler_lost++ : result->other_lost++;
+    }
+}
+
+/* The espnow task pops and serves frames one after the other, up to now */
+static int64_t sim_serve(sim_result_t *result, int64_t consumer_free, int64_t now)
+{
+    frame_t frame;
+    while (consumer_free <= now && pop(&frame, 0))
+    {
+        result->delay_us[frame.lane][result->delay_num[frame.lane]++] = consumer_free - frame.rx_us;
+        consumer_free += service_us(&frame);
+    }
+    return consumer_free;
+}
+
+static void sim_run(sim_result_t *result)
+{
+    int64_t consumer_free = 0;
+    reset();
+    for (int i = 0; i < arrival_num; i++)
+    {
+        const frame_t *frame = &arrivals[i];
+        consumer_free = sim_serve(result, consumer_free, frame->rx_us);
+
+        espnow_ingest_lane_state_t *lane = &ingest_lanes[frame->lane];
+        uint32_t drops = lane->drops;
+        uint8_t oldest = lane->items[lane->head].src[5];
+        int64_t start = host_test_now_ns();
+        push(frame);
+        result->push_ns[result->callback_num] = host_test_now_ns() - start;
+        result->callback_us[result->callback_num++] = 0;
+        result->frames[frame->lane]++;
+
+        if (lane->drops != drops)
+        {
+            /* Drop-oldest sheds the head of the lane, drop-newest the frame at hand */
+            frame_t shed = *frame;
+            if (!ESPNOW_INGEST_DROP_NEWEST)
+            {
+                shed.source = oldest;
+            }
+            sim_lost(result, &shed);
+        }
+
+        /* An idle espnow task wakes up on the frame */
+        if (consumer_free < frame->rx_us)
+        {
+            consumer_free = frame->rx_us;
+        }
+    }
+    sim_serve(result, consumer_free, INT64_MAX);
+}
+
+/*
+ * The blocking queue it replaced, one FIFO for all frames. Frames go through the queue in order,
+ * so the time a frame leaves it only depends on the frames before it.
+ */
+static void sim_run_legacy(sim_result_t *result)
+{
+    static int64_t pop_us[SIM_MAX_FRAMES];
+    static int64_t callback_end_us[SIM_MAX_FRAMES];
+    static frame_t queued[SIM_MAX_FRAMES];
+    int queued_num = 0;
+    int accepted = 0;
+    int64_t wifi_free = 0;
+
+    for (int i = 0; i < arrival_num; i++)
+    {
+        const frame_t *frame = &arrivals[i];
+        result->frames[frame->lane]++;
+
+        /* While the callback waits the Wi-Fi task takes no frames, the driver buffers fill up */
+        if (accepted >= LEGACY_RX_BUFFERS && callback_end_us[accepted - LEGACY_RX_BUFFERS] > frame->rx_us)
+        {
+            result->air_lost[frame->lane]++;
+            if (frame->lane == ESPNOW_INGEST_LANE_DATA)
+            {
+                frame->source == 0 ? result->babbler_lost++ : result->other_lost++;
+            }
+            continue;
+        }
+
+        int64_t start = frame->rx_us > wifi_free ? frame->rx_us : wifi_free;
+        int64_t end = start;
+        bool sent = true;
+        if (queued_num >= LEGACY_QUEUE_SIZE && pop_us[queued_num - LEGACY_QUEUE_SIZE] > start)
+        {
+            /* Full: wait for the espnow task to take a frame out, up to ESPNOW_MAXDELAY */
+            end = pop_us[queued_num - LEGACY_QUEUE_SIZE];
+            if (end - start > LEGACY_MAXDELAY_US)
+            {
+                end = start + LEGACY_MAXDELAY_US;
+                sent = false;
+            }
+        }
+        if (sent)
+        {
+            int64_t prev_done = queued_num ? pop_us[queued_num - 1] + service_us(&queued[queued_num - 1]) : 0;
+            queued[queued_num] = *frame;
+            pop_us[queued_num] = end > prev_done ? end : prev_done;
+            result->delay_us[frame->lane][result->delay_num[frame->lane]++] = pop_us[queued_num] - frame->rx_us;
+            queued_num++;
+        }
+        else
+        {
+            sim_lost(result, frame);
+        }
+
+        result->callback_us[result->callback_num++] = end - start;
+        result->stalled_us += end - start;
+        callback_end_us[accepted++] = end;
+        wifi_free = end;
+    }
+}
+
+static void sim_report(sim_result_t *result, bool legacy)
+{
+    printf("BENCH %s\n", result->name);
+    printf("BENCH   control: %d frames, %d shed, %d lost in the driver, delay p50 %" PRIi64 " us, p99 %" PRIi64
+           " us, max %" PRIi64 " us\n",
+           result->frames[ESPNOW_INGEST_LANE_CONTROL], result->lost[ESPNOW_INGEST_LANE_CONTROL],
+           result->air_lost[ESPNOW_INGEST_LANE_CONTROL],
+           percentile(result->delay_us[0], result->delay_num[0], 0.50),
+           percentile(result->delay_us[0], result->delay_num[0], 0.99),
+           percentile(result->delay_us[0], result->delay_num[0], 1.0));
+    printf("BENCH   data: %d frames, %d shed, %d lost in the driver (%d of the babbler, %d of other nodes)\n",
+           result->frames[ESPNOW_INGEST_LANE_DATA], result->lost[ESPNOW_INGEST_LANE_DATA],
+           result->air_lost[ESPNOW_INGEST_LANE_DATA], result->babbler_lost, result->other_lost);
+    if (legacy)
+    {
+        printf("BENCH   callback blocked: p50 %" PRIi64 " us, p99 %" PRIi64 " us, max %" PRIi64
+               " us, Wi-Fi task stalled %.0f%% of the time\n",
+               percentile(result->callback_us, result->callback_num, 0.50),
+               percentile(result->callback_us, result->callback_num, 0.99),
+               percentile(result->callback_us, result->callback_num, 1.0), 100.0 * result->stalled_us / SIM_US);
+    }
+    else
+    {
+        printf("BENCH   callback never blocks, push on the host: p50 %" PRIi64 " ns, p99 %" PRIi64 " ns, max %" PRIi64
+               " ns\n",
+               percentile(result->push_ns, result->callback_num, 0.50),
+               percentile(result->push_ns, result->callback_num, 0.99),
+               percentile(result->push_ns, result->callback_num, 1.0));
+    }
+}
+
+static sim_result_t sim_result;
+static sim_result_t legacy_result;
+
+static void test_babbler(void)
+{
+    sim_make_arrivals();
+    sim_result.name = ESPNOW_INGEST_DROP_NEWEST ? "babbling node, lanes, drop newest" : "babbling node, lanes, drop oldest";
+    sim_run(&sim_result);
+    legacy_result.name = "babbling node, blocking queue send";
+    sim_run_legacy(&legacy_result);
+    sim_report(&sim_result, false);
+    sim_report(&legacy_result, true);
+
+    /* Control frames are never shed and only wait for the frame being served */
+    TEST_ASSERT(sim_result.lost[ESPNOW_INGEST_LANE_CONTROL] == 0);
+    TEST_ASSERT(percentile(sim_result.delay_us[0], sim_result.delay_num[0], 1.0) <=
+                SIM_DATA_SERVICE_US + SIM_SINKS * SIM_CONTROL_SERVICE_US);
+    TEST_ASSERT(sim_result.delay_num[0] + sim_result.delay_num[1] + sim_result.lost[0] + sim_result.lost[1] == arrival_num);
+    TEST_ASSERT(percentile(sim_result.push_ns, sim_result.callback_num, 0.99) < 20000);
+
+    /* The babbler is charged with its drops, it tops the table */
+    int top = 0;
+    for (int i = 1; i < ESPNOW_INGEST_SOURCES; i++)
+    {
+        top = ingest_sources[i].drops > ingest_sources[top].drops ? i : top;
+    }
+    TEST_ASSERT(ingest_sources[top].mac[5] == 0);
+    TEST_ASSERT(sim_result.babbler_lost > 10 * sim_result.other_lost);
+    TEST_ASSERT(events_high >= 1 && events_drained == events_high);
+
+    /* The old callback waited out a service time per frame, the driver lost control frames meanwhile */
+    TEST_ASSERT(percentile(legacy_result.callback_us, legacy_result.callback_num, 1.0) >= SIM_DATA_SERVICE_US);
+    TEST_ASSERT(legacy_result.stalled_us > SIM_US / 4);
+    TEST_ASSERT(legacy_result.air_lost[ESPNOW_INGEST_LANE_CONTROL] > 0);
+}
+
+/* Two thread flood of the real hand-off, the receive callback against the espnow task */
+static volatile bool flood_done;
+static uint32_t flood_pushed[ESPNOW_INGEST_LANE_MAX];
+static uint32_t flood_popped[ESPNOW_INGEST_LANE_MAX];
+static uint32_t flood_disorder;
+static int64_t flood_push_ns[FLOOD_FRAMES];
+
+static void *flood_producer(void *arg)
+{
+    frame_t frame;
+    uint32_t seq[FLOOD_SOURCES] = {0};
+
+    for (int i = 0; i < FLOOD_FRAMES; i++)
+    {
+        frame.source = rng() % FLOOD_SOURCES;
+        frame.lane = (frame.source % 16 == 0) ? ESPNOW_INGEST_LANE_CONTROL : ESPNOW_INGEST_LANE_DATA;
+        frame.seq = seq[frame.source]++;
+        int64_t start = host_test_now_ns();
+        push(&frame);
+        flood_push_ns[i] = host_test_now_ns() - start;
+        flood_pushed[frame.lane]++;
+    }
+    __atomic_store_n(&flood_done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *flood_consumer(void *arg)
+{
+    frame_t frame;
+    int64_t next[FLOOD_SOURCES];
+    memset(next, 0, sizeof(next));
+
+    for (;;)
+    {
+        bool done = __atomic_load_n(&flood_done, __ATOMIC_ACQUIRE);
+        if (!pop(&frame, 10))
+        {
+            if (done)
+            {
+                break;
+            }
+            continue;
+        }
+        /* Shed frames leave gaps, a frame never comes twice or before an earlier one */
+        TRACE_BEGIN("espnow_process");
+        flood_disorder += frame.seq < next[frame.source];
+        next[frame.source] = frame.seq + 1;
+        flood_popped[frame.lane]++;
+        TRACE_END("espnow_process");
+    }
+    return NULL;
+}
+
+static void test_flood_threads(void)
+{
+    pthread_t producer, consumer;
+
+    reset();
+    int64_t start = host_test_now_ns();
+    pthread_create(&consumer, NULL, flood_consumer, NULL);
+    pthread_create(&producer, NULL, flood_producer, NULL);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double ms = (host_test_now_ns() - start) / 1e6;
+
+    for (int lane = 0; lane < ESPNOW_INGEST_LANE_MAX; lane++)
+    {
+        TEST_ASSERT(flood_pushed[lane] == flood_popped[lane] + ingest_lanes[lane].drops);
+    }
+    TEST_ASSERT(flood_disorder == 0);
+
+    printf("BENCH flood of %d frames from %d sources, two threads: %.0f ms, %u control and %u data frames shed\n",
+           FLOOD_FRAMES, FLOOD_SOURCES, ms, (unsigned)ingest_lanes[0].drops, (unsigned)ingest_lanes[1].drops);
+    printf("BENCH   push: p50 %" PRIi64 " ns, p99 %" PRIi64 " ns, p99.9 %" PRIi64 " ns, max %" PRIi64 " ns\n",
+           percentile(flood_push_ns, FLOOD_FRAMES, 0.50), percentile(flood_push_ns, FLOOD_FRAMES, 0.99),
+           percentile(flood_push_ns, FLOOD_FRAMES, 0.999), percentile(flood_push_ns, FLOOD_FRAMES, 1.0));
+}
+
+#if CONFIG_APP_TRACE_ENABLE
+/* The end of the flood as exported: every push and every processed frame, in order per thread */
+static FILE *trace_file;
+static char trace[64 * 1024];
+static size_t trace_len;
+
+static esp_err_t trace_flush(void *ctx, const char *buf, size_t len)
+{
+    TEST_ASSERT(trace_len + len < sizeof(trace));
+    memcpy(trace + trace_len, buf, len);
+    trace_len += len;
+    trace[trace_len] = '\0';
+    return fwrite(buf, 1, len, trace_file) == len ? ESP_OK : ESP_FAIL;
+}
+
+static void test_trace(void)
+{
+    enum
+    {
+        TRACE_RX,
+        TRACE_ENQUEUE,
+        TRACE_BEGIN_PROCESS,
+        TRACE_END_PROCESS,
+        TRACE_KINDS,
+    };
+    int counts[TRACE_KINDS] = {0};
+    int64_t push_ns[CONFIG_APP_TRACE_RING_SIZE];
+    int64_t process_ns[CONFIG_APP_TRACE_RING_SIZE];
+    int push_num = 0;
+    int process_num = 0;
+    int last[2] = {-1, -1};
+    double last_ts[2] = {0};
+    unsigned long tids[2] = {0};
+
+    trace_file = fopen(TRACE_FILE, "w");
+    TEST_ASSERT(trace_file != NULL);
+    if (!trace_file)
+    {
+        return;
+    }
+    trace_len = 0;
+    TEST_ASSERT(tracing_export_chrome(trace_flush, NULL) == ESP_OK);
+    fclose(trace_file);
+
+    for (char *line = strstr(trace, "\n{\"name\":\""); line; line = strstr(line + 1, "\n{\"name\":\""))
+    {
+        char name[32];
+        char phase;
+        double ts;
+        unsigned long tid;
+        TEST_ASSERT(sscanf(line, "\n{\"name\":\"%31[^\"]\",\"ph\":\"%c\",\"ts\":%lf,\"pid\":0,\"tid\":%lu", name, &phase, &ts, &tid) == 4);
+
+        int kind = !strcmp(name, "espnow_rx")        ? TRACE_RX
+                   : !strcmp(name, "espnow_enqueue") ? TRACE_ENQUEUE
+                   : phase == TRACING_PHASE_BEGIN    ? TRACE_BEGIN_PROCESS
+                                                     : TRACE_END_PROCESS;
+        TEST_ASSERT(kind < TRACE_BEGIN_PROCESS || !strcmp(name, "espnow_process"));
+        counts[kind]++;
+
+        // The producer pushes and the consumer processes, each alternates between its two events
+        int thread = kind >= TRACE_BEGIN_PROCESS;
+        if (!tids[thread])
+        {
+            tids[thread] = tid;
+        }
+        TEST_ASSERT(tid == tids[thread]);
+        if (last[thread] >= 0)
+        {
+            TEST_ASSERT(kind == (last[thread] ^ 1));
+            if (kind == TRACE_ENQUEUE)
+            {
+                push_ns[push_num++] = (int64_t)((ts - last_ts[thread]) * 1000);
+            }
+            else if (kind == TRACE_END_PROCESS)
+            {
+                process_ns[process_num++] = (int64_t)((ts - last_ts[thread]) * 1000);
+            }
+        }
+        last[thread] = kind;
+        last_ts[thread] = ts;
+    }
+    TEST_ASSERT(tids[0] != tids[1]);
+    TEST_ASSERT(counts[TRACE_RX] + counts[TRACE_ENQUEUE] + counts[TRACE_BEGIN_PROCESS] + counts[TRACE_END_PROCESS] ==
+                CONFIG_APP_TRACE_RING_SIZE);
+    TEST_ASSERT(push_num > 0 && process_num > 0);
+
+    printf("BENCH trace of the flood end: %d rx, %d enqueue, %d process spans, %u bytes to %s\n", counts[TRACE_RX],
+           counts[TRACE_ENQUEUE], process_num, (unsigned)trace_len, TRACE_FILE);
+    printf("BENCH   rx to enqueue: p50 %" PRIi64 " ns, max %" PRIi64 " ns; process span: p50 %" PRIi64 " ns, max %" PRIi64 " ns\n",
+           percentile(push_ns, push_num, 0.50), percentile(push_ns, push_num, 1.0), percentile(process_ns, process_num, 0.50),
+           percentile(process_ns, process_num, 1.0));
+}
+#endif
+
+static size_t scrape_len;
+static char scrape[8192];
+
+static esp_err_t scrape_flush(void *ctx, const char *buf, size_t len)
+{
+    if (scrape_len + len >= sizeof(scrape))
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(scrape + scrape_len, buf, len);
+    scrape_len += len;
+    scrape[scrape_len] = '\0';
+    return ESP_OK;
+}
+
+static void test_scrape(void)
+{
+    /* After the babbler: its drops are exported against its MAC */
+    sim_run(&sim_result);
+    TEST_ASSERT(metrics_scrape(scrape_flush, NULL) == ESP_OK);
+    TEST_ASSERT(strstr(scrape, "espnow_ingest_source_dropped_total{source=\"24:0a:c4:00:00:00\"}") != NULL);
+    TEST_ASSERT(strstr(scrape, "espnow_ingest_dropped_total{lane=\"control\"} 0\n") != NULL);
+    TEST_ASSERT(strstr(scrape, "espnow_rx_dropped_total") != NULL);
+}
+
+int main(void)
+{
+    esp_timer_base_us = host_test_now_ns() / 1000;
+    metrics_init();
+    espnow_ingest_init();
+
+    RUN_TEST(test_shed_policy);
+    RUN_TEST(test_watermark);
+    RUN_TEST(test_source_drops);
+    RUN_TEST(test_babbler);
+    RUN_TEST(test_flood_threads);
+#if CONFIG_APP_TRACE_ENABLE
+    RUN_TEST(test_trace);
+#endif
+    RUN_TEST(test_scrape);
+    return host_test_result();
+}
@@ -0,0 +1,636 @@
+/*
+ * esp_mesh_lite_espnow peer cache against a fake ESP-NOW driver with a 20 entry peer table: no
+ * driver call for a cached peer, channel changes, least recently used eviction, peers added or
+ * deleted behind the cache, and driver calls per send of a unicast workload to more peers than
+ * the table holds, next to the create, send and delete of every send it replaced. Then the
+ * capability exchange: frame sizes per peer in a mixed fleet, replies sent outside the receive
+ * callback, backoff of requests to peers that never answer, and frames and airtime of a transfer
+ * to a v1 and to a v2 peer.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+/* The cache is static, the test inspects it */
+#include "../components/mesh_lite/src/esp_mesh_lite_espnow.c"
+
+#define BENCH_SENDS 200000
+#define BENCH_HOT_PEERS 8       /* Parent and children, most of the traffic */
+#define BENCH_PEERS 40
+#define BENCH_HOT_PERCENT 80
+#define BENCH_TRANSFER_BYTES (64 * 1024)
+
+/* Airtime of a frame at 1 Mbit/s: long preamble, then MAC header, vendor action and FCS */
+#define AIR_PREAMBLE_US 192
+#define AIR_OVERHEAD_BYTES 43
+
+enum
+{
+    DRIVER_ADD,
+    DRIVER_MOD,
+    DRIVER_DEL,
+    DRIVER_GET,
+    DRIVER_EXIST,
+    DRIVER_SEND,
+    DRIVER_CALLS,
+};
+
+/* The driver peer table */
+static esp_now_peer_info_t driver_peers[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static bool driver_used[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static uint32_t driver_calls[DRIVER_CALLS];
+
+/* Last frame sent */
+static uint8_t sent_addr[ESP_NOW_ETH_ALEN];
+static uint8_t sent_frame[ESPNOW_PAYLOAD_MAX_LEN];
+static size_t sent_len;
+
+/* Function call pended to the timer task, run by the test */
+static PendedFunction_t pended_fn;
+static bool timer_queue_full;
+static TickType_t now_ticks;
+
+static int driver_find(const uint8_t *peer_addr)
+{
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++)
+    {
+        if (driver_used[i] && !memcmp(driver_peers[i].peer_addr, peer_addr, ESP_NOW_ETH_ALEN))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int driver_num(void)
+{
+    int num = 0;
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++)
+    {
+        num += driver_used[i];
+    }
+    return num;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    driver_calls[DRIVER_ADD]++;
+    if (driver_find(peer->peer_addr) >= 0)
+    {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++)
+    {
+        if (!driver_used[i])
+        {
+            driver_peers[i] = *peer;
+            driver_used[i] = true;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_ESPNOW_FULL;
+}
+
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer)
+{
+    driver_calls[DRIVER_MOD]++;
+    int i = driver_find(peer->peer_addr);
+    if (i < 0)
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    driver_peers[i] = *peer;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    driver_calls[DRIVER_DEL]++;
+    int i = driver_find(peer_addr);
+    if (i < 0)
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    driver_used[i] = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_get_peer(const uint8_t *peer_addr, esp_now_peer_info_t *peer)
+{
+    driver_calls[DRIVER_GET]++;
+    int i = driver_find(peer_addr);
+    if (i < 0)
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    *peer = driver_peers[i];
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    driver_calls[DRIVER_EXIST]++;
+    return driver_find(peer_addr) >= 0;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    driver_calls[DRIVER_SEND]++;
+    if (!IS_BROADCAST_ADDR(peer_addr) && driver_find(peer_addr) < 0)
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    TEST_ASSERT(len <= sizeof(sent_frame));
+    memcpy(sent_addr, peer_addr, ESP_NOW_ETH_ALEN);
+    memcpy(sent_frame, data, len);
+    sent_len = len;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_now_get_version(uint32_t *version)
+{
+    *version = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    return ESP_OK;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return now_ticks;
+}
+
+BaseType_t xTimerPendFunctionCall(PendedFunction_t fn, void *arg1, uint32_t arg2, TickType_t wait)
+{
+    if (timer_queue_full)
+    {
+        return pdFAIL;
+    }
+    TEST_ASSERT(pended_fn == NULL);
+    pended_fn = fn;
+    return pdPASS;
+}
+
+static void reset(void)
+{
+    memset(driver_used, 0, sizeof(driver_used));
+    memset(driver_calls, 0, sizeof(driver_calls));
+    memset(espnow_peer_cache, 0, sizeof(espnow_peer_cache));
+    memset(&espnow_peer_stats, 0, sizeof(espnow_peer_stats));
+}
+
+static uint32_t driver_total(void)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < DRIVER_SEND; i++)
+    {
+        total += driver_calls[i];
+    }
+    return total;
+}
+
+static void make_mac(uint8_t *mac, int peer)
+{
+    static const uint8_t oui[3] = {0x24, 0x0a, 0xc4};
+    memcpy(mac, oui, 3);
+    mac[3] = 0;
+    mac[4] = peer >> 8;
+    mac[5] = peer;
+}
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void test_hit(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    esp_now_peer_info_t peer;
+
+    reset();
+    make_mac(mac, 1);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 6, WIFI_IF_STA) == ESP_OK);
+    TEST_ASSERT(driver_calls[DRIVER_ADD] == 1 && driver_num() == 1);
+    for (int i = 0; i < 100; i++)
+    {
+        TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 6, WIFI_IF_STA) == ESP_OK);
+    }
+    TEST_ASSERT(driver_total() == 1 && espnow_peer_stats.hits == 100);
+
+    /* A new channel or interface goes to the driver */
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 11, WIFI_IF_STA) == ESP_OK);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 11, WIFI_IF_AP) == ESP_OK);
+    TEST_ASSERT(driver_calls[DRIVER_MOD] == 2 && espnow_peer_stats.mods == 2);
+    TEST_ASSERT(esp_now_get_peer(mac, &peer) == ESP_OK && peer.channel == 11 && peer.ifidx == WIFI_IF_AP);
+    TEST_ASSERT(driver_num() == 1);
+
+    /* Deleted through the cache, the next add goes to the driver again */
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_del(mac) == ESP_OK && driver_num() == 0);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 11, WIFI_IF_AP) == ESP_OK && driver_num() == 1);
+    TEST_ASSERT(espnow_peer_stats.adds == 2);
+}
+
+static void test_lru(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    reset();
+    for (int peer = 0; peer < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM; peer++)
+    {
+        make_mac(mac, peer);
+        TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA) == ESP_OK);
+    }
+    /* Peer 0 is used again, peer 1 is now the least recently used */
+    make_mac(mac, 0);
+    esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA);
+
+    make_mac(mac, CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA) == ESP_OK);
+    TEST_ASSERT(espnow_peer_stats.evictions == 1 && driver_num() == CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM);
+    make_mac(mac, 0);
+    TEST_ASSERT(driver_find(mac) >= 0);
+    make_mac(mac, 1);
+    TEST_ASSERT(driver_find(mac) < 0 && espnow_peer_cache_find(mac) == NULL);
+
+    /* Every cached peer is in the driver table */
+    for (int i = 0; i < CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM; i++)
+    {
+        TEST_ASSERT(!espnow_peer_cache[i].valid || driver_find(espnow_peer_cache[i].peer_addr) >= 0);
+    }
+}
+
+static void test_outside_peers(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t data[8] = {0};
+    esp_now_peer_info_t peer = {0};
+
+    /* The driver table filled up by peers added without the cache: one cached peer makes room */
+    reset();
+    make_mac(mac, 100);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA) == ESP_OK);
+    for (int i = 0; driver_num() < ESP_NOW_MAX_TOTAL_PEER_NUM; i++)
+    {
+        make_mac(peer.peer_addr, 200 + i);
+        TEST_ASSERT(esp_now_add_peer(&peer) == ESP_OK);
+    }
+    make_mac(mac, 101);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA) == ESP_OK);
+    TEST_ASSERT(espnow_peer_stats.evictions == 1 && driver_find(mac) >= 0);
+
+    /* Nothing cached left to evict, the error of the driver is returned and nothing is cached */
+    make_mac(mac, 102);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA) == ESP_OK);
+    make_mac(mac, 103);
+    memset(espnow_peer_cache, 0, sizeof(espnow_peer_cache));
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(mac, 0, WIFI_IF_STA) == ESP_ERR_ESPNOW_FULL);
+    TEST_ASSERT(espnow_peer_cache_find(mac) == NULL);
+
+    /* Added behind the cache: taken over with a mod */
+    reset();
+    make_mac(peer.peer_addr, 1);
+    peer.channel = 1;
+    esp_now_add_peer(&peer);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(peer.peer_addr, 6, WIFI_IF_STA) == ESP_OK);
+    TEST_ASSERT(esp_now_get_peer(peer.peer_addr, &peer) == ESP_OK && peer.channel == 6);
+    TEST_ASSERT(espnow_peer_cache_find(peer.peer_addr) != NULL);
+
+    /* Deleted behind the cache: a channel change adds it again */
+    esp_now_del_peer(peer.peer_addr);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(peer.peer_addr, 11, WIFI_IF_STA) == ESP_OK);
+    TEST_ASSERT(driver_find(peer.peer_addr) >= 0);
+
+    /* Deleted behind the cache: the failed send drops the cached entry, the next add restores it */
+    espnow_init = true;
+    esp_now_del_peer(peer.peer_addr);
+    TEST_ASSERT(esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_RESERVE, peer.peer_addr, data, sizeof(data)) ==
+                ESP_ERR_ESPNOW_NOT_FOUND);
+    TEST_ASSERT(espnow_peer_cache_find(peer.peer_addr) == NULL);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_add(peer.peer_addr, 11, WIFI_IF_STA) == ESP_OK);
+    TEST_ASSERT(esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_RESERVE, peer.peer_addr, data, sizeof(data)) == ESP_OK);
+    espnow_init = false;
+}
+
+/* The create_peer of wireless debug and the app before the cache, on every send */
+static esp_err_t legacy_create_peer(uint8_t *dst_mac, uint8_t channel)
+{
+    esp_err_t ret = ESP_FAIL;
+    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
+    if (peer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(peer, 0, sizeof(esp_now_peer_info_t));
+
+    esp_now_get_peer(dst_mac, peer);
+    peer->channel = channel;
+    peer->ifidx = WIFI_IF_STA;
+    peer->encrypt = false;
+    memcpy(peer->peer_addr, dst_mac, ESP_NOW_ETH_ALEN);
+
+    if (esp_now_is_peer_exist(dst_mac) == false)
+    {
+        ret = esp_now_add_peer(peer);
+    }
+    else
+    {
+        ret = esp_now_mod_peer(peer);
+    }
+    free(peer);
+    return ret;
+}
+
+typedef enum
+{
+    BENCH_CACHE,
+    BENCH_LEGACY_KEEP,      /* Peers left in the table */
+    BENCH_LEGACY_DELETE,    /* esp_mesh_lite_espnow_send_and_del_peer() */
+} bench_mode_t;
+
+static void bench_workload(bench_mode_t mode, const char *label)
+{
+    static uint8_t macs[BENCH_PEERS][ESP_NOW_ETH_ALEN];
+    uint8_t data[32] = {0};
+    uint32_t failed = 0;
+
+    reset();
+    rng_state = 1;
+    for (int peer = 0; peer < BENCH_PEERS; peer++)
+    {
+        make_mac(macs[peer], peer);
+    }
+
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_SENDS; i++)
+    {
+        uint32_t r = rng();
+        int peer = (r % 100 < BENCH_HOT_PERCENT) ? (r >> 8) % BENCH_HOT_PEERS
+                                                  : BENCH_HOT_PEERS + (r >> 8) % (BENCH_PEERS - BENCH_HOT_PEERS);
+        esp_err_t ret = mode == BENCH_CACHE ? esp_mesh_lite_espnow_peer_add(macs[peer], 0, WIFI_IF_STA)
+                                            : legacy_create_peer(macs[peer], 0);
+        if (ret == ESP_OK)
+        {
+            ret = esp_now_send(macs[peer], data, sizeof(data));
+        }
+        if (mode == BENCH_LEGACY_DELETE)
+        {
+            esp_now_del_peer(macs[peer]);
+        }
+        failed += ret != ESP_OK;
+    }
+    double ns = (double)(host_test_now_ns() - start) / BENCH_SENDS;
+
+    if (mode == BENCH_CACHE)
+    {
+        TEST_ASSERT(failed == 0 && driver_num() <= CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM);
+        /* The hot peers stay cached, only the cold ones churn */
+        TEST_ASSERT(espnow_peer_stats.hits > BENCH_SENDS * BENCH_HOT_PERCENT / 100);
+    }
+    printf("BENCH %-26s %.2f driver calls and %.1f%% failed per send (add %u, mod %u, del %u, get %u, exist %u), "
+           "%.0f ns per send on the host\n",
+           label, (double)driver_total() / BENCH_SENDS, 100.0 * failed / BENCH_SENDS, (unsigned)driver_calls[DRIVER_ADD],
+           (unsigned)driver_calls[DRIVER_MOD], (unsigned)driver_calls[DRIVER_DEL], (unsigned)driver_calls[DRIVER_GET],
+           (unsigned)driver_calls[DRIVER_EXIST], ns);
+    if (mode == BENCH_CACHE)
+    {
+        printf("BENCH   cache: %u hits, %u adds, %u evictions\n", (unsigned)espnow_peer_stats.hits,
+               (unsigned)espnow_peer_stats.adds, (unsigned)espnow_peer_stats.evictions);
+    }
+}
+
+static void bench_peers(void)
+{
+    printf("BENCH %d unicast sends to %d peers, %d%% to %d of them\n", BENCH_SENDS, BENCH_PEERS, BENCH_HOT_PERCENT,
+           BENCH_HOT_PEERS);
+    bench_workload(BENCH_CACHE, "peer cache:");
+    bench_workload(BENCH_LEGACY_KEEP, "create_peer, kept:");
+    bench_workload(BENCH_LEGACY_DELETE, "create_peer, send, delete:");
+}
+
+static void run_pended(void)
+{
+    PendedFunction_t fn = pended_fn;
+    pended_fn = NULL;
+    if (fn)
+    {
+        fn(NULL, 0);
+    }
+}
+
+static void caps_reset(void)
+{
+    reset();
+    memset(espnow_caps_cache, 0, sizeof(espnow_caps_cache));
+    espnow_caps_reply_scheduled = false;
+    pended_fn = NULL;
+    timer_queue_full = false;
+    sent_len = 0;
+    espnow_local_caps.version = 2;
+    espnow_local_caps.max_payload = ESPNOW_PAYLOAD_MAX_LEN;
+    espnow_local_caps.codecs = 0x3;
+}
+
+/* A capability frame from a peer, as the receive callback dispatches it */
+static void caps_recv(int peer, espnow_caps_msg_type_t type, uint8_t version, uint16_t max_payload, uint32_t codecs)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -60};
+    esp_now_recv_info_t recv_info = {.src_addr = mac, .rx_ctrl = &rx_ctrl};
+    espnow_caps_msg_t msg = {.type = type, .version = version, .max_payload = max_payload, .codecs = codecs};
+
+    make_mac(mac, peer);
+    TEST_ASSERT(espnow_caps_recv_cb(&recv_info, (const uint8_t *)&msg, sizeof(msg)) == ESP_OK);
+}
+
+static bool sent_caps(int peer, espnow_caps_msg_type_t type)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    espnow_caps_msg_t msg;
+
+    make_mac(mac, peer);
+    if (sent_len != 1 + sizeof(msg) || sent_frame[0] != ESPNOW_DATA_TYPE_CAPABILITY || memcmp(sent_addr, mac, ESP_NOW_ETH_ALEN))
+    {
+        return false;
+    }
+    memcpy(&msg, &sent_frame[1], sizeof(msg));
+    return msg.type == type && msg.version == espnow_local_caps.version && msg.max_payload == ESPNOW_PAYLOAD_MAX_LEN &&
+           msg.codecs == espnow_local_caps.codecs;
+}
+
+static void test_caps_exchange(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t broadcast[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    esp_mesh_lite_espnow_caps_t caps;
+
+    caps_reset();
+    make_mac(mac, 1);
+
+    /* Unknown until the reply: v1 frames, and the query sends the capabilities of this node */
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESP_NOW_MAX_DATA_LEN - 1);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_get_caps(mac, &caps) == ESP_ERR_NOT_FOUND && sent_len == 0);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_query_caps(mac) == ESP_OK && sent_caps(1, ESPNOW_CAPS_REQUEST));
+    TEST_ASSERT(driver_find(mac) >= 0);
+    caps_recv(1, ESPNOW_CAPS_REPLY, 2, ESPNOW_PAYLOAD_MAX_LEN, 0x1);
+    TEST_ASSERT(pended_fn == NULL);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_get_caps(mac, &caps) == ESP_OK && caps.version == 2 && caps.codecs == 0x1);
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESPNOW_PAYLOAD_MAX_LEN - 1);
+
+    /* Known: no more requests */
+    sent_len = 0;
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_query_caps(mac) == ESP_OK && sent_len == 0);
+
+    /* A v1 peer stays at the v1 size, whatever this node supports */
+    make_mac(mac, 2);
+    caps_recv(2, ESPNOW_CAPS_REPLY, 1, ESP_NOW_MAX_DATA_LEN, 0);
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESP_NOW_MAX_DATA_LEN - 1);
+
+    /* Broadcasts reach every peer, v1 ones too */
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(broadcast) == ESP_NOW_MAX_DATA_LEN - 1);
+    TEST_ASSERT(esp_mesh_lite_espnow_peer_query_caps(broadcast) == ESP_ERR_INVALID_ARG);
+}
+
+static void test_caps_reply(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    /* A request informs this end, the reply waits for the timer task */
+    caps_reset();
+    caps_recv(3, ESPNOW_CAPS_REQUEST, 2, ESPNOW_PAYLOAD_MAX_LEN, 0x1);
+    caps_recv(4, ESPNOW_CAPS_REQUEST, 2, ESPNOW_PAYLOAD_MAX_LEN, 0x1);
+    TEST_ASSERT(sent_len == 0 && pended_fn != NULL);
+    make_mac(mac, 3);
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESPNOW_PAYLOAD_MAX_LEN - 1);
+
+    /* One pended call answers both, the last one sent is the reply to node 4 */
+    run_pended();
+    TEST_ASSERT(sent_caps(4, ESPNOW_CAPS_REPLY) && driver_calls[DRIVER_SEND] == 2);
+    TEST_ASSERT(!espnow_caps_reply_scheduled);
+
+    /* Timer queue full: no reply, the next request schedules again */
+    timer_queue_full = true;
+    caps_recv(5, ESPNOW_CAPS_REQUEST, 2, ESPNOW_PAYLOAD_MAX_LEN, 0x1);
+    TEST_ASSERT(!espnow_caps_reply_scheduled && pended_fn == NULL);
+    timer_queue_full = false;
+    caps_recv(5, ESPNOW_CAPS_REQUEST, 2, ESPNOW_PAYLOAD_MAX_LEN, 0x1);
+    run_pended();
+    TEST_ASSERT(sent_caps(5, ESPNOW_CAPS_REPLY));
+}
+
+static void test_caps_backoff(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int requests = 0;
+    int interval_max = 0;
+    TickType_t last = 0;
+
+    /* Older firmware never answers: one query per second for 10 minutes */
+    caps_reset();
+    make_mac(mac, 6);
+    for (now_ticks = 0; now_ticks < pdMS_TO_TICKS(600000); now_ticks += pdMS_TO_TICKS(1000))
+    {
+        sent_len = 0;
+        esp_err_t ret = esp_mesh_lite_espnow_peer_query_caps(mac);
+        if (sent_len)
+        {
+            TEST_ASSERT(ret == ESP_OK);
+            if (requests)
+            {
+                interval_max = now_ticks - last > interval_max ? now_ticks - last : interval_max;
+            }
+            last = now_ticks;
+            requests++;
+        }
+        else
+        {
+            TEST_ASSERT(ret == ESP_ERR_NOT_FINISHED);
+        }
+        TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESP_NOW_MAX_DATA_LEN - 1);
+    }
+    now_ticks = 0;
+
+    /* 0, 5, 15, 35, 75 s, then every 80 s */
+    TEST_ASSERT(requests == 11);
+    TEST_ASSERT(interval_max == pdMS_TO_TICKS(ESPNOW_CAPS_REQUEST_INTERVAL_MS) << ESPNOW_CAPS_REQUEST_BACKOFF_MAX);
+    printf("BENCH unanswered peer queried every second for 10 minutes: %d requests, at most %d s apart\n", requests,
+           interval_max / 1000);
+}
+
+static void test_caps_lru(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    /* More peers than the cache, the least recently used is forgotten and falls back to v1 */
+    caps_reset();
+    for (int peer = 0; peer <= CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM; peer++)
+    {
+        caps_recv(10 + peer, ESPNOW_CAPS_REPLY, 2, ESPNOW_PAYLOAD_MAX_LEN, 0);
+        if (peer == 0)
+        {
+            caps_recv(11, ESPNOW_CAPS_REPLY, 2, ESPNOW_PAYLOAD_MAX_LEN, 0);
+        }
+    }
+    make_mac(mac, 10);
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESP_NOW_MAX_DATA_LEN - 1);
+    make_mac(mac, 11);
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESPNOW_PAYLOAD_MAX_LEN - 1);
+    make_mac(mac, 10 + CONFIG_MESH_LITE_ESPNOW_PEER_CACHE_NUM);
+    TEST_ASSERT(esp_mesh_lite_espnow_max_data_len(mac) == ESPNOW_PAYLOAD_MAX_LEN - 1);
+}
+
+static void bench_transfer(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    caps_reset();
+    caps_recv(1, ESPNOW_CAPS_REPLY, 1, ESP_NOW_MAX_DATA_LEN, 0);
+    caps_recv(2, ESPNOW_CAPS_REPLY, 2, ESPNOW_PAYLOAD_MAX_LEN, 0);
+
+    /* The same transfer, e.g. a wireless debug log, to a v1 and to a v2 peer */
+    int frames[2];
+    double airtime_ms[2];
+    for (int peer = 1; peer <= 2; peer++)
+    {
+        make_mac(mac, peer);
+        size_t chunk = esp_mesh_lite_espnow_max_data_len(mac);
+        int num = (BENCH_TRANSFER_BYTES + chunk - 1) / chunk;
+        frames[peer - 1] = num;
+        airtime_ms[peer - 1] = (num * (AIR_PREAMBLE_US + (AIR_OVERHEAD_BYTES + 1) * 8.0) + BENCH_TRANSFER_BYTES * 8.0) / 1000;
+    }
+    /* The exchange itself, a request and a reply */
+    double exchange_ms = 2 * (AIR_PREAMBLE_US + (AIR_OVERHEAD_BYTES + 1 + sizeof(espnow_caps_msg_t)) * 8.0) / 1000;
+
+    TEST_ASSERT(frames[0] >= 5 * frames[1]);
+    printf("BENCH %d KB transfer: v1 peer %d frames %.1f ms on air, v2 peer %d frames %.1f ms on air (%.1fx fewer frames), "
+           "exchange %.2f ms\n",
+           BENCH_TRANSFER_BYTES / 1024, frames[0], airtime_ms[0], frames[1], airtime_ms[1], (double)frames[0] / frames[1],
+           exchange_ms);
+}
+
+int main(void)
+{
+    RUN_TEST(test_hit);
+    RUN_TEST(test_lru);
+    RUN_TEST(test_outside_peers);
+    RUN_TEST(bench_peers);
+    RUN_TEST(test_caps_exchange);
+    RUN_TEST(test_caps_reply);
+    RUN_TEST(test_caps_backoff);
+    RUN_TEST(test_caps_lru);
+    RUN_TEST(bench_transfer);
+    return host_test_result();
+}
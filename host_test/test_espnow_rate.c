@@ -0,0 +1,173 @@
+/*
+ * espnow_rate: simulation of the rate controller against a synthetic loss model, reporting goodput
+ * vs SNR next to the fixed 1 Mbit/s default and the best fixed rate, and the time to follow a step
+ * change of the link.
+ */
+#include <math.h>
+#include "host_test.h"
+#include "espnow_rate.h"
+
+#define FRAME_LEN 250
+#define FRAME_INTERVAL_MS 5     /* 200 frames/s offered, 20 per controller update */
+#define SIM_FRAMES 20000
+
+/* SNR at which a rate delivers half of the frames, steps after the 802.11b/n sensitivity tables */
+static const float snr_50[ESPNOW_RATE_NUM] = {2, 5, 8, 11, 5, 8, 11, 14, 18, 22, 24, 26};
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static float delivery(espnow_rate_t rate, float snr)
+{
+    return 1.0f / (1.0f + expf(-(snr - snr_50[rate]) * 1.5f));
+}
+
+/* Same airtime model as the controller: preamble, SIFS and ACK, then the payload */
+static float airtime_us(espnow_rate_t rate)
+{
+    return (rate <= ESPNOW_RATE_11M ? 500 : 90) + FRAME_LEN * 8 * 1000.0f / espnow_rate_kbps(rate);
+}
+
+typedef struct
+{
+    float kbps;         /* Delivered payload bits per airtime used */
+    float airtime_us;   /* Mean airtime per frame */
+} sim_result_t;
+
+static sim_result_t sim_fixed(espnow_rate_t rate, float snr)
+{
+    sim_result_t result;
+    float p = delivery(rate, snr);
+    result.kbps = p * FRAME_LEN * 8 * 1000 / airtime_us(rate);
+    result.airtime_us = airtime_us(rate);
+    return result;
+}
+
+static sim_result_t sim_controller(espnow_rate_ctrl_t *ctrl, float snr, uint32_t *now_ms, int frames)
+{
+    double bits = 0;
+    double airtime = 0;
+
+    for (int i = 0; i < frames; i++)
+    {
+        espnow_rate_t rate = espnow_rate_ctrl_select(ctrl, rng());
+        bool success = (rng() % 10000) < delivery(rate, snr) * 10000;
+        espnow_rate_ctrl_report(ctrl, rate, success, *now_ms);
+        bits += success ? FRAME_LEN * 8 : 0;
+        airtime += airtime_us(rate);
+        *now_ms += FRAME_INTERVAL_MS;
+    }
+    return (sim_result_t){.kbps = bits * 1000 / airtime, .airtime_us = airtime / frames};
+}
+
+static sim_result_t sim_best_fixed(float snr, espnow_rate_t *best)
+{
+    sim_result_t result = {0};
+    for (int i = 0; i < ESPNOW_RATE_NUM; i++)
+    {
+        sim_result_t r = sim_fixed(i, snr);
+        if (r.kbps > result.kbps)
+        {
+            result = r;
+            *best = i;
+        }
+    }
+    return result;
+}
+
+/* Goodput vs SNR, started from 1 Mbit/s as a cold link, measured after one second of warm-up */
+static void test_goodput_vs_snr(void)
+{
+    printf("BENCH  SNR dB | controller kbit/s  airtime us | 1M fixed kbit/s  airtime us | best fixed kbit/s (rate)\n");
+    for (int snr = 0; snr <= 30; snr += 3)
+    {
+        espnow_rate_ctrl_t ctrl;
+        uint32_t now_ms = 0;
+        espnow_rate_t best = ESPNOW_RATE_1M;
+
+        espnow_rate_ctrl_init(&ctrl, FRAME_LEN, ESPNOW_RATE_1M, now_ms);
+        sim_controller(&ctrl, snr, &now_ms, 1000 / FRAME_INTERVAL_MS);
+        sim_result_t adaptive = sim_controller(&ctrl, snr, &now_ms, SIM_FRAMES);
+        sim_result_t fixed = sim_fixed(ESPNOW_RATE_1M, snr);
+        sim_result_t oracle = sim_best_fixed(snr, &best);
+
+        printf("BENCH  %6d | %17.0f  %10.0f | %15.0f  %10.0f | %17.0f (%d)\n", snr, adaptive.kbps, adaptive.airtime_us,
+               fixed.kbps, fixed.airtime_us, oracle.kbps, best);
+        // Probing costs one frame in ESPNOW_RATE_PROBE_INTERVAL, the rest goes at the best rate
+        TEST_ASSERT(adaptive.kbps >= 0.75f * oracle.kbps);
+        TEST_ASSERT(adaptive.kbps >= 0.95f * fixed.kbps || snr < 3);
+    }
+}
+
+/* Frames until the controller settles after the link drops from 30 to 8 dB and comes back */
+static void test_step_response(void)
+{
+    espnow_rate_ctrl_t ctrl;
+    uint32_t now_ms = 0;
+    espnow_rate_t best_low = ESPNOW_RATE_1M;
+    espnow_rate_t best_high = ESPNOW_RATE_1M;
+
+    sim_best_fixed(8, &best_low);
+    sim_best_fixed(30, &best_high);
+    espnow_rate_ctrl_init(&ctrl, FRAME_LEN, ESPNOW_RATE_1M, now_ms);
+    sim_controller(&ctrl, 30, &now_ms, 2000);
+    TEST_ASSERT(ctrl.best == best_high);
+
+    int down_ms = -1;
+    for (int ms = 0; ms < 5000 && down_ms < 0; ms += FRAME_INTERVAL_MS)
+    {
+        sim_controller(&ctrl, 8, &now_ms, 1);
+        if (espnow_rate_ctrl_throughput(&ctrl, ctrl.best) >= 0.8f * sim_fixed(best_low, 8).kbps
+                && sim_fixed(ctrl.best, 8).kbps >= 0.8f * sim_fixed(best_low, 8).kbps)
+        {
+            down_ms = ms;
+        }
+    }
+
+    int up_ms = -1;
+    for (int ms = 0; ms < 20000 && up_ms < 0; ms += FRAME_INTERVAL_MS)
+    {
+        sim_controller(&ctrl, 30, &now_ms, 1);
+        if (sim_fixed(ctrl.best, 30).kbps >= 0.8f * sim_fixed(best_high, 30).kbps)
+        {
+            up_ms = ms;
+        }
+    }
+    printf("BENCH step 30 -> 8 dB settled after %d ms, 8 -> 30 dB after %d ms, at %d frames/s\n",
+           down_ms, up_ms, 1000 / FRAME_INTERVAL_MS);
+    // A rate that stops delivering keeps 75% of its probability per update, 9 updates to fall under 10%
+    TEST_ASSERT(down_ms >= 0 && down_ms <= 2000);
+    TEST_ASSERT(up_ms >= 0 && up_ms <= 5000);
+}
+
+static void test_bench_cost(void)
+{
+    espnow_rate_ctrl_t ctrl;
+    uint32_t now_ms = 0;
+    espnow_rate_ctrl_init(&ctrl, FRAME_LEN, ESPNOW_RATE_MCS3, now_ms);
+
+    int64_t t0 = host_test_now_ns();
+    for (int i = 0; i < 1000000; i++)
+    {
+        espnow_rate_t rate = espnow_rate_ctrl_select(&ctrl, i * 2654435761u);
+        espnow_rate_ctrl_report(&ctrl, rate, i & 1, now_ms);
+        now_ms += i % 20 == 0;
+    }
+    int64_t t1 = host_test_now_ns();
+    printf("BENCH select + report %.1f ns per frame, controller %zu bytes per peer\n", (t1 - t0) / 1e6, sizeof(ctrl));
+}
+
+int main(void)
+{
+    RUN_TEST(test_goodput_vs_snr);
+    RUN_TEST(test_step_response);
+    RUN_TEST(test_bench_cost);
+    return host_test_result();
+}
@@ -0,0 +1,415 @@
+/*
+ * espnow sensor frames to the sink: broadcast while no sink is known, a unicast acknowledged by the
+ * MAC layer, resends and the broadcast fallback once the sink is unreachable, a late send callback
+ * that must not be credited to the next attempt. Then a sensor node sending to the sink over links
+ * of increasing frame loss, unicast to the advertised sink against the blind broadcast it replaced:
+ * delivery ratio, medium time per delivered frame and frames parsed by the nodes around.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+/* The sink, the frame in flight and the send timer are static, the test drives them */
+#include "../main/espnow.c"
+
+#define SIM_FRAMES 2000
+#define SIM_FRAME_PERIOD_US 10000000LL  /* A sensor batch every 10 s */
+#define SIM_PAYLOAD_LEN 60
+#define SIM_BYSTANDERS 10               /* Other nodes in range of the sender */
+#define SIM_MAC_TRIES 4                 /* Assumed tries of the Wi-Fi MAC for a unicast frame */
+#define SIM_SINK_RSSI -70
+
+/* Medium time at 1 Mbit/s: DIFS and the mean backoff, long preamble, then MAC header, vendor action and FCS */
+#define AIR_PREAMBLE_US 192
+#define AIR_OVERHEAD_BYTES 43
+#define AIR_DIFS_US 50
+#define AIR_SLOT_US 20
+#define AIR_CW_MIN 31
+#define AIR_CW_MAX 1023
+#define AIR_ACK_US (10 + AIR_PREAMBLE_US + 14 * 8) /* SIFS and the ACK */
+
+typedef struct
+{
+    uint32_t unicast;       /* Frames handed to the driver */
+    uint32_t broadcast;
+    uint32_t tries;         /* Unicast transmissions by the MAC layer, retries included */
+    uint32_t sink_rx;       /* Distinct frames received by the sink */
+    uint32_t sink_dup;
+    uint32_t bystander_rx;  /* Frames received and parsed by other nodes */
+    double medium_us;
+} radio_t;
+
+static const uint8_t sink_mac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0xaa};
+static int64_t now_us = 1000000;
+static double loss;                     /* Of every frame on the link, data and ACK */
+static radio_t radio;
+static uint8_t delivered[SIM_FRAMES];
+static esp_now_send_cb_t send_cb;
+
+/* Send callbacks held back, for the late callback test */
+static bool send_cb_held;
+static esp_now_send_status_t held_status[4];
+static int held_num;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static bool heard(void)
+{
+    return rng() / 4294967296.0 >= loss;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return now_us / 1000;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task)
+{
+    // The espnow task only serves received frames, the sink is fed directly
+    *task = NULL;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data, size_t event_data_size,
+                         TickType_t ticks_to_wait)
+{
+    return ESP_OK;
+}
+
+void parent_select_offer_rx(const uint8_t *mac, int8_t rssi, const uint8_t *data, size_t len)
+{
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_send_cb(void)
+{
+    send_cb = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_init(void)
+{
+    return ESP_OK;
+}
+
+void esp_mesh_lite_espnow_set_codecs(uint32_t codecs)
+{
+}
+
+esp_err_t esp_mesh_lite_espnow_register_rx_hook(esp_mesh_lite_espnow_rx_hook_t cb)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_recv_cb_register(esp_mesh_lite_espnow_data_type_t type, esp_mesh_lite_espnow_recv_cb_t recv_cb)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_add(const uint8_t *peer_addr, uint8_t channel, wifi_interface_t ifidx)
+{
+    return ESP_OK;
+}
+
+void esp_mesh_lite_espnow_peer_get_stats(esp_mesh_lite_espnow_peer_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_query_caps(const uint8_t *peer_addr)
+{
+    return ESP_OK;
+}
+
+size_t esp_mesh_lite_espnow_max_data_len(const uint8_t *peer_addr)
+{
+    return ESP_NOW_MAX_DATA_LEN - 1;
+}
+
+static double frame_us(size_t len)
+{
+    return AIR_PREAMBLE_US + (AIR_OVERHEAD_BYTES + len) * 8.0;
+}
+
+static void sink_rx(const uint8_t *data)
+{
+    uint32_t seq = ((const app_espnow_data_t *)data)->seq;
+    TEST_ASSERT(seq < SIM_FRAMES);
+    if (seq >= SIM_FRAMES)
+    {
+        return;
+    }
+    radio.sink_dup += delivered[seq];
+    radio.sink_rx += !delivered[seq];
+    delivered[seq] = 1;
+}
+
+/* The radio: a broadcast goes out once, a unicast until it is acknowledged or the MAC gives up */
+esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    TEST_ASSERT(type == ESPNOW_DATA_TYPE_RESERVE);
+    if (IS_BROADCAST_ADDR(peer_addr))
+    {
+        radio.broadcast++;
+        radio.medium_us += AIR_DIFS_US + AIR_CW_MIN / 2.0 * AIR_SLOT_US + frame_us(len + 1);
+        if (heard())
+        {
+            sink_rx(data);
+        }
+        for (int i = 0; i < SIM_BYSTANDERS; i++)
+        {
+            radio.bystander_rx += heard();
+        }
+        return ESP_OK;
+    }
+
+    TEST_ASSERT(!memcmp(peer_addr, sink_mac, ESP_NOW_ETH_ALEN));
+    radio.unicast++;
+    esp_now_send_status_t status = ESP_NOW_SEND_FAIL;
+    int cw = AIR_CW_MIN;
+    for (int try = 0; try < SIM_MAC_TRIES && status != ESP_NOW_SEND_SUCCESS; try++)
+    {
+        radio.tries++;
+        radio.medium_us += AIR_DIFS_US + cw / 2.0 * AIR_SLOT_US + frame_us(len + 1);
+        cw = cw * 2 + 1 > AIR_CW_MAX ? AIR_CW_MAX : cw * 2 + 1;
+        if (!heard())
+        {
+            continue;
+        }
+        // Filtered by address in the other nodes, only the sink receives and acknowledges it
+        sink_rx(data);
+        radio.medium_us += AIR_ACK_US;
+        if (heard())
+        {
+            status = ESP_NOW_SEND_SUCCESS;
+        }
+    }
+    if (send_cb_held)
+    {
+        held_status[held_num++ % 4] = status;
+    }
+    else
+    {
+        send_cb(peer_addr, status);
+    }
+    return ESP_OK;
+}
+
+static uint32_t counter(metrics_counter_t *c)
+{
+    return atomic_load(&c->value[0]);
+}
+
+static void reset(double frame_loss)
+{
+    memset(&radio, 0, sizeof(radio));
+    memset(delivered, 0, sizeof(delivered));
+    memset(&espnow_sink, 0, sizeof(espnow_sink));
+    esp_now_remove_send_msgs();
+    sent_msgs->dest[0] = 0;
+    atomic_store(&espnow_tx_owed, 0);
+    memset(espnow_tx_dest, 0, sizeof(espnow_tx_dest));
+    atomic_store(&espnow_sink_acked.value[0], 0);
+    atomic_store(&espnow_sink_fallback.value[0], 0);
+    loss = frame_loss;
+    send_cb_held = false;
+    held_num = 0;
+    rng_state = 1;
+}
+
+static void tick(int ticks)
+{
+    for (int i = 0; i < ticks; i++)
+    {
+        now_us += ESPNOW_SEND_TIMER_MS * 1000;
+        esp_now_send_timer_cb(NULL);
+    }
+}
+
+/* The espnow task handles an advertisement of the sink */
+static void advertise(void)
+{
+    espnow_sink_update(sink_mac, SIM_SINK_RSSI);
+}
+
+static esp_err_t send_frame(uint32_t seq, bool legacy)
+{
+    uint8_t payload[SIM_PAYLOAD_LEN] = {0};
+
+    // Single threaded, the previous frame must be done or the send would wait for it forever
+    TEST_ASSERT(sent_msgs->sent_msg == NULL);
+    return legacy ? esp_now_send_broadcast(payload, sizeof(payload), seq == 0)
+                  : esp_now_send_to_sink(payload, sizeof(payload), seq == 0);
+}
+
+static void test_no_sink(void)
+{
+    reset(0);
+    TEST_ASSERT(send_frame(0, false) == ESP_OK);
+    TEST_ASSERT(radio.broadcast == 1 && radio.unicast == 0);
+    tick(1);
+    TEST_ASSERT(radio.broadcast == 2 && sent_msgs->sent_msg != NULL);
+    tick(1);
+    TEST_ASSERT(radio.broadcast == 2 && sent_msgs->sent_msg == NULL);
+}
+
+static void test_acked(void)
+{
+    reset(0);
+    advertise();
+    TEST_ASSERT(send_frame(0, false) == ESP_OK);
+    TEST_ASSERT(radio.unicast == 1 && radio.tries == 1 && radio.sink_rx == 1);
+    tick(1);
+    TEST_ASSERT(sent_msgs->sent_msg == NULL && counter(&espnow_sink_acked) == 1);
+    tick(10);
+    TEST_ASSERT(radio.unicast == 1 && radio.broadcast == 0);
+}
+
+static void test_fallback(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    /* Nothing gets through: each resend follows a MAC failure, then the frame is broadcast */
+    reset(1.0);
+    advertise();
+    TEST_ASSERT(send_frame(0, false) == ESP_OK);
+    for (int i = 0; i < CONFIG_APP_ESPNOW_SINK_MAX_RETRY; i++)
+    {
+        tick(1);
+        TEST_ASSERT(radio.unicast == 2 + i && radio.broadcast == 0);
+    }
+    tick(1);
+    TEST_ASSERT(radio.broadcast == 1 && counter(&espnow_sink_fallback) == 1);
+    TEST_ASSERT(radio.tries == (CONFIG_APP_ESPNOW_SINK_MAX_RETRY + 1) * SIM_MAC_TRIES);
+    tick(2);
+    TEST_ASSERT(radio.broadcast == 2 && sent_msgs->sent_msg == NULL);
+
+    /* The sink is forgotten until its next advertisement */
+    TEST_ASSERT(!espnow_sink_get(mac));
+    TEST_ASSERT(send_frame(1, false) == ESP_OK && radio.broadcast == 3);
+    tick(2);
+    advertise();
+    TEST_ASSERT(send_frame(2, false) == ESP_OK && radio.unicast == CONFIG_APP_ESPNOW_SINK_MAX_RETRY + 2);
+    tick(20);
+}
+
+static void test_late_callback(void)
+{
+    /* No callback within ESPNOW_SEND_CB_TIMEOUT_TICKS: counted as failed and resent */
+    reset(0);
+    advertise();
+    send_cb_held = true;
+    TEST_ASSERT(send_frame(0, false) == ESP_OK);
+    tick(ESPNOW_SEND_CB_TIMEOUT_TICKS - 1);
+    TEST_ASSERT(radio.unicast == 1);
+    tick(1);
+    TEST_ASSERT(radio.unicast == 2 && atomic_load(&espnow_tx_owed) == 1);
+
+    /* The success of the first attempt arrives late, it does not acknowledge the second */
+    send_cb(sink_mac, held_status[0]);
+    tick(1);
+    TEST_ASSERT(sent_msgs->sent_msg != NULL && counter(&espnow_sink_acked) == 0);
+    send_cb(sink_mac, held_status[1]);
+    tick(1);
+    TEST_ASSERT(sent_msgs->sent_msg == NULL && counter(&espnow_sink_acked) == 1 && radio.unicast == 2);
+}
+
+typedef struct
+{
+    double delivery;
+    double medium_ms;       /* Per delivered frame */
+    double bystander_rx;    /* Per frame sent */
+    double tries;           /* Per unicast frame */
+    uint32_t fallbacks;
+} sim_result_t;
+
+static void sim_run(double frame_loss, bool legacy, sim_result_t *result)
+{
+    reset(frame_loss);
+    int64_t next_adv_us = now_us;
+    for (uint32_t seq = 0; seq < SIM_FRAMES; seq++)
+    {
+        int64_t end_us = now_us + SIM_FRAME_PERIOD_US;
+        TEST_ASSERT(send_frame(seq, legacy) == ESP_OK);
+        while (now_us < end_us)
+        {
+            if (now_us >= next_adv_us)
+            {
+                next_adv_us += CONFIG_APP_ESPNOW_SINK_ADV_INTERVAL_MS * 1000LL;
+                if (heard())
+                {
+                    advertise();
+                }
+            }
+            tick(1);
+        }
+    }
+    result->delivery = (double)radio.sink_rx / SIM_FRAMES;
+    result->medium_ms = radio.sink_rx ? radio.medium_us / radio.sink_rx / 1000 : 0;
+    result->bystander_rx = (double)radio.bystander_rx / SIM_FRAMES;
+    result->tries = radio.unicast ? (double)radio.tries / radio.unicast : 0;
+    result->fallbacks = counter(&espnow_sink_fallback);
+}
+
+static void bench_delivery(void)
+{
+    static const double losses[] = {0.0, 0.1, 0.3, 0.5, 0.7};
+
+    printf("BENCH %d sensor frames of %d bytes every %lld s, sink advertised every %d ms, %d nodes around, "
+           "%d MAC tries per unicast\n",
+           SIM_FRAMES, SIM_PAYLOAD_LEN, SIM_FRAME_PERIOD_US / 1000000, CONFIG_APP_ESPNOW_SINK_ADV_INTERVAL_MS,
+           SIM_BYSTANDERS, SIM_MAC_TRIES);
+    printf("BENCH   loss  broadcast: delivered  ms/frame  parsed around | unicast: delivered  ms/frame  parsed around  tries  fallbacks\n");
+    for (size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); i++)
+    {
+        sim_result_t legacy, unicast;
+        sim_run(losses[i], true, &legacy);
+        sim_run(losses[i], false, &unicast);
+        printf("BENCH   %3.0f%%  %19.1f%%  %8.2f  %13.1f | %18.1f%%  %8.2f  %13.1f  %5.2f  %9u\n", losses[i] * 100,
+               legacy.delivery * 100, legacy.medium_ms, legacy.bystander_rx, unicast.delivery * 100, unicast.medium_ms,
+               unicast.bystander_rx, unicast.tries, (unsigned)unicast.fallbacks);
+
+        /*
+         * Unicast delivers at least as much, beyond light loss more, and wakes the nodes around only
+         * for the fallback broadcasts. It pays for it in retries on a bad link.
+         */
+        TEST_ASSERT(unicast.delivery >= legacy.delivery - 0.005);
+        TEST_ASSERT(losses[i] < 0.3 || unicast.delivery > legacy.delivery + 0.02);
+        TEST_ASSERT(unicast.bystander_rx < legacy.bystander_rx);
+    }
+}
+
+int main(void)
+{
+    TEST_ASSERT(app_espnow_init() == ESP_OK);
+
+    RUN_TEST(test_no_sink);
+    RUN_TEST(test_acked);
+    RUN_TEST(test_fallback);
+    RUN_TEST(test_late_callback);
+    RUN_TEST(bench_delivery);
+    return host_test_result();
+}
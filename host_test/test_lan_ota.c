@@ -0,0 +1,862 @@
+/*
+ * esp_mesh_lite_ota resumable LAN OTA: a transfer cut by a reboot keeps the chunks saved in the
+ * bitmap and writes the rest, never on unerased flash, and only for the image with the same first
+ * chunk; a node still downloading serves the chunks it holds and refuses the others; a finished
+ * update is served until the reboot, never the running image under another version; progress
+ * reports are throttled and aggregated on the root. Then the time to update a fleet of 121 nodes
+ * down to level 5, with the real callbacks of every node, cut through against store and forward,
+ * and with a level 2 node rebooting halfway.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+/* In newlib, glibc only has it from 2.38 */
+static size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size)
+    {
+        size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+#endif
+
+/* The session, the pending update and the progress table are static, the test swaps them per node */
+#include "../components/mesh_lite/src/esp_mesh_lite_ota.c"
+
+#define IMAGE_SIZE (1024 * 1024)            /* A multiple of 64 KB, as the core rounds the file size up to */
+#define CHUNK_NUM ((IMAGE_SIZE + OTA_DATA_LEN - 1) / OTA_DATA_LEN)
+#define WINDOW_CHUNKS (OTA_WND_DEFAULT / OTA_DATA_LEN)
+#define SIM_FANOUT 3
+#define SIM_NODES 121                       /* Levels 1 to 5: 1 + 3 + 9 + 27 + 81 */
+#define SIM_HOP_KBPS 2000                   /* Application throughput of a parent to child link, assumed */
+#define SIM_CHUNK_OVERHEAD 60               /* Headers of a chunk on the air */
+#define SIM_WINDOW_RTT_US 5000              /* From the request of a window to its first chunk, assumed */
+#define SIM_RETRY_US 100000                 /* The core asks again after ESP_ERR_NOT_FINISHED or a lost parent, assumed */
+#define SIM_ERASE_US 30000                  /* Erase of a 4 KB sector, assumed */
+#define SIM_WRITE_US 2000                   /* Write of a chunk, assumed */
+#define SIM_REBOOT_US 8000000               /* Reboot and rejoin of the mesh */
+#define SIM_REBOOT_NODE 1                   /* On level 2, a third of the fleet below it */
+#define SIM_TIMEOUT_US (3600 * 1000000LL)
+
+#define NEW_VERSION "2.0"
+#define OLD_VERSION "1.0"
+
+enum
+{
+    EV_NONE,
+    EV_REQUEST,                             /* The core of the node asks its parent for the next chunk */
+    EV_DELIVER,                             /* The chunk is in, get_file_cb */
+};
+
+typedef struct
+{
+    esp_partition_t part;                   /* First, the module only sees this */
+    uint8_t *data;
+} host_partition_t;
+
+typedef struct
+{
+    int parent;                             /* -1 for the root */
+    uint8_t level;
+    uint8_t mac[6];
+    host_partition_t update;
+    const esp_partition_t *boot;
+    /* The statics of esp_mesh_lite_ota.c while another node runs */
+    ota_session_t *session;
+    ota_resume_info_t pending_info;
+    const esp_partition_t *pending_partition;
+    uint8_t reported_percentage;
+    /* NVS of the node */
+    bool nvs_info_set;
+    ota_resume_info_t nvs_info;
+    size_t nvs_bitmap_len;
+    uint8_t nvs_bitmap[(CHUNK_NUM + 7) / 8];
+    /* Download */
+    int event;
+    int64_t event_us;
+    uint32_t chunk;                         /* Next chunk to ask for */
+    int64_t radio_free_us;
+    int64_t online_us;                      /* Rebooting until then */
+    int64_t done_us;
+    uint32_t writes;
+    uint32_t erases;
+    int64_t flash_us;                       /* Spent by the last callback */
+} sim_node_t;
+
+static uint8_t image[IMAGE_SIZE];
+static uint8_t old_image[IMAGE_SIZE];
+static host_partition_t root_running = {.part = {.address = 0x10000, .size = IMAGE_SIZE, .label = "ota_0"}, .data = image};
+static host_partition_t node_running = {.part = {.address = 0x10000, .size = IMAGE_SIZE, .label = "ota_0"}, .data = old_image};
+static sim_node_t sim_nodes[SIM_NODES];
+static int sim_num;
+static int cur;                             /* Node whose code is running */
+static int64_t now_us = 1000000;
+static int64_t air_free_us;                 /* With one medium for the whole mesh */
+static bool shared_air;
+static bool store_and_forward;
+static uint32_t reports;
+static uint32_t report_bytes;
+
+static esp_mesh_lite_lan_ota_file_transfer_cb_t *ota_cb;
+static const esp_mesh_lite_raw_msg_action_t *raw_actions;
+static esp_event_handler_t ota_event_handler;
+const char *ESP_MESH_LITE_EVENT = "ESP_MESH_LITE_EVENT";
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+uint8_t esp_mesh_lite_get_level(void)
+{
+    return sim_nodes[cur].level;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    memcpy(mac, sim_nodes[cur].mac, 6);
+    return ESP_OK;
+}
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    static esp_app_desc_t root_desc = {.version = NEW_VERSION};
+    static esp_app_desc_t node_desc = {.version = OLD_VERSION};
+    return cur == 0 ? &root_desc : &node_desc;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    const host_partition_t *p = (const host_partition_t *)partition;
+    if (src_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, p->data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    host_partition_t *p = (host_partition_t *)partition;
+    TEST_ASSERT(offset % OTA_FLASH_SECTOR_SIZE == 0 && size % OTA_FLASH_SECTOR_SIZE == 0 && offset + size <= partition->size);
+    memset(p->data + offset, 0xff, size);
+    sim_nodes[cur].erases += size / OTA_FLASH_SECTOR_SIZE;
+    sim_nodes[cur].flash_us += SIM_ERASE_US * (int64_t)(size / OTA_FLASH_SECTOR_SIZE);
+    return ESP_OK;
+}
+
+/* NOR flash: a write only clears bits, writing on data that was not erased corrupts it */
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    host_partition_t *p = (host_partition_t *)partition;
+    const uint8_t *data = src;
+    TEST_ASSERT(dst_offset + size <= partition->size);
+    for (size_t i = 0; i < size; i++)
+    {
+        TEST_ASSERT((p->data[dst_offset + i] & data[i]) == data[i]);
+        p->data[dst_offset + i] &= data[i];
+    }
+    sim_nodes[cur].writes++;
+    sim_nodes[cur].flash_us += SIM_WRITE_US;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return cur == 0 ? &root_running.part : &node_running.part;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &sim_nodes[cur].update.part;
+}
+
+/* Validates the image like the bootloader would */
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    const host_partition_t *p = (const host_partition_t *)partition;
+    if (memcmp(p->data, image, IMAGE_SIZE))
+    {
+        return ESP_FAIL;
+    }
+    sim_nodes[cur].boot = partition;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    TEST_ASSERT(!strcmp(namespace_name, OTA_NVS_NAMESPACE));
+    *out_handle = cur + 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    sim_node_t *node = &sim_nodes[handle - 1];
+    if (!strcmp(key, OTA_NVS_KEY_INFO) && node->nvs_info_set)
+    {
+        *length = MIN(*length, sizeof(node->nvs_info));
+        memcpy(out_value, &node->nvs_info, *length);
+        return ESP_OK;
+    }
+    if (!strcmp(key, OTA_NVS_KEY_BITMAP) && node->nvs_bitmap_len)
+    {
+        *length = MIN(*length, node->nvs_bitmap_len);
+        memcpy(out_value, node->nvs_bitmap, *length);
+        return ESP_OK;
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    sim_node_t *node = &sim_nodes[handle - 1];
+    if (!strcmp(key, OTA_NVS_KEY_INFO))
+    {
+        TEST_ASSERT(length == sizeof(node->nvs_info));
+        memcpy(&node->nvs_info, value, sizeof(node->nvs_info));
+        node->nvs_info_set = true;
+    }
+    else
+    {
+        TEST_ASSERT(!strcmp(key, OTA_NVS_KEY_BITMAP) && length <= sizeof(node->nvs_bitmap));
+        memcpy(node->nvs_bitmap, value, length);
+        node->nvs_bitmap_len = length;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    sim_node_t *node = &sim_nodes[handle - 1];
+    if (!strcmp(key, OTA_NVS_KEY_INFO))
+    {
+        node->nvs_info_set = false;
+    }
+    else if (!strcmp(key, OTA_NVS_KEY_BITMAP))
+    {
+        node->nvs_bitmap_len = 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+void esp_mesh_lite_ota_register_file_transfer_cb(esp_mesh_lite_lan_ota_file_transfer_cb_t *cb)
+{
+    ota_cb = cb;
+}
+
+esp_err_t esp_mesh_lite_raw_msg_action_list_register(const esp_mesh_lite_raw_msg_action_t *msg_action)
+{
+    raw_actions = msg_action;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    ota_event_handler = event_handler;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_send_raw_msg_to_root(const uint8_t *data, size_t size)
+{
+    return ESP_OK;
+}
+
+/* A fixed layout stands in for the wire format, the reports are only counted */
+void mesh_lite__ota_progress__init(MeshLite__OtaProgress *message)
+{
+    memset(message, 0, sizeof(*message));
+}
+
+size_t mesh_lite__ota_progress__get_packed_size(const MeshLite__OtaProgress *message)
+{
+    return 6 + 4;
+}
+
+size_t mesh_lite__ota_progress__pack(const MeshLite__OtaProgress *message, uint8_t *out)
+{
+    memcpy(out, message->node_mac.data, 6);
+    out[6] = message->node_level;
+    out[7] = message->percentage;
+    out[8] = message->state;
+    out[9] = message->reason;
+    return 6 + 4;
+}
+
+MeshLite__OtaProgress *mesh_lite__ota_progress__unpack(ProtobufCAllocator *allocator, size_t len, const uint8_t *data)
+{
+    if (len != 6 + 4)
+    {
+        return NULL;
+    }
+    MeshLite__OtaProgress *message = calloc(1, sizeof(*message) + 6);
+    message->node_mac.len = 6;
+    message->node_mac.data = (uint8_t *)(message + 1);
+    memcpy(message->node_mac.data, data, 6);
+    message->node_level = data[6];
+    message->percentage = data[7];
+    message->state = data[8];
+    message->reason = data[9];
+    return message;
+}
+
+void mesh_lite__ota_progress__free_unpacked(MeshLite__OtaProgress *message, ProtobufCAllocator *allocator)
+{
+    free(message);
+}
+
+/* Reports reach the root right away, its handler runs as the root */
+esp_err_t esp_mesh_lite_send_msg(esp_mesh_lite_msg_data_t type, esp_mesh_lite_msg_config_t *conf)
+{
+    uint8_t *out_data = NULL;
+    uint32_t out_len;
+    int self = cur;
+
+    TEST_ASSERT(type == ESP_MESH_LITE_RAW_MSG && conf->raw_msg.msg_id == raw_actions[0].msg_id);
+    reports++;
+    report_bytes += conf->raw_msg.size;
+    cur = 0;
+    TEST_ASSERT(raw_actions[0].raw_process((uint8_t *)conf->raw_msg.data, conf->raw_msg.size, &out_data, &out_len, 0) == ESP_OK);
+    cur = self;
+    return ESP_OK;
+}
+
+/* Makes another node the one running, with its statics */
+static void node_switch(int id)
+{
+    sim_node_t *node = &sim_nodes[cur];
+    node->session = ota_session;
+    node->pending_info = pending_info;
+    node->pending_partition = pending_partition;
+    node->reported_percentage = reported_percentage;
+
+    cur = id;
+    node = &sim_nodes[id];
+    ota_session = node->session;
+    pending_info = node->pending_info;
+    pending_partition = node->pending_partition;
+    reported_percentage = node->reported_percentage;
+}
+
+static void node_event(int32_t event_id, void *event_data)
+{
+    ota_event_handler(NULL, ESP_MESH_LITE_EVENT, event_id, event_data);
+}
+
+/* Power loss: RAM is gone, flash and NVS stay */
+static void node_reboot(int id)
+{
+    int self = cur;
+    node_switch(id);
+    ota_session_free();
+    pending_partition = NULL;
+    reported_percentage = 0;
+    node_switch(self);
+}
+
+static void mesh_build(int num)
+{
+    node_switch(cur);                       // The statics of the running node back in its entry
+    for (int i = 0; i < sim_num; i++)
+    {
+        free(sim_nodes[i].update.data);
+        free(sim_nodes[i].session);
+    }
+    memset(sim_nodes, 0, sizeof(sim_nodes));
+    ota_session = NULL;
+    pending_partition = NULL;
+    reported_percentage = 0;
+    cur = 0;
+    sim_num = num;
+    for (int i = 0; i < num; i++)
+    {
+        sim_node_t *node = &sim_nodes[i];
+        node->parent = i ? (i - 1) / SIM_FANOUT : -1;
+        node->level = i ? sim_nodes[node->parent].level + 1 : ROOT;
+        node->mac[0] = 0x24;
+        node->mac[1] = 0x0a;
+        node->mac[2] = 0xc4;
+        node->mac[4] = i >> 8;
+        node->mac[5] = i & 0xff;
+        node->update = (host_partition_t) {.part = {.address = 0x110000, .size = IMAGE_SIZE, .label = "ota_1"}};
+        node->update.data = malloc(IMAGE_SIZE);
+        memset(node->update.data, 0xa5, IMAGE_SIZE);  // The previous update, not erased
+    }
+    esp_mesh_lite_ota_clear_progress();
+}
+
+static esp_mesh_lite_lan_ota_file_transfer_param_t chunk_param(uint32_t chunk, const char *version, char *data)
+{
+    size_t offset = chunk * OTA_DATA_LEN;
+    return (esp_mesh_lite_lan_ota_file_transfer_param_t) {
+        .fw_version = (char *)version,
+        .filesize = IMAGE_SIZE,
+        .offset = offset,
+        .data = data,
+        .data_size = MIN(OTA_DATA_LEN, IMAGE_SIZE - offset),
+    };
+}
+
+/* Node id gets a chunk straight from the image, as from a parent that has it */
+static esp_err_t node_receive(int id, uint32_t chunk)
+{
+    node_switch(id);
+    esp_mesh_lite_lan_ota_file_transfer_param_t param = chunk_param(chunk, NEW_VERSION, (char *)image + chunk * OTA_DATA_LEN);
+    return ota_cb->get_file_cb(&param);
+}
+
+static esp_err_t node_provide(int id, uint32_t chunk, const char *version, char *data)
+{
+    node_switch(id);
+    esp_mesh_lite_lan_ota_file_transfer_param_t param = chunk_param(chunk, version, data);
+    return ota_cb->provide_file_cb(&param);
+}
+
+static void test_resume(void)
+{
+    mesh_build(2);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    TEST_ASSERT(sim_nodes[1].writes == 100);
+
+    // The bitmap was saved every OTA_BITMAP_SAVE_INTERVAL chunks, the last 4 are written again
+    node_reboot(1);
+    sim_nodes[1].writes = 0;
+    sim_nodes[1].erases = 0;
+    for (uint32_t i = 0; i < CHUNK_NUM; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    uint32_t saved = 100 / OTA_BITMAP_SAVE_INTERVAL * OTA_BITMAP_SAVE_INTERVAL;
+    TEST_ASSERT(sim_nodes[1].writes == CHUNK_NUM - saved);
+    TEST_ASSERT(sim_nodes[1].erases == IMAGE_SIZE / OTA_FLASH_SECTOR_SIZE - ((saved * OTA_DATA_LEN - 1) / OTA_FLASH_SECTOR_SIZE + 1));
+    TEST_ASSERT(ota_cb->get_file_done() == ESP_OK);
+    TEST_ASSERT(sim_nodes[1].boot == &sim_nodes[1].update.part && !sim_nodes[1].nvs_info_set);
+
+    // Another image does not reuse the bitmap
+    mesh_build(2);
+    for (uint32_t i = 0; i < 64; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    node_reboot(1);
+    sim_nodes[1].writes = 0;
+    sim_nodes[1].erases = 0;
+    node_switch(1);
+    char data[OTA_DATA_LEN];
+    esp_mesh_lite_lan_ota_file_transfer_param_t param = chunk_param(0, "3.0", data);
+    memset(data, 0, sizeof(data));
+    TEST_ASSERT(ota_cb->get_file_cb(&param) == ESP_OK);
+    TEST_ASSERT(sim_nodes[1].writes == 1 && sim_nodes[1].erases == 1);
+
+    // Nor another build under the same version and size, told apart by its first chunk
+    mesh_build(2);
+    for (uint32_t i = 0; i < 64; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    node_reboot(1);
+    sim_nodes[1].writes = 0;
+    sim_nodes[1].erases = 0;
+    node_switch(1);
+    param = chunk_param(0, NEW_VERSION, data);
+    memcpy(data, image, OTA_DATA_LEN);
+    data[OTA_DATA_LEN / 2] ^= 0x01;
+    TEST_ASSERT(ota_cb->get_file_cb(&param) == ESP_OK);
+    TEST_ASSERT(node_receive(1, 1) == ESP_OK);
+    TEST_ASSERT(sim_nodes[1].writes == 2 && sim_nodes[1].erases == 1);
+
+    // A new build sent while the session is open starts it over
+    TEST_ASSERT(node_receive(1, 0) == ESP_OK && node_receive(1, 1) == ESP_OK);
+    TEST_ASSERT(sim_nodes[1].writes == 4 && ota_session->chunk_received == 2);
+
+    // Nor a transfer picked up again on a later chunk, which cannot tell the build
+    node_reboot(1);
+    sim_nodes[1].writes = 0;
+    TEST_ASSERT(node_receive(1, 1) == ESP_OK && sim_nodes[1].writes == 1 && ota_session->chunk_received == 1);
+
+    // Until its first chunk comes by, from then on the bitmap is resumed
+    TEST_ASSERT(node_receive(1, 0) == ESP_OK);
+    for (uint32_t i = 2; i < 40; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    node_reboot(1);
+    sim_nodes[1].writes = 0;
+    for (uint32_t i = 0; i < 40; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    TEST_ASSERT(sim_nodes[1].writes == 40 - OTA_BITMAP_SAVE_INTERVAL);
+}
+
+static void test_cut_through(void)
+{
+    char data[2 * OTA_DATA_LEN];
+
+    mesh_build(3);
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+
+    // Chunks on flash are served, the others are not there yet
+    TEST_ASSERT(node_provide(1, 5, NEW_VERSION, data) == ESP_OK && !memcmp(data, image + 5 * OTA_DATA_LEN, OTA_DATA_LEN));
+    TEST_ASSERT(node_provide(1, 10, NEW_VERSION, data) == ESP_ERR_NOT_FINISHED);
+    node_switch(1);
+    esp_mesh_lite_lan_ota_file_transfer_param_t param = chunk_param(9, NEW_VERSION, data);
+    param.data_size = 2 * OTA_DATA_LEN;
+    TEST_ASSERT(ota_cb->provide_file_cb(&param) == ESP_ERR_NOT_FINISHED);
+
+    // Neither the old image under the new version, nor a version it does not have
+    TEST_ASSERT(node_provide(2, 0, NEW_VERSION, data) == ESP_ERR_NOT_FOUND);
+    TEST_ASSERT(node_provide(1, 0, "3.0", data) == ESP_ERR_NOT_FOUND);
+    TEST_ASSERT(node_provide(1, 0, OLD_VERSION, data) == ESP_OK && !memcmp(data, old_image, OTA_DATA_LEN));
+    TEST_ASSERT(node_provide(0, 0, NEW_VERSION, data) == ESP_OK && !memcmp(data, image, OTA_DATA_LEN));
+}
+
+static void test_serve_pending(void)
+{
+    char data[OTA_DATA_LEN];
+
+    mesh_build(2);
+    for (uint32_t i = 0; i < CHUNK_NUM; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    TEST_ASSERT(ota_cb->get_file_done() == ESP_OK && !ota_session);
+
+    // Until the reboot the update partition is served under the new version
+    uint32_t last = CHUNK_NUM - 1;
+    TEST_ASSERT(node_provide(1, last, NEW_VERSION, data) == ESP_OK
+                && !memcmp(data, image + last * OTA_DATA_LEN, IMAGE_SIZE - last * OTA_DATA_LEN));
+    TEST_ASSERT(node_provide(1, 0, OLD_VERSION, data) == ESP_OK && !memcmp(data, old_image, OTA_DATA_LEN));
+
+    // A new transfer overwrites the update partition, it is no longer served
+    node_switch(1);
+    esp_mesh_lite_lan_ota_file_transfer_param_t param = chunk_param(0, "3.0", data);
+    memset(data, 0, sizeof(data));
+    TEST_ASSERT(ota_cb->get_file_cb(&param) == ESP_OK);
+    TEST_ASSERT(node_provide(1, last, NEW_VERSION, data) == ESP_ERR_NOT_FOUND);
+}
+
+static void test_progress(void)
+{
+    mesh_build(5);
+    reports = 0;
+    for (int id = 1; id < 5; id++)
+    {
+        node_switch(id);
+        node_event(ESP_MESH_LITE_EVENT_OTA_START, NULL);
+        for (int percentage = 1; percentage <= 100; percentage++)
+        {
+            esp_mesh_lite_event_ota_progress_t event = {.percentage = percentage};
+            node_event(ESP_MESH_LITE_EVENT_OTA_PROGRESS, &event);
+        }
+        esp_mesh_lite_event_ota_finish_t finish = {.reason = id == 4 ? ESP_MESH_LITE_EVENT_OTA_CHECKSUM_ERR : ESP_MESH_LITE_EVENT_OTA_SUCCESS};
+        node_event(ESP_MESH_LITE_EVENT_OTA_FINISH, &finish);
+    }
+    // The start, every 5 %, and the end
+    TEST_ASSERT(reports == 4 * (1 + 100 / OTA_PROGRESS_REPORT_STEP + 1));
+
+    esp_mesh_lite_ota_progress_t list[8];
+    TEST_ASSERT(esp_mesh_lite_ota_get_progress(list, 8) == 4);
+    for (int i = 0; i < 4; i++)
+    {
+        TEST_ASSERT(list[i].mac_addr[5] == i + 1 && list[i].level == sim_nodes[i + 1].level);
+        TEST_ASSERT(i == 3 ? list[i].state == ESP_MESH_LITE_OTA_STATE_FAIL && list[i].percentage == 100
+                    : list[i].state == ESP_MESH_LITE_OTA_STATE_SUCCESS && list[i].percentage == 100);
+    }
+
+    // A checksum error drops the saved bitmap
+    mesh_build(2);
+    for (uint32_t i = 0; i < 40; i++)
+    {
+        TEST_ASSERT(node_receive(1, i) == ESP_OK);
+    }
+    TEST_ASSERT(sim_nodes[1].nvs_bitmap_len);
+    esp_mesh_lite_event_ota_finish_t finish = {.reason = ESP_MESH_LITE_EVENT_OTA_CHECKSUM_ERR};
+    node_event(ESP_MESH_LITE_EVENT_OTA_FINISH, &finish);
+    TEST_ASSERT(!sim_nodes[1].nvs_info_set && !sim_nodes[1].nvs_bitmap_len && !ota_session);
+}
+
+static int64_t chunk_air_us(uint32_t chunk)
+{
+    size_t size = MIN(OTA_DATA_LEN, IMAGE_SIZE - chunk * OTA_DATA_LEN);
+    return (int64_t)(size + SIM_CHUNK_OVERHEAD) * 8 * 1000 / SIM_HOP_KBPS;
+}
+
+static int64_t max64(int64_t a, int64_t b)
+{
+    return a > b ? a : b;
+}
+
+/*
+ * The core of node id asks its parent for the next chunk. The parent answers with its real
+ * provide_file_cb, the chunk takes the radios of both, or the one medium, for its airtime.
+ */
+static void sim_request(int id)
+{
+    static char data[OTA_DATA_LEN];
+    sim_node_t *node = &sim_nodes[id];
+    sim_node_t *parent = &sim_nodes[node->parent];
+
+    if (now_us < parent->online_us)
+    {
+        node->event_us = now_us + SIM_RETRY_US;
+        return;
+    }
+    // A parent back from a reboot has no session until it gets its first chunk again
+    esp_err_t ret = node_provide(node->parent, node->chunk, NEW_VERSION, data);
+    if (ret == ESP_ERR_NOT_FINISHED || ret == ESP_ERR_NOT_FOUND)
+    {
+        node->event_us = now_us + SIM_RETRY_US;
+        return;
+    }
+    TEST_ASSERT(ret == ESP_OK);
+
+    int64_t start_us = max64(max64(now_us, node->radio_free_us), parent->radio_free_us);
+    if (shared_air)
+    {
+        start_us = max64(start_us, air_free_us);
+    }
+    if (node->chunk % WINDOW_CHUNKS == 0)
+    {
+        start_us += SIM_WINDOW_RTT_US;
+    }
+    int64_t end_us = start_us + chunk_air_us(node->chunk);
+    node->radio_free_us = parent->radio_free_us = end_us;
+    if (shared_air)
+    {
+        air_free_us = end_us;
+    }
+    node->event = EV_DELIVER;
+    node->event_us = end_us;
+}
+
+static void sim_deliver(int id)
+{
+    sim_node_t *node = &sim_nodes[id];
+
+    node_switch(id);
+    node->flash_us = 0;
+    esp_mesh_lite_lan_ota_file_transfer_param_t param = chunk_param(node->chunk, NEW_VERSION, (char *)image + node->chunk * OTA_DATA_LEN);
+    TEST_ASSERT(ota_cb->get_file_cb(&param) == ESP_OK);
+    node->chunk++;
+    esp_mesh_lite_event_ota_progress_t progress = {.percentage = node->chunk * 100 / CHUNK_NUM};
+    node_event(ESP_MESH_LITE_EVENT_OTA_PROGRESS, &progress);
+
+    if (node->chunk < CHUNK_NUM)
+    {
+        node->event = EV_REQUEST;
+        node->event_us = now_us + node->flash_us;
+        return;
+    }
+
+    TEST_ASSERT(ota_cb->get_file_done() == ESP_OK);
+    esp_mesh_lite_event_ota_finish_t finish = {.reason = ESP_MESH_LITE_EVENT_OTA_SUCCESS};
+    node_event(ESP_MESH_LITE_EVENT_OTA_FINISH, &finish);
+    node->event = EV_NONE;
+    node->done_us = now_us + node->flash_us;
+    for (int i = 1; store_and_forward && i < sim_num; i++)
+    {
+        if (sim_nodes[i].parent == id)
+        {
+            sim_nodes[i].event = EV_REQUEST;
+            sim_nodes[i].event_us = node->done_us;
+        }
+    }
+}
+
+typedef struct
+{
+    double done_s;
+    double median_s;
+    double level_s[CONFIG_MESH_LITE_MAXIMUM_LEVEL_ALLOWED + 1];
+    uint32_t writes;
+    uint32_t erases;
+} sim_result_t;
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* The root starts the update, every node downloads from its parent. reboot_at: chunk of SIM_REBOOT_NODE to reboot at, or 0 */
+static void sim_run(uint32_t reboot_at, bool resumable, sim_result_t *result)
+{
+    static int64_t took_us[SIM_NODES];
+    int64_t start_us = now_us;
+    bool rebooted = false;
+
+    mesh_build(SIM_NODES);
+    reports = 0;
+    report_bytes = 0;
+    air_free_us = now_us;
+    for (int i = 1; i < sim_num; i++)
+    {
+        node_switch(i);
+        node_event(ESP_MESH_LITE_EVENT_OTA_START, NULL);
+        sim_nodes[i].event = !store_and_forward || sim_nodes[i].parent == 0 ? EV_REQUEST : EV_NONE;
+        sim_nodes[i].event_us = now_us;
+    }
+
+    for (;;)
+    {
+        int next = -1;
+        for (int i = 1; i < sim_num; i++)
+        {
+            if (sim_nodes[i].event != EV_NONE && (next < 0 || sim_nodes[i].event_us < sim_nodes[next].event_us))
+            {
+                next = i;
+            }
+        }
+        if (next < 0 || sim_nodes[next].event_us > start_us + SIM_TIMEOUT_US)
+        {
+            break;
+        }
+        now_us = sim_nodes[next].event_us;
+        sim_node_t *node = &sim_nodes[next];
+
+        if (!rebooted && reboot_at && next == SIM_REBOOT_NODE && node->chunk == reboot_at)
+        {
+            // Down before the chunk is written, the core starts over from the first chunk after the rejoin
+            rebooted = true;
+            node_reboot(next);
+            if (!resumable)
+            {
+                node->nvs_info_set = false;
+                node->nvs_bitmap_len = 0;
+            }
+            node->online_us = now_us + SIM_REBOOT_US;
+            node->chunk = 0;
+            node->event = EV_REQUEST;
+            node->event_us = node->online_us;
+            continue;
+        }
+
+        if (node->event == EV_REQUEST)
+        {
+            sim_request(next);
+        }
+        else
+        {
+            sim_deliver(next);
+        }
+    }
+
+    memset(result, 0, sizeof(*result));
+    for (int i = 1; i < sim_num; i++)
+    {
+        sim_node_t *node = &sim_nodes[i];
+        TEST_ASSERT(node->done_us && node->boot == &node->update.part);
+        took_us[i - 1] = node->done_us - start_us;
+        result->done_s = max64(result->done_s * 1e6, took_us[i - 1]) / 1e6;
+        result->level_s[node->level] = max64(result->level_s[node->level] * 1e6, took_us[i - 1]) / 1e6;
+        result->writes += node->writes;
+        result->erases += node->erases;
+    }
+    qsort(took_us, sim_num - 1, sizeof(took_us[0]), compare_us);
+    result->median_s = took_us[(sim_num - 1) / 2] / 1e6;
+
+    // The root saw every node through to the end
+    esp_mesh_lite_ota_progress_t list[SIM_NODES];
+    TEST_ASSERT(esp_mesh_lite_ota_get_progress(list, SIM_NODES) == sim_num - 1);
+    for (int i = 0; i < sim_num - 1; i++)
+    {
+        TEST_ASSERT(list[i].state == ESP_MESH_LITE_OTA_STATE_SUCCESS && list[i].percentage == 100);
+    }
+    now_us = start_us + (int64_t)(result->done_s * 1e6) + 1000000;
+}
+
+static void sim_print(const char *name, const sim_result_t *result)
+{
+    printf("BENCH %-36s %d nodes to level %d, %d KB: all done in %6.1f s, median %6.1f s, level 2..5 done in",
+           name, SIM_NODES - 1, CONFIG_MESH_LITE_MAXIMUM_LEVEL_ALLOWED, IMAGE_SIZE / 1024, result->done_s, result->median_s);
+    for (int level = 2; level <= CONFIG_MESH_LITE_MAXIMUM_LEVEL_ALLOWED; level++)
+    {
+        printf(" %.1f", result->level_s[level]);
+    }
+    printf(" s, %u chunk writes, %u sector erases\n", (unsigned)result->writes, (unsigned)result->erases);
+}
+
+static void bench_fleet(void)
+{
+    sim_result_t forward, cut, forward_shared, cut_shared, resumed, restarted;
+
+    store_and_forward = true;
+    sim_run(0, true, &forward);
+    sim_print("store and forward, radio per link:", &forward);
+    store_and_forward = false;
+    sim_run(0, true, &cut);
+    sim_print("cut through, radio per link:", &cut);
+    TEST_ASSERT(cut.done_s < forward.done_s);
+
+    shared_air = true;
+    store_and_forward = true;
+    sim_run(0, true, &forward_shared);
+    sim_print("store and forward, one medium:", &forward_shared);
+    store_and_forward = false;
+    sim_run(0, true, &cut_shared);
+    sim_print("cut through, one medium:", &cut_shared);
+    shared_air = false;
+
+    // The level 2 node reboots halfway, its subtree waits for it
+    sim_run(CHUNK_NUM / 2, true, &resumed);
+    sim_print("cut through, reboot, resumed:", &resumed);
+    sim_run(CHUNK_NUM / 2, false, &restarted);
+    sim_print("cut through, reboot, not resumable:", &restarted);
+    TEST_ASSERT(resumed.done_s <= restarted.done_s && resumed.writes < restarted.writes);
+    printf("BENCH %u progress reports to the root, %.1f per node, %u bytes\n", (unsigned)reports,
+           (double)reports / (SIM_NODES - 1), (unsigned)report_bytes);
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < IMAGE_SIZE; i++)
+    {
+        image[i] = rng();
+        old_image[i] = rng();
+    }
+    TEST_ASSERT(esp_mesh_lite_ota_init() == ESP_OK && ota_cb && raw_actions && ota_event_handler);
+
+    RUN_TEST(test_resume);
+    RUN_TEST(test_cut_through);
+    RUN_TEST(test_serve_pending);
+    RUN_TEST(test_progress);
+    RUN_TEST(bench_fleet);
+    mesh_build(0);
+    return host_test_result();
+}
@@ -0,0 +1,181 @@
+/*
+ * link_table: averages settle on the samples, the neighbour heard from the longest ago is the one
+ * forgotten, and the cost of an update on the receive path.
+ */
+#include <string.h>
+#include "host_test.h"
+#include "link_table.h"
+#include "sdkconfig.h"
+
+static int64_t now_us = 1;
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+static void mac_make(uint8_t *mac, uint32_t n)
+{
+    // One OUI for the whole fleet, like the real nodes
+    const uint8_t mac_base[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0, 0, 0};
+    memcpy(mac, mac_base, ESP_NOW_ETH_ALEN);
+    mac[3] = n >> 16;
+    mac[4] = n >> 8;
+    mac[5] = n;
+}
+
+static void test_tx_success_settles(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    link_entry_t entry;
+
+    mac_make(mac, 1);
+    link_table_tx(mac, false);
+    TEST_ASSERT(link_table_get(mac, &entry) && entry.tx_success == 0);
+    for (int i = 0; i < 200; i++)
+    {
+        link_table_tx(mac, true);
+    }
+    TEST_ASSERT(link_table_get(mac, &entry) && entry.tx_success == 1000);
+    TEST_ASSERT(entry.tx_frames == 201 && entry.tx_acked == 200);
+
+    // Half the frames lost settles around half
+    for (int i = 0; i < 400; i++)
+    {
+        link_table_tx(mac, i & 1);
+    }
+    link_table_get(mac, &entry);
+    TEST_ASSERT(entry.tx_success >= 400 && entry.tx_success <= 600);
+
+    for (int i = 0; i < 200; i++)
+    {
+        link_table_tx(mac, false);
+    }
+    TEST_ASSERT(link_table_get(mac, &entry) && entry.tx_success == 0);
+}
+
+static void test_rssi_settles(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    link_entry_t entry;
+    wifi_pkt_rx_ctrl_t rx = {.rssi = -60, .rate = 11, .noise_floor = -95};
+
+    mac_make(mac, 2);
+    now_us += 1000;
+    link_table_rx(mac, &rx);
+    TEST_ASSERT(link_table_get(mac, &entry) && entry.rssi == -60 && entry.noise_floor == -95 && entry.rx_rate == 11);
+
+    rx.rssi = -71;
+    rx.noise_floor = -92;
+    for (int i = 0; i < 100; i++)
+    {
+        link_table_rx(mac, &rx);
+    }
+    TEST_ASSERT(link_table_get(mac, &entry) && entry.rssi == -71 && entry.noise_floor == -92);
+
+    rx.noise_floor = -96;
+    for (int i = 0; i < 100; i++)
+    {
+        link_table_rx(mac, &rx);
+    }
+    TEST_ASSERT(link_table_get(mac, &entry) && entry.noise_floor == -96);
+
+    for (int i = 0; i < 100; i++)
+    {
+        link_table_rssi(mac, -50);
+    }
+    TEST_ASSERT(link_table_get(mac, &entry) && entry.rssi == -50 && entry.rx_frames == 201);
+    TEST_ASSERT(entry.last_heard == now_us);
+}
+
+/* A neighbour heard all along survives a crowd of new ones, every lookup stays within its probes */
+static void test_eviction_keeps_recent(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t parent[ESP_NOW_ETH_ALEN];
+    link_entry_t entry;
+    static link_entry_t entries[CONFIG_APP_LINK_TABLE_SIZE];
+
+    mac_make(parent, 3);
+    for (uint32_t n = 100; n < 1100; n++)
+    {
+        now_us += 1000;
+        link_table_rssi(parent, -40);
+        now_us += 1000;
+        mac_make(mac, n);
+        link_table_rssi(mac, -80);
+        TEST_ASSERT(link_table_get(mac, &entry));
+    }
+    TEST_ASSERT(link_table_get(parent, &entry) && entry.rssi == -40);
+    TEST_ASSERT(link_table_list(entries, CONFIG_APP_LINK_TABLE_SIZE) <= CONFIG_APP_LINK_TABLE_SIZE);
+
+    mac_make(mac, 99);
+    TEST_ASSERT(!link_table_get(mac, &entry));
+}
+
+/* How many of N neighbours heard once each are still in the table, the probe sequence limits the fill */
+static void bench_occupancy(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    link_entry_t entry;
+
+    for (uint32_t num = 8; num <= CONFIG_APP_LINK_TABLE_SIZE; num *= 2)
+    {
+        size_t kept = 0;
+        for (uint32_t n = 0; n < num; n++)
+        {
+            now_us += 1000;
+            mac_make(mac, 0x10000 * num + n * 7919);
+            link_table_rssi(mac, -70);
+        }
+        for (uint32_t n = 0; n < num; n++)
+        {
+            mac_make(mac, 0x10000 * num + n * 7919);
+            kept += link_table_get(mac, &entry);
+        }
+        printf("BENCH %2u neighbours in %d slots: %zu kept\n", (unsigned)num, CONFIG_APP_LINK_TABLE_SIZE, kept);
+    }
+}
+
+static void bench_update_cost(void)
+{
+    uint8_t macs[64][ESP_NOW_ETH_ALEN];
+    wifi_pkt_rx_ctrl_t rx = {.rssi = -60, .rate = 11, .noise_floor = -95};
+
+    for (int i = 0; i < 64; i++)
+    {
+        mac_make(macs[i], 0x800000 + i);
+    }
+
+    // Hits: 16 neighbours that stay in the table
+    int64_t t0 = host_test_now_ns();
+    for (int i = 0; i < 1000000; i++)
+    {
+        link_table_rx(macs[i & 15], &rx);
+    }
+    int64_t t1 = host_test_now_ns();
+    // Misses: 64 neighbours cycling through 32 slots, every update evicts
+    for (int i = 0; i < 1000000; i++)
+    {
+        now_us++;
+        link_table_rx(macs[i & 63], &rx);
+    }
+    int64_t t2 = host_test_now_ns();
+    for (int i = 0; i < 1000000; i++)
+    {
+        link_table_tx(macs[i & 15], i & 1);
+    }
+    int64_t t3 = host_test_now_ns();
+    printf("BENCH link_table_rx %.1f ns (hit), %.1f ns (evict), link_table_tx %.1f ns, no allocation\n",
+           (t1 - t0) / 1e6, (t2 - t1) / 1e6, (t3 - t2) / 1e6);
+}
+
+int main(void)
+{
+    RUN_TEST(test_tx_success_settles);
+    RUN_TEST(test_rssi_settles);
+    RUN_TEST(test_eviction_keeps_recent);
+    bench_occupancy();
+    bench_update_cost();
+    return host_test_result();
+}
@@ -0,0 +1,379 @@
+/*
+ * metrics: registration, OpenMetrics rendering through the preallocated buffer checked line by
+ * line, flush and error handling, and the cost of an update and of a scrape of a full registry
+ * with a per-node collector, as on a root with 200 nodes.
+ */
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "metrics.h"
+
+#define BENCH_UPDATES 10000000
+#define BENCH_SCRAPES 2000
+#define BENCH_NODES 200
+
+int64_t esp_timer_get_time(void)
+{
+    return host_test_now_ns() / 1000;
+}
+
+static char scrape[256 * 1024];
+static size_t scrape_len;
+static int flushes;
+static int flushes_split;       /* Chunks that do not end on a line */
+static esp_err_t flush_ret = ESP_OK;
+
+static esp_err_t scrape_flush(void *ctx, const char *buf, size_t len)
+{
+    TEST_ASSERT(len > 0 && len <= CONFIG_METRICS_RENDER_BUF_SIZE);
+    if (flush_ret != ESP_OK)
+    {
+        return flush_ret;
+    }
+    TEST_ASSERT(scrape_len + len < sizeof(scrape));
+    memcpy(scrape + scrape_len, buf, len);
+    scrape_len += len;
+    scrape[scrape_len] = '\0';
+    flushes++;
+    flushes_split += buf[len - 1] != '\n';
+    return ESP_OK;
+}
+
+static esp_err_t do_scrape(void)
+{
+    scrape_len = 0;
+    scrape[0] = '\0';
+    flushes = 0;
+    flushes_split = 0;
+    return metrics_scrape(scrape_flush, NULL);
+}
+
+static bool is_name(const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!(isalpha((unsigned char)s[i]) || s[i] == '_' || s[i] == ':' || (i > 0 && isdigit((unsigned char)s[i]))))
+        {
+            return false;
+        }
+    }
+    return len > 0;
+}
+
+/*
+ * The subset of the OpenMetrics text format the exporter uses: every sample belongs to the family
+ * of the # TYPE before it, with the suffix its type allows, histogram buckets are cumulative and
+ * end with +Inf equal to _count, and the exposition ends with # EOF. Returns the number of samples.
+ */
+static int check_openmetrics(const char *text)
+{
+    char family[128] = "";
+    char type[16] = "";
+    char families[64][128];
+    int family_num = 0;
+    int samples = 0;
+    uint64_t bucket = 0;
+    bool bucket_inf = false;
+
+    TEST_ASSERT(strlen(text) >= 6 && !strcmp(text + strlen(text) - 6, "# EOF\n"));
+    for (const char *line = text; *line;)
+    {
+        const char *end = strchr(line, '\n');
+        TEST_ASSERT(end != NULL);
+        if (!end)
+        {
+            break;
+        }
+        size_t len = end - line;
+
+        if (!strncmp(line, "# EOF", 5))
+        {
+            TEST_ASSERT(end[1] == '\0');
+        }
+        else if (!strncmp(line, "# TYPE ", 7))
+        {
+            TEST_ASSERT(sscanf(line, "# TYPE %127s %15s", family, type) == 2);
+            TEST_ASSERT(is_name(family, strlen(family)));
+            TEST_ASSERT(!strcmp(type, "counter") || !strcmp(type, "gauge") || !strcmp(type, "histogram"));
+            for (int i = 0; i < family_num; i++)
+            {
+                TEST_ASSERT(strcmp(families[i], family) != 0);
+            }
+            if (family_num < 64)
+            {
+                strcpy(families[family_num++], family);
+            }
+            bucket = 0;
+            bucket_inf = false;
+        }
+        else if (!strncmp(line, "# HELP ", 7))
+        {
+            TEST_ASSERT(!strncmp(line + 7, family, strlen(family)) && line[7 + strlen(family)] == ' ');
+        }
+        else
+        {
+            /* name{labels} value */
+            size_t name_len = strcspn(line, "{ ");
+            const char *value = memchr(line, ' ', len);
+            TEST_ASSERT(family[0] && is_name(line, name_len) && value != NULL);
+            TEST_ASSERT(!strncmp(line, family, strlen(family)));
+            if (!value || strncmp(line, family, strlen(family)))
+            {
+                break;
+            }
+            const char *suffix = line + strlen(family);
+            size_t suffix_len = name_len - strlen(family);
+            char *num_end;
+            double v = strtod(value + 1, &num_end);
+            TEST_ASSERT(num_end == end);
+            if (line[name_len] == '{')
+            {
+                TEST_ASSERT(value[-1] == '}' && line[name_len + 1] != '}');
+            }
+
+            if (!strcmp(type, "counter"))
+            {
+                TEST_ASSERT(suffix_len == 6 && !strncmp(suffix, "_total", 6));
+            }
+            else if (!strcmp(type, "gauge"))
+            {
+                TEST_ASSERT(suffix_len == 0);
+            }
+            else if (suffix_len == 7 && !strncmp(suffix, "_bucket", 7))
+            {
+                TEST_ASSERT(!bucket_inf && v >= bucket);
+                bucket = v;
+                bucket_inf = value - line >= 10 && !strncmp(value - 10, "le=\"+Inf\"}", 10);
+            }
+            else if (suffix_len == 6 && !strncmp(suffix, "_count", 6))
+            {
+                TEST_ASSERT(bucket_inf && v == bucket);
+            }
+            else
+            {
+                TEST_ASSERT(suffix_len == 4 && !strncmp(suffix, "_sum", 4));
+            }
+            samples++;
+        }
+        line = end + 1;
+    }
+    return samples;
+}
+
+static uint64_t sample_value(const char *sample)
+{
+    const char *line = strstr(scrape, sample);
+    TEST_ASSERT(line != NULL);
+    return line ? strtoull(line + strlen(sample), NULL, 10) : 0;
+}
+
+static metrics_counter_t frames;
+static metrics_gauge_t depth;
+static metrics_gauge_t heap;
+static metrics_histogram_t latency;
+static const uint32_t latency_bounds[] = {5, 10, 20, 50, 100, 500};
+
+static int32_t read_heap(void *arg)
+{
+    return *(int32_t *)arg;
+}
+
+static void test_register(void)
+{
+    static const uint32_t unordered[] = {10, 5};
+    static const uint32_t too_many[METRICS_HISTOGRAM_MAX_BUCKETS + 1] = {0};
+    static metrics_histogram_t bad;
+    static int32_t heap_value = 123456;
+
+    /* Observed before it is registered, e.g. an early frame */
+    metrics_histogram_observe(&latency, 3);
+
+    TEST_ASSERT(metrics_counter_register(&frames, "espnow_rx_frames", "Received ESP-NOW frames") == ESP_OK);
+    TEST_ASSERT(metrics_counter_register(&frames, "espnow_rx_frames", "Received ESP-NOW frames") == ESP_OK);
+    TEST_ASSERT(metrics_gauge_register(&depth, "espnow_queue_depth", "Frames waiting", NULL, NULL) == ESP_OK);
+    TEST_ASSERT(metrics_gauge_register(&heap, "heap_free_bytes", "Free heap", read_heap, &heap_value) == ESP_OK);
+    TEST_ASSERT(metrics_histogram_register(&bad, "bad", NULL, unordered, 2) == ESP_ERR_INVALID_ARG);
+    TEST_ASSERT(metrics_histogram_register(&bad, "bad", NULL, too_many, METRICS_HISTOGRAM_MAX_BUCKETS + 1) == ESP_ERR_INVALID_ARG);
+    TEST_ASSERT(metrics_histogram_register(&latency, "espnow_ingest_push_us", "Push time", latency_bounds,
+                                           sizeof(latency_bounds) / sizeof(latency_bounds[0])) == ESP_OK);
+
+    metrics_counter_add(&frames, 41);
+    metrics_counter_inc(&frames);
+    metrics_gauge_set(&depth, 7);
+    metrics_gauge_add(&depth, -2);
+    metrics_histogram_observe(&latency, 5);
+    metrics_histogram_observe(&latency, 6);
+    metrics_histogram_observe(&latency, 1000);
+
+    TEST_ASSERT(do_scrape() == ESP_OK);
+    TEST_ASSERT(check_openmetrics(scrape) > 0);
+    TEST_ASSERT(sample_value("\nespnow_rx_frames_total ") == 42);
+    TEST_ASSERT(sample_value("\nespnow_queue_depth ") == 5);
+    TEST_ASSERT(sample_value("\nheap_free_bytes ") == 123456);
+    TEST_ASSERT(strstr(scrape, "# TYPE espnow_rx_frames counter\n# HELP espnow_rx_frames Received ESP-NOW frames\n"));
+    TEST_ASSERT(strstr(scrape, "\nbad") == NULL);
+
+    /* Bounds are upper bounds, the early observation is counted but in no finite bucket */
+    TEST_ASSERT(sample_value("espnow_ingest_push_us_bucket{le=\"5\"} ") == 1);
+    TEST_ASSERT(sample_value("espnow_ingest_push_us_bucket{le=\"10\"} ") == 2);
+    TEST_ASSERT(sample_value("espnow_ingest_push_us_bucket{le=\"500\"} ") == 2);
+    TEST_ASSERT(sample_value("espnow_ingest_push_us_bucket{le=\"+Inf\"} ") == 4);
+    TEST_ASSERT(sample_value("espnow_ingest_push_us_count ") == 4);
+    TEST_ASSERT(sample_value("espnow_ingest_push_us_sum ") == 1014);
+
+    /* The scrape reports its own size with the next one */
+    size_t len = scrape_len;
+    TEST_ASSERT(do_scrape() == ESP_OK);
+    TEST_ASSERT(sample_value("\nmetrics_scrape_bytes ") == len);
+}
+
+/* Per-node lines as the root's health collector writes them */
+static void collect_nodes(metrics_writer_t *writer, void *arg)
+{
+    int nodes = *(int *)arg;
+    metrics_printf(writer, "# TYPE mesh_node_rssi gauge\n# HELP mesh_node_rssi RSSI of the node to its parent\n");
+    for (int i = 0; i < nodes; i++)
+    {
+        metrics_printf(writer, "mesh_node_rssi{mac=\"24:0a:c4:00:%02x:%02x\",level=\"%d\"} %d\n", i >> 8, i & 0xff,
+                       1 + i % 5, -40 - i % 50);
+    }
+}
+
+static int collector_line_len;
+
+static void collect_long_line(metrics_writer_t *writer, void *arg)
+{
+    if (collector_line_len)
+    {
+        metrics_printf(writer, "# TYPE long gauge\nlong{x=\"%0*d\"} 1\n", collector_line_len, 0);
+    }
+}
+
+static void test_flush(void)
+{
+    static int nodes = BENCH_NODES;
+    TEST_ASSERT(metrics_collector_register(collect_nodes, &nodes) == ESP_OK);
+    TEST_ASSERT(metrics_collector_register(collect_long_line, NULL) == ESP_OK);
+
+    /* Lines are never split across chunks */
+    TEST_ASSERT(do_scrape() == ESP_OK);
+    TEST_ASSERT(flushes > 1 && flushes_split == 0);
+    TEST_ASSERT(check_openmetrics(scrape) > BENCH_NODES);
+
+    /* A line longer than the buffer ends the scrape with an error, the rest still fits */
+    collector_line_len = CONFIG_METRICS_RENDER_BUF_SIZE;
+    TEST_ASSERT(do_scrape() == ESP_ERR_NO_MEM);
+    TEST_ASSERT(strstr(scrape, "\nlong") == NULL && flushes_split == 0);
+    collector_line_len = CONFIG_METRICS_RENDER_BUF_SIZE - 32;
+    TEST_ASSERT(do_scrape() == ESP_OK);
+    TEST_ASSERT(strstr(scrape, "\nlong{") != NULL && check_openmetrics(scrape) > 0);
+    collector_line_len = 0;
+
+    /* A failed send stops the scrape at the first chunk */
+    flush_ret = ESP_FAIL;
+    TEST_ASSERT(do_scrape() == ESP_FAIL);
+    TEST_ASSERT(flushes == 0);
+    flush_ret = ESP_OK;
+}
+
+static volatile uint32_t sink;
+
+static void bench_updates(void)
+{
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_UPDATES; i++)
+    {
+        metrics_counter_inc(&frames);
+    }
+    double counter_ns = (double)(host_test_now_ns() - start) / BENCH_UPDATES;
+
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_UPDATES; i++)
+    {
+        metrics_histogram_observe(&latency, i & 511);
+    }
+    double histogram_ns = (double)(host_test_now_ns() - start) / BENCH_UPDATES;
+
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_UPDATES; i++)
+    {
+        metrics_gauge_set(&depth, i);
+    }
+    double gauge_ns = (double)(host_test_now_ns() - start) / BENCH_UPDATES;
+
+    /* What the updates would cost behind a mutex instead */
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    uint32_t locked = 0;
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_UPDATES; i++)
+    {
+        pthread_mutex_lock(&mutex);
+        locked++;
+        pthread_mutex_unlock(&mutex);
+    }
+    double mutex_ns = (double)(host_test_now_ns() - start) / BENCH_UPDATES;
+    sink = locked;
+
+    TEST_ASSERT(metrics_counter_get(&frames) == 42 + BENCH_UPDATES);
+    printf("BENCH counter inc %.1f ns, histogram observe (6 bounds) %.1f ns, gauge set %.1f ns, mutex counter %.1f ns\n",
+           counter_ns, histogram_ns, gauge_ns, mutex_ns);
+}
+
+static void bench_scrape(void)
+{
+    static metrics_counter_t counters[40];
+    static metrics_gauge_t gauges[10];
+    static metrics_histogram_t histograms[8];
+    static char names[58][32];
+    int n = 0;
+
+    /* Fill the registry up to CONFIG_METRICS_MAX_NUM, as a root with every module does */
+    for (int i = 0; i < 40; i++, n++)
+    {
+        snprintf(names[n], sizeof(names[n]), "bench_counter_%d", i);
+        metrics_counter_register(&counters[i], names[n], "Bench counter");
+        metrics_counter_add(&counters[i], i * 1000);
+    }
+    for (int i = 0; i < 10; i++, n++)
+    {
+        snprintf(names[n], sizeof(names[n]), "bench_gauge_%d", i);
+        metrics_gauge_register(&gauges[i], names[n], "Bench gauge", NULL, NULL);
+    }
+    int histogram_num = CONFIG_METRICS_MAX_NUM - 6 - 50;
+    for (int i = 0; i < histogram_num; i++, n++)
+    {
+        snprintf(names[n], sizeof(names[n]), "bench_histogram_%d", i);
+        metrics_histogram_register(&histograms[i], names[n], "Bench histogram", latency_bounds,
+                                   sizeof(latency_bounds) / sizeof(latency_bounds[0]));
+        metrics_histogram_observe(&histograms[i], i * 7);
+    }
+    static metrics_counter_t overflow;
+    TEST_ASSERT(metrics_counter_register(&overflow, "overflow", NULL) == ESP_ERR_NO_MEM);
+
+    TEST_ASSERT(do_scrape() == ESP_OK);
+    int samples = check_openmetrics(scrape);
+    TEST_ASSERT(strstr(scrape, "\noverflow") == NULL);
+
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_SCRAPES; i++)
+    {
+        do_scrape();
+    }
+    double us = (host_test_now_ns() - start) / 1e3 / BENCH_SCRAPES;
+    printf("BENCH scrape of %d metrics and %d node lines: %d samples, %u bytes in %d chunks, %.1f us\n",
+           CONFIG_METRICS_MAX_NUM, BENCH_NODES, samples, (unsigned)scrape_len, flushes, us);
+}
+
+int main(void)
+{
+    TEST_ASSERT(metrics_init() == ESP_OK);
+
+    RUN_TEST(test_register);
+    RUN_TEST(test_flush);
+    RUN_TEST(bench_updates);
+    RUN_TEST(bench_scrape);
+    return host_test_result();
+}
@@ -0,0 +1,446 @@
+/*
+ * esp_mesh_lite_node_events: the channel with its task running as a thread. Merging of the changes of
+ * one node, the window, early delivery of a full batch, the overflow flag, a subscriber replica of the
+ * node table that stays equal to the table, and the throughput at 500 node changes.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_test.h"
+#include "freertos/task.h"
+#include "esp_mesh_lite_node_events.h"
+
+#define SIM_MACS 200                        /* Nodes of the mesh, at most one batch */
+#define SIM_SPARE_MACS (SIM_MACS + 1)       /* Beyond them, to overflow a batch */
+#define WAIT_MS 2000
+
+/* Tasks are threads, notifications a counter under a mutex */
+typedef struct
+{
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notified;
+} host_task_t;
+
+static __thread host_task_t *task_self;
+
+static void *host_task_main(void *arg)
+{
+    task_self = arg;
+    task_self->fn(task_self->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task)
+{
+    host_task_t *t = calloc(1, sizeof(*t));
+    pthread_condattr_t attr;
+
+    t->fn = fn;
+    t->arg = arg;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&t->cond, &attr);
+    if (pthread_create(&t->thread, NULL, host_task_main, t))
+    {
+        free(t);
+        return pdFALSE;
+    }
+    *task = t;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    host_task_t *t = task;
+    pthread_mutex_lock(&t->lock);
+    t->notified++;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    host_task_t *t = task_self;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait / 1000;
+    deadline.tv_nsec += (long)(wait % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    while (t->notified == 0)
+    {
+        if (wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(&t->cond, &t->lock);
+        }
+        else if (pthread_cond_timedwait(&t->cond, &t->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    uint32_t value = t->notified;
+    if (value)
+    {
+        t->notified = clear ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return value;
+}
+
+uint32_t esp_mesh_lite_get_nodes_generation(void)
+{
+    return 0;
+}
+
+/* The node table as the poster sees it, and the replica the subscriber builds from the batches */
+typedef struct
+{
+    bool present;
+    esp_mesh_lite_node_info_t node;
+} sim_entry_t;
+
+static sim_entry_t truth[SIM_MACS + SIM_SPARE_MACS];
+static sim_entry_t replica[SIM_MACS + SIM_SPARE_MACS];
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static int batches;
+static int diffs;
+static int invalid;                 /* Diffs that do not apply to the replica */
+static int64_t delivered_ns;
+static esp_mesh_lite_node_diff_t last_diffs[CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE];
+static esp_mesh_lite_node_diff_batch_t last_batch;
+static bool gate_closed;
+static bool gate_waiting;
+
+static int mac_index(const uint8_t *mac)
+{
+    return mac[4] << 8 | mac[5];
+}
+
+static void replica_apply(const esp_mesh_lite_node_diff_t *diff)
+{
+    sim_entry_t *entry = &replica[mac_index(diff->node.mac_addr)];
+    switch (diff->type)
+    {
+    case ESP_MESH_LITE_NODE_DIFF_JOIN:
+        invalid += entry->present;
+        entry->present = true;
+        break;
+    case ESP_MESH_LITE_NODE_DIFF_LEAVE:
+        invalid += !entry->present;
+        entry->present = false;
+        break;
+    case ESP_MESH_LITE_NODE_DIFF_CHANGE:
+        invalid += !entry->present;
+        break;
+    }
+    entry->node = diff->node;
+}
+
+static void subscriber_cb(const esp_mesh_lite_node_diff_batch_t *batch, void *arg)
+{
+    pthread_mutex_lock(&log_lock);
+    for (size_t i = 0; i < batch->num; i++)
+    {
+        replica_apply(&batch->diffs[i]);
+    }
+    memcpy(last_diffs, batch->diffs, batch->num * sizeof(batch->diffs[0]));
+    last_batch = *batch;
+    batches++;
+    diffs += batch->num;
+    delivered_ns = host_test_now_ns();
+    pthread_cond_broadcast(&log_cond);
+    /* Holds the task in the callback, as a slow subscriber */
+    while (gate_closed)
+    {
+        gate_waiting = true;
+        pthread_cond_broadcast(&log_cond);
+        pthread_cond_wait(&log_cond, &log_lock);
+    }
+    gate_waiting = false;
+    pthread_mutex_unlock(&log_lock);
+}
+
+static int other_subscriber_batches;
+
+static void other_subscriber_cb(const esp_mesh_lite_node_diff_batch_t *batch, void *arg)
+{
+    other_subscriber_batches++;
+}
+
+/* Waits for the batch count to reach num, false on timeout */
+static bool wait_batches(int num)
+{
+    int64_t end_ns = host_test_now_ns() + WAIT_MS * 1000000LL;
+    bool reached;
+
+    pthread_mutex_lock(&log_lock);
+    while (batches < num && host_test_now_ns() < end_ns)
+    {
+        pthread_mutex_unlock(&log_lock);
+        usleep(1000);
+        pthread_mutex_lock(&log_lock);
+    }
+    reached = batches >= num;
+    pthread_mutex_unlock(&log_lock);
+    return reached;
+}
+
+/* Waits until a whole window passes without a delivery */
+static void wait_idle(void)
+{
+    int before;
+    do
+    {
+        pthread_mutex_lock(&log_lock);
+        before = batches;
+        pthread_mutex_unlock(&log_lock);
+        usleep((CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS + 100) * 1000);
+    } while (!wait_batches(before) || batches != before);
+}
+
+static void sim_post(esp_mesh_lite_node_diff_type_t type, int index, uint8_t level)
+{
+    sim_entry_t *entry = &truth[index];
+    entry->node.mac_addr[0] = 0x24;
+    entry->node.mac_addr[4] = index >> 8;
+    entry->node.mac_addr[5] = index;
+    entry->node.level = level;
+    entry->node.ip_addr = 0x0a000000 | index;
+    entry->present = (type != ESP_MESH_LITE_NODE_DIFF_LEAVE);
+    esp_mesh_lite_node_diff_post(type, &entry->node);
+}
+
+static int replica_mismatches(void)
+{
+    int mismatches = 0;
+    for (int i = 0; i < SIM_MACS + SIM_SPARE_MACS; i++)
+    {
+        mismatches += (truth[i].present != replica[i].present) ||
+                      (truth[i].present && memcmp(&truth[i].node, &replica[i].node, sizeof(truth[i].node)));
+    }
+    return mismatches;
+}
+
+static void test_subscribe(void)
+{
+    TEST_ASSERT(esp_mesh_lite_node_diff_subscribe(NULL, NULL) == ESP_ERR_INVALID_ARG);
+    TEST_ASSERT(esp_mesh_lite_node_events_init() == ESP_OK);
+    TEST_ASSERT(esp_mesh_lite_node_events_init() == ESP_OK);
+    TEST_ASSERT(esp_mesh_lite_node_diff_subscribe(subscriber_cb, NULL) == ESP_OK);
+    TEST_ASSERT(esp_mesh_lite_node_diff_subscribe(other_subscriber_cb, NULL) == ESP_OK);
+    for (int i = 2; i < CONFIG_MESH_LITE_NODE_EVENT_SUBSCRIBERS; i++)
+    {
+        TEST_ASSERT(esp_mesh_lite_node_diff_subscribe(other_subscriber_cb, NULL) == ESP_OK);
+    }
+    TEST_ASSERT(esp_mesh_lite_node_diff_subscribe(other_subscriber_cb, NULL) == ESP_ERR_NO_MEM);
+}
+
+static void test_merge(void)
+{
+    /* Node 0 and 3 are in the table already */
+    sim_post(ESP_MESH_LITE_NODE_DIFF_JOIN, 0, 2);
+    sim_post(ESP_MESH_LITE_NODE_DIFF_JOIN, 3, 2);
+    TEST_ASSERT(wait_batches(1));
+    wait_idle();
+
+    int before = batches;
+    sim_post(ESP_MESH_LITE_NODE_DIFF_JOIN, 1, 2);       /* Join, then a change: still a join */
+    sim_post(ESP_MESH_LITE_NODE_DIFF_CHANGE, 1, 3);
+    sim_post(ESP_MESH_LITE_NODE_DIFF_JOIN, 2, 2);       /* Join and leave: nothing */
+    sim_post(ESP_MESH_LITE_NODE_DIFF_LEAVE, 2, 2);
+    sim_post(ESP_MESH_LITE_NODE_DIFF_LEAVE, 3, 2);      /* Leave and back: a change */
+    sim_post(ESP_MESH_LITE_NODE_DIFF_JOIN, 3, 4);
+    sim_post(ESP_MESH_LITE_NODE_DIFF_LEAVE, 0, 2);      /* Change and leave: a leave */
+    TEST_ASSERT(wait_batches(before + 1));
+    wait_idle();
+
+    TEST_ASSERT(batches == before + 1);
+    TEST_ASSERT(last_batch.num == 3 && last_batch.posted == 7 && !last_batch.overflow);
+    for (size_t i = 0; i < last_batch.num; i++)
+    {
+        const esp_mesh_lite_node_diff_t *diff = &last_diffs[i];
+        switch (mac_index(diff->node.mac_addr))
+        {
+        case 0:
+            TEST_ASSERT(diff->type == ESP_MESH_LITE_NODE_DIFF_LEAVE);
+            break;
+        case 1:
+            TEST_ASSERT(diff->type == ESP_MESH_LITE_NODE_DIFF_JOIN && diff->node.level == 3);
+            break;
+        case 3:
+            TEST_ASSERT(diff->type == ESP_MESH_LITE_NODE_DIFF_CHANGE && diff->node.level == 4);
+            break;
+        default:
+            TEST_ASSERT(false);
+        }
+    }
+    TEST_ASSERT(other_subscriber_batches == batches * (CONFIG_MESH_LITE_NODE_EVENT_SUBSCRIBERS - 1));
+    TEST_ASSERT(invalid == 0 && replica_mismatches() == 0);
+}
+
+static void test_window(void)
+{
+    int before = batches;
+    int64_t start_ns = host_test_now_ns();
+
+    /* The second change falls into the window of the first */
+    sim_post(ESP_MESH_LITE_NODE_DIFF_CHANGE, 1, 2);
+    usleep(CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS / 2 * 1000);
+    sim_post(ESP_MESH_LITE_NODE_DIFF_CHANGE, 3, 2);
+    TEST_ASSERT(wait_batches(before + 1));
+    double latency_ms = (delivered_ns - start_ns) / 1e6;
+    wait_idle();
+
+    printf("BENCH window %d ms, first change delivered after %.1f ms\n", CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS,
+           latency_ms);
+    TEST_ASSERT(batches == before + 1 && last_batch.num == 2);
+    TEST_ASSERT(latency_ms >= CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS * 0.9);
+    TEST_ASSERT(latency_ms < CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS * 3);
+}
+
+static void test_full_batch(void)
+{
+    int before = batches;
+    int64_t start_ns = host_test_now_ns();
+
+    for (int i = 0; i < SIM_MACS; i++)
+    {
+        sim_post(truth[i].present ? ESP_MESH_LITE_NODE_DIFF_CHANGE : ESP_MESH_LITE_NODE_DIFF_JOIN, i, 3);
+    }
+    TEST_ASSERT(wait_batches(before + 1));
+    double latency_ms = (delivered_ns - start_ns) / 1e6;
+    wait_idle();
+
+    printf("BENCH full batch of %d delivered after %.1f ms\n", CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE, latency_ms);
+    TEST_ASSERT(batches == before + 1 && last_batch.num == CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE);
+    TEST_ASSERT(latency_ms < CONFIG_MESH_LITE_NODE_EVENT_WINDOW_MS / 2);
+    TEST_ASSERT(invalid == 0 && replica_mismatches() == 0);
+}
+
+static void test_overflow(void)
+{
+    int before = batches;
+
+    /* A slow subscriber holds the task while the other buffer fills up, and then one more node */
+    pthread_mutex_lock(&log_lock);
+    gate_closed = true;
+    pthread_mutex_unlock(&log_lock);
+    sim_post(ESP_MESH_LITE_NODE_DIFF_CHANGE, 0, 2);
+    pthread_mutex_lock(&log_lock);
+    while (!gate_waiting)
+    {
+        pthread_cond_wait(&log_cond, &log_lock);
+    }
+    pthread_mutex_unlock(&log_lock);
+
+    for (int i = 0; i < SIM_SPARE_MACS; i++)
+    {
+        sim_post(ESP_MESH_LITE_NODE_DIFF_JOIN, SIM_MACS + i, 2);
+    }
+    pthread_mutex_lock(&log_lock);
+    gate_closed = false;
+    pthread_cond_broadcast(&log_cond);
+    pthread_mutex_unlock(&log_lock);
+    TEST_ASSERT(wait_batches(before + 2));
+    wait_idle();
+
+    TEST_ASSERT(last_batch.overflow);
+    TEST_ASSERT(last_batch.num == CONFIG_MESH_LITE_NODE_EVENT_BATCH_SIZE && last_batch.posted == SIM_SPARE_MACS);
+
+    /* The node that did not fit is missing until the subscriber re-reads the table */
+    TEST_ASSERT(replica_mismatches() == 1);
+    memcpy(replica, truth, sizeof(replica));
+}
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* A valid change of a random node: join if it is gone, else mostly a level or IP change */
+static void sim_post_random(void)
+{
+    int index = rng() % SIM_MACS;
+    if (!truth[index].present)
+    {
+        sim_post(ESP_MESH_LITE_NODE_DIFF_JOIN, index, 2 + rng() % 4);
+    }
+    else if (rng() % 4 == 0)
+    {
+        sim_post(ESP_MESH_LITE_NODE_DIFF_LEAVE, index, truth[index].node.level);
+    }
+    else
+    {
+        sim_post(ESP_MESH_LITE_NODE_DIFF_CHANGE, index, 2 + rng() % 4);
+    }
+}
+
+static void bench_500_changes(void)
+{
+    int before = batches, diffs_before = diffs;
+    int64_t start_ns = host_test_now_ns();
+
+    for (int i = 0; i < 500; i++)
+    {
+        sim_post_random();
+    }
+    int64_t posted_ns = host_test_now_ns();
+    wait_idle();
+
+    printf("BENCH 500 changes of %d nodes: posted in %.1f us (%.0f ns each), %d batches, %d diffs, "
+           "last delivered after %.1f ms, %d callbacks per subscriber instead of 500\n",
+           SIM_MACS, (posted_ns - start_ns) / 1e3, (posted_ns - start_ns) / 500.0, batches - before,
+           diffs - diffs_before, (delivered_ns - start_ns) / 1e6, batches - before);
+    TEST_ASSERT(batches - before >= 1 && diffs - diffs_before <= SIM_MACS);
+    TEST_ASSERT(invalid == 0 && replica_mismatches() == 0);
+
+    /* Sustained, while the task delivers */
+    const int num = 2000000;
+    before = batches;
+    diffs_before = diffs;
+    start_ns = host_test_now_ns();
+    for (int i = 0; i < num; i++)
+    {
+        sim_post_random();
+    }
+    posted_ns = host_test_now_ns();
+    wait_idle();
+
+    printf("BENCH %d changes back to back: %.0f ns each, %.1f M/s, %d batches, %d diffs\n", num,
+           (double)(posted_ns - start_ns) / num, num * 1e3 / (posted_ns - start_ns), batches - before,
+           diffs - diffs_before);
+    TEST_ASSERT(last_batch.num <= SIM_MACS && !last_batch.overflow);
+    TEST_ASSERT(invalid == 0 && replica_mismatches() == 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_subscribe);
+    RUN_TEST(test_merge);
+    RUN_TEST(test_window);
+    RUN_TEST(test_full_batch);
+    RUN_TEST(test_overflow);
+    RUN_TEST(bench_500_changes);
+    return host_test_result();
+}
@@ -0,0 +1,1302 @@
+/*
+ * esp_mesh_lite node info reports: simulation of a root reboot under 200 nodes. The nodes reconnect
+ * level by level and report, the root answers with node list broadcasts. Reports reaching the root
+ * and broadcasts sent by it are counted per second, next to a replay of the reporting before the
+ * jitter and the broadcast token bucket: a report right on every new IP, a fixed interval, and one
+ * broadcast per changed entry. Then the health summaries the reports carry, as the root keeps them.
+ * Last, the root fails half an hour in and a level 2 node takes over: time until its node table
+ * matches the mesh again, seeded from its replica of the node list, against an empty table with
+ * and without the nodes reconciling their entry.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "host_test.h"
+
+/* Set by the build of the component */
+#define MESH_LITE_VER_MAJOR 0
+#define MESH_LITE_VER_MINOR 0
+#define MESH_LITE_VER_PATCH 0
+
+/* The reports and the broadcasts are static, the test drives them through the timers and the handlers */
+#include "../components/mesh_lite/src/esp_mesh_lite.c"
+
+#define SIM_NODES 200           /* Besides the root */
+#define SIM_FANOUT 6
+#define SIM_STORM_S 60          /* Reports and broadcasts are binned over the first minute */
+#define SIM_STEADY_FROM_S 1800
+#define SIM_END_S 5400
+#define SIM_INFLIGHT 1024
+#define SIM_LEGACY_INTERVAL_MS (CONFIG_MESH_LITE_REPORT_INTERVAL * 1000)
+#define BENCH_SNAPSHOTS 10000
+#define SIM_LISTS_INFLIGHT 4096
+#define SIM_FAILOVER_S SIM_STEADY_FROM_S
+#define SIM_FAILOVER_END_S (SIM_FAILOVER_S + 900)
+#define SIM_ROOT_LOSS_MS 3000   /* Until the successor has lost the root and connects to the router */
+#define SIM_SUCCESSOR 1
+
+/* The node table statics of the component, per node: the table of the root, the replica of the others */
+typedef struct
+{
+    node_info_list_t *list;
+    uint32_t num;
+    uint32_t generation;
+    uint32_t epoch;
+    uint32_t boot_epoch;
+    uint8_t root_mac[ETH_HWADDR_LEN];
+    bool owned;
+    uint32_t reconciled_generation;
+    int64_t report_soon_time;
+    uint32_t broadcast_tokens;
+    int64_t broadcast_refill_time;
+    bool broadcast_pending;
+    uint32_t broadcast_coalesced;
+} sim_replica_t;
+
+typedef struct
+{
+    uint8_t mac[ETH_HWADDR_LEN];
+    uint8_t level;              /* 0 until the node is connected again */
+    uint8_t tree_level;
+    int parent;
+    int children;
+    uint32_t ip;                /* 0 until the node has an IP */
+    uint8_t subnet;             /* Of the IP, changes when the node moves to another parent */
+    uint32_t report_interval_ms;
+    int64_t report_due_ms;      /* Report timer, -1 while it is stopped */
+    int64_t got_ip_ms;          /* -1 once handled */
+    sim_replica_t replica;      /* While the code of another node is running */
+} sim_node_t;
+
+typedef struct
+{
+    int64_t arrive_ms;
+    uint32_t len;
+    uint8_t data[96];
+} sim_msg_t;
+
+/* Node list on its way from a node to one of its children */
+typedef struct
+{
+    int64_t arrive_ms;
+    int node;
+    uint32_t len;
+    uint8_t *data;
+} sim_list_msg_t;
+
+typedef struct
+{
+    int reports_per_s[SIM_STORM_S];
+    int reports_per_100ms[SIM_STORM_S * 10];
+    int broadcasts_per_s[SIM_STORM_S];
+    int broadcasts;             /* Within the first minute */
+    uint64_t broadcast_bytes;
+    double complete_s;          /* All nodes in the table of the root */
+    double list_complete_s;     /* A broadcast with all nodes sent */
+    uint32_t last_generation;   /* Of the last broadcast */
+    int leaves;
+    int steady_reports;
+    int steady_broadcasts;
+    uint64_t steady_report_bytes;
+    uint64_t steady_health_bytes;  /* Of the report bytes */
+    double recovered_s;         /* After the failure of the root, the table of the new root matches the mesh */
+    int failover_reports;       /* Reaching the new root in the first minute after the failure */
+    int failover_broadcasts;
+    uint64_t failover_broadcast_bytes;
+} sim_result_t;
+
+static sim_node_t sim_nodes[SIM_NODES + 1];
+static int cur;                 /* Node whose code is running, its node table is in the statics */
+static int sim_root;            /* Node whose node table is in the statics between events */
+static bool root_up;
+static int64_t now_ms;
+static bool legacy;
+static int64_t broadcast_due_ms;
+static int64_t root_timer_due_ms;
+static sim_msg_t inflight[SIM_INFLIGHT];
+static int inflight_num;
+static sim_result_t *result;
+static bool replicas;           /* The nodes receive the node lists */
+static bool unversioned;        /* Node lists as sent by roots without a generation */
+static bool cold;               /* The new root starts from an empty table */
+static sim_list_msg_t lists_inflight[SIM_LISTS_INFLIGHT];
+static int lists_inflight_num;
+static int64_t failover_due_ms;
+static int64_t takeover_due_ms;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/*
+ * The messages in the protobuf wire format, so that the byte counts are those on the air. The node
+ * list is only decoded in the runs where the nodes keep a replica of it.
+ */
+static size_t pb_varint_size(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static uint8_t *pb_put_varint(uint8_t *out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static bool pb_get_varint(const uint8_t **in, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; *in < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *(*in)++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t pb_uint_size(uint64_t value)
+{
+    return value ? 1 + pb_varint_size(value) : 0;
+}
+
+static uint8_t *pb_put_uint(uint8_t *out, int field, uint64_t value)
+{
+    if (value)
+    {
+        out = pb_put_varint(out, (uint64_t)field << 3);
+        out = pb_put_varint(out, value);
+    }
+    return out;
+}
+
+static size_t pb_bytes_size(size_t len)
+{
+    return len ? 1 + pb_varint_size(len) + len : 0;
+}
+
+static uint8_t *pb_put_bytes(uint8_t *out, int field, const uint8_t *data, size_t len)
+{
+    if (len)
+    {
+        out = pb_put_varint(out, (uint64_t)field << 3 | 2);
+        out = pb_put_varint(out, len);
+        memcpy(out, data, len);
+        out += len;
+    }
+    return out;
+}
+
+static uint32_t pb_zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static size_t health_size(const MeshLite__NodeHealth *health)
+{
+    return pb_uint_size(health->free_heap) + pb_uint_size(health->min_free_heap) +
+           pb_uint_size(pb_zigzag(health->parent_rssi)) + pb_uint_size(health->child_num) +
+           pb_uint_size(health->queue_depth) + pb_uint_size(health->queue_drops) + pb_uint_size(health->uptime);
+}
+
+static uint8_t *health_pack(const MeshLite__NodeHealth *health, uint8_t *out)
+{
+    out = pb_put_uint(out, 1, health->free_heap);
+    out = pb_put_uint(out, 2, health->min_free_heap);
+    out = pb_put_uint(out, 3, pb_zigzag(health->parent_rssi));
+    out = pb_put_uint(out, 4, health->child_num);
+    out = pb_put_uint(out, 5, health->queue_depth);
+    out = pb_put_uint(out, 6, health->queue_drops);
+    return pb_put_uint(out, 7, health->uptime);
+}
+
+static uint8_t *node_data_pack(const MeshLite__NodeData *message, uint8_t *out)
+{
+    out = pb_put_uint(out, 1, message->node_level);
+    out = pb_put_uint(out, 2, message->node_ip);
+    out = pb_put_bytes(out, 3, message->node_mac.data, message->node_mac.len);
+    if (message->health)
+    {
+        out = pb_put_varint(out, 4 << 3 | 2);
+        out = pb_put_varint(out, health_size(message->health));
+        out = health_pack(message->health, out);
+    }
+    return out;
+}
+
+static void health_unpack(MeshLite__NodeHealth *health, const uint8_t *data, const uint8_t *end)
+{
+    uint64_t key, value;
+
+    while (data < end && pb_get_varint(&data, end, &key) && (key & 7) == 0 && pb_get_varint(&data, end, &value))
+    {
+        switch (key >> 3)
+        {
+        case 1:
+            health->free_heap = value;
+            break;
+        case 2:
+            health->min_free_heap = value;
+            break;
+        case 3:
+            health->parent_rssi = (int32_t)((value >> 1) ^ -(value & 1));
+            break;
+        case 4:
+            health->child_num = value;
+            break;
+        case 5:
+            health->queue_depth = value;
+            break;
+        case 6:
+            health->queue_drops = value;
+            break;
+        case 7:
+            health->uptime = value;
+            break;
+        }
+    }
+}
+
+void mesh_lite__node_health__init(MeshLite__NodeHealth *message)
+{
+    memset(message, 0, sizeof(*message));
+}
+
+void mesh_lite__node_data__init(MeshLite__NodeData *message)
+{
+    memset(message, 0, sizeof(*message));
+}
+
+size_t mesh_lite__node_data__get_packed_size(const MeshLite__NodeData *message)
+{
+    size_t size = pb_uint_size(message->node_level) + pb_uint_size(message->node_ip) +
+                  pb_bytes_size(message->node_mac.len);
+    if (message->health)
+    {
+        size += 1 + pb_varint_size(health_size(message->health)) + health_size(message->health);
+    }
+    return size;
+}
+
+size_t mesh_lite__node_data__pack(const MeshLite__NodeData *message, uint8_t *out)
+{
+    return node_data_pack(message, out) - out;
+}
+
+MeshLite__NodeData *mesh_lite__node_data__unpack(ProtobufCAllocator *allocator, size_t len, const uint8_t *data)
+{
+    const uint8_t *end = data + len;
+    MeshLite__NodeData *message = calloc(1, sizeof(*message));
+    uint64_t key, value;
+
+    while (data < end && pb_get_varint(&data, end, &key))
+    {
+        if ((key & 7) == 2)
+        {
+            if (!pb_get_varint(&data, end, &value) || value > (uint64_t)(end - data))
+            {
+                break;
+            }
+            if ((key >> 3) == 3)
+            {
+                message->node_mac.data = malloc(value);
+                message->node_mac.len = value;
+                memcpy(message->node_mac.data, data, value);
+            }
+            else if ((key >> 3) == 4)
+            {
+                message->health = calloc(1, sizeof(*message->health));
+                health_unpack(message->health, data, data + value);
+            }
+            data += value;
+        }
+        else if (pb_get_varint(&data, end, &value))
+        {
+            if ((key >> 3) == 1)
+            {
+                message->node_level = value;
+            }
+            else if ((key >> 3) == 2)
+            {
+                message->node_ip = value;
+            }
+        }
+    }
+    return message;
+}
+
+void mesh_lite__node_data__free_unpacked(MeshLite__NodeData *message, ProtobufCAllocator *allocator)
+{
+    free(message->node_mac.data);
+    free(message->health);
+    free(message);
+}
+
+void mesh_lite__data__init(MeshLite__Data *message)
+{
+    memset(message, 0, sizeof(*message));
+}
+
+size_t mesh_lite__data__get_packed_size(const MeshLite__Data *message)
+{
+    size_t size = unversioned ? 0 : pb_uint_size(message->generation) + pb_bytes_size(message->root_mac.len) +
+                                    pb_uint_size(message->epoch);
+    for (size_t i = 0; i < message->n_nodes; i++)
+    {
+        size_t node_size = mesh_lite__node_data__get_packed_size(message->nodes[i]);
+        size += 1 + pb_varint_size(node_size) + node_size;
+    }
+    return size;
+}
+
+size_t mesh_lite__data__pack(const MeshLite__Data *message, uint8_t *out)
+{
+    uint8_t *start = out;
+    for (size_t i = 0; i < message->n_nodes; i++)
+    {
+        out = pb_put_varint(out, 1 << 3 | 2);
+        out = pb_put_varint(out, mesh_lite__node_data__get_packed_size(message->nodes[i]));
+        out = node_data_pack(message->nodes[i], out);
+    }
+    if (!unversioned)
+    {
+        out = pb_put_uint(out, 2, message->generation);
+        out = pb_put_bytes(out, 3, message->root_mac.data, message->root_mac.len);
+        out = pb_put_uint(out, 4, message->epoch);
+    }
+    return out - start;
+}
+
+MeshLite__Data *mesh_lite__data__unpack(ProtobufCAllocator *allocator, size_t len, const uint8_t *data)
+{
+    const uint8_t *end = data + len;
+    MeshLite__Data *message = calloc(1, sizeof(*message));
+    uint64_t key, value;
+
+    while (data < end && pb_get_varint(&data, end, &key))
+    {
+        if ((key & 7) == 2)
+        {
+            if (!pb_get_varint(&data, end, &value) || value > (uint64_t)(end - data))
+            {
+                break;
+            }
+            if ((key >> 3) == 1)
+            {
+                message->nodes = realloc(message->nodes, (message->n_nodes + 1) * sizeof(message->nodes[0]));
+                message->nodes[message->n_nodes++] = mesh_lite__node_data__unpack(NULL, value, data);
+            }
+            else if ((key >> 3) == 3)
+            {
+                message->root_mac.data = malloc(value);
+                message->root_mac.len = value;
+                memcpy(message->root_mac.data, data, value);
+            }
+            data += value;
+        }
+        else if (pb_get_varint(&data, end, &value))
+        {
+            if ((key >> 3) == 2)
+            {
+                message->generation = value;
+            }
+            else if ((key >> 3) == 4)
+            {
+                message->epoch = value;
+            }
+        }
+    }
+    return message;
+}
+
+void mesh_lite__data__free_unpacked(MeshLite__Data *message, ProtobufCAllocator *allocator)
+{
+    for (size_t i = 0; i < message->n_nodes; i++)
+    {
+        mesh_lite__node_data__free_unpacked(message->nodes[i], NULL);
+    }
+    free(message->nodes);
+    free(message->root_mac.data);
+    free(message);
+}
+
+/* The node whose code is running answers for the platform */
+int64_t esp_timer_get_time(void)
+{
+    return now_ms * 1000;
+}
+
+uint32_t esp_random(void)
+{
+    return rng();
+}
+
+uint8_t esp_mesh_lite_get_level(void)
+{
+    return sim_nodes[cur].level;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    memcpy(mac, sim_nodes[cur].mac, ETH_HWADDR_LEN);
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
+{
+    return NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info)
+{
+    memset(ip_info, 0, sizeof(*ip_info));
+    ip_info->ip.addr = sim_nodes[cur].ip;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    memset(ap_info, 0, sizeof(*ap_info));
+    ap_info->rssi = -60;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta)
+{
+    sta->num = sim_nodes[cur].children;
+    return ESP_OK;
+}
+
+/* Moves with every report, without drawing from the random stream of the simulation */
+uint32_t esp_get_free_heap_size(void)
+{
+    return 120000 - (now_ms / 1000 + cur * 37) % 4096;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 90000;
+}
+
+/* One hop up: air time and the parent forwarding */
+static int64_t hop_delay_ms(void)
+{
+    return 2 + rng() % 15;
+}
+
+/* Every node up to the root is connected */
+static bool sim_reachable(int i)
+{
+    while (i != sim_root)
+    {
+        if (i < 0 || sim_nodes[i].level == 0)
+        {
+            return false;
+        }
+        i = sim_nodes[i].parent;
+    }
+    return root_up;
+}
+
+/* One hop down, to each connected child */
+static void sim_forward_list(const uint8_t *data, uint32_t len)
+{
+    for (int i = 0; i <= SIM_NODES; i++)
+    {
+        if (sim_nodes[i].parent != cur || sim_nodes[i].level == 0)
+        {
+            continue;
+        }
+        TEST_ASSERT(lists_inflight_num < SIM_LISTS_INFLIGHT);
+        if (lists_inflight_num < SIM_LISTS_INFLIGHT)
+        {
+            sim_list_msg_t *msg = &lists_inflight[lists_inflight_num++];
+            msg->arrive_ms = now_ms + hop_delay_ms();
+            msg->node = i;
+            msg->len = len;
+            msg->data = malloc(len);
+            memcpy(msg->data, data, len);
+        }
+    }
+}
+
+esp_err_t esp_mesh_lite_send_msg(esp_mesh_lite_msg_data_t type, esp_mesh_lite_msg_config_t *conf)
+{
+    TEST_ASSERT(type == ESP_MESH_LITE_RAW_MSG);
+    if (conf->raw_msg.msg_id == MESH_LITE_MSG_ID_REPORT_NODE_INFO)
+    {
+        /* Lost on the way, the node reports again at its next interval */
+        if (!sim_reachable(cur))
+        {
+            return ESP_OK;
+        }
+        TEST_ASSERT(inflight_num < SIM_INFLIGHT && conf->raw_msg.size <= sizeof(inflight[0].data));
+        if (inflight_num < SIM_INFLIGHT && conf->raw_msg.size <= sizeof(inflight[0].data))
+        {
+            sim_msg_t *msg = &inflight[inflight_num++];
+            msg->arrive_ms = now_ms;
+            for (int hop = ROOT; hop < sim_nodes[cur].level; hop++)
+            {
+                msg->arrive_ms += hop_delay_ms();
+            }
+            msg->len = conf->raw_msg.size;
+            memcpy(msg->data, conf->raw_msg.data, msg->len);
+        }
+    }
+    else if (conf->raw_msg.msg_id == MESH_LITE_MSG_ID_UPDATE_NODES_LIST && cur == sim_root)
+    {
+        if (now_ms >= SIM_FAILOVER_S * 1000 && now_ms < SIM_FAILOVER_S * 1000 + 60000)
+        {
+            result->failover_broadcasts++;
+            result->failover_broadcast_bytes += conf->raw_msg.size;
+        }
+        if (now_ms < SIM_STORM_S * 1000)
+        {
+            result->broadcasts_per_s[now_ms / 1000]++;
+            result->broadcasts++;
+            result->broadcast_bytes += conf->raw_msg.size;
+        }
+        else if (now_ms >= SIM_STEADY_FROM_S * 1000)
+        {
+            result->steady_broadcasts++;
+        }
+        if (nodes_num == SIM_NODES + 1 && result->list_complete_s < 0)
+        {
+            result->list_complete_s = now_ms / 1000.0;
+        }
+        result->last_generation = nodes_generation;
+    }
+    if (conf->raw_msg.msg_id == MESH_LITE_MSG_ID_UPDATE_NODES_LIST && replicas)
+    {
+        sim_forward_list(conf->raw_msg.data, conf->raw_msg.size);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_send_raw_msg_to_root(const uint8_t *data, size_t size)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_send_broadcast_raw_msg_to_child(const uint8_t *data, size_t size)
+{
+    return ESP_OK;
+}
+
+void esp_mesh_lite_node_diff_post(esp_mesh_lite_node_diff_type_t type, const esp_mesh_lite_node_info_t *node)
+{
+    if (type == ESP_MESH_LITE_NODE_DIFF_LEAVE && cur == sim_root)
+    {
+        result->leaves++;
+    }
+}
+
+/* Each node has its own report timer, the one of the node whose code is running */
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    if (timer == report_timer)
+    {
+        sim_nodes[cur].report_due_ms = now_ms + period;
+    }
+    else if (timer == nodes_broadcast_timer)
+    {
+        broadcast_due_ms = now_ms + period;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return (timer == report_timer) ? sim_nodes[cur].report_due_ms >= 0 : pdTRUE;
+}
+
+/* Rest of the platform, not part of the reports */
+const char *ESP_MESH_LITE_EVENT = "ESP_MESH_LITE_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    return ESP_OK;
+}
+
+void esp_bridge_network_segment_check_register(bool (*cb)(uint32_t ip))
+{
+}
+
+esp_err_t esp_bridge_netif_network_segment_conflict_update(void *netif)
+{
+    return ESP_OK;
+}
+
+bool esp_mesh_lite_network_segment_is_used(uint32_t ip)
+{
+    return false;
+}
+
+esp_err_t esp_mesh_lite_espnow_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_core_init(esp_mesh_lite_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_node_events_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_raw_msg_action_list_register(const esp_mesh_lite_raw_msg_action_t *msg_action)
+{
+    return ESP_OK;
+}
+
+void esp_mesh_lite_connect(void)
+{
+}
+
+esp_err_t esp_wifi_deauth_sta(uint16_t aid)
+{
+    return ESP_OK;
+}
+
+static void sim_free_list(node_info_list_t *list)
+{
+    while (list)
+    {
+        node_info_list_t *next = list->next;
+        free(list->node);
+        free(list);
+        list = next;
+    }
+}
+
+/* The node table statics to the node running now, the ones of the node before back to it */
+static void sim_swap(int i)
+{
+    sim_replica_t *replica = &sim_nodes[cur].replica;
+
+    replica->list = node_info_list;
+    replica->num = nodes_num;
+    replica->generation = nodes_generation;
+    replica->epoch = nodes_epoch;
+    replica->boot_epoch = nodes_boot_epoch;
+    memcpy(replica->root_mac, nodes_root_mac, ETH_HWADDR_LEN);
+    replica->owned = nodes_owned;
+    replica->reconciled_generation = nodes_reconciled_generation;
+    replica->report_soon_time = report_soon_time;
+    replica->broadcast_tokens = nodes_broadcast_tokens;
+    replica->broadcast_refill_time = nodes_broadcast_refill_time;
+    replica->broadcast_pending = nodes_broadcast_pending;
+    replica->broadcast_coalesced = nodes_broadcast_coalesced;
+
+    cur = i;
+    replica = &sim_nodes[cur].replica;
+    node_info_list = replica->list;
+    nodes_num = replica->num;
+    nodes_generation = replica->generation;
+    nodes_epoch = replica->epoch;
+    nodes_boot_epoch = replica->boot_epoch;
+    memcpy(nodes_root_mac, replica->root_mac, ETH_HWADDR_LEN);
+    nodes_owned = replica->owned;
+    nodes_reconciled_generation = replica->reconciled_generation;
+    report_soon_time = replica->report_soon_time;
+    nodes_broadcast_tokens = replica->broadcast_tokens;
+    nodes_broadcast_refill_time = replica->broadcast_refill_time;
+    nodes_broadcast_pending = replica->broadcast_pending;
+    nodes_broadcast_coalesced = replica->broadcast_coalesced;
+}
+
+/* Runs code as node i, with the report interval and the node table of that node */
+static void sim_enter(int i)
+{
+    sim_swap(i);
+    report_interval_ms = sim_nodes[i].report_interval_ms;
+    if (legacy && i == 0)
+    {
+        /* One broadcast per change, as before the token bucket */
+        nodes_broadcast_tokens = 1;
+        nodes_broadcast_refill_time = esp_timer_get_time();
+    }
+}
+
+/* Back to the node table of the root */
+static void sim_leave(void)
+{
+    sim_nodes[cur].report_interval_ms = report_interval_ms;
+    sim_swap(sim_root);
+}
+
+/* Back to a root that just booted, with the nodes mid-way through their report interval */
+static void sim_reset(sim_result_t *r, bool legacy_reports)
+{
+    for (int i = 0; i <= SIM_NODES; i++)
+    {
+        if (i != cur)
+        {
+            sim_free_list(sim_nodes[i].replica.list);
+        }
+    }
+    sim_free_list(node_info_list);
+    while (lists_inflight_num)
+    {
+        free(lists_inflight[--lists_inflight_num].data);
+    }
+    node_info_list = NULL;
+    nodes_num = 0;
+    nodes_generation = 0;
+    nodes_epoch = 0;
+    nodes_owned = false;
+    nodes_reconciled_generation = 0;
+    nodes_broadcast_tokens = CONFIG_MESH_LITE_NODES_BROADCAST_BURST;
+    nodes_broadcast_refill_time = 0;
+    nodes_broadcast_pending = false;
+    nodes_broadcast_coalesced = 0;
+
+    memset(r, 0, sizeof(*r));
+    r->complete_s = -1;
+    r->list_complete_s = -1;
+    r->recovered_s = -1;
+    result = r;
+    legacy = legacy_reports;
+    rng_state = 1;
+    now_ms = 0;
+    inflight_num = 0;
+    broadcast_due_ms = -1;
+    root_timer_due_ms = 1000;
+    failover_due_ms = -1;
+    takeover_due_ms = -1;
+    cur = 0;
+    sim_root = 0;
+    root_up = true;
+
+    for (int i = 0; i <= SIM_NODES; i++)
+    {
+        sim_node_t *node = &sim_nodes[i];
+        memset(node, 0, sizeof(*node));
+        node->mac[0] = 0x24;
+        node->mac[4] = i >> 8;
+        node->mac[5] = i;
+        node->parent = i ? (i - 1) / SIM_FANOUT : -1;
+        node->tree_level = i ? sim_nodes[node->parent].tree_level + 1 : ROOT;
+        if (i)
+        {
+            sim_nodes[node->parent].children++;
+        }
+        node->report_interval_ms = MESH_LITE_REPORT_INTERVAL_MAX_MS;
+        node->report_due_ms = rng() % MESH_LITE_REPORT_INTERVAL_MAX_MS;
+        /* The root has its IP from the router first, its children reconnect one level after the other */
+        node->got_ip_ms = i ? 3000 + (node->tree_level - 2) * 2000 + rng() % 2000 : 2000;
+        /* Any nonce but 0, the root draws its own in esp_mesh_lite_init() */
+        node->replica.boot_epoch = 0x5a000000 | i;
+        node->replica.report_soon_time = -MESH_LITE_REPORT_INTERVAL_MIN_MS * 1000LL;
+    }
+
+    sim_nodes[0].level = ROOT;
+    sim_enter(0);
+    esp_mesh_lite_init(NULL);
+    report_interval_ms = MESH_LITE_REPORT_INTERVAL_MIN_MS;
+    sim_nodes[0].report_due_ms = legacy ? SIM_LEGACY_INTERVAL_MS : esp_mesh_lite_report_jitter(report_interval_ms);
+    sim_leave();
+}
+
+static void sim_got_ip(int i)
+{
+    sim_node_t *node = &sim_nodes[i];
+
+    node->got_ip_ms = -1;
+    node->level = node->tree_level;
+    node->ip = 0x0a000000 | node->subnet << 16 | i;
+    sim_enter(i);
+    if (legacy)
+    {
+        esp_mesh_lite_report_info();
+    }
+    else
+    {
+        esp_mesh_lite_event_got_ip_handler(NULL, IP_EVENT, IP_EVENT_STA_GOT_IP, NULL);
+    }
+    sim_leave();
+
+    if (node->parent >= 0)
+    {
+        sim_enter(node->parent);
+        if (legacy)
+        {
+            esp_mesh_lite_report_info();
+        }
+        else
+        {
+            esp_mesh_lite_event_ap_sta_ip_assigned_handler(NULL, IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, NULL);
+        }
+        sim_leave();
+    }
+}
+
+static void sim_report_timer(int i)
+{
+    sim_enter(i);
+    if (legacy)
+    {
+        esp_mesh_lite_report_info();
+        if (esp_mesh_lite_get_level() == ROOT)
+        {
+            esp_mesh_lite_update_nodes_info_to_children();
+        }
+        sim_nodes[i].report_due_ms = now_ms + SIM_LEGACY_INTERVAL_MS;
+    }
+    else
+    {
+        sim_nodes[i].report_due_ms = -1;
+        report_timer_cb(report_timer);
+    }
+    sim_leave();
+}
+
+static void sim_deliver(int m)
+{
+    sim_msg_t msg = inflight[m];
+    uint8_t *out_data = NULL;
+    uint32_t out_len = 0;
+
+    inflight[m] = inflight[--inflight_num];
+    if (!root_up)
+    {
+        return;
+    }
+    if (now_ms >= SIM_FAILOVER_S * 1000 && now_ms < SIM_FAILOVER_S * 1000 + 60000)
+    {
+        result->failover_reports++;
+    }
+    if (now_ms < SIM_STORM_S * 1000)
+    {
+        result->reports_per_s[now_ms / 1000]++;
+        result->reports_per_100ms[now_ms / 100]++;
+    }
+    else if (now_ms >= SIM_STEADY_FROM_S * 1000)
+    {
+        MeshLite__NodeData *report = mesh_lite__node_data__unpack(NULL, msg.len, msg.data);
+        result->steady_reports++;
+        result->steady_report_bytes += msg.len;
+        if (report->health)
+        {
+            result->steady_health_bytes += 1 + pb_varint_size(health_size(report->health)) + health_size(report->health);
+        }
+        mesh_lite__node_data__free_unpacked(report, NULL);
+    }
+
+    sim_enter(sim_root);
+    mesh_lite_report_nodes_handler(msg.data, msg.len, &out_data, &out_len, 0);
+    sim_leave();
+    if (nodes_num == SIM_NODES + 1 && result->complete_s < 0)
+    {
+        result->complete_s = now_ms / 1000.0;
+    }
+}
+
+static void sim_deliver_list(int m)
+{
+    sim_list_msg_t msg = lists_inflight[m];
+    uint8_t *out_data = NULL;
+    uint32_t out_len = 0;
+
+    lists_inflight[m] = lists_inflight[--lists_inflight_num];
+    sim_enter(msg.node);
+    mesh_lite_update_nodes_list(msg.data, msg.len, &out_data, &out_len, 0);
+    sim_leave();
+    free(msg.data);
+}
+
+/* The root is gone: its children lose their parent, reports on their way to it are lost */
+static void sim_root_fail(void)
+{
+    failover_due_ms = -1;
+    root_up = false;
+    root_timer_due_ms = INT64_MAX;
+    broadcast_due_ms = -1;
+    inflight_num = 0;
+    sim_nodes[0].level = 0;
+    sim_nodes[0].report_due_ms = -1;
+    for (int i = 1; i <= SIM_NODES; i++)
+    {
+        if (sim_nodes[i].parent == 0)
+        {
+            sim_nodes[i].level = 0;
+        }
+    }
+    takeover_due_ms = now_ms + SIM_ROOT_LOSS_MS;
+}
+
+/*
+ * The successor connects to the router and the other children of the old root to it, with an IP from
+ * the new subnet. The subtree of the successor moves one level up and keeps its IPs, the other subtrees
+ * keep both.
+ */
+static void sim_take_over(void)
+{
+    sim_node_t *successor = &sim_nodes[SIM_SUCCESSOR];
+
+    takeover_due_ms = -1;
+    sim_root = SIM_SUCCESSOR;
+    root_up = true;
+    sim_enter(SIM_SUCCESSOR);
+    if (cold)
+    {
+        sim_free_list(node_info_list);
+        node_info_list = NULL;
+        nodes_num = 0;
+    }
+    sim_leave();
+
+    successor->parent = -1;
+    successor->level = ROOT;
+    successor->subnet = 1;
+    successor->got_ip_ms = now_ms + 1000 + rng() % 2000;
+    for (int i = 1; i <= SIM_NODES; i++)
+    {
+        sim_node_t *node = &sim_nodes[i];
+        if (node->parent == 0)
+        {
+            node->parent = SIM_SUCCESSOR;
+            node->subnet = 1;
+            node->got_ip_ms = now_ms + 2000 + rng() % 3000;
+        }
+    }
+    for (int i = 0; i <= SIM_NODES; i++)
+    {
+        sim_nodes[i].children = 0;
+    }
+    for (int i = 1; i <= SIM_NODES; i++)
+    {
+        sim_node_t *node = &sim_nodes[i];
+        node->tree_level = node->parent < 0 ? ROOT : sim_nodes[node->parent].tree_level + 1;
+        if (node->parent >= 0)
+        {
+            sim_nodes[node->parent].children++;
+        }
+        if (node->level)
+        {
+            node->level = node->tree_level;
+        }
+    }
+    root_timer_due_ms = now_ms + 1 + rng() % 1000;
+}
+
+/* Every node but the failed root in the table of the new root, with its level and IP */
+static void sim_check_recovered(void)
+{
+    int matched = 0;
+
+    if (sim_root != SIM_SUCCESSOR || result->recovered_s >= 0)
+    {
+        return;
+    }
+    for (const node_info_list_t *entry = node_info_list; entry; entry = entry->next)
+    {
+        const sim_node_t *node = &sim_nodes[entry->node->mac_addr[4] << 8 | entry->node->mac_addr[5]];
+        matched += node->level && entry->node->level == node->level && entry->node->ip_addr == node->ip;
+    }
+    if (matched == SIM_NODES && nodes_num == SIM_NODES)
+    {
+        result->recovered_s = now_ms / 1000.0 - SIM_FAILOVER_S;
+    }
+}
+
+/* Event by event, the earliest of the timers, the new IPs and the messages in flight first */
+static void sim_run(int64_t end_ms)
+{
+    for (;;)
+    {
+        int64_t next_ms = end_ms;
+        int kind = -1, index = 0;
+
+        if (root_timer_due_ms < next_ms)
+        {
+            next_ms = root_timer_due_ms;
+            kind = 0;
+        }
+        if (broadcast_due_ms >= 0 && broadcast_due_ms < next_ms)
+        {
+            next_ms = broadcast_due_ms;
+            kind = 1;
+        }
+        for (int i = 0; i <= SIM_NODES; i++)
+        {
+            if (sim_nodes[i].got_ip_ms >= 0 && sim_nodes[i].got_ip_ms < next_ms)
+            {
+                next_ms = sim_nodes[i].got_ip_ms;
+                kind = 2;
+                index = i;
+            }
+            if (sim_nodes[i].report_due_ms >= 0 && sim_nodes[i].report_due_ms < next_ms)
+            {
+                next_ms = sim_nodes[i].report_due_ms;
+                kind = 3;
+                index = i;
+            }
+        }
+        for (int m = 0; m < inflight_num; m++)
+        {
+            if (inflight[m].arrive_ms < next_ms)
+            {
+                next_ms = inflight[m].arrive_ms;
+                kind = 4;
+                index = m;
+            }
+        }
+        for (int m = 0; m < lists_inflight_num; m++)
+        {
+            if (lists_inflight[m].arrive_ms < next_ms)
+            {
+                next_ms = lists_inflight[m].arrive_ms;
+                kind = 5;
+                index = m;
+            }
+        }
+        if (failover_due_ms >= 0 && failover_due_ms < next_ms)
+        {
+            next_ms = failover_due_ms;
+            kind = 6;
+        }
+        if (takeover_due_ms >= 0 && takeover_due_ms < next_ms)
+        {
+            next_ms = takeover_due_ms;
+            kind = 7;
+        }
+        if (kind < 0)
+        {
+            break;
+        }
+
+        now_ms = next_ms;
+        switch (kind)
+        {
+        case 0:
+            root_timer_due_ms += 1000;
+            sim_enter(sim_root);
+            root_timer_cb(NULL);
+            sim_leave();
+            break;
+        case 1:
+            broadcast_due_ms = -1;
+            sim_enter(sim_root);
+            nodes_broadcast_timer_cb(nodes_broadcast_timer);
+            sim_leave();
+            break;
+        case 2:
+            sim_got_ip(index);
+            break;
+        case 3:
+            sim_report_timer(index);
+            break;
+        case 4:
+            sim_deliver(index);
+            break;
+        case 5:
+            sim_deliver_list(index);
+            break;
+        case 6:
+            sim_root_fail();
+            break;
+        case 7:
+            sim_take_over();
+            break;
+        }
+        sim_check_recovered();
+    }
+    now_ms = end_ms;
+}
+
+static int peak(const int *bins, int num)
+{
+    int max = 0;
+    for (int i = 0; i < num; i++)
+    {
+        max = bins[i] > max ? bins[i] : max;
+    }
+    return max;
+}
+
+static void sim_report(const char *name, const sim_result_t *r)
+{
+    int reports = 0;
+    for (int s = 0; s < SIM_STORM_S; s++)
+    {
+        reports += r->reports_per_s[s];
+    }
+    int parents = 0;
+    for (int i = 0; i <= SIM_NODES; i++)
+    {
+        parents += sim_nodes[i].children > 0;
+    }
+
+    printf("BENCH %s, root reboot under %d nodes, first %d s:\n", name, SIM_NODES, SIM_STORM_S);
+    printf("BENCH   reports at the root  %4d, peak %3d/s, %3d per 100 ms\n", reports,
+           peak(r->reports_per_s, SIM_STORM_S), peak(r->reports_per_100ms, SIM_STORM_S * 10));
+    printf("BENCH   node list broadcasts %4d, peak %3d/s, %.0f kB sent by the root, %.0f kB relayed by %d parents\n",
+           r->broadcasts, peak(r->broadcasts_per_s, SIM_STORM_S), r->broadcast_bytes / 1e3,
+           r->broadcast_bytes * parents / 1e3, parents);
+    printf("BENCH   all nodes on the root after %.1f s, in a broadcast after %.1f s\n", r->complete_s,
+           r->list_complete_s);
+    printf("BENCH   steady state from %d s: %.2f reports/s, %.3f broadcasts/s, %d nodes timed out\n",
+           SIM_STEADY_FROM_S, r->steady_reports / (double)(SIM_END_S - SIM_STEADY_FROM_S),
+           r->steady_broadcasts / (double)(SIM_END_S - SIM_STEADY_FROM_S), r->leaves);
+}
+
+static sim_result_t legacy_result;
+static sim_result_t storm_result;
+
+static void test_legacy_storm(void)
+{
+    sim_reset(&legacy_result, true);
+    sim_run(SIM_END_S * 1000LL);
+    sim_report("fixed interval, broadcast per change", &legacy_result);
+
+    TEST_ASSERT(legacy_result.complete_s >= 0);
+    TEST_ASSERT(legacy_result.leaves == 0);
+}
+
+static void test_report_storm(void)
+{
+    sim_reset(&storm_result, false);
+    sim_run(SIM_STORM_S * 1000LL);
+    /* The last change of the storm reaches the nodes, coalesced into a later broadcast if need be */
+    TEST_ASSERT(storm_result.last_generation == nodes_generation);
+    sim_run(SIM_END_S * 1000LL);
+    sim_report("jitter, adaptive interval, token bucket", &storm_result);
+
+    TEST_ASSERT(storm_result.complete_s >= 0 && storm_result.complete_s < 15);
+    TEST_ASSERT(storm_result.list_complete_s >= 0 && storm_result.list_complete_s < storm_result.complete_s + 2);
+    TEST_ASSERT(peak(storm_result.broadcasts_per_s, SIM_STORM_S) <= CONFIG_MESH_LITE_NODES_BROADCAST_BURST + 1);
+    TEST_ASSERT(storm_result.broadcasts <= SIM_STORM_S + CONFIG_MESH_LITE_NODES_BROADCAST_BURST);
+    TEST_ASSERT(storm_result.leaves == 0);
+    /* Back to the full interval once stable, with every node within the TTL */
+    double steady = storm_result.steady_reports / (double)(SIM_END_S - SIM_STEADY_FROM_S);
+    TEST_ASSERT(fabs(steady - (SIM_NODES + 1) / (double)CONFIG_MESH_LITE_REPORT_INTERVAL) < 0.1);
+}
+
+static void test_storm_vs_legacy(void)
+{
+    TEST_ASSERT(peak(storm_result.reports_per_s, SIM_STORM_S) * 2 < peak(legacy_result.reports_per_s, SIM_STORM_S));
+    TEST_ASSERT(storm_result.broadcasts * 4 < legacy_result.broadcasts);
+    TEST_ASSERT(storm_result.broadcast_bytes * 4 < legacy_result.broadcast_bytes);
+}
+
+/*
+ * The root after the storm: the health of every node as it last reported it. Health moves with every
+ * report but is not a node change, an hour more of reports leaves the generation of the table alone.
+ */
+static void test_health(void)
+{
+    static esp_mesh_lite_node_snapshot_t nodes[SIM_NODES + 1];
+    uint32_t generation = nodes_generation;
+
+    /* Steady state of the storm, before the hour added here */
+    double seconds = SIM_END_S - SIM_STEADY_FROM_S;
+    printf("BENCH node health: %.1f of %.1f bytes per report, %.1f of %.1f B/s reaching the root from %d nodes\n",
+           (double)storm_result.steady_health_bytes / storm_result.steady_reports,
+           (double)storm_result.steady_report_bytes / storm_result.steady_reports,
+           storm_result.steady_health_bytes / seconds, storm_result.steady_report_bytes / seconds, SIM_NODES);
+
+    sim_run(now_ms + 3600 * 1000LL);
+    TEST_ASSERT(nodes_generation == generation && storm_result.leaves == 0);
+    uint32_t num = esp_mesh_lite_get_nodes_snapshot(nodes, SIM_NODES + 1);
+
+    TEST_ASSERT(num == SIM_NODES + 1);
+    for (uint32_t i = 0; i < num; i++)
+    {
+        int id = nodes[i].node.mac_addr[4] << 8 | nodes[i].node.mac_addr[5];
+        const esp_mesh_lite_node_health_t *health = &nodes[i].health;
+        TEST_ASSERT(health->update_time > 0
+                    && now_ms / 1000 - health->update_time <= MESH_LITE_REPORT_TTL);
+        TEST_ASSERT(health->child_num == sim_nodes[id].children && health->parent_rssi == (id ? -60 : 0));
+        TEST_ASSERT(health->free_heap > 120000 - 4096 && health->free_heap <= 120000 && health->min_free_heap == 90000);
+        TEST_ASSERT(health->uptime > 0 && health->uptime <= health->update_time);
+    }
+
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_SNAPSHOTS; i++)
+    {
+        num = esp_mesh_lite_get_nodes_snapshot(nodes, SIM_NODES + 1);
+    }
+    double snapshot_us = (host_test_now_ns() - start) / 1e3 / BENCH_SNAPSHOTS;
+
+    printf("BENCH node table snapshot of %u nodes: %zu bytes, %.2f us\n", (unsigned)num, sizeof(nodes), snapshot_us);
+}
+
+/* Storm and steady state with the nodes keeping the list, then the root fails */
+static void sim_failover(const char *name, sim_result_t *r, bool replica, bool versioned)
+{
+    sim_reset(r, false);
+    replicas = true;
+    unversioned = !versioned;
+    cold = !replica;
+    sim_run(SIM_FAILOVER_S * 1000LL);
+    failover_due_ms = now_ms;
+    sim_run(SIM_FAILOVER_END_S * 1000LL);
+    replicas = false;
+    unversioned = false;
+    cold = false;
+
+    printf("BENCH root failover, %s: new root table right after %.1f s, in the first minute %d reports, "
+           "%d node list broadcasts of %.0f kB\n", name, r->recovered_s, r->failover_reports,
+           r->failover_broadcasts, r->failover_broadcast_bytes / 1e3);
+}
+
+static sim_result_t legacy_failover_result;
+static sim_result_t cold_failover_result;
+static sim_result_t failover_result;
+
+static void test_failover(void)
+{
+    sim_failover("empty table, no generation", &legacy_failover_result, false, false);
+    sim_failover("empty table, reconciled", &cold_failover_result, false, true);
+    sim_failover("replica, reconciled", &failover_result, true, true);
+    printf("BENCH   with replicas, root reboot: reports peak %d/s, %d node list broadcasts in the first %d s, "
+           "all nodes on the root after %.1f s\n", peak(failover_result.reports_per_s, SIM_STORM_S),
+           failover_result.broadcasts, SIM_STORM_S, failover_result.complete_s);
+
+    /* The nodes reconciling their entry take over from the periodic reports */
+    TEST_ASSERT(legacy_failover_result.recovered_s > 60);
+    TEST_ASSERT(cold_failover_result.recovered_s >= 0 && cold_failover_result.recovered_s < 30);
+    TEST_ASSERT(failover_result.recovered_s >= 0 && failover_result.recovered_s < 30);
+    /* Both wait for the children of the old root to get an IP again, but only the nodes out of date report */
+    TEST_ASSERT(failover_result.failover_reports * 2 < cold_failover_result.failover_reports);
+    /* Keeping the replicas does not add to the reboot storm */
+    TEST_ASSERT(failover_result.complete_s >= 0 && failover_result.complete_s < 15);
+    TEST_ASSERT(peak(failover_result.reports_per_s, SIM_STORM_S) <= peak(storm_result.reports_per_s, SIM_STORM_S) * 3 / 2);
+    TEST_ASSERT(failover_result.leaves == 1);
+}
+
+int main(void)
+{
+    RUN_TEST(test_legacy_storm);
+    RUN_TEST(test_report_storm);
+    RUN_TEST(test_storm_vs_legacy);
+    RUN_TEST(test_health);
+    RUN_TEST(test_failover);
+    return host_test_result();
+}
@@ -0,0 +1,379 @@
+/*
+ * esp_mesh_lite_ota_pack: installs the packs that tools/mesh_lite_ota_pack.py makes from two
+ * builds of ota_image.c, full and delta, deflated or not, through in-memory partitions, and
+ * reports the bytes transferred and the install time of each. Corrupt, truncated and misdirected
+ * packs must not get to the boot partition.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/sha.h>
+#include "host_test.h"
+#include "esp_ota_ops.h"
+#include "esp_mesh_lite_ota_pack.h"
+
+#define PARTITION_SIZE (1024 * 1024)
+#define BENCH_RUNS 200
+
+typedef struct
+{
+    esp_partition_t part;       /* First, the module only sees this */
+    uint8_t data[PARTITION_SIZE];
+    size_t len;                 /* Image length, what esp_partition_get_sha256() hashes */
+} host_partition_t;
+
+static host_partition_t running = {.part = {.address = 0x10000, .size = PARTITION_SIZE, .label = "ota_0"}};
+static host_partition_t update = {.part = {.address = 0x110000, .size = PARTITION_SIZE, .label = "ota_1"}};
+static host_partition_t staging = {.part = {.address = 0x210000, .size = PARTITION_SIZE, .label = "staging"}};
+
+static bool ota_open;
+static int ota_begins;
+static int ota_aborts;
+static const esp_partition_t *boot;
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    const host_partition_t *p = (const host_partition_t *)partition;
+    if (src_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, p->data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256)
+{
+    const host_partition_t *p = (const host_partition_t *)partition;
+    SHA256(p->data, p->len, sha_256);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    TEST_ASSERT(partition == &update.part && !ota_open);
+    if (image_size != OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(update.data, 0xff, sizeof(update.data));
+    update.len = 0;
+    ota_open = true;
+    ota_begins++;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    TEST_ASSERT(handle == 1 && ota_open);
+    if (update.len + size > update.part.size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(update.data + update.len, data, size);
+    update.len += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    TEST_ASSERT(handle == 1 && ota_open);
+    ota_open = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    TEST_ASSERT(handle == 1 && ota_open);
+    ota_open = false;
+    ota_aborts++;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &running.part;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &update.part;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    boot = partition;
+    return ESP_OK;
+}
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static size_t load_file(const char *path, uint8_t *data, size_t max)
+{
+    FILE *f = fopen(path, "rb");
+    TEST_ASSERT(f != NULL);
+    if (!f)
+    {
+        return 0;
+    }
+    size_t len = fread(data, 1, max, f);
+    TEST_ASSERT(len > 0 && len < max);
+    fclose(f);
+    return len;
+}
+
+static uint8_t old_image[PARTITION_SIZE];
+static size_t old_len;
+static uint8_t new_image[PARTITION_SIZE];
+static size_t new_len;
+
+static void load_running(const uint8_t *image, size_t len)
+{
+    memcpy(running.data, image, len);
+    running.len = len;
+}
+
+static size_t load_staging(const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", OTA_PACK_DIR, name);
+    return load_file(path, staging.data, sizeof(staging.data));
+}
+
+static esp_err_t install(size_t filesize)
+{
+    boot = NULL;
+    ota_begins = 0;
+    ota_aborts = 0;
+    esp_err_t ret = esp_mesh_lite_ota_pack_install(&staging.part, filesize);
+    TEST_ASSERT(!ota_open);
+    return ret;
+}
+
+static bool installed(const uint8_t *image, size_t len)
+{
+    return boot == &update.part && update.len == len && !memcmp(update.data, image, len);
+}
+
+static void test_plain(void)
+{
+    memcpy(staging.data, new_image, new_len);
+    TEST_ASSERT(install(new_len) == ESP_OK);
+    TEST_ASSERT(installed(new_image, new_len));
+}
+
+static void test_full(void)
+{
+    size_t filesize = load_staging("full.mlpk");
+    TEST_ASSERT(install(filesize) == ESP_OK);
+    TEST_ASSERT(installed(new_image, new_len));
+
+    filesize = load_staging("full_raw.mlpk");
+    TEST_ASSERT(install(filesize) == ESP_OK);
+    TEST_ASSERT(installed(new_image, new_len));
+}
+
+static void test_delta(void)
+{
+    load_running(old_image, old_len);
+    size_t filesize = load_staging("delta.mlpk");
+    TEST_ASSERT(install(filesize) == ESP_OK);
+    TEST_ASSERT(installed(new_image, new_len));
+
+    filesize = load_staging("delta_raw.mlpk");
+    TEST_ASSERT(install(filesize) == ESP_OK);
+    TEST_ASSERT(installed(new_image, new_len));
+}
+
+static void test_wrong_source(void)
+{
+    /* Already updated: the delta must not be applied to the new image, nothing is written */
+    load_running(new_image, new_len);
+    size_t filesize = load_staging("delta.mlpk");
+    TEST_ASSERT(install(filesize) == ESP_ERR_INVALID_VERSION);
+    TEST_ASSERT(boot == NULL && ota_begins == 0);
+    load_running(old_image, old_len);
+}
+
+static void test_corrupt(void)
+{
+    esp_mesh_lite_ota_pack_header_t header;
+
+    /* A flipped image byte decodes to the wrong image */
+    size_t filesize = load_staging("full_raw.mlpk");
+    staging.data[filesize - 1] ^= 0x01;
+    TEST_ASSERT(install(filesize) == ESP_ERR_INVALID_CRC);
+    TEST_ASSERT(boot == NULL);
+
+    /* A flipped top byte of the length of the first copy runs past the image size */
+    filesize = load_staging("delta_raw.mlpk");
+    size_t op = sizeof(header);
+    while (staging.data[op] != ESP_MESH_LITE_OTA_DELTA_COPY)
+    {
+        TEST_ASSERT(op < filesize);
+        uint32_t len;
+        if (staging.data[op] == ESP_MESH_LITE_OTA_DELTA_INSERT)
+        {
+            memcpy(&len, staging.data + op + 1, sizeof(len));
+            op += 1 + 4 + len;
+        }
+        else
+        {
+            memcpy(&len, staging.data + op + 5, sizeof(len));
+            op += 1 + 8 + len;
+        }
+    }
+    staging.data[op + 8] ^= 0x01;
+    TEST_ASSERT(install(filesize) == ESP_ERR_INVALID_SIZE);
+    TEST_ASSERT(boot == NULL && ota_aborts == 1);
+
+    /* In a deflated payload, inflate catches it on the way */
+    filesize = load_staging("full.mlpk");
+    staging.data[sizeof(header) + (filesize - sizeof(header)) / 2] ^= 0x10;
+    TEST_ASSERT(install(filesize) != ESP_OK);
+    TEST_ASSERT(boot == NULL && ota_aborts == 1);
+
+    /* A file cut short of its payload is refused before the update partition is touched */
+    filesize = load_staging("delta.mlpk");
+    TEST_ASSERT(install(filesize - 1) == ESP_ERR_NOT_SUPPORTED);
+    TEST_ASSERT(boot == NULL && ota_begins == 0);
+
+    /* A payload that ends early, in the middle of an op or of the zlib stream */
+    static const char *const packs[] = {"delta_raw.mlpk", "delta.mlpk", "full.mlpk"};
+    for (size_t i = 0; i < sizeof(packs) / sizeof(packs[0]); i++)
+    {
+        filesize = load_staging(packs[i]);
+        memcpy(&header, staging.data, sizeof(header));
+        header.payload_size -= 3;
+        memcpy(staging.data, &header, sizeof(header));
+        TEST_ASSERT(install(filesize) == ESP_ERR_INVALID_SIZE);
+        TEST_ASSERT(boot == NULL && ota_aborts == 1);
+    }
+}
+
+/*
+ * Ops of 1 to 40 bytes over the whole image, so every op header and data run starts at all
+ * offsets of the 1 KB reads. The reference result is built alongside.
+ */
+static size_t make_small_ops(uint8_t *payload, uint8_t *image, size_t len)
+{
+    size_t p = 0;
+    size_t out = 0;
+
+    while (out < len)
+    {
+        uint32_t n = 1 + rng() % 40;
+        uint32_t src = rng() % (old_len - n);
+        uint8_t op = ESP_MESH_LITE_OTA_DELTA_COPY + rng() % 3;
+
+        n = n < len - out ? n : len - out;
+        payload[p++] = op;
+        if (op != ESP_MESH_LITE_OTA_DELTA_INSERT)
+        {
+            memcpy(payload + p, &src, 4);
+            p += 4;
+        }
+        memcpy(payload + p, &n, 4);
+        p += 4;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint8_t byte = rng();
+            if (op == ESP_MESH_LITE_OTA_DELTA_COPY)
+            {
+                image[out++] = old_image[src + i];
+            }
+            else if (op == ESP_MESH_LITE_OTA_DELTA_ADD)
+            {
+                payload[p++] = byte;
+                image[out++] = old_image[src + i] + byte;
+            }
+            else
+            {
+                payload[p++] = byte;
+                image[out++] = byte;
+            }
+        }
+    }
+    return p;
+}
+
+static void test_ops_across_reads(void)
+{
+    static uint8_t image[PARTITION_SIZE];
+    esp_mesh_lite_ota_pack_header_t header = {
+        .magic = ESP_MESH_LITE_OTA_PACK_MAGIC,
+        .version = ESP_MESH_LITE_OTA_PACK_VERSION,
+        .type = ESP_MESH_LITE_OTA_PACK_DELTA,
+        .image_size = new_len,
+    };
+
+    load_running(old_image, old_len);
+    header.payload_size = make_small_ops(staging.data + sizeof(header), image, new_len);
+    SHA256(image, new_len, header.image_sha256);
+    SHA256(old_image, old_len, header.source_sha256);
+    memcpy(staging.data, &header, sizeof(header));
+
+    TEST_ASSERT(install(sizeof(header) + header.payload_size) == ESP_OK);
+    TEST_ASSERT(installed(image, new_len));
+}
+
+static void bench_pack(const char *name, const char *file)
+{
+    size_t filesize;
+    if (file)
+    {
+        filesize = load_staging(file);
+    }
+    else
+    {
+        filesize = new_len;
+        memcpy(staging.data, new_image, new_len);
+    }
+
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_RUNS; i++)
+    {
+        TEST_ASSERT(install(filesize) == ESP_OK);
+    }
+    double us = (host_test_now_ns() - start) / 1e3 / BENCH_RUNS;
+    TEST_ASSERT(installed(new_image, new_len));
+    printf("BENCH   %-22s %7u %7.1f%% %9.0f %8.0f\n", name, (unsigned)filesize, 100.0 * filesize / new_len, us,
+           new_len / us);
+}
+
+static void bench_transfer(void)
+{
+    load_running(old_image, old_len);
+    printf("BENCH old image %u bytes, new image %u bytes\n", (unsigned)old_len, (unsigned)new_len);
+    printf("BENCH   pack                     bytes   image   install us   MB/s\n");
+    bench_pack("plain image", NULL);
+    bench_pack("full, no compression", "full_raw.mlpk");
+    bench_pack("full, deflated", "full.mlpk");
+    bench_pack("delta, no compression", "delta_raw.mlpk");
+    bench_pack("delta, deflated", "delta.mlpk");
+}
+
+int main(void)
+{
+    old_len = load_file(OTA_IMAGE_OLD, old_image, sizeof(old_image));
+    new_len = load_file(OTA_IMAGE_NEW, new_image, sizeof(new_image));
+    TEST_ASSERT(old_len == new_len ? memcmp(old_image, new_image, old_len) != 0 : true);
+
+    RUN_TEST(test_plain);
+    RUN_TEST(test_full);
+    RUN_TEST(test_delta);
+    RUN_TEST(test_wrong_source);
+    RUN_TEST(test_corrupt);
+    RUN_TEST(test_ops_across_reads);
+    RUN_TEST(bench_transfer);
+    return host_test_result();
+}
@@ -0,0 +1,361 @@
+/*
+ * parent_select: the ETX cost of a candidate, learning the delivery ratio from offer gaps, and a
+ * simulation of a node among lossy candidates reporting which parent it settles on against the
+ * RSSI pick, how long that takes and how often two equal parents make it switch.
+ */
+#include <stdlib.h>
+#include "host_test.h"
+
+/* The evaluation is static, the test runs it in place of the offer timer */
+#include "../main/parent_select.c"
+
+#define SIM_STEP_US PARENT_OFFER_INTERVAL_US
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t bssid[ESP_NOW_ETH_ALEN];
+    uint8_t level;
+    uint16_t path_cost;
+    uint8_t child_num;
+    int8_t rssi;
+    float loss;         /* Of each frame, in either direction */
+    uint16_t seq;
+    bool accepts;       /* Lets the station associate */
+} sim_candidate_t;
+
+static int64_t now_us = 1;
+static sim_candidate_t sim_candidates[4];
+static int sim_candidate_num;
+static const sim_candidate_t *sim_parent;   /* NULL while not associated */
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+uint8_t esp_mesh_lite_get_level(void)
+{
+    return sim_parent ? sim_parent->level + 1 : 0;
+}
+
+esp_err_t esp_mesh_lite_get_ssid_by_mac_cb_register(esp_mesh_lite_get_ssid_by_mac_cb_t cb, bool whitelist)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (sim_parent == NULL)
+    {
+        return ESP_FAIL;
+    }
+    memcpy(ap_info->bssid, sim_parent->bssid, ESP_NOW_ETH_ALEN);
+    ap_info->rssi = sim_parent->rssi;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    sim_parent = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send_parent_offer(const uint8_t *data, size_t len)
+{
+    return ESP_OK;
+}
+
+void espnow_get_queue_stats(uint32_t *depth, uint32_t *drops)
+{
+}
+
+esp_err_t metrics_counter_register(metrics_counter_t *counter, const char *name, const char *help)
+{
+    return ESP_OK;
+}
+
+esp_err_t metrics_collector_register(metrics_collect_t collect, void *arg)
+{
+    return ESP_OK;
+}
+
+void metrics_printf(metrics_writer_t *writer, const char *fmt, ...)
+{
+}
+
+static void sim_reset(void)
+{
+    memset(parent_slots, 0, sizeof(parent_slots));
+    memset(parent_bssid, 0, sizeof(parent_bssid));
+    memset(&parent_switches, 0, sizeof(parent_switches));
+    memset(&parent_switch_failures, 0, sizeof(parent_switch_failures));
+    parent_pin_until = 0;
+    parent_since = 0;
+    parent_better_count = 0;
+    sim_candidate_num = 0;
+    sim_parent = NULL;
+}
+
+static sim_candidate_t *sim_candidate_add(uint8_t id, uint8_t level, uint16_t path_cost, int8_t rssi, float loss)
+{
+    sim_candidate_t *candidate = &sim_candidates[sim_candidate_num++];
+    const uint8_t mac[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0, 0, id};
+
+    memset(candidate, 0, sizeof(*candidate));
+    memcpy(candidate->mac, mac, ESP_NOW_ETH_ALEN);
+    memcpy(candidate->bssid, mac, ESP_NOW_ETH_ALEN);
+    candidate->bssid[5]++;  // softAP MAC follows the station MAC
+    candidate->level = level;
+    candidate->path_cost = path_cost;
+    candidate->child_num = 1;
+    candidate->rssi = rssi;
+    candidate->loss = loss;
+    candidate->accepts = true;
+    return candidate;
+}
+
+static void sim_offer(sim_candidate_t *candidate)
+{
+    parent_offer_t offer = {
+        .seq = ++candidate->seq,
+        .level = candidate->level,
+        .child_num = candidate->child_num,
+        .max_child = 10,
+        .path_cost = candidate->path_cost,
+        .ssid_len = 4,
+        .ssid = "mesh",
+    };
+    memcpy(offer.bssid, candidate->bssid, ESP_NOW_ETH_ALEN);
+
+    if (rng() % 1000 >= candidate->loss * 1000)
+    {
+        parent_select_offer_rx(candidate->mac, candidate->rssi, (const uint8_t *)&offer, sizeof(offer));
+    }
+}
+
+/* Like mesh-lite after a disconnect: join the first candidate the whitelist lets through */
+static void sim_associate(void)
+{
+    for (int i = 0; i < sim_candidate_num && sim_parent == NULL; i++)
+    {
+        if (sim_candidates[i].accepts && parent_ssid_by_mac(sim_candidates[i].bssid))
+        {
+            sim_parent = &sim_candidates[i];
+        }
+    }
+}
+
+/* One offer interval: every candidate offers, then the node evaluates */
+static void sim_step(void)
+{
+    now_us += SIM_STEP_US;
+    for (int i = 0; i < sim_candidate_num; i++)
+    {
+        sim_offer(&sim_candidates[i]);
+    }
+    if (sim_parent == NULL)
+    {
+        sim_associate();
+    }
+    uint8_t level = esp_mesh_lite_get_level();
+    if (level)
+    {
+        parent_evaluate(level, now_us);
+    }
+}
+
+static uint32_t candidate_cost(const sim_candidate_t *candidate)
+{
+    parent_candidate_t candidates[CONFIG_APP_PARENT_CANDIDATES];
+    size_t num = parent_select_list(candidates, CONFIG_APP_PARENT_CANDIDATES);
+
+    for (size_t i = 0; i < num; i++)
+    {
+        if (!memcmp(candidates[i].bssid, candidate->bssid, ESP_NOW_ETH_ALEN))
+        {
+            return candidates[i].cost;
+        }
+    }
+    return 0;
+}
+
+/* Transmissions for a frame to reach the root through a candidate, from the true losses */
+static float true_etx(const sim_candidate_t *candidate, float upstream_etx)
+{
+    float delivery = 1 - candidate->loss;
+    return 1 / (delivery * delivery) + upstream_etx;
+}
+
+static void test_cost_of_a_clean_link(void)
+{
+    sim_reset();
+    sim_candidate_t *root = sim_candidate_add(1, 1, 0, -50, 0);
+    sim_candidate_t *other = sim_candidate_add(3, 2, 175, -50, 0);
+    sim_parent = other;
+
+    sim_offer(root);
+    // Path cost 0, one transmission, one hop and two stations with this node
+    TEST_ASSERT(candidate_cost(root) == PARENT_COST_UNIT + CONFIG_APP_PARENT_HOP_COST + 2 * CONFIG_APP_PARENT_CHILD_COST);
+
+    // Every other offer lost: about half delivered each way, about four transmissions
+    for (int i = 0; i < 100; i++)
+    {
+        root->seq++;
+        sim_offer(root);
+    }
+    parent_candidate_t candidate;
+    parent_select_list(&candidate, 1);
+    uint32_t etx = PARENT_COST_UNIT * 1000 * 1000 / (candidate.delivery * candidate.delivery);
+    TEST_ASSERT(candidate.delivery >= 450 && candidate.delivery <= 550);
+    TEST_ASSERT(candidate_cost(root) == etx + CONFIG_APP_PARENT_HOP_COST + 2 * CONFIG_APP_PARENT_CHILD_COST);
+
+    // At the level of this node or below it may be a descendant
+    sim_candidate_t *peer = sim_candidate_add(5, 3, 300, -50, 0);
+    sim_offer(peer);
+    TEST_ASSERT(candidate_cost(peer) == PARENT_COST_MAX);
+}
+
+static void test_lossy_parent_vs_relay(void)
+{
+    sim_reset();
+    // The strongest parent is behind a wall of interference, a weaker relay has a clean link
+    sim_candidate_t *lossy = sim_candidate_add(3, 2, 175, -60, 0.45f);
+    sim_candidate_t *relay = sim_candidate_add(5, 2, 175, -75, 0.02f);
+    sim_candidate_t *root = sim_candidate_add(1, 1, 0, -88, 0.7f);
+    sim_parent = lossy;
+
+    int switched_s = -1;
+    for (int i = 0; i < 600 * 1000000LL / SIM_STEP_US; i++)
+    {
+        sim_step();
+        if (switched_s < 0 && sim_parent == relay)
+        {
+            switched_s = (i + 1) * SIM_STEP_US / 1000000;
+        }
+    }
+
+    // Both relays have a clean link to the root
+    printf("BENCH cost lossy parent %" PRIu32 ", relay %" PRIu32 ", switched to the relay after %d s\n",
+           candidate_cost(lossy), candidate_cost(relay), switched_s);
+    printf("BENCH transmissions to the root: RSSI pick %.2f, ETX pick %.2f, root directly %.2f\n",
+           true_etx(lossy, 1), true_etx(relay, 1), true_etx(root, 0));
+
+    TEST_ASSERT(sim_parent == relay);
+    // Not before the minimum dwell, then the hold
+    TEST_ASSERT(switched_s >= CONFIG_APP_PARENT_MIN_DWELL_S && switched_s < CONFIG_APP_PARENT_MIN_DWELL_S + 30);
+    TEST_ASSERT(metrics_counter_get(&parent_switches) == 1);
+}
+
+static void test_no_flapping(void)
+{
+    sim_reset();
+    // Two relays alike, the noise of the delivery averages must not move the node back and forth
+    sim_candidate_t *a = sim_candidate_add(3, 2, 175, -65, 0.15f);
+    sim_candidate_add(5, 2, 175, -65, 0.15f);
+    sim_candidate_add(1, 1, 0, -88, 0.7f);
+    sim_parent = a;
+
+    int cheaper = 0;
+    int steps = 3600 * 1000000LL / SIM_STEP_US;
+    for (int i = 0; i < steps; i++)
+    {
+        sim_step();
+        uint32_t current = candidate_cost(sim_parent ? sim_parent : a);
+        for (int j = 0; j < sim_candidate_num; j++)
+        {
+            if (&sim_candidates[j] != sim_parent && candidate_cost(&sim_candidates[j]) < current)
+            {
+                cheaper++;
+                break;
+            }
+        }
+    }
+    printf("BENCH two equal relays for 1 h: another candidate cheaper in %d of %d evaluations, %" PRIu64 " switches\n",
+           cheaper, steps, metrics_counter_get(&parent_switches));
+    TEST_ASSERT(metrics_counter_get(&parent_switches) <= 2);
+}
+
+static void test_failed_switch_blocks(void)
+{
+    sim_reset();
+    sim_candidate_t *lossy = sim_candidate_add(3, 2, 175, -60, 0.45f);
+    sim_candidate_t *relay = sim_candidate_add(5, 2, 175, -75, 0);
+    relay->accepts = false;
+    sim_parent = lossy;
+
+    // Switches to the relay, which never takes the station: back to the old parent once the pin lapses,
+    // the relay blocked for the dwell
+    int64_t disconnected_us = 0;
+    int64_t end_us = now_us + 600 * 1000000LL;
+    while (metrics_counter_get(&parent_switch_failures) == 0 && now_us < end_us)
+    {
+        sim_step();
+        disconnected_us += sim_parent ? 0 : SIM_STEP_US;
+    }
+    printf("BENCH switch to a parent that does not take the station: %lld s disconnected\n",
+           (long long)(disconnected_us / 1000000));
+    TEST_ASSERT(metrics_counter_get(&parent_switch_failures) == 1);
+    TEST_ASSERT(sim_parent == lossy);
+    TEST_ASSERT(disconnected_us <= PARENT_PIN_TIMEOUT_US + SIM_STEP_US);
+    TEST_ASSERT(parent_ssid_by_mac(relay->bssid) == NULL);
+}
+
+static void test_bench_cost(void)
+{
+    sim_reset();
+    for (int i = 0; i < 4; i++)
+    {
+        sim_candidate_add(1 + 2 * i, i ? 2 : 1, i ? 175 : 0, -60, 0.1f);
+    }
+    sim_parent = &sim_candidates[0];
+
+    int64_t t0 = host_test_now_ns();
+    for (int i = 0; i < 100000; i++)
+    {
+        sim_offer(&sim_candidates[i & 3]);
+    }
+    int64_t t1 = host_test_now_ns();
+    for (int i = 0; i < 100000; i++)
+    {
+        parent_evaluate(2, now_us);
+    }
+    int64_t t2 = host_test_now_ns();
+    printf("BENCH offer rx %.0f ns, evaluation of %d candidates %.0f ns, %zu bytes per candidate\n",
+           (t1 - t0) / 1e5, sim_candidate_num, (t2 - t1) / 1e5, sizeof(parent_slot_t));
+}
+
+int main(void)
+{
+    RUN_TEST(test_cost_of_a_clean_link);
+    RUN_TEST(test_lossy_parent_vs_relay);
+    RUN_TEST(test_no_flapping);
+    RUN_TEST(test_failed_switch_blocks);
+    RUN_TEST(test_bench_cost);
+    return host_test_result();
+}
@@ -0,0 +1,313 @@
+/*
+ * sensor_codec: round trips of both value codecs, frames cut at the buffer end, error returns,
+ * and a benchmark of the compression ratio and the encode/decode cost on synthetic sensor traces.
+ */
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "sensor_codec.h"
+
+#define FRAME_LEN 244   /* SENSOR_FRAME_LEN with v1 ESP-NOW frames */
+#define TRACE_LEN 4096
+
+typedef struct
+{
+    sensor_packet_t packets[TRACE_LEN];
+    size_t count;
+} decoded_t;
+
+static void decoded_cb(const sensor_packet_t *packet, void *arg)
+{
+    decoded_t *decoded = arg;
+    if (decoded->count < TRACE_LEN)
+    {
+        decoded->packets[decoded->count++] = *packet;
+    }
+}
+
+static float packet_value(const sensor_packet_t *packet)
+{
+    return packet->data.generic.value;
+}
+
+static uint32_t rng_state = 12345;
+
+static float noise(void)
+{
+    // Sum of uniforms, close enough to a normal distribution with sigma 1
+    float sum = 0;
+    for (int i = 0; i < 12; i++)
+    {
+        rng_state = rng_state * 1664525 + 1013904223;
+        sum += (rng_state >> 8) / (float)(1 << 24);
+    }
+    return sum - 6;
+}
+
+/* 1 Hz readings with a few ms of scheduling jitter, the value a slow wave plus sensor noise */
+static void trace_fill(sensor_packet_t *packets, size_t count, uint32_t sensor_id, sensor_type_t type,
+                       float base, float swing, float sigma)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        packets[i].timestamp = (1700000000000ULL + i * 1000 + (int)(noise() * 3)) * 1000;
+        packets[i].sensor_id = sensor_id;
+        packets[i].type = type;
+        packets[i].data.generic.value = base + swing * sinf(i / 600.0f) + sigma * noise();
+    }
+}
+
+static void test_qdelta_round_trip(void)
+{
+    static sensor_packet_t packets[64];
+    static decoded_t decoded;
+    uint8_t frame[1470];
+
+    trace_fill(packets, 64, 7, SENSOR_TYPE_TEMPERATURE, 22.5f, 3.0f, 0.05f);
+    sensor_packet_t original[64];
+    memcpy(original, packets, sizeof(original));
+
+    size_t count = 64;
+    size_t len = sensor_codec_encode(packets, &count, frame, sizeof(frame));
+    TEST_ASSERT(len > 0 && count == 64);
+
+    decoded.count = 0;
+    TEST_ASSERT(sensor_codec_decode(frame, len, decoded_cb, &decoded) == ESP_OK);
+    TEST_ASSERT(decoded.count == 64);
+    for (size_t i = 0; i < decoded.count; i++)
+    {
+        // Timestamps travel in ms, values quantized to 0.01
+        TEST_ASSERT(decoded.packets[i].timestamp == original[i].timestamp / 1000 * 1000);
+        TEST_ASSERT(decoded.packets[i].sensor_id == 7 && decoded.packets[i].type == SENSOR_TYPE_TEMPERATURE);
+        TEST_ASSERT(fabsf(packet_value(&decoded.packets[i]) - packet_value(&original[i])) <= 0.005f + 1e-4f);
+    }
+}
+
+static void test_gorilla_lossless(void)
+{
+    static sensor_packet_t packets[64];
+    static decoded_t decoded;
+    uint8_t frame[1470];
+
+    trace_fill(packets, 64, 1000000, SENSOR_TYPE_GENERIC, 1.0f, 0.5f, 0.01f);
+    packets[10].data.generic.value = packets[9].data.generic.value;  // Repeated value
+    packets[20].data.generic.value = -1e30f;                          // Sign and exponent change
+    packets[21].data.generic.value = 0.0f;
+    packets[40].timestamp += 3600000000ULL;                           // Varint escape of the timestamps
+    sensor_packet_t original[64];
+    memcpy(original, packets, sizeof(original));
+
+    size_t count = 64;
+    size_t len = sensor_codec_encode(packets, &count, frame, sizeof(frame));
+    TEST_ASSERT(count == 64);
+
+    decoded.count = 0;
+    TEST_ASSERT(sensor_codec_decode(frame, len, decoded_cb, &decoded) == ESP_OK);
+    TEST_ASSERT(decoded.count == 64);
+    for (size_t i = 0; i < decoded.count; i++)
+    {
+        TEST_ASSERT(decoded.packets[i].timestamp == original[i].timestamp / 1000 * 1000);
+        TEST_ASSERT(!memcmp(&decoded.packets[i].data, &original[i].data, sizeof(float)));
+    }
+}
+
+/* Interleaved sensors: a full frame takes what fits, grouped per sensor, and leaves the rest in order */
+static void test_frame_cut(void)
+{
+    static sensor_packet_t packets[300];
+    static sensor_packet_t original[300];
+    static decoded_t decoded;
+    uint8_t frame[FRAME_LEN];
+
+    for (size_t i = 0; i < 300; i++)
+    {
+        trace_fill(&packets[i], 1, i % 3, i % 3 == 2 ? SENSOR_TYPE_GENERIC : SENSOR_TYPE_HUMIDITY, 50.0f, 0, 0.5f);
+        packets[i].timestamp += i / 3 * 1000000;
+    }
+    memcpy(original, packets, sizeof(packets));
+
+    size_t left = 300;
+    size_t frames = 0;
+    size_t per_sensor[3] = {0};
+    sensor_packet_t *next = packets;
+    while (left)
+    {
+        size_t count = left;
+        size_t len = sensor_codec_encode(next, &count, frame, sizeof(frame));
+        TEST_ASSERT(len > 0 && len <= sizeof(frame) && count > 0);
+        if (count == 0)
+        {
+            break;
+        }
+
+        decoded.count = 0;
+        TEST_ASSERT(sensor_codec_decode(frame, len, decoded_cb, &decoded) == ESP_OK);
+        TEST_ASSERT(decoded.count == count);
+        for (size_t i = 0; i < decoded.count; i++)
+        {
+            // Per sensor, readings come out in the order they went in, none lost or repeated
+            uint32_t id = decoded.packets[i].sensor_id;
+            const sensor_packet_t *expected = &original[per_sensor[id]++ * 3 + id];
+            TEST_ASSERT(decoded.packets[i].timestamp == expected->timestamp / 1000 * 1000);
+        }
+        next += count;
+        left -= count;
+        frames++;
+    }
+    TEST_ASSERT(per_sensor[0] == 100 && per_sensor[1] == 100 && per_sensor[2] == 100);
+    TEST_ASSERT(frames > 1);
+}
+
+static void test_decode_errors(void)
+{
+    static sensor_packet_t packets[16];
+    static decoded_t decoded;
+    uint8_t frame[FRAME_LEN];
+
+    trace_fill(packets, 16, 1, SENSOR_TYPE_TEMPERATURE, 20.0f, 1.0f, 0.1f);
+    size_t count = 16;
+    size_t len = sensor_codec_encode(packets, &count, frame, sizeof(frame));
+
+    decoded.count = 0;
+    TEST_ASSERT(sensor_codec_decode(frame, len - 2, decoded_cb, &decoded) == ESP_ERR_INVALID_SIZE);
+    TEST_ASSERT(decoded.count < 16);
+
+    frame[0] = SENSOR_CODEC_VERSION + 1;
+    TEST_ASSERT(sensor_codec_decode(frame, len, decoded_cb, &decoded) == ESP_ERR_NOT_SUPPORTED);
+
+    // Too small for the header
+    count = 16;
+    TEST_ASSERT(sensor_codec_encode(packets, &count, frame, 1) == 0 && count == 0);
+}
+
+typedef struct
+{
+    int64_t ts[256];
+    float value[256];
+    size_t count;
+} points_t;
+
+static bool points_cb(int64_t timestamp_ms, float value, void *arg)
+{
+    points_t *points = arg;
+    points->ts[points->count] = timestamp_ms;
+    points->value[points->count] = value;
+    return ++points->count == 256;
+}
+
+static void test_series_append(void)
+{
+    sensor_codec_series_t series;
+    uint8_t buf[64];
+    static points_t points;
+
+    sensor_codec_series_init(&series, SENSOR_CODEC_GORILLA);
+    size_t appended = 0;
+    while (sensor_codec_series_append(&series, buf, sizeof(buf), 1000 + appended * 1000, 3.25f + (appended % 4)))
+    {
+        appended++;
+    }
+    TEST_ASSERT(appended > 8 && series.count == appended);
+    TEST_ASSERT(series.bits <= sizeof(buf) * 8);
+
+    // The reading that did not fit left the series as it was
+    uint16_t bits = series.bits;
+    TEST_ASSERT(!sensor_codec_series_append(&series, buf, sizeof(buf), 1000 + appended * 1000, 1e9f));
+    TEST_ASSERT(series.bits == bits && series.count == appended);
+
+    points.count = 0;
+    TEST_ASSERT(sensor_codec_series_decode(SENSOR_CODEC_GORILLA, series.count, buf, sizeof(buf), points_cb, &points) == ESP_OK);
+    TEST_ASSERT(points.count == appended);
+    for (size_t i = 0; i < points.count; i++)
+    {
+        TEST_ASSERT(points.ts[i] == 1000 + (int64_t)i * 1000);
+        TEST_ASSERT(points.value[i] == 3.25f + (i % 4));
+    }
+    TEST_ASSERT(sensor_codec_series_decode(SENSOR_CODEC_GORILLA + 1, 1, buf, sizeof(buf), points_cb, &points) == ESP_ERR_NOT_SUPPORTED);
+}
+
+/*
+ * Encode a trace frame by frame as the batcher does, 64 readings per batch, and report the bytes
+ * against the 24-byte sensor_packet_t structs sent before the codec.
+ */
+static void bench_trace(const char *name, sensor_packet_t *trace, size_t count, size_t frame_len)
+{
+    static sensor_packet_t batch[64];
+    static decoded_t decoded;
+    uint8_t frame[1470];
+    size_t bytes = 0;
+    size_t frames = 0;
+    int64_t encode_ns = 0;
+    int64_t decode_ns = 0;
+
+    for (int round = 0; round < 20; round++)
+    {
+        size_t next = 0;
+        bytes = 0;
+        frames = 0;
+        while (next < count)
+        {
+            size_t n = count - next < 64 ? count - next : 64;
+            memcpy(batch, &trace[next], n * sizeof(sensor_packet_t));
+            size_t left = n;
+            sensor_packet_t *p = batch;
+            while (left)
+            {
+                size_t done = left;
+                int64_t t0 = host_test_now_ns();
+                size_t len = sensor_codec_encode(p, &done, frame, frame_len);
+                int64_t t1 = host_test_now_ns();
+                decoded.count = 0;
+                sensor_codec_decode(frame, len, decoded_cb, &decoded);
+                int64_t t2 = host_test_now_ns();
+                encode_ns += t1 - t0;
+                decode_ns += t2 - t1;
+                bytes += len;
+                frames++;
+                p += done;
+                left -= done;
+            }
+            next += n;
+        }
+    }
+
+    printf("BENCH %-22s frame %4zu B: %5.2f B/reading, ratio %5.2fx, %4zu frames (raw %4zu), encode %5.1f ns, decode %5.1f ns per reading\n",
+           name, frame_len, (double)bytes / count, (double)count * sizeof(sensor_packet_t) / bytes, frames,
+           (count + frame_len / sizeof(sensor_packet_t) - 1) / (frame_len / sizeof(sensor_packet_t)),
+           (double)encode_ns / 20 / count, (double)decode_ns / 20 / count);
+}
+
+static void bench_compression(void)
+{
+    static sensor_packet_t trace[TRACE_LEN];
+
+    trace_fill(trace, TRACE_LEN, 1, SENSOR_TYPE_TEMPERATURE, 22.5f, 3.0f, 0.02f);
+    bench_trace("temperature", trace, TRACE_LEN, FRAME_LEN);
+    bench_trace("temperature", trace, TRACE_LEN, 1464);
+
+    trace_fill(trace, TRACE_LEN, 2, SENSOR_TYPE_HUMIDITY, 45.0f, 10.0f, 0.2f);
+    bench_trace("humidity", trace, TRACE_LEN, FRAME_LEN);
+
+    trace_fill(trace, TRACE_LEN, 3, SENSOR_TYPE_GENERIC, 1.0f, 0.2f, 0.001f);
+    bench_trace("generic (gorilla)", trace, TRACE_LEN, FRAME_LEN);
+
+    // Three sensors interleaved, as they come out of the ring
+    for (size_t i = 0; i < TRACE_LEN; i++)
+    {
+        trace_fill(&trace[i], 1, i % 3, i % 3 + 1, 20.0f + 10 * (i % 3), 0, 0.05f);
+        trace[i].timestamp += i / 3 * 1000000;
+    }
+    bench_trace("3 sensors interleaved", trace, TRACE_LEN, FRAME_LEN);
+}
+
+int main(void)
+{
+    RUN_TEST(test_qdelta_round_trip);
+    RUN_TEST(test_gorilla_lossless);
+    RUN_TEST(test_frame_cut);
+    RUN_TEST(test_decode_errors);
+    RUN_TEST(test_series_append);
+    bench_compression();
+    return host_test_result();
+}
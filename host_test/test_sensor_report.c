@@ -0,0 +1,434 @@
+/*
+ * sensor: the report-by-exception triggers one by one, a reading dropped on a full ring, the error
+ * bound the deadband keeps on a trace, and the frames and airtime a node spends on a day of synthetic
+ * room readings with the driver policies against sending every sample.
+ */
+#include <math.h>
+#include <string.h>
+#include "host_test.h"
+#include "../main/sensor.c"
+
+#define DAY_S (24 * 3600)
+/* MAC header, action frame and vendor element around an ESP-NOW payload, FCS included */
+#define ESPNOW_FRAME_OVERHEAD 43
+#define ESPNOW_PREAMBLE_US 192 /* 1 Mbit/s long preamble, the ESP-NOW default rate */
+#define BENCH_CHECKS 1000000
+
+static int64_t now_us = 1;
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task)
+{
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    return 0;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return now_us / 1000;
+}
+
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t increment)
+{
+    *prev_wake += increment;
+}
+
+static void sensor_reset(void)
+{
+    sensor_packet_t packet;
+    memset(sensor_entries, 0, sizeof(sensor_entries));
+    memset(sensor_wheel, 0, sizeof(sensor_wheel));
+    sensor_entry_num = 0;
+    while (sensor_ring_pop(&sensor_ring, &packet))
+    {
+    }
+}
+
+static esp_err_t value_sample(void *ctx, float *value)
+{
+    *value = *(float *)ctx;
+    return ESP_OK;
+}
+
+static const sensor_driver_t value_driver = {
+    .name = "value",
+    .type = SENSOR_TYPE_GENERIC,
+    .period_ms = 1000,
+    .sample = value_sample,
+};
+
+static float value;
+
+/* Samples the value sensor at t_ms, true if the reading was queued for sending */
+static bool sample_at(uint32_t sensor_id, float v, int64_t t_ms)
+{
+    sensor_packet_t packet;
+    now_us = t_ms * 1000;
+    value = v;
+    sensor_sample_one(sensor_find(sensor_id));
+    if (!sensor_ring_pop(&sensor_ring, &packet))
+    {
+        return false;
+    }
+    TEST_ASSERT(packet.sensor_id == sensor_id && packet.data.generic.value == v);
+    TEST_ASSERT(packet.timestamp == (uint64_t)now_us);
+    return true;
+}
+
+static void test_triggers(void)
+{
+    sensor_report_policy_t policy = {0};
+    sensor_report_stats_t stats = {0};
+
+    sensor_reset();
+    TEST_ASSERT(sensor_register(&value_driver, &value, 1, 0) == ESP_OK);
+
+    /* No trigger, every sample goes out */
+    TEST_ASSERT(sample_at(1, 20.0f, 0) && sample_at(1, 20.0f, 1000) && sample_at(1, 20.0f, 2000));
+
+    /* Absolute deadband against the last sent value, not the last sample */
+    policy.deadband_abs = 0.5f;
+    TEST_ASSERT(sensor_set_report_policy(1, &policy) == ESP_OK);
+    TEST_ASSERT(!sample_at(1, 20.4f, 3000));
+    TEST_ASSERT(!sample_at(1, 20.5f, 4000));
+    TEST_ASSERT(sample_at(1, 20.75f, 5000));
+    TEST_ASSERT(!sample_at(1, 20.3f, 6000));
+    TEST_ASSERT(sample_at(1, 20.0f, 7000));
+
+    /* Relative deadband, 10% of 20 */
+    policy.deadband_abs = 0;
+    policy.deadband_rel = 0.1f;
+    TEST_ASSERT(sensor_set_report_policy(1, &policy) == ESP_OK);
+    TEST_ASSERT(!sample_at(1, 21.5f, 8000));
+    TEST_ASSERT(sample_at(1, 22.5f, 9000));
+
+    /* A fast change is sent while it is still inside the deadband */
+    policy.deadband_abs = 0.5f;
+    policy.deadband_rel = 0;
+    policy.rate_of_change = 0.1f;
+    TEST_ASSERT(sensor_set_report_policy(1, &policy) == ESP_OK);
+    TEST_ASSERT(!sample_at(1, 22.55f, 10000));
+    TEST_ASSERT(sample_at(1, 22.8f, 11000));
+    TEST_ASSERT(!sample_at(1, 22.85f, 12000));
+
+    /* Minimum interval holds back even a large change */
+    policy.rate_of_change = 0;
+    policy.min_interval_ms = 5000;
+    TEST_ASSERT(sensor_set_report_policy(1, &policy) == ESP_OK);
+    TEST_ASSERT(!sample_at(1, 30.0f, 13000));
+    TEST_ASSERT(!sample_at(1, 30.0f, 15999));
+    TEST_ASSERT(sample_at(1, 30.0f, 16000));
+
+    /* Heartbeat of an unchanged value */
+    policy.min_interval_ms = 0;
+    policy.max_interval_ms = 60000;
+    TEST_ASSERT(sensor_set_report_policy(1, &policy) == ESP_OK);
+    for (int t = 17; t < 76; t++)
+    {
+        TEST_ASSERT(!sample_at(1, 30.0f, t * 1000));
+    }
+    TEST_ASSERT(sample_at(1, 30.0f, 76000));
+
+    TEST_ASSERT(sensor_get_report_stats(1, &stats) == ESP_OK);
+    TEST_ASSERT(stats.sent == 9 && stats.suppressed == 67);
+
+    TEST_ASSERT(sensor_set_report_policy(2, &policy) == ESP_ERR_NOT_FOUND);
+    TEST_ASSERT(sensor_set_report_policy(1, NULL) == ESP_ERR_INVALID_ARG);
+    TEST_ASSERT(sensor_get_report_stats(2, &stats) == ESP_ERR_NOT_FOUND);
+    TEST_ASSERT(sensor_get_report_stats(1, NULL) == ESP_ERR_INVALID_ARG);
+}
+
+/* A reading the ring has no room for is not sent, the deadband stays on the last reading that was */
+static void test_ring_full(void)
+{
+    sensor_report_policy_t policy = {.deadband_abs = 0.5f};
+    sensor_report_stats_t stats = {0};
+    sensor_packet_t filler = {0};
+
+    sensor_reset();
+    TEST_ASSERT(sensor_register(&value_driver, &value, 1, 0) == ESP_OK);
+    TEST_ASSERT(sensor_set_report_policy(1, &policy) == ESP_OK);
+    TEST_ASSERT(sample_at(1, 20.0f, 0));
+
+    while (sensor_ring_push(&sensor_ring, &filler))
+    {
+    }
+    now_us = 1000 * 1000;
+    value = 21.0f;
+    sensor_sample_one(sensor_find(1));
+    TEST_ASSERT(sensor_ring_count(&sensor_ring) == SENSOR_RING_SIZE);
+    TEST_ASSERT(sensor_get_report_stats(1, &stats) == ESP_OK);
+    TEST_ASSERT(stats.sent == 1 && stats.suppressed == 0 && stats.dropped == 1);
+
+    /* Within the deadband of the dropped reading, but not of the one the receiver holds */
+    while (sensor_ring_pop(&sensor_ring, &filler))
+    {
+    }
+    TEST_ASSERT(sample_at(1, 20.75f, 2000));
+    TEST_ASSERT(!sample_at(1, 21.0f, 3000));
+    TEST_ASSERT(sensor_get_report_stats(1, &stats) == ESP_OK);
+    TEST_ASSERT(stats.sent == 2 && stats.suppressed == 1 && stats.dropped == 1);
+}
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static float noise(void)
+{
+    // Sum of uniforms, close enough to a normal distribution with sigma 1
+    float sum = 0;
+    for (int i = 0; i < 12; i++)
+    {
+        sum += (rng() >> 8) / (float)(1 << 24);
+    }
+    return sum - 6;
+}
+
+typedef struct
+{
+    const char *name;
+    const sensor_driver_t *driver;
+    float (*model)(int t_s);
+    float resolution;
+    uint32_t sensor_id;
+    int64_t next_ms;
+} trace_t;
+
+static esp_err_t trace_sample(void *ctx, float *v)
+{
+    trace_t *trace = ctx;
+    float raw = trace->model(now_us / 1000000);
+    *v = roundf(raw / trace->resolution) * trace->resolution;
+    return ESP_OK;
+}
+
+static float diurnal(int t_s, float base, float swing)
+{
+    // Coldest at 5:00, warmest at 17:00
+    return base - swing * cosf(2 * (float)M_PI * (t_s - 5 * 3600) / DAY_S);
+}
+
+/* Room temperature, a window opened at 13:00 for 10 minutes */
+static float room_temperature(int t_s)
+{
+    float v = diurnal(t_s, 21.0f, 1.5f) + 0.05f * noise();
+    int since = t_s - 13 * 3600;
+    if (since > 0)
+    {
+        float drop = since < 600 ? 4.0f * since / 600 : 4.0f * expf(-(since - 600) / 1800.0f);
+        v -= drop;
+    }
+    return v;
+}
+
+/* Bathroom humidity, a shower at 7:00 */
+static float room_humidity(int t_s)
+{
+    float v = diurnal(t_s, 50.0f, -6.0f) + 0.2f * noise();
+    int since = t_s - 7 * 3600;
+    if (since > 0)
+    {
+        v += since < 300 ? 35.0f * since / 300 : 35.0f * expf(-(since - 300) / 1200.0f);
+    }
+    return MIN(v, 100.0f);
+}
+
+/* A reading that never changes, like the dummy humidity sensor */
+static float constant(int t_s)
+{
+    return 85.5f;
+}
+
+static const sensor_driver_t temperature_driver = {
+    .name = "temperature",
+    .type = SENSOR_TYPE_TEMPERATURE,
+    .period_ms = 30000,
+    .sample = trace_sample,
+    .policy = {
+        .deadband_abs = 0.5f,
+        .rate_of_change = 0.1f,
+        .max_interval_ms = 300000,
+    },
+};
+
+static const sensor_driver_t humidity_driver = {
+    .name = "humidity",
+    .type = SENSOR_TYPE_HUMIDITY,
+    .period_ms = 10000,
+    .sample = trace_sample,
+    .policy = {
+        .deadband_abs = 0.5f,
+        .max_interval_ms = 60000,
+    },
+};
+
+static trace_t traces[] = {
+    {"temperature", &temperature_driver, room_temperature, 0.1f, 1},
+    {"humidity", &humidity_driver, room_humidity, 0.1f, 2},
+    {"constant", &dummy_humidity_driver, constant, 0.1f, 3},
+};
+
+#define TRACE_NUM (sizeof(traces) / sizeof(traces[0]))
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t bytes;
+    uint64_t airtime_us;
+    float max_error[TRACE_NUM];     // Between the last sent value and the sample, every sample
+    int64_t max_gap_ms[TRACE_NUM];  // Between two sent readings
+} day_t;
+
+/* What sensor_main_task does when it wakes up */
+static void batch_send(day_t *day)
+{
+    static sensor_packet_t batch[SENSOR_BATCH_MAX];
+    size_t count = 0;
+    while (count < SENSOR_BATCH_MAX && sensor_ring_pop(&sensor_ring, &batch[count]))
+    {
+        count++;
+    }
+    while (count)
+    {
+        size_t encoded = count;
+        size_t len = sensor_codec_encode(batch, &encoded, sensor_frame, sizeof(sensor_frame));
+        TEST_ASSERT(encoded > 0);
+        if (encoded == 0)
+        {
+            return;
+        }
+        size_t frame_len = ESPNOW_FRAME_OVERHEAD + 1 + ESPNOW_PAYLOAD_HEAD_LEN + len;
+        day->frames++;
+        day->bytes += frame_len;
+        day->airtime_us += ESPNOW_PREAMBLE_US + frame_len * 8;
+        count -= encoded;
+        memmove(batch, &batch[encoded], count * sizeof(sensor_packet_t));
+    }
+}
+
+/*
+ * A day on one node sampling the traces on their driver periods, the batcher waking up every
+ * CONFIG_SENSOR_BATCH_TIMEOUT_MS. Every trigger disabled when send_all is set.
+ */
+static void day_run(day_t *day, bool send_all)
+{
+    static const sensor_report_policy_t all = {0};
+    int64_t last_sent_ms[TRACE_NUM] = {0};
+
+    memset(day, 0, sizeof(*day));
+    sensor_reset();
+    rng_state = 1;
+    for (size_t i = 0; i < TRACE_NUM; i++)
+    {
+        TEST_ASSERT(sensor_register(traces[i].driver, &traces[i], traces[i].sensor_id, 0) == ESP_OK);
+        if (send_all)
+        {
+            sensor_set_report_policy(traces[i].sensor_id, &all);
+        }
+        traces[i].next_ms = 0;
+    }
+
+    for (int64_t t_ms = 0; t_ms < DAY_S * 1000LL; t_ms += CONFIG_SENSOR_BATCH_TIMEOUT_MS)
+    {
+        for (size_t i = 0; i < TRACE_NUM; i++)
+        {
+            trace_t *trace = &traces[i];
+            if (t_ms < trace->next_ms)
+            {
+                continue;
+            }
+            sensor_entry_t *entry = sensor_find(trace->sensor_id);
+            uint32_t sent = entry->stats.sent;
+            now_us = t_ms * 1000 + 1;
+            sensor_sample_one(entry);
+            trace->next_ms += trace->driver->period_ms;
+
+            if (entry->stats.sent != sent)
+            {
+                day->max_gap_ms[i] = MAX(day->max_gap_ms[i], t_ms - last_sent_ms[i]);
+                last_sent_ms[i] = t_ms;
+            }
+            day->max_error[i] = MAX(day->max_error[i], fabsf(entry->last_value - entry->last_sent_value));
+        }
+        batch_send(day);
+    }
+}
+
+static void bench_day(void)
+{
+    static day_t all;
+    static day_t policy;
+    sensor_report_stats_t stats = {0};
+
+    day_run(&all, true);
+    day_run(&policy, false);
+
+    for (size_t i = 0; i < TRACE_NUM; i++)
+    {
+        const sensor_report_policy_t *p = &traces[i].driver->policy;
+        sensor_get_report_stats(traces[i].sensor_id, &stats);
+        /* Nothing the receiver holds is further off than the deadband, nor older than the heartbeat */
+        TEST_ASSERT(policy.max_error[i] <= p->deadband_abs + 1e-4f);
+        TEST_ASSERT(policy.max_gap_ms[i] <= p->max_interval_ms);
+        TEST_ASSERT(stats.sent + stats.suppressed == DAY_S * 1000 / traces[i].driver->period_ms);
+        printf("BENCH %-11s every %2" PRIu32 " s: %5" PRIu32 " samples, %4" PRIu32 " sent (%4.1f%%), held value off by %.2f at most\n",
+               traces[i].name, traces[i].driver->period_ms / 1000, stats.sent + stats.suppressed, stats.sent,
+               100.0 * stats.sent / (stats.sent + stats.suppressed), policy.max_error[i]);
+    }
+    TEST_ASSERT(policy.airtime_us * 2 < all.airtime_us);
+    printf("BENCH day of one node, every sample: %" PRIu32 " frames, %" PRIu32 " bytes, %.2f s airtime\n",
+           all.frames, all.bytes, all.airtime_us / 1e6);
+    printf("BENCH day of one node, driver policies: %" PRIu32 " frames, %" PRIu32 " bytes, %.2f s airtime (%.1f%% less)\n",
+           policy.frames, policy.bytes, policy.airtime_us / 1e6, 100.0 - 100.0 * policy.airtime_us / all.airtime_us);
+}
+
+static void bench_check(void)
+{
+    sensor_reset();
+    sensor_register(&value_driver, &value, 1, 0);
+    sensor_report_policy_t policy = {.deadband_abs = 0.5f, .rate_of_change = 0.1f};
+    sensor_set_report_policy(1, &policy);
+    sensor_entry_t *entry = sensor_find(1);
+
+    sample_at(1, 20.0f, 0);
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_CHECKS; i++)
+    {
+        now_us = (int64_t)(i + 1) * 1000000;
+        value = 20.0f + (i & 7) * 0.01f;
+        sensor_sample_one(entry);
+    }
+    double ns = (double)(host_test_now_ns() - start) / BENCH_CHECKS;
+    TEST_ASSERT(entry->stats.suppressed == BENCH_CHECKS);
+    printf("BENCH suppressed sample, policy check included: %.1f ns\n", ns);
+}
+
+int main(void)
+{
+    RUN_TEST(test_triggers);
+    RUN_TEST(test_ring_full);
+    RUN_TEST(bench_day);
+    RUN_TEST(bench_check);
+    return host_test_result();
+}
@@ -0,0 +1,398 @@
+/*
+ * sensor_store: raw, aggregate and rollup queries against the readings put in, chunks spilled to
+ * a flash log that survives a reboot and wraps, a chunk spilled while a query scans the log, and
+ * the ingest rate and query latency with 1000 series, a 200 node mesh with 5 sensors per node.
+ */
+#include <math.h>
+#include <string.h>
+#include "host_test.h"
+#include "../main/sensor_store.c"
+
+#define LOG_SIZE (256 * 1024)
+#define LOG_SECTOR 4096
+#define BENCH_NODES 200
+#define BENCH_SENSORS 5
+#define BENCH_PERIOD_MS 10000
+#define BENCH_HOURS 6
+#define BENCH_QUERIES 2000
+
+/* NOR flash: erased to 0xff, writes only clear bits */
+static uint8_t log_flash[LOG_SIZE];
+static esp_partition_t log_partition = {.size = LOG_SIZE, .erase_size = LOG_SECTOR, .label = "sensor_log"};
+static bool log_present = true;
+static uint32_t log_erases;
+/* Run on the next read, as another task would while a query scans the log */
+static void (*log_read_hook)(void);
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    return log_present && !strcmp(label, log_partition.label) ? &log_partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    TEST_ASSERT(src_offset + size <= partition->size);
+    if (log_read_hook)
+    {
+        void (*hook)(void) = log_read_hook;
+        log_read_hook = NULL;
+        hook();
+    }
+    memcpy(dst, log_flash + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    TEST_ASSERT(dst_offset + size <= partition->size);
+    for (size_t i = 0; i < size; i++)
+    {
+        // Written twice without an erase in between
+        TEST_ASSERT(log_flash[dst_offset + i] == 0xff);
+        log_flash[dst_offset + i] &= ((const uint8_t *)src)[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    TEST_ASSERT(offset % partition->erase_size == 0 && size % partition->erase_size == 0);
+    TEST_ASSERT(offset + size <= partition->size);
+    memset(log_flash + offset, 0xff, size);
+    log_erases++;
+    return ESP_OK;
+}
+
+/* A reboot: RAM is lost, the flash log is found again by sensor_store_init() */
+static void store_reboot(void)
+{
+    for (size_t i = 0; i < s_series_num; i++)
+    {
+        free(s_series[i]);
+    }
+    s_series_num = 0;
+    memset(s_series_index, 0, sizeof(s_series_index));
+    free(s_log_buf);
+    s_log_buf = NULL;
+    s_log_partition = NULL;
+    if (s_log_lock)
+    {
+        vSemaphoreDelete(s_log_lock);
+        s_log_lock = NULL;
+    }
+    s_log_offset = 0;
+    s_log_seq = 0;
+    if (s_store_lock)
+    {
+        vSemaphoreDelete(s_store_lock);
+        s_store_lock = NULL;
+    }
+    TEST_ASSERT(sensor_store_init() == ESP_OK);
+}
+
+static void mac_make(uint8_t *mac, uint32_t n)
+{
+    const uint8_t mac_base[6] = {0x24, 0x6f, 0x28, 0, 0, 0};
+    memcpy(mac, mac_base, 6);
+    mac[4] = n >> 8;
+    mac[5] = n;
+}
+
+static float reading(uint32_t sensor_id, int64_t ts_ms)
+{
+    return 20.0f + sensor_id + 3.0f * sinf(ts_ms / 3600000.0f);
+}
+
+static void add(const uint8_t *mac, uint32_t sensor_id, int64_t ts_ms)
+{
+    sensor_packet_t packet = {
+        .timestamp = ts_ms * 1000,
+        .sensor_id = sensor_id,
+        .type = SENSOR_TYPE_TEMPERATURE,
+        .data.temperature.value = reading(sensor_id, ts_ms),
+    };
+    TEST_ASSERT(sensor_store_add(mac, &packet) == ESP_OK);
+}
+
+static sensor_store_point_t points[16384];
+
+static void test_queries(void)
+{
+    uint8_t mac[6];
+    sensor_store_bucket_t agg;
+    sensor_store_bucket_t buckets[64];
+    sensor_store_series_info_t info[4];
+
+    log_present = false;
+    store_reboot();
+    mac_make(mac, 1);
+
+    /* 5 minutes at 1 Hz, fits in the RAM chunks */
+    for (int64_t t = 0; t < 300; t++)
+    {
+        add(mac, 7, t * 1000);
+    }
+    TEST_ASSERT(sensor_store_list(info, 4) == 1);
+    TEST_ASSERT(info[0].sensor_id == 7 && info[0].count == 300 && info[0].last_ts == 299000);
+
+    size_t num = sensor_store_query(mac, 7, 0, INT64_MAX, points, 16384);
+    TEST_ASSERT(num == 300);
+    for (size_t i = 0; i < num; i++)
+    {
+        // Quantized to 0.01 by the codec
+        TEST_ASSERT(points[i].timestamp == (int64_t)i * 1000);
+        TEST_ASSERT(fabsf(points[i].value - reading(7, i * 1000)) <= 0.005f + 1e-4f);
+    }
+    TEST_ASSERT(sensor_store_query(mac, 7, 100000, 199999, points, 16384) == 100 && points[0].timestamp == 100000);
+    TEST_ASSERT(sensor_store_query(mac, 7, 0, INT64_MAX, points, 10) == 10);
+    TEST_ASSERT(sensor_store_query(mac, 8, 0, INT64_MAX, points, 16384) == 0);
+
+    float min = INFINITY;
+    float max = -INFINITY;
+    double sum = 0;
+    for (int64_t t = 60; t < 180; t++)
+    {
+        min = fminf(min, reading(7, t * 1000));
+        max = fmaxf(max, reading(7, t * 1000));
+        sum += reading(7, t * 1000);
+    }
+    TEST_ASSERT(sensor_store_aggregate(mac, 7, 60000, 179999, &agg) == ESP_OK);
+    TEST_ASSERT(agg.count == 120 && fabsf(agg.min - min) < 0.01f && fabsf(agg.max - max) < 0.01f);
+    TEST_ASSERT(fabsf(agg.avg - sum / 120) < 0.01f);
+    TEST_ASSERT(sensor_store_aggregate(mac, 8, 0, INT64_MAX, &agg) == ESP_ERR_NOT_FOUND);
+
+    /* Rollups are kept on the exact values */
+    TEST_ASSERT(sensor_store_rollup(mac, 7, SENSOR_STORE_ROLLUP_MINUTE, 0, INT64_MAX, buckets, 64) == 5);
+    TEST_ASSERT(buckets[1].start == 60000 && buckets[1].count == 60);
+    TEST_ASSERT(buckets[1].min == reading(7, 60000) && buckets[1].max == reading(7, 119000));
+    TEST_ASSERT(sensor_store_rollup(mac, 7, SENSOR_STORE_ROLLUP_MINUTE, 120000, 239999, buckets, 64) == 2);
+    TEST_ASSERT(sensor_store_rollup(mac, 7, SENSOR_STORE_ROLLUP_HOUR, 0, INT64_MAX, buckets, 64) == 1);
+    TEST_ASSERT(buckets[0].count == 300);
+
+    /* Without a flash log the oldest chunk is dropped, the rollups keep the whole hour */
+    for (int64_t t = 300; t < 3600; t++)
+    {
+        add(mac, 7, t * 1000);
+    }
+    num = sensor_store_query(mac, 7, 0, INT64_MAX, points, 16384);
+    TEST_ASSERT(num > 0 && num < 3600 && points[num - 1].timestamp == 3599000);
+    TEST_ASSERT(points[0].timestamp == (3600 - (int64_t)num) * 1000);
+    TEST_ASSERT(sensor_store_rollup(mac, 7, SENSOR_STORE_ROLLUP_HOUR, 0, INT64_MAX, buckets, 64) == 1);
+    TEST_ASSERT(buckets[0].count == 3600);
+    TEST_ASSERT(sensor_store_rollup(mac, 7, SENSOR_STORE_ROLLUP_MINUTE, 0, INT64_MAX, buckets, 64) == 60);
+}
+
+/* The oldest readings of a series kept are contiguous, returns their number */
+static uint32_t store_series_check(const uint8_t *mac, int64_t *oldest)
+{
+    sensor_store_bucket_t agg;
+    size_t num = sensor_store_query(mac, 7, 0, INT64_MAX, points, 16384);
+    TEST_ASSERT(num == 16384 && points[0].timestamp > 0);
+    for (size_t i = 1; i < num; i++)
+    {
+        TEST_ASSERT(points[i].timestamp == points[i - 1].timestamp + 1000);
+    }
+    *oldest = points[0].timestamp;
+    TEST_ASSERT(sensor_store_aggregate(mac, 7, 0, INT64_MAX, &agg) == ESP_OK);
+    return agg.count;
+}
+
+static void test_spill(void)
+{
+    uint8_t mac[6];
+    uint8_t other[6];
+
+    memset(log_flash, 0xff, sizeof(log_flash));
+    log_present = true;
+    store_reboot();
+    TEST_ASSERT(s_log_partition != NULL);
+    mac_make(mac, 1);
+    mac_make(other, 2);
+
+    /* Two series interleaved, an hour each, most of it spilled */
+    for (int64_t t = 0; t < 3600; t++)
+    {
+        add(mac, 7, t * 1000);
+        add(other, 7, t * 1000);
+    }
+    size_t num = sensor_store_query(mac, 7, 0, INT64_MAX, points, 16384);
+    TEST_ASSERT(num == 3600);
+    for (size_t i = 0; i < num; i++)
+    {
+        TEST_ASSERT(points[i].timestamp == (int64_t)i * 1000);
+    }
+    TEST_ASSERT(sensor_store_query(mac, 7, 1000000, 1999999, points, 16384) == 1000);
+
+    /* After a reboot only the spilled chunks are left, and appending continues behind them */
+    uint32_t offset = s_log_offset;
+    uint32_t seq = s_log_seq;
+    store_reboot();
+    TEST_ASSERT(s_log_offset == offset && s_log_seq == seq);
+    add(mac, 7, 3600000);
+    num = sensor_store_query(mac, 7, 0, INT64_MAX, points, 16384);
+    TEST_ASSERT(num > 3000 && num < 3600 && points[0].timestamp == 0);
+    TEST_ASSERT(points[num - 2].timestamp < 3599000 && points[num - 1].timestamp == 3600000);
+
+    /* Wrapped: the oldest sectors are gone, what is left is contiguous up to the newest */
+    uint32_t erases = log_erases;
+    for (int64_t t = 3601; t < 400000; t++)
+    {
+        add(mac, 7, t * 1000);
+        add(other, 7, t * 1000);
+    }
+    TEST_ASSERT(log_erases - erases > 2 * LOG_SIZE / LOG_SECTOR);
+    int64_t oldest;
+    uint32_t count = store_series_check(mac, &oldest);
+    TEST_ASSERT(sensor_store_query(mac, 7, oldest + (count - 1) * 1000LL, INT64_MAX, points, 16384) == 1);
+    TEST_ASSERT(points[0].timestamp == 399999000);
+
+    /* The readings still in RAM are lost with a reboot, at most a ring of chunks */
+    store_reboot();
+    add(mac, 7, 400000000);
+    int64_t oldest_after;
+    uint32_t count_after = store_series_check(mac, &oldest_after);
+    TEST_ASSERT(oldest_after == oldest);
+    TEST_ASSERT(count_after < count && count_after + 400 > count);
+}
+
+static uint8_t race_mac[6];
+static int64_t race_next_ms;
+
+/* Readings of the queried series coming in until its oldest chunk in RAM is spilled */
+static void race_add(void)
+{
+    uint32_t seq = s_log_seq;
+    while (s_log_seq == seq)
+    {
+        add(race_mac, 7, race_next_ms);
+        race_next_ms += 1000;
+    }
+}
+
+/* A chunk spilled while a query scans the log is in the copy of the chunks, it is read once */
+static void test_spill_during_query(void)
+{
+    memset(log_flash, 0xff, sizeof(log_flash));
+    log_present = true;
+    store_reboot();
+    mac_make(race_mac, 3);
+    for (race_next_ms = 0; race_next_ms < 1800000; race_next_ms += 1000)
+    {
+        add(race_mac, 7, race_next_ms);
+    }
+
+    log_read_hook = race_add;
+    size_t num = sensor_store_query(race_mac, 7, 0, INT64_MAX, points, 16384);
+    TEST_ASSERT(log_read_hook == NULL && num == 1800);
+    for (size_t i = 0; i < num; i++)
+    {
+        TEST_ASSERT(points[i].timestamp == (int64_t)i * 1000);
+    }
+
+    /* The readings that came in meanwhile are there for the next query */
+    TEST_ASSERT(sensor_store_query(race_mac, 7, 0, INT64_MAX, points, 16384) == race_next_ms / 1000);
+}
+
+static void bench_series(void)
+{
+    static uint8_t macs[BENCH_NODES][6];
+    sensor_store_bucket_t agg;
+    sensor_store_bucket_t buckets[64];
+    static sensor_store_series_info_t info[CONFIG_SENSOR_STORE_MAX_SERIES];
+
+    memset(log_flash, 0xff, sizeof(log_flash));
+    log_present = true;
+    store_reboot();
+    log_erases = 0;
+    for (int n = 0; n < BENCH_NODES; n++)
+    {
+        mac_make(macs[n], 100 + n);
+    }
+
+    /* Every series reports every BENCH_PERIOD_MS, the nodes spread over the period */
+    uint32_t adds = 0;
+    int64_t start = host_test_now_ns();
+    for (int64_t t = 0; t < BENCH_HOURS * 3600000LL; t += BENCH_PERIOD_MS)
+    {
+        for (int n = 0; n < BENCH_NODES; n++)
+        {
+            for (uint32_t s = 0; s < BENCH_SENSORS; s++)
+            {
+                add(macs[n], s, t + n * (BENCH_PERIOD_MS / BENCH_NODES));
+                adds++;
+            }
+        }
+    }
+    double add_ns = (double)(host_test_now_ns() - start) / adds;
+    TEST_ASSERT(sensor_store_list(info, CONFIG_SENSOR_STORE_MAX_SERIES) == BENCH_NODES * BENCH_SENSORS);
+
+    uint8_t mac[6];
+    mac_make(mac, 1000);
+    sensor_packet_t packet = {.sensor_id = 1, .type = SENSOR_TYPE_TEMPERATURE};
+    for (int i = BENCH_NODES * BENCH_SENSORS; i < CONFIG_SENSOR_STORE_MAX_SERIES; i++)
+    {
+        packet.sensor_id = i;
+        TEST_ASSERT(sensor_store_add(mac, &packet) == ESP_OK);
+    }
+    packet.sensor_id = CONFIG_SENSOR_STORE_MAX_SERIES;
+    TEST_ASSERT(sensor_store_add(mac, &packet) == ESP_ERR_NO_MEM);
+
+    /* Queries on the last node, the worst case of the series lookup */
+    const uint8_t *last = macs[BENCH_NODES - 1];
+    int64_t end = BENCH_HOURS * 3600000LL;
+    size_t ram_points = sensor_store_query(last, 4, end - 3600000, end, points, 16384);
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_QUERIES; i++)
+    {
+        sensor_store_query(last, 4, end - 3600000, end, points, 16384);
+    }
+    double query_ram_us = (host_test_now_ns() - start) / 1e3 / BENCH_QUERIES;
+
+    size_t all_points = sensor_store_query(last, 4, 0, end, points, 16384);
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_QUERIES / 100; i++)
+    {
+        sensor_store_query(last, 4, 0, end, points, 16384);
+    }
+    double query_all_us = (host_test_now_ns() - start) / 1e3 / (BENCH_QUERIES / 100);
+
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_QUERIES; i++)
+    {
+        sensor_store_aggregate(last, 4, end - 3600000, end, &agg);
+    }
+    double aggregate_us = (host_test_now_ns() - start) / 1e3 / BENCH_QUERIES;
+
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_QUERIES; i++)
+    {
+        sensor_store_rollup(last, 4, SENSOR_STORE_ROLLUP_MINUTE, 0, end, buckets, 64);
+    }
+    double rollup_us = (host_test_now_ns() - start) / 1e3 / BENCH_QUERIES;
+
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_QUERIES / 10; i++)
+    {
+        sensor_store_list(info, CONFIG_SENSOR_STORE_MAX_SERIES);
+    }
+    double list_us = (host_test_now_ns() - start) / 1e3 / (BENCH_QUERIES / 10);
+
+    printf("BENCH %d series, %u readings over %d h: %.0f ns per add (%.2f M/s), %u log sector erases\n",
+           BENCH_NODES * BENCH_SENSORS, (unsigned)adds, BENCH_HOURS, add_ns, 1e3 / add_ns, (unsigned)log_erases);
+    printf("BENCH %u bytes of RAM per series, %u readings in RAM\n", (unsigned)sizeof(store_series_t),
+           (unsigned)ram_points);
+    printf("BENCH query last hour %.1f us, query all %u points from RAM and flash %.0f us\n", query_ram_us,
+           (unsigned)all_points, query_all_us);
+    printf("BENCH aggregate last hour %.1f us, 60 minute rollups %.1f us, list of %d series %.1f us\n", aggregate_us,
+           rollup_us, CONFIG_SENSOR_STORE_MAX_SERIES, list_us);
+}
+
+int main(void)
+{
+    RUN_TEST(test_queries);
+    RUN_TEST(test_spill);
+    RUN_TEST(test_spill_during_query);
+    RUN_TEST(bench_series);
+    return host_test_result();
+}
@@ -0,0 +1,421 @@
+/*
+ * startup: a stage runs once its prerequisites are ready, a stage waiting on a signal blocks the
+ * orchestrator until the signal, a failed stage skips its dependents, a signal before startup_run()
+ * is kept, the /metrics lines. Then boot to first sensor packet over simulated boots with the stage
+ * table of main.c, against the app_main it replaced, which spun on the station IP before starting
+ * ESP-NOW, the HTTP server and the sensors.
+ */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+/* The ready times are static, every boot starts from none */
+#include "../main/startup.c"
+
+#define SIM_BOOTS 1000
+#define SIM_ROUTER_DOWN_PERCENT 5   /* Boots with no router in reach, the station never gets an IP */
+
+/* Time each stage takes, from the start of its function to its return, assumed */
+typedef struct
+{
+    int min_ms;
+    int max_ms;
+} sim_range_t;
+
+static const sim_range_t sim_stage_ms[STARTUP_STAGE_MAX] = {
+    [STARTUP_STAGE_NVS] = {20, 60},          /* nvs_flash_init() */
+    [STARTUP_STAGE_NETIF] = {100, 200},      /* Netifs, event loop, Wi-Fi start */
+    [STARTUP_STAGE_MESH] = {20, 50},
+    [STARTUP_STAGE_WIFI_STA] = {1500, 6000}, /* From the mesh start: association and DHCP */
+    [STARTUP_STAGE_STORE] = {10, 80},        /* Scan of the flash log */
+    [STARTUP_STAGE_ESPNOW] = {5, 15},
+    [STARTUP_STAGE_PARENT] = {1, 2},
+    [STARTUP_STAGE_HTTPD] = {20, 40},
+    [STARTUP_STAGE_NIMBLE] = {300, 500},     /* BLE controller and host */
+    [STARTUP_STAGE_SENSORS] = {2, 5},
+    /* The first frame leaves when the sensor task wakes on the batch timeout */
+    [STARTUP_STAGE_SENSOR_TX] = {CONFIG_SENSOR_BATCH_TIMEOUT_MS, CONFIG_SENSOR_BATCH_TIMEOUT_MS + 10},
+};
+
+static int64_t now_us;
+static int64_t signal_us[STARTUP_STAGE_MAX];    /* Signals to come from the subsystems, -1 for none */
+static int64_t started_us[STARTUP_STAGE_MAX];   /* Start function called, -1 for not */
+static int64_t stage_us[STARTUP_STAGE_MAX];     /* Drawn for this boot */
+static bool router_down;
+static EventBits_t fail_bits;
+static int waits;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+/* The collector output, one scrape */
+struct metrics_writer
+{
+    char buf[1024];
+    size_t len;
+};
+
+static metrics_collect_t collector;
+
+esp_err_t metrics_collector_register(metrics_collect_t collect, void *arg)
+{
+    collector = collect;
+    return ESP_OK;
+}
+
+void metrics_printf(metrics_writer_t *writer, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    writer->len += vsnprintf(writer->buf + writer->len, sizeof(writer->buf) - writer->len, fmt, args);
+    va_end(args);
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf)
+{
+    buf->bits = 0;
+    return buf;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return group->bits;
+}
+
+/* The subsystems run alongside the orchestrator, a signal is recorded at its own time */
+static void sim_signal(int stage)
+{
+    int64_t now = now_us;
+    now_us = signal_us[stage];
+    signal_us[stage] = -1;
+    startup_signal(stage);
+    now_us = now > now_us ? now : now_us;
+}
+
+/* Blocked until the next signal the orchestrator waits for, the clock jumps to it */
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all,
+                                TickType_t wait)
+{
+    int next = -1;
+    for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+    {
+        if ((bits & STARTUP_BIT(i)) && signal_us[i] >= 0 && (next < 0 || signal_us[i] < signal_us[next]))
+        {
+            next = i;
+        }
+    }
+    waits++;
+    if (next < 0)
+    {
+        printf("%s:%d: startup_run() blocked forever\n", __FILE__, __LINE__);
+        exit(1);
+    }
+    sim_signal(next);
+    return group->bits;
+}
+
+/* Signals left after startup_run(), in time order */
+static void sim_drain(void)
+{
+    for (;;)
+    {
+        int next = -1;
+        for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+        {
+            if (signal_us[i] >= 0 && (next < 0 || signal_us[i] < signal_us[next]))
+            {
+                next = i;
+            }
+        }
+        if (next < 0)
+        {
+            return;
+        }
+        sim_signal(next);
+    }
+}
+
+static int64_t sim_draw(startup_stage_t stage)
+{
+    const sim_range_t *range = &sim_stage_ms[stage];
+    return (range->min_ms + rng() % (range->max_ms - range->min_ms + 1)) * 1000LL;
+}
+
+static void sim_reset(void)
+{
+    memset(startup_ready_us, 0, sizeof(startup_ready_us));
+    startup_group = NULL;
+    startup_stages = NULL;
+    collector = NULL;
+    now_us = 0;
+    fail_bits = 0;
+    waits = 0;
+    router_down = rng() % 100 < SIM_ROUTER_DOWN_PERCENT;
+    for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+    {
+        signal_us[i] = -1;
+        started_us[i] = -1;
+        stage_us[i] = sim_draw(i);
+    }
+}
+
+static esp_err_t sim_stage(startup_stage_t stage)
+{
+    started_us[stage] = now_us;
+    now_us += stage_us[stage];
+    if (stage == STARTUP_STAGE_MESH && !router_down)
+    {
+        signal_us[STARTUP_STAGE_WIFI_STA] = now_us + stage_us[STARTUP_STAGE_WIFI_STA];
+    }
+    else if (stage == STARTUP_STAGE_SENSORS)
+    {
+        signal_us[STARTUP_STAGE_SENSOR_TX] = now_us + stage_us[STARTUP_STAGE_SENSOR_TX];
+    }
+    return (fail_bits & STARTUP_BIT(stage)) ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t sim_nvs(void)
+{
+    return sim_stage(STARTUP_STAGE_NVS);
+}
+
+static esp_err_t sim_netif(void)
+{
+    return sim_stage(STARTUP_STAGE_NETIF);
+}
+
+static esp_err_t sim_mesh(void)
+{
+    return sim_stage(STARTUP_STAGE_MESH);
+}
+
+static esp_err_t sim_store(void)
+{
+    return sim_stage(STARTUP_STAGE_STORE);
+}
+
+static esp_err_t sim_espnow(void)
+{
+    return sim_stage(STARTUP_STAGE_ESPNOW);
+}
+
+static esp_err_t sim_parent(void)
+{
+    return sim_stage(STARTUP_STAGE_PARENT);
+}
+
+static esp_err_t sim_httpd(void)
+{
+    return sim_stage(STARTUP_STAGE_HTTPD);
+}
+
+static esp_err_t sim_nimble(void)
+{
+    return sim_stage(STARTUP_STAGE_NIMBLE);
+}
+
+static esp_err_t sim_sensors(void)
+{
+    return sim_stage(STARTUP_STAGE_SENSORS);
+}
+
+/* The table of main.c, with the subsystems simulated */
+static const startup_stage_desc_t main_stages[STARTUP_STAGE_MAX] = {
+    [STARTUP_STAGE_NVS] = {"nvs", 0, sim_nvs},
+    [STARTUP_STAGE_NETIF] = {"netif", STARTUP_BIT(STARTUP_STAGE_NVS), sim_netif},
+    [STARTUP_STAGE_MESH] = {"mesh", STARTUP_BIT(STARTUP_STAGE_NETIF), sim_mesh},
+    [STARTUP_STAGE_WIFI_STA] = {"wifi_sta", STARTUP_BIT(STARTUP_STAGE_MESH), NULL},
+    [STARTUP_STAGE_STORE] = {"store", 0, sim_store},
+    [STARTUP_STAGE_ESPNOW] = {"espnow", STARTUP_BIT(STARTUP_STAGE_MESH) | STARTUP_BIT(STARTUP_STAGE_STORE), sim_espnow},
+    [STARTUP_STAGE_PARENT] = {"parent", STARTUP_BIT(STARTUP_STAGE_ESPNOW), sim_parent},
+    [STARTUP_STAGE_SENSORS] = {"sensors", STARTUP_BIT(STARTUP_STAGE_ESPNOW), sim_sensors},
+    [STARTUP_STAGE_SENSOR_TX] = {"sensor_tx", STARTUP_BIT(STARTUP_STAGE_SENSORS), NULL},
+    [STARTUP_STAGE_HTTPD] = {"httpd", STARTUP_BIT(STARTUP_STAGE_NETIF) | STARTUP_BIT(STARTUP_STAGE_STORE), sim_httpd},
+    [STARTUP_STAGE_NIMBLE] = {"nimble", STARTUP_BIT(STARTUP_STAGE_NVS), sim_nimble},
+};
+
+static void check_deps(const startup_stage_desc_t *stages)
+{
+    for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+    {
+        for (int dep = 0; dep < STARTUP_STAGE_MAX && started_us[i] >= 0; dep++)
+        {
+            if (stages[i].deps & STARTUP_BIT(dep))
+            {
+                TEST_ASSERT(startup_ready_time(dep) >= 0 && startup_ready_time(dep) <= started_us[i]);
+            }
+        }
+    }
+}
+
+static void test_order(void)
+{
+    sim_reset();
+    router_down = false;
+    TEST_ASSERT(startup_run(main_stages) == ESP_OK);
+    sim_drain();
+    check_deps(main_stages);
+    // Nothing of main.c waits for the station, and the sensors do not wait for BLE
+    TEST_ASSERT(waits == 0);
+    TEST_ASSERT(started_us[STARTUP_STAGE_SENSORS] < started_us[STARTUP_STAGE_NIMBLE]);
+    for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+    {
+        TEST_ASSERT(startup_ready_time(i) > 0);
+    }
+
+    // A stage on the station IP: the orchestrator blocks until it, then goes on
+    static startup_stage_desc_t on_ip[STARTUP_STAGE_MAX];
+    memcpy(on_ip, main_stages, sizeof(on_ip));
+    on_ip[STARTUP_STAGE_HTTPD].deps |= STARTUP_BIT(STARTUP_STAGE_WIFI_STA);
+    sim_reset();
+    router_down = false;
+    TEST_ASSERT(startup_run(on_ip) == ESP_OK);
+    check_deps(on_ip);
+    TEST_ASSERT(waits >= 1 && started_us[STARTUP_STAGE_HTTPD] == startup_ready_time(STARTUP_STAGE_WIFI_STA));
+    TEST_ASSERT(started_us[STARTUP_STAGE_SENSORS] < started_us[STARTUP_STAGE_HTTPD]);
+}
+
+static void test_failure(void)
+{
+    sim_reset();
+    fail_bits = STARTUP_BIT(STARTUP_STAGE_STORE);
+    TEST_ASSERT(startup_run(main_stages) == ESP_FAIL);
+    sim_drain();
+    // Everything on the store is skipped, the rest runs
+    TEST_ASSERT(started_us[STARTUP_STAGE_STORE] >= 0 && startup_ready_time(STARTUP_STAGE_STORE) < 0);
+    TEST_ASSERT(started_us[STARTUP_STAGE_ESPNOW] < 0 && started_us[STARTUP_STAGE_HTTPD] < 0);
+    TEST_ASSERT(started_us[STARTUP_STAGE_PARENT] < 0 && started_us[STARTUP_STAGE_SENSORS] < 0);
+    TEST_ASSERT(startup_ready_time(STARTUP_STAGE_SENSOR_TX) < 0);
+    TEST_ASSERT(startup_ready_time(STARTUP_STAGE_MESH) > 0 && startup_ready_time(STARTUP_STAGE_NIMBLE) > 0);
+}
+
+static void test_signals(void)
+{
+    struct metrics_writer writer = {0};
+
+    // Before startup_run() and twice: the first time counts
+    sim_reset();
+    now_us = 5000;
+    startup_signal(STARTUP_STAGE_WIFI_STA);
+    now_us = 6000;
+    startup_signal(STARTUP_STAGE_WIFI_STA);
+    TEST_ASSERT(startup_ready_time(STARTUP_STAGE_WIFI_STA) == 5000);
+    TEST_ASSERT(startup_run(main_stages) == ESP_OK);
+    TEST_ASSERT(startup_group->bits & STARTUP_BIT(STARTUP_STAGE_WIFI_STA));
+    TEST_ASSERT(startup_ready_time(STARTUP_STAGE_WIFI_STA) == 5000);
+    sim_drain();
+
+    TEST_ASSERT(collector != NULL);
+    collector(&writer, NULL);
+    TEST_ASSERT(strstr(writer.buf, "# TYPE startup_stage_ready_ms gauge\n") == writer.buf);
+    TEST_ASSERT(strstr(writer.buf, "\nstartup_stage_ready_ms{stage=\"wifi_sta\"} 5\n") != NULL);
+    char line[64];
+    snprintf(line, sizeof(line), "\nstartup_stage_ready_ms{stage=\"sensor_tx\"} %lld\n",
+             (long long)(startup_ready_time(STARTUP_STAGE_SENSOR_TX) / 1000));
+    TEST_ASSERT(strstr(writer.buf, line) != NULL);
+}
+
+/* app_main before the orchestrator: one stage after the other, spinning on the station IP after the mesh */
+static int64_t legacy_boot(void)
+{
+    sim_nvs();
+    sim_netif();
+    sim_mesh();
+    if (router_down)
+    {
+        return -1;
+    }
+    now_us = signal_us[STARTUP_STAGE_WIFI_STA];
+    sim_store();
+    sim_espnow();
+    sim_parent();
+    sim_httpd();
+    sim_nimble();
+    sim_sensors();
+    return signal_us[STARTUP_STAGE_SENSOR_TX];
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_boots(const char *name, int64_t *boots, int never)
+{
+    int num = SIM_BOOTS - never;
+    qsort(boots, num, sizeof(boots[0]), compare_us);
+    printf("BENCH %-22s boot to first sensor packet: median %5lld ms, p99 %5lld ms, max %5lld ms, %d of %d boots never\n",
+           name, (long long)boots[num / 2] / 1000, (long long)boots[num * 99 / 100] / 1000,
+           (long long)boots[num - 1] / 1000, never, SIM_BOOTS);
+}
+
+static void bench_boot(void)
+{
+    static int64_t before[SIM_BOOTS];
+    static int64_t after[SIM_BOOTS];
+    int before_never = 0, after_never = 0, before_num = 0, after_num = 0;
+
+    // The same draws for both
+    for (int boot = 0; boot < SIM_BOOTS; boot++)
+    {
+        uint32_t seed = rng_state;
+        sim_reset();
+        int64_t sent = legacy_boot();
+        if (sent < 0)
+        {
+            before_never++;
+        }
+        else
+        {
+            before[before_num++] = sent;
+        }
+
+        rng_state = seed;
+        sim_reset();
+        TEST_ASSERT(startup_run(main_stages) == ESP_OK);
+        sim_drain();
+        if (startup_ready_time(STARTUP_STAGE_SENSOR_TX) < 0)
+        {
+            after_never++;
+        }
+        else
+        {
+            after[after_num++] = startup_ready_time(STARTUP_STAGE_SENSOR_TX);
+        }
+    }
+
+    print_boots("spin on the IP:", before, before_never);
+    print_boots("startup stages:", after, after_never);
+    TEST_ASSERT(after_never == 0 && after[after_num / 2] < before[before_num / 2]);
+}
+
+int main(void)
+{
+    RUN_TEST(test_order);
+    RUN_TEST(test_failure);
+    RUN_TEST(test_signals);
+    RUN_TEST(bench_boot);
+    return host_test_result();
+}
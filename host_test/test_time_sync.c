@@ -0,0 +1,272 @@
+/*
+ * esp_mesh_lite_time_sync: simulation of a node below the root with a drifting clock and a mesh
+ * that jitters and queues, reporting the time to converge and the percentiles of the mesh time
+ * error, next to taking the offset of the last exchange as it is.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "host_test.h"
+
+/* The servo is static, the test drives it through the timer callback and the message handlers */
+#include "../components/mesh_lite/src/esp_mesh_lite_time_sync.c"
+
+#define SIM_SECONDS 3600
+#define SIM_PROBES 10           /* Mesh time error probes per second */
+#define SIM_SETTLE_S 300        /* Error percentiles are taken from here on, from cold */
+
+/* Simulation state: true time is the root clock, the node clock runs off it */
+static double true_us;
+static double node_ppm;
+static double node_phase_us;
+static uint8_t node_level = 2;
+static MeshLite__TimeSync sent_req;
+static bool req_sent;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double rng_unit(void)
+{
+    return (rng() + 0.5) / 4294967296.0;
+}
+
+static int64_t node_clock(double t)
+{
+    return (int64_t)(node_phase_us + t * (1 + node_ppm * 1e-6));
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return node_clock(true_us);
+}
+
+uint8_t esp_mesh_lite_get_level(void)
+{
+    return node_level;
+}
+
+esp_err_t esp_mesh_lite_send_msg(esp_mesh_lite_msg_data_t type, esp_mesh_lite_msg_config_t *conf)
+{
+    TEST_ASSERT(type == ESP_MESH_LITE_RAW_MSG && conf->raw_msg.msg_id == MESH_LITE_MSG_ID_TIME_SYNC);
+    MeshLite__TimeSync *req = mesh_lite__time_sync__unpack(NULL, conf->raw_msg.size, conf->raw_msg.data);
+    TEST_ASSERT(req != NULL);
+    if (req)
+    {
+        sent_req = *req;
+        req_sent = true;
+        mesh_lite__time_sync__free_unpacked(req, NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_send_raw_msg_to_parent(const uint8_t *data, size_t size)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_raw_msg_action_list_register(const esp_mesh_lite_raw_msg_action_t *msg_action)
+{
+    return ESP_OK;
+}
+
+/* One hop: air time and the parent forwarding, plus a queue behind other traffic one time in ten */
+static double hop_delay_us(void)
+{
+    double delay = 1500 - 500 * log(rng_unit());
+    if (rng() % 10 == 0)
+    {
+        delay += 5000 + rng() % 55000;
+    }
+    return delay;
+}
+
+typedef struct
+{
+    int exchanges;
+    int answered;
+    double synced_s;        /* esp_mesh_lite_time_is_synced() from here on */
+    double converged_s;     /* Error below 1 ms from here on */
+    double err_us[SIM_SECONDS * SIM_PROBES];    /* |mesh time error| after the settle time */
+    double naive_us[SIM_SECONDS * SIM_PROBES];  /* Same, for the offset of the last exchange as it is */
+    int err_num;
+} sim_result_t;
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *values, int num, double p)
+{
+    qsort(values, num, sizeof(values[0]), cmp_double);
+    return values[(int)(p * (num - 1))];
+}
+
+/*
+ * Runs the node for seconds of simulated time from start_s, errors are collected from settle_s on.
+ * One timer tick per second, as at the fast interval, the response comes back before the next tick
+ * or is lost.
+ */
+static void sim_run(sim_result_t *result, int start_s, int seconds, int settle_s)
+{
+    static bool naive_valid = false;
+    static int64_t naive_offset = 0;
+
+    result->synced_s = -1;
+    result->converged_s = -1;
+    for (int s = start_s; s < start_s + seconds; s++)
+    {
+        double tick_us = s * 1e6;
+
+        true_us = tick_us;
+        req_sent = false;
+        time_sync_timer_cb(time_sync_timer);
+        if (req_sent)
+        {
+            result->exchanges++;
+            double t2 = tick_us + hop_delay_us();
+            double t3 = t2 + 200;
+            double t4 = t3 + hop_delay_us();
+            if (rng() % 20 != 0)
+            {
+                MeshLite__TimeSync resp;
+                mesh_lite__time_sync__init(&resp);
+                resp.seq = sent_req.seq;
+                resp.t1 = sent_req.t1;
+                resp.t2 = (int64_t)t2;
+                resp.t3 = (int64_t)t3;
+                resp.synced = true;
+                uint8_t data[64];
+                uint32_t len = mesh_lite__time_sync__pack(&resp, data);
+                uint8_t *out_data = NULL;
+                uint32_t out_len = 0;
+
+                true_us = t4;
+                time_sync_resp_handler(data, len, &out_data, &out_len, 0);
+                result->answered++;
+
+                naive_offset = ((resp.t2 - resp.t1) + (resp.t3 - node_clock(t4))) / 2;
+                naive_valid = true;
+            }
+        }
+
+        for (int p = 0; p < SIM_PROBES; p++)
+        {
+            true_us = tick_us + 1e6 * p / SIM_PROBES;
+            int64_t local = node_clock(true_us);
+            double err = fabs((double)esp_mesh_lite_time_from_local(local) - true_us);
+
+            if (!esp_mesh_lite_time_is_synced())
+            {
+                result->synced_s = -1;
+            }
+            else if (result->synced_s < 0)
+            {
+                result->synced_s = true_us / 1e6 - start_s;
+            }
+            if (err >= 1000)
+            {
+                result->converged_s = -1;
+            }
+            else if (result->converged_s < 0)
+            {
+                result->converged_s = true_us / 1e6 - start_s;
+            }
+
+            if (s >= settle_s && naive_valid)
+            {
+                result->err_us[result->err_num] = err;
+                result->naive_us[result->err_num] = fabs((double)(local + naive_offset) - true_us);
+                result->err_num++;
+            }
+        }
+    }
+}
+
+/* The servo reports the drift of mesh time against the node clock, the opposite of node_ppm */
+static double estimated_node_ppm(void)
+{
+    esp_mesh_lite_time_sync_status_t status;
+    esp_mesh_lite_time_sync_get_status(&status);
+    return -status.drift_ppm;
+}
+
+static void sim_report(const char *name, sim_result_t *result)
+{
+
+    double p50 = percentile(result->err_us, result->err_num, 0.50);
+    double p95 = percentile(result->err_us, result->err_num, 0.95);
+    double p99 = percentile(result->err_us, result->err_num, 0.99);
+    double naive_p50 = percentile(result->naive_us, result->err_num, 0.50);
+    double naive_p95 = percentile(result->naive_us, result->err_num, 0.95);
+    double naive_p99 = percentile(result->naive_us, result->err_num, 0.99);
+
+    printf("BENCH %s: %d exchanges, %d answered, synced after %.0f s, error below 1 ms from %.1f s\n",
+           name, result->exchanges, result->answered, result->synced_s, result->converged_s);
+    printf("BENCH   drift estimate %.1f ppm, true %.1f ppm\n", estimated_node_ppm(), node_ppm);
+    printf("BENCH   |error| us       p50     p95     p99     max\n");
+    printf("BENCH   servo        %7.0f %7.0f %7.0f %7.0f\n", p50, p95, p99, result->err_us[result->err_num - 1]);
+    printf("BENCH   last exch    %7.0f %7.0f %7.0f %7.0f\n", naive_p50, naive_p95, naive_p99,
+           result->naive_us[result->err_num - 1]);
+}
+
+static sim_result_t result;
+
+static void test_convergence(void)
+{
+    node_ppm = 40;
+    node_phase_us = 3.7e6;
+
+    sim_run(&result, 0, SIM_SECONDS / 2, SIM_SETTLE_S);
+    sim_report("40 ppm from cold", &result);
+
+    TEST_ASSERT(result.synced_s >= 0 && result.synced_s < 10);
+    TEST_ASSERT(result.converged_s >= 0 && result.converged_s < 180);
+    TEST_ASSERT(fabs(estimated_node_ppm() - node_ppm) < 5);
+    TEST_ASSERT(percentile(result.err_us, result.err_num, 0.99) < 1000);
+    TEST_ASSERT(percentile(result.naive_us, result.err_num, 0.99) > 10000);
+}
+
+static void test_drift_step(void)
+{
+    /* A 15 ppm step, as a node warming up, with the node clock continuous across it */
+    double tick_us = SIM_SECONDS / 2 * 1e6;
+    int64_t local = node_clock(tick_us);
+    node_ppm = 55;
+    node_phase_us += local - node_clock(tick_us);
+
+    memset(&result, 0, sizeof(result));
+    sim_run(&result, SIM_SECONDS / 2, SIM_SECONDS / 2, SIM_SECONDS / 2);
+    sim_report("15 ppm step", &result);
+
+    TEST_ASSERT(fabs(estimated_node_ppm() - node_ppm) < 5);
+    TEST_ASSERT(percentile(result.err_us, result.err_num, 0.99) < 1500);
+}
+
+static void test_parent_change(void)
+{
+    /* One hop further down, the estimate carries over and converges again at the fast interval */
+    node_level = 3;
+    memset(&result, 0, sizeof(result));
+    sim_run(&result, SIM_SECONDS, 120, SIM_SECONDS);
+    sim_report("parent change, 120 s", &result);
+
+    TEST_ASSERT(result.synced_s >= 0 && result.synced_s < 10);
+    TEST_ASSERT(percentile(result.err_us, result.err_num, 0.99) < 1000);
+}
+
+int main(void)
+{
+    RUN_TEST(test_convergence);
+    RUN_TEST(test_drift_step);
+    RUN_TEST(test_parent_change);
+    return host_test_result();
+}
@@ -0,0 +1,306 @@
+/*
+ * tracing: events come out of the Chrome trace export in order with their times, across a wrap
+ * of the cycle counter and an ISR stamping out of order, the ring keeps the newest events, an
+ * export racing a writer never shows a torn event, and the cost of an event and of an export.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+#include "freertos/task.h"
+#include "tracing.h"
+
+#define CPU_MHZ 240
+#define EXPORT_MAX (64 * 1024)
+#define BENCH_EVENTS 10000000
+
+/* The cycle counter is simulated, at CPU_MHZ against esp_timer */
+static uint32_t cycles_now;
+static uint32_t cycles_step;    /* Added by every read, for the thread test */
+static int64_t now_us = 1000000;
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    return __atomic_add_fetch(&cycles_now, cycles_step, __ATOMIC_RELAXED);
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void)
+{
+    return CPU_MHZ;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)pthread_self();
+}
+
+static void advance_us(int64_t us)
+{
+    now_us += us;
+    cycles_now += us * CPU_MHZ;
+}
+
+static char export_buf[EXPORT_MAX];
+static size_t export_len;
+static int export_flushes;
+static esp_err_t flush_ret = ESP_OK;
+
+static esp_err_t export_flush(void *ctx, const char *buf, size_t len)
+{
+    TEST_ASSERT(len > 0 && len <= 512);
+    export_flushes++;
+    if (flush_ret != ESP_OK)
+    {
+        return flush_ret;
+    }
+    TEST_ASSERT(export_len + len < sizeof(export_buf));
+    memcpy(export_buf + export_len, buf, len);
+    export_len += len;
+    export_buf[export_len] = '\0';
+    return ESP_OK;
+}
+
+typedef struct
+{
+    char name[32];
+    char phase;
+    double ts;
+    uint32_t arg;
+} trace_event_t;
+
+static trace_event_t events[1024];
+
+/* Export, checks the frame of the JSON and reads back the events, one per line */
+static int export_events(void)
+{
+    export_len = 0;
+    export_flushes = 0;
+    export_buf[0] = '\0';
+    TEST_ASSERT(tracing_export_chrome(export_flush, NULL) == ESP_OK);
+    TEST_ASSERT(!strncmp(export_buf, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", 40));
+    TEST_ASSERT(export_len >= 4 && !strcmp(export_buf + export_len - 4, "\n]}\n"));
+
+    int num = 0;
+    for (char *line = strstr(export_buf, "{\"name\":\""); line && num < 1024; line = strstr(line + 1, "\n{\"name\":\""))
+    {
+        trace_event_t *event = &events[num];
+        if (*line == '\n')
+        {
+            line++;
+        }
+        memset(event, 0, sizeof(*event));
+        TEST_ASSERT(sscanf(line, "{\"name\":\"%31[^\"]\",\"ph\":\"%c\",\"ts\":%lf", event->name, &event->phase, &event->ts) == 3);
+        char *end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        TEST_ASSERT(line[len - 1] == '}' || (line[len - 1] == ',' && line[len - 2] == '}'));
+        if (event->phase == TRACING_PHASE_INSTANT)
+        {
+            char *arg = strstr(line, "\"args\":{\"arg\":");
+            TEST_ASSERT(arg && arg < line + len && strstr(line, ",\"s\":\"t\"") < line + len);
+            event->arg = arg ? strtoul(arg + 14, NULL, 10) : 0;
+        }
+        num++;
+    }
+    return num;
+}
+
+static int trace_base = 0;
+
+/* Events since the previous call, the ring keeps the older ones */
+static trace_event_t *events_new(int *num)
+{
+    int total = export_events();
+    *num = total - trace_base;
+    trace_event_t *first = &events[trace_base];
+    trace_base = total;
+    return first;
+}
+
+static void test_order(void)
+{
+    int num;
+
+    advance_us(1000);
+    int64_t begin_us = now_us;
+    TRACE_BEGIN("outer");
+    advance_us(10);
+    TRACE_INSTANT("mark", 7);
+    advance_us(10);
+    TRACE_END("outer");
+    advance_us(5000);
+
+    trace_event_t *e = events_new(&num);
+    TEST_ASSERT(num == 3);
+    TEST_ASSERT(!strcmp(e[0].name, "outer") && e[0].phase == 'B' && e[0].ts == begin_us);
+    TEST_ASSERT(!strcmp(e[1].name, "mark") && e[1].phase == 'i' && e[1].ts == begin_us + 10 && e[1].arg == 7);
+    TEST_ASSERT(!strcmp(e[2].name, "outer") && e[2].phase == 'E' && e[2].ts == begin_us + 20);
+
+    /* Fractions of a microsecond are kept */
+    cycles_now += CPU_MHZ / 2;
+    TRACE_INSTANT("half", 0);
+    cycles_now += CPU_MHZ / 2;
+    now_us++;
+    e = events_new(&num);
+    TEST_ASSERT(num == 1 && e[0].ts == now_us - 0.5);
+}
+
+static void test_counter_wrap(void)
+{
+    int num;
+
+    /* 20 events 10 us apart, the 32 bit counter wraps in the middle */
+    cycles_now = UINT32_MAX - 95 * CPU_MHZ;
+    int64_t first_us = now_us;
+    for (int i = 0; i < 20; i++)
+    {
+        TRACE_INSTANT("tick", i);
+        advance_us(10);
+    }
+    TEST_ASSERT(cycles_now < 200 * CPU_MHZ);
+
+    trace_event_t *e = events_new(&num);
+    TEST_ASSERT(num == 20);
+    for (int i = 0; i < num; i++)
+    {
+        TEST_ASSERT(e[i].arg == (uint32_t)i && e[i].ts == first_us + i * 10);
+    }
+}
+
+static void test_isr_reorder(void)
+{
+    int num;
+
+    /*
+     * A task claims a slot and an ISR preempts it before it reads the counter: the ISR's event, in
+     * the next slot, is stamped before the task's
+     */
+    TRACE_INSTANT("before", 1);
+    uint32_t before = cycles_now;
+    cycles_now = before + 3 * CPU_MHZ;
+    TRACE_INSTANT("task", 2);
+    cycles_now = before + CPU_MHZ;
+    TRACE_INSTANT("isr", 3);
+    advance_us(100);
+
+    trace_event_t *e = events_new(&num);
+    TEST_ASSERT(num == 3);
+    TEST_ASSERT(e[1].ts - e[0].ts == 3 && e[2].ts - e[0].ts == 1);
+}
+
+static void test_overwrite(void)
+{
+    int num;
+
+    for (uint32_t i = 0; i < 4 * CONFIG_APP_TRACE_RING_SIZE; i++)
+    {
+        TRACE_INSTANT("fill", i);
+        advance_us(1);
+    }
+    num = export_events();
+    TEST_ASSERT(num == CONFIG_APP_TRACE_RING_SIZE);
+    for (int i = 0; i < num; i++)
+    {
+        TEST_ASSERT(events[i].arg == 3 * CONFIG_APP_TRACE_RING_SIZE + (uint32_t)i);
+        TEST_ASSERT(i == 0 || events[i].ts == events[i - 1].ts + 1);
+    }
+    trace_base = num;
+
+    /* A failed send ends the export at the first chunk */
+    export_flushes = 0;
+    flush_ret = ESP_FAIL;
+    TEST_ASSERT(tracing_export_chrome(export_flush, NULL) == ESP_FAIL);
+    TEST_ASSERT(export_flushes == 1);
+    flush_ret = ESP_OK;
+}
+
+/* Name and phase of an event follow from its argument, a torn event shows as a mismatch */
+static const char *const race_names[] = {"rx", "enqueue", "process", "send"};
+static volatile bool race_done;
+static uint32_t race_written;
+
+static void *race_writer(void *arg)
+{
+    for (uint32_t i = 0; !__atomic_load_n(&race_done, __ATOMIC_ACQUIRE); i++)
+    {
+        tracing_emit(race_names[i % 4], i % 3 ? TRACING_PHASE_INSTANT : TRACING_PHASE_BEGIN, i);
+        __atomic_store_n(&race_written, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void test_export_race(void)
+{
+    pthread_t writer;
+    int exports = 0;
+    int seen = 0;
+    int torn = 0;
+
+    cycles_step = 24;
+    race_done = false;
+    pthread_create(&writer, NULL, race_writer, NULL);
+    // The ring still holds the events of the previous tests until the writer has filled it
+    while (__atomic_load_n(&race_written, __ATOMIC_ACQUIRE) < CONFIG_APP_TRACE_RING_SIZE)
+    {
+        sched_yield();
+    }
+    for (; exports < 200; exports++)
+    {
+        int num = export_events();
+        bool first = true;
+        uint32_t last = 0;
+        for (int i = 0; i < num; i++)
+        {
+            // Only instants carry the argument
+            if (events[i].phase != TRACING_PHASE_INSTANT)
+            {
+                continue;
+            }
+            torn += strcmp(events[i].name, race_names[events[i].arg % 4]) || events[i].arg % 3 == 0;
+            torn += !first && events[i].arg <= last;
+            first = false;
+            last = events[i].arg;
+            seen++;
+        }
+    }
+    __atomic_store_n(&race_done, true, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+    cycles_step = 0;
+
+    TEST_ASSERT(torn == 0 && seen > exports);
+    printf("BENCH %d exports racing a writer: %d instants checked, %d torn\n", exports, seen, torn);
+}
+
+static void bench_emit(void)
+{
+    int64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_EVENTS; i++)
+    {
+        TRACE_INSTANT("bench", i);
+    }
+    double emit_ns = (double)(host_test_now_ns() - start) / BENCH_EVENTS;
+
+    start = host_test_now_ns();
+    int num = export_events();
+    double export_us = (host_test_now_ns() - start) / 1e3;
+    TEST_ASSERT(num == CONFIG_APP_TRACE_RING_SIZE);
+    printf("BENCH emit %.1f ns per event, export of %d events %.0f us, %u bytes (%u per event) in %d chunks\n",
+           emit_ns, num, export_us, (unsigned)export_len, (unsigned)(export_len / num), export_flushes);
+}
+
+int main(void)
+{
+    RUN_TEST(test_order);
+    RUN_TEST(test_counter_wrap);
+    RUN_TEST(test_isr_reorder);
+    RUN_TEST(test_overwrite);
+    RUN_TEST(test_export_race);
+    RUN_TEST(bench_emit);
+    return host_test_result();
+}
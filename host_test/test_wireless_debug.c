@@ -0,0 +1,745 @@
+/*
+ * esp_mesh_lite_wireless_debug fan-out on a simulated clock and radio: every target of a list
+ * answers and the results come in one callback before the timeout, targets out of range time out,
+ * a broadcast records every responder, a response spanning frames is joined, a response after the
+ * callback is dropped. Then the time to query 100 nodes: one command at a time through
+ * esp_mesh_lite_wireless_debug_send_command, against one fan-out to the list and one broadcast.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+/* The request slots, the debug task and its queue are static, the test drives them */
+#include "../components/mesh_lite/src/esp_mesh_lite_wireless_debug.c"
+
+#define SIM_NODES 100
+#define SIM_TIMEOUT_MS 500
+#define SIM_CHANNEL 6
+#define SIM_PROCESS_US 2000             /* Console run on a responder, assumed */
+#define SIM_TX_QUEUE 8                  /* Frames the ESP-NOW driver holds before ESP_ERR_ESPNOW_NO_MEM, assumed */
+#define SIM_MAC_TRIES 4                 /* Assumed tries of the Wi-Fi MAC for a unicast frame */
+#define SIM_EVENTS 1024
+#define SIM_LONG_OUTPUT 400             /* Output of the "dump" command of the simulated responders */
+
+/* Medium time at 1 Mbit/s: DIFS and the mean backoff, long preamble, then MAC header, vendor action and FCS */
+#define AIR_PREAMBLE_US 192
+#define AIR_OVERHEAD_BYTES 43
+#define AIR_DIFS_US 50
+#define AIR_SLOT_US 20
+#define AIR_CW_MIN 31
+#define AIR_ACK_US (10 + AIR_PREAMBLE_US + 14 * 8) /* SIFS and the ACK */
+
+enum
+{
+    EV_NODE_RX,     /* A responder receives a command */
+    EV_NODE_TX,     /* A responder has run it and sends the output */
+    EV_REQ_RX,      /* The requester receives a frame of a response */
+};
+
+typedef struct
+{
+    bool used;
+    int kind;
+    int node;
+    int64_t at_us;
+    int len;
+    uint8_t data[ESPNOW_PAYLOAD_MAX_LEN];
+} sim_event_t;
+
+typedef struct
+{
+    void *id;
+    TimerCallbackFunction_t cb;
+    bool active;
+    int64_t expiry_us;
+} sim_timer_t;
+
+static const uint8_t own_mac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+static uint8_t node_mac[SIM_NODES][ESP_NOW_ETH_ALEN];
+static bool node_absent[SIM_NODES];
+static int64_t node_delay_us[SIM_NODES];
+
+static int64_t now_us;
+static int64_t air_free_us;
+static int64_t tx_queue_end_us[SIM_TX_QUEUE];  /* End of the last frames of the requester, oldest first */
+static double loss;
+static uint32_t frames;
+static sim_event_t sim_events[SIM_EVENTS];
+static sim_timer_t sim_timers[FANOUT_MAX_REQUESTS];
+static int timer_num;
+
+static esp_mesh_lite_espnow_event_t queue_items[WIRELESS_DEBUG_QUEUE_SIZE];
+static int queue_head;
+static int queue_len;
+static uint32_t queue_drops;
+
+static uint32_t rng_state = 2463534242;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static bool heard(void)
+{
+    return rng() / 4294967296.0 >= loss;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return now_us / 1000;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return now_us / 1000;
+}
+
+static void sim_run_until(int64_t until_us, const bool *stop);
+
+void vTaskDelay(TickType_t ticks)
+{
+    // The driver drains and responses keep coming while the sender waits
+    int64_t until_us = now_us + ticks * 1000LL;
+    sim_run_until(until_us, NULL);
+    now_us = until_us;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task)
+{
+    // The test runs the debug task whenever its queue has something
+    *task = (TaskHandle_t)fn;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    TEST_ASSERT(length == WIRELESS_DEBUG_QUEUE_SIZE && item_size == sizeof(esp_mesh_lite_espnow_event_t));
+    return queue_items;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    if (queue_len == WIRELESS_DEBUG_QUEUE_SIZE)
+    {
+        queue_drops++;
+        return pdFALSE;
+    }
+    memcpy(&queue_items[(queue_head + queue_len++) % WIRELESS_DEBUG_QUEUE_SIZE], item, sizeof(queue_items[0]));
+    return pdTRUE;
+}
+
+/* Empty: the debug task returns, the test runs it again for the next frame */
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    if (queue_len == 0)
+    {
+        return pdFALSE;
+    }
+    memcpy(item, &queue_items[queue_head], sizeof(queue_items[0]));
+    queue_head = (queue_head + 1) % WIRELESS_DEBUG_QUEUE_SIZE;
+    queue_len--;
+    return pdTRUE;
+}
+
+TimerHandle_t xTimerCreate(const char *name, uint32_t period, int reload, void *id, TimerCallbackFunction_t cb)
+{
+    TEST_ASSERT(timer_num < FANOUT_MAX_REQUESTS && !reload);
+    sim_timers[timer_num] = (sim_timer_t) {.id = id, .cb = cb};
+    return &sim_timers[timer_num++];
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return ((sim_timer_t *)timer)->id;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    sim_timer_t *t = timer;
+    t->active = true;
+    t->expiry_us = now_us + period * 1000LL;
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait)
+{
+    ((sim_timer_t *)timer)->active = false;
+    return pdPASS;
+}
+
+static struct arg_int arg_int_stub;
+static struct arg_str arg_str_stub;
+static struct arg_end arg_end_stub;
+
+struct arg_int *arg_int1(const char *shortopts, const char *longopts, const char *datatype, const char *glossary)
+{
+    return &arg_int_stub;
+}
+
+struct arg_str *arg_str1(const char *shortopts, const char *longopts, const char *datatype, const char *glossary)
+{
+    return &arg_str_stub;
+}
+
+struct arg_end *arg_end(int maxcount)
+{
+    return &arg_end_stub;
+}
+
+int arg_parse(int argc, char **argv, void **argtable)
+{
+    return 0;
+}
+
+void arg_print_errors(FILE *fp, struct arg_end *end, const char *progname)
+{
+}
+
+esp_err_t esp_console_init(const esp_console_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_console_deinit(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    return ESP_OK;
+}
+
+/* The requester only receives responses, the responders are simulated */
+esp_err_t esp_console_run(const char *cmdline, int *cmd_ret)
+{
+    TEST_ASSERT(false);
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second)
+{
+    *primary = SIM_CHANNEL;
+    *second = WIFI_SECOND_CHAN_NONE;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    memcpy(mac, own_mac, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    memset(ap_info, 0, sizeof(*ap_info));
+    ap_info->primary = SIM_CHANNEL;
+    return ESP_OK;
+}
+
+void esp_restart(void)
+{
+}
+
+uint8_t esp_mesh_lite_get_mesh_id(void)
+{
+    return CONFIG_MESH_ID;
+}
+
+void esp_mesh_lite_core_log_enable(bool enable)
+{
+}
+
+void esp_mesh_lite_set_wireless_debug_log_writev(wireless_debug_log_writev_t writev)
+{
+}
+
+esp_err_t esp_mesh_lite_espnow_recv_cb_register(esp_mesh_lite_espnow_data_type_t type, esp_mesh_lite_espnow_recv_cb_t recv_cb)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_recv_cb_unregister(esp_mesh_lite_espnow_data_type_t type)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_add(const uint8_t *peer_addr, uint8_t channel, wifi_interface_t ifidx)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_query_caps(const uint8_t *peer_addr)
+{
+    return ESP_OK;
+}
+
+size_t esp_mesh_lite_espnow_max_data_len(const uint8_t *peer_addr)
+{
+    return ESP_NOW_MAX_DATA_LEN - 1;
+}
+
+static void sim_schedule(int kind, int node, int64_t at_us, const uint8_t *data, int len)
+{
+    for (int i = 0; i < SIM_EVENTS; i++)
+    {
+        if (!sim_events[i].used)
+        {
+            sim_events[i] = (sim_event_t) {.used = true, .kind = kind, .node = node, .at_us = at_us, .len = len};
+            memcpy(sim_events[i].data, data, len);
+            return;
+        }
+    }
+    TEST_ASSERT(false);
+}
+
+/* One frame on the medium from at_us, returns when it is done, and if it got through */
+static int64_t sim_air(int64_t at_us, bool unicast, size_t len, bool *delivered)
+{
+    int64_t start_us = at_us > air_free_us ? at_us : air_free_us;
+    double air_us = 0;
+    int cw = AIR_CW_MIN;
+
+    frames++;
+    *delivered = !unicast;
+    for (int try = 0; try < (unicast ? SIM_MAC_TRIES : 1); try++)
+    {
+        air_us += AIR_DIFS_US + cw / 2.0 * AIR_SLOT_US + AIR_PREAMBLE_US + (AIR_OVERHEAD_BYTES + len + 1) * 8.0;
+        cw = cw * 2 + 1;
+        if (unicast && heard())
+        {
+            air_us += AIR_ACK_US;
+            *delivered = true;
+            break;
+        }
+    }
+    air_free_us = start_us + (int64_t)air_us;
+    return air_free_us;
+}
+
+static int node_index(const uint8_t *mac)
+{
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        if (!memcmp(node_mac[i], mac, ESP_NOW_ETH_ALEN))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Sent by the requester: queued by the driver, on the air after what it queued before */
+esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    TEST_ASSERT(type == ESPNOW_DATA_TYPE_WIRELESS_DEBUG && len <= ESP_NOW_MAX_DATA_LEN - 1);
+    if (tx_queue_end_us[0] > now_us)
+    {
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+
+    bool broadcast = IS_BROADCAST_ADDR(peer_addr);
+    bool delivered;
+    int64_t queued_us = tx_queue_end_us[SIM_TX_QUEUE - 1] > now_us ? tx_queue_end_us[SIM_TX_QUEUE - 1] : now_us;
+    int64_t end_us = sim_air(queued_us, !broadcast, len, &delivered);
+    memmove(tx_queue_end_us, tx_queue_end_us + 1, sizeof(tx_queue_end_us) - sizeof(tx_queue_end_us[0]));
+    tx_queue_end_us[SIM_TX_QUEUE - 1] = end_us;
+
+    if (broadcast)
+    {
+        for (int i = 0; i < SIM_NODES; i++)
+        {
+            if (heard())
+            {
+                sim_schedule(EV_NODE_RX, i, end_us, data, len);
+            }
+        }
+    }
+    else if (delivered && node_index(peer_addr) >= 0)
+    {
+        sim_schedule(EV_NODE_RX, node_index(peer_addr), end_us, data, len);
+    }
+    return ESP_OK;
+}
+
+/* A responder runs the command like wireless_debug_cmd_*: a --mac of another node is not answered */
+static void node_rx(sim_event_t *ev)
+{
+    const wireless_debug_data_t *cmd = (const wireless_debug_data_t *)ev->data;
+    char line[ESPNOW_PAYLOAD_MAX_LEN] = {0};
+    char own[18];
+
+    if (node_absent[ev->node] || cmd->is_rsp_payload)
+    {
+        return;
+    }
+    memcpy(line, cmd->payload, ev->len - sizeof(wireless_debug_data_t));
+    snprintf(own, sizeof(own), MACSTR, MAC2STR(node_mac[ev->node]));
+    char *mac = strstr(line, "--mac ");
+    if ((mac && strncmp(mac + 6, own, 17)) || (!mac && strncmp(line, "core_log", 8)))
+    {
+        return;
+    }
+
+    uint8_t rsp[ESPNOW_PAYLOAD_MAX_LEN];
+    wireless_debug_data_t *data = (wireless_debug_data_t *)rsp;
+    memcpy(data, cmd, sizeof(*data));
+    data->is_rsp_payload = true;
+    int len;
+    if (!strncmp(line, "dump", 4))
+    {
+        len = SIM_LONG_OUTPUT;
+    }
+    else if (!strncmp(line, "core_log", 8))
+    {
+        len = sprintf((char *)data->payload, "core_log:OK");
+    }
+    else
+    {
+        len = sprintf((char *)data->payload, "discover:%s,%d.", own, SIM_CHANNEL);
+    }
+
+    // Split like the debug task does, into frames of what the requester receives
+    size_t chunk_max = ESP_NOW_MAX_DATA_LEN - 1 - sizeof(wireless_debug_data_t);
+    int64_t at_us = ev->at_us + SIM_PROCESS_US + node_delay_us[ev->node];
+    for (int offset = 0; offset < len; offset += chunk_max)
+    {
+        int chunk = len - offset < (int)chunk_max ? len - offset : (int)chunk_max;
+        if (len == SIM_LONG_OUTPUT)
+        {
+            memset(data->payload, 'a' + offset / chunk_max, chunk);
+        }
+        else
+        {
+            memmove(data->payload, data->payload + offset, chunk);
+        }
+        sim_schedule(EV_NODE_TX, ev->node, at_us, rsp, sizeof(wireless_debug_data_t) + chunk);
+    }
+}
+
+static void node_tx(sim_event_t *ev)
+{
+    bool delivered;
+    int64_t end_us = sim_air(ev->at_us, true, ev->len, &delivered);
+    if (delivered)
+    {
+        sim_schedule(EV_REQ_RX, ev->node, end_us, ev->data, ev->len);
+    }
+}
+
+/* The ESP-NOW receive callback, then the debug task until its queue is empty */
+static void req_rx(sim_event_t *ev)
+{
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -60};
+    esp_now_recv_info_t info = {.src_addr = node_mac[ev->node], .des_addr = (uint8_t *)own_mac, .rx_ctrl = &rx_ctrl};
+
+    wireless_debug_process_cb(&info, ev->data, ev->len);
+    TaskHandle_t task = mesh_lite_wireless_debug_task_handle;
+    esp_mesh_lite_wireless_debug_task(NULL);
+    mesh_lite_wireless_debug_task_handle = task;
+}
+
+static void sim_run_until(int64_t until_us, const bool *stop)
+{
+    while (!stop || !*stop)
+    {
+        sim_event_t *ev = NULL;
+        sim_timer_t *timer = NULL;
+        int64_t next_us = until_us + 1;
+        for (int i = 0; i < SIM_EVENTS; i++)
+        {
+            if (sim_events[i].used && sim_events[i].at_us < next_us)
+            {
+                ev = &sim_events[i];
+                next_us = ev->at_us;
+            }
+        }
+        for (int i = 0; i < timer_num; i++)
+        {
+            if (sim_timers[i].active && sim_timers[i].expiry_us < next_us)
+            {
+                timer = &sim_timers[i];
+                next_us = timer->expiry_us;
+            }
+        }
+        if (next_us > until_us)
+        {
+            return;
+        }
+        now_us = next_us > now_us ? next_us : now_us;
+        if (timer)
+        {
+            timer->active = false;
+            timer->cb(timer);
+            continue;
+        }
+        sim_event_t copy = *ev;
+        ev->used = false;
+        if (copy.kind == EV_NODE_RX)
+        {
+            node_rx(&copy);
+        }
+        else if (copy.kind == EV_NODE_TX)
+        {
+            node_tx(&copy);
+        }
+        else
+        {
+            req_rx(&copy);
+        }
+    }
+}
+
+/* Results of the last fan-out, copied out of the callback */
+static bool fanout_done;
+static int fanout_calls;
+static int64_t fanout_done_us;
+static uint32_t fanout_corr_id;
+static size_t fanout_count;
+static esp_mesh_lite_wireless_debug_fanout_result_t fanout_results[FANOUT_MAX_NODES];
+static char fanout_responses[FANOUT_MAX_NODES][SIM_LONG_OUTPUT + 1];
+
+static void fanout_cb(uint32_t corr_id, const esp_mesh_lite_wireless_debug_fanout_result_t *results, size_t count, void *arg)
+{
+    fanout_done = true;
+    fanout_calls++;
+    fanout_done_us = now_us;
+    fanout_corr_id = corr_id;
+    fanout_count = count;
+    for (size_t i = 0; i < count && i < FANOUT_MAX_NODES; i++)
+    {
+        fanout_results[i] = results[i];
+        fanout_results[i].response = NULL;
+        fanout_responses[i][0] = '\0';
+        if (results[i].response)
+        {
+            TEST_ASSERT(results[i].response_len == strlen(results[i].response) && results[i].response_len <= SIM_LONG_OUTPUT);
+            strncpy(fanout_responses[i], results[i].response, SIM_LONG_OUTPUT);
+        }
+    }
+}
+
+static bool legacy_done;
+static int64_t legacy_done_us;
+
+static void legacy_cb(char *response_data, size_t len)
+{
+    legacy_done = true;
+    legacy_done_us = now_us;
+}
+
+static void reset(double frame_loss)
+{
+    loss = frame_loss;
+    rng_state = 2463534242;
+    frames = 0;
+    queue_drops = 0;
+    memset(node_absent, 0, sizeof(node_absent));
+    memset(node_delay_us, 0, sizeof(node_delay_us));
+    // Whatever a previous test left on the air is let through first
+    sim_run_until(INT64_MAX / 2, NULL);
+    now_us += 1000000;
+    air_free_us = now_us;
+}
+
+/* A fan-out to the first num nodes, or a broadcast if num is 0, run until its callback */
+static int64_t fanout(int num, const char *command)
+{
+    uint32_t id = 0;
+    int64_t start_us = now_us;
+
+    fanout_done = false;
+    fanout_calls = 0;
+    TEST_ASSERT(esp_mesh_lite_wireless_debug_send_command_multi(num ? node_mac : NULL, num, command, strlen(command),
+                                                                SIM_CHANNEL, SIM_TIMEOUT_MS, fanout_cb, NULL, &id) == ESP_OK);
+    sim_run_until(now_us + 60 * 1000000LL, &fanout_done);
+    TEST_ASSERT(fanout_done && fanout_corr_id == id);
+    return fanout_done_us - start_us;
+}
+
+static void test_fanout_all(void)
+{
+    reset(0);
+    int64_t took_us = fanout(SIM_NODES, "discover");
+    TEST_ASSERT(fanout_count == SIM_NODES && took_us < SIM_TIMEOUT_MS * 1000);
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        char expect[64];
+        snprintf(expect, sizeof(expect), "discover:" MACSTR ",%d.", MAC2STR(node_mac[i]), SIM_CHANNEL);
+        TEST_ASSERT(!memcmp(fanout_results[i].mac, node_mac[i], ESP_NOW_ETH_ALEN));
+        TEST_ASSERT(fanout_results[i].status == WIRELESS_DEBUG_FANOUT_OK && !strcmp(fanout_responses[i], expect));
+    }
+
+    /* Only once, even with the timer of the deadline still due */
+    sim_run_until(now_us + 2 * SIM_TIMEOUT_MS * 1000, NULL);
+    TEST_ASSERT(fanout_calls == 1 && queue_drops == 0);
+}
+
+static void test_fanout_timeout(void)
+{
+    reset(0);
+    node_absent[3] = node_absent[50] = true;
+    int64_t took_us = fanout(SIM_NODES, "discover");
+    TEST_ASSERT(took_us >= SIM_TIMEOUT_MS * 1000 && took_us < 2 * SIM_TIMEOUT_MS * 1000);
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        TEST_ASSERT(fanout_results[i].status == (node_absent[i] ? WIRELESS_DEBUG_FANOUT_TIMEOUT : WIRELESS_DEBUG_FANOUT_OK));
+    }
+
+    /* Answered after the callback: dropped */
+    reset(0);
+    node_delay_us[7] = 2 * SIM_TIMEOUT_MS * 1000;
+    fanout(10, "discover");
+    TEST_ASSERT(fanout_results[7].status == WIRELESS_DEBUG_FANOUT_TIMEOUT);
+    sim_run_until(now_us + 3 * SIM_TIMEOUT_MS * 1000, NULL);
+    TEST_ASSERT(fanout_calls == 1);
+}
+
+static void test_broadcast(void)
+{
+    reset(0);
+    int64_t took_us = fanout(0, "core_log --onoff 0 --level 0");
+    TEST_ASSERT(fanout_count == SIM_NODES && took_us >= SIM_TIMEOUT_MS * 1000);
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        TEST_ASSERT(node_index(fanout_results[i].mac) >= 0 && !strcmp(fanout_responses[i], "core_log:OK"));
+    }
+}
+
+static void test_long_response(void)
+{
+    reset(0);
+    fanout(2, "dump");
+    for (int i = 0; i < 2; i++)
+    {
+        TEST_ASSERT(fanout_results[i].status == WIRELESS_DEBUG_FANOUT_OK && strlen(fanout_responses[i]) == SIM_LONG_OUTPUT);
+        TEST_ASSERT(fanout_responses[i][0] == 'a' && fanout_responses[i][SIM_LONG_OUTPUT - 1] == 'b');
+    }
+}
+
+/* One command at a time: sent, then the response or the timeout before the next */
+static int64_t legacy_sweep(int *answered)
+{
+    int64_t start_us = now_us;
+
+    *answered = 0;
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        char command[64];
+        snprintf(command, sizeof(command), "discover --mac " MACSTR, MAC2STR(node_mac[i]));
+        legacy_done = false;
+        int64_t sent_us = now_us;
+        TEST_ASSERT(esp_mesh_lite_wireless_debug_send_command(node_mac[i], command, strlen(command), SIM_CHANNEL) == ESP_OK);
+        sim_run_until(sent_us + SIM_TIMEOUT_MS * 1000, &legacy_done);
+        *answered += legacy_done;
+        now_us = legacy_done ? legacy_done_us : sent_us + SIM_TIMEOUT_MS * 1000;
+    }
+    return now_us - start_us;
+}
+
+static void latency_ms(int *p50, int *max)
+{
+    uint32_t sorted[FANOUT_MAX_NODES];
+    int num = 0;
+
+    for (size_t i = 0; i < fanout_count; i++)
+    {
+        if (fanout_results[i].status == WIRELESS_DEBUG_FANOUT_OK)
+        {
+            uint32_t v = fanout_results[i].latency_ms;
+            int j = num++;
+            for (; j > 0 && sorted[j - 1] > v; j--)
+            {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[j] = v;
+        }
+    }
+    *p50 = num ? sorted[num / 2] : 0;
+    *max = num ? sorted[num - 1] : 0;
+}
+
+static int answered(void)
+{
+    int num = 0;
+    for (size_t i = 0; i < fanout_count; i++)
+    {
+        num += fanout_results[i].status == WIRELESS_DEBUG_FANOUT_OK;
+    }
+    return num;
+}
+
+static void bench_nodes(void)
+{
+    static const struct
+    {
+        double loss;
+        int absent;     /* Nodes off or out of range, from the end of the list */
+    } cases[] = {{0.0, 0}, {0.0, 5}, {0.1, 0}, {0.3, 0}};
+
+    printf("BENCH %d nodes, %d ms timeout, %d us to run a command, %d frames queued by the driver, %d MAC tries\n",
+           SIM_NODES, SIM_TIMEOUT_MS, SIM_PROCESS_US, SIM_TX_QUEUE, SIM_MAC_TRIES);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        int legacy_answered, p50, max;
+
+        reset(cases[i].loss);
+        memset(node_absent + SIM_NODES - cases[i].absent, 1, cases[i].absent);
+        int64_t legacy_us = legacy_sweep(&legacy_answered);
+        uint32_t legacy_frames = frames;
+
+        reset(cases[i].loss);
+        memset(node_absent + SIM_NODES - cases[i].absent, 1, cases[i].absent);
+        int64_t list_us = fanout(SIM_NODES, "discover");
+        int list_answered = answered();
+        latency_ms(&p50, &max);
+        uint32_t list_frames = frames;
+
+        reset(cases[i].loss);
+        memset(node_absent + SIM_NODES - cases[i].absent, 1, cases[i].absent);
+        int64_t broadcast_us = fanout(0, "core_log --onoff 0 --level 0");
+        int broadcast_answered = answered();
+
+        printf("BENCH   loss %2.0f%%, %d absent: one at a time %7.1f ms, %3d answered, %3u frames | fan-out %6.1f ms, "
+               "%3d answered, %3u frames, latency p50 %2d ms max %2d ms | broadcast %5.1f ms, %3d answered\n",
+               cases[i].loss * 100, cases[i].absent, legacy_us / 1e3, legacy_answered, (unsigned)legacy_frames,
+               list_us / 1e3, list_answered, (unsigned)list_frames, p50, max, broadcast_us / 1e3, broadcast_answered);
+
+        /* Airtime bounds both, the fan-out saves the wait per node, and a timeout per silent node */
+        TEST_ASSERT(list_answered >= legacy_answered - 2 && list_us < legacy_us && queue_drops == 0);
+        TEST_ASSERT(list_answered == legacy_answered || list_us * 2 < legacy_us);
+    }
+}
+
+int main(void)
+{
+    for (int i = 0; i < SIM_NODES; i++)
+    {
+        uint8_t mac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0x10, i / 256, i % 256};
+        memcpy(node_mac[i], mac, ESP_NOW_ETH_ALEN);
+    }
+    esp_mesh_lite_wireless_debug_init();
+    TEST_ASSERT(mesh_lite_wireless_debug_task_handle != NULL);
+    // Runs until its queue is empty, which creates the queue
+    esp_mesh_lite_wireless_debug_task(NULL);
+    mesh_lite_wireless_debug_task_handle = (TaskHandle_t)esp_mesh_lite_wireless_debug_task;
+
+    esp_mesh_lite_wireless_debug_cb_list_t cb = {.recv_resp_data_cb = legacy_cb};
+    esp_mesh_lite_wireless_debug_cb_register(&cb);
+
+    RUN_TEST(test_fanout_all);
+    RUN_TEST(test_fanout_timeout);
+    RUN_TEST(test_broadcast);
+    RUN_TEST(test_long_response);
+    RUN_TEST(bench_nodes);
+    return host_test_result();
+}
@@ -0,0 +1,1294 @@
+/*
+ * zero_provisioning discovery on a simulated clock and radio: the sweep visits channels with mesh
+ * beacons first, then channels with other APs, each sorted by RSSI, with a dwell that follows the
+ * hint and doubles every round up to 8x; the last broadcast on a channel is answered before the hop,
+ * and the sweep ends on the provisioner's credentials and stays on its channel until the ack,
+ * resending the confirm. A full pending table of the provisioner makes room with its oldest done
+ * entry. Then the time to provision a fleet of 50 devices, median and p99, against the fixed
+ * round-robin sweep it replaced, and 200 idle nodes around one provisioner, unpacked over 2 s or
+ * powered up within 200 ms, against the stateless provisioner it replaced.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host_test.h"
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+/* In newlib, glibc only has it from 2.38 */
+static size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size)
+    {
+        size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+#endif
+
+#include "sdkconfig.h"
+#if HOST_TEST_HANDSHAKES
+/* Built again with another limit, see CMakeLists.txt */
+#undef CONFIG_ZERO_PROV_MAX_CONCURRENT_HANDSHAKES
+#define CONFIG_ZERO_PROV_MAX_CONCURRENT_HANDSHAKES HOST_TEST_HANDSHAKES
+#endif
+
+/* The sweep, the handshake timers and the event queue are static, the test drives them */
+#include "../components/mesh_lite/src/wifi_prov/zero_provisioning.c"
+
+#define SIM_DEVICES 50
+#define SIM_LOSS 0.1
+#define SIM_PROCESS_US 20000            /* Provisioner turnaround from a frame to its answer, assumed */
+#define SIM_INFO_RETRY_US 300000        /* Provisioner resends the credentials while no confirm comes */
+#define SIM_INFO_TRIES 6
+#define SIM_SEES_MESH 0.7               /* Devices whose boot scan has a beacon of a mesh softAP, assumed */
+#define SIM_SEES_ROUTER 0.8             /* Devices whose boot scan has a beacon of the router, assumed */
+#define SIM_MAC_TRIES 4                 /* Assumed tries of the Wi-Fi MAC for a unicast frame */
+#define SIM_TIMEOUT_US (120 * 1000000LL)
+#define SIM_TX_QUEUE 8                  /* Frames the ESP-NOW driver holds before ESP_ERR_ESPNOW_NO_MEM, assumed */
+#define SIM_EVENTS 1024
+#define SIM_TIMERS 4
+#define SIM_LOG 512
+#define LEGACY_INTERVAL_MS 400          /* The replaced sweep: every channel in order, 4 broadcasts 400 ms apart */
+
+/* Bulk provisioning: idle nodes found the provisioner's channel and broadcast on it */
+#define FLEET_NODES 200
+#define FLEET_CHANNEL 6
+#define FLEET_BOOT_US 2000000           /* The idle nodes power up within 2 s, as they are unpacked */
+#define FLEET_BURST_US 200000           /* A site powered up at once, within 200 ms */
+#define FLEET_PROCESS_US 5000           /* Idle node from the credentials to its confirm, assumed */
+#define FLEET_CONFIRM_RESEND_US 500000  /* The resend timer of zero_prov_init */
+#define FLEET_TIMEOUT_US (300 * 1000000LL)
+
+/* Medium time at 1 Mbit/s: DIFS and the mean backoff, long preamble, then MAC header, vendor action and FCS */
+#define AIR_PREAMBLE_US 192
+#define AIR_OVERHEAD_BYTES 43
+#define AIR_DIFS_US 50
+#define AIR_SLOT_US 20
+#define AIR_CW_MIN 31
+#define AIR_ACK_US (10 + AIR_PREAMBLE_US + 14 * 8) /* SIFS and the ACK */
+
+enum
+{
+    EV_SEND_DONE,   /* A frame of the node under test is out, the driver calls the send callback */
+    EV_PEER_RX,     /* A simulated peer receives a frame of the node under test */
+    EV_PEER_TX,     /* A simulated peer sends */
+    EV_OWN_RX,      /* The node under test receives a frame of a peer */
+};
+
+typedef struct
+{
+    bool used;
+    int kind;
+    int64_t at_us;
+    int node;                           /* Index in the fleet */
+    uint32_t gen;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    esp_now_send_status_t status;
+    int len;
+    uint8_t data[ESPNOW_PAYLOAD_MAX_LEN];
+} sim_event_t;
+
+typedef struct
+{
+    bool used;
+    bool active;
+    bool reload;
+    int64_t period_us;
+    int64_t expiry_us;
+    TimerCallbackFunction_t cb;
+} sim_timer_t;
+
+struct esp_timer
+{
+    bool used;
+    bool active;
+    int64_t expiry_us;
+    esp_timer_cb_t cb;
+    void *arg;
+};
+
+typedef struct
+{
+    int64_t at_us;
+    uint8_t channel;
+} sim_broadcast_t;
+
+enum
+{
+    FLEET_BROADCASTING,
+    FLEET_CONFIRMING,
+    FLEET_DONE,
+};
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int state;
+    uint32_t gen;                       /* Restarts the confirm resends on new credentials */
+    int infos;
+    int64_t boot_us;
+    int64_t done_us;
+} fleet_node_t;
+
+static const uint8_t node_mac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+static const uint8_t prov_mac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x02};
+
+static int64_t now_us = 1000000;
+static int64_t air_free_us;
+static double loss;
+static uint8_t own_channel = 1;
+static uint8_t prov_channel;            /* 0: no provisioner in range */
+static sim_event_t sim_events[SIM_EVENTS];
+static sim_timer_t sim_timers[SIM_TIMERS];
+static struct esp_timer sim_esp_timers[SIM_TIMERS];
+static bool provisioned;
+static int own_tx_inflight;
+static uint32_t own_frames;
+static uint32_t own_no_mem;
+static esp_now_send_cb_t own_send_cb;
+static esp_mesh_lite_espnow_recv_cb_t own_recv_cb;
+static zero_prov_act_t node_act;
+
+static zero_prov_event_t queue_items[ZERO_PROV_QUEUE_SIZE];
+static int queue_head;
+static int queue_len;
+
+/* The provisioner, a mesh node on prov_channel */
+static bool prov_busy;
+static bool prov_confirmed;
+static int prov_info_tries;
+static int prov_confirms;
+static int drop_confirms;
+
+static sim_broadcast_t broadcasts[SIM_LOG];
+static int broadcast_num;
+static int info_received;
+static bool connected;
+
+/* The idle nodes around a provisioner under test, none when the node under test is an idle node */
+static fleet_node_t fleet[FLEET_NODES];
+static int fleet_num;
+static int fleet_done;
+static bool fleet_all_done;
+
+static int legacy_broadcast_count;
+static uint8_t legacy_channel_num;
+
+static uint32_t rng_state = 2463534242;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double rng_unit(void)
+{
+    return rng() / 4294967296.0;
+}
+
+static bool heard(void)
+{
+    return rng_unit() >= loss;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    for (int i = 0; i < SIM_TIMERS; i++)
+    {
+        if (!sim_esp_timers[i].used)
+        {
+            sim_esp_timers[i] = (struct esp_timer) {.used = true, .cb = create_args->callback, .arg = create_args->arg};
+            *out_handle = &sim_esp_timers[i];
+            return ESP_OK;
+        }
+    }
+    TEST_ASSERT(false);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    timer->active = true;
+    timer->expiry_us = now_us + timeout_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    timer->used = false;
+    timer->active = false;
+    return ESP_OK;
+}
+
+TimerHandle_t xTimerCreate(const char *name, uint32_t period, int reload, void *id, TimerCallbackFunction_t cb)
+{
+    for (int i = 0; i < SIM_TIMERS; i++)
+    {
+        if (!sim_timers[i].used)
+        {
+            sim_timers[i] = (sim_timer_t) {.used = true, .reload = reload, .period_us = period * 1000LL, .cb = cb};
+            return &sim_timers[i];
+        }
+    }
+    TEST_ASSERT(false);
+    return NULL;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return NULL;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    sim_timer_t *t = timer;
+    t->active = true;
+    t->expiry_us = now_us + t->period_us;
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    ((sim_timer_t *)timer)->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    ((sim_timer_t *)timer)->period_us = period * 1000LL;
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return ((sim_timer_t *)timer)->active ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait)
+{
+    ((sim_timer_t *)timer)->used = false;
+    ((sim_timer_t *)timer)->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *task)
+{
+    // The test runs the event handlers of zero_prov_task whenever its queue has something
+    *task = (TaskHandle_t)fn;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    TEST_ASSERT(length == ZERO_PROV_QUEUE_SIZE && item_size == sizeof(zero_prov_event_t));
+    queue_head = 0;
+    queue_len = 0;
+    return queue_items;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    if (queue_len == ZERO_PROV_QUEUE_SIZE)
+    {
+        return pdFALSE;
+    }
+    memcpy(&queue_items[(queue_head + queue_len++) % ZERO_PROV_QUEUE_SIZE], item, sizeof(queue_items[0]));
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    if (queue_len == 0)
+    {
+        return pdFALSE;
+    }
+    memcpy(item, &queue_items[queue_head], sizeof(queue_items[0]));
+    queue_head = (queue_head + 1) % ZERO_PROV_QUEUE_SIZE;
+    queue_len--;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    // Received frames still queued are dropped with their buffers, as on the device
+    zero_prov_event_t evt;
+    while (xQueueReceive(queue, &evt, 0) == pdTRUE)
+    {
+        if (evt.id == ZERO_PROV_RECIVE_DATA)
+        {
+            free(evt.info.recv_cb.data);
+        }
+    }
+    return pdPASS;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler,
+                                     void *event_handler_arg)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler)
+{
+    return ESP_OK;
+}
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(WIFI_PROV_EVENT);
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    memset(conf, 0, sizeof(*conf));
+    if (provisioned && interface == WIFI_IF_STA)
+    {
+        strcpy((char *)conf->sta.ssid, "router");
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    memcpy(mac, ifx == WIFI_IF_STA ? node_mac : prov_mac, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_country(wifi_country_t *country)
+{
+    country->schan = 1;
+    country->nchan = 13;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    own_channel = primary;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second)
+{
+    *primary = own_channel;
+    *second = WIFI_SECOND_CHAN_NONE;
+    return ESP_OK;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 100000;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    own_send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_send_cb(void)
+{
+    own_send_cb = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_recv_cb_register(esp_mesh_lite_espnow_data_type_t type, esp_mesh_lite_espnow_recv_cb_t recv_cb)
+{
+    TEST_ASSERT(type == ESPNOW_DATA_TYPE_ZERO_PROV);
+    own_recv_cb = recv_cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_recv_cb_unregister(esp_mesh_lite_espnow_data_type_t type)
+{
+    own_recv_cb = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_add(const uint8_t *peer_addr, uint8_t channel, wifi_interface_t ifidx)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_espnow_peer_del(const uint8_t *peer_addr)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_set_router_config(mesh_lite_sta_config_t *config)
+{
+    return ESP_OK;
+}
+
+void esp_mesh_lite_connect(void)
+{
+    connected = true;
+}
+
+esp_err_t esp_mesh_lite_get_router_config(mesh_lite_sta_config_t *router_config)
+{
+    strcpy((char *)router_config->ssid, "router");
+    strcpy((char *)router_config->password, "password");
+    return ESP_OK;
+}
+
+uint8_t esp_mesh_lite_get_mesh_id(void)
+{
+    return CONFIG_MESH_ID;
+}
+
+uint32_t esp_mesh_lite_get_argot(void)
+{
+    return 0;
+}
+
+void esp_mesh_lite_set_mesh_id(uint8_t mesh_id, bool force_update_nvs)
+{
+    TEST_ASSERT(mesh_id == CONFIG_MESH_ID);
+}
+
+esp_err_t esp_mesh_lite_set_argot(uint32_t argot)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_set_softap_info(const char *softap_ssid, const char *softap_password)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_set_softap_ssid_to_nvs(char *softap_ssid)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_lite_set_softap_psw_to_nvs(char *softap_psw)
+{
+    return ESP_OK;
+}
+
+static int64_t frame_us(int len)
+{
+    return AIR_DIFS_US + AIR_CW_MIN * AIR_SLOT_US / 2 + AIR_PREAMBLE_US + (len + AIR_OVERHEAD_BYTES) * 8;
+}
+
+/* Puts a frame on the air, a unicast frame is tried until the receiver acks it. Returns the end of the last try. */
+static int64_t sim_air(int len, bool unicast, bool on_channel, bool *delivered)
+{
+    int64_t end = now_us > air_free_us ? now_us : air_free_us;
+    int tries = unicast ? SIM_MAC_TRIES : 1;
+
+    *delivered = false;
+    for (int i = 0; i < tries && !*delivered; i++)
+    {
+        end += frame_us(len) + (unicast ? AIR_ACK_US : 0);
+        *delivered = on_channel && heard();
+    }
+    air_free_us = end;
+    return end;
+}
+
+static sim_event_t *sim_event_add(int kind, int64_t at_us)
+{
+    for (int i = 0; i < SIM_EVENTS; i++)
+    {
+        if (!sim_events[i].used)
+        {
+            sim_events[i].used = true;
+            sim_events[i].kind = kind;
+            sim_events[i].at_us = at_us;
+            return &sim_events[i];
+        }
+    }
+    TEST_ASSERT(false);
+    static sim_event_t overflow;
+    return &overflow;
+}
+
+static int fleet_index(const uint8_t *mac)
+{
+    return mac[4] << 8 | mac[5];
+}
+
+/*
+ * Sends of the node under test. An idle node reaches the provisioner if it is on its channel, a
+ * provisioner reaches every node of the fleet.
+ */
+esp_err_t esp_mesh_lite_espnow_send(uint8_t type, uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    bool delivered;
+    bool unicast = !IS_BROADCAST_ADDR(peer_addr);
+
+    TEST_ASSERT(type == ESPNOW_DATA_TYPE_ZERO_PROV && len <= ESPNOW_PAYLOAD_MAX_LEN);
+    if (own_tx_inflight == SIM_TX_QUEUE)
+    {
+        own_no_mem++;
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    own_tx_inflight++;
+    own_frames++;
+    if (!unicast && broadcast_num < SIM_LOG)
+    {
+        broadcasts[broadcast_num++] = (sim_broadcast_t) {.at_us = now_us, .channel = own_channel};
+    }
+
+    bool on_channel = fleet_num ? unicast && fleet_index(peer_addr) < fleet_num : own_channel == prov_channel;
+    if (unicast && data[0] == ESPNOW_DATA_UNICAST_CONFIRM && drop_confirms > 0)
+    {
+        drop_confirms--;
+        on_channel = false;
+    }
+    int64_t end = sim_air(len, unicast, on_channel, &delivered);
+
+    sim_event_t *done = sim_event_add(EV_SEND_DONE, end);
+    memcpy(done->mac, peer_addr, ESP_NOW_ETH_ALEN);
+    done->status = !unicast || delivered ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL;
+    if (delivered)
+    {
+        sim_event_t *rx = sim_event_add(EV_PEER_RX, end);
+        rx->node = fleet_num ? fleet_index(peer_addr) : 0;
+        rx->len = len;
+        memcpy(rx->data, data, len);
+    }
+    return ESP_OK;
+}
+
+static void prov_send(uint8_t type)
+{
+    uint8_t buf[ESPNOW_PAYLOAD_MAX_LEN] = {0};
+    zero_prov_esp_now_data_t *frame = (zero_prov_esp_now_data_t *)buf;
+    bool delivered;
+
+    frame->type = type;
+    frame->len = sizeof(zero_prov_esp_now_data_t);
+    if (type == ESPNOW_DATA_UNICAST_INFO)
+    {
+        zero_prov_unicast_data_t *info = (zero_prov_unicast_data_t *)frame->payload;
+        strcpy((char *)info->router_ssid, "router");
+        strcpy((char *)info->router_password, "password");
+        strcpy((char *)info->softap_ssid, CONFIG_DEFAULT_SSID_PREFIX);
+        info->channel = prov_channel;
+        info->mesh_id = CONFIG_MESH_ID;
+        frame->len += sizeof(zero_prov_unicast_data_t);
+    }
+    else
+    {
+        frame->len += sizeof(struct tm);
+    }
+    frame->crc = esp_crc16_le(UINT16_MAX, buf, frame->len);
+
+    int64_t end = sim_air(frame->len, true, own_channel == prov_channel, &delivered);
+    if (delivered)
+    {
+        sim_event_t *rx = sim_event_add(EV_OWN_RX, end);
+        memcpy(rx->mac, prov_mac, ESP_NOW_ETH_ALEN);
+        rx->len = frame->len;
+        memcpy(rx->data, buf, frame->len);
+    }
+}
+
+/* The provisioner answers a broadcast with the credentials and resends them until the confirm, then acks every confirm */
+static void prov_receive(const sim_event_t *ev)
+{
+    int type = zero_prov_data_parse(ev->data, ev->len);
+    TEST_ASSERT(type == ESPNOW_DATA_BROADCAST || type == ESPNOW_DATA_UNICAST_CONFIRM);
+
+    if (type == ESPNOW_DATA_BROADCAST && !prov_busy)
+    {
+        prov_busy = true;
+        prov_info_tries = 0;
+        sim_event_add(EV_PEER_TX, now_us + SIM_PROCESS_US)->data[0] = ESPNOW_DATA_UNICAST_INFO;
+    }
+    else if (type == ESPNOW_DATA_UNICAST_CONFIRM)
+    {
+        prov_confirmed = true;
+        prov_confirms++;
+        sim_event_add(EV_PEER_TX, now_us + SIM_PROCESS_US)->data[0] = ESPNOW_DATA_UNICAST_ACK;
+    }
+}
+
+static void prov_transmit(const sim_event_t *ev)
+{
+    if (ev->data[0] == ESPNOW_DATA_UNICAST_ACK)
+    {
+        prov_send(ESPNOW_DATA_UNICAST_ACK);
+        return;
+    }
+    if (prov_confirmed)
+    {
+        return;
+    }
+    prov_send(ESPNOW_DATA_UNICAST_INFO);
+    if (++prov_info_tries < SIM_INFO_TRIES)
+    {
+        sim_event_add(EV_PEER_TX, now_us + SIM_INFO_RETRY_US)->data[0] = ESPNOW_DATA_UNICAST_INFO;
+    }
+    else
+    {
+        // Given up, the next broadcast that gets through starts over
+        prov_busy = false;
+    }
+}
+
+static void own_receive(const sim_event_t *ev)
+{
+    esp_now_recv_info_t info = {.src_addr = (uint8_t *)ev->mac, .des_addr = (uint8_t *)node_mac};
+
+    if (ev->data[0] == ESPNOW_DATA_UNICAST_INFO)
+    {
+        info_received++;
+    }
+    if (own_recv_cb)
+    {
+        own_recv_cb(&info, ev->data, ev->len);
+    }
+}
+
+static int fleet_frame(uint8_t type, uint8_t *buf)
+{
+    zero_prov_esp_now_data_t *frame = (zero_prov_esp_now_data_t *)buf;
+
+    memset(buf, 0, ESPNOW_PAYLOAD_MAX_LEN);
+    frame->type = type;
+    frame->len = sizeof(zero_prov_esp_now_data_t) + (type == ESPNOW_DATA_BROADCAST ? sizeof(zero_prov_idle_node_data_t) : 0);
+    frame->crc = esp_crc16_le(UINT16_MAX, buf, frame->len);
+    return frame->len;
+}
+
+/*
+ * An idle node of the fleet: broadcasts 100 ms after the previous one is out, confirms the
+ * credentials and repeats the confirm every 500 ms until the ack
+ */
+static void fleet_transmit(const sim_event_t *ev)
+{
+    fleet_node_t *node = &fleet[ev->node];
+    uint8_t type = ev->data[0];
+    uint8_t buf[ESPNOW_PAYLOAD_MAX_LEN];
+    bool delivered;
+
+    if (type == ESPNOW_DATA_BROADCAST ? node->state != FLEET_BROADCASTING
+            : node->state != FLEET_CONFIRMING || ev->gen != node->gen)
+    {
+        return;
+    }
+
+    int len = fleet_frame(type, buf);
+    int64_t end = sim_air(len, type != ESPNOW_DATA_BROADCAST, true, &delivered);
+    if (delivered)
+    {
+        sim_event_t *rx = sim_event_add(EV_OWN_RX, end);
+        memcpy(rx->mac, node->mac, ESP_NOW_ETH_ALEN);
+        rx->len = len;
+        memcpy(rx->data, buf, len);
+    }
+
+    int64_t next_us = type == ESPNOW_DATA_BROADCAST ? end + ZERO_PROV_BROADCAST_INTERVAL_MS * 1000 : now_us + FLEET_CONFIRM_RESEND_US;
+    sim_event_t *next = sim_event_add(EV_PEER_TX, next_us);
+    next->node = ev->node;
+    next->gen = node->gen;
+    next->data[0] = type;
+}
+
+static void fleet_receive(const sim_event_t *ev)
+{
+    fleet_node_t *node = &fleet[ev->node];
+    int type = zero_prov_data_parse(ev->data, ev->len);
+
+    TEST_ASSERT(type == ESPNOW_DATA_UNICAST_INFO || type == ESPNOW_DATA_UNICAST_ACK);
+    if (node->state == FLEET_DONE)
+    {
+        return;
+    }
+    if (type == ESPNOW_DATA_UNICAST_INFO)
+    {
+        node->infos++;
+        node->state = FLEET_CONFIRMING;
+        sim_event_t *confirm = sim_event_add(EV_PEER_TX, now_us + FLEET_PROCESS_US);
+        confirm->node = ev->node;
+        confirm->gen = ++node->gen;
+        confirm->data[0] = ESPNOW_DATA_UNICAST_CONFIRM;
+    }
+    else if (node->state == FLEET_CONFIRMING)
+    {
+        node->state = FLEET_DONE;
+        node->done_us = now_us;
+        fleet_all_done = ++fleet_done == fleet_num;
+    }
+}
+
+/* The replaced sweep, zero_prov_broadcast_cb before the channel hints */
+static void legacy_broadcast_cb(void *arg)
+{
+    wifi_country_t country;
+    memset(&country, 0x0, sizeof(country));
+    esp_wifi_get_country(&country);
+
+    if (legacy_channel_num == 0)
+    {
+        legacy_channel_num = country.schan;
+    }
+
+    if (legacy_broadcast_count >= ZERO_PROV_PER_CHANNEL_BROADCAST_COUNT)
+    {
+        legacy_broadcast_count = 0;
+        legacy_channel_num = legacy_channel_num == country.nchan ? country.schan : legacy_channel_num + 1;
+        zero_prov_sweep_set_channel(legacy_channel_num);
+    }
+    legacy_broadcast_count++;
+
+    esp_timer_start_once(g_timer_handle, LEGACY_INTERVAL_MS * 1000);
+}
+
+/* The replaced provisioner: the credentials go straight back to every broadcast it hears */
+static void legacy_recieve_handle(void *arg)
+{
+    zero_prov_event_t *evt = (zero_prov_event_t *)arg;
+    espnow_recv_cb_t *recv_cb = &evt->info.recv_cb;
+    uint8_t channel;
+    wifi_second_chan_t second;
+
+    if (recv_cb->type != ESPNOW_DATA_BROADCAST)
+    {
+        zero_prov_recieve_handle(arg);
+        return;
+    }
+    esp_wifi_get_channel(&channel, &second);
+    zero_prov_check_peer_is_exist(recv_cb->mac_addr);
+    zero_prov_esp_now_data_t *pbuf = zero_prov_info_frame_create(channel);
+    esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_ZERO_PROV, recv_cb->mac_addr, (const uint8_t *)pbuf, pbuf->len);
+    free(pbuf);
+    free(recv_cb->data);
+}
+
+/* What zero_prov_task does with its queue */
+static void sim_drain(void)
+{
+    zero_prov_event_t evt;
+    while (xQueueReceive(s_zero_prov_queue, &evt, 0) == pdTRUE)
+    {
+        zero_prov_event_handle(&node_act, evt.id, &evt);
+    }
+}
+
+static void sim_run_until(int64_t until_us, const bool *stop)
+{
+    while (!(stop && *stop))
+    {
+        int64_t next_us = until_us + 1;
+        sim_event_t *ev = NULL;
+        sim_timer_t *timer = NULL;
+        struct esp_timer *esp_timer = NULL;
+
+        for (int i = 0; i < SIM_EVENTS; i++)
+        {
+            if (sim_events[i].used && sim_events[i].at_us < next_us)
+            {
+                next_us = sim_events[i].at_us;
+                ev = &sim_events[i];
+            }
+        }
+        for (int i = 0; i < SIM_TIMERS; i++)
+        {
+            if (sim_timers[i].active && sim_timers[i].expiry_us < next_us)
+            {
+                next_us = sim_timers[i].expiry_us;
+                timer = &sim_timers[i];
+                ev = NULL;
+            }
+        }
+        for (int i = 0; i < SIM_TIMERS; i++)
+        {
+            if (sim_esp_timers[i].active && sim_esp_timers[i].expiry_us < next_us)
+            {
+                next_us = sim_esp_timers[i].expiry_us;
+                esp_timer = &sim_esp_timers[i];
+                ev = NULL;
+                timer = NULL;
+            }
+        }
+        if (next_us > until_us)
+        {
+            break;
+        }
+        now_us = next_us;
+
+        if (esp_timer)
+        {
+            esp_timer->active = false;
+            esp_timer->cb(esp_timer->arg);
+        }
+        else if (timer)
+        {
+            timer->active = timer->reload;
+            timer->expiry_us += timer->period_us;
+            timer->cb(timer);
+        }
+        else
+        {
+            sim_event_t event = *ev;
+            ev->used = false;
+            switch (event.kind)
+            {
+            case EV_SEND_DONE:
+                own_tx_inflight--;
+                if (own_send_cb)
+                {
+                    own_send_cb(event.mac, event.status);
+                }
+                break;
+            case EV_PEER_RX:
+                fleet_num ? fleet_receive(&event) : prov_receive(&event);
+                break;
+            case EV_PEER_TX:
+                fleet_num ? fleet_transmit(&event) : prov_transmit(&event);
+                break;
+            case EV_OWN_RX:
+                own_receive(&event);
+                break;
+            }
+        }
+        if (s_zero_prov_queue)
+        {
+            sim_drain();
+        }
+    }
+    if (!(stop && *stop))
+    {
+        now_us = until_us;
+    }
+}
+
+/* A device boots with what its scan saw and starts broadcasting, as on WIFI_PROV_START */
+static void device_start(const wifi_ap_record_t *scan, int scan_num, bool legacy)
+{
+    // The replaced sweep started on channel 1 whatever the scan saw
+    memset(channel_hints, 0, sizeof(channel_hints));
+    if (!legacy)
+    {
+        esp_mesh_lite_scan_ap_records_observe(scan, scan_num);
+    }
+
+    zero_prov_table[0].eventfun = legacy ? legacy_broadcast_cb : zero_prov_broadcast_cb;
+    legacy_broadcast_count = 0;
+    legacy_channel_num = 0;
+    own_channel = 1;
+    broadcast_num = 0;
+    info_received = 0;
+    connected = false;
+    prov_busy = false;
+    prov_confirmed = false;
+    prov_confirms = 0;
+    air_free_us = now_us;
+
+    TEST_ASSERT(zero_prov_init(NULL, NULL) == ESP_OK);
+    zero_prov_regist(&node_act, zero_prov_table);
+    TEST_ASSERT(zero_prov_br_start() == ESP_OK);
+}
+
+static void device_stop(void)
+{
+    zero_prov_br_stop();
+    zero_prov_deinit();
+    if (resend_timer)
+    {
+        xTimerDelete(resend_timer, 0);
+        resend_timer = NULL;
+    }
+    free(idle_br_data);
+    idle_br_data = NULL;
+    zero_prov_done = false;
+    is_use_zero_prov = false;
+    memset(sim_events, 0, sizeof(sim_events));
+    own_tx_inflight = 0;
+    for (int i = 0; i < SIM_TIMERS; i++)
+    {
+        TEST_ASSERT(!sim_timers[i].used && !sim_esp_timers[i].used);
+    }
+}
+
+/* Runs a device until it is provisioned, returns the time it took or -1 */
+static int64_t device_provision(const wifi_ap_record_t *scan, int scan_num, bool legacy)
+{
+    int64_t start_us = now_us;
+    device_start(scan, scan_num, legacy);
+    sim_run_until(start_us + SIM_TIMEOUT_US, &zero_prov_done);
+    int64_t took_us = zero_prov_done ? now_us - start_us : -1;
+    device_stop();
+    return took_us;
+}
+
+static wifi_ap_record_t ap_record(const char *ssid, uint8_t channel, int8_t rssi)
+{
+    wifi_ap_record_t record = {.primary = channel, .rssi = rssi};
+    strcpy((char *)record.ssid, ssid);
+    return record;
+}
+
+static void test_sweep_order(void)
+{
+    wifi_ap_record_t scan[] = {
+        ap_record(CONFIG_DEFAULT_SSID_PREFIX "_a1b2c3", 11, -70),
+        ap_record("office", 1, -40),
+        ap_record(CONFIG_DEFAULT_SSID_PREFIX "_d4e5f6", 6, -60),
+        ap_record("guest", 3, -80),
+        ap_record("office", 11, -30),
+    };
+    const uint8_t order[] = {6, 11, 1, 3, 2, 4, 5, 7, 8, 9, 10, 12, 13};
+    zero_prov_sweep_t sweep = {0};
+
+    memset(channel_hints, 0, sizeof(channel_hints));
+    esp_mesh_lite_scan_ap_records_observe(scan, sizeof(scan) / sizeof(scan[0]));
+    zero_prov_sweep_plan(&sweep);
+    TEST_ASSERT(sweep.num == 13 && !memcmp(sweep.order, order, sizeof(order)));
+    TEST_ASSERT(sweep.level[0] == ZERO_PROV_CHANNEL_HAS_MESH && sweep.level[1] == ZERO_PROV_CHANNEL_HAS_MESH);
+    TEST_ASSERT(sweep.level[2] == ZERO_PROV_CHANNEL_HAS_AP && sweep.level[4] == ZERO_PROV_CHANNEL_UNKNOWN);
+
+    // Hints older than ten minutes are dropped, the sweep is back in channel order
+    now_us += ZERO_PROV_CHANNEL_HINT_TTL_US + 1;
+    zero_prov_sweep_plan(&sweep);
+    for (int i = 0; i < sweep.num; i++)
+    {
+        TEST_ASSERT(sweep.order[i] == i + 1 && sweep.level[i] == ZERO_PROV_CHANNEL_UNKNOWN);
+    }
+}
+
+static void test_dwell(void)
+{
+    wifi_ap_record_t scan[] = {
+        ap_record(CONFIG_DEFAULT_SSID_PREFIX "_a1b2c3", 6, -60),
+        ap_record("office", 1, -40),
+    };
+    const uint8_t order[] = {6, 1, 2, 3, 4, 5, 7, 8, 9, 10, 11, 12, 13};
+    const int dwell[] = {4, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+    // No provisioner in range: the dwell doubles each round and stops at 8x, 17 * 15 broadcasts take four rounds
+    prov_channel = 0;
+    loss = 0;
+    int64_t start_us = now_us;
+    device_start(scan, 2, false);
+    sim_run_until(start_us + 30 * 1000000LL, NULL);
+
+    int n = 0;
+    for (int round = 0; round < 5; round++)
+    {
+        int shift = round < ZERO_PROV_MAX_DWELL_SHIFT ? round : ZERO_PROV_MAX_DWELL_SHIFT;
+        for (int i = 0; i < 13; i++)
+        {
+            for (int j = 0; j < dwell[i] << shift && n < broadcast_num; j++, n++)
+            {
+                TEST_ASSERT(broadcasts[n].channel == order[i]);
+            }
+        }
+    }
+    TEST_ASSERT(n == broadcast_num && broadcast_num > 17 * 15);
+    // The timer restarts from the send callback once the frame is out, a hop adds a millisecond
+    for (int i = 1; i < broadcast_num; i++)
+    {
+        int64_t gap_us = broadcasts[i].at_us - broadcasts[i - 1].at_us;
+        TEST_ASSERT(gap_us > ZERO_PROV_BROADCAST_INTERVAL_MS * 1000 && gap_us < ZERO_PROV_BROADCAST_INTERVAL_MS * 1000 + 3000);
+    }
+    device_stop();
+}
+
+static void test_stop_on_info(void)
+{
+    wifi_ap_record_t scan[] = {
+        ap_record("office", 1, -40),
+        ap_record("office", 11, -50),
+    };
+
+    // The provisioner is on the second channel tried, the device stays there once it has the credentials
+    prov_channel = 11;
+    loss = 0;
+    int64_t start_us = now_us;
+    device_start(scan, 2, false);
+    sim_run_until(start_us + 5 * 1000000LL, &zero_prov_done);
+    TEST_ASSERT(zero_prov_done && connected && info_received == 1 && prov_confirms == 1);
+    TEST_ASSERT(broadcast_num == 3 && broadcasts[2].channel == 11 && own_channel == 11);
+    TEST_ASSERT(g_timer_handle == NULL && resend_timer == NULL);
+    TEST_ASSERT(now_us - start_us < 400000);
+
+    // The provisioner's channel is now the best hint
+    TEST_ASSERT(channel_hints[11].level == ZERO_PROV_CHANNEL_HAS_MESH);
+    int before = broadcast_num;
+    sim_run_until(now_us + 2 * 1000000LL, NULL);
+    TEST_ASSERT(broadcast_num == before && own_channel == 11);
+    device_stop();
+}
+
+static void test_answer_last_broadcast(void)
+{
+    // Nothing in the scan, one broadcast per channel: the answer to the one on channel 3 is not missed by a hop
+    prov_channel = 3;
+    loss = 0;
+    int64_t start_us = now_us;
+    device_start(NULL, 0, false);
+    sim_run_until(start_us + 5 * 1000000LL, &zero_prov_done);
+    TEST_ASSERT(zero_prov_done && info_received == 1 && broadcast_num == 3);
+    TEST_ASSERT(broadcasts[0].channel == 1 && broadcasts[2].channel == 3 && own_channel == 3);
+    device_stop();
+}
+
+static void test_confirm_resend(void)
+{
+    wifi_ap_record_t scan[] = {ap_record(CONFIG_DEFAULT_SSID_PREFIX "_a1b2c3", 6, -60)};
+
+    // The confirms answering the credentials are all lost, the resend timer repeats it 500 ms after the last
+    prov_channel = 6;
+    loss = 0;
+    drop_confirms = SIM_INFO_TRIES;
+    int64_t start_us = now_us;
+    device_start(scan, 1, false);
+    sim_run_until(start_us + 5 * 1000000LL, &zero_prov_done);
+    TEST_ASSERT(zero_prov_done && connected && prov_confirms == 1 && drop_confirms == 0);
+    TEST_ASSERT(broadcast_num == 1 && info_received == SIM_INFO_TRIES && own_channel == 6);
+    int64_t last_info_us = start_us + 100000 + (SIM_INFO_TRIES - 1) * SIM_INFO_RETRY_US + SIM_PROCESS_US;
+    TEST_ASSERT(now_us > last_info_us + 500000 && now_us < last_info_us + 500000 + SIM_PROCESS_US + 10000);
+    device_stop();
+}
+
+static void test_pending_full(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    memcpy(mac, node_mac, ESP_NOW_ETH_ALEN);
+    for (int i = 0; i < CONFIG_ZERO_PROV_MAX_PENDING_NODES; i++)
+    {
+        mac[5] = i;
+        zero_prov_pending_add(mac, FLEET_CHANNEL);
+        zero_prov_pending_find(mac)->state = ZERO_PROV_NODE_INFO_SENT;
+    }
+
+    // Every entry is in a handshake: the new node waits for its next broadcast
+    mac[5] = 0xf0;
+    zero_prov_pending_add(mac, FLEET_CHANNEL);
+    TEST_ASSERT(!zero_prov_pending_find(mac));
+
+    // Done entries linger, the oldest one makes room
+    for (int i = 0; i < 3; i++)
+    {
+        mac[5] = 10 + i;
+        zero_prov_pending_done(mac);
+        now_us += 1000;
+    }
+    mac[5] = 0xf0;
+    zero_prov_pending_add(mac, FLEET_CHANNEL);
+    TEST_ASSERT(zero_prov_pending_find(mac) && zero_prov_pending_find(mac)->state == ZERO_PROV_NODE_WAITING);
+    mac[5] = 10;
+    TEST_ASSERT(!zero_prov_pending_find(mac));
+    mac[5] = 11;
+    TEST_ASSERT(zero_prov_pending_find(mac) && zero_prov_pending_find(mac)->state == ZERO_PROV_NODE_DONE);
+
+    zero_prov_pending_deinit();
+    TEST_ASSERT(!pending_nodes && !pending_timer);
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Boot scan of a device of a site whose mesh and router are on the channel: what it saw, with neighbours on 1/6/11 */
+static int fleet_scan(wifi_ap_record_t *scan, uint8_t channel)
+{
+    static const uint8_t common[] = {1, 6, 11};
+    int num = 0;
+
+    if (rng_unit() < SIM_SEES_MESH)
+    {
+        scan[num++] = ap_record(CONFIG_DEFAULT_SSID_PREFIX "_a1b2c3", channel, -55 - rng() % 30);
+    }
+    if (rng_unit() < SIM_SEES_ROUTER)
+    {
+        scan[num++] = ap_record("router", channel, -45 - rng() % 40);
+    }
+    for (int i = rng() % 4; i > 0; i--)
+    {
+        scan[num++] = ap_record("neighbour", common[rng() % 3], -40 - rng() % 50);
+    }
+    return num;
+}
+
+static void fleet_stats(const char *name, uint8_t channel, int64_t *took_us, double *median_ms, double *p99_ms)
+{
+    int failed = 0;
+    double sum_ms = 0;
+
+    qsort(took_us, SIM_DEVICES, sizeof(took_us[0]), compare_us);
+    for (int i = 0; i < SIM_DEVICES; i++)
+    {
+        failed += took_us[i] < 0;
+        sum_ms += took_us[i] / 1000.0;
+    }
+    TEST_ASSERT(failed == 0);
+    *median_ms = (took_us[SIM_DEVICES / 2 - 1] + took_us[SIM_DEVICES / 2]) / 2000.0;
+    *p99_ms = took_us[(SIM_DEVICES * 99 + 99) / 100 - 1] / 1000.0;
+    printf("BENCH %s sweep, provisioner on channel %2u, %d devices, %.0f%% loss: median %.0f ms, p99 %.0f ms, mean %.0f ms\n",
+           name, channel, SIM_DEVICES, SIM_LOSS * 100, *median_ms, *p99_ms, sum_ms / SIM_DEVICES);
+}
+
+static void bench_fleet(void)
+{
+    static const uint8_t channels[] = {1, 6, 11};
+    static wifi_ap_record_t scans[SIM_DEVICES][8];
+    static int scan_num[SIM_DEVICES];
+    int64_t took_us[SIM_DEVICES];
+    double median_ms, p99_ms, legacy_median_ms, legacy_p99_ms;
+
+    loss = SIM_LOSS;
+    for (int c = 0; c < sizeof(channels); c++)
+    {
+        prov_channel = channels[c];
+        for (int i = 0; i < SIM_DEVICES; i++)
+        {
+            scan_num[i] = fleet_scan(scans[i], prov_channel);
+        }
+
+        for (int i = 0; i < SIM_DEVICES; i++)
+        {
+            took_us[i] = device_provision(scans[i], scan_num[i], true);
+        }
+        fleet_stats("round-robin", prov_channel, took_us, &legacy_median_ms, &legacy_p99_ms);
+
+        for (int i = 0; i < SIM_DEVICES; i++)
+        {
+            took_us[i] = device_provision(scans[i], scan_num[i], false);
+        }
+        fleet_stats("hinted     ", prov_channel, took_us, &median_ms, &p99_ms);
+
+        // Channel 1 is where the round-robin sweep starts, its best case
+        TEST_ASSERT(prov_channel == 1 || (median_ms < legacy_median_ms && p99_ms < legacy_p99_ms));
+    }
+}
+
+/*
+ * A provisioned node listens on FLEET_CHANNEL while FLEET_NODES idle nodes broadcast to it. Returns
+ * the time from the first boot to the last ack, or -1.
+ */
+static int64_t bulk_provision(bool legacy, int64_t boot_us, uint32_t *no_mem)
+{
+    static int64_t took_us[FLEET_NODES];
+    int64_t first_us = INT64_MAX;
+    double median_ms, p99_ms;
+    int infos = 0;
+
+    provisioned = true;
+    own_channel = FLEET_CHANNEL;
+    own_frames = 0;
+    own_no_mem = 0;
+    loss = SIM_LOSS;
+    air_free_us = now_us;
+    fleet_num = FLEET_NODES;
+    fleet_done = 0;
+    fleet_all_done = false;
+    for (int i = 0; i < FLEET_NODES; i++)
+    {
+        fleet_node_t *node = &fleet[i];
+        memset(node, 0, sizeof(*node));
+        memcpy(node->mac, node_mac, ESP_NOW_ETH_ALEN);
+        node->mac[3] = 0x10;
+        node->mac[4] = i >> 8;
+        node->mac[5] = i & 0xff;
+        node->boot_us = now_us + rng() % boot_us;
+        first_us = node->boot_us < first_us ? node->boot_us : first_us;
+        sim_event_t *boot = sim_event_add(EV_PEER_TX, node->boot_us);
+        boot->node = i;
+        boot->data[0] = ESPNOW_DATA_BROADCAST;
+    }
+
+    zero_prov_table[1].eventfun = legacy ? legacy_recieve_handle : zero_prov_recieve_handle;
+    TEST_ASSERT(zero_prov_init(NULL, NULL) == ESP_OK);
+    zero_prov_regist(&node_act, zero_prov_table);
+    zero_prov_listening(ZERO_PROV_LISTENING_TIMEOUT);
+    sim_run_until(now_us + FLEET_TIMEOUT_US, &fleet_all_done);
+
+    int64_t last_us = 0;
+    for (int i = 0; i < FLEET_NODES; i++)
+    {
+        took_us[i] = fleet[i].state == FLEET_DONE ? fleet[i].done_us - fleet[i].boot_us : INT64_MAX;
+        last_us = fleet[i].done_us > last_us ? fleet[i].done_us : last_us;
+        infos += fleet[i].infos;
+    }
+    qsort(took_us, FLEET_NODES, sizeof(took_us[0]), compare_us);
+    median_ms = (took_us[FLEET_NODES / 2 - 1] + took_us[FLEET_NODES / 2]) / 2000.0;
+    p99_ms = took_us[(FLEET_NODES * 99 + 99) / 100 - 1] / 1000.0;
+    printf("BENCH %s provisioner, %3d handshakes at once, %d nodes booting within %4.0f ms, %.0f%% loss: %d done in %4.1f s, "
+           "median %5.0f ms, p99 %5.0f ms, %.1f frames sent and %.1f credentials received per node, %4u ESP_ERR_ESPNOW_NO_MEM\n",
+           legacy ? "stateless" : "pending  ", legacy ? FLEET_NODES : CONFIG_ZERO_PROV_MAX_CONCURRENT_HANDSHAKES, FLEET_NODES,
+           boot_us / 1e3, SIM_LOSS * 100, fleet_done, (last_us - first_us) / 1e6, median_ms, p99_ms,
+           (double)own_frames / FLEET_NODES, (double)infos / FLEET_NODES, (unsigned)own_no_mem);
+    int64_t makespan_us = fleet_all_done ? last_us - first_us : -1;
+    *no_mem = own_no_mem;
+
+    zero_prov_listening_stop();
+    free(idle_br_data);
+    idle_br_data = NULL;
+    zero_prov_table[1].eventfun = zero_prov_recieve_handle;
+    memset(sim_events, 0, sizeof(sim_events));
+    own_tx_inflight = 0;
+    fleet_num = 0;
+    provisioned = false;
+    for (int i = 0; i < SIM_TIMERS; i++)
+    {
+        TEST_ASSERT(!sim_timers[i].used && !sim_esp_timers[i].used);
+    }
+    return makespan_us;
+}
+
+static void bench_bulk(void)
+{
+    uint32_t no_mem, legacy_no_mem;
+
+    // Unpacked a few at a time the air stays free, the table must not slow the site down
+    int64_t legacy_us = bulk_provision(true, FLEET_BOOT_US, &legacy_no_mem);
+    int64_t took_us = bulk_provision(false, FLEET_BOOT_US, &no_mem);
+    TEST_ASSERT(legacy_us > 0 && took_us > 0 && took_us < legacy_us + 500000);
+
+    // Powered up at once the broadcasts fill the air, the limit keeps the send buffers from overflowing
+    legacy_us = bulk_provision(true, FLEET_BURST_US, &legacy_no_mem);
+    took_us = bulk_provision(false, FLEET_BURST_US, &no_mem);
+    TEST_ASSERT(legacy_us > 0 && took_us > 0 && no_mem < legacy_no_mem);
+}
+
+int main(void)
+{
+    RUN_TEST(test_sweep_order);
+    RUN_TEST(test_dwell);
+    RUN_TEST(test_stop_on_info);
+    RUN_TEST(test_answer_last_broadcast);
+    RUN_TEST(test_confirm_resend);
+    RUN_TEST(test_pending_full);
+    RUN_TEST(bench_fleet);
+    RUN_TEST(bench_bulk);
+    return host_test_result();
+}
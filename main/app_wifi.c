@@ -4,6 +4,8 @@
 #include "esp_bridge.h"
 #include "esp_mesh_lite.h"
 #include "app_wifi.h"
+#include "metrics.h"
+#include "startup.h"
 
 #include "esp_netif.h"
 #include "esp_netif_net_stack.h"
@@ -21,6 +23,9 @@ bool sta_got_ip = false;
 
 #if CONFIG_ENABLE_ARP_SCAN
 static arp_scan_result_list_t *arp_scan_result_list = NULL;
+static metrics_counter_t arp_scans;
+static metrics_counter_t arp_requests;
+static metrics_gauge_t arp_hosts;
 
 void arp_scan_result_list_init()
 {
@@ -102,8 +107,8 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
         s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
         sta_got_ip = true;
+        startup_signal(STARTUP_STAGE_WIFI_STA);
     }
 }
 #endif
@@ -176,7 +181,10 @@ void arp_scan()
         // Send ARP request
         err_t res = etharp_request(lwip_netif, &target);
         if (res == ERR_OK)
+        {
+            metrics_counter_inc(&arp_requests);
             ESP_LOGD(TAG, "ARP request sent for %s", ip_str);
+        }
 
         vTaskDelay(pdMS_TO_TICKS(200));
 
@@ -201,6 +209,8 @@ void arp_scan()
     }
 
     ESP_LOGI(TAG, "ARP scan finished");
+    metrics_counter_inc(&arp_scans);
+    metrics_gauge_set(&arp_hosts, arp_scan_result_list ? arp_scan_result_list->count : 0);
     print_arp_scan_result_list();
     arp_scan_result_list_free();
     arp_scan_result_list_init();
@@ -248,6 +258,9 @@ void wifi_task_main(void *pvParameter)
 {
 #if CONFIG_ENABLE_ARP_SCAN
     arp_scan_result_list_init();
+    metrics_counter_register(&arp_scans, "arp_scans", "Completed ARP scans of the station subnet");
+    metrics_counter_register(&arp_requests, "arp_requests", "ARP requests sent");
+    metrics_gauge_register(&arp_hosts, "arp_hosts", "Hosts found by the last ARP scan", NULL, NULL);
 #endif
     ESP_LOGI(TAG, "Start wifi_task");
     wifi_init();
@@ -288,9 +301,6 @@ void wifi_init_ap(void)
 #if CONFIG_ENABLE_WIFI_STA
 void wifi_init_sta(void)
 {
-
-    s_wifi_event_group = xEventGroupCreate();
-
     esp_event_handler_instance_t instance_any_id;
     esp_event_handler_instance_t instance_got_ip;
 
@@ -305,7 +315,7 @@ void wifi_init_sta(void)
                                                         &wifi_event_handler,
                                                         NULL,
                                                         &instance_got_ip));
-    // Station
+    // Station, the connection is reported by IP_EVENT_STA_GOT_IP
     wifi_config_t wifi_config = {
         .sta = {
             .ssid = CONFIG_ESP_WIFI_SSID,
@@ -313,27 +323,6 @@ void wifi_init_sta(void)
         },
     };
     esp_bridge_wifi_set_config(WIFI_IF_STA, &wifi_config);
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    if (bits & WIFI_CONNECTED_BIT)
-    {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 softap_ssid, softap_psw);
-    }
-    else if (bits & WIFI_FAIL_BIT)
-    {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASSWORD);
-    }
-    else
-    {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-        return;
-    }
 }
 #endif
 
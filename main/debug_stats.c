@@ -0,0 +1,264 @@
+#include "debug_stats.h"
+
+#if CONFIG_APP_DEBUG_STATS_ENABLE
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
+#if CONFIG_APP_DEBUG_HEAP_SAMPLING && CONFIG_IDF_TARGET_ARCH_XTENSA
+#include "esp_debug_helpers.h"
+#endif
+#include "metrics.h"
+
+static const char *TAG = "debug_stats";
+
+typedef struct
+{
+    TaskHandle_t handle;
+    configRUN_TIME_COUNTER_TYPE runtime;
+} debug_task_runtime_t;
+
+typedef struct
+{
+    configRUN_TIME_COUNTER_TYPE total;
+    size_t num;
+    debug_task_runtime_t tasks[CONFIG_APP_DEBUG_STATS_MAX_TASKS];
+} debug_snapshot_t;
+
+/* One more than the window, the oldest one is the start of the window */
+static debug_snapshot_t debug_snapshots[CONFIG_APP_DEBUG_STATS_WINDOW + 1];
+static size_t debug_snapshot_head = 0;
+static size_t debug_snapshot_num = 0;
+
+/* Latest status of every task, kept static as it does not fit on the timer task stack */
+static TaskStatus_t debug_task_status[CONFIG_APP_DEBUG_STATS_MAX_TASKS];
+static size_t debug_task_status_num = 0;
+static uint32_t debug_task_num = 0;
+
+static SemaphoreHandle_t debug_stats_mutex = NULL;
+static metrics_gauge_t debug_collect_us;
+static uint32_t debug_collect_max_us = 0;
+
+static void debug_stats_timer_cb(TimerHandle_t timer)
+{
+    if (xSemaphoreTake(debug_stats_mutex, 0) != pdTRUE)
+    {
+        // Being read, skip this sample rather than block the timer task
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    debug_snapshot_t *snapshot = &debug_snapshots[debug_snapshot_head];
+    UBaseType_t num = uxTaskGetSystemState(debug_task_status, CONFIG_APP_DEBUG_STATS_MAX_TASKS, &snapshot->total);
+
+    debug_task_num = uxTaskGetNumberOfTasks();
+    if (num == 0)
+    {
+        // uxTaskGetSystemState() returns nothing at all when the array is too small
+        ESP_LOGW(TAG, "%" PRIu32 " tasks, increase CONFIG_APP_DEBUG_STATS_MAX_TASKS", debug_task_num);
+        xSemaphoreGive(debug_stats_mutex);
+        return;
+    }
+
+    snapshot->num = num;
+    for (UBaseType_t i = 0; i < num; i++)
+    {
+        snapshot->tasks[i].handle = debug_task_status[i].xHandle;
+        snapshot->tasks[i].runtime = debug_task_status[i].ulRunTimeCounter;
+    }
+    debug_task_status_num = num;
+    debug_snapshot_head = (debug_snapshot_head + 1) % (CONFIG_APP_DEBUG_STATS_WINDOW + 1);
+    debug_snapshot_num = MIN(debug_snapshot_num + 1, CONFIG_APP_DEBUG_STATS_WINDOW + 1);
+
+    uint32_t collect_us = esp_timer_get_time() - start;
+    debug_collect_max_us = MAX(debug_collect_max_us, collect_us);
+    metrics_gauge_set(&debug_collect_us, collect_us);
+    xSemaphoreGive(debug_stats_mutex);
+}
+
+static int debug_task_cmp(const void *a, const void *b)
+{
+    float cpu_a = ((const debug_task_stats_t *)a)->cpu;
+    float cpu_b = ((const debug_task_stats_t *)b)->cpu;
+    return (cpu_a < cpu_b) - (cpu_a > cpu_b);
+}
+
+size_t debug_stats_get_tasks(debug_task_stats_t *tasks, size_t max, debug_stats_info_t *info)
+{
+    size_t num = 0;
+
+    memset(info, 0x0, sizeof(debug_stats_info_t));
+    if (!debug_stats_mutex)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(debug_stats_mutex, portMAX_DELAY);
+    const debug_snapshot_t *newest = &debug_snapshots[(debug_snapshot_head + CONFIG_APP_DEBUG_STATS_WINDOW) % (CONFIG_APP_DEBUG_STATS_WINDOW + 1)];
+    const debug_snapshot_t *oldest = &debug_snapshots[debug_snapshot_num > CONFIG_APP_DEBUG_STATS_WINDOW ? debug_snapshot_head : 0];
+    configRUN_TIME_COUNTER_TYPE total = newest->total - oldest->total;
+
+    info->window_ms = (debug_snapshot_num ? debug_snapshot_num - 1 : 0) * CONFIG_APP_DEBUG_STATS_PERIOD_MS;
+    info->collect_us = atomic_load_explicit(&debug_collect_us.value, memory_order_relaxed);
+    info->collect_max_us = debug_collect_max_us;
+    info->task_num = debug_task_num;
+
+    for (size_t i = 0; i < debug_task_status_num && num < max; i++)
+    {
+        const TaskStatus_t *status = &debug_task_status[i];
+        debug_task_stats_t *task = &tasks[num++];
+
+        strlcpy(task->name, status->pcTaskName, sizeof(task->name));
+        task->state = status->eCurrentState;
+        task->priority = status->uxCurrentPriority;
+#if configTASKLIST_INCLUDE_COREID
+        task->core = status->xCoreID == tskNO_AFFINITY ? -1 : status->xCoreID;
+#else
+        task->core = -1;
+#endif
+        task->stack_free_min = status->usStackHighWaterMark * sizeof(StackType_t);
+
+        // Tasks created during the window count from 0
+        configRUN_TIME_COUNTER_TYPE start = 0;
+        for (size_t j = 0; j < oldest->num; j++)
+        {
+            if (oldest->tasks[j].handle == status->xHandle)
+            {
+                start = oldest->tasks[j].runtime;
+                break;
+            }
+        }
+        task->cpu = total ? 100.0f * (status->ulRunTimeCounter - start) / total : 0;
+    }
+    xSemaphoreGive(debug_stats_mutex);
+
+    qsort(tasks, num, sizeof(debug_task_stats_t), debug_task_cmp);
+    return num;
+}
+
+#if CONFIG_APP_DEBUG_HEAP_SAMPLING
+static debug_heap_hotspot_t heap_hotspots[CONFIG_APP_DEBUG_HEAP_HOTSPOTS];
+static portMUX_TYPE heap_hotspot_lock = portMUX_INITIALIZER_UNLOCKED;
+static _Atomic uint32_t heap_allocs = 0;
+static uint32_t heap_sampled = 0;
+static uint64_t heap_sample_cycles = 0;
+
+/* Called by the heap for every successful allocation when CONFIG_HEAP_USE_HOOKS is set */
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (atomic_fetch_add_explicit(&heap_allocs, 1, memory_order_relaxed) % CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE)
+    {
+        return;
+    }
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    uint32_t pc[DEBUG_STATS_HEAP_DEPTH] = {0};
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+    esp_backtrace_frame_t frame;
+    esp_backtrace_get_start(&frame.pc, &frame.sp, &frame.next_pc);
+    // The first frame is this hook
+    for (int i = 0; i < DEBUG_STATS_HEAP_DEPTH && esp_backtrace_get_next_frame(&frame); i++)
+    {
+        pc[i] = esp_cpu_process_stack_pc(frame.pc);
+    }
+#endif
+
+    // Allocations before the scheduler starts have no task
+    const char *task = xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED ? "boot" : pcTaskGetName(NULL);
+
+    portENTER_CRITICAL_SAFE(&heap_hotspot_lock);
+    debug_heap_hotspot_t *hotspot = NULL;
+    debug_heap_hotspot_t *min = &heap_hotspots[0];
+    for (int i = 0; i < CONFIG_APP_DEBUG_HEAP_HOTSPOTS; i++)
+    {
+        if (!memcmp(heap_hotspots[i].pc, pc, sizeof(pc)) && !strncmp(heap_hotspots[i].task, task, configMAX_TASK_NAME_LEN))
+        {
+            hotspot = &heap_hotspots[i];
+            break;
+        }
+        if (heap_hotspots[i].bytes < min->bytes)
+        {
+            min = &heap_hotspots[i];
+        }
+    }
+    if (!hotspot)
+    {
+        // Space-saving: the new site inherits the counts of the lightest one, so heavy sites are never missed
+        hotspot = min;
+        memcpy(hotspot->pc, pc, sizeof(pc));
+        strlcpy(hotspot->task, task, sizeof(hotspot->task));
+    }
+    hotspot->count++;
+    hotspot->bytes += size;
+    heap_sampled++;
+    heap_sample_cycles += esp_cpu_get_cycle_count() - start;
+    portEXIT_CRITICAL_SAFE(&heap_hotspot_lock);
+}
+
+static int debug_hotspot_cmp(const void *a, const void *b)
+{
+    uint32_t bytes_a = ((const debug_heap_hotspot_t *)a)->bytes;
+    uint32_t bytes_b = ((const debug_heap_hotspot_t *)b)->bytes;
+    return (bytes_a < bytes_b) - (bytes_a > bytes_b);
+}
+#endif
+
+size_t debug_stats_get_heap_hotspots(debug_heap_hotspot_t *hotspots, size_t max, debug_heap_sampling_info_t *info)
+{
+    memset(info, 0x0, sizeof(debug_heap_sampling_info_t));
+#if CONFIG_APP_DEBUG_HEAP_SAMPLING
+    size_t num = 0;
+
+    info->rate = CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE;
+    info->allocs = atomic_load_explicit(&heap_allocs, memory_order_relaxed);
+    portENTER_CRITICAL(&heap_hotspot_lock);
+    info->sampled = heap_sampled;
+    info->avg_cycles = heap_sampled ? heap_sample_cycles / heap_sampled : 0;
+    for (int i = 0; i < CONFIG_APP_DEBUG_HEAP_HOTSPOTS && num < max; i++)
+    {
+        if (heap_hotspots[i].count)
+        {
+            hotspots[num++] = heap_hotspots[i];
+        }
+    }
+    portEXIT_CRITICAL(&heap_hotspot_lock);
+
+    qsort(hotspots, num, sizeof(debug_heap_hotspot_t), debug_hotspot_cmp);
+    return num;
+#else
+    return 0;
+#endif
+}
+
+esp_err_t debug_stats_init(void)
+{
+    debug_stats_mutex = xSemaphoreCreateMutex();
+    if (!debug_stats_mutex)
+    {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_FAIL;
+    }
+
+    metrics_gauge_register(&debug_collect_us, "debug_stats_collect_us", "Cost of the last task statistics sample", NULL, NULL);
+
+    TimerHandle_t timer = xTimerCreate("debug_stats", pdMS_TO_TICKS(CONFIG_APP_DEBUG_STATS_PERIOD_MS), pdTRUE, NULL, debug_stats_timer_cb);
+    if (!timer)
+    {
+        ESP_LOGE(TAG, "Create timer fail");
+        return ESP_FAIL;
+    }
+    xTimerStart(timer, portMAX_DELAY);
+    debug_stats_timer_cb(timer);
+    return ESP_OK;
+}
+
+#endif
@@ -7,19 +7,110 @@
 #include "freertos/timers.h"
 #include "freertos/semphr.h"
 #include "esp_wifi.h"
+#include "esp_idf_version.h"
+#include <string.h>
+#include <stdatomic.h>
 #include <espnow.h>
 #include <sensor.h>
+#include <sensor_codec.h>
+#include <sensor_store.h>
+#include <metrics.h>
+#include <tracing.h>
+#include "esp_random.h"
+#include "espnow_rate.h"
+#include "espnow_ingest.h"
+#include "link_table.h"
+#include "parent_select.h"
 
 static const char *TAG = "espnow";
 
 static uint32_t current_seq = 0;
 static TaskHandle_t espnow_task_ctrl_handle = NULL;
-static QueueHandle_t espnow_recv_queue = NULL;
 static SemaphoreHandle_t sent_msgs_mutex = NULL;
+static SemaphoreHandle_t sent_msgs_idle = NULL; /* Given whenever sent_msgs is done with its frame */
 static uint8_t s_broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 static esp_now_msg_send_t *sent_msgs;
 uint8_t espnow_payload[ESPNOW_PAYLOAD_MAX_LEN];
 
+/* Rates are only set per peer, which needs IDF 5.4. Per interface they would also apply to broadcasts and mesh-lite */
+#define ESPNOW_RATE_CONTROL (CONFIG_APP_ESPNOW_RATE_CONTROL && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0))
+
+#define ESPNOW_DATA_TYPE_SINK (ESPNOW_DATA_TYPE_RESERVE + 1)
+#define ESPNOW_DATA_TYPE_PARENT (ESPNOW_DATA_TYPE_RESERVE + 2)
+#define ESPNOW_SINK_TIMEOUT_US (3000LL * CONFIG_APP_ESPNOW_SINK_ADV_INTERVAL_MS)
+#define ESPNOW_SINK_RSSI_HYSTERESIS 6 /* dB a new sink must be stronger by to replace the current one */
+#define ESPNOW_SEND_TIMER_MS 100
+#define ESPNOW_SEND_CB_TIMEOUT_TICKS 10 /* Send timer periods to wait for the send callback */
+/* Longest a frame stays in flight: every unicast attempt times out, then the broadcast is sent twice */
+#define ESPNOW_SEND_WAIT_MS (ESPNOW_SEND_TIMER_MS * ((CONFIG_APP_ESPNOW_SINK_MAX_RETRY + 1) * ESPNOW_SEND_CB_TIMEOUT_TICKS + 3))
+
+typedef enum
+{
+    ESPNOW_TX_PENDING = 0,
+    ESPNOW_TX_ACKED,
+    ESPNOW_TX_FAILED,
+} espnow_tx_state_t;
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int8_t rssi;
+    int64_t last_seen;
+} espnow_sink_t;
+
+static espnow_sink_t espnow_sink = {0};
+static portMUX_TYPE espnow_sink_lock = portMUX_INITIALIZER_UNLOCKED;
+/* Destination and outcome of the last unicast frame, written by the send callback */
+static uint8_t espnow_tx_dest[ESP_NOW_ETH_ALEN];
+static _Atomic uint8_t espnow_tx_state = ESPNOW_TX_PENDING;
+/* Send callbacks still due for attempts to espnow_tx_dest that timed out, they must not be credited to later ones */
+static _Atomic uint8_t espnow_tx_owed = 0;
+
+#if ESPNOW_RATE_CONTROL
+#define ESPNOW_RATE_PEER_NUM 4
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    espnow_rate_ctrl_t ctrl;
+    espnow_rate_t applied;   /* Rate configured in the driver */
+    uint32_t last_used;
+    bool valid;
+} espnow_rate_peer_t;
+
+static espnow_rate_peer_t espnow_rate_peers[ESPNOW_RATE_PEER_NUM];
+static portMUX_TYPE espnow_rate_lock = portMUX_INITIALIZER_UNLOCKED;
+static const wifi_phy_rate_t espnow_phy_rates[ESPNOW_RATE_NUM] = {
+    [ESPNOW_RATE_1M] = WIFI_PHY_RATE_1M_L,
+    [ESPNOW_RATE_2M] = WIFI_PHY_RATE_2M_L,
+    [ESPNOW_RATE_5M5] = WIFI_PHY_RATE_5M_L,
+    [ESPNOW_RATE_11M] = WIFI_PHY_RATE_11M_L,
+    [ESPNOW_RATE_MCS0] = WIFI_PHY_RATE_MCS0_LGI,
+    [ESPNOW_RATE_MCS1] = WIFI_PHY_RATE_MCS1_LGI,
+    [ESPNOW_RATE_MCS2] = WIFI_PHY_RATE_MCS2_LGI,
+    [ESPNOW_RATE_MCS3] = WIFI_PHY_RATE_MCS3_LGI,
+    [ESPNOW_RATE_MCS4] = WIFI_PHY_RATE_MCS4_LGI,
+    [ESPNOW_RATE_MCS5] = WIFI_PHY_RATE_MCS5_LGI,
+    [ESPNOW_RATE_MCS6] = WIFI_PHY_RATE_MCS6_LGI,
+    [ESPNOW_RATE_MCS7] = WIFI_PHY_RATE_MCS7_LGI,
+};
+#endif
+
+static metrics_counter_t espnow_rx_frames;
+static metrics_counter_t espnow_rx_bytes;
+static metrics_counter_t espnow_rx_invalid;
+static metrics_counter_t espnow_tx_frames;
+static metrics_counter_t espnow_tx_bytes;
+static metrics_counter_t espnow_tx_errors;
+static metrics_counter_t espnow_tx_failed;
+static metrics_histogram_t espnow_rx_frame_size;
+static metrics_counter_t espnow_sink_tx;
+static metrics_counter_t espnow_sink_acked;
+static metrics_counter_t espnow_sink_fallback;
+static metrics_counter_t espnow_tx_busy;
+static metrics_counter_t espnow_sink_changes;
+static const uint32_t espnow_frame_size_bounds[] = {16, 32, 64, 128, 192, ESPNOW_PAYLOAD_MAX_LEN};
+
 esp_err_t espnow_data_parse(const uint8_t *data, uint16_t data_len)
 {
     app_espnow_data_t *buf = (app_espnow_data_t *)data;
@@ -61,65 +152,261 @@ void espnow_data_prepare(uint8_t *buf, const uint8_t *payload, size_t payload_le
 
 esp_err_t app_espnow_create_peer(uint8_t dst_mac[ESP_NOW_ETH_ALEN])
 {
-    esp_err_t ret = ESP_FAIL;
-    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-    if (peer == NULL)
+    // No driver call unless the peer is new or was evicted
+    return esp_mesh_lite_espnow_peer_add(dst_mac, 0, WIFI_IF_STA);
+}
+
+#if ESPNOW_RATE_CONTROL
+/* Called with espnow_rate_lock held */
+static espnow_rate_peer_t *espnow_rate_peer_find(const uint8_t *mac)
+{
+    for (int i = 0; i < ESPNOW_RATE_PEER_NUM; i++)
     {
-        ESP_LOGE(TAG, "Malloc peer information fail");
-        return ESP_ERR_NO_MEM;
+        if (espnow_rate_peers[i].valid && !memcmp(espnow_rate_peers[i].mac, mac, ESP_NOW_ETH_ALEN))
+        {
+            return &espnow_rate_peers[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t espnow_rate_apply(const uint8_t *mac, espnow_rate_t rate)
+{
+    esp_now_rate_config_t config = {
+        .phymode = rate <= ESPNOW_RATE_11M ? WIFI_PHY_MODE_11B : WIFI_PHY_MODE_HT20,
+        .rate = espnow_phy_rates[rate],
+        .ersu = false,
+        .dcm = false,
+    };
+    return esp_now_set_peer_rate_config(mac, &config);
+}
+
+/* First rate of a new peer from the RSSI it is heard at, 1M when it was not heard yet */
+static espnow_rate_t espnow_rate_initial(const uint8_t *mac)
+{
+    link_entry_t link;
+
+    if (!link_table_get(mac, &link) || link.last_heard == 0)
+    {
+        return ESPNOW_RATE_1M;
+    }
+    if (link.rssi >= -60)
+    {
+        return ESPNOW_RATE_MCS4;
+    }
+    if (link.rssi >= -70)
+    {
+        return ESPNOW_RATE_MCS2;
+    }
+    if (link.rssi >= -80)
+    {
+        return ESPNOW_RATE_MCS0;
     }
-    memset(peer, 0, sizeof(esp_now_peer_info_t));
+    return ESPNOW_RATE_1M;
+}
+
+/* Picks and configures the rate of the next unicast frame to mac */
+static void espnow_rate_before_send(const uint8_t *mac, size_t len)
+{
+    static uint32_t tick = 0;
+    uint32_t now = esp_timer_get_time() / 1000;
+    espnow_rate_t start = espnow_rate_initial(mac);
+
+    portENTER_CRITICAL(&espnow_rate_lock);
+    espnow_rate_peer_t *peer = espnow_rate_peer_find(mac);
+    if (!peer)
+    {
+        // Replace the least recently used controller
+        peer = &espnow_rate_peers[0];
+        for (int i = 1; i < ESPNOW_RATE_PEER_NUM && peer->valid; i++)
+        {
+            if (!espnow_rate_peers[i].valid || tick - espnow_rate_peers[i].last_used > tick - peer->last_used)
+            {
+                peer = &espnow_rate_peers[i];
+            }
+        }
+        memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+        espnow_rate_ctrl_init(&peer->ctrl, len, start, now);
+        peer->applied = ESPNOW_RATE_1M;
+        peer->valid = true;
+    }
+    peer->last_used = ++tick;
+    espnow_rate_t rate = espnow_rate_ctrl_select(&peer->ctrl, esp_random());
+    espnow_rate_t applied = peer->applied;
+    portEXIT_CRITICAL(&espnow_rate_lock);
 
-    esp_now_get_peer(dst_mac, peer);
+    if (rate != applied && espnow_rate_apply(mac, rate) == ESP_OK)
+    {
+        portENTER_CRITICAL(&espnow_rate_lock);
+        peer = espnow_rate_peer_find(mac);
+        if (peer)
+        {
+            peer->applied = rate;
+        }
+        portEXIT_CRITICAL(&espnow_rate_lock);
+    }
+}
 
-    peer->channel = 0;
-    peer->ifidx = ESP_IF_WIFI_STA;
-    peer->encrypt = false;
-    // memcpy(peer->lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
-    memcpy(peer->peer_addr, dst_mac, ESP_NOW_ETH_ALEN);
+/* Credits the outcome to the rate the frame went out at */
+static void espnow_rate_on_sent(const uint8_t *mac, bool success)
+{
+    uint32_t now = esp_timer_get_time() / 1000;
 
-    if (esp_now_is_peer_exist(dst_mac) == false)
+    portENTER_CRITICAL(&espnow_rate_lock);
+    espnow_rate_peer_t *peer = espnow_rate_peer_find(mac);
+    if (peer)
     {
-        ret = esp_now_add_peer(peer);
+        espnow_rate_ctrl_report(&peer->ctrl, peer->applied, success, now);
+    }
+    portEXIT_CRITICAL(&espnow_rate_lock);
+}
+#endif
+
+static esp_err_t espnow_send_msg(const uint8_t *dest, uint8_t *buf, size_t len)
+{
+    app_espnow_create_peer((uint8_t *)dest);
+    esp_err_t ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_RESERVE, (uint8_t *)dest, buf, len);
+    if (ret != ESP_OK)
+    {
+        metrics_counter_inc(&espnow_tx_errors);
+        ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
     }
     else
     {
-        ret = esp_now_mod_peer(peer);
+        metrics_counter_inc(&espnow_tx_frames);
+        metrics_counter_add(&espnow_tx_bytes, len);
+    }
+    return ret;
+}
+
+/* Called with sent_msgs_mutex held */
+static void espnow_msg_clear(void)
+{
+    sent_msgs->retry_times = 0;
+    sent_msgs->max_retry = 0;
+    sent_msgs->msg_len = 0;
+    if (sent_msgs->sent_msg)
+    {
+        free(sent_msgs->sent_msg);
+        sent_msgs->sent_msg = NULL;
+    }
+    xSemaphoreGive(sent_msgs_idle);
+}
+
+/*
+ * Waits until the frame in flight was acknowledged or given up on, so a new frame never cancels
+ * the resends of the previous one. Returns with sent_msgs_mutex held on success.
+ */
+static esp_err_t espnow_msg_slot_take(void)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    xSemaphoreTake(sent_msgs_mutex, portMAX_DELAY);
+    while (sent_msgs->sent_msg)
+    {
+        xSemaphoreGive(sent_msgs_mutex);
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= pdMS_TO_TICKS(ESPNOW_SEND_WAIT_MS) ||
+            xSemaphoreTake(sent_msgs_idle, pdMS_TO_TICKS(ESPNOW_SEND_WAIT_MS) - waited) != pdTRUE)
+        {
+            metrics_counter_inc(&espnow_tx_busy);
+            return ESP_ERR_TIMEOUT;
+        }
+        xSemaphoreTake(sent_msgs_mutex, portMAX_DELAY);
     }
-    free(peer);
+    return ESP_OK;
+}
 
+/* Called with sent_msgs_mutex held */
+static esp_err_t espnow_msg_send_unicast(void)
+{
+    if (memcmp(espnow_tx_dest, sent_msgs->dest, ESP_NOW_ETH_ALEN))
+    {
+        // Callbacks still due for the previous destination no longer match
+        atomic_store_explicit(&espnow_tx_owed, 0, memory_order_relaxed);
+        memcpy(espnow_tx_dest, sent_msgs->dest, ESP_NOW_ETH_ALEN);
+    }
+    atomic_store_explicit(&espnow_tx_state, ESPNOW_TX_PENDING, memory_order_release);
+    sent_msgs->wait_ticks = 0;
+#if ESPNOW_RATE_CONTROL
+    espnow_rate_before_send(sent_msgs->dest, sent_msgs->msg_len);
+#endif
+
+    esp_err_t ret = espnow_send_msg(sent_msgs->dest, sent_msgs->sent_msg, sent_msgs->msg_len);
+    if (ret != ESP_OK)
+    {
+        atomic_store_explicit(&espnow_tx_state, ESPNOW_TX_FAILED, memory_order_release);
+    }
     return ret;
 }
 
+static void espnow_sink_lost(const uint8_t *mac)
+{
+    portENTER_CRITICAL(&espnow_sink_lock);
+    if (!memcmp(espnow_sink.mac, mac, ESP_NOW_ETH_ALEN))
+    {
+        espnow_sink.last_seen = 0;
+    }
+    portEXIT_CRITICAL(&espnow_sink_lock);
+    ESP_LOGW(TAG, "Sink " MACSTR " unreachable, fall back to broadcast", MAC2STR(mac));
+}
+
+/* Unicast frames are resent once the send callback reports that the MAC layer gave up */
+static void espnow_send_unicast_check(void)
+{
+    espnow_tx_state_t state = atomic_load_explicit(&espnow_tx_state, memory_order_acquire);
+
+    if (state == ESPNOW_TX_PENDING)
+    {
+        if (++sent_msgs->wait_ticks < ESPNOW_SEND_CB_TIMEOUT_TICKS)
+        {
+            return;
+        }
+        // Given up on as failed, its callback may still arrive
+        atomic_fetch_add_explicit(&espnow_tx_owed, 1, memory_order_relaxed);
+    }
+    if (state == ESPNOW_TX_ACKED)
+    {
+        metrics_counter_inc(&espnow_sink_acked);
+        espnow_msg_clear();
+        return;
+    }
+    if (sent_msgs->retry_times < sent_msgs->max_retry)
+    {
+        sent_msgs->retry_times++;
+        espnow_msg_send_unicast();
+        return;
+    }
+
+    // Retries exhausted, hand the frame to whoever hears it. Frames sized for a v2 sink only
+    // reach the v2 nodes around
+    metrics_counter_inc(&espnow_sink_fallback);
+    espnow_sink_lost(sent_msgs->dest);
+    memcpy(sent_msgs->dest, s_broadcast_mac, ESP_NOW_ETH_ALEN);
+    sent_msgs->retry_times = 0;
+    sent_msgs->max_retry = 1;
+    espnow_send_msg(s_broadcast_mac, sent_msgs->sent_msg, sent_msgs->msg_len);
+}
+
 static void esp_now_send_timer_cb(TimerHandle_t timer)
 {
     xSemaphoreTake(sent_msgs_mutex, portMAX_DELAY);
-    if (sent_msgs->max_retry > sent_msgs->retry_times)
+    if (sent_msgs->sent_msg && !IS_BROADCAST_ADDR(sent_msgs->dest))
+    {
+        espnow_send_unicast_check();
+    }
+    else if (sent_msgs->max_retry > sent_msgs->retry_times)
     {
+        // Broadcasts are not acknowledged, send them twice
         sent_msgs->retry_times++;
         if (sent_msgs->sent_msg)
         {
-            app_espnow_create_peer(s_broadcast_mac);
-            esp_err_t ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_RESERVE, s_broadcast_mac, sent_msgs->sent_msg, sent_msgs->msg_len);
-            if (ret != ESP_OK)
-            {
-                ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
-            }
+            espnow_send_msg(s_broadcast_mac, sent_msgs->sent_msg, sent_msgs->msg_len);
         }
     }
-    else
+    else if (sent_msgs->max_retry)
     {
-        if (sent_msgs->max_retry)
-        {
-            sent_msgs->retry_times = 0;
-            sent_msgs->max_retry = 0;
-            sent_msgs->msg_len = 0;
-            if (sent_msgs->sent_msg)
-            {
-                free(sent_msgs->sent_msg);
-                sent_msgs->sent_msg = NULL;
-            }
-        }
+        espnow_msg_clear();
     }
     xSemaphoreGive(sent_msgs_mutex);
 }
@@ -129,14 +416,7 @@ void esp_now_remove_send_msgs(void)
     xSemaphoreTake(sent_msgs_mutex, portMAX_DELAY);
     if (sent_msgs->max_retry)
     {
-        sent_msgs->retry_times = 0;
-        sent_msgs->max_retry = 0;
-        sent_msgs->msg_len = 0;
-        if (sent_msgs->sent_msg)
-        {
-            free(sent_msgs->sent_msg);
-            sent_msgs->sent_msg = NULL;
-        }
+        espnow_msg_clear();
     }
     xSemaphoreGive(sent_msgs_mutex);
 }
@@ -159,6 +439,32 @@ static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status
         return;
     }
 
+    if (status != ESP_NOW_SEND_SUCCESS)
+    {
+        metrics_counter_inc(&espnow_tx_failed);
+    }
+    if (!IS_BROADCAST_ADDR(mac_addr))
+    {
+        link_table_tx(mac_addr, status == ESP_NOW_SEND_SUCCESS);
+    }
+    if (!memcmp(mac_addr, espnow_tx_dest, ESP_NOW_ETH_ALEN))
+    {
+        // Callbacks arrive in send order, so an owed one belongs to an attempt that already timed out
+        uint8_t owed = atomic_load_explicit(&espnow_tx_owed, memory_order_relaxed);
+        while (owed && !atomic_compare_exchange_weak_explicit(&espnow_tx_owed, &owed, owed - 1, memory_order_relaxed,
+                                                               memory_order_relaxed))
+        {
+        }
+        if (owed == 0)
+        {
+#if ESPNOW_RATE_CONTROL
+            espnow_rate_on_sent(mac_addr, status == ESP_NOW_SEND_SUCCESS);
+#endif
+            atomic_store_explicit(&espnow_tx_state, status == ESP_NOW_SEND_SUCCESS ? ESPNOW_TX_ACKED : ESPNOW_TX_FAILED,
+                                  memory_order_release);
+        }
+    }
+
 #if CONFIG_APP_DEBUG
     if (status == ESP_NOW_SEND_SUCCESS)
     {
@@ -171,13 +477,19 @@ static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status
 #endif
 }
 
-static esp_err_t espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+/* Every received frame, whatever its data type, tells about the link to its sender */
+static void espnow_link_rx_hook(const esp_now_recv_info_t *recv_info, int len)
 {
-    esp_mesh_lite_espnow_event_t evt;
-    espnow_recv_cb_t *recv_cb = &evt.info.recv_cb;
-    uint8_t *mac_addr = (uint8_t *)recv_info->src_addr;
+    if (recv_info && recv_info->src_addr)
+    {
+        link_table_rx(recv_info->src_addr, recv_info->rx_ctrl);
+    }
+}
 
-    if (mac_addr == NULL || data == NULL || len <= 0)
+static esp_err_t espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    TRACE_INSTANT("espnow_rx", len);
+    if (recv_info->src_addr == NULL || data == NULL || len <= 0)
     {
         ESP_LOGE(TAG, "Receive cb arg error");
         return ESP_FAIL;
@@ -187,78 +499,147 @@ static esp_err_t espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint
     {
         return ESP_FAIL;
     }
+    metrics_counter_inc(&espnow_rx_frames);
+    metrics_counter_add(&espnow_rx_bytes, len);
+    metrics_histogram_observe(&espnow_rx_frame_size, len);
 
-    evt.id = ESPNOW_RECV_CB;
-    memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    recv_cb->data = malloc(len);
-    if (recv_cb->data == NULL)
+    // Runs in the Wi-Fi task, a full lane sheds a frame instead of waiting
+    return espnow_ingest_push(ESPNOW_INGEST_LANE_DATA, recv_info, ESPNOW_DATA_TYPE_RESERVE, data, len);
+}
+
+static esp_err_t espnow_sink_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    if (recv_info == NULL || recv_info->src_addr == NULL || data == NULL || espnow_data_parse(data, len) != ESP_OK)
     {
-        ESP_LOGE(TAG, "Malloc receive data fail");
         return ESP_FAIL;
     }
-    memcpy(recv_cb->data, data, len);
-    recv_cb->data_len = len;
-    if (xQueueSend(espnow_recv_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE)
+    return espnow_ingest_push(ESPNOW_INGEST_LANE_CONTROL, recv_info, ESPNOW_DATA_TYPE_SINK, data, len);
+}
+
+static esp_err_t espnow_parent_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    if (recv_info == NULL || recv_info->src_addr == NULL || data == NULL || espnow_data_parse(data, len) != ESP_OK)
     {
-        ESP_LOGW(TAG, "Send receive queue fail");
-        free(recv_cb->data);
-        recv_cb->data = NULL;
         return ESP_FAIL;
     }
-    return ESP_OK;
+    return espnow_ingest_push(ESPNOW_INGEST_LANE_CONTROL, recv_info, ESPNOW_DATA_TYPE_PARENT, data, len);
+}
+
+static void espnow_sink_update(const uint8_t *mac, int8_t rssi)
+{
+    int64_t now = esp_timer_get_time();
+    bool changed = false;
+
+    portENTER_CRITICAL(&espnow_sink_lock);
+    bool expired = !espnow_sink.last_seen || now - espnow_sink.last_seen > ESPNOW_SINK_TIMEOUT_US;
+    bool same = !memcmp(espnow_sink.mac, mac, ESP_NOW_ETH_ALEN);
+    if (same || expired || rssi > espnow_sink.rssi + ESPNOW_SINK_RSSI_HYSTERESIS)
+    {
+        changed = !same || expired;
+        memcpy(espnow_sink.mac, mac, ESP_NOW_ETH_ALEN);
+        espnow_sink.rssi = rssi;
+        espnow_sink.last_seen = now;
+    }
+    portEXIT_CRITICAL(&espnow_sink_lock);
+
+    if (changed)
+    {
+        metrics_counter_inc(&espnow_sink_changes);
+        ESP_LOGI(TAG, "Sink " MACSTR ", rssi %d", MAC2STR(mac), rssi);
+    }
+}
+
+static bool espnow_sink_get(uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&espnow_sink_lock);
+    bool valid = espnow_sink.last_seen && now - espnow_sink.last_seen <= ESPNOW_SINK_TIMEOUT_US;
+    memcpy(mac, espnow_sink.mac, ESP_NOW_ETH_ALEN);
+    portEXIT_CRITICAL(&espnow_sink_lock);
+    return valid;
+}
+
+#if CONFIG_APP_ESPNOW_SINK
+static void espnow_sink_adv_timer_cb(TimerHandle_t timer)
+{
+    app_espnow_data_t adv = {
+        .seq = 0,
+        .mesh_id = CONFIG_MESH_ID,
+    };
+    app_espnow_create_peer(s_broadcast_mac);
+    esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_SINK, s_broadcast_mac, (const uint8_t *)&adv, sizeof(adv));
+}
+#endif
+
+static void espnow_sensor_packet_handle(const sensor_packet_t *sensor_data, void *arg)
+{
+#if CONFIG_SENSOR_STORE_ENABLE
+    sensor_store_add((const uint8_t *)arg, sensor_data);
+#endif
+    uint64_t timestamp = sensor_data->timestamp;
+    uint32_t sensor_id = sensor_data->sensor_id;
+    sensor_type_t type = sensor_data->type;
+    if (type == SENSOR_TYPE_TEMPERATURE)
+    {
+        float temperature = sensor_data->data.temperature.value;
+#if CONFIG_APP_DEBUG
+        ESP_LOGI(TAG, "Timestamp: %llu, Sensor ID: %lu, Type: %u, Temperature: %.2f",
+                 timestamp, sensor_id, type, temperature);
+#endif
+    }
+    else if (type == SENSOR_TYPE_HUMIDITY)
+    {
+        float humidity = sensor_data->data.humidity.value;
+#if CONFIG_APP_DEBUG
+        ESP_LOGI(TAG, "Timestamp: %llu, Sensor ID: %lu, Type: %u, Humidity: %.2f",
+                 timestamp, sensor_id, type, humidity);
+#endif
+    }
 }
 
 static void espnow_task(void *pvParameter)
 {
-    esp_mesh_lite_espnow_event_t evt;
+    espnow_ingest_item_t item;
 
     ESP_LOGI(TAG, "Start espnow task");
 
-    while (xQueueReceive(espnow_recv_queue, &evt, portMAX_DELAY) == pdTRUE)
+    while (espnow_ingest_pop(&item, portMAX_DELAY))
     {
-        switch (evt.id)
+        switch (item.type)
         {
-        case ESPNOW_RECV_CB:
-            espnow_recv_cb_t *recv_cb = &evt.info.recv_cb;
-            app_espnow_data_t *buf = (app_espnow_data_t *)recv_cb->data;
+        case ESPNOW_DATA_TYPE_SINK:
+            espnow_sink_update(item.src, item.rssi);
+            break;
+        case ESPNOW_DATA_TYPE_PARENT:
+            parent_select_offer_rx(item.src, item.rssi, item.data + ESPNOW_PAYLOAD_HEAD_LEN, item.len - ESPNOW_PAYLOAD_HEAD_LEN);
+            break;
+        case ESPNOW_DATA_TYPE_RESERVE:
+            TRACE_BEGIN("espnow_process");
+            app_espnow_data_t *buf = (app_espnow_data_t *)item.data;
             uint32_t recv_seq = buf->seq;
             memset(espnow_payload, 0x0, ESPNOW_PAYLOAD_MAX_LEN);
-            memcpy(espnow_payload, buf->payload, recv_cb->data_len - ESPNOW_PAYLOAD_HEAD_LEN);
+            memcpy(espnow_payload, buf->payload, item.len - ESPNOW_PAYLOAD_HEAD_LEN);
 
 #if CONFIG_APP_DEBUG
             ESP_LOGI(TAG, "Receive broadcast data from: " MACSTR ", len: %d, recv_seq: %" PRIu32 ", current_seq: %" PRIu32 "",
-                     MAC2STR(recv_cb->mac_addr),
-                     recv_cb->data_len,
+                     MAC2STR(item.src),
+                     item.len,
                      recv_seq,
                      current_seq);
 #endif
-            sensor_packet_t *sensor_data = (sensor_packet_t *)espnow_payload;
-            uint64_t timestamp = sensor_data->timestamp;
-            uint32_t sensor_id = sensor_data->sensor_id;
-            sensor_type_t type = sensor_data->type;
-            if (type == SENSOR_TYPE_TEMPERATURE)
+            if (sensor_codec_decode(espnow_payload, item.len - ESPNOW_PAYLOAD_HEAD_LEN, espnow_sensor_packet_handle, item.src) != ESP_OK)
             {
-                float temperature = sensor_data->data.temperature.value;
-#if CONFIG_APP_DEBUG
-                ESP_LOGI(TAG, "Timestamp: %llu, Sensor ID: %lu, Type: %u, Temperature: %.2f",
-                         timestamp, sensor_id, type, temperature);
-#endif
+                metrics_counter_inc(&espnow_rx_invalid);
+                ESP_LOGW(TAG, "Invalid sensor frame from " MACSTR "", MAC2STR(item.src));
             }
-            else if (type == SENSOR_TYPE_HUMIDITY)
-            {
-                float humidity = sensor_data->data.humidity.value;
-#if CONFIG_APP_DEBUG
-                ESP_LOGI(TAG, "Timestamp: %llu, Sensor ID: %lu, Type: %u, Humidity: %.2f",
-                         timestamp, sensor_id, type, humidity);
-#endif
-            }
-            free(recv_cb->data);
-            recv_cb->data = NULL;
+            TRACE_END("espnow_process");
             break;
         default:
-            ESP_LOGE(TAG, "Callback type error: %d", evt.id);
+            ESP_LOGE(TAG, "Callback type error: %d", item.type);
             break;
         }
+        free(item.data);
     }
 }
 
@@ -266,16 +647,20 @@ esp_err_t esp_now_send_broadcast(const uint8_t *payload, size_t payload_len, boo
 {
     esp_err_t ret = ESP_OK;
     uint8_t *buf = calloc(1, payload_len + ESPNOW_PAYLOAD_HEAD_LEN);
-    espnow_data_prepare(buf, payload, payload_len, seq_init);
-    app_espnow_create_peer(s_broadcast_mac);
-    ret = esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_RESERVE, s_broadcast_mac, buf, payload_len + ESPNOW_PAYLOAD_HEAD_LEN);
-    if (ret != ESP_OK)
+    if (buf == NULL)
     {
-        ESP_LOGE(TAG, "Send error: %d [%s %d]", ret, __func__, __LINE__);
+        return ESP_ERR_NO_MEM;
     }
+    espnow_data_prepare(buf, payload, payload_len, seq_init);
 
-    xSemaphoreTake(sent_msgs_mutex, portMAX_DELAY);
-    sent_msgs->retry_times = 0;
+    // Previous message still waiting for its retry, e.g. back-to-back sensor batches
+    if (espnow_msg_slot_take() != ESP_OK)
+    {
+        free(buf);
+        return ESP_ERR_TIMEOUT;
+    }
+    ret = espnow_send_msg(s_broadcast_mac, buf, payload_len + ESPNOW_PAYLOAD_HEAD_LEN);
+    memcpy(sent_msgs->dest, s_broadcast_mac, ESP_NOW_ETH_ALEN);
     sent_msgs->max_retry = 1;
     sent_msgs->msg_len = payload_len + ESPNOW_PAYLOAD_HEAD_LEN;
     sent_msgs->sent_msg = buf;
@@ -283,6 +668,69 @@ esp_err_t esp_now_send_broadcast(const uint8_t *payload, size_t payload_len, boo
     return ret;
 }
 
+esp_err_t esp_now_send_parent_offer(const uint8_t *offer, size_t offer_len)
+{
+    uint8_t buf[ESPNOW_PAYLOAD_HEAD_LEN + sizeof(parent_offer_t)];
+    app_espnow_data_t *head = (app_espnow_data_t *)buf;
+
+    if (offer_len > sizeof(parent_offer_t))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    head->seq = 0;
+    head->mesh_id = CONFIG_MESH_ID;
+    memcpy(head->payload, offer, offer_len);
+    app_espnow_create_peer(s_broadcast_mac);
+    return esp_mesh_lite_espnow_send(ESPNOW_DATA_TYPE_PARENT, s_broadcast_mac, buf, ESPNOW_PAYLOAD_HEAD_LEN + offer_len);
+}
+
+size_t esp_now_sink_payload_max(void)
+{
+    uint8_t dest[ESP_NOW_ETH_ALEN];
+    if (espnow_sink_get(dest))
+    {
+        app_espnow_create_peer(dest);
+        esp_mesh_lite_espnow_peer_query_caps(dest);
+    }
+    else
+    {
+        memcpy(dest, s_broadcast_mac, ESP_NOW_ETH_ALEN);
+    }
+    return esp_mesh_lite_espnow_max_data_len(dest) - ESPNOW_PAYLOAD_HEAD_LEN;
+}
+
+esp_err_t esp_now_send_to_sink(const uint8_t *payload, size_t payload_len, bool seq_init)
+{
+    uint8_t sink[ESP_NOW_ETH_ALEN];
+    if (!espnow_sink_get(sink))
+    {
+        return esp_now_send_broadcast(payload, payload_len, seq_init);
+    }
+
+    uint8_t *buf = calloc(1, payload_len + ESPNOW_PAYLOAD_HEAD_LEN);
+    if (buf == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    espnow_data_prepare(buf, payload, payload_len, seq_init);
+
+    if (espnow_msg_slot_take() != ESP_OK)
+    {
+        free(buf);
+        return ESP_ERR_TIMEOUT;
+    }
+    memcpy(sent_msgs->dest, sink, ESP_NOW_ETH_ALEN);
+    sent_msgs->max_retry = CONFIG_APP_ESPNOW_SINK_MAX_RETRY;
+    sent_msgs->msg_len = payload_len + ESPNOW_PAYLOAD_HEAD_LEN;
+    sent_msgs->sent_msg = buf;
+    metrics_counter_inc(&espnow_sink_tx);
+    esp_err_t ret = espnow_msg_send_unicast();
+    xSemaphoreGive(sent_msgs_mutex);
+
+    // A frame the driver rejected is retried by the send timer
+    return ret == ESP_ERR_ESPNOW_NO_MEM ? ESP_OK : ret;
+}
+
 void espnow_deinit(void)
 {
     esp_now_unregister_send_cb();
@@ -292,49 +740,101 @@ void espnow_deinit(void)
         vTaskDelete(espnow_task_ctrl_handle);
         espnow_task_ctrl_handle = NULL;
     }
+}
 
-    if (espnow_recv_queue)
+static void espnow_peer_collect(metrics_writer_t *writer, void *arg)
+{
+    esp_mesh_lite_espnow_peer_stats_t stats;
+    esp_mesh_lite_espnow_peer_get_stats(&stats);
+
+    metrics_printf(writer, "# TYPE espnow_peer_cache counter\n# HELP espnow_peer_cache ESP-NOW peer cache lookups by outcome\n");
+    metrics_printf(writer, "espnow_peer_cache_total{result=\"hit\"} %" PRIu32 "\n", stats.hits);
+    metrics_printf(writer, "espnow_peer_cache_total{result=\"add\"} %" PRIu32 "\n", stats.adds);
+    metrics_printf(writer, "espnow_peer_cache_total{result=\"mod\"} %" PRIu32 "\n", stats.mods);
+    metrics_printf(writer, "espnow_peer_cache_total{result=\"evict\"} %" PRIu32 "\n", stats.evictions);
+}
+
+#if ESPNOW_RATE_CONTROL
+static void espnow_rate_collect(metrics_writer_t *writer, void *arg)
+{
+    metrics_printf(writer, "# TYPE espnow_rate_kbps gauge\n# HELP espnow_rate_kbps Nominal PHY rate chosen for the unicast peer\n");
+    for (int i = 0; i < ESPNOW_RATE_PEER_NUM; i++)
     {
-        vSemaphoreDelete(espnow_recv_queue);
-        espnow_recv_queue = NULL;
+        portENTER_CRITICAL(&espnow_rate_lock);
+        espnow_rate_peer_t peer = espnow_rate_peers[i];
+        portEXIT_CRITICAL(&espnow_rate_lock);
+        if (peer.valid)
+        {
+            metrics_printf(writer, "espnow_rate_kbps{peer=\"" MACSTR "\"} %" PRIu32 "\n", MAC2STR(peer.mac), espnow_rate_kbps(peer.ctrl.best));
+        }
     }
 }
+#endif
+
+static void espnow_metrics_register(void)
+{
+    metrics_counter_register(&espnow_rx_frames, "espnow_rx_frames", "ESP-NOW frames received for this mesh");
+    metrics_counter_register(&espnow_rx_bytes, "espnow_rx_bytes", "ESP-NOW bytes received for this mesh");
+    metrics_counter_register(&espnow_rx_invalid, "espnow_rx_invalid", "Received ESP-NOW frames that are not valid sensor frames");
+    metrics_counter_register(&espnow_tx_frames, "espnow_tx_frames", "ESP-NOW frames handed to the driver, including resends");
+    metrics_counter_register(&espnow_tx_bytes, "espnow_tx_bytes", "ESP-NOW bytes handed to the driver, including resends");
+    metrics_counter_register(&espnow_tx_errors, "espnow_tx_errors", "ESP-NOW frames rejected by the driver");
+    metrics_counter_register(&espnow_tx_failed, "espnow_tx_failed", "ESP-NOW frames reported as failed by the send callback");
+    metrics_histogram_register(&espnow_rx_frame_size, "espnow_rx_frame_size_bytes", "Size of received ESP-NOW frames",
+                               espnow_frame_size_bounds, sizeof(espnow_frame_size_bounds) / sizeof(espnow_frame_size_bounds[0]));
+    metrics_counter_register(&espnow_sink_tx, "espnow_sink_tx", "Sensor frames sent as unicast to the sink");
+    metrics_counter_register(&espnow_sink_acked, "espnow_sink_acked", "Unicast sensor frames acknowledged by the sink");
+    metrics_counter_register(&espnow_sink_fallback, "espnow_sink_fallback", "Unicast sensor frames broadcast after running out of retries");
+    metrics_counter_register(&espnow_tx_busy, "espnow_tx_busy", "Sensor frames not sent because the previous one was still in flight");
+    metrics_counter_register(&espnow_sink_changes, "espnow_sink_changes", "Sinks learned from sink advertisements");
+    metrics_collector_register(espnow_peer_collect, NULL);
+#if ESPNOW_RATE_CONTROL
+    metrics_collector_register(espnow_rate_collect, NULL);
+#endif
+}
+
+void espnow_get_queue_stats(uint32_t *depth, uint32_t *drops)
+{
+    espnow_ingest_get_stats(depth, drops);
+}
 
 esp_err_t app_espnow_init(void)
 {
-    espnow_recv_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(esp_mesh_lite_espnow_event_t));
-    if (espnow_recv_queue == NULL)
-    {
-        ESP_LOGE(TAG, "Create mutex fail");
-        return ESP_FAIL;
-    }
+    espnow_metrics_register();
+
+    espnow_ingest_init();
 
     esp_mesh_lite_espnow_init();
+    esp_mesh_lite_espnow_set_codecs(SENSOR_CODEC_SUPPORTED);
+    esp_mesh_lite_espnow_register_rx_hook(espnow_link_rx_hook);
     ESP_ERROR_CHECK(esp_now_register_send_cb(espnow_send_cb));
     esp_mesh_lite_espnow_recv_cb_register(ESPNOW_DATA_TYPE_RESERVE, espnow_recv_cb);
+    esp_mesh_lite_espnow_recv_cb_register(ESPNOW_DATA_TYPE_SINK, espnow_sink_recv_cb);
+    esp_mesh_lite_espnow_recv_cb_register(ESPNOW_DATA_TYPE_PARENT, espnow_parent_recv_cb);
 
     /* Add broadcast peer information to peer list. */
     if (app_espnow_create_peer(s_broadcast_mac) != ESP_OK)
     {
         ESP_LOGE(TAG, "Malloc peer information fail");
         esp_now_unregister_send_cb();
-        vSemaphoreDelete(espnow_recv_queue);
-        espnow_recv_queue = NULL;
         return ESP_FAIL;
     }
 
     xTaskCreate(espnow_task, "espnow_task", ESPNOW_TASK_STACK_SIZE, NULL, ESPNOW_TASK_PRIORITY, &espnow_task_ctrl_handle);
 
-    sent_msgs = (esp_now_msg_send_t *)malloc(sizeof(esp_now_msg_send_t));
-    sent_msgs->max_retry = 0;
-    sent_msgs->msg_len = 0;
-    sent_msgs->retry_times = 0;
-    sent_msgs->sent_msg = NULL;
+    sent_msgs = (esp_now_msg_send_t *)calloc(1, sizeof(esp_now_msg_send_t));
     sent_msgs_mutex = xSemaphoreCreateMutex();
+    sent_msgs_idle = xSemaphoreCreateBinary();
 
-    TimerHandle_t esp_now_send_timer = xTimerCreate("esp_now_send_timer", 100 / portTICK_PERIOD_MS, pdTRUE,
+    TimerHandle_t esp_now_send_timer = xTimerCreate("esp_now_send_timer", pdMS_TO_TICKS(ESPNOW_SEND_TIMER_MS), pdTRUE,
                                                     NULL, esp_now_send_timer_cb);
     xTimerStart(esp_now_send_timer, portMAX_DELAY);
 
+#if CONFIG_APP_ESPNOW_SINK
+    TimerHandle_t sink_adv_timer = xTimerCreate("espnow_sink_adv", pdMS_TO_TICKS(CONFIG_APP_ESPNOW_SINK_ADV_INTERVAL_MS), pdTRUE,
+                                                NULL, espnow_sink_adv_timer_cb);
+    xTimerStart(sink_adv_timer, portMAX_DELAY);
+#endif
+
     return ESP_OK;
 }
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "espnow_ingest.h"
+#include "metrics.h"
+#include "tracing.h"
+
+#define ESPNOW_INGEST_SOURCES 8 /* Sources whose drops are tracked, the heaviest ones are kept */
+
+#if CONFIG_APP_ESPNOW_INGEST_DROP_NEWEST
+#define ESPNOW_INGEST_DROP_NEWEST true
+#else
+#define ESPNOW_INGEST_DROP_NEWEST false
+#endif
+
+ESP_EVENT_DEFINE_BASE(ESPNOW_INGEST_EVENT);
+
+typedef struct
+{
+    espnow_ingest_item_t *items;
+    uint16_t size;
+    uint16_t head;
+    uint16_t count;
+    uint16_t high;  /* High watermark depth */
+    bool above;     /* Crossed the high watermark and not drained yet */
+    uint32_t drops;
+} espnow_ingest_lane_state_t;
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t drops;
+} espnow_ingest_source_t;
+
+static const char *TAG = "espnow_ingest";
+static const char *const ingest_lane_names[ESPNOW_INGEST_LANE_MAX] = {"control", "data"};
+
+static espnow_ingest_item_t ingest_control_items[CONFIG_APP_ESPNOW_INGEST_CONTROL_DEPTH];
+static espnow_ingest_item_t ingest_data_items[CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH];
+static espnow_ingest_lane_state_t ingest_lanes[ESPNOW_INGEST_LANE_MAX] = {
+    [ESPNOW_INGEST_LANE_CONTROL] = {.items = ingest_control_items, .size = CONFIG_APP_ESPNOW_INGEST_CONTROL_DEPTH},
+    [ESPNOW_INGEST_LANE_DATA] = {.items = ingest_data_items, .size = CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH},
+};
+static espnow_ingest_source_t ingest_sources[ESPNOW_INGEST_SOURCES];
+static portMUX_TYPE ingest_lock = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t ingest_ready_buf;
+static SemaphoreHandle_t ingest_ready = NULL;
+
+static metrics_counter_t ingest_dropped;
+static metrics_histogram_t ingest_push_us;
+static const uint32_t ingest_push_bounds[] = {5, 10, 20, 50, 100, 500};
+
+/* Called with ingest_lock held. Space-saving count: an unknown source takes over the slot of the
+ * lightest one and inherits its count, so heavy sources are never evicted by a stream of new ones */
+static void espnow_ingest_count_drop(espnow_ingest_lane_state_t *lane, const uint8_t *src)
+{
+    espnow_ingest_source_t *lightest = &ingest_sources[0];
+
+    lane->drops++;
+    for (int i = 0; i < ESPNOW_INGEST_SOURCES; i++)
+    {
+        if (!memcmp(ingest_sources[i].mac, src, ESP_NOW_ETH_ALEN))
+        {
+            ingest_sources[i].drops++;
+            return;
+        }
+        if (ingest_sources[i].drops < lightest->drops)
+        {
+            lightest = &ingest_sources[i];
+        }
+    }
+    memcpy(lightest->mac, src, ESP_NOW_ETH_ALEN);
+    lightest->drops++;
+}
+
+static void espnow_ingest_post(espnow_ingest_event_id_t id, espnow_ingest_lane_t lane, uint32_t depth)
+{
+    espnow_ingest_event_t event = {
+        .lane = lane,
+        .depth = depth,
+    };
+    // Never wait for the event loop, the event is lost if its queue is full
+    esp_event_post(ESPNOW_INGEST_EVENT, id, &event, sizeof(event), 0);
+}
+
+esp_err_t espnow_ingest_push(espnow_ingest_lane_t lane, const esp_now_recv_info_t *recv_info, uint8_t type,
+                             const uint8_t *data, int len)
+{
+    int64_t start = esp_timer_get_time();
+    espnow_ingest_lane_state_t *state = &ingest_lanes[lane];
+    espnow_ingest_item_t item = {
+        .type = type,
+        .rssi = recv_info->rx_ctrl ? recv_info->rx_ctrl->rssi : INT8_MIN,
+        .len = len,
+        .data = NULL,
+    };
+    memcpy(item.src, recv_info->src_addr, ESP_NOW_ETH_ALEN);
+
+    uint8_t *shed = NULL;
+    bool queued = false;
+    bool high = false;
+
+#if CONFIG_APP_ESPNOW_INGEST_DROP_NEWEST
+    // Do not copy a frame that has no room
+    portENTER_CRITICAL(&ingest_lock);
+    bool full = state->count == state->size;
+    portEXIT_CRITICAL(&ingest_lock);
+    if (!full)
+#endif
+    {
+        item.data = malloc(len);
+        if (item.data)
+        {
+            memcpy(item.data, data, len);
+        }
+    }
+
+    portENTER_CRITICAL(&ingest_lock);
+    if (item.data == NULL)
+    {
+        espnow_ingest_count_drop(state, item.src);
+    }
+    else if (state->count == state->size && ESPNOW_INGEST_DROP_NEWEST)
+    {
+        espnow_ingest_count_drop(state, item.src);
+        shed = item.data;
+    }
+    else
+    {
+        if (state->count == state->size)
+        {
+            espnow_ingest_item_t *oldest = &state->items[state->head];
+            espnow_ingest_count_drop(state, oldest->src);
+            shed = oldest->data;
+            state->head = (state->head + 1) % state->size;
+            state->count--;
+        }
+        state->items[(state->head + state->count) % state->size] = item;
+        state->count++;
+        queued = true;
+        if (!state->above && state->count >= state->high)
+        {
+            state->above = true;
+            high = true;
+        }
+    }
+    uint32_t depth = state->count;
+    portEXIT_CRITICAL(&ingest_lock);
+
+    free(shed);
+    if (!queued || shed)
+    {
+        metrics_counter_inc(&ingest_dropped);
+    }
+    if (queued)
+    {
+        xSemaphoreGive(ingest_ready);
+    }
+    if (high)
+    {
+        espnow_ingest_post(ESPNOW_INGEST_EVENT_HIGH_WATERMARK, lane, depth);
+    }
+    TRACE_INSTANT("espnow_enqueue", depth);
+    metrics_histogram_observe(&ingest_push_us, esp_timer_get_time() - start);
+    return queued ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bool espnow_ingest_pop(espnow_ingest_item_t *item, TickType_t wait)
+{
+    do
+    {
+        int served = -1;
+        bool drained = false;
+
+        portENTER_CRITICAL(&ingest_lock);
+        for (int lane = 0; lane < ESPNOW_INGEST_LANE_MAX && served < 0; lane++)
+        {
+            espnow_ingest_lane_state_t *state = &ingest_lanes[lane];
+            if (state->count == 0)
+            {
+                continue;
+            }
+            *item = state->items[state->head];
+            state->head = (state->head + 1) % state->size;
+            state->count--;
+            served = lane;
+            if (state->above && state->count <= state->high / 2)
+            {
+                state->above = false;
+                drained = true;
+            }
+        }
+        portEXIT_CRITICAL(&ingest_lock);
+
+        if (drained)
+        {
+            espnow_ingest_post(ESPNOW_INGEST_EVENT_DRAINED, served, 0);
+        }
+        if (served >= 0)
+        {
+            return true;
+        }
+    } while (xSemaphoreTake(ingest_ready, wait) == pdTRUE);
+
+    return false;
+}
+
+void espnow_ingest_get_stats(uint32_t *depth, uint32_t *drops)
+{
+    *depth = 0;
+    *drops = 0;
+    portENTER_CRITICAL(&ingest_lock);
+    for (int i = 0; i < ESPNOW_INGEST_LANE_MAX; i++)
+    {
+        *depth += ingest_lanes[i].count;
+        *drops += ingest_lanes[i].drops;
+    }
+    portEXIT_CRITICAL(&ingest_lock);
+}
+
+static void espnow_ingest_collect(metrics_writer_t *writer, void *arg)
+{
+    espnow_ingest_lane_state_t lanes[ESPNOW_INGEST_LANE_MAX];
+    espnow_ingest_source_t sources[ESPNOW_INGEST_SOURCES];
+
+    portENTER_CRITICAL(&ingest_lock);
+    memcpy(lanes, ingest_lanes, sizeof(lanes));
+    memcpy(sources, ingest_sources, sizeof(sources));
+    portEXIT_CRITICAL(&ingest_lock);
+
+    metrics_printf(writer, "# TYPE espnow_ingest_depth gauge\n# HELP espnow_ingest_depth Received ESP-NOW frames waiting in the lane\n");
+    for (int i = 0; i < ESPNOW_INGEST_LANE_MAX; i++)
+    {
+        metrics_printf(writer, "espnow_ingest_depth{lane=\"%s\"} %u\n", ingest_lane_names[i], lanes[i].count);
+    }
+    metrics_printf(writer, "# TYPE espnow_ingest_dropped counter\n# HELP espnow_ingest_dropped Received ESP-NOW frames shed by the lane\n");
+    for (int i = 0; i < ESPNOW_INGEST_LANE_MAX; i++)
+    {
+        metrics_printf(writer, "espnow_ingest_dropped_total{lane=\"%s\"} %" PRIu32 "\n", ingest_lane_names[i], lanes[i].drops);
+    }
+    metrics_printf(writer, "# TYPE espnow_ingest_source_dropped counter\n# HELP espnow_ingest_source_dropped Received ESP-NOW frames shed by source, for the heaviest sources\n");
+    for (int i = 0; i < ESPNOW_INGEST_SOURCES; i++)
+    {
+        if (sources[i].drops)
+        {
+            metrics_printf(writer, "espnow_ingest_source_dropped_total{source=\"" MACSTR "\"} %" PRIu32 "\n",
+                           MAC2STR(sources[i].mac), sources[i].drops);
+        }
+    }
+}
+
+esp_err_t espnow_ingest_init(void)
+{
+    if (ingest_ready)
+    {
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < ESPNOW_INGEST_LANE_MAX; i++)
+    {
+        uint32_t high = ingest_lanes[i].size * CONFIG_APP_ESPNOW_INGEST_HIGH_WATERMARK / 100;
+        ingest_lanes[i].high = high ? high : 1;
+    }
+    ingest_ready = xSemaphoreCreateBinaryStatic(&ingest_ready_buf);
+
+    metrics_counter_register(&ingest_dropped, "espnow_rx_dropped", "Received ESP-NOW frames dropped before processing");
+    metrics_histogram_register(&ingest_push_us, "espnow_ingest_push_us", "Time the receive callback spends queueing a frame",
+                               ingest_push_bounds, sizeof(ingest_push_bounds) / sizeof(ingest_push_bounds[0]));
+    metrics_collector_register(espnow_ingest_collect, NULL);
+
+    ESP_LOGI(TAG, "Lanes control %d, data %d, shed %s", CONFIG_APP_ESPNOW_INGEST_CONTROL_DEPTH, CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH,
+             ESPNOW_INGEST_DROP_NEWEST ? "newest" : "oldest");
+    return ESP_OK;
+}
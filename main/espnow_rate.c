@@ -0,0 +1,128 @@
+#include <string.h>
+#include "espnow_rate.h"
+
+#define ESPNOW_RATE_PROB_MIN 100 /* Rates delivering less than 10% are considered unusable */
+
+typedef struct
+{
+    uint32_t kbps;
+    uint16_t overhead_us; /* Preamble, SIFS and ACK */
+} espnow_rate_info_t;
+
+static const espnow_rate_info_t espnow_rate_info[ESPNOW_RATE_NUM] = {
+    [ESPNOW_RATE_1M] = {1000, 500},
+    [ESPNOW_RATE_2M] = {2000, 500},
+    [ESPNOW_RATE_5M5] = {5500, 500},
+    [ESPNOW_RATE_11M] = {11000, 500},
+    [ESPNOW_RATE_MCS0] = {6500, 90},
+    [ESPNOW_RATE_MCS1] = {13000, 90},
+    [ESPNOW_RATE_MCS2] = {19500, 90},
+    [ESPNOW_RATE_MCS3] = {26000, 90},
+    [ESPNOW_RATE_MCS4] = {39000, 90},
+    [ESPNOW_RATE_MCS5] = {52000, 90},
+    [ESPNOW_RATE_MCS6] = {58500, 90},
+    [ESPNOW_RATE_MCS7] = {65000, 90},
+};
+
+uint32_t espnow_rate_kbps(espnow_rate_t rate)
+{
+    return espnow_rate_info[rate].kbps;
+}
+
+static uint32_t espnow_rate_airtime_us(const espnow_rate_ctrl_t *ctrl, espnow_rate_t rate)
+{
+    return espnow_rate_info[rate].overhead_us + (uint32_t)ctrl->frame_len * 8 * 1000 / espnow_rate_info[rate].kbps;
+}
+
+/* Throughput at a delivery probability of prob / 1000 */
+static uint32_t espnow_rate_throughput_at(const espnow_rate_ctrl_t *ctrl, espnow_rate_t rate, uint32_t prob)
+{
+    return prob * ctrl->frame_len * 8 / espnow_rate_airtime_us(ctrl, rate);
+}
+
+uint32_t espnow_rate_ctrl_throughput(const espnow_rate_ctrl_t *ctrl, espnow_rate_t rate)
+{
+    const espnow_rate_stats_t *stats = &ctrl->rates[rate];
+    if (!stats->sampled || stats->prob < ESPNOW_RATE_PROB_MIN)
+    {
+        return 0;
+    }
+    return espnow_rate_throughput_at(ctrl, rate, stats->prob);
+}
+
+void espnow_rate_ctrl_init(espnow_rate_ctrl_t *ctrl, uint16_t frame_len, espnow_rate_t start, uint32_t now_ms)
+{
+    memset(ctrl, 0x0, sizeof(espnow_rate_ctrl_t));
+    ctrl->frame_len = frame_len ? frame_len : 1;
+    // Unsampled, so the first update falls back to the best rate that delivered
+    ctrl->best = start;
+    ctrl->last_update = now_ms;
+}
+
+static void espnow_rate_ctrl_update(espnow_rate_ctrl_t *ctrl)
+{
+    uint32_t best_throughput = 0;
+    espnow_rate_t best = ESPNOW_RATE_1M;
+
+    for (int i = 0; i < ESPNOW_RATE_NUM; i++)
+    {
+        espnow_rate_stats_t *stats = &ctrl->rates[i];
+        if (stats->attempts)
+        {
+            uint32_t prob = (uint32_t)stats->successes * 1000 / stats->attempts;
+            stats->prob = stats->sampled ? (stats->prob * ESPNOW_RATE_EWMA_WEIGHT + prob * (100 - ESPNOW_RATE_EWMA_WEIGHT)) / 100 : prob;
+            stats->sampled = true;
+            stats->attempts = 0;
+            stats->successes = 0;
+        }
+
+        uint32_t throughput = espnow_rate_ctrl_throughput(ctrl, i);
+        if (throughput > best_throughput)
+        {
+            best_throughput = throughput;
+            best = i;
+        }
+    }
+    ctrl->best = best;
+}
+
+espnow_rate_t espnow_rate_ctrl_select(espnow_rate_ctrl_t *ctrl, uint32_t random)
+{
+    if (++ctrl->frames < ESPNOW_RATE_PROBE_INTERVAL)
+    {
+        return ctrl->best;
+    }
+    ctrl->frames = 0;
+
+    // Probe among the rates that would beat the current one at full delivery
+    uint32_t current = espnow_rate_ctrl_throughput(ctrl, ctrl->best);
+    uint8_t candidates[ESPNOW_RATE_NUM];
+    int num = 0;
+    for (int i = 0; i < ESPNOW_RATE_NUM; i++)
+    {
+        if (i != ctrl->best && espnow_rate_throughput_at(ctrl, i, 1000) > current)
+        {
+            candidates[num++] = i;
+        }
+    }
+    return num ? candidates[random % num] : ctrl->best;
+}
+
+void espnow_rate_ctrl_report(espnow_rate_ctrl_t *ctrl, espnow_rate_t rate, bool success, uint32_t now_ms)
+{
+    espnow_rate_stats_t *stats = &ctrl->rates[rate];
+
+    if (stats->attempts == UINT16_MAX)
+    {
+        stats->attempts /= 2;
+        stats->successes /= 2;
+    }
+    stats->attempts++;
+    stats->successes += success;
+
+    if (now_ms - ctrl->last_update >= ESPNOW_RATE_UPDATE_MS)
+    {
+        ctrl->last_update = now_ms;
+        espnow_rate_ctrl_update(ctrl);
+    }
+}
@@ -15,6 +15,13 @@
 #include "http_server.h"
 #include "esp_mac.h"
 #include "lwip/inet.h"
+#include "sensor_store.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "debug_stats.h"
+#include "link_table.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 static const char *TAG = "http_server";
 
@@ -26,6 +33,12 @@ SemaphoreHandle_t worker_ready_count;
 // Each worker has its own thread
 TaskHandle_t worker_handles[CONFIG_EXAMPLE_MAX_ASYNC_REQUESTS];
 
+static metrics_counter_t http_requests;
+static metrics_counter_t http_request_errors;
+static metrics_counter_t http_async_rejected;
+static metrics_histogram_t http_request_duration;
+static const uint32_t http_request_duration_bounds[] = {5, 10, 25, 50, 100, 250, 500, 1000, 2500};
+
 // queue an HTTP req to the worker queue
 esp_err_t queue_request(httpd_req_t *req, httpd_req_handler_t handler)
 {
@@ -47,10 +60,13 @@ esp_err_t queue_request(httpd_req_t *req, httpd_req_handler_t handler)
     // http error if no workers are available.
     int ticks = 0;
 
+    TRACE_INSTANT("http_queue_request", uxQueueMessagesWaiting(request_queue));
+
     // counting semaphore: if success, we know 1 or
     // more asyncReqTaskWorkers are available.
     if (xSemaphoreTake(worker_ready_count, ticks) == false)
     {
+        metrics_counter_inc(&http_async_rejected);
         ESP_LOGE(TAG, "No workers are available");
         httpd_req_async_handler_complete(copy); // cleanup
         return ESP_FAIL;
@@ -60,6 +76,7 @@ esp_err_t queue_request(httpd_req_t *req, httpd_req_handler_t handler)
     // But lets wait up to 100ms just to be safe.
     if (xQueueSend(request_queue, &async_req, pdMS_TO_TICKS(100)) == false)
     {
+        metrics_counter_inc(&http_async_rejected);
         ESP_LOGE(TAG, "worker queue is full");
         httpd_req_async_handler_complete(copy); // cleanup
         return ESP_FAIL;
@@ -176,6 +193,7 @@ void worker_task(void *p)
         {
 
             ESP_LOGI(TAG, "invoking %s", async_req.req->uri);
+            TRACE_BEGIN("http_worker");
 
             // call the handler
             async_req.handler(async_req.req);
@@ -186,6 +204,7 @@ void worker_task(void *p)
             {
                 ESP_LOGE(TAG, "failed to complete async req");
             }
+            TRACE_END("http_worker");
         }
     }
 
@@ -266,14 +285,19 @@ void start_workers(void)
 esp_err_t mesh_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "uri: /mesh");
-    uint32_t size = 0;
-    const node_info_list_t *node = esp_mesh_lite_get_nodes_list(&size);
-    for (uint32_t loop = 0; (loop < size) && (node != NULL); loop++)
+    // Sending chunks can block on the socket, so the node table is only read through a copy
+    esp_mesh_lite_node_snapshot_t *nodes = malloc(CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER * sizeof(esp_mesh_lite_node_snapshot_t));
+    if (nodes == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    uint32_t size = esp_mesh_lite_get_nodes_snapshot(nodes, CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER);
+    for (uint32_t loop = 0; loop < size; loop++)
     {
         struct in_addr ip_struct;
-        ip_struct.s_addr = node->node->ip_addr;
-        printf("%ld: %d, " MACSTR ", %s\r\n", loop + 1, node->node->level, MAC2STR(node->node->mac_addr), inet_ntoa(ip_struct));
-        node = node->next;
+        ip_struct.s_addr = nodes[loop].node.ip_addr;
+        printf("%ld: %d, " MACSTR ", %s\r\n", loop + 1, nodes[loop].node.level, MAC2STR(nodes[loop].node.mac_addr), inet_ntoa(ip_struct));
     }
 
     httpd_resp_set_type(req, "text/html");
@@ -297,41 +321,406 @@ esp_err_t mesh_handler(httpd_req_t *req)
                              "<h1>Mesh Network</h1>"
                              "<div class=\"meta\">Refresh the page (Ctrl+R) to update</div>"
                              "<table>"
-                             "<thead><tr><th>#</th><th>Level</th><th>MAC</th><th>IP</th></tr></thead>"
+                             "<thead><tr><th>#</th><th>Level</th><th>MAC</th><th>IP</th>"
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+                             "<th>Free heap</th><th>Min heap</th><th>Parent RSSI</th><th>Children</th>"
+                             "<th>Queue</th><th>Drops</th><th>Uptime (s)</th><th>Report age (s)</th>"
+#endif
+                             "</tr></thead>"
                              "<tbody>");
 
     if (size == 0)
     {
-        httpd_resp_sendstr_chunk(req, "<tr><td colspan=\"4\">No nodes</td></tr>");
+        httpd_resp_sendstr_chunk(req, "<tr><td colspan=\"12\">No nodes</td></tr>");
     }
     else
     {
-        const node_info_list_t *cur = esp_mesh_lite_get_nodes_list(&size);
-        for (uint32_t i = 0; (i < size) && (cur != NULL); i++)
+        for (uint32_t i = 0; i < size; i++)
         {
+            const esp_mesh_lite_node_snapshot_t *cur = &nodes[i];
             struct in_addr ip_struct;
-            ip_struct.s_addr = cur->node->ip_addr;
+            ip_struct.s_addr = cur->node.ip_addr;
 
             char row[192];
             int n = snprintf(row, sizeof(row),
-                             "<tr><td>%lu</td><td>%d</td><td>" MACSTR "</td><td>%s</td></tr>",
+                             "<tr><td>%lu</td><td>%d</td><td>" MACSTR "</td><td>%s</td>",
                              (unsigned long)(i + 1),
-                             cur->node->level,
-                             MAC2STR(cur->node->mac_addr),
+                             cur->node.level,
+                             MAC2STR(cur->node.mac_addr),
                              inet_ntoa(ip_struct));
             if (n > 0)
             {
                 httpd_resp_send_chunk(req, row, (size_t)n);
             }
-            cur = cur->next;
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+            const esp_mesh_lite_node_health_t *health = &cur->health;
+            if (health->update_time)
+            {
+                n = snprintf(row, sizeof(row),
+                             "<td>%" PRIu32 "</td><td>%" PRIu32 "</td><td>%d</td><td>%u</td>"
+                             "<td>%u</td><td>%" PRIu32 "</td><td>%" PRIu32 "</td><td>%" PRIu32 "</td>",
+                             health->free_heap, health->min_free_heap, health->parent_rssi, health->child_num,
+                             health->queue_depth, health->queue_drops, health->uptime,
+                             (uint32_t)(esp_timer_get_time() / 1000000) - health->update_time);
+            }
+            else
+            {
+                n = snprintf(row, sizeof(row), "<td colspan=\"8\">-</td>");
+            }
+            if (n > 0)
+            {
+                httpd_resp_send_chunk(req, row, (size_t)n);
+            }
+#endif
+            httpd_resp_sendstr_chunk(req, "</tr>");
         }
     }
+    free(nodes);
 
     httpd_resp_sendstr_chunk(req, "</tbody></table></body></html>");
     httpd_resp_send_chunk(req, NULL, 0);
     return ESP_OK;
 }
 
+#if CONFIG_SENSOR_STORE_ENABLE
+#define SENSOR_QUERY_MAX_POINTS 256
+
+esp_err_t sensors_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "uri: /sensors");
+    size_t num = sensor_store_list(NULL, 0);
+    sensor_store_series_info_t *list = calloc(num ? num : 1, sizeof(sensor_store_series_info_t));
+    if (list == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    num = MIN(sensor_store_list(list, num), num);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr_chunk(req, "[");
+    for (size_t i = 0; i < num; i++)
+    {
+        char row[160];
+        int n = snprintf(row, sizeof(row),
+                         "%s{\"mac\":\"" MACSTR "\",\"id\":%lu,\"type\":%u,\"count\":%lu,\"last_ts\":%lld,\"last\":%.2f}",
+                         i ? "," : "", MAC2STR(list[i].mac), (unsigned long)list[i].sensor_id, list[i].type,
+                         (unsigned long)list[i].count, (long long)list[i].last_ts, list[i].last_value);
+        if (n > 0)
+        {
+            httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "]");
+    httpd_resp_send_chunk(req, NULL, 0);
+    free(list);
+    return ESP_OK;
+}
+
+/*
+ * /sensors/query?mac=aa:bb:cc:dd:ee:ff&id=2[&from=ms][&to=ms][&agg=raw|summary|minute|hour][&limit=n]
+ */
+esp_err_t sensors_query_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "uri: /sensors/query");
+    char query[160] = {0};
+    char value[32];
+    unsigned int mac_int[6];
+    uint8_t mac[6];
+    uint32_t sensor_id = 0;
+    int64_t from = 0;
+    int64_t to = INT64_MAX;
+    size_t limit = SENSOR_QUERY_MAX_POINTS;
+    char agg[8] = "raw";
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK
+            || httpd_query_key_value(query, "mac", value, sizeof(value)) != ESP_OK
+            || sscanf(value, "%x:%x:%x:%x:%x:%x", &mac_int[0], &mac_int[1], &mac_int[2], &mac_int[3], &mac_int[4], &mac_int[5]) != 6
+            || httpd_query_key_value(query, "id", value, sizeof(value)) != ESP_OK)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "mac and id are required");
+        return ESP_FAIL;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        mac[i] = mac_int[i];
+    }
+    sensor_id = strtoul(value, NULL, 0);
+    if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK)
+    {
+        from = strtoll(value, NULL, 0);
+    }
+    if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK)
+    {
+        to = strtoll(value, NULL, 0);
+    }
+    if (httpd_query_key_value(query, "limit", value, sizeof(value)) == ESP_OK)
+    {
+        limit = MIN(strtoul(value, NULL, 0), SENSOR_QUERY_MAX_POINTS);
+    }
+    httpd_query_key_value(query, "agg", agg, sizeof(agg));
+
+    char row[128];
+    int n = 0;
+    httpd_resp_set_type(req, "application/json");
+
+    if (!strcmp(agg, "summary"))
+    {
+        sensor_store_bucket_t result;
+        if (sensor_store_aggregate(mac, sensor_id, from, to, &result) != ESP_OK)
+        {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such series");
+            return ESP_FAIL;
+        }
+        n = snprintf(row, sizeof(row), "{\"count\":%lu,\"min\":%.2f,\"max\":%.2f,\"avg\":%.3f}",
+                     (unsigned long)result.count, result.min, result.max, result.avg);
+        httpd_resp_send(req, row, MIN((size_t)n, sizeof(row) - 1));
+        return ESP_OK;
+    }
+
+    if (!strcmp(agg, "minute") || !strcmp(agg, "hour"))
+    {
+        sensor_store_bucket_t *buckets = calloc(limit ? limit : 1, sizeof(sensor_store_bucket_t));
+        if (buckets == NULL)
+        {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+            return ESP_FAIL;
+        }
+        size_t num = sensor_store_rollup(mac, sensor_id, !strcmp(agg, "hour") ? SENSOR_STORE_ROLLUP_HOUR : SENSOR_STORE_ROLLUP_MINUTE,
+                                         from, to, buckets, limit);
+        httpd_resp_sendstr_chunk(req, "[");
+        for (size_t i = 0; i < num; i++)
+        {
+            n = snprintf(row, sizeof(row), "%s{\"start\":%lld,\"count\":%lu,\"min\":%.2f,\"max\":%.2f,\"avg\":%.3f}",
+                         i ? "," : "", (long long)buckets[i].start, (unsigned long)buckets[i].count,
+                         buckets[i].min, buckets[i].max, buckets[i].avg);
+            httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+        }
+        httpd_resp_sendstr_chunk(req, "]");
+        httpd_resp_send_chunk(req, NULL, 0);
+        free(buckets);
+        return ESP_OK;
+    }
+
+    sensor_store_point_t *points = calloc(limit ? limit : 1, sizeof(sensor_store_point_t));
+    if (points == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    size_t num = sensor_store_query(mac, sensor_id, from, to, points, limit);
+    httpd_resp_sendstr_chunk(req, "[");
+    for (size_t i = 0; i < num; i++)
+    {
+        n = snprintf(row, sizeof(row), "%s[%lld,%.2f]", i ? "," : "", (long long)points[i].timestamp, points[i].value);
+        httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+    }
+    httpd_resp_sendstr_chunk(req, "]");
+    httpd_resp_send_chunk(req, NULL, 0);
+    free(points);
+    return ESP_OK;
+}
+#endif
+
+static esp_err_t metrics_send_chunk(void *ctx, const char *buf, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, buf, len);
+}
+
+esp_err_t metrics_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/openmetrics-text; version=1.0.0; charset=utf-8");
+    // A scrape that fails halfway ends without "# EOF", which scrapers reject
+    esp_err_t ret = metrics_scrape(metrics_send_chunk, req);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ret;
+}
+
+// Registered in place of every URI handler, the real one is passed in user_ctx
+static esp_err_t http_metrics_handler(httpd_req_t *req)
+{
+    httpd_req_handler_t handler = (httpd_req_handler_t)req->user_ctx;
+    int64_t start = esp_timer_get_time();
+
+    TRACE_BEGIN("http_handler");
+    esp_err_t ret = handler(req);
+    TRACE_END("http_handler");
+
+    metrics_counter_inc(&http_requests);
+    if (ret != ESP_OK)
+    {
+        metrics_counter_inc(&http_request_errors);
+    }
+    metrics_histogram_observe(&http_request_duration, (esp_timer_get_time() - start) / 1000);
+    return ret;
+}
+
+#if CONFIG_APP_TRACE_ENABLE
+static esp_err_t trace_send_chunk(void *ctx, const char *buf, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, buf, len);
+}
+
+esp_err_t trace_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"trace.json\"");
+    esp_err_t ret = tracing_export_chrome(trace_send_chunk, req);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ret;
+}
+
+static esp_err_t http_open_cb(httpd_handle_t hd, int sockfd)
+{
+    TRACE_INSTANT("httpd_open", sockfd);
+    return ESP_OK;
+}
+#endif
+
+#if CONFIG_APP_DEBUG_STATS_ENABLE
+static const char *task_state_names[] = {"running", "ready", "blocked", "suspended", "deleted", "invalid"};
+
+esp_err_t tasks_handler(httpd_req_t *req)
+{
+    debug_stats_info_t info;
+    debug_task_stats_t *tasks = calloc(CONFIG_APP_DEBUG_STATS_MAX_TASKS, sizeof(debug_task_stats_t));
+    if (tasks == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    size_t num = debug_stats_get_tasks(tasks, CONFIG_APP_DEBUG_STATS_MAX_TASKS, &info);
+
+    char row[160];
+    int n = snprintf(row, sizeof(row),
+                     "{\"window_ms\":%" PRIu32 ",\"collect_us\":%" PRIu32 ",\"collect_max_us\":%" PRIu32 ",\"task_num\":%" PRIu32 ",\"tasks\":[",
+                     info.window_ms, info.collect_us, info.collect_max_us, info.task_num);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+    for (size_t i = 0; i < num; i++)
+    {
+        n = snprintf(row, sizeof(row),
+                     "%s{\"name\":\"%s\",\"state\":\"%s\",\"priority\":%u,\"core\":%d,\"cpu\":%.1f,\"stack_free_min\":%" PRIu32 "}",
+                     i ? "," : "", tasks[i].name, task_state_names[MIN((size_t)tasks[i].state, sizeof(task_state_names) / sizeof(task_state_names[0]) - 1)],
+                     (unsigned int)tasks[i].priority, tasks[i].core, tasks[i].cpu, tasks[i].stack_free_min);
+        if (n > 0)
+        {
+            httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_send_chunk(req, NULL, 0);
+    free(tasks);
+    return ESP_OK;
+}
+
+esp_err_t heap_handler(httpd_req_t *req)
+{
+    static const struct
+    {
+        const char *name;
+        uint32_t caps;
+    } heap_caps[] = {
+        {"internal", MALLOC_CAP_INTERNAL},
+        {"8bit", MALLOC_CAP_8BIT},
+        {"32bit", MALLOC_CAP_32BIT},
+        {"dma", MALLOC_CAP_DMA},
+#if CONFIG_SPIRAM
+        {"spiram", MALLOC_CAP_SPIRAM},
+#endif
+    };
+    char row[224];
+    int n;
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr_chunk(req, "{\"caps\":[");
+    for (size_t i = 0; i < sizeof(heap_caps) / sizeof(heap_caps[0]); i++)
+    {
+        multi_heap_info_t heap;
+        heap_caps_get_info(&heap, heap_caps[i].caps);
+        n = snprintf(row, sizeof(row),
+                     "%s{\"caps\":\"%s\",\"free\":%u,\"allocated\":%u,\"largest_free_block\":%u,\"min_free\":%u,"
+                     "\"allocated_blocks\":%u,\"free_blocks\":%u}",
+                     i ? "," : "", heap_caps[i].name, (unsigned int)heap.total_free_bytes, (unsigned int)heap.total_allocated_bytes,
+                     (unsigned int)heap.largest_free_block, (unsigned int)heap.minimum_free_bytes,
+                     (unsigned int)heap.allocated_blocks, (unsigned int)heap.free_blocks);
+        if (n > 0)
+        {
+            httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "]");
+
+#if CONFIG_APP_DEBUG_HEAP_SAMPLING
+    debug_heap_sampling_info_t info;
+    debug_heap_hotspot_t *hotspots = calloc(CONFIG_APP_DEBUG_HEAP_HOTSPOTS, sizeof(debug_heap_hotspot_t));
+    size_t num = hotspots ? debug_stats_get_heap_hotspots(hotspots, CONFIG_APP_DEBUG_HEAP_HOTSPOTS, &info) : 0;
+
+    n = snprintf(row, sizeof(row),
+                 ",\"sampling\":{\"rate\":%" PRIu32 ",\"allocs\":%" PRIu32 ",\"sampled\":%" PRIu32 ",\"avg_cycles\":%" PRIu32 ",\"hotspots\":[",
+                 info.rate, info.allocs, info.sampled, info.avg_cycles);
+    httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+    for (size_t i = 0; i < num; i++)
+    {
+        // Bytes and count are sampled, scaled by the rate they estimate the totals
+        n = snprintf(row, sizeof(row), "%s{\"task\":\"%s\",\"count\":%" PRIu32 ",\"bytes\":%" PRIu32 ",\"pc\":[",
+                     i ? "," : "", hotspots[i].task, hotspots[i].count, hotspots[i].bytes);
+        for (int j = 0; j < DEBUG_STATS_HEAP_DEPTH && hotspots[i].pc[j] && n > 0 && n < sizeof(row); j++)
+        {
+            n += snprintf(row + n, sizeof(row) - n, "%s\"0x%08" PRIx32 "\"", j ? "," : "", hotspots[i].pc[j]);
+        }
+        if (n > 0 && n < sizeof(row))
+        {
+            n += snprintf(row + n, sizeof(row) - n, "]}");
+        }
+        if (n > 0)
+        {
+            httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    free(hotspots);
+#endif
+
+    httpd_resp_sendstr_chunk(req, "}");
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t links_handler(httpd_req_t *req)
+{
+    link_entry_t *links = calloc(CONFIG_APP_LINK_TABLE_SIZE, sizeof(link_entry_t));
+    if (links == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    size_t num = link_table_list(links, CONFIG_APP_LINK_TABLE_SIZE);
+    int64_t now = esp_timer_get_time();
+
+    char row[224];
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr_chunk(req, "{\"links\":[");
+    for (size_t i = 0; i < num; i++)
+    {
+        int n = snprintf(row, sizeof(row),
+                         "%s{\"mac\":\"" MACSTR "\",\"rssi\":%d,\"noise_floor\":%d,\"rx_rate\":%u,\"rx_frames\":%" PRIu32
+                         ",\"tx_frames\":%" PRIu32 ",\"tx_acked\":%" PRIu32 ",\"tx_success\":%.3f,\"last_heard_ms\":%" PRId64 "}",
+                         i ? "," : "", MAC2STR(links[i].mac), links[i].rssi, links[i].noise_floor, links[i].rx_rate,
+                         links[i].rx_frames, links[i].tx_frames, links[i].tx_acked, links[i].tx_success / 1000.0,
+                         links[i].last_heard ? (now - links[i].last_heard) / 1000 : -1);
+        if (n > 0)
+        {
+            httpd_resp_send_chunk(req, row, MIN((size_t)n, sizeof(row) - 1));
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_send_chunk(req, NULL, 0);
+    free(links);
+    return ESP_OK;
+}
+
 esp_err_t index_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "uri: /");
@@ -339,6 +728,18 @@ esp_err_t index_handler(httpd_req_t *req)
                               "<p>This is a simple web server running on ESP32.</p>"
                               "<ul>"
                               "<li><a href=\"/mesh\">Show Mesh Tree</a></li>"
+                              "<li><a href=\"/metrics\">Metrics</a></li>"
+                              "<li><a href=\"/links\">Link Quality</a></li>"
+#if CONFIG_APP_TRACE_ENABLE
+                              "<li><a href=\"/debug/trace\">Download Trace</a></li>"
+#endif
+#if CONFIG_APP_DEBUG_STATS_ENABLE
+                              "<li><a href=\"/debug/tasks\">Task Statistics</a></li>"
+                              "<li><a href=\"/debug/heap\">Heap Statistics</a></li>"
+#endif
+#if CONFIG_SENSOR_STORE_ENABLE
+                              "<li><a href=\"/sensors\">Show Sensor Series</a></li>"
+#endif
                               "</ul>";
     httpd_resp_sendstr(req, welcome_msg);
     return ESP_OK;
@@ -356,6 +757,10 @@ httpd_handle_t start_webserver(void)
     // get taken by the long async handlers, and your server will no
     // longer be responsive.
     config.max_open_sockets = CONFIG_EXAMPLE_MAX_ASYNC_REQUESTS + 1;
+    config.max_uri_handlers = 12;
+#if CONFIG_APP_TRACE_ENABLE
+    config.open_fn = http_open_cb;
+#endif
 
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
@@ -365,17 +770,80 @@ httpd_handle_t start_webserver(void)
         return NULL;
     }
 
+    metrics_counter_register(&http_requests, "http_requests", "HTTP requests handled");
+    metrics_counter_register(&http_request_errors, "http_request_errors", "HTTP requests whose handler failed");
+    metrics_counter_register(&http_async_rejected, "http_async_rejected", "HTTP requests rejected for lack of an async worker");
+    metrics_histogram_register(&http_request_duration, "http_request_duration_ms", "HTTP handler run time",
+                               http_request_duration_bounds, sizeof(http_request_duration_bounds) / sizeof(http_request_duration_bounds[0]));
+
     const httpd_uri_t index_uri = {
         .uri = "/",
         .method = HTTP_GET,
-        .handler = index_handler,
+        .handler = http_metrics_handler,
+        .user_ctx = index_handler,
     };
 
     const httpd_uri_t mesh_uri = {
         .uri = "/mesh",
         .method = HTTP_GET,
-        .handler = mesh_handler,
+        .handler = http_metrics_handler,
+        .user_ctx = mesh_handler,
+    };
+
+    const httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = http_metrics_handler,
+        .user_ctx = metrics_handler,
+    };
+
+    const httpd_uri_t links_uri = {
+        .uri = "/links",
+        .method = HTTP_GET,
+        .handler = http_metrics_handler,
+        .user_ctx = links_handler,
+    };
+
+#if CONFIG_APP_TRACE_ENABLE
+    const httpd_uri_t trace_uri = {
+        .uri = "/debug/trace",
+        .method = HTTP_GET,
+        .handler = http_metrics_handler,
+        .user_ctx = trace_handler,
+    };
+#endif
+
+#if CONFIG_APP_DEBUG_STATS_ENABLE
+    const httpd_uri_t tasks_uri = {
+        .uri = "/debug/tasks",
+        .method = HTTP_GET,
+        .handler = http_metrics_handler,
+        .user_ctx = tasks_handler,
+    };
+
+    const httpd_uri_t heap_uri = {
+        .uri = "/debug/heap",
+        .method = HTTP_GET,
+        .handler = http_metrics_handler,
+        .user_ctx = heap_handler,
+    };
+#endif
+
+#if CONFIG_SENSOR_STORE_ENABLE
+    const httpd_uri_t sensors_uri = {
+        .uri = "/sensors",
+        .method = HTTP_GET,
+        .handler = http_metrics_handler,
+        .user_ctx = sensors_handler,
+    };
+
+    const httpd_uri_t sensors_query_uri = {
+        .uri = "/sensors/query",
+        .method = HTTP_GET,
+        .handler = http_metrics_handler,
+        .user_ctx = sensors_query_handler,
     };
+#endif
 
     // const httpd_uri_t long_uri = {
     //     .uri = "/long",
@@ -393,6 +861,19 @@ httpd_handle_t start_webserver(void)
     ESP_LOGI(TAG, "Registering URI handlers");
     httpd_register_uri_handler(server, &index_uri);
     httpd_register_uri_handler(server, &mesh_uri);
+    httpd_register_uri_handler(server, &metrics_uri);
+    httpd_register_uri_handler(server, &links_uri);
+#if CONFIG_APP_TRACE_ENABLE
+    httpd_register_uri_handler(server, &trace_uri);
+#endif
+#if CONFIG_APP_DEBUG_STATS_ENABLE
+    httpd_register_uri_handler(server, &tasks_uri);
+    httpd_register_uri_handler(server, &heap_uri);
+#endif
+#if CONFIG_SENSOR_STORE_ENABLE
+    httpd_register_uri_handler(server, &sensors_uri);
+    httpd_register_uri_handler(server, &sensors_query_uri);
+#endif
     // httpd_register_uri_handler(server, &long_uri);
     // httpd_register_uri_handler(server, &quick_uri);
 
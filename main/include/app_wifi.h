@@ -28,11 +28,8 @@ void wifi_task_init(void);
 void wifi_task_main(void *);
 
 #if CONFIG_ENABLE_WIFI_STA
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
 extern bool sta_got_ip;
 static int s_retry_num = 0;
-static EventGroupHandle_t s_wifi_event_group;
 void wifi_init_sta(void);
 #if CONFIG_ENABLE_ARP_SCAN
 typedef struct arp_scan_result
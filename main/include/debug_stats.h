@@ -0,0 +1,68 @@
+#ifndef __DEBUG_STATS_H__
+#define __DEBUG_STATS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+/*
+ * Task and heap profiling for /debug/tasks and /debug/heap.
+ *
+ * A timer samples the FreeRTOS run time counters of all tasks every CONFIG_APP_DEBUG_STATS_PERIOD_MS
+ * and keeps the last CONFIG_APP_DEBUG_STATS_WINDOW samples, CPU shares are computed over that window.
+ * With CONFIG_APP_DEBUG_HEAP_SAMPLING, one in CONFIG_APP_DEBUG_HEAP_SAMPLE_RATE allocations is
+ * attributed to its task and call stack in a fixed table of the heaviest allocation sites.
+ */
+
+#if CONFIG_APP_DEBUG_HEAP_SAMPLING
+#define DEBUG_STATS_HEAP_DEPTH CONFIG_APP_DEBUG_HEAP_SAMPLE_DEPTH
+#else
+#define DEBUG_STATS_HEAP_DEPTH 1
+#endif
+
+typedef struct
+{
+    char name[configMAX_TASK_NAME_LEN];
+    eTaskState state;
+    UBaseType_t priority;
+    int core;                /* -1 when not pinned */
+    uint32_t stack_free_min; /* Bytes */
+    float cpu;               /* Percent of one core over the window */
+} debug_task_stats_t;
+
+typedef struct
+{
+    uint32_t window_ms;
+    uint32_t collect_us;     /* Cost of the last sample */
+    uint32_t collect_max_us; /* Worst sample since boot */
+    uint32_t task_num;       /* Tasks running, more than returned when the table is full */
+} debug_stats_info_t;
+
+typedef struct
+{
+    char task[configMAX_TASK_NAME_LEN];
+    uint32_t pc[DEBUG_STATS_HEAP_DEPTH]; /* Innermost first, 0 past the end of the stack */
+    uint32_t count;
+    uint32_t bytes;
+} debug_heap_hotspot_t;
+
+typedef struct
+{
+    uint32_t rate;
+    uint32_t allocs;      /* Allocations seen */
+    uint32_t sampled;     /* Allocations attributed */
+    uint32_t avg_cycles;  /* Cost of attributing one allocation */
+} debug_heap_sampling_info_t;
+
+esp_err_t debug_stats_init(void);
+
+/* Returns the number of tasks written, which are sorted by CPU share */
+size_t debug_stats_get_tasks(debug_task_stats_t *tasks, size_t max, debug_stats_info_t *info);
+
+/* Returns the number of hot spots written, sorted by sampled bytes; 0 without CONFIG_APP_DEBUG_HEAP_SAMPLING */
+size_t debug_stats_get_heap_hotspots(debug_heap_hotspot_t *hotspots, size_t max, debug_heap_sampling_info_t *info);
+
+#endif
@@ -12,10 +12,11 @@ typedef struct esp_now_msg_send
     uint32_t max_retry;
     uint32_t msg_len;
     void *sent_msg;
+    uint8_t dest[ESP_NOW_ETH_ALEN]; // Broadcast address unless sent to the sink
+    uint32_t wait_ticks;            // Send timer periods waited for the send callback of a unicast frame
 } esp_now_msg_send_t;
 
 #define ESPNOW_PAYLOAD_HEAD_LEN (5)
-#define ESPNOW_QUEUE_SIZE (50)
 
 typedef struct
 {
@@ -26,5 +27,12 @@ typedef struct
 
 esp_err_t app_espnow_init(void);
 esp_err_t esp_now_send_broadcast(const uint8_t *, size_t, bool);
+// Unicast to the sink advertised nearby, broadcast while no sink is known
+esp_err_t esp_now_send_to_sink(const uint8_t *, size_t, bool);
+// Largest payload esp_now_send_to_sink() delivers to the current destination
+size_t esp_now_sink_payload_max(void);
+// Broadcast a parent offer, see parent_select.h
+esp_err_t esp_now_send_parent_offer(const uint8_t *, size_t);
+void espnow_get_queue_stats(uint32_t *depth, uint32_t *drops);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef __ESPNOW_INGEST_H__
+#define __ESPNOW_INGEST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_now.h"
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Hand-off of received ESP-NOW frames from the Wi-Fi task to the espnow task.
+ *
+ * espnow_ingest_push() runs in the receive callback and never waits: when a lane is full a frame
+ * is shed according to CONFIG_APP_ESPNOW_INGEST_POLICY and the drop is counted against its source.
+ * Lanes have their own depth and the consumer always serves the control lane first, so a burst of
+ * sensor data can neither delay nor push out control frames. Crossing the high watermark of a lane,
+ * and draining back below half of it, is posted to the default event loop.
+ */
+
+ESP_EVENT_DECLARE_BASE(ESPNOW_INGEST_EVENT);
+
+typedef enum
+{
+    ESPNOW_INGEST_EVENT_HIGH_WATERMARK, // espnow_ingest_event_t
+    ESPNOW_INGEST_EVENT_DRAINED,        // espnow_ingest_event_t
+} espnow_ingest_event_id_t;
+
+typedef enum
+{
+    ESPNOW_INGEST_LANE_CONTROL = 0, // Served first
+    ESPNOW_INGEST_LANE_DATA,
+    ESPNOW_INGEST_LANE_MAX,
+} espnow_ingest_lane_t;
+
+typedef struct
+{
+    espnow_ingest_lane_t lane;
+    uint32_t depth;
+} espnow_ingest_event_t;
+
+typedef struct
+{
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t type;   // ESP-NOW data type of the frame
+    int8_t rssi;
+    uint16_t len;
+    uint8_t *data;  // Owned by the caller of espnow_ingest_pop()
+} espnow_ingest_item_t;
+
+esp_err_t espnow_ingest_init(void);
+
+/**
+ * @brief Queue a copy of a received frame, never blocks.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the frame was shed
+ */
+esp_err_t espnow_ingest_push(espnow_ingest_lane_t lane, const esp_now_recv_info_t *recv_info, uint8_t type,
+                             const uint8_t *data, int len);
+
+/* Take the oldest frame of the highest priority lane, waiting up to wait ticks */
+bool espnow_ingest_pop(espnow_ingest_item_t *item, TickType_t wait);
+
+/* Frames waiting in all lanes and frames shed since boot */
+void espnow_ingest_get_stats(uint32_t *depth, uint32_t *drops);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __ESPNOW_RATE_H__
+#define __ESPNOW_RATE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Per-peer PHY rate control for ESP-NOW unicast, after Minstrel.
+ *
+ * The success of the frames sent at each rate is folded into an EWMA of the delivery probability
+ * every ESPNOW_RATE_UPDATE_MS, and frames go out at the rate with the highest expected throughput
+ * (probability x frame size / airtime). One frame in ESPNOW_RATE_PROBE_INTERVAL probes a rate that
+ * would beat the current one if its probability were high enough, so links move up when they get
+ * better; the EWMA moves them down when they get worse.
+ *
+ * Plain C without ESP-IDF dependencies, the caller maps rate indexes to wifi_phy_rate_t and serializes
+ * access to a controller.
+ */
+
+#define ESPNOW_RATE_NUM 12
+#define ESPNOW_RATE_UPDATE_MS 100
+#define ESPNOW_RATE_PROBE_INTERVAL 10
+#define ESPNOW_RATE_EWMA_WEIGHT 75 /* Percent of the old probability kept on update */
+
+/* Rate indexes, 802.11b long preamble then HT20 long GI */
+typedef enum
+{
+    ESPNOW_RATE_1M = 0,
+    ESPNOW_RATE_2M,
+    ESPNOW_RATE_5M5,
+    ESPNOW_RATE_11M,
+    ESPNOW_RATE_MCS0,
+    ESPNOW_RATE_MCS1,
+    ESPNOW_RATE_MCS2,
+    ESPNOW_RATE_MCS3,
+    ESPNOW_RATE_MCS4,
+    ESPNOW_RATE_MCS5,
+    ESPNOW_RATE_MCS6,
+    ESPNOW_RATE_MCS7,
+} espnow_rate_t;
+
+typedef struct
+{
+    uint16_t attempts;  /* Since the last update */
+    uint16_t successes; /* Since the last update */
+    uint16_t prob;      /* EWMA of the delivery probability, 0..1000 */
+    bool sampled;       /* prob is based on at least one frame */
+} espnow_rate_stats_t;
+
+typedef struct
+{
+    espnow_rate_stats_t rates[ESPNOW_RATE_NUM];
+    uint16_t frame_len;    /* Typical frame size, in bytes */
+    uint8_t best;          /* Highest expected throughput */
+    uint8_t frames;        /* Since the last probe */
+    uint32_t last_update;  /* ms */
+} espnow_rate_ctrl_t;
+
+/* start is the first rate used, e.g. guessed from the RSSI, probing corrects a bad guess */
+void espnow_rate_ctrl_init(espnow_rate_ctrl_t *ctrl, uint16_t frame_len, espnow_rate_t start, uint32_t now_ms);
+
+/* Rate for the next frame, random is any random number */
+espnow_rate_t espnow_rate_ctrl_select(espnow_rate_ctrl_t *ctrl, uint32_t random);
+
+/* Outcome of a frame sent at rate, after the MAC layer retries */
+void espnow_rate_ctrl_report(espnow_rate_ctrl_t *ctrl, espnow_rate_t rate, bool success, uint32_t now_ms);
+
+/* Expected throughput of a rate in kbit/s, from its current probability */
+uint32_t espnow_rate_ctrl_throughput(const espnow_rate_ctrl_t *ctrl, espnow_rate_t rate);
+
+/* Nominal bit rate in kbit/s */
+uint32_t espnow_rate_kbps(espnow_rate_t rate);
+
+#endif
@@ -23,6 +23,13 @@ void start_workers(void);
 esp_err_t long_handler(httpd_req_t *);
 esp_err_t quick_handler(httpd_req_t *);
 esp_err_t index_handler(httpd_req_t *);
+esp_err_t metrics_handler(httpd_req_t *);
+esp_err_t links_handler(httpd_req_t *);
+esp_err_t trace_handler(httpd_req_t *);
+esp_err_t tasks_handler(httpd_req_t *);
+esp_err_t heap_handler(httpd_req_t *);
+esp_err_t sensors_handler(httpd_req_t *);
+esp_err_t sensors_query_handler(httpd_req_t *);
 httpd_handle_t start_webserver(void);
 
 esp_err_t stop_webserver(httpd_handle_t);
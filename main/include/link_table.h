@@ -0,0 +1,50 @@
+#ifndef __LINK_TABLE_H__
+#define __LINK_TABLE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_wifi.h"
+#include "esp_now.h"
+
+/*
+ * Quality of the links to the neighbours, keyed by MAC address.
+ *
+ * Filled passively: every received ESP-NOW frame updates the RSSI and noise floor averages and the
+ * rate of its sender, every unicast send callback the success ratio of its destination, and the
+ * periodic system information adds the RSSI of the parent and of the softAP stations. The table is
+ * a fixed array with a short probe sequence per MAC, so an update is O(1) and never allocates; when
+ * all slots of the sequence are taken, the one heard from the longest ago is reused.
+ */
+
+#define LINK_TABLE_EWMA_SHIFT 3 /* Averages move by 1/8 of the difference per sample */
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int8_t rssi;          // Average, dBm
+    int8_t noise_floor;   // Average, dBm, 0 if not reported
+    uint8_t rx_rate;      // rx_ctrl rate of the last frame
+    uint32_t rx_frames;
+    uint32_t tx_frames;   // Unicast frames sent
+    uint32_t tx_acked;
+    uint16_t tx_success;  // Average send success ratio, 0..1000
+    int64_t last_heard;   // esp_timer_get_time() of the last frame or sample
+} link_entry_t;
+
+/* Received frame, from the receive callback */
+void link_table_rx(const uint8_t *mac, const wifi_pkt_rx_ctrl_t *rx_ctrl);
+
+/* RSSI reported by the Wi-Fi driver for an associated parent or station */
+void link_table_rssi(const uint8_t *mac, int8_t rssi);
+
+/* Outcome of a unicast frame, from the send callback */
+void link_table_tx(const uint8_t *mac, bool success);
+
+/* Copy of the entry of mac, false if it is not in the table */
+bool link_table_get(const uint8_t *mac, link_entry_t *entry);
+
+/* Copies up to max entries in table order, returns the number copied */
+size_t link_table_list(link_entry_t *entries, size_t max);
+
+#endif
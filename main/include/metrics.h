@@ -0,0 +1,132 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+/*
+ * Metrics registry, exported in the OpenMetrics text format on /metrics.
+ *
+ * Metrics are statically allocated by the module that updates them and registered once
+ * at init. Updates are lock-free: counters and histograms keep one 32 bit slot per core
+ * that is only summed up at scrape time, so they wrap around like any 32 bit counter.
+ * Updating a metric that is not registered (yet) is valid, it is just not exported.
+ */
+
+#define METRICS_HISTOGRAM_MAX_BUCKETS 12
+
+typedef enum
+{
+    METRICS_TYPE_COUNTER = 0,
+    METRICS_TYPE_GAUGE,
+    METRICS_TYPE_HISTOGRAM,
+} metrics_type_t;
+
+typedef struct
+{
+    const char *name;
+    const char *help;
+    metrics_type_t type;
+} metrics_desc_t;
+
+typedef struct
+{
+    metrics_desc_t desc;
+    _Atomic uint32_t value[portNUM_PROCESSORS];
+} metrics_counter_t;
+
+/* Reads the current value of a gauge at scrape time */
+typedef int32_t (*metrics_gauge_read_t)(void *arg);
+
+typedef struct
+{
+    metrics_desc_t desc;
+    _Atomic int32_t value;
+    metrics_gauge_read_t read;
+    void *arg;
+} metrics_gauge_t;
+
+typedef struct
+{
+    metrics_desc_t desc;
+    const uint32_t *bounds; /* Ascending upper bounds, the +Inf bucket is implicit */
+    uint8_t bound_num;
+    _Atomic uint32_t bucket[portNUM_PROCESSORS][METRICS_HISTOGRAM_MAX_BUCKETS + 1];
+    _Atomic uint32_t sum[portNUM_PROCESSORS];
+} metrics_histogram_t;
+
+/* Scrape output, passed to collectors to append their own metric families */
+typedef struct metrics_writer metrics_writer_t;
+
+/* Sends a chunk of the scrape */
+typedef esp_err_t (*metrics_flush_t)(void *ctx, const char *buf, size_t len);
+
+/* Renders metrics that are not in the registry, e.g. one sample per mesh node, at scrape time */
+typedef void (*metrics_collect_t)(metrics_writer_t *writer, void *arg);
+
+esp_err_t metrics_init(void);
+
+/* Registering a metric again is a no-op */
+esp_err_t metrics_counter_register(metrics_counter_t *counter, const char *name, const char *help);
+esp_err_t metrics_gauge_register(metrics_gauge_t *gauge, const char *name, const char *help,
+                                 metrics_gauge_read_t read, void *arg);
+esp_err_t metrics_histogram_register(metrics_histogram_t *histogram, const char *name, const char *help,
+                                     const uint32_t *bounds, size_t bound_num);
+esp_err_t metrics_collector_register(metrics_collect_t collect, void *arg);
+
+/* Append to the scrape from a collector, a single line must fit into CONFIG_METRICS_RENDER_BUF_SIZE */
+void metrics_printf(metrics_writer_t *writer, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static inline void metrics_counter_add(metrics_counter_t *counter, uint32_t n)
+{
+    atomic_fetch_add_explicit(&counter->value[xPortGetCoreID()], n, memory_order_relaxed);
+}
+
+static inline void metrics_counter_inc(metrics_counter_t *counter)
+{
+    metrics_counter_add(counter, 1);
+}
+
+static inline uint64_t metrics_counter_get(const metrics_counter_t *counter)
+{
+    uint64_t value = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        value += atomic_load_explicit(&counter->value[core], memory_order_relaxed);
+    }
+    return value;
+}
+
+static inline void metrics_gauge_set(metrics_gauge_t *gauge, int32_t value)
+{
+    atomic_store_explicit(&gauge->value, value, memory_order_relaxed);
+}
+
+static inline void metrics_gauge_add(metrics_gauge_t *gauge, int32_t n)
+{
+    atomic_fetch_add_explicit(&gauge->value, n, memory_order_relaxed);
+}
+
+static inline void metrics_histogram_observe(metrics_histogram_t *histogram, uint32_t value)
+{
+    int core = xPortGetCoreID();
+    uint8_t i = 0;
+    while (i < histogram->bound_num && value > histogram->bounds[i])
+    {
+        i++;
+    }
+    atomic_fetch_add_explicit(&histogram->bucket[core][i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum[core], value, memory_order_relaxed);
+}
+
+/*
+ * Render all registered metrics and collectors through the buffer preallocated by metrics_init(),
+ * calling flush each time it is full. Scrapes are serialized.
+ */
+esp_err_t metrics_scrape(metrics_flush_t flush, void *ctx);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __PARENT_SELECT_H__
+#define __PARENT_SELECT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/*
+ * Parent selection by expected transmission count (ETX) instead of static RSSI thresholds.
+ *
+ * Every mesh node broadcasts a parent offer each CONFIG_APP_PARENT_OFFER_INTERVAL_MS with its
+ * level, softAP, number of stations, receive queue load and its own cost to the root. A node
+ * tracks the offers it hears and prices every candidate parent as
+ *
+ *     path cost of the candidate + link ETX + hop cost + child cost * stations + queue cost * load
+ *
+ * in ETX x 100 units. The link ETX is 1 / (forward * reverse delivery ratio): the forward ratio is
+ * learned from gaps in the offer sequence numbers, seeded from the RSSI, and the reverse one is the
+ * unicast send success from the link table once enough frames were sent to the candidate.
+ *
+ * Only candidates at a lower level than this node are eligible, so a node never picks one of its
+ * descendants. A switch needs a candidate cheaper than the current parent by the switch margin for
+ * several offer intervals in a row, and the current parent to have been kept for a minimum time;
+ * it is steered through the BSSID whitelist of mesh-lite, pinned to the new parent until the
+ * station associates or the pin times out.
+ */
+
+#define PARENT_COST_UNIT 100 /* Cost of one transmission */
+#define PARENT_COST_MAX UINT16_MAX
+
+typedef struct
+{
+    uint16_t seq;
+    uint8_t level;
+    uint8_t child_num;
+    uint8_t max_child;   // Stations the softAP accepts
+    uint8_t queue_load;  // Receive queue depth, percent
+    uint16_t path_cost;  // Cost of this node to the root, 0 on the root
+    uint8_t bssid[ESP_NOW_ETH_ALEN];
+    uint8_t ssid_len;
+    char ssid[32];
+} __attribute__((packed)) parent_offer_t;
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];   // Station MAC, source of the offers
+    uint8_t bssid[ESP_NOW_ETH_ALEN];
+    uint8_t level;
+    uint8_t child_num;
+    uint8_t queue_load;
+    uint16_t path_cost;
+    uint16_t delivery;  // Average offer delivery ratio, 0..1000
+    uint32_t cost;      // Cost through this candidate, PARENT_COST_MAX if it is not eligible
+    bool current;
+} parent_candidate_t;
+
+esp_err_t parent_select_init(void);
+
+/* Offer received from mac, from the espnow task */
+void parent_select_offer_rx(const uint8_t *mac, int8_t rssi, const uint8_t *data, size_t len);
+
+/* Copies up to max candidates with their current cost, returns the number copied */
+size_t parent_select_list(parent_candidate_t *candidates, size_t max);
+
+#endif
@@ -9,6 +9,9 @@
 #define SENSOR_MAIN_TASK_STACK_SIZE 3 * 1024
 #define SENSOR_MAIN_TASK_PRIORITY 5
 
+#define SENSOR_SCHED_TASK_STACK_SIZE 3 * 1024
+#define SENSOR_SCHED_TASK_PRIORITY 6
+
 
 typedef uint8_t sensor_type_t;
 enum
@@ -32,10 +35,16 @@ typedef struct
     float value;
 } humidity_sensor_data_t;
 
+typedef struct
+{
+    float value;
+} generic_sensor_data_t;
+
 typedef union
 {
     temperature_sensor_data_t temperature;
     humidity_sensor_data_t humidity;
+    generic_sensor_data_t generic;
 } sensor_data_u;
 
 typedef struct
@@ -46,5 +55,69 @@ typedef struct
     sensor_data_u data;
 } sensor_packet_t;
 
+/**
+ * @brief Report-by-exception policy of a sensor, evaluated on every sample before it is queued for sending.
+ *
+ * A sample is sent if one of the enabled triggers fires and min_interval_ms has passed since
+ * the last sent sample. With every trigger disabled (all zero), every sample is sent.
+ */
+typedef struct
+{
+    float deadband_abs;         // Send when the value moved more than this from the last sent value, 0 to disable
+    float deadband_rel;         // Same, as a fraction of the last sent value, 0 to disable
+    float rate_of_change;       // Send when the value changes faster than this per second, 0 to disable
+    uint32_t min_interval_ms;   // Never send more often than this
+    uint32_t max_interval_ms;   // Heartbeat: always send after this long, 0 to disable
+} sensor_report_policy_t;
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t suppressed;
+    uint32_t dropped;           // Due to be sent, but the sample ring was full
+} sensor_report_stats_t;
+
+/**
+ * @brief Sensor driver, shared by every sensor instance of the same kind.
+ *
+ * `init` is called once when the sensor is registered, `sample` on every period
+ * from the sensor scheduler task, so it must not block for long.
+ */
+typedef struct
+{
+    const char *name;
+    sensor_type_t type;
+    uint32_t period_ms;                             // Default sampling period
+    esp_err_t (*init)(void *ctx);                   // Optional
+    esp_err_t (*sample)(void *ctx, float *value);
+    sensor_report_policy_t policy;                  // Default report policy
+} sensor_driver_t;
+
+/**
+ * @brief Register a sensor and start sampling it on its own period.
+ *
+ * @param driver     Driver of the sensor, must stay valid while registered
+ * @param ctx        Driver argument, passed to init and sample
+ * @param sensor_id  ID reported with every reading
+ * @param period_ms  Sampling period, 0 to use the driver default
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM if the registry is full, or the error of driver->init
+ */
+esp_err_t sensor_register(const sensor_driver_t *driver, void *ctx, uint32_t sensor_id, uint32_t period_ms);
+
+/**
+ * @brief Replace the report policy of a registered sensor.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or ESP_ERR_NOT_FOUND if no sensor has this ID
+ */
+esp_err_t sensor_set_report_policy(uint32_t sensor_id, const sensor_report_policy_t *policy);
+
+/**
+ * @brief Get the number of sent, suppressed and dropped samples of a registered sensor.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or ESP_ERR_NOT_FOUND if no sensor has this ID
+ */
+esp_err_t sensor_get_report_stats(uint32_t sensor_id, sensor_report_stats_t *stats);
+
 esp_err_t init_sensor_read_task(void);
-#endif
\ No newline at end of file
+#endif
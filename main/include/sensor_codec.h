@@ -0,0 +1,92 @@
+#ifndef __SENSOR_CODEC_H__
+#define __SENSOR_CODEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sensor.h"
+
+#define SENSOR_CODEC_VERSION 1
+
+/*
+ * Readings are grouped per sensor into series. Timestamps are sent in milliseconds as
+ * delta-of-delta, values with the codec picked for the sensor type.
+ */
+typedef enum
+{
+    SENSOR_CODEC_QDELTA = 0, // Quantized to 0.01, zigzag varint delta. For slow physical quantities
+    SENSOR_CODEC_GORILLA,    // Lossless XOR of consecutive floats
+} sensor_codec_t;
+
+// Codecs this firmware decodes, advertised to ESP-NOW peers
+#define SENSOR_CODEC_SUPPORTED ((1 << SENSOR_CODEC_QDELTA) | (1 << SENSOR_CODEC_GORILLA))
+
+typedef void (*sensor_codec_cb_t)(const sensor_packet_t *packet, void *arg);
+
+/* Return true to stop decoding */
+typedef bool (*sensor_codec_point_cb_t)(int64_t timestamp_ms, float value, void *arg);
+
+typedef struct
+{
+    int64_t prev_ts;
+    int64_t prev_delta;
+    int32_t prev_q;
+    uint32_t prev_bits;
+    uint8_t leading;
+    uint8_t trailing;
+} sensor_codec_state_t;
+
+/*
+ * A single series that can be appended to reading by reading, e.g. a storage chunk.
+ * Same bit stream as a series in a frame, without the series header.
+ */
+typedef struct
+{
+    sensor_codec_t codec;
+    uint16_t count;
+    uint16_t bits;              // Bits used in the buffer
+    sensor_codec_state_t state;
+} sensor_codec_series_t;
+
+sensor_codec_t sensor_codec_select(sensor_type_t type);
+
+/**
+ * @brief Encode readings into one frame.
+ *
+ * Readings that fit are moved to the front of packets, keeping per-sensor order,
+ * and the rest is left behind them for the next frame.
+ *
+ * @param packets  Readings to encode, reordered in place
+ * @param count    In: number of readings, out: number of readings encoded
+ * @param buf      Frame buffer
+ * @param buf_len  Size of buf
+ *
+ * @return Length of the frame, 0 if nothing fits
+ */
+size_t sensor_codec_encode(sensor_packet_t *packets, size_t *count, uint8_t *buf, size_t buf_len);
+
+/**
+ * @brief Decode a frame, calling cb for every reading.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED on an unknown version, ESP_ERR_INVALID_SIZE on a truncated frame
+ */
+esp_err_t sensor_codec_decode(const uint8_t *buf, size_t len, sensor_codec_cb_t cb, void *arg);
+
+void sensor_codec_series_init(sensor_codec_series_t *series, sensor_codec_t codec);
+
+/**
+ * @brief Append a reading to a series stored in buf.
+ *
+ * @return false if the reading does not fit, the series is left unchanged
+ */
+bool sensor_codec_series_append(sensor_codec_series_t *series, uint8_t *buf, size_t buf_len, int64_t timestamp_ms, float value);
+
+/**
+ * @brief Decode count readings of a series stored in buf, oldest first.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED on an unknown codec, ESP_ERR_INVALID_SIZE on a truncated series
+ */
+esp_err_t sensor_codec_series_decode(sensor_codec_t codec, uint16_t count, const uint8_t *buf, size_t buf_len,
+                                     sensor_codec_point_cb_t cb, void *arg);
+
+#endif
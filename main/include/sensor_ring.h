@@ -0,0 +1,64 @@
+#ifndef __SENSOR_RING_H__
+#define __SENSOR_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "sensor.h"
+
+/*
+ * Fixed-size lock-free ring of sensor readings with a single producer (the sensor
+ * scheduler task) and a single consumer (the transmit batcher). Only the producer
+ * writes head and only the consumer writes tail, so no lock is needed.
+ */
+
+#define SENSOR_RING_SIZE CONFIG_SENSOR_RING_SIZE
+#define SENSOR_RING_MASK (SENSOR_RING_SIZE - 1)
+
+_Static_assert((SENSOR_RING_SIZE & SENSOR_RING_MASK) == 0, "CONFIG_SENSOR_RING_SIZE must be a power of two");
+
+typedef struct
+{
+    sensor_packet_t buf[SENSOR_RING_SIZE];
+    atomic_uint_fast32_t head;
+    atomic_uint_fast32_t tail;
+    uint32_t dropped; // Written by the producer only
+} sensor_ring_t;
+
+static inline uint32_t sensor_ring_count(sensor_ring_t *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+static inline bool sensor_ring_push(sensor_ring_t *ring, const sensor_packet_t *packet)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail == SENSOR_RING_SIZE)
+    {
+        ring->dropped++;
+        return false;
+    }
+
+    ring->buf[head & SENSOR_RING_MASK] = *packet;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+static inline bool sensor_ring_pop(sensor_ring_t *ring, sensor_packet_t *packet)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    *packet = ring->buf[tail & SENSOR_RING_MASK];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef __SENSOR_STORE_H__
+#define __SENSOR_STORE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sensor.h"
+
+/*
+ * In-RAM time-series store of the readings received over ESP-NOW, one series per
+ * (source MAC, sensor ID). Timestamps are in milliseconds, in mesh time when
+ * CONFIG_MESH_LITE_TIME_SYNC_ENABLE is set and in the time base of the sender otherwise.
+ */
+
+typedef enum
+{
+    SENSOR_STORE_ROLLUP_MINUTE = 0,
+    SENSOR_STORE_ROLLUP_HOUR,
+} sensor_store_rollup_t;
+
+typedef struct
+{
+    uint8_t mac[6];
+    uint32_t sensor_id;
+    sensor_type_t type;
+    uint32_t count;         // Readings received since boot
+    int64_t last_ts;
+    float last_value;
+} sensor_store_series_info_t;
+
+typedef struct
+{
+    int64_t timestamp;
+    float value;
+} sensor_store_point_t;
+
+typedef struct
+{
+    int64_t start;          // Start of the bucket, or of the range for sensor_store_aggregate()
+    uint32_t count;
+    float min;
+    float max;
+    float avg;
+} sensor_store_bucket_t;
+
+esp_err_t sensor_store_init(void);
+
+/**
+ * @brief Add a reading received from mac. Creates the series on first use.
+ */
+esp_err_t sensor_store_add(const uint8_t mac[6], const sensor_packet_t *packet);
+
+/**
+ * @brief List the stored series.
+ *
+ * @return Number of series, which may be larger than max_num
+ */
+size_t sensor_store_list(sensor_store_series_info_t *list, size_t max_num);
+
+/**
+ * @brief Get the raw readings of a series in [from, to], oldest first, including those spilled to flash.
+ *
+ * @return Number of points written to points
+ */
+size_t sensor_store_query(const uint8_t mac[6], uint32_t sensor_id, int64_t from, int64_t to,
+                          sensor_store_point_t *points, size_t max_num);
+
+/**
+ * @brief Get min/max/avg over the raw readings of a series in [from, to].
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if the series does not exist
+ */
+esp_err_t sensor_store_aggregate(const uint8_t mac[6], uint32_t sensor_id, int64_t from, int64_t to,
+                                 sensor_store_bucket_t *result);
+
+/**
+ * @brief Get the 1 minute or 1 hour rollup buckets of a series in [from, to], oldest first.
+ *
+ * @return Number of buckets written to buckets
+ */
+size_t sensor_store_rollup(const uint8_t mac[6], uint32_t sensor_id, sensor_store_rollup_t rollup,
+                           int64_t from, int64_t to, sensor_store_bucket_t *buckets, size_t max_num);
+
+#endif
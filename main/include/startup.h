@@ -0,0 +1,58 @@
+#ifndef __STARTUP_H__
+#define __STARTUP_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/*
+ * Startup orchestration.
+ *
+ * Every subsystem is a stage with a set of prerequisite stages. startup_run() starts each stage as
+ * soon as its prerequisites are ready, so nothing waits for a slow event (e.g. the station getting
+ * an IP) unless it actually depends on it. A stage without a start function is signaled ready by the
+ * subsystem itself with startup_signal(). The time every stage got ready is kept for diagnostics.
+ */
+
+/* Stages ready at the same time start in this order, the path to the first sensor frame goes first */
+typedef enum
+{
+    STARTUP_STAGE_NVS = 0,
+    STARTUP_STAGE_NETIF,
+    STARTUP_STAGE_MESH,
+    STARTUP_STAGE_WIFI_STA,  /* Station got an IP, signaled by app_wifi */
+    STARTUP_STAGE_STORE,
+    STARTUP_STAGE_ESPNOW,
+    STARTUP_STAGE_PARENT,
+    STARTUP_STAGE_SENSORS,
+    STARTUP_STAGE_SENSOR_TX, /* First sensor frame sent, signaled by sensor */
+    STARTUP_STAGE_HTTPD,
+    STARTUP_STAGE_NIMBLE,
+    STARTUP_STAGE_MAX,
+} startup_stage_t;
+
+#define STARTUP_BIT(stage) ((EventBits_t)1 << (stage))
+
+typedef esp_err_t (*startup_fn_t)(void);
+
+typedef struct
+{
+    const char *name;
+    EventBits_t deps;   /* STARTUP_BIT() of the prerequisite stages */
+    startup_fn_t start; /* NULL when signaled by the subsystem */
+} startup_stage_desc_t;
+
+/*
+ * Run the stages, indexed by startup_stage_t, until every stage with a start function has run.
+ * Stages whose start function fails are not marked ready, and neither are the stages that depend on them.
+ */
+esp_err_t startup_run(const startup_stage_desc_t stages[STARTUP_STAGE_MAX]);
+
+/* Mark a stage ready, only the first call of a stage is recorded */
+void startup_signal(startup_stage_t stage);
+
+/* Microseconds since boot the stage got ready, -1 if it is not */
+int64_t startup_ready_time(startup_stage_t stage);
+
+#endif
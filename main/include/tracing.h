@@ -0,0 +1,58 @@
+#ifndef __TRACING_H__
+#define __TRACING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*
+ * Hot-path tracing, compiled out unless CONFIG_APP_TRACE_ENABLE is set.
+ *
+ * Events are written into a per-core ring that overwrites the oldest events, stamped with the
+ * cycle counter of the core, and exported as Chrome trace JSON (loads in chrome://tracing and
+ * ui.perfetto.dev). Event names must be string literals, only the pointer is recorded.
+ * BEGIN and END must be emitted by the same task. Two consecutive events of a core more than
+ * 2^32 cycles (about 17 s at 240 MHz) apart make the older events look more recent.
+ */
+
+typedef enum
+{
+    TRACING_PHASE_BEGIN = 'B',
+    TRACING_PHASE_END = 'E',
+    TRACING_PHASE_INSTANT = 'i',
+} tracing_phase_t;
+
+/* Sends a chunk of the export */
+typedef esp_err_t (*tracing_flush_t)(void *ctx, const char *buf, size_t len);
+
+#if CONFIG_APP_TRACE_ENABLE
+
+void tracing_emit(const char *name, tracing_phase_t phase, uint32_t arg);
+
+/* Chrome trace JSON of the events in the rings, oldest first */
+esp_err_t tracing_export_chrome(tracing_flush_t flush, void *ctx);
+
+#define TRACE_BEGIN(name) tracing_emit(name, TRACING_PHASE_BEGIN, 0)
+#define TRACE_END(name) tracing_emit(name, TRACING_PHASE_END, 0)
+#define TRACE_INSTANT(name, arg) tracing_emit(name, TRACING_PHASE_INSTANT, arg)
+
+#else
+
+#define TRACE_BEGIN(name) \
+    do                    \
+    {                     \
+    } while (0)
+#define TRACE_END(name) \
+    do                  \
+    {                   \
+    } while (0)
+#define TRACE_INSTANT(name, arg) \
+    do                           \
+    {                            \
+        (void)(arg);             \
+    } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "link_table.h"
+#include "sdkconfig.h"
+
+#define LINK_TABLE_SIZE CONFIG_APP_LINK_TABLE_SIZE
+#define LINK_TABLE_PROBES 4
+
+typedef struct
+{
+    link_entry_t entry;
+    int16_t rssi_q4;  // Averages in 1/16 dB, rounded into entry
+    int16_t noise_q4;
+    int16_t tx_success_q4;  // 1/16 of a permille, so that the average can settle at 0 and 1000
+    bool valid;
+} link_slot_t;
+
+static link_slot_t link_slots[LINK_TABLE_SIZE];
+static portMUX_TYPE link_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t link_table_hash(const uint8_t *mac)
+{
+    // The OUI is shared by the whole fleet
+    return ((uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5]) * 2654435761u;
+}
+
+/* Called with link_lock held */
+static link_slot_t *link_table_slot(const uint8_t *mac, bool create)
+{
+    uint32_t hash = link_table_hash(mac);
+    link_slot_t *victim = NULL;
+
+    for (int i = 0; i < LINK_TABLE_PROBES; i++)
+    {
+        link_slot_t *slot = &link_slots[(hash + i) % LINK_TABLE_SIZE];
+        if (slot->valid && !memcmp(slot->entry.mac, mac, ESP_NOW_ETH_ALEN))
+        {
+            return slot;
+        }
+        if (!victim || (victim->valid && (!slot->valid || slot->entry.last_heard < victim->entry.last_heard)))
+        {
+            victim = slot;
+        }
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+
+    // Slots are only ever reused, never emptied, so every MAC stays within its probe sequence
+    memset(victim, 0x0, sizeof(link_slot_t));
+    memcpy(victim->entry.mac, mac, ESP_NOW_ETH_ALEN);
+    victim->valid = true;
+    return victim;
+}
+
+static inline int16_t link_table_ewma(int16_t avg, int16_t sample, bool first)
+{
+    // Rounded, a truncated step stalls below the sample once the difference is under the divisor
+    return first ? sample : avg + ((sample - avg + (1 << (LINK_TABLE_EWMA_SHIFT - 1))) >> LINK_TABLE_EWMA_SHIFT);
+}
+
+static void link_table_update_rssi(link_slot_t *slot, int8_t rssi, bool first)
+{
+    slot->rssi_q4 = link_table_ewma(slot->rssi_q4, rssi * 16, first);
+    slot->entry.rssi = (slot->rssi_q4 + (slot->rssi_q4 < 0 ? -8 : 8)) / 16;
+}
+
+void link_table_rx(const uint8_t *mac, const wifi_pkt_rx_ctrl_t *rx_ctrl)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&link_lock);
+    link_slot_t *slot = link_table_slot(mac, true);
+    bool first = slot->entry.last_heard == 0;
+    if (rx_ctrl)
+    {
+        link_table_update_rssi(slot, rx_ctrl->rssi, first);
+        if (rx_ctrl->noise_floor)
+        {
+            slot->noise_q4 = link_table_ewma(slot->noise_q4, rx_ctrl->noise_floor * 16, !slot->entry.noise_floor);
+            slot->entry.noise_floor = (slot->noise_q4 + (slot->noise_q4 < 0 ? -8 : 8)) / 16;
+        }
+        slot->entry.rx_rate = rx_ctrl->rate;
+    }
+    slot->entry.rx_frames++;
+    slot->entry.last_heard = now;
+    portEXIT_CRITICAL(&link_lock);
+}
+
+void link_table_rssi(const uint8_t *mac, int8_t rssi)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&link_lock);
+    link_slot_t *slot = link_table_slot(mac, true);
+    link_table_update_rssi(slot, rssi, slot->entry.last_heard == 0);
+    slot->entry.last_heard = now;
+    portEXIT_CRITICAL(&link_lock);
+}
+
+void link_table_tx(const uint8_t *mac, bool success)
+{
+    portENTER_CRITICAL(&link_lock);
+    link_slot_t *slot = link_table_slot(mac, true);
+    int16_t sample = success ? 1000 * 16 : 0;
+    slot->tx_success_q4 = link_table_ewma(slot->tx_success_q4, sample, slot->entry.tx_frames == 0);
+    slot->entry.tx_success = (slot->tx_success_q4 + 8) / 16;
+    slot->entry.tx_frames++;
+    slot->entry.tx_acked += success;
+    portEXIT_CRITICAL(&link_lock);
+}
+
+bool link_table_get(const uint8_t *mac, link_entry_t *entry)
+{
+    portENTER_CRITICAL(&link_lock);
+    link_slot_t *slot = link_table_slot(mac, false);
+    if (slot)
+    {
+        *entry = slot->entry;
+    }
+    portEXIT_CRITICAL(&link_lock);
+    return slot != NULL;
+}
+
+size_t link_table_list(link_entry_t *entries, size_t max)
+{
+    size_t num = 0;
+
+    for (int i = 0; i < LINK_TABLE_SIZE && num < max; i++)
+    {
+        portENTER_CRITICAL(&link_lock);
+        if (link_slots[i].valid)
+        {
+            entries[num++] = link_slots[i].entry;
+        }
+        portEXIT_CRITICAL(&link_lock);
+    }
+    return num;
+}
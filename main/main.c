@@ -3,6 +3,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+#include "esp_timer.h"
 
 #include "esp_wifi.h"
 #include "nvs_flash.h"
@@ -11,6 +12,9 @@
 #include "esp_mac.h"
 #include "esp_bridge.h"
 #include "esp_mesh_lite.h"
+#if CONFIG_MESH_LITE_NODE_INFO_REPORT
+#include "esp_mesh_lite_node_events.h"
+#endif
 
 #include <esp_event.h>
 #include <esp_system.h>
@@ -22,10 +26,15 @@
 #include <espnow.h>
 #include <nimble.h>
 #include <sensor.h>
+#include <sensor_store.h>
 #include "app_wifi.h"
+#include "metrics.h"
+#include "debug_stats.h"
+#include "startup.h"
+#include "link_table.h"
+#include "parent_select.h"
 
 static const char *TAG = "mesh";
-extern bool sta_got_ip;
 
 typedef struct
 {
@@ -58,21 +67,227 @@ static void print_system_info_timercb(TimerHandle_t timer)
              esp_mesh_lite_get_level(), MAC2STR(sta_mac), MAC2STR(ap_info.bssid),
              (ap_info.rssi != 0 ? ap_info.rssi : -120), esp_get_free_heap_size());
 
+    if (ap_info.rssi != 0)
+    {
+        link_table_rssi(ap_info.bssid, ap_info.rssi);
+    }
     for (int i = 0; i < wifi_sta_list.num; i++)
     {
-        ESP_LOGI(TAG, "Child mac: " MACSTR, MAC2STR(wifi_sta_list.sta[i].mac));
+        ESP_LOGI(TAG, "Child mac: " MACSTR ", rssi: %d", MAC2STR(wifi_sta_list.sta[i].mac), wifi_sta_list.sta[i].rssi);
+        link_table_rssi(wifi_sta_list.sta[i].mac, wifi_sta_list.sta[i].rssi);
     }
 
-    uint32_t size = 0;
-    const node_info_list_t *node = esp_mesh_lite_get_nodes_list(&size);
+    esp_mesh_lite_node_snapshot_t *nodes = malloc(CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER * sizeof(esp_mesh_lite_node_snapshot_t));
+    if (nodes == NULL)
+    {
+        return;
+    }
+    uint32_t size = esp_mesh_lite_get_nodes_snapshot(nodes, CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER);
     printf("MeshLite nodes %ld:\r\n", size);
-    for (uint32_t loop = 0; (loop < size) && (node != NULL); loop++)
+    for (uint32_t loop = 0; loop < size; loop++)
     {
         struct in_addr ip_struct;
-        ip_struct.s_addr = node->node->ip_addr;
-        printf("%ld: %d, " MACSTR ", %s\r\n", loop + 1, node->node->level, MAC2STR(node->node->mac_addr), inet_ntoa(ip_struct));
-        node = node->next;
+        ip_struct.s_addr = nodes[loop].node.ip_addr;
+        printf("%ld: %d, " MACSTR ", %s\r\n", loop + 1, nodes[loop].node.level, MAC2STR(nodes[loop].node.mac_addr), inet_ntoa(ip_struct));
+    }
+    free(nodes);
+}
+
+static int32_t metrics_read_mesh_nodes_generation(void *arg)
+{
+    return esp_mesh_lite_get_nodes_generation();
+}
+
+static int32_t metrics_read_mesh_level(void *arg)
+{
+    return esp_mesh_lite_get_level();
+}
+
+static int32_t metrics_read_mesh_nodes(void *arg)
+{
+    uint32_t size = 0;
+    esp_mesh_lite_get_nodes_list(&size);
+    return size;
+}
+
+static int32_t metrics_read_wifi_children(void *arg)
+{
+    wifi_sta_list_t wifi_sta_list = {0x0};
+    esp_wifi_ap_get_sta_list(&wifi_sta_list);
+    return wifi_sta_list.num;
+}
+
+static int32_t metrics_read_wifi_parent_rssi(void *arg)
+{
+    wifi_ap_record_t ap_info = {0};
+    if (esp_mesh_lite_get_level() > 1 && esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
+    {
+        return ap_info.rssi;
+    }
+    return -120;
+}
+
+static int32_t metrics_read_wifi_channel(void *arg)
+{
+    uint8_t primary = 0;
+    wifi_second_chan_t second = 0;
+    esp_wifi_get_channel(&primary, &second);
+    return primary;
+}
+
+static int32_t metrics_read_heap_free(void *arg)
+{
+    return esp_get_free_heap_size();
+}
+
+static int32_t metrics_read_heap_min_free(void *arg)
+{
+    return esp_get_minimum_free_heap_size();
+}
+
+static int32_t metrics_read_uptime(void *arg)
+{
+    return esp_timer_get_time() / 1000000;
+}
+
+#if CONFIG_MESH_LITE_NODE_INFO_REPORT
+static metrics_counter_t mesh_node_changes[3];
+static metrics_counter_t mesh_node_changes_posted;
+static metrics_counter_t mesh_node_diff_overflows;
+static metrics_histogram_t mesh_node_diff_batch;
+static const uint32_t mesh_node_diff_batch_bounds[] = {1, 2, 4, 8, 16, 32, 64};
+
+/**
+ * @brief Batch of node table changes, after coalescing per node
+ */
+static void mesh_node_diff_cb(const esp_mesh_lite_node_diff_batch_t *batch, void *arg)
+{
+    for (size_t i = 0; i < batch->num; i++)
+    {
+        metrics_counter_inc(&mesh_node_changes[batch->diffs[i].type]);
+    }
+    metrics_counter_add(&mesh_node_changes_posted, batch->posted);
+    if (batch->overflow)
+    {
+        metrics_counter_inc(&mesh_node_diff_overflows);
+    }
+    metrics_histogram_observe(&mesh_node_diff_batch, batch->num);
+}
+
+static void mesh_node_diff_metrics_register(void)
+{
+    metrics_counter_register(&mesh_node_changes[ESP_MESH_LITE_NODE_DIFF_JOIN], "mesh_node_joins", "Nodes added to the node table");
+    metrics_counter_register(&mesh_node_changes[ESP_MESH_LITE_NODE_DIFF_LEAVE], "mesh_node_leaves", "Nodes removed from the node table");
+    metrics_counter_register(&mesh_node_changes[ESP_MESH_LITE_NODE_DIFF_CHANGE], "mesh_node_changes", "Level or IP changes of nodes in the node table");
+    metrics_counter_register(&mesh_node_changes_posted, "mesh_node_changes_posted", "Node table changes before coalescing");
+    metrics_counter_register(&mesh_node_diff_overflows, "mesh_node_diff_overflows", "Node change batches that lost changes");
+    metrics_histogram_register(&mesh_node_diff_batch, "mesh_node_diff_batch_nodes", "Nodes in a node change batch",
+                               mesh_node_diff_batch_bounds, sizeof(mesh_node_diff_batch_bounds) / sizeof(mesh_node_diff_batch_bounds[0]));
+    esp_mesh_lite_node_diff_subscribe(mesh_node_diff_cb, NULL);
+}
+#endif
+
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+static void mesh_health_cb(esp_mesh_lite_node_health_t *health)
+{
+    uint32_t depth = 0;
+    espnow_get_queue_stats(&depth, &health->queue_drops);
+    health->queue_depth = MIN(depth, UINT16_MAX);
+}
+
+/**
+ * @brief Health of every node reported to the root, one sample per node and family
+ */
+static void mesh_health_collect(metrics_writer_t *writer, void *arg)
+{
+    static const struct
+    {
+        const char *name;
+        const char *type;
+        const char *help;
+    } families[] = {
+        {"mesh_node_free_heap_bytes", "gauge", "Free heap of the node"},
+        {"mesh_node_min_free_heap_bytes", "gauge", "Lowest free heap of the node since boot"},
+        {"mesh_node_parent_rssi_dbm", "gauge", "RSSI of the parent of the node, 0 on the root"},
+        {"mesh_node_children", "gauge", "Stations connected to the softAP of the node"},
+        {"mesh_node_queue_depth", "gauge", "ESP-NOW receive queue depth of the node"},
+        {"mesh_node_queue_drops", "counter", "ESP-NOW frames dropped by the node"},
+        {"mesh_node_uptime_seconds", "gauge", "Time since boot of the node"},
+        {"mesh_node_report_age_seconds", "gauge", "Time since the root received the report of the node"},
+    };
+
+    if (esp_mesh_lite_get_level() != 1)
+    {
+        return;
+    }
+
+    // metrics_printf can block on the socket, so the node table is only read through a copy
+    esp_mesh_lite_node_snapshot_t *nodes = malloc(CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER * sizeof(esp_mesh_lite_node_snapshot_t));
+    if (nodes == NULL)
+    {
+        return;
+    }
+    uint32_t size = esp_mesh_lite_get_nodes_snapshot(nodes, CONFIG_MESH_LITE_MAXIMUM_NODE_NUMBER);
+
+    uint32_t now = esp_timer_get_time() / 1000000;
+    for (size_t f = 0; f < sizeof(families) / sizeof(families[0]); f++)
+    {
+        metrics_printf(writer, "# TYPE %s %s\n# HELP %s %s\n", families[f].name, families[f].type, families[f].name, families[f].help);
+
+        for (uint32_t loop = 0; loop < size; loop++)
+        {
+            const esp_mesh_lite_node_info_t *node = &nodes[loop].node;
+            const esp_mesh_lite_node_health_t *health = &nodes[loop].health;
+            if (health->update_time == 0)
+            {
+                continue;
+            }
+
+            // In the order of families
+            const int64_t values[] = {
+                health->free_heap,
+                health->min_free_heap,
+                health->parent_rssi,
+                health->child_num,
+                health->queue_depth,
+                health->queue_drops,
+                health->uptime,
+                now - health->update_time,
+            };
+            metrics_printf(writer, "%s%s{mac=\"" MACSTR "\",level=\"%d\"} %lld\n", families[f].name,
+                           f == 5 ? "_total" : "", MAC2STR(node->mac_addr), node->level, (long long)values[f]);
+        }
     }
+    free(nodes);
+}
+#endif
+
+/**
+ * @brief System information of print_system_info_timercb, as metrics
+ */
+static void system_metrics_register(void)
+{
+    static metrics_gauge_t gauges[9];
+
+    metrics_gauge_register(&gauges[0], "mesh_level", "Level of this node in the mesh, 0 when not connected", metrics_read_mesh_level, NULL);
+    metrics_gauge_register(&gauges[1], "mesh_nodes", "Nodes in the mesh-lite node table", metrics_read_mesh_nodes, NULL);
+    metrics_gauge_register(&gauges[2], "wifi_children", "Stations connected to the softAP", metrics_read_wifi_children, NULL);
+    metrics_gauge_register(&gauges[3], "wifi_parent_rssi_dbm", "RSSI of the parent, -120 without parent", metrics_read_wifi_parent_rssi, NULL);
+    metrics_gauge_register(&gauges[4], "wifi_channel", "Primary Wi-Fi channel", metrics_read_wifi_channel, NULL);
+    metrics_gauge_register(&gauges[5], "heap_free_bytes", "Free heap", metrics_read_heap_free, NULL);
+    metrics_gauge_register(&gauges[6], "heap_min_free_bytes", "Lowest free heap since boot", metrics_read_heap_min_free, NULL);
+    metrics_gauge_register(&gauges[7], "uptime_seconds", "Time since boot", metrics_read_uptime, NULL);
+    metrics_gauge_register(&gauges[8], "mesh_nodes_generation", "Generation of the mesh-lite node table, or of its replica on non-root nodes",
+                           metrics_read_mesh_nodes_generation, NULL);
+
+#if CONFIG_MESH_LITE_NODE_INFO_REPORT
+    mesh_node_diff_metrics_register();
+#endif
+
+#if CONFIG_MESH_LITE_NODE_HEALTH_REPORT
+    esp_mesh_lite_set_health_cb(mesh_health_cb);
+    metrics_collector_register(mesh_health_collect, NULL);
+#endif
 }
 
 // TODO read location from storage
@@ -118,20 +333,25 @@ static esp_err_t esp_storage_init(void)
     return err;
 }
 
-void app_main()
+static esp_err_t startup_nvs(void)
 {
-    // Set the log level for serial port printing.
-    esp_log_level_set("*", ESP_LOG_INFO);
-
     esp_storage_init();
+    return ESP_OK;
+}
 
+static esp_err_t startup_netif(void)
+{
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     esp_bridge_create_all_netif();
 
     wifi_task_init();
+    return ESP_OK;
+}
 
+static esp_err_t startup_mesh(void)
+{
     esp_mesh_lite_config_t mesh_lite_config = ESP_MESH_LITE_DEFAULT_INIT();
     mesh_lite_config.join_mesh_ignore_router_status = true;
 #if CONFIG_MESH_ROOT
@@ -155,24 +375,57 @@ void app_main()
     esp_wifi_get_mac(ESP_IF_WIFI_STA, node_config.sta_mac);
     esp_mesh_lite_start();
 
-#if CONFIG_ENABLE_WIFI_STA
-    while (!sta_got_ip)
-    {
-    }
-#endif
-
-    app_espnow_init();
-
 #if CONFIG_APP_DEBUG
     TimerHandle_t timer = xTimerCreate("print_system_info", 10000 / portTICK_PERIOD_MS,
                                        true, NULL, print_system_info_timercb);
     xTimerStart(timer, 0);
 #endif
+    return ESP_OK;
+}
+
+static esp_err_t startup_store(void)
+{
+#if CONFIG_SENSOR_STORE_ENABLE
+    return sensor_store_init();
+#else
+    return ESP_OK;
+#endif
+}
 
+static esp_err_t startup_httpd(void)
+{
     start_workers();
-    httpd_handle_t server = start_webserver();
+    return start_webserver() ? ESP_OK : ESP_FAIL;
+}
 
-    init_nimble();
+/*
+ * ESP-NOW and the HTTP server only need Wi-Fi to be started, the station getting an IP
+ * is recorded but nothing waits for it.
+ */
+static const startup_stage_desc_t startup_stages[STARTUP_STAGE_MAX] = {
+    [STARTUP_STAGE_NVS] = {"nvs", 0, startup_nvs},
+    [STARTUP_STAGE_NETIF] = {"netif", STARTUP_BIT(STARTUP_STAGE_NVS), startup_netif},
+    [STARTUP_STAGE_MESH] = {"mesh", STARTUP_BIT(STARTUP_STAGE_NETIF), startup_mesh},
+    [STARTUP_STAGE_WIFI_STA] = {"wifi_sta", STARTUP_BIT(STARTUP_STAGE_MESH), NULL},
+    [STARTUP_STAGE_STORE] = {"store", 0, startup_store},
+    [STARTUP_STAGE_ESPNOW] = {"espnow", STARTUP_BIT(STARTUP_STAGE_MESH) | STARTUP_BIT(STARTUP_STAGE_STORE), app_espnow_init},
+    [STARTUP_STAGE_PARENT] = {"parent", STARTUP_BIT(STARTUP_STAGE_ESPNOW), parent_select_init},
+    [STARTUP_STAGE_SENSORS] = {"sensors", STARTUP_BIT(STARTUP_STAGE_ESPNOW), init_sensor_read_task},
+    [STARTUP_STAGE_SENSOR_TX] = {"sensor_tx", STARTUP_BIT(STARTUP_STAGE_SENSORS), NULL},
+    [STARTUP_STAGE_HTTPD] = {"httpd", STARTUP_BIT(STARTUP_STAGE_NETIF) | STARTUP_BIT(STARTUP_STAGE_STORE), startup_httpd},
+    [STARTUP_STAGE_NIMBLE] = {"nimble", STARTUP_BIT(STARTUP_STAGE_NVS), init_nimble},
+};
+
+void app_main()
+{
+    // Set the log level for serial port printing.
+    esp_log_level_set("*", ESP_LOG_INFO);
+
+    metrics_init();
+    system_metrics_register();
+#if CONFIG_APP_DEBUG_STATS_ENABLE
+    debug_stats_init();
+#endif
 
-    init_sensor_read_task();
+    startup_run(startup_stages);
 }
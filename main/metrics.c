@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "metrics.h"
+
+static const char *TAG = "metrics";
+
+static metrics_desc_t *metrics_registry[CONFIG_METRICS_MAX_NUM];
+static size_t metrics_num = 0;
+static portMUX_TYPE metrics_registry_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static char *metrics_buf = NULL;
+static SemaphoreHandle_t metrics_buf_mutex = NULL;
+
+#define METRICS_MAX_COLLECTORS 4
+
+typedef struct
+{
+    metrics_collect_t collect;
+    void *arg;
+} metrics_collector_t;
+
+static metrics_collector_t metrics_collectors[METRICS_MAX_COLLECTORS];
+static size_t metrics_collector_num = 0;
+
+static metrics_gauge_t metrics_scrape_duration;
+static metrics_gauge_t metrics_scrape_bytes;
+
+struct metrics_writer
+{
+    char *buf;
+    size_t size;
+    size_t len;
+    size_t total;
+    metrics_flush_t flush;
+    void *ctx;
+    esp_err_t err;
+};
+
+static void metrics_writer_flush(metrics_writer_t *writer)
+{
+    if (writer->err == ESP_OK && writer->len > 0)
+    {
+        writer->err = writer->flush(writer->ctx, writer->buf, writer->len);
+        writer->total += writer->len;
+        writer->len = 0;
+    }
+}
+
+void metrics_printf(metrics_writer_t *writer, const char *fmt, ...)
+{
+    // Retried once on an empty buffer when the line does not fit
+    for (int i = 0; i < 2 && writer->err == ESP_OK; i++)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(writer->buf + writer->len, writer->size - writer->len, fmt, args);
+        va_end(args);
+
+        if (n < 0)
+        {
+            writer->err = ESP_FAIL;
+        }
+        else if ((size_t)n < writer->size - writer->len)
+        {
+            writer->len += n;
+            return;
+        }
+        else if (writer->len == 0)
+        {
+            writer->err = ESP_ERR_NO_MEM;
+        }
+        else
+        {
+            metrics_writer_flush(writer);
+        }
+    }
+}
+
+static esp_err_t metrics_register(metrics_desc_t *desc, const char *name, const char *help, metrics_type_t type)
+{
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&metrics_registry_lock);
+    if (desc->name)
+    {
+        // Already registered, e.g. by a module that is started again
+    }
+    else if (metrics_num >= CONFIG_METRICS_MAX_NUM)
+    {
+        ret = ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        desc->name = name;
+        desc->help = help;
+        desc->type = type;
+        metrics_registry[metrics_num++] = desc;
+    }
+    portEXIT_CRITICAL(&metrics_registry_lock);
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Registry full, %s is not exported", name);
+    }
+    return ret;
+}
+
+esp_err_t metrics_counter_register(metrics_counter_t *counter, const char *name, const char *help)
+{
+    return metrics_register(&counter->desc, name, help, METRICS_TYPE_COUNTER);
+}
+
+esp_err_t metrics_gauge_register(metrics_gauge_t *gauge, const char *name, const char *help,
+                                 metrics_gauge_read_t read, void *arg)
+{
+    gauge->read = read;
+    gauge->arg = arg;
+    return metrics_register(&gauge->desc, name, help, METRICS_TYPE_GAUGE);
+}
+
+esp_err_t metrics_histogram_register(metrics_histogram_t *histogram, const char *name, const char *help,
+                                     const uint32_t *bounds, size_t bound_num)
+{
+    if (bound_num > METRICS_HISTOGRAM_MAX_BUCKETS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 1; i < bound_num; i++)
+    {
+        if (bounds[i] <= bounds[i - 1])
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    // Observations before registration were counted in bucket 0 with no bounds, they go to +Inf
+    for (int core = 0; core < portNUM_PROCESSORS && bound_num > 0; core++)
+    {
+        uint32_t early = atomic_exchange_explicit(&histogram->bucket[core][0], 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&histogram->bucket[core][bound_num], early, memory_order_relaxed);
+    }
+    histogram->bounds = bounds;
+    histogram->bound_num = bound_num;
+    return metrics_register(&histogram->desc, name, help, METRICS_TYPE_HISTOGRAM);
+}
+
+esp_err_t metrics_collector_register(metrics_collect_t collect, void *arg)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    portENTER_CRITICAL(&metrics_registry_lock);
+    if (metrics_collector_num < METRICS_MAX_COLLECTORS)
+    {
+        metrics_collectors[metrics_collector_num].collect = collect;
+        metrics_collectors[metrics_collector_num].arg = arg;
+        metrics_collector_num++;
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&metrics_registry_lock);
+
+    return ret;
+}
+
+static void metrics_render_counter(metrics_writer_t *writer, const metrics_counter_t *counter)
+{
+    metrics_printf(writer, "%s_total %" PRIu64 "\n", counter->desc.name, metrics_counter_get(counter));
+}
+
+static void metrics_render_gauge(metrics_writer_t *writer, const metrics_gauge_t *gauge)
+{
+    int32_t value = gauge->read ? gauge->read(gauge->arg) : atomic_load_explicit(&gauge->value, memory_order_relaxed);
+    metrics_printf(writer, "%s %" PRIi32 "\n", gauge->desc.name, value);
+}
+
+static void metrics_render_histogram(metrics_writer_t *writer, const metrics_histogram_t *histogram)
+{
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        sum += atomic_load_explicit(&histogram->sum[core], memory_order_relaxed);
+    }
+    for (uint8_t i = 0; i <= histogram->bound_num; i++)
+    {
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            count += atomic_load_explicit(&histogram->bucket[core][i], memory_order_relaxed);
+        }
+        if (i < histogram->bound_num)
+        {
+            metrics_printf(writer, "%s_bucket{le=\"%" PRIu32 "\"} %" PRIu64 "\n", histogram->desc.name, histogram->bounds[i], count);
+        }
+        else
+        {
+            metrics_printf(writer, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", histogram->desc.name, count);
+        }
+    }
+    metrics_printf(writer, "%s_count %" PRIu64 "\n", histogram->desc.name, count);
+    metrics_printf(writer, "%s_sum %" PRIu64 "\n", histogram->desc.name, sum);
+}
+
+static const char *metrics_type_str(metrics_type_t type)
+{
+    switch (type)
+    {
+    case METRICS_TYPE_COUNTER:
+        return "counter";
+    case METRICS_TYPE_GAUGE:
+        return "gauge";
+    case METRICS_TYPE_HISTOGRAM:
+        return "histogram";
+    default:
+        return "unknown";
+    }
+}
+
+esp_err_t metrics_scrape(metrics_flush_t flush, void *ctx)
+{
+    if (!metrics_buf)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(metrics_buf_mutex, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+
+    portENTER_CRITICAL(&metrics_registry_lock);
+    size_t num = metrics_num;
+    size_t collector_num = metrics_collector_num;
+    portEXIT_CRITICAL(&metrics_registry_lock);
+
+    metrics_writer_t writer = {
+        .buf = metrics_buf,
+        .size = CONFIG_METRICS_RENDER_BUF_SIZE,
+        .flush = flush,
+        .ctx = ctx,
+        .err = ESP_OK,
+    };
+    for (size_t i = 0; i < num && writer.err == ESP_OK; i++)
+    {
+        const metrics_desc_t *desc = metrics_registry[i];
+        metrics_printf(&writer, "# TYPE %s %s\n", desc->name, metrics_type_str(desc->type));
+        if (desc->help)
+        {
+            metrics_printf(&writer, "# HELP %s %s\n", desc->name, desc->help);
+        }
+
+        switch (desc->type)
+        {
+        case METRICS_TYPE_COUNTER:
+            metrics_render_counter(&writer, (const metrics_counter_t *)desc);
+            break;
+        case METRICS_TYPE_GAUGE:
+            metrics_render_gauge(&writer, (const metrics_gauge_t *)desc);
+            break;
+        case METRICS_TYPE_HISTOGRAM:
+            metrics_render_histogram(&writer, (const metrics_histogram_t *)desc);
+            break;
+        }
+    }
+    for (size_t i = 0; i < collector_num && writer.err == ESP_OK; i++)
+    {
+        metrics_collectors[i].collect(&writer, metrics_collectors[i].arg);
+    }
+    metrics_printf(&writer, "# EOF\n");
+    metrics_writer_flush(&writer);
+
+    if (writer.err == ESP_OK)
+    {
+        // Exported with the next scrape
+        metrics_gauge_set(&metrics_scrape_duration, esp_timer_get_time() - start);
+        metrics_gauge_set(&metrics_scrape_bytes, writer.total);
+    }
+    else if (writer.err == ESP_ERR_NO_MEM)
+    {
+        ESP_LOGE(TAG, "Metric line longer than %d bytes", CONFIG_METRICS_RENDER_BUF_SIZE);
+    }
+    xSemaphoreGive(metrics_buf_mutex);
+
+    return writer.err;
+}
+
+esp_err_t metrics_init(void)
+{
+    if (metrics_buf)
+    {
+        return ESP_OK;
+    }
+
+    metrics_buf_mutex = xSemaphoreCreateMutex();
+    if (!metrics_buf_mutex)
+    {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_FAIL;
+    }
+
+    metrics_buf = malloc(CONFIG_METRICS_RENDER_BUF_SIZE);
+    if (!metrics_buf)
+    {
+        ESP_LOGE(TAG, "Malloc scrape buffer fail");
+        vSemaphoreDelete(metrics_buf_mutex);
+        metrics_buf_mutex = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    metrics_gauge_register(&metrics_scrape_duration, "metrics_scrape_duration_us",
+                           "Render time of the previous scrape", NULL, NULL);
+    metrics_gauge_register(&metrics_scrape_bytes, "metrics_scrape_bytes",
+                           "Size of the previous scrape", NULL, NULL);
+    return ESP_OK;
+}
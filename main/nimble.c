@@ -1,8 +1,13 @@
 #include <nimble.h>
 #include "esp_mac.h"
 #include "esp_log.h"
+#include "metrics.h"
 static const char *TAG = "nimble";
 
+static metrics_counter_t ble_adv_reports;
+static metrics_counter_t ble_adv_invalid;
+static metrics_counter_t ble_disconnects;
+
 void blecent_scan(void)
 {
     uint8_t own_addr_type;
@@ -299,10 +304,12 @@ int blecent_gap_event(struct ble_gap_event *event, void *arg)
     switch (event->type)
     {
     case BLE_GAP_EVENT_DISC:
+        metrics_counter_inc(&ble_adv_reports);
         rc = ble_hs_adv_parse_fields(&fields, event->disc.data,
                                      event->disc.length_data);
         if (rc != 0)
         {
+            metrics_counter_inc(&ble_adv_invalid);
             return 0;
         }
         const ble_addr_t *addr = &event->disc.addr;
@@ -318,6 +325,7 @@ int blecent_gap_event(struct ble_gap_event *event, void *arg)
         return 0;
     case BLE_GAP_EVENT_DISCONNECT:
         /* Connection terminated. */
+        metrics_counter_inc(&ble_disconnects);
         ESP_LOGI(TAG, "disconnect; reason=%d ", event->disconnect.reason);
         print_conn_desc(&event->disconnect.conn);
         ESP_LOGI(TAG, "\n");
@@ -408,6 +416,11 @@ void blecent_host_task(void *param)
 esp_err_t init_nimble(void)
 {
     esp_err_t ret = ESP_OK;
+
+    metrics_counter_register(&ble_adv_reports, "ble_adv_reports", "BLE advertising reports received while scanning");
+    metrics_counter_register(&ble_adv_invalid, "ble_adv_invalid", "BLE advertising reports that failed to parse");
+    metrics_counter_register(&ble_disconnects, "ble_disconnects", "BLE connections terminated");
+
     ret = nimble_port_init();
     if (ret != ESP_OK)
     {
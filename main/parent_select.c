@@ -0,0 +1,439 @@
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_mesh_lite.h"
+#include "espnow.h"
+#include "link_table.h"
+#include "metrics.h"
+#include "parent_select.h"
+#include "sdkconfig.h"
+
+#define PARENT_OFFER_INTERVAL_US (1000LL * CONFIG_APP_PARENT_OFFER_INTERVAL_MS)
+#define PARENT_OFFER_TIMEOUT_US (5 * PARENT_OFFER_INTERVAL_US) /* Candidates not heard for longer are not eligible */
+#define PARENT_PIN_TIMEOUT_US (10 * PARENT_OFFER_INTERVAL_US)  /* Time the station has to associate with a new parent */
+#define PARENT_MIN_DWELL_US (1000000LL * CONFIG_APP_PARENT_MIN_DWELL_S)
+#define PARENT_DELIVERY_SHIFT 3      /* Delivery ratio moves by 1/8 of the difference per offer */
+#define PARENT_DELIVERY_MIN 10       /* Floor of the delivery ratios, caps the link ETX at 100 transmissions */
+#define PARENT_SEQ_GAP_MAX 32        /* Larger gaps in the offer sequence are a restart of the candidate */
+#define PARENT_REVERSE_MIN_FRAMES 8  /* Unicast frames sent to a candidate before its send success is trusted */
+
+#if CONFIG_APP_PARENT_SELECT
+#define PARENT_SELECT_STEER true
+#else
+#define PARENT_SELECT_STEER false /* Costs are still computed, children need the path cost of this node */
+#endif
+
+typedef struct
+{
+    parent_offer_t offer;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t delivery;
+    uint16_t delivery_q4;  // Average in 1/16 of a permille, rounded into delivery
+    int64_t last_heard;
+    int64_t blocked_until; // Not eligible before, after it failed to take this node
+    bool valid;
+} parent_slot_t;
+
+static const char *TAG = "parent_select";
+
+static parent_slot_t parent_slots[CONFIG_APP_PARENT_CANDIDATES];
+static portMUX_TYPE parent_lock = portMUX_INITIALIZER_UNLOCKED;
+/* Parent being switched to, only it is whitelisted until pin_until */
+static uint8_t parent_pin[ESP_NOW_ETH_ALEN];
+static int64_t parent_pin_until = 0;
+
+/* Only used by the timer */
+static uint16_t parent_offer_seq = 0;
+static uint16_t parent_path_cost = PARENT_COST_MAX;
+static uint8_t parent_bssid[ESP_NOW_ETH_ALEN];
+static int64_t parent_since = 0;
+static uint8_t parent_better[ESP_NOW_ETH_ALEN];
+static uint8_t parent_better_count = 0;
+
+static metrics_counter_t parent_switches;
+static metrics_counter_t parent_switch_failures;
+
+/* Delivery ratio assumed for a new candidate until its offers tell better */
+static uint16_t parent_delivery_prior(int8_t rssi)
+{
+    if (rssi >= -70)
+    {
+        return 1000;
+    }
+    if (rssi <= -90)
+    {
+        return 100;
+    }
+    return 100 + (rssi + 90) * 45;
+}
+
+/* Rounded and with extra precision, like the link table, so that the average settles at 0 and 1000 */
+static inline void parent_delivery_ewma(parent_slot_t *slot, uint16_t sample)
+{
+    int32_t diff = (int32_t)sample * 16 - slot->delivery_q4;
+    slot->delivery_q4 += (diff + (1 << (PARENT_DELIVERY_SHIFT - 1))) >> PARENT_DELIVERY_SHIFT;
+    slot->delivery = (slot->delivery_q4 + 8) / 16;
+}
+
+/* Called with parent_lock held */
+static parent_slot_t *parent_slot_find(const uint8_t *mac, const uint8_t *bssid)
+{
+    for (int i = 0; i < CONFIG_APP_PARENT_CANDIDATES; i++)
+    {
+        parent_slot_t *slot = &parent_slots[i];
+        if (slot->valid && ((mac && !memcmp(slot->mac, mac, ESP_NOW_ETH_ALEN)) ||
+                            (bssid && !memcmp(slot->offer.bssid, bssid, ESP_NOW_ETH_ALEN))))
+        {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+void parent_select_offer_rx(const uint8_t *mac, int8_t rssi, const uint8_t *data, size_t len)
+{
+    parent_offer_t offer;
+
+    if (len < sizeof(offer))
+    {
+        return;
+    }
+    memcpy(&offer, data, sizeof(offer));
+    offer.ssid_len = MIN(offer.ssid_len, sizeof(offer.ssid));
+
+    portENTER_CRITICAL(&parent_lock);
+    parent_slot_t *slot = parent_slot_find(mac, NULL);
+    if (slot == NULL)
+    {
+        slot = &parent_slots[0];
+        for (int i = 0; i < CONFIG_APP_PARENT_CANDIDATES && slot->valid; i++)
+        {
+            if (!parent_slots[i].valid || parent_slots[i].last_heard < slot->last_heard)
+            {
+                slot = &parent_slots[i];
+            }
+        }
+        memset(slot, 0x0, sizeof(parent_slot_t));
+        memcpy(slot->mac, mac, ESP_NOW_ETH_ALEN);
+        slot->delivery = parent_delivery_prior(rssi);
+        slot->delivery_q4 = slot->delivery * 16;
+        slot->valid = true;
+    }
+    else
+    {
+        // Every offer missed since the last one is a failed delivery
+        uint16_t gap = offer.seq - slot->offer.seq;
+        if (gap == 0)
+        {
+            portEXIT_CRITICAL(&parent_lock);
+            return;
+        }
+        for (int i = 1; i < gap && gap <= PARENT_SEQ_GAP_MAX; i++)
+        {
+            parent_delivery_ewma(slot, 0);
+        }
+        parent_delivery_ewma(slot, 1000);
+    }
+    slot->offer = offer;
+    slot->last_heard = esp_timer_get_time();
+    portEXIT_CRITICAL(&parent_lock);
+}
+
+/* Cost through a candidate for a node at level, 0 when not associated */
+static uint32_t parent_cost(const parent_slot_t *slot, bool current, uint8_t level, int64_t now)
+{
+    const parent_offer_t *offer = &slot->offer;
+
+    if (!slot->valid || now - slot->last_heard > PARENT_OFFER_TIMEOUT_US || now < slot->blocked_until)
+    {
+        return PARENT_COST_MAX;
+    }
+    // A candidate at this node's level or deeper may be one of its descendants
+    if (offer->level == 0 || (level && offer->level >= level) || offer->path_cost == PARENT_COST_MAX)
+    {
+        return PARENT_COST_MAX;
+    }
+    if (!current && offer->child_num >= offer->max_child)
+    {
+        return PARENT_COST_MAX;
+    }
+
+    uint32_t forward = MAX(slot->delivery, PARENT_DELIVERY_MIN);
+    uint32_t reverse = forward;
+    link_entry_t link;
+    if (link_table_get(slot->mac, &link) && link.tx_frames >= PARENT_REVERSE_MIN_FRAMES)
+    {
+        reverse = MAX(link.tx_success, PARENT_DELIVERY_MIN);
+    }
+    uint32_t etx = PARENT_COST_UNIT * 1000 * 1000 / (forward * reverse);
+
+    // The current parent already counts this node among its stations
+    uint32_t children = offer->child_num + (current ? 0 : 1);
+    uint32_t cost = offer->path_cost + etx + CONFIG_APP_PARENT_HOP_COST + CONFIG_APP_PARENT_CHILD_COST * children +
+                    CONFIG_APP_PARENT_QUEUE_COST * offer->queue_load / 100;
+    return MIN(cost, PARENT_COST_MAX - 1);
+}
+
+static void parent_offer_send(uint8_t level)
+{
+    parent_offer_t offer = {
+        .seq = ++parent_offer_seq,
+        .level = level,
+        .path_cost = level == 1 ? 0 : parent_path_cost,
+    };
+    wifi_config_t ap_config = {0};
+    wifi_sta_list_t sta_list = {0};
+    uint32_t depth = 0;
+    uint32_t drops = 0;
+
+    esp_wifi_get_config(WIFI_IF_AP, &ap_config);
+    esp_wifi_ap_get_sta_list(&sta_list);
+    espnow_get_queue_stats(&depth, &drops);
+    esp_wifi_get_mac(WIFI_IF_AP, offer.bssid);
+
+    offer.child_num = sta_list.num;
+    offer.max_child = ap_config.ap.max_connection;
+    offer.queue_load = MIN(100, depth * 100 / (CONFIG_APP_ESPNOW_INGEST_DATA_DEPTH + CONFIG_APP_ESPNOW_INGEST_CONTROL_DEPTH));
+    offer.ssid_len = ap_config.ap.ssid_len ? ap_config.ap.ssid_len : strnlen((const char *)ap_config.ap.ssid, sizeof(offer.ssid));
+    offer.ssid_len = MIN(offer.ssid_len, sizeof(offer.ssid));
+    memcpy(offer.ssid, ap_config.ap.ssid, offer.ssid_len);
+
+    esp_now_send_parent_offer((const uint8_t *)&offer, sizeof(offer));
+}
+
+static void parent_switch(const parent_slot_t *slot, uint32_t cost, uint32_t current_cost, int64_t now)
+{
+    portENTER_CRITICAL(&parent_lock);
+    memcpy(parent_pin, slot->offer.bssid, ESP_NOW_ETH_ALEN);
+    parent_pin_until = now + PARENT_PIN_TIMEOUT_US;
+    portEXIT_CRITICAL(&parent_lock);
+
+    ESP_LOGI(TAG, "Switch to parent " MACSTR ", level %d, cost %" PRIu32 " (current %" PRIu32 ")",
+             MAC2STR(slot->offer.bssid), slot->offer.level, cost, current_cost);
+    // mesh-lite reconnects on its own, the whitelist only leaves it the pinned parent
+    esp_wifi_disconnect();
+}
+
+/* Called with parent_lock held, true once the pending switch is over */
+static bool parent_pin_check(const uint8_t *bssid, bool associated, int64_t now)
+{
+    if (associated && !memcmp(parent_pin, bssid, ESP_NOW_ETH_ALEN))
+    {
+        parent_pin_until = 0;
+        metrics_counter_inc(&parent_switches);
+        return true;
+    }
+    if (now <= parent_pin_until)
+    {
+        return false;
+    }
+
+    parent_slot_t *slot = parent_slot_find(NULL, parent_pin);
+    if (slot)
+    {
+        slot->blocked_until = now + PARENT_MIN_DWELL_US;
+    }
+    parent_pin_until = 0;
+    metrics_counter_inc(&parent_switch_failures);
+    return true;
+}
+
+static void parent_evaluate(uint8_t level, int64_t now)
+{
+    parent_slot_t slots[CONFIG_APP_PARENT_CANDIDATES];
+    wifi_ap_record_t ap_info = {0};
+    bool associated = level > 1 && esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK;
+
+    if (!associated)
+    {
+        memset(parent_bssid, 0x0, sizeof(parent_bssid));
+    }
+    else if (memcmp(parent_bssid, ap_info.bssid, ESP_NOW_ETH_ALEN))
+    {
+        memcpy(parent_bssid, ap_info.bssid, ESP_NOW_ETH_ALEN);
+        parent_since = now;
+        parent_better_count = 0;
+    }
+
+    portENTER_CRITICAL(&parent_lock);
+    bool switching = parent_pin_until && !parent_pin_check(ap_info.bssid, associated, now);
+    memcpy(slots, parent_slots, sizeof(slots));
+    portEXIT_CRITICAL(&parent_lock);
+
+    if (!associated)
+    {
+        parent_path_cost = PARENT_COST_MAX;
+        return;
+    }
+
+    const parent_slot_t *current = NULL;
+    const parent_slot_t *best = NULL;
+    uint32_t current_cost = PARENT_COST_MAX;
+    uint32_t best_cost = PARENT_COST_MAX;
+    for (int i = 0; i < CONFIG_APP_PARENT_CANDIDATES; i++)
+    {
+        bool is_current = slots[i].valid && !memcmp(slots[i].offer.bssid, parent_bssid, ESP_NOW_ETH_ALEN);
+        uint32_t cost = parent_cost(&slots[i], is_current, level, now);
+        if (is_current)
+        {
+            current = &slots[i];
+            current_cost = cost;
+        }
+        else if (cost < best_cost)
+        {
+            best = &slots[i];
+            best_cost = cost;
+        }
+    }
+
+    // Parents that do not send offers are priced by their level alone and never left
+    parent_path_cost = current ? current_cost : (level - 1) * (PARENT_COST_UNIT + CONFIG_APP_PARENT_HOP_COST);
+    if (!PARENT_SELECT_STEER || switching || current == NULL || best == NULL ||
+        best_cost + CONFIG_APP_PARENT_SWITCH_MARGIN >= current_cost || now - parent_since < PARENT_MIN_DWELL_US)
+    {
+        parent_better_count = 0;
+        return;
+    }
+
+    // Hysteresis: the same candidate has to stay cheaper for several evaluations in a row
+    if (parent_better_count && !memcmp(parent_better, best->offer.bssid, ESP_NOW_ETH_ALEN))
+    {
+        parent_better_count++;
+    }
+    else
+    {
+        memcpy(parent_better, best->offer.bssid, ESP_NOW_ETH_ALEN);
+        parent_better_count = 1;
+    }
+    if (parent_better_count >= CONFIG_APP_PARENT_SWITCH_HOLD)
+    {
+        parent_better_count = 0;
+        parent_switch(best, best_cost, current_cost, now);
+    }
+}
+
+#if CONFIG_APP_PARENT_SELECT
+/* Whitelist of mesh-lite, only consulted when joining a parent */
+static const uint8_t *parent_ssid_by_mac(const uint8_t *bssid)
+{
+    static uint8_t ssid[33];
+
+    if (bssid == NULL)
+    {
+        return NULL;
+    }
+
+    int64_t now = esp_timer_get_time();
+    bool allowed = false;
+
+    portENTER_CRITICAL(&parent_lock);
+    // The router and nodes whose offer was not heard, e.g. still scanning other channels, are not listed.
+    // The pin lapses here too: while disconnected the level is 0 and the timer does not check it.
+    parent_slot_t *slot = parent_slot_find(NULL, bssid);
+    bool pinned = parent_pin_until && now <= parent_pin_until;
+    if (slot && !(pinned && memcmp(parent_pin, bssid, ESP_NOW_ETH_ALEN)))
+    {
+        allowed = now >= slot->blocked_until;
+        memcpy(ssid, slot->offer.ssid, slot->offer.ssid_len);
+        ssid[slot->offer.ssid_len] = '\0';
+    }
+    portEXIT_CRITICAL(&parent_lock);
+
+    return allowed ? ssid : NULL;
+}
+#endif
+
+static void parent_select_timer_cb(TimerHandle_t timer)
+{
+    uint8_t level = esp_mesh_lite_get_level();
+
+    if (level == 0)
+    {
+        return;
+    }
+    // Children could not attach below the deepest allowed level
+    if (level < CONFIG_MESH_LITE_MAXIMUM_LEVEL_ALLOWED)
+    {
+        parent_offer_send(level);
+    }
+    parent_evaluate(level, esp_timer_get_time());
+}
+
+size_t parent_select_list(parent_candidate_t *candidates, size_t max)
+{
+    parent_slot_t slots[CONFIG_APP_PARENT_CANDIDATES];
+    int64_t now = esp_timer_get_time();
+    uint8_t level = esp_mesh_lite_get_level();
+    size_t num = 0;
+
+    portENTER_CRITICAL(&parent_lock);
+    memcpy(slots, parent_slots, sizeof(slots));
+    portEXIT_CRITICAL(&parent_lock);
+
+    for (int i = 0; i < CONFIG_APP_PARENT_CANDIDATES && num < max; i++)
+    {
+        if (!slots[i].valid)
+        {
+            continue;
+        }
+        parent_candidate_t *candidate = &candidates[num++];
+        memcpy(candidate->mac, slots[i].mac, ESP_NOW_ETH_ALEN);
+        memcpy(candidate->bssid, slots[i].offer.bssid, ESP_NOW_ETH_ALEN);
+        candidate->level = slots[i].offer.level;
+        candidate->child_num = slots[i].offer.child_num;
+        candidate->queue_load = slots[i].offer.queue_load;
+        candidate->path_cost = slots[i].offer.path_cost;
+        candidate->delivery = slots[i].delivery;
+        candidate->current = level > 1 && !memcmp(slots[i].offer.bssid, parent_bssid, ESP_NOW_ETH_ALEN);
+        candidate->cost = parent_cost(&slots[i], candidate->current, level, now);
+    }
+    return num;
+}
+
+static void parent_select_collect(metrics_writer_t *writer, void *arg)
+{
+    parent_candidate_t candidates[CONFIG_APP_PARENT_CANDIDATES];
+    size_t num = parent_select_list(candidates, CONFIG_APP_PARENT_CANDIDATES);
+
+    metrics_printf(writer, "# TYPE parent_candidate_cost gauge\n# HELP parent_candidate_cost Cost to the root through the candidate parent, in ETX x 100\n");
+    for (size_t i = 0; i < num; i++)
+    {
+        metrics_printf(writer, "parent_candidate_cost{bssid=\"" MACSTR "\",level=\"%u\",current=\"%d\"} %" PRIu32 "\n",
+                       MAC2STR(candidates[i].bssid), candidates[i].level, candidates[i].current, candidates[i].cost);
+    }
+    metrics_printf(writer, "# TYPE parent_candidate_delivery gauge\n# HELP parent_candidate_delivery Average delivery ratio of the offers of the candidate parent, per mille\n");
+    for (size_t i = 0; i < num; i++)
+    {
+        metrics_printf(writer, "parent_candidate_delivery{bssid=\"" MACSTR "\"} %u\n", MAC2STR(candidates[i].bssid), candidates[i].delivery);
+    }
+}
+
+esp_err_t parent_select_init(void)
+{
+    metrics_counter_register(&parent_switches, "parent_switches", "Parent changes steered by the link cost");
+    metrics_counter_register(&parent_switch_failures, "parent_switch_failures", "Steered parent changes the station failed to complete");
+    metrics_collector_register(parent_select_collect, NULL);
+
+#if CONFIG_APP_PARENT_SELECT
+    esp_err_t ret = esp_mesh_lite_get_ssid_by_mac_cb_register(parent_ssid_by_mac, true);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+#endif
+
+    TimerHandle_t timer = xTimerCreate("parent_offer", pdMS_TO_TICKS(CONFIG_APP_PARENT_OFFER_INTERVAL_MS), pdTRUE,
+                                       NULL, parent_select_timer_cb);
+    if (timer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    xTimerStart(timer, portMAX_DELAY);
+    return ESP_OK;
+}
@@ -1,38 +1,442 @@
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include <math.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
 
 #include "esp_mac.h"
 #include "esp_bridge.h"
+#include "esp_mesh_lite.h"
+#if CONFIG_MESH_LITE_TIME_SYNC_ENABLE
+#include "esp_mesh_lite_time_sync.h"
+#endif
 #include "sdkconfig.h"
+#include "soc/soc_caps.h"
 #include "sensor.h"
+#include "sensor_ring.h"
+#include "sensor_codec.h"
+#include "startup.h"
+
+#if SOC_TEMP_SENSOR_SUPPORTED
+#include "driver/temperature_sensor.h"
+#endif
+
+/*
+ * Sensors are sampled by a single scheduler task driving a hashed timer wheel:
+ * every wheel tick only the sensors hashed into the current slot are looked at,
+ * whatever the number of sensors. Readings go through a lock-free SPSC ring to
+ * the transmit batcher (sensor_main_task), which packs them into ESP-NOW frames.
+ */
+
+#define SENSOR_WHEEL_SLOTS 64
+#define SENSOR_WHEEL_MASK (SENSOR_WHEEL_SLOTS - 1)
+#define SENSOR_WHEEL_TICK_MS CONFIG_SENSOR_WHEEL_TICK_MS
+/* esp_mesh_lite_espnow_send() takes one byte of the ESP-NOW frame for the data type */
+#define SENSOR_FRAME_LEN (ESPNOW_PAYLOAD_MAX_LEN - 1 - ESPNOW_PAYLOAD_HEAD_LEN)
+#define SENSOR_BATCH_MAX 64
+
+typedef struct sensor_entry
+{
+    const sensor_driver_t *driver;
+    void *ctx;
+    uint32_t sensor_id;
+    uint32_t period_ticks;
+    uint32_t rounds; // Full wheel turns left before the entry is due
+    struct sensor_entry *next;
+
+    sensor_report_policy_t policy;
+    sensor_report_stats_t stats;
+    bool reported;
+    float last_sent_value;
+    int64_t last_sent_time;
+    float last_value;
+    int64_t last_time;
+} sensor_entry_t;
 
 static const char *TAG = "sensor";
 static TaskHandle_t sensor_main_task_handle = NULL;
+static TaskHandle_t sensor_sched_task_handle = NULL;
+
+static sensor_entry_t sensor_entries[CONFIG_SENSOR_MAX_NUM];
+static uint32_t sensor_entry_num = 0;
+static sensor_entry_t *sensor_wheel[SENSOR_WHEEL_SLOTS];
+static uint32_t sensor_wheel_now = 0;
+static portMUX_TYPE sensor_wheel_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static sensor_ring_t sensor_ring;
+
+/* Must be called with sensor_wheel_lock held */
+static void sensor_wheel_insert(sensor_entry_t *entry, uint32_t delay_ticks)
+{
+    if (delay_ticks == 0)
+    {
+        delay_ticks = 1;
+    }
+
+    uint32_t slot = (sensor_wheel_now + delay_ticks) & SENSOR_WHEEL_MASK;
+    entry->rounds = (delay_ticks - 1) / SENSOR_WHEEL_SLOTS;
+    entry->next = sensor_wheel[slot];
+    sensor_wheel[slot] = entry;
+}
+
+static bool sensor_report_check(sensor_entry_t *entry, float value, int64_t now)
+{
+    sensor_report_policy_t policy;
+    taskENTER_CRITICAL(&sensor_wheel_lock);
+    policy = entry->policy;
+    taskEXIT_CRITICAL(&sensor_wheel_lock);
+
+    float last_value = entry->last_value;
+    int64_t last_time = entry->last_time;
+    entry->last_value = value;
+    entry->last_time = now;
+
+    if (!entry->reported)
+    {
+        return true;
+    }
+
+    int64_t elapsed_ms = (now - entry->last_sent_time) / 1000;
+    if (elapsed_ms < policy.min_interval_ms)
+    {
+        return false;
+    }
+
+    if (policy.max_interval_ms && elapsed_ms >= policy.max_interval_ms)
+    {
+        return true;
+    }
+
+    if (!policy.deadband_abs && !policy.deadband_rel && !policy.rate_of_change)
+    {
+        return true;
+    }
+
+    float diff = fabsf(value - entry->last_sent_value);
+    if (policy.deadband_abs && diff > policy.deadband_abs)
+    {
+        return true;
+    }
+
+    if (policy.deadband_rel && diff > policy.deadband_rel * fabsf(entry->last_sent_value))
+    {
+        return true;
+    }
+
+    if (policy.rate_of_change && now > last_time)
+    {
+        float rate = fabsf(value - last_value) * 1000000.0f / (now - last_time);
+        if (rate > policy.rate_of_change)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void sensor_sample_one(sensor_entry_t *entry)
+{
+    float value = 0;
+    if (entry->driver->sample(entry->ctx, &value) != ESP_OK)
+    {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (!sensor_report_check(entry, value, now))
+    {
+        entry->stats.suppressed++;
+        return;
+    }
+
+    sensor_packet_t packet = {
+#if CONFIG_MESH_LITE_TIME_SYNC_ENABLE
+        /* Mesh time, so that readings of different nodes line up on the receiver */
+        .timestamp = esp_mesh_lite_time_from_local(now),
+#else
+        .timestamp = now,
+#endif
+        .sensor_id = entry->sensor_id,
+        .type = entry->driver->type,
+    };
+    switch (entry->driver->type)
+    {
+    case SENSOR_TYPE_TEMPERATURE:
+        packet.data.temperature.value = value;
+        break;
+    case SENSOR_TYPE_HUMIDITY:
+        packet.data.humidity.value = value;
+        break;
+    default:
+        packet.data.generic.value = value;
+        break;
+    }
+
+    if (!sensor_ring_push(&sensor_ring, &packet))
+    {
+        /* Not sent: the next sample is still compared against what the receiver last got */
+        entry->stats.dropped++;
+#if CONFIG_APP_DEBUG
+        ESP_LOGW(TAG, "Sample ring full, dropped %" PRIu32 "", sensor_ring.dropped);
+#endif
+        return;
+    }
+    entry->stats.sent++;
+    entry->reported = true;
+    entry->last_sent_value = value;
+    entry->last_sent_time = now;
+
+    if (sensor_ring_count(&sensor_ring) >= SENSOR_BATCH_MAX / 2)
+    {
+        xTaskNotifyGive(sensor_main_task_handle);
+    }
+}
+
+static void sensor_sched_task(void *pvParameter)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    TickType_t tick_period = MAX(pdMS_TO_TICKS(SENSOR_WHEEL_TICK_MS), 1);
+
+    ESP_LOGI(TAG, "Start sensor_sched_task");
+
+    while (1)
+    {
+        /* Catches up tick by tick if sampling ran late, so periods do not drift */
+        vTaskDelayUntil(&last_wake, tick_period);
+
+        sensor_entry_t *due = NULL;
+        taskENTER_CRITICAL(&sensor_wheel_lock);
+        sensor_wheel_now++;
+        sensor_entry_t **link = &sensor_wheel[sensor_wheel_now & SENSOR_WHEEL_MASK];
+        while (*link)
+        {
+            sensor_entry_t *entry = *link;
+            if (entry->rounds)
+            {
+                entry->rounds--;
+                link = &entry->next;
+                continue;
+            }
+            *link = entry->next;
+            entry->next = due;
+            due = entry;
+        }
+        taskEXIT_CRITICAL(&sensor_wheel_lock);
+
+        while (due)
+        {
+            sensor_entry_t *entry = due;
+            due = entry->next;
+
+            sensor_sample_one(entry);
+
+            taskENTER_CRITICAL(&sensor_wheel_lock);
+            sensor_wheel_insert(entry, entry->period_ticks);
+            taskEXIT_CRITICAL(&sensor_wheel_lock);
+        }
+    }
+}
+
+esp_err_t sensor_register(const sensor_driver_t *driver, void *ctx, uint32_t sensor_id, uint32_t period_ms)
+{
+    if (driver == NULL || driver->sample == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (period_ms == 0)
+    {
+        period_ms = driver->period_ms;
+    }
+
+    if (driver->init)
+    {
+        esp_err_t ret = driver->init(ctx);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Init sensor %s fail: %s", driver->name, esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    taskENTER_CRITICAL(&sensor_wheel_lock);
+    if (sensor_entry_num >= CONFIG_SENSOR_MAX_NUM)
+    {
+        taskEXIT_CRITICAL(&sensor_wheel_lock);
+        ESP_LOGE(TAG, "Sensor registry full");
+        return ESP_ERR_NO_MEM;
+    }
+    sensor_entry_t *entry = &sensor_entries[sensor_entry_num++];
+    entry->driver = driver;
+    entry->ctx = ctx;
+    entry->sensor_id = sensor_id;
+    entry->period_ticks = MAX(period_ms / SENSOR_WHEEL_TICK_MS, 1);
+    entry->policy = driver->policy;
+    sensor_wheel_insert(entry, 1);
+    taskEXIT_CRITICAL(&sensor_wheel_lock);
+
+    ESP_LOGI(TAG, "Register sensor %s, id: %" PRIu32 ", period: %" PRIu32 " ms", driver->name, sensor_id, period_ms);
+    return ESP_OK;
+}
+
+static sensor_entry_t *sensor_find(uint32_t sensor_id)
+{
+    for (uint32_t i = 0; i < sensor_entry_num; i++)
+    {
+        if (sensor_entries[i].sensor_id == sensor_id)
+        {
+            return &sensor_entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t sensor_set_report_policy(uint32_t sensor_id, const sensor_report_policy_t *policy)
+{
+    if (policy == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-static void broadcast_sensor_readings(void)
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    taskENTER_CRITICAL(&sensor_wheel_lock);
+    sensor_entry_t *entry = sensor_find(sensor_id);
+    if (entry)
+    {
+        entry->policy = *policy;
+        ret = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&sensor_wheel_lock);
+    return ret;
+}
+
+esp_err_t sensor_get_report_stats(uint32_t sensor_id, sensor_report_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    taskENTER_CRITICAL(&sensor_wheel_lock);
+    sensor_entry_t *entry = sensor_find(sensor_id);
+    if (entry)
+    {
+        *stats = entry->stats;
+        ret = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&sensor_wheel_lock);
+    return ret;
+}
+
+static esp_err_t dummy_humidity_sample(void *ctx, float *value)
 {
     // dummy data
-    sensor_packet_t *msg_buffer = (sensor_packet_t *)malloc(sizeof(sensor_packet_t));
-    msg_buffer->timestamp = 0;
-    msg_buffer->sensor_id = 2;
-    msg_buffer->type = SENSOR_TYPE_HUMIDITY;
-    msg_buffer->data.humidity.value = 85.5f;
-    esp_now_send_broadcast((const uint8_t *)msg_buffer, sizeof(sensor_packet_t), true);
-    free(msg_buffer);
-    msg_buffer = NULL;
+    *value = 85.5f;
+    return ESP_OK;
 }
 
+static const sensor_driver_t dummy_humidity_driver = {
+    .name = "dummy_humidity",
+    .type = SENSOR_TYPE_HUMIDITY,
+    .period_ms = 10000, // frequent for debugging purposes..
+    .sample = dummy_humidity_sample,
+    .policy = {
+        .deadband_abs = 0.5f,
+        .max_interval_ms = 60000,
+    },
+};
+
+#if SOC_TEMP_SENSOR_SUPPORTED
+static temperature_sensor_handle_t chip_temperature_handle = NULL;
+
+static esp_err_t chip_temperature_init(void *ctx)
+{
+    temperature_sensor_config_t config = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+    esp_err_t ret = temperature_sensor_install(&config, &chip_temperature_handle);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    return temperature_sensor_enable(chip_temperature_handle);
+}
+
+static esp_err_t chip_temperature_sample(void *ctx, float *value)
+{
+    return temperature_sensor_get_celsius(chip_temperature_handle, value);
+}
+
+static const sensor_driver_t chip_temperature_driver = {
+    .name = "chip_temperature",
+    .type = SENSOR_TYPE_TEMPERATURE,
+    .period_ms = 30000,
+    .init = chip_temperature_init,
+    .sample = chip_temperature_sample,
+    .policy = {
+        .deadband_abs = 0.5f,
+        .rate_of_change = 0.1f,
+        .max_interval_ms = 300000,
+    },
+};
+#endif
+
+static sensor_packet_t sensor_batch[SENSOR_BATCH_MAX];
+static uint8_t sensor_frame[SENSOR_FRAME_LEN];
+
 static void sensor_main_task(void *pvParameter)
 {
+    size_t count = 0;
 
     ESP_LOGI(TAG, "Start sensor_main_task");
 
     while (1)
     {
-        broadcast_sensor_readings();
-        vTaskDelay(10000 / portTICK_PERIOD_MS); // frequent for debugging purposes..
+        /* Woken early by the scheduler once half a batch is waiting */
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_SENSOR_BATCH_TIMEOUT_MS));
+
+        do
+        {
+            while (count < SENSOR_BATCH_MAX && sensor_ring_pop(&sensor_ring, &sensor_batch[count]))
+            {
+                count++;
+            }
+            if (count == 0)
+            {
+                break;
+            }
+
+            size_t encoded = count;
+            // v2 sinks take frames up to 1470 bytes, everyone else 250
+            size_t frame_len = MIN(esp_now_sink_payload_max(), sizeof(sensor_frame));
+            size_t len = sensor_codec_encode(sensor_batch, &encoded, sensor_frame, frame_len);
+            if (encoded == 0)
+            {
+                ESP_LOGE(TAG, "Encode sensor frame fail");
+                count = 0;
+                break;
+            }
+#if CONFIG_APP_DEBUG
+            ESP_LOGI(TAG, "Send %u readings in %u bytes", (unsigned)encoded, (unsigned)len);
+#endif
+            esp_err_t ret = esp_now_send_to_sink(sensor_frame, len, true);
+            if (ret == ESP_ERR_TIMEOUT)
+            {
+                // The previous frame is still in flight, keep the batch for the next round
+                break;
+            }
+            if (ret == ESP_OK)
+            {
+                startup_signal(STARTUP_STAGE_SENSOR_TX);
+            }
+
+            count -= encoded;
+            memmove(sensor_batch, &sensor_batch[encoded], count * sizeof(sensor_packet_t));
+        } while (count || sensor_ring_count(&sensor_ring));
     }
 }
 
@@ -40,5 +444,11 @@ esp_err_t init_sensor_read_task(void)
 {
     esp_err_t ret = ESP_OK;
     xTaskCreate(sensor_main_task, "sensor_main_task", SENSOR_MAIN_TASK_STACK_SIZE, NULL, SENSOR_MAIN_TASK_PRIORITY, &sensor_main_task_handle);
+    xTaskCreate(sensor_sched_task, "sensor_sched_task", SENSOR_SCHED_TASK_STACK_SIZE, NULL, SENSOR_SCHED_TASK_PRIORITY, &sensor_sched_task_handle);
+
+    sensor_register(&dummy_humidity_driver, NULL, 2, 0);
+#if SOC_TEMP_SENSOR_SUPPORTED
+    sensor_register(&chip_temperature_driver, NULL, 1, 0);
+#endif
     return ret;
-}
\ No newline at end of file
+}
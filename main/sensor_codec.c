@@ -0,0 +1,523 @@
+#include <string.h>
+#include <math.h>
+#include <sys/param.h>
+#include "sensor_codec.h"
+
+/*
+ * Frame layout, as a bit stream (MSB first):
+ *
+ *   u8 version, u8 series_num
+ *   per series: varint sensor_id, u8 type, u8 codec, u8 count
+ *     timestamps: varint t0 (ms), then per reading a delta-of-delta bucket
+ *       '0' = 0, '10' + 7 bits, '110' + 12 bits, '111' + varint (zigzag)
+ *     values, QDELTA:  zigzag varint q0, then zigzag varint deltas
+ *             GORILLA: 32 raw bits, then per reading '0' if equal, else '1' and
+ *                      '0' + bits in the previous window, or '1' + 5 bits leading
+ *                      zeros + 5 bits (length - 1) + meaningful bits
+ *
+ * Timestamps and values of a reading are written together, so a frame can be cut
+ * between any two readings.
+ */
+
+#define SENSOR_CODEC_SERIES_MAX 255
+#define SENSOR_CODEC_QUANTUM 100.0f
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t len;     // In bits
+    size_t pos;     // In bits
+    bool overflow;
+} bit_writer_t;
+
+typedef struct
+{
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool overflow;
+} bit_reader_t;
+
+static void bits_put(bit_writer_t *w, uint32_t value, uint8_t n)
+{
+    if (w->pos + n > w->len)
+    {
+        w->overflow = true;
+        return;
+    }
+
+    while (n--)
+    {
+        uint8_t mask = 0x80 >> (w->pos & 7);
+        if ((value >> n) & 1)
+        {
+            w->buf[w->pos >> 3] |= mask;
+        }
+        else
+        {
+            w->buf[w->pos >> 3] &= ~mask;
+        }
+        w->pos++;
+    }
+}
+
+static uint32_t bits_get(bit_reader_t *r, uint8_t n)
+{
+    uint32_t value = 0;
+
+    if (r->pos + n > r->len)
+    {
+        r->overflow = true;
+        return 0;
+    }
+
+    while (n--)
+    {
+        value = (value << 1) | ((r->buf[r->pos >> 3] >> (7 - (r->pos & 7))) & 1);
+        r->pos++;
+    }
+    return value;
+}
+
+static void varint_put(bit_writer_t *w, uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        bits_put(w, byte | (value ? 0x80 : 0), 8);
+    } while (value && !w->overflow);
+}
+
+static uint64_t varint_get(bit_reader_t *r)
+{
+    uint64_t value = 0;
+
+    for (uint8_t shift = 0; shift < 64 && !r->overflow; shift += 7)
+    {
+        uint8_t byte = bits_get(r, 8);
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+static inline uint64_t zigzag_encode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+sensor_codec_t sensor_codec_select(sensor_type_t type)
+{
+    switch (type)
+    {
+    case SENSOR_TYPE_TEMPERATURE:
+    case SENSOR_TYPE_HUMIDITY:
+        return SENSOR_CODEC_QDELTA;
+    default:
+        return SENSOR_CODEC_GORILLA;
+    }
+}
+
+static float sensor_packet_value(const sensor_packet_t *packet)
+{
+    switch (packet->type)
+    {
+    case SENSOR_TYPE_TEMPERATURE:
+        return packet->data.temperature.value;
+    case SENSOR_TYPE_HUMIDITY:
+        return packet->data.humidity.value;
+    default:
+        return packet->data.generic.value;
+    }
+}
+
+static void sensor_packet_set_value(sensor_packet_t *packet, float value)
+{
+    switch (packet->type)
+    {
+    case SENSOR_TYPE_TEMPERATURE:
+        packet->data.temperature.value = value;
+        break;
+    case SENSOR_TYPE_HUMIDITY:
+        packet->data.humidity.value = value;
+        break;
+    default:
+        packet->data.generic.value = value;
+        break;
+    }
+}
+
+static void timestamp_put(bit_writer_t *w, sensor_codec_state_t *s, size_t index, int64_t ts)
+{
+    if (index == 0)
+    {
+        varint_put(w, ts);
+        s->prev_ts = ts;
+        s->prev_delta = 0;
+        return;
+    }
+
+    int64_t delta = ts - s->prev_ts;
+    uint64_t dod = zigzag_encode(delta - s->prev_delta);
+    if (dod == 0)
+    {
+        bits_put(w, 0, 1);
+    }
+    else if (dod < (1 << 7))
+    {
+        bits_put(w, 0x2, 2);
+        bits_put(w, dod, 7);
+    }
+    else if (dod < (1 << 12))
+    {
+        bits_put(w, 0x6, 3);
+        bits_put(w, dod, 12);
+    }
+    else
+    {
+        bits_put(w, 0x7, 3);
+        varint_put(w, dod);
+    }
+    s->prev_ts = ts;
+    s->prev_delta = delta;
+}
+
+static int64_t timestamp_get(bit_reader_t *r, sensor_codec_state_t *s, size_t index)
+{
+    if (index == 0)
+    {
+        s->prev_ts = varint_get(r);
+        s->prev_delta = 0;
+        return s->prev_ts;
+    }
+
+    uint64_t dod = 0;
+    if (bits_get(r, 1))
+    {
+        if (!bits_get(r, 1))
+        {
+            dod = bits_get(r, 7);
+        }
+        else if (!bits_get(r, 1))
+        {
+            dod = bits_get(r, 12);
+        }
+        else
+        {
+            dod = varint_get(r);
+        }
+    }
+    s->prev_delta += zigzag_decode(dod);
+    s->prev_ts += s->prev_delta;
+    return s->prev_ts;
+}
+
+static void gorilla_put(bit_writer_t *w, sensor_codec_state_t *s, size_t index, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (index == 0)
+    {
+        bits_put(w, bits, 32);
+        s->prev_bits = bits;
+        s->leading = UINT8_MAX;
+        return;
+    }
+
+    uint32_t xor = bits ^ s->prev_bits;
+    s->prev_bits = bits;
+    if (xor == 0)
+    {
+        bits_put(w, 0, 1);
+        return;
+    }
+
+    uint8_t leading = MIN(__builtin_clz(xor), 31);
+    uint8_t trailing = __builtin_ctz(xor);
+    bits_put(w, 1, 1);
+    if (s->leading != UINT8_MAX && leading >= s->leading && trailing >= s->trailing)
+    {
+        bits_put(w, 0, 1);
+        bits_put(w, xor >> s->trailing, 32 - s->leading - s->trailing);
+        return;
+    }
+
+    uint8_t length = 32 - leading - trailing;
+    bits_put(w, 1, 1);
+    bits_put(w, leading, 5);
+    bits_put(w, length - 1, 5);
+    bits_put(w, xor >> trailing, length);
+    s->leading = leading;
+    s->trailing = trailing;
+}
+
+static float gorilla_get(bit_reader_t *r, sensor_codec_state_t *s, size_t index)
+{
+    float value;
+
+    if (index == 0)
+    {
+        s->prev_bits = bits_get(r, 32);
+        s->leading = UINT8_MAX;
+    }
+    else if (bits_get(r, 1))
+    {
+        if (bits_get(r, 1))
+        {
+            uint8_t leading = bits_get(r, 5);
+            uint8_t length = bits_get(r, 5) + 1;
+            if (leading + length > 32)
+            {
+                r->overflow = true;
+                return 0;
+            }
+            s->leading = leading;
+            s->trailing = 32 - leading - length;
+        }
+        if (s->leading == UINT8_MAX)
+        {
+            r->overflow = true;
+            return 0;
+        }
+        s->prev_bits ^= bits_get(r, 32 - s->leading - s->trailing) << s->trailing;
+    }
+
+    memcpy(&value, &s->prev_bits, sizeof(value));
+    return value;
+}
+
+static void qdelta_put(bit_writer_t *w, sensor_codec_state_t *s, size_t index, float value)
+{
+    int32_t q = lroundf(value * SENSOR_CODEC_QUANTUM);
+    varint_put(w, zigzag_encode(index == 0 ? q : (int64_t)q - s->prev_q));
+    s->prev_q = q;
+}
+
+static float qdelta_get(bit_reader_t *r, sensor_codec_state_t *s, size_t index)
+{
+    int64_t q = zigzag_decode(varint_get(r));
+    s->prev_q = index == 0 ? q : s->prev_q + q;
+    return s->prev_q / SENSOR_CODEC_QUANTUM;
+}
+
+static void sensor_codec_put(bit_writer_t *w, sensor_codec_t codec, sensor_codec_state_t *s, size_t index, int64_t ts, float value)
+{
+    timestamp_put(w, s, index, ts);
+    if (codec == SENSOR_CODEC_QDELTA)
+    {
+        qdelta_put(w, s, index, value);
+    }
+    else
+    {
+        gorilla_put(w, s, index, value);
+    }
+}
+
+static float sensor_codec_get(bit_reader_t *r, sensor_codec_t codec, sensor_codec_state_t *s, size_t index, int64_t *ts)
+{
+    *ts = timestamp_get(r, s, index);
+    return codec == SENSOR_CODEC_QDELTA ? qdelta_get(r, s, index) : gorilla_get(r, s, index);
+}
+
+/* Move the later readings of the sensor at packets[0] right behind it, keeping their order */
+static size_t sensor_codec_group(sensor_packet_t *packets, size_t count)
+{
+    size_t end = 1;
+
+    for (size_t i = 1; i < count && end < SENSOR_CODEC_SERIES_MAX; i++)
+    {
+        if (packets[i].sensor_id != packets[0].sensor_id || packets[i].type != packets[0].type)
+        {
+            continue;
+        }
+        if (i != end)
+        {
+            sensor_packet_t tmp = packets[i];
+            memmove(&packets[end + 1], &packets[end], (i - end) * sizeof(sensor_packet_t));
+            packets[end] = tmp;
+        }
+        end++;
+    }
+    return end;
+}
+
+size_t sensor_codec_encode(sensor_packet_t *packets, size_t *count, uint8_t *buf, size_t buf_len)
+{
+    bit_writer_t w = {.buf = buf, .len = buf_len * 8};
+    size_t done = 0;
+    uint8_t series_num = 0;
+
+    bits_put(&w, SENSOR_CODEC_VERSION, 8);
+    bits_put(&w, 0, 8); // series_num, patched below
+    if (w.overflow)
+    {
+        *count = 0;
+        return 0;
+    }
+
+    while (done < *count && series_num < SENSOR_CODEC_SERIES_MAX)
+    {
+        size_t end = done + sensor_codec_group(&packets[done], *count - done);
+        sensor_codec_t codec = sensor_codec_select(packets[done].type);
+        sensor_codec_state_t state = {0};
+        size_t series_start = w.pos;
+
+        varint_put(&w, packets[done].sensor_id);
+        bits_put(&w, packets[done].type, 8);
+        bits_put(&w, codec, 8);
+        size_t count_pos = w.pos;
+        bits_put(&w, 0, 8); // count, patched below
+
+        size_t n = 0;
+        while (!w.overflow && done + n < end)
+        {
+            bit_writer_t saved_w = w;
+            sensor_codec_state_t saved_state = state;
+            const sensor_packet_t *packet = &packets[done + n];
+
+            sensor_codec_put(&w, codec, &state, n, packet->timestamp / 1000, sensor_packet_value(packet));
+
+            if (w.overflow)
+            {
+                w = saved_w;
+                state = saved_state;
+                w.overflow = true;
+                break;
+            }
+            n++;
+        }
+
+        if (n == 0)
+        {
+            w.pos = series_start;
+            break;
+        }
+
+        size_t pos = w.pos;
+        w.pos = count_pos;
+        bits_put(&w, n, 8);
+        w.pos = pos;
+        series_num++;
+        done += n;
+
+        if (w.overflow)
+        {
+            break;
+        }
+    }
+
+    w.overflow = false;
+    size_t pos = w.pos;
+    w.pos = 8;
+    bits_put(&w, series_num, 8);
+
+    *count = done;
+    return (pos + 7) / 8;
+}
+
+esp_err_t sensor_codec_decode(const uint8_t *buf, size_t len, sensor_codec_cb_t cb, void *arg)
+{
+    bit_reader_t r = {.buf = buf, .len = len * 8};
+
+    if (bits_get(&r, 8) != SENSOR_CODEC_VERSION)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint8_t series_num = bits_get(&r, 8);
+    for (uint8_t i = 0; i < series_num && !r.overflow; i++)
+    {
+        sensor_codec_state_t state = {0};
+        sensor_packet_t packet = {0};
+
+        packet.sensor_id = varint_get(&r);
+        packet.type = bits_get(&r, 8);
+        sensor_codec_t codec = bits_get(&r, 8);
+        uint8_t n = bits_get(&r, 8);
+        if (codec > SENSOR_CODEC_GORILLA)
+        {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+
+        for (uint8_t j = 0; j < n && !r.overflow; j++)
+        {
+            int64_t ts;
+            float value = sensor_codec_get(&r, codec, &state, j, &ts);
+            packet.timestamp = ts * 1000;
+            if (r.overflow)
+            {
+                break;
+            }
+            sensor_packet_set_value(&packet, value);
+            cb(&packet, arg);
+        }
+    }
+
+    return r.overflow ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+void sensor_codec_series_init(sensor_codec_series_t *series, sensor_codec_t codec)
+{
+    memset(series, 0, sizeof(sensor_codec_series_t));
+    series->codec = codec;
+}
+
+bool sensor_codec_series_append(sensor_codec_series_t *series, uint8_t *buf, size_t buf_len, int64_t timestamp_ms, float value)
+{
+    bit_writer_t w = {.buf = buf, .len = buf_len * 8, .pos = series->bits};
+    sensor_codec_state_t saved_state = series->state;
+
+    if (series->count == UINT16_MAX)
+    {
+        return false;
+    }
+
+    sensor_codec_put(&w, series->codec, &series->state, series->count, timestamp_ms, value);
+    if (w.overflow)
+    {
+        series->state = saved_state;
+        return false;
+    }
+
+    series->bits = w.pos;
+    series->count++;
+    return true;
+}
+
+esp_err_t sensor_codec_series_decode(sensor_codec_t codec, uint16_t count, const uint8_t *buf, size_t buf_len,
+                                     sensor_codec_point_cb_t cb, void *arg)
+{
+    bit_reader_t r = {.buf = buf, .len = buf_len * 8};
+    sensor_codec_state_t state = {0};
+
+    if (codec > SENSOR_CODEC_GORILLA)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        int64_t ts;
+        float value = sensor_codec_get(&r, codec, &state, i, &ts);
+        if (r.overflow)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (cb(ts, value, arg))
+        {
+            break;
+        }
+    }
+
+    return ESP_OK;
+}
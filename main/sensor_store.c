@@ -0,0 +1,610 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <float.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "sdkconfig.h"
+#include "sensor_codec.h"
+#include "sensor_store.h"
+
+/*
+ * Every series keeps its raw readings in a ring of fixed-size chunks, each one an
+ * appendable sensor_codec series, plus rings of 1 minute and 1 hour rollup buckets.
+ * When the ring is full the oldest chunk is dropped, or with CONFIG_SENSOR_STORE_SPILL
+ * appended to a log in a flash partition first.
+ *
+ * The flash log is a ring of sectors. Records never cross a sector boundary, and a
+ * sector is erased right before the first record is written into it, so the oldest
+ * data is always the sector after the one holding the newest record.
+ *
+ * Queries scan the flash log without s_store_lock, under s_log_lock, so that readings
+ * keep coming in meanwhile. s_log_lock is taken after s_store_lock when both are held.
+ */
+
+#define STORE_MINUTE_MS (60 * 1000)
+#define STORE_HOUR_MS (60 * 60 * 1000)
+#define STORE_CHUNK_NUM CONFIG_SENSOR_STORE_CHUNK_NUM
+#define STORE_CHUNK_SIZE CONFIG_SENSOR_STORE_CHUNK_SIZE
+/* Open addressing at most half full, a lookup ends at the first empty slot */
+#define STORE_INDEX_SIZE (2 * CONFIG_SENSOR_STORE_MAX_SERIES)
+
+typedef struct
+{
+    int64_t first_ts;
+    int64_t last_ts;
+    sensor_codec_series_t enc;
+    uint8_t data[STORE_CHUNK_SIZE];
+} store_chunk_t;
+
+typedef struct
+{
+    int32_t index;      // Start of the bucket, in bucket periods
+    uint32_t count;
+    float min;
+    float max;
+    float sum;
+} store_bucket_t;
+
+typedef struct
+{
+    uint8_t mac[6];
+    uint32_t sensor_id;
+    sensor_type_t type;
+    uint32_t count;
+    int64_t last_ts;
+    float last_value;
+
+    uint8_t chunk_first;
+    uint8_t chunk_num;
+    store_chunk_t chunks[STORE_CHUNK_NUM];
+
+    store_bucket_t minutes[CONFIG_SENSOR_STORE_MINUTE_BUCKETS];
+    store_bucket_t hours[CONFIG_SENSOR_STORE_HOUR_BUCKETS];
+} store_series_t;
+
+typedef struct
+{
+    int64_t from;
+    int64_t to;
+    sensor_store_point_t *points;
+    size_t max_num;
+    size_t num;
+    sensor_store_bucket_t *agg;
+    double sum;
+} store_visit_t;
+
+static const char *TAG = "sensor_store";
+
+static store_series_t *s_series[CONFIG_SENSOR_STORE_MAX_SERIES];
+static size_t s_series_num = 0;
+static uint16_t s_series_index[STORE_INDEX_SIZE]; // Position in s_series + 1, 0 for an empty slot
+static SemaphoreHandle_t s_store_lock = NULL;
+
+#if CONFIG_SENSOR_STORE_SPILL
+#define STORE_LOG_MAGIC 0x5354
+
+typedef struct
+{
+    uint16_t magic;
+    uint16_t len;           // Data bytes following the record header
+    uint32_t seq;
+    uint8_t mac[6];
+    uint8_t type;
+    uint8_t codec;
+    uint32_t sensor_id;
+    uint16_t count;
+    uint16_t bits;
+    int64_t first_ts;
+    int64_t last_ts;
+    uint32_t crc;           // Of the header up to here and the data
+} __attribute__((packed)) store_log_record_t;
+
+static const esp_partition_t *s_log_partition = NULL;
+static SemaphoreHandle_t s_log_lock = NULL;
+static uint32_t s_log_offset = 0;
+static uint32_t s_log_seq = 0;        // Written under both locks, either one is enough to read it
+static uint8_t *s_log_buf = NULL;
+
+static uint32_t store_log_crc(const store_log_record_t *record, const uint8_t *data)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(store_log_record_t, crc));
+    return esp_rom_crc32_le(crc, data, record->len);
+}
+
+static bool store_log_record_read(uint32_t offset, uint32_t sector_end, store_log_record_t *record)
+{
+    if (offset + sizeof(store_log_record_t) > sector_end
+            || esp_partition_read(s_log_partition, offset, record, sizeof(store_log_record_t)) != ESP_OK)
+    {
+        return false;
+    }
+
+    return record->magic == STORE_LOG_MAGIC && offset + sizeof(store_log_record_t) + record->len <= sector_end;
+}
+
+static esp_err_t store_log_init(void)
+{
+    s_log_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                               CONFIG_SENSOR_STORE_SPILL_PARTITION_LABEL);
+    if (s_log_partition == NULL)
+    {
+        ESP_LOGW(TAG, "No \"%s\" partition, spilling to flash is disabled", CONFIG_SENSOR_STORE_SPILL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_log_buf = malloc(STORE_CHUNK_SIZE);
+    s_log_lock = xSemaphoreCreateMutex();
+    if (s_log_buf == NULL || s_log_lock == NULL)
+    {
+        free(s_log_buf);
+        s_log_buf = NULL;
+        if (s_log_lock)
+        {
+            vSemaphoreDelete(s_log_lock);
+            s_log_lock = NULL;
+        }
+        s_log_partition = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* The newest sector is the one whose first record has the highest sequence number */
+    uint32_t sector_size = s_log_partition->erase_size;
+    uint32_t head = UINT32_MAX;
+    uint32_t head_seq = 0;
+    store_log_record_t record;
+    for (uint32_t sector = 0; sector < s_log_partition->size; sector += sector_size)
+    {
+        if (store_log_record_read(sector, sector + sector_size, &record) && (head == UINT32_MAX || record.seq > head_seq))
+        {
+            head = sector;
+            head_seq = record.seq;
+        }
+    }
+
+    if (head == UINT32_MAX)
+    {
+        s_log_offset = 0;
+        s_log_seq = 0;
+        return ESP_OK;
+    }
+
+    s_log_offset = head;
+    s_log_seq = head_seq;
+    while (store_log_record_read(s_log_offset, head + sector_size, &record))
+    {
+        s_log_seq = record.seq + 1;
+        s_log_offset += sizeof(store_log_record_t) + record.len;
+    }
+    s_log_offset %= s_log_partition->size;
+
+    ESP_LOGI(TAG, "Flash log at 0x%" PRIx32 ", seq %" PRIu32 "", s_log_offset, s_log_seq);
+    return ESP_OK;
+}
+
+static void store_log_append(const store_series_t *series, const store_chunk_t *chunk)
+{
+    if (s_log_partition == NULL)
+    {
+        return;
+    }
+
+    uint32_t sector_size = s_log_partition->erase_size;
+    store_log_record_t record = {
+        .magic = STORE_LOG_MAGIC,
+        .len = (chunk->enc.bits + 7) / 8,
+        .type = series->type,
+        .codec = chunk->enc.codec,
+        .sensor_id = series->sensor_id,
+        .count = chunk->enc.count,
+        .bits = chunk->enc.bits,
+        .first_ts = chunk->first_ts,
+        .last_ts = chunk->last_ts,
+    };
+    memcpy(record.mac, series->mac, sizeof(record.mac));
+
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    record.seq = s_log_seq++;
+    record.crc = store_log_crc(&record, chunk->data);
+
+    uint32_t size = sizeof(record) + record.len;
+    uint32_t sector_end = s_log_offset - s_log_offset % sector_size + sector_size;
+    if (s_log_offset + size > sector_end)
+    {
+        s_log_offset = sector_end % s_log_partition->size;
+    }
+    if (s_log_offset % sector_size == 0 && esp_partition_erase_range(s_log_partition, s_log_offset, sector_size) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Erase flash log at 0x%" PRIx32 " fail", s_log_offset);
+        xSemaphoreGive(s_log_lock);
+        return;
+    }
+
+    if (esp_partition_write(s_log_partition, s_log_offset, &record, sizeof(record)) != ESP_OK
+            || esp_partition_write(s_log_partition, s_log_offset + sizeof(record), chunk->data, record.len) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Write flash log at 0x%" PRIx32 " fail", s_log_offset);
+    }
+    s_log_offset = (s_log_offset + size) % s_log_partition->size;
+    xSemaphoreGive(s_log_lock);
+}
+
+/* Records from seq_end on are skipped, they were still in RAM when the caller looked */
+static void store_log_visit(const uint8_t mac[6], uint32_t sensor_id, uint32_t seq_end, sensor_codec_point_cb_t cb,
+                            store_visit_t *visit)
+{
+    if (s_log_partition == NULL)
+    {
+        return;
+    }
+
+    /*
+     * Oldest sector first: the one after the sector being written, or the sector at the
+     * write offset itself if it is sector aligned, as that one is not erased yet.
+     * The erased space behind the newest record ends the walk of its sector.
+     */
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    uint32_t sector_size = s_log_partition->erase_size;
+    uint32_t oldest = s_log_offset - s_log_offset % sector_size + (s_log_offset % sector_size ? sector_size : 0);
+    for (uint32_t i = 0; i < s_log_partition->size / sector_size; i++)
+    {
+        uint32_t sector = (oldest + i * sector_size) % s_log_partition->size;
+        uint32_t offset = sector;
+        store_log_record_t record;
+
+        while (store_log_record_read(offset, sector + sector_size, &record))
+        {
+            if (record.sensor_id == sensor_id && !memcmp(record.mac, mac, sizeof(record.mac)) && record.seq < seq_end
+                    && record.last_ts >= visit->from && record.first_ts <= visit->to && record.len <= STORE_CHUNK_SIZE
+                    && esp_partition_read(s_log_partition, offset + sizeof(record), s_log_buf, record.len) == ESP_OK
+                    && store_log_crc(&record, s_log_buf) == record.crc)
+            {
+                sensor_codec_series_decode(record.codec, record.count, s_log_buf, record.len, cb, visit);
+            }
+            offset += sizeof(record) + record.len;
+        }
+    }
+    xSemaphoreGive(s_log_lock);
+}
+#endif /* CONFIG_SENSOR_STORE_SPILL */
+
+static inline uint32_t store_series_hash(const uint8_t mac[6], uint32_t sensor_id)
+{
+    // The OUI is shared by the whole fleet
+    uint32_t key = ((uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5]) ^ sensor_id * 0x9e3779b9u;
+    return (key * 2654435761u) >> 8;
+}
+
+static store_series_t *store_series_find(const uint8_t mac[6], uint32_t sensor_id)
+{
+    uint32_t hash = store_series_hash(mac, sensor_id);
+    for (size_t i = 0; i < STORE_INDEX_SIZE; i++)
+    {
+        uint16_t slot = s_series_index[(hash + i) % STORE_INDEX_SIZE];
+        if (slot == 0)
+        {
+            break;
+        }
+        store_series_t *series = s_series[slot - 1];
+        if (series->sensor_id == sensor_id && !memcmp(series->mac, mac, 6))
+        {
+            return series;
+        }
+    }
+    return NULL;
+}
+
+/* Series are never removed, so a slot once taken stays on the probe sequence of its series */
+static void store_series_index_add(size_t pos)
+{
+    uint32_t hash = store_series_hash(s_series[pos]->mac, s_series[pos]->sensor_id);
+    size_t i = 0;
+    while (s_series_index[(hash + i) % STORE_INDEX_SIZE])
+    {
+        i++;
+    }
+    s_series_index[(hash + i) % STORE_INDEX_SIZE] = pos + 1;
+}
+
+static void store_bucket_update(store_bucket_t *buckets, size_t bucket_num, int64_t period, int64_t ts, float value)
+{
+    int32_t index = ts / period;
+    store_bucket_t *bucket = &buckets[index % bucket_num];
+
+    if (bucket->count == 0 || bucket->index != index)
+    {
+        bucket->index = index;
+        bucket->count = 0;
+        bucket->min = value;
+        bucket->max = value;
+        bucket->sum = 0;
+    }
+    bucket->count++;
+    bucket->min = MIN(bucket->min, value);
+    bucket->max = MAX(bucket->max, value);
+    bucket->sum += value;
+}
+
+static bool store_visit_cb(int64_t timestamp_ms, float value, void *arg)
+{
+    store_visit_t *visit = (store_visit_t *)arg;
+
+    if (timestamp_ms < visit->from || timestamp_ms > visit->to)
+    {
+        return false;
+    }
+
+    if (visit->points)
+    {
+        if (visit->num == visit->max_num)
+        {
+            return true;
+        }
+        visit->points[visit->num].timestamp = timestamp_ms;
+        visit->points[visit->num].value = value;
+    }
+
+    if (visit->agg)
+    {
+        visit->agg->min = MIN(visit->agg->min, value);
+        visit->agg->max = MAX(visit->agg->max, value);
+        visit->sum += value;
+    }
+    visit->num++;
+    return false;
+}
+
+static inline bool store_chunk_in_range(const store_chunk_t *chunk, const store_visit_t *visit)
+{
+    return chunk->last_ts >= visit->from && chunk->first_ts <= visit->to;
+}
+
+static inline void store_chunk_visit(const store_chunk_t *chunk, store_visit_t *visit)
+{
+    sensor_codec_series_decode(chunk->enc.codec, chunk->enc.count, chunk->data, sizeof(chunk->data), store_visit_cb, visit);
+}
+
+/*
+ * The flash log first, it holds the older readings. With a log, the chunks in range are
+ * copied under s_store_lock and the log is scanned after it is released, up to the
+ * records spilled from the copy. Returns false if there is no such series.
+ */
+static bool store_series_visit(const uint8_t mac[6], uint32_t sensor_id, store_visit_t *visit)
+{
+    xSemaphoreTake(s_store_lock, portMAX_DELAY);
+    const store_series_t *series = store_series_find(mac, sensor_id);
+    if (series == NULL)
+    {
+        xSemaphoreGive(s_store_lock);
+        return false;
+    }
+
+#if CONFIG_SENSOR_STORE_SPILL
+    store_chunk_t *chunks = s_log_partition ? malloc(series->chunk_num * sizeof(store_chunk_t)) : NULL;
+    if (chunks)
+    {
+        uint8_t chunk_num = 0;
+        for (uint8_t i = 0; i < series->chunk_num; i++)
+        {
+            const store_chunk_t *chunk = &series->chunks[(series->chunk_first + i) % STORE_CHUNK_NUM];
+            if (store_chunk_in_range(chunk, visit))
+            {
+                chunks[chunk_num++] = *chunk;
+            }
+        }
+        uint32_t seq_end = s_log_seq;
+        xSemaphoreGive(s_store_lock);
+
+        store_log_visit(mac, sensor_id, seq_end, store_visit_cb, visit);
+        for (uint8_t i = 0; i < chunk_num; i++)
+        {
+            store_chunk_visit(&chunks[i], visit);
+        }
+        free(chunks);
+        return true;
+    }
+    /* Without memory for the copy the log is scanned under the lock */
+    store_log_visit(mac, sensor_id, s_log_seq, store_visit_cb, visit);
+#endif
+
+    for (uint8_t i = 0; i < series->chunk_num; i++)
+    {
+        const store_chunk_t *chunk = &series->chunks[(series->chunk_first + i) % STORE_CHUNK_NUM];
+        if (store_chunk_in_range(chunk, visit))
+        {
+            store_chunk_visit(chunk, visit);
+        }
+    }
+    xSemaphoreGive(s_store_lock);
+    return true;
+}
+
+esp_err_t sensor_store_add(const uint8_t mac[6], const sensor_packet_t *packet)
+{
+    float value;
+    switch (packet->type)
+    {
+    case SENSOR_TYPE_TEMPERATURE:
+        value = packet->data.temperature.value;
+        break;
+    case SENSOR_TYPE_HUMIDITY:
+        value = packet->data.humidity.value;
+        break;
+    default:
+        value = packet->data.generic.value;
+        break;
+    }
+    int64_t ts = packet->timestamp / 1000;
+
+    xSemaphoreTake(s_store_lock, portMAX_DELAY);
+    store_series_t *series = store_series_find(mac, packet->sensor_id);
+    if (series == NULL)
+    {
+        if (s_series_num == CONFIG_SENSOR_STORE_MAX_SERIES || (series = calloc(1, sizeof(store_series_t))) == NULL)
+        {
+            xSemaphoreGive(s_store_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(series->mac, mac, sizeof(series->mac));
+        series->sensor_id = packet->sensor_id;
+        series->type = packet->type;
+        s_series[s_series_num] = series;
+        store_series_index_add(s_series_num++);
+    }
+
+    store_chunk_t *chunk = series->chunk_num ? &series->chunks[(series->chunk_first + series->chunk_num - 1) % STORE_CHUNK_NUM] : NULL;
+    if (chunk == NULL || !sensor_codec_series_append(&chunk->enc, chunk->data, sizeof(chunk->data), ts, value))
+    {
+        if (series->chunk_num == STORE_CHUNK_NUM)
+        {
+#if CONFIG_SENSOR_STORE_SPILL
+            store_log_append(series, &series->chunks[series->chunk_first]);
+#endif
+            series->chunk_first = (series->chunk_first + 1) % STORE_CHUNK_NUM;
+            series->chunk_num--;
+        }
+
+        chunk = &series->chunks[(series->chunk_first + series->chunk_num) % STORE_CHUNK_NUM];
+        series->chunk_num++;
+        sensor_codec_series_init(&chunk->enc, sensor_codec_select(packet->type));
+        chunk->first_ts = ts;
+        chunk->last_ts = ts;
+        sensor_codec_series_append(&chunk->enc, chunk->data, sizeof(chunk->data), ts, value);
+    }
+    chunk->first_ts = MIN(chunk->first_ts, ts);
+    chunk->last_ts = MAX(chunk->last_ts, ts);
+
+    store_bucket_update(series->minutes, CONFIG_SENSOR_STORE_MINUTE_BUCKETS, STORE_MINUTE_MS, ts, value);
+    store_bucket_update(series->hours, CONFIG_SENSOR_STORE_HOUR_BUCKETS, STORE_HOUR_MS, ts, value);
+
+    series->count++;
+    series->last_ts = ts;
+    series->last_value = value;
+    xSemaphoreGive(s_store_lock);
+
+    return ESP_OK;
+}
+
+size_t sensor_store_list(sensor_store_series_info_t *list, size_t max_num)
+{
+    xSemaphoreTake(s_store_lock, portMAX_DELAY);
+    for (size_t i = 0; list && i < s_series_num && i < max_num; i++)
+    {
+        memcpy(list[i].mac, s_series[i]->mac, sizeof(list[i].mac));
+        list[i].sensor_id = s_series[i]->sensor_id;
+        list[i].type = s_series[i]->type;
+        list[i].count = s_series[i]->count;
+        list[i].last_ts = s_series[i]->last_ts;
+        list[i].last_value = s_series[i]->last_value;
+    }
+    size_t num = s_series_num;
+    xSemaphoreGive(s_store_lock);
+
+    return num;
+}
+
+size_t sensor_store_query(const uint8_t mac[6], uint32_t sensor_id, int64_t from, int64_t to,
+                          sensor_store_point_t *points, size_t max_num)
+{
+    store_visit_t visit = {
+        .from = from,
+        .to = to,
+        .points = points,
+        .max_num = max_num,
+    };
+
+    store_series_visit(mac, sensor_id, &visit);
+    return visit.num;
+}
+
+esp_err_t sensor_store_aggregate(const uint8_t mac[6], uint32_t sensor_id, int64_t from, int64_t to,
+                                 sensor_store_bucket_t *result)
+{
+    store_visit_t visit = {
+        .from = from,
+        .to = to,
+        .agg = result,
+    };
+
+    memset(result, 0, sizeof(sensor_store_bucket_t));
+    result->start = from;
+    result->min = FLT_MAX;
+    result->max = -FLT_MAX;
+
+    if (!store_series_visit(mac, sensor_id, &visit))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    result->count = visit.num;
+    if (visit.num)
+    {
+        result->avg = visit.sum / visit.num;
+    }
+    else
+    {
+        result->min = 0;
+        result->max = 0;
+    }
+    return ESP_OK;
+}
+
+size_t sensor_store_rollup(const uint8_t mac[6], uint32_t sensor_id, sensor_store_rollup_t rollup,
+                           int64_t from, int64_t to, sensor_store_bucket_t *buckets, size_t max_num)
+{
+    size_t num = 0;
+
+    xSemaphoreTake(s_store_lock, portMAX_DELAY);
+    store_series_t *series = store_series_find(mac, sensor_id);
+    if (series)
+    {
+        const store_bucket_t *ring = rollup == SENSOR_STORE_ROLLUP_HOUR ? series->hours : series->minutes;
+        size_t ring_num = rollup == SENSOR_STORE_ROLLUP_HOUR ? CONFIG_SENSOR_STORE_HOUR_BUCKETS : CONFIG_SENSOR_STORE_MINUTE_BUCKETS;
+        int64_t period = rollup == SENSOR_STORE_ROLLUP_HOUR ? STORE_HOUR_MS : STORE_MINUTE_MS;
+        int32_t last = series->last_ts / period;
+
+        for (int32_t index = MAX(last - (int32_t)ring_num + 1, 0); index <= last && num < max_num; index++)
+        {
+            const store_bucket_t *bucket = &ring[index % ring_num];
+            int64_t start = (int64_t)index * period;
+            if (bucket->count == 0 || bucket->index != index || start + period <= from || start > to)
+            {
+                continue;
+            }
+            buckets[num].start = start;
+            buckets[num].count = bucket->count;
+            buckets[num].min = bucket->min;
+            buckets[num].max = bucket->max;
+            buckets[num].avg = bucket->sum / bucket->count;
+            num++;
+        }
+    }
+    xSemaphoreGive(s_store_lock);
+
+    return num;
+}
+
+esp_err_t sensor_store_init(void)
+{
+    if (s_store_lock)
+    {
+        return ESP_OK;
+    }
+
+    s_store_lock = xSemaphoreCreateMutex();
+    if (s_store_lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_SENSOR_STORE_SPILL
+    store_log_init();
+#endif
+    return ESP_OK;
+}
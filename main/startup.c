@@ -0,0 +1,130 @@
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "startup.h"
+#include "metrics.h"
+
+#define STARTUP_ALL_BITS (STARTUP_BIT(STARTUP_STAGE_MAX) - 1)
+
+static const char *TAG = "startup";
+
+static StaticEventGroup_t startup_group_buf;
+static EventGroupHandle_t startup_group = NULL;
+static portMUX_TYPE startup_lock = portMUX_INITIALIZER_UNLOCKED;
+static const startup_stage_desc_t *startup_stages = NULL;
+static int64_t startup_ready_us[STARTUP_STAGE_MAX];
+
+void startup_signal(startup_stage_t stage)
+{
+    int64_t now = esp_timer_get_time();
+    bool first = false;
+
+    portENTER_CRITICAL(&startup_lock);
+    if (startup_ready_us[stage] == 0)
+    {
+        startup_ready_us[stage] = now;
+        first = true;
+    }
+    portEXIT_CRITICAL(&startup_lock);
+
+    // Signals before startup_run() are only recorded, it picks them up
+    if (first && startup_group)
+    {
+        ESP_LOGI(TAG, "%s ready at %" PRId64 " ms", startup_stages[stage].name, now / 1000);
+        xEventGroupSetBits(startup_group, STARTUP_BIT(stage));
+    }
+}
+
+int64_t startup_ready_time(startup_stage_t stage)
+{
+    int64_t ready = startup_ready_us[stage];
+    return ready ? ready : -1;
+}
+
+static void startup_collect(metrics_writer_t *writer, void *arg)
+{
+    metrics_printf(writer, "# TYPE startup_stage_ready_ms gauge\n# HELP startup_stage_ready_ms Time since boot the startup stage got ready\n");
+    for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+    {
+        int64_t ready = startup_ready_time(i);
+        if (ready >= 0)
+        {
+            metrics_printf(writer, "startup_stage_ready_ms{stage=\"%s\"} %" PRId64 "\n", startup_stages[i].name, ready / 1000);
+        }
+    }
+}
+
+esp_err_t startup_run(const startup_stage_desc_t stages[STARTUP_STAGE_MAX])
+{
+    EventBits_t pending = 0;
+    EventBits_t failed = 0;
+
+    startup_stages = stages;
+    EventGroupHandle_t group = xEventGroupCreateStatic(&startup_group_buf);
+    portENTER_CRITICAL(&startup_lock);
+    startup_group = group;
+    portEXIT_CRITICAL(&startup_lock);
+    metrics_collector_register(startup_collect, NULL);
+
+    for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+    {
+        if (stages[i].start)
+        {
+            pending |= STARTUP_BIT(i);
+        }
+        if (startup_ready_us[i])
+        {
+            xEventGroupSetBits(group, STARTUP_BIT(i));
+        }
+    }
+
+    while (pending)
+    {
+        EventBits_t ready = xEventGroupGetBits(group);
+        bool progress = false;
+
+        for (int i = 0; i < STARTUP_STAGE_MAX; i++)
+        {
+            if (!(pending & STARTUP_BIT(i)))
+            {
+                continue;
+            }
+            if (stages[i].deps & failed)
+            {
+                ESP_LOGW(TAG, "%s skipped, a prerequisite failed", stages[i].name);
+                pending &= ~STARTUP_BIT(i);
+                failed |= STARTUP_BIT(i);
+                progress = true;
+                continue;
+            }
+            if ((ready & stages[i].deps) != stages[i].deps)
+            {
+                continue;
+            }
+
+            int64_t start = esp_timer_get_time();
+            esp_err_t ret = stages[i].start();
+            pending &= ~STARTUP_BIT(i);
+            progress = true;
+            if (ret != ESP_OK)
+            {
+                ESP_LOGE(TAG, "%s failed: %s", stages[i].name, esp_err_to_name(ret));
+                failed |= STARTUP_BIT(i);
+                continue;
+            }
+            ESP_LOGD(TAG, "%s started in %" PRId64 " us", stages[i].name, esp_timer_get_time() - start);
+            startup_signal(i);
+            ready = xEventGroupGetBits(group);
+        }
+
+        if (!progress)
+        {
+            // Block until a signaled stage gets ready
+            xEventGroupWaitBits(group, STARTUP_ALL_BITS & ~ready, pdFALSE, pdFALSE, portMAX_DELAY);
+        }
+    }
+
+    return failed ? ESP_FAIL : ESP_OK;
+}
@@ -0,0 +1,264 @@
+#include "tracing.h"
+
+#if CONFIG_APP_TRACE_ENABLE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#if !CONFIG_FREERTOS_UNICORE
+#include "esp_ipc.h"
+#endif
+
+#define TRACING_RING_MASK (CONFIG_APP_TRACE_RING_SIZE - 1)
+#define TRACING_CHUNK_SIZE 512
+#define TRACING_REORDER_CYCLES (1 << 20) /* Largest backward step between consecutive events of a core */
+
+_Static_assert((CONFIG_APP_TRACE_RING_SIZE & TRACING_RING_MASK) == 0, "CONFIG_APP_TRACE_RING_SIZE must be a power of two");
+
+static const char *TAG = "tracing";
+
+typedef struct
+{
+    _Atomic uint32_t seq; /* Index + 1 of the event in the slot, once it is completely written */
+    uint32_t cycles;
+    const char *name;
+    TaskHandle_t task;
+    uint32_t arg;
+    uint8_t phase;
+} tracing_event_t;
+
+typedef struct
+{
+    _Atomic uint32_t head;
+    tracing_event_t events[CONFIG_APP_TRACE_RING_SIZE];
+} tracing_ring_t;
+
+typedef struct
+{
+    uint32_t cycles;
+    int64_t time_us;
+} tracing_anchor_t;
+
+/* Event copied out of the ring for export */
+typedef struct
+{
+    int64_t cycles; /* Raw counter, then cycles before the anchor */
+    const char *name;
+    TaskHandle_t task;
+    uint32_t arg;
+    uint8_t phase;
+} tracing_sample_t;
+
+static tracing_ring_t tracing_rings[portNUM_PROCESSORS];
+
+void tracing_emit(const char *name, tracing_phase_t phase, uint32_t arg)
+{
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    tracing_ring_t *ring = &tracing_rings[xPortGetCoreID()];
+
+    // Tasks and ISRs preempting each other on this core each claim their own slot
+    uint32_t index = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    tracing_event_t *event = &ring->events[index & TRACING_RING_MASK];
+
+    atomic_store_explicit(&event->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    event->cycles = cycles;
+    event->name = name;
+    event->task = xTaskGetCurrentTaskHandle();
+    event->arg = arg;
+    event->phase = phase;
+    atomic_store_explicit(&event->seq, index + 1, memory_order_release);
+}
+
+static void tracing_anchor_cb(void *arg)
+{
+    tracing_anchor_t *anchor = (tracing_anchor_t *)arg;
+    anchor->time_us = esp_timer_get_time();
+    anchor->cycles = esp_cpu_get_cycle_count();
+}
+
+/* The cycle counters of the cores are not synchronized, each one is mapped to esp_timer on its own */
+static void tracing_anchor(int core, tracing_anchor_t *anchor)
+{
+#if !CONFIG_FREERTOS_UNICORE
+    if (core != xPortGetCoreID())
+    {
+        esp_ipc_call_blocking(core, tracing_anchor_cb, anchor);
+        return;
+    }
+#endif
+    tracing_anchor_cb(anchor);
+}
+
+/* Copies the completely written events of a ring, oldest first */
+static size_t tracing_snapshot(const tracing_ring_t *ring, tracing_sample_t *out)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t start = head > CONFIG_APP_TRACE_RING_SIZE ? head - CONFIG_APP_TRACE_RING_SIZE : 0;
+    size_t num = 0;
+
+    for (uint32_t index = start; index != head; index++)
+    {
+        const tracing_event_t *event = &ring->events[index & TRACING_RING_MASK];
+        if (atomic_load_explicit(&event->seq, memory_order_acquire) != index + 1)
+        {
+            continue;
+        }
+        out[num].cycles = event->cycles;
+        out[num].name = event->name;
+        out[num].task = event->task;
+        out[num].arg = event->arg;
+        out[num].phase = event->phase;
+        atomic_thread_fence(memory_order_acquire);
+        // Overwritten while copying
+        if (atomic_load_explicit(&event->seq, memory_order_relaxed) != index + 1)
+        {
+            continue;
+        }
+        num++;
+    }
+    return num;
+}
+
+typedef struct
+{
+    char buf[TRACING_CHUNK_SIZE];
+    size_t len;
+    tracing_flush_t flush;
+    void *ctx;
+    esp_err_t err;
+} tracing_writer_t;
+
+static void tracing_printf(tracing_writer_t *writer, const char *fmt, ...)
+{
+    for (int i = 0; i < 2 && writer->err == ESP_OK; i++)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(writer->buf + writer->len, sizeof(writer->buf) - writer->len, fmt, args);
+        va_end(args);
+
+        if (n >= 0 && (size_t)n < sizeof(writer->buf) - writer->len)
+        {
+            writer->len += n;
+            return;
+        }
+        if (n < 0 || writer->len == 0)
+        {
+            writer->err = ESP_FAIL;
+            return;
+        }
+        writer->err = writer->flush(writer->ctx, writer->buf, writer->len);
+        writer->len = 0;
+    }
+}
+
+static void tracing_export_task_names(tracing_writer_t *writer, bool *first)
+{
+#if configUSE_TRACE_FACILITY
+    UBaseType_t num = uxTaskGetNumberOfTasks();
+    TaskStatus_t *tasks = malloc(num * sizeof(TaskStatus_t));
+    if (!tasks)
+    {
+        return;
+    }
+    num = uxTaskGetSystemState(tasks, num, NULL);
+    for (UBaseType_t i = 0; i < num; i++)
+    {
+        tracing_printf(writer, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%" PRIuPTR ",\"args\":{\"name\":\"%s\"}}",
+                       *first ? "" : ",\n", (uintptr_t)tasks[i].xHandle, tasks[i].pcTaskName);
+        *first = false;
+    }
+    free(tasks);
+#endif
+}
+
+esp_err_t tracing_export_chrome(tracing_flush_t flush, void *ctx)
+{
+    tracing_writer_t *writer = calloc(1, sizeof(tracing_writer_t));
+    tracing_sample_t *events = malloc(CONFIG_APP_TRACE_RING_SIZE * sizeof(tracing_sample_t));
+    if (!writer || !events)
+    {
+        free(writer);
+        free(events);
+        return ESP_ERR_NO_MEM;
+    }
+    writer->flush = flush;
+    writer->ctx = ctx;
+
+    uint32_t ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+    bool first = true;
+
+    tracing_printf(writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    tracing_export_task_names(writer, &first);
+
+    for (int core = 0; core < portNUM_PROCESSORS && writer->err == ESP_OK; core++)
+    {
+        // Anchor after the snapshot, so that all copied events are older
+        size_t num = tracing_snapshot(&tracing_rings[core], events);
+        tracing_anchor_t anchor;
+        tracing_anchor(core, &anchor);
+
+        // Walk back from the anchor so that every wrap of the 32 bit counter is accounted for
+        int64_t delta = 0;
+        uint32_t later = anchor.cycles;
+        for (size_t i = num; i-- > 0;)
+        {
+            uint32_t cycles = events[i].cycles;
+            uint32_t diff = later - cycles;
+            // An ISR preempting between claiming a slot and reading the counter records a later time in an earlier slot
+            if (diff > UINT32_MAX - TRACING_REORDER_CYCLES)
+            {
+                delta -= (int64_t)(UINT32_MAX - diff) + 1;
+            }
+            else
+            {
+                delta += diff;
+            }
+            later = cycles;
+            events[i].cycles = delta;
+        }
+
+        for (size_t i = 0; i < num && writer->err == ESP_OK; i++)
+        {
+            int64_t ns = anchor.time_us * 1000 - (int64_t)(events[i].cycles * 1000 / ticks_per_us);
+            tracing_printf(writer, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRId64 ".%03d,\"pid\":0,\"tid\":%" PRIuPTR "%s",
+                           first ? "" : ",\n", events[i].name, events[i].phase, ns / 1000, (int)(ns % 1000),
+                           (uintptr_t)events[i].task, events[i].phase == TRACING_PHASE_INSTANT ? ",\"s\":\"t\"" : "");
+            if (events[i].phase == TRACING_PHASE_INSTANT)
+            {
+                tracing_printf(writer, ",\"args\":{\"arg\":%" PRIu32 ",\"core\":%d}}", events[i].arg, core);
+            }
+            else
+            {
+                tracing_printf(writer, ",\"args\":{\"core\":%d}}", core);
+            }
+            first = false;
+        }
+    }
+    tracing_printf(writer, "\n]}\n");
+    if (writer->err == ESP_OK && writer->len > 0)
+    {
+        writer->err = flush(ctx, writer->buf, writer->len);
+    }
+
+    esp_err_t ret = writer->err;
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Export failed: %s", esp_err_to_name(ret));
+    }
+    free(events);
+    free(writer);
+    return ret;
+}
+
+#endif